@@ -0,0 +1,103 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_OBJECT_RUNNER_H
+#define CLING_OBJECT_RUNNER_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+  class MemoryBuffer;
+  class RuntimeDyld;
+}
+
+namespace cling {
+  ///\brief Links and runs precompiled objects in this process, without the
+  /// interpreter and its C++ frontend: it is all of libclingExec.
+  ///
+  /// The objects are the ones the interpreter writes, through .export,
+  /// .package or to the cache of CLING_OBJECT_CACHE. They resolve to each
+  /// other, then to the process and the libraries loaded through
+  /// loadLibrary(). Their static initializers run when they are added; the
+  /// destructors they register with __cxa_atexit() run when the
+  /// ObjectRunner is destroyed.
+  ///
+  /// Objects needing the interpreter's runtime, e.g. gCling or the value
+  /// printing, fail to link unless a library provides it.
+  ///
+  class ObjectRunner {
+  public:
+    class MemoryManager;
+    class Resolver;
+
+  private:
+    std::unique_ptr<MemoryManager> m_MM;
+    std::unique_ptr<Resolver> m_Resolver;
+    std::unique_ptr<llvm::RuntimeDyld> m_Dyld;
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> m_Objects;
+
+    ///\brief The __dso_handle of the objects, which points to this.
+    ObjectRunner** m_DSOHandle;
+
+    ///\brief The destructors registered by the objects, in order.
+    std::vector<std::pair<void (*)(void*), void*>> m_AtExit;
+
+    ///\brief __cxa_atexit() for the objects, which pass m_DSOHandle.
+    static int AtExit(void (*Func)(void*), void* Arg, void* DSO);
+
+  public:
+    ObjectRunner();
+    ~ObjectRunner();
+
+    ///\brief Makes the symbols of the shared library Path available to the
+    /// objects added after.
+    bool loadLibrary(llvm::StringRef Path, std::string& Err);
+
+    ///\brief Links Object, then runs its static initializers.
+    ///\returns false if it cannot be loaded or has unresolved symbols.
+    bool addObject(std::unique_ptr<llvm::MemoryBuffer> Object,
+                   std::string& Err);
+
+    ///\brief Reads the object file Path and adds it.
+    bool addObjectFile(llvm::StringRef Path, std::string& Err);
+
+    ///\brief Adds the object of a package that Interpreter::exportPackage()
+    /// wrote, after loading the libraries it names; a library not found at
+    /// its path on the interpreter's host is searched by its file name.
+    ///\returns false if a symbol it needs is defined neither by the objects
+    /// added before, e.g. through the packages of earlier transactions, nor
+    /// by the libraries and the process; Err names them.
+    bool addPackage(std::unique_ptr<llvm::MemoryBuffer> Package,
+                    std::string& Err);
+
+    ///\brief Reads the package file Path and adds it.
+    bool addPackageFile(llvm::StringRef Path, std::string& Err);
+
+    ///\brief The address of the symbol of the objects with the linkage name
+    /// Name (mangled, but without the platform's global prefix), or nullptr.
+    void* getAddress(llvm::StringRef Name) const;
+
+    ///\brief The function with the linkage name Name, of type T, e.g.
+    /// `getFunction<int(int)>("_Z6squarei")`.
+    template <class T>
+    T* getFunction(llvm::StringRef Name) const {
+      return reinterpret_cast<T*>(getAddress(Name));
+    }
+
+    ///\brief Calls the function of type void() Name.
+    ///\returns false if the objects define no such function.
+    bool run(llvm::StringRef Name) const;
+  };
+} // end namespace cling
+
+#endif // CLING_OBJECT_RUNNER_H
@@ -14,6 +14,10 @@
 #include "cling/Interpreter/InterpreterCallbacks.h"
 
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <memory>
+#include <vector>
 
 namespace clang {
   class Decl;
@@ -23,6 +27,7 @@ namespace clang {
 }
 
 namespace cling {
+  class AutoloadIndex;
   class Interpreter;
   class Transaction;
 }
@@ -36,16 +41,40 @@ namespace cling {
     // The key is the Unique File ID obtained from the source manager.
     FwdDeclsMap m_Map;
     bool m_ShowSuggestions;
+
+    ///\brief The indexes of forward declarations, and which of their chunks
+    /// were declared already.
+    std::vector<std::unique_ptr<AutoloadIndex>> m_Indexes;
+    std::vector<std::vector<bool>> m_Declared;
+
+    ///\brief The unqualified names of what the indexes declare, including
+    /// their namespaces.
+    LookupNameFilter m_NameFilter;
+
+    ///\brief Set while declaring chunks; their lookups must not recurse.
+    bool m_IsDeclaring;
+
+    ///\brief Whether the header of an autoloaded class is #included once the
+    /// class needs to be complete, e.g. for a variable or a member access;
+    /// set by $CLING_AUTOLOAD_ON_COMPLETION.
+    bool m_IncludeOnCompletion;
   public:
-    AutoloadCallback(cling::Interpreter* interp, bool showSuggestions = true)
-      : InterpreterCallbacks(interp), m_ShowSuggestions(showSuggestions) { }
+    AutoloadCallback(cling::Interpreter* interp, bool showSuggestions = true);
     ~AutoloadCallback();
     using cling::InterpreterCallbacks::LookupObject;
     //^to get rid of bogus warning : "-Woverloaded-virtual"
     //virtual functions ARE meant to be overriden!
 
-//    bool LookupObject (clang::LookupResult &R, clang::Scope *);
+    bool LookupObject (clang::LookupResult &R, clang::Scope *S);
+    bool LookupObject (const clang::DeclContext* DC,
+                       clang::DeclarationName Name);
     bool LookupObject (clang::TagDecl* t);
+    const LookupNameFilter* getLookupNameFilter() const {
+      return &m_NameFilter;
+    }
+
+    ///\brief Declares what Index has for a name upon its first lookup.
+    void addIndex(std::unique_ptr<AutoloadIndex> Index);
 
     void InclusionDirective(clang::SourceLocation HashLoc,
                             const clang::Token &IncludeTok,
@@ -62,6 +91,25 @@ namespace cling {
   private:
     void report(clang::SourceLocation l, llvm::StringRef name,
                 llvm::StringRef header);
+
+    ///\brief Declares the chunks of the indexes for Key, and what they need.
+    ///\returns true if anything got declared.
+    bool declareFromIndexes(llvm::StringRef Key);
+
+    ///\brief Declares Code in the translation unit, amid a lookup.
+    bool declare(const std::string& Code);
+
+    ///\brief Makes Sema ask for the completion of the autoloaded tags in D,
+    /// or in the namespaces of D.
+    void markForCompletion(clang::Decl* D);
+
+    ///\brief #includes the header the annotation of t names, once.
+    ///\returns true if t got defined.
+    bool includeHeaderOf(clang::TagDecl* t);
+
+    ///\brief If D is a namespace the indexes have names in, makes lookups
+    /// into it consult them; then does the same for the namespaces in D.
+    void markIndexedNamespaces(clang::Decl* D);
   };
 } // end namespace cling
 
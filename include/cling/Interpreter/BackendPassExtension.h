@@ -0,0 +1,72 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_BACKEND_PASS_EXTENSION_H
+#define CLING_BACKEND_PASS_EXTENSION_H
+
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+
+#include <functional>
+
+namespace cling {
+
+  ///\brief Adds passes to the optimization pipeline of the JITted code, like
+  /// an extension of the llvm::PassManagerBuilder: the builder tells the
+  /// opt level of the pipeline. It might be called on other threads, when
+  /// modules get optimized in the background.
+  ///
+  typedef std::function<void(const llvm::PassManagerBuilder&,
+                             llvm::legacy::PassManagerBase&)>
+    BackendPassExtension;
+
+  ///\brief The OptLevels of registerBackendPassExtension() for all levels.
+  enum : unsigned { kAllOptLevels = 0xf };
+
+  ///\brief Registers passes to add to the JIT's pipelines, e.g. from a plugin
+  /// loaded with -fplugin. The pipelines built before get rebuilt with them.
+  /// The extensions of the new pass manager, which has no extension points
+  /// of the PassManagerBuilder, are not supported.
+  ///
+  ///\param [in] EP - Where in the pipeline to add the passes.
+  ///\param [in] Extension - What adds the passes.
+  ///\param [in] OptLevels - The opt levels whose pipelines get the passes,
+  ///   as a mask of (1 << OptLevel).
+  ///\returns The ID of the extension, for unregisterBackendPassExtension().
+  ///
+  unsigned
+  registerBackendPassExtension(llvm::PassManagerBuilder::ExtensionPointTy EP,
+                               BackendPassExtension Extension,
+                               unsigned OptLevels = kAllOptLevels);
+
+  ///\brief Removes the extension ID from the JIT's pipelines, e.g. before
+  /// the plugin that registered it gets unloaded.
+  ///
+  void unregisterBackendPassExtension(unsigned ID);
+
+  ///\brief Registers an extension for the lifetime of the object, e.g. as a
+  /// static object of a plugin, like llvm::RegisterStandardPasses.
+  ///
+  class RegisterBackendPassExtension {
+    unsigned m_ID;
+
+  public:
+    RegisterBackendPassExtension(llvm::PassManagerBuilder::ExtensionPointTy EP,
+                                 BackendPassExtension Extension,
+                                 unsigned OptLevels = kAllOptLevels)
+      : m_ID(registerBackendPassExtension(EP, std::move(Extension),
+                                          OptLevels)) {}
+    ~RegisterBackendPassExtension() { unregisterBackendPassExtension(m_ID); }
+
+    RegisterBackendPassExtension(const RegisterBackendPassExtension&) = delete;
+    RegisterBackendPassExtension&
+    operator=(const RegisterBackendPassExtension&) = delete;
+  };
+
+} // namespace cling
+
+#endif // CLING_BACKEND_PASS_EXTENSION_H
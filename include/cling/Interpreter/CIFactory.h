@@ -45,6 +45,30 @@ namespace cling {
              const char* LLVMDir, std::unique_ptr<clang::ASTConsumer> consumer,
              const ModuleFileExtensions& moduleExtensions,
              bool OnlyLex = false);
+
+    ///\brief The file in a prebuilt module path that records the
+    /// fingerprint its modules were built with, see
+    /// tools/prebuild-modules. Paths with a stamp that does not match are
+    /// ignored: their modules would be rebuilt upon the first import.
+    extern const char* const PrebuiltModulesStampName;
+
+    ///\brief The name of the file in a prebuilt module path that tells
+    /// which of its modules declares which name, see
+    /// Interpreter::writeModuleIndex().
+    extern const char* const PrebuiltModuleIndexName;
+
+    ///\brief Hashes what the prebuilt modules of CI depend on, besides the
+    /// headers that clang checks when loading them.
+    std::string
+    getPrebuiltModulesFingerprint(const clang::CompilerInstance& CI);
+
+    ///\returns false if Dir has no stamp.
+    bool readPrebuiltModulesStamp(llvm::StringRef Dir,
+                                  std::string& Fingerprint);
+
+    ///\returns false if the stamp could not be written.
+    bool writePrebuiltModulesStamp(llvm::StringRef Dir,
+                                   llvm::StringRef Fingerprint);
   } // namespace CIFactory
 } // namespace cling
 #endif // CLING_CIFACTORY_H
@@ -0,0 +1,120 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_CALL_WRAPPER_H
+#define CLING_CALL_WRAPPER_H
+
+#include <memory>
+#include <utility>
+
+namespace cling {
+
+  ///\brief Calls an interpreted function, see Interpreter::getCallWrapper().
+  ///
+  ///\param[in] obj - The object a non-static member function is called on,
+  ///   otherwise ignored.
+  ///\param[in] args - The addresses of the arguments, one for each parameter
+  ///   of the function: of the object a reference parameter binds to, or of
+  ///   the object a parameter taken by value is copied from.
+  ///\param[in] ret - Unless the function returns void or is null: where to
+  ///   construct the returned object or, for a returned reference, where to
+  ///   store the address of the referenced object.
+  ///
+  using CallWrapper_t = void (*)(void* obj, void** args, void* ret);
+
+  namespace internal {
+    ///\brief The host compiler's spelling of T, within the name of this
+    /// function; see Interpreter::getFunction().
+    template <class T>
+    const char* spellType() {
+#if defined(_MSC_VER) && !defined(__clang__)
+      return __FUNCSIG__;
+#else
+      return __PRETTY_FUNCTION__;
+#endif
+    }
+
+    template <class T>
+    void* argAddress(T& Arg) {
+      return const_cast<void*>(static_cast<const void*>(std::addressof(Arg)));
+    }
+
+    ///\brief Calls a CallWrapper_t and returns what it constructed.
+    template <class R>
+    struct CallResult {
+      static R call(CallWrapper_t Wrapper, void** Args) {
+        alignas(R) unsigned char Storage[sizeof(R)];
+        Wrapper(nullptr, Args, Storage);
+        R* Result = reinterpret_cast<R*>(Storage);
+        R Ret(std::move(*Result));
+        Result->~R();
+        return Ret;
+      }
+    };
+
+    template <class R>
+    struct CallResult<R&> {
+      static R& call(CallWrapper_t Wrapper, void** Args) {
+        R* Result = nullptr;
+        Wrapper(nullptr, Args, &Result);
+        return *Result;
+      }
+    };
+
+    template <class R>
+    struct CallResult<R&&> {
+      static R&& call(CallWrapper_t Wrapper, void** Args) {
+        R* Result = nullptr;
+        Wrapper(nullptr, Args, &Result);
+        return static_cast<R&&>(*Result);
+      }
+    };
+
+    template <>
+    struct CallResult<void> {
+      static void call(CallWrapper_t Wrapper, void** Args) {
+        Wrapper(nullptr, Args, nullptr);
+      }
+    };
+  } // end namespace internal
+
+  template <class Signature> class Function;
+
+  ///\brief An interpreted function of the signature R(Args...), see
+  /// Interpreter::getFunction(). Calls go straight to the compiled function
+  /// where its address is known, otherwise through its CallWrapper_t.
+  ///
+  /// A Function is invalidated by unloading the function or its wrapper.
+  ///
+  template <class R, class... Args>
+  class Function<R(Args...)> {
+  private:
+    CallWrapper_t m_Wrapper = nullptr;
+    R (*m_Address)(Args...) = nullptr;
+
+  public:
+    Function() = default;
+    Function(CallWrapper_t Wrapper, void* Address):
+      m_Wrapper(Wrapper), m_Address((R (*)(Args...))Address) {}
+
+    ///\brief Whether the function was found and compiled.
+    explicit operator bool() const { return m_Wrapper; }
+
+    CallWrapper_t getWrapper() const { return m_Wrapper; }
+
+    R operator()(Args... args) const {
+      if (m_Address)
+        return m_Address(std::forward<Args>(args)...);
+      // The leading element keeps the array valid without arguments.
+      void* ArgAddresses[] = {nullptr, internal::argAddress(args)...};
+      return internal::CallResult<R>::call(m_Wrapper, ArgAddresses + 1);
+    }
+  };
+} // end namespace cling
+
+#endif // CLING_CALL_WRAPPER_H
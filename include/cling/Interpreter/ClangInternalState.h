@@ -12,6 +12,7 @@
 
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MD5.h"
 
 #include <memory>
 #include <string>
@@ -25,7 +26,6 @@ namespace clang {
 
 namespace llvm {
   class Module;
-  class raw_fd_ostream;
   class raw_ostream;
 }
 
@@ -35,17 +35,28 @@ namespace cling {
   /// 'after' an event happened.
   ///
   class ClangInternalState {
+  public:
+    ///\brief What is stored of the compiler, in the order it is compared.
+    ///
+    enum Category {
+      kLookupTables,
+      kIncludedFiles,
+      kAST,
+      kLLVMModule,
+      kMacros,
+      kNumCategories
+    };
+
   private:
-    std::string m_LookupTablesFile;
-    std::string m_IncludedFilesFile;
-    std::string m_ASTFile;
-    std::string m_LLVMModuleFile;
-    std::string m_MacrosFile;
+    ///\brief The printout of each category, and its hash: equal states are
+    /// told apart without looking at the contents.
+    ///
+    std::string m_Contents[kNumCategories];
+    llvm::MD5::MD5Result m_Hashes[kNumCategories];
     const clang::ASTContext& m_ASTContext;
     const clang::Preprocessor& m_Preprocessor;
     clang::CodeGenerator* m_CodeGen;
     const llvm::Module* m_Module;
-    const std::string m_DiffCommand;
     const std::string m_Name;
     ///\brief Takes the ownership after compare was made.
     ///
@@ -61,7 +72,7 @@ namespace cling {
     ///
     const std::string& getName() const { return m_Name; }
 
-    ///\brief Stores all internal structures of the compiler into a stream.
+    ///\brief Prints and hashes all internal structures of the compiler.
     ///
     void store();
 
@@ -69,15 +80,16 @@ namespace cling {
     ///
     void compare(const std::string& Name, bool Verbose);
 
-    ///\brief Runs diff on two files.
-    ///\param[in] file1 - A file to diff
-    ///\param[in] file2 - A file to diff
+    ///\brief Diffs the contents of a category with those of another state.
+    ///\param[in] C - The category to diff
+    ///\param[in] Other - The state to diff with
     ///\param[in] type - The type/name of the differences to print.
     ///\param[in] verbose - Verbose output.
-    ///\param[in] ignores - A list of differences to ignore.
+    ///\param[in] ignores - A list of differences to ignore: changes of lines
+    /// that all contain one of these literals or regular expressions.
     ///\returns true if there is difference in the contents.
     ///
-    bool differentContent(const std::string& file1, const std::string& file2,
+    bool differentContent(Category C, const ClangInternalState& Other,
                           const char* type = nullptr, bool verbose = false,
                const llvm::SmallVectorImpl<llvm::StringRef>* ignores = 0) const;
 
@@ -93,10 +105,6 @@ namespace cling {
                                 clang::CodeGenerator& CG);
     static void printMacroDefinitions(llvm::raw_ostream& Out,
                                       const clang::Preprocessor& PP);
-  private:
-    llvm::raw_fd_ostream* createOutputFile(llvm::StringRef OutFile,
-                                           std::string* TempPathName = 0,
-                                           bool RemoveFileOnSignal = true);
   };
 } // end namespace cling
 #endif // CLING_CLANG_INTERNAL_STATE_H
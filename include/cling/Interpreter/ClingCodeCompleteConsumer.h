@@ -21,13 +21,18 @@ namespace cling {
     CodeCompletionTUInfo m_CCTUInfo;
     /// \ brief Results of the completer to be printed by the text interface.
     std::vector<std::string> &m_Completions;
+    /// \brief If set, receives the name each completion is filtered by.
+    std::vector<std::string> *m_Names;
+
+    std::string getFilterName(const CodeCompletionResult &Result) const;
 
   public:
     ClingCodeCompleteConsumer(const CodeCompleteOptions &CodeComplOpts,
-                              std::vector<std::string> &completions)
+                              std::vector<std::string> &completions,
+                              std::vector<std::string> *names = nullptr)
       : CodeCompleteConsumer(CodeComplOpts),
         m_CCTUInfo(std::make_shared<GlobalCodeCompletionAllocator>()),
-        m_Completions(completions) {}
+        m_Completions(completions), m_Names(names) {}
     ~ClingCodeCompleteConsumer() {}
 
     /// \brief Prints the finalized code-completion results.
@@ -70,12 +70,45 @@ namespace cling {
     ///\brief Optimization level.
     unsigned OptLevel : 2;
 
+    ///\brief Let the executor pick the optimization level of the module from
+    /// its IR, see BackendPasses::selectOptLevel(); OptLevel is the default.
+    ///
+    unsigned AutoOptLevel : 1;
+
+    ///\brief The input is null-terminated, ends in a newline and stays valid
+    /// until its transaction is unloaded: the SourceManager refers to it
+    /// instead of a copy.
+    ///
+    unsigned CallerOwnedInput : 1;
+
+    ///\brief Compile the functions that only call what does not throw as
+    /// nounwind and without unwind tables, see
+    /// RuntimeOptions::NoUnwindWrappers.
+    ///
+    unsigned InferNoUnwind : 1;
+
+    ///\brief Route the calls to the functions defined through stubs that
+    /// Interpreter::reloadFile() re-points to their new bodies; the
+    /// functions defined again replace those.
+    ///
+    unsigned Reloadable : 1;
+
+    ///\brief Compile the floating point math as with -ffast-math. Only the
+    /// CUDA device compiler honors it, see `#pragma cling cuda fast_math`.
+    ///
+    unsigned FastMath : 1;
+
     ///\brief Offset into the input line to enable the setting of the
     /// code completion point.
     /// -1 diasables code completion.
     ///
     int CodeCompletionOffset = -1;
 
+    ///\brief The milliseconds the optimization of the module may take; the
+    /// functions not optimized by then are emitted at O0. 0: no limit.
+    ///
+    unsigned CompileBudgetMs = 0;
+
     CompilationOptions() {
       DeclarationExtraction = 0;
       EnableShadowing = 0;
@@ -87,7 +120,12 @@ namespace cling {
       CodeGenerationForModule = 0;
       IgnorePromptDiags = 0;
       OptLevel = 2;
+      AutoOptLevel = 0;
       CheckPointerValidity = 1;
+      CallerOwnedInput = 0;
+      InferNoUnwind = 0;
+      Reloadable = 0;
+      FastMath = 0;
     }
 
     bool operator==(CompilationOptions Other) const {
@@ -103,7 +141,13 @@ namespace cling {
         IgnorePromptDiags     == Other.IgnorePromptDiags &&
         CheckPointerValidity  == Other.CheckPointerValidity &&
         OptLevel              == Other.OptLevel &&
-        CodeCompletionOffset  == Other.CodeCompletionOffset;
+        AutoOptLevel          == Other.AutoOptLevel &&
+        CallerOwnedInput      == Other.CallerOwnedInput &&
+        InferNoUnwind         == Other.InferNoUnwind &&
+        Reloadable            == Other.Reloadable &&
+        FastMath              == Other.FastMath &&
+        CodeCompletionOffset  == Other.CodeCompletionOffset &&
+        CompileBudgetMs       == Other.CompileBudgetMs;
     }
 
     bool operator!=(CompilationOptions Other) const {
@@ -119,7 +163,13 @@ namespace cling {
         IgnorePromptDiags     != Other.IgnorePromptDiags ||
         CheckPointerValidity  != Other.CheckPointerValidity ||
         OptLevel              != Other.OptLevel ||
-        CodeCompletionOffset  != Other.CodeCompletionOffset;
+        AutoOptLevel          != Other.AutoOptLevel ||
+        CallerOwnedInput      != Other.CallerOwnedInput ||
+        InferNoUnwind         != Other.InferNoUnwind ||
+        Reloadable            != Other.Reloadable ||
+        FastMath              != Other.FastMath ||
+        CodeCompletionOffset  != Other.CodeCompletionOffset ||
+        CompileBudgetMs       != Other.CompileBudgetMs;
     }
   };
 } // end namespace cling
@@ -54,6 +54,21 @@ namespace runtime {
       /// before evaluation. To be used only at runtime.
       ///
       const char* getExpr();
+
+      ///\brief Like getExpr(), but reads the address of the i-th variable
+      /// from Slots[i] when evaluated, such that the compiled expression can
+      /// be reused for other addresses, see bind().
+      ///
+      std::string getExprReadingFrom(void* const* Slots) const;
+
+      ///\brief Returns the number of variable addresses in the template.
+      ///
+      unsigned getNumAddresses() const;
+
+      ///\brief Stores the addresses of this evaluation's variables in Slots.
+      ///
+      void bind(void** Slots) const;
+
       bool isValuePrinterRequested() { return m_ValuePrinterReq; }
       const char* getTemplate() const { return m_Template; }
     };
@@ -10,13 +10,22 @@
 #ifndef CLING_DYNAMIC_LIBRARY_MANAGER_H
 #define CLING_DYNAMIC_LIBRARY_MANAGER_H
 
+#include "cling/Utils/Paths.h"
+
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/StringSet.h"
 
+#include "llvm/Support/Chrono.h"
 #include "llvm/Support/Path.h"
 
+#include <future>
+#include <string>
+#include <utility>
+#include <vector>
+
 namespace cling {
   class Dyld;
   class InterpreterCallbacks;
@@ -58,14 +67,91 @@ namespace cling {
     DyLibs m_DyLibs;
     llvm::StringSet<> m_LoadedLibraries;
 
+    ///\brief A load of loadLibraryAsync(), for joinPendingLoads() to
+    /// complete.
+    ///
+    struct PendingLoad {
+      std::string Path;
+      std::string LibStem;
+      bool Permanent;
+      bool Resolved;
+      ///\brief The handle, or null and the error message.
+      std::shared_future<std::pair<DyLibHandle, std::string>> Result;
+    };
+    std::vector<PendingLoad> m_PendingLoads;
+
+    ///\brief Records the library at Path that DLOpen() opened as Handle,
+    /// or reports ErrMsg if it could not; see loadLibrary().
+    ///
+    LoadLibResult completeLoad(const std::string& Path,
+                               const std::string& LibStem, bool Permanent,
+                               bool Resolved, DyLibHandle Handle,
+                               const std::string& ErrMsg);
+
     ///\brief System's include path, get initialized at construction time.
     ///
     SearchPathInfos m_SearchPaths;
 
+    ///\brief The directories of m_SearchPaths, for addSearchPath() to skip
+    /// duplicates.
+    ///
+    utils::PathSet m_SearchPathSet;
+
     InterpreterCallbacks* m_Callbacks = nullptr;
 
     Dyld* m_Dyld = nullptr;
 
+    ///\brief Incremented whenever the symbols that can be found may have
+    /// changed, i.e. upon loading or unloading a library or adding a path.
+    ///
+    unsigned m_Generation = 0;
+
+    ///\brief The number of libraries unloaded, see getNumUnloads().
+    ///
+    unsigned m_NumUnloads = 0;
+
+    ///\brief The symbols that searchLibrariesForSymbol() did not find since
+    /// the last change, mapped to whether the system libraries were searched.
+    ///
+    mutable llvm::StringMap<bool> m_MissingSymbols;
+
+    void invalidateSymbolSearches() {
+      ++m_Generation;
+      m_MissingSymbols.clear();
+    }
+
+    ///\brief Keeps the libraries that m_Dyld searches in line with the
+    /// search path Info just added, without rescanning the others.
+    ///
+    void updateDyld(const SearchPathInfo& Info, bool Prepend);
+
+    ///\brief Takes the library at Path out of the libraries that m_Dyld
+    /// searches once Loaded, or puts it back once unloaded.
+    ///
+    void updateDyld(llvm::StringRef Path, bool Loaded);
+
+    ///\brief The entries of a search path, sparing a file system probe per
+    /// name variant and path in lookupLibrary().
+    ///
+    struct DirListing {
+      /// The modification time of the directory when it was listed.
+      llvm::sys::TimePoint<> ModTime;
+      /// The lookupLibrary() call that last compared ModTime.
+      unsigned Epoch = 0;
+      /// Whether Names holds all entries of the directory.
+      bool Valid = false;
+      llvm::StringSet<> Names;
+    };
+    mutable llvm::StringMap<DirListing> m_DirListings;
+    mutable unsigned m_LookupEpoch = 0;
+
+    ///\brief Checks the listing of the search path Dir, updating it once per
+    /// lookupLibrary() call if the directory was modified.
+    ///
+    ///\returns false if Dir certainly has no entry Name.
+    ///
+    bool mayContain(llvm::StringRef Dir, llvm::StringRef Name) const;
+
     ///\brief Concatenates current include paths and the system include paths
     /// and performs a lookup for the filename.
     ///\param[in] libStem - The filename being looked up
@@ -85,11 +171,12 @@ namespace cling {
     ///
     std::string lookupLibMaybeAddExt(llvm::StringRef filename) const;
 
+  public:
     /// On a success returns to full path to a shared object that holds the
     /// symbol pointed by func.
     ///
     static std::string getSymbolLocation(void* func);
-  public:
+
     DynamicLibraryManager();
     ~DynamicLibraryManager();
     DynamicLibraryManager(const DynamicLibraryManager&) = delete;
@@ -107,11 +194,21 @@ namespace cling {
        return m_SearchPaths;
     }
 
+    ///\brief Adds a library search path, unless it names a directory
+    /// already searched; prepending such a path moves it to the front.
+    ///
     void addSearchPath(llvm::StringRef dir, bool isUser = true,
-                       bool prepend = false) {
-      auto pos = prepend ? m_SearchPaths.begin() : m_SearchPaths.end();
-      m_SearchPaths.insert(pos, SearchPathInfo{dir, isUser});
-    }
+                       bool prepend = false);
+
+    ///\brief Returns a number that changes whenever a symbol lookup that
+    /// failed might succeed, for clients caching failed lookups.
+    ///
+    unsigned getGeneration() const { return m_Generation; }
+
+    ///\brief Returns a number that changes whenever a library got unloaded,
+    /// for clients caching the addresses of the symbols found.
+    ///
+    unsigned getNumUnloads() const { return m_NumUnloads; }
 
     ///\brief Looks up a library taking into account the current include paths
     /// and the system include paths.
@@ -135,6 +232,37 @@ namespace cling {
     LoadLibResult loadLibrary(const std::string& libStem, bool permanent,
                               bool resolved = false);
 
+    ///\brief Starts loading a shared library on a thread of its own, after
+    /// the loads started before: its relocations and static constructors
+    /// run while the caller goes on, e.g. parsing the library's headers.
+    /// The load completes, as loadLibrary() would do it, in
+    /// joinPendingLoads(). Its static constructors must not use the
+    /// interpreter.
+    ///
+    ///\returns kLoadLibSuccess if the load started; an error shows once it
+    /// is joined. Otherwise as loadLibrary().
+    ///
+    LoadLibResult loadLibraryAsync(const std::string& libStem, bool permanent,
+                                   bool resolved = false);
+
+    ///\brief Waits for the loads of loadLibraryAsync() and completes them.
+    /// Done before a module is handed to the JIT, which might need their
+    /// symbols, and before any other library is loaded or unloaded.
+    ///
+    ///\returns false if one of them failed; the error was reported.
+    ///
+    bool joinPendingLoads();
+
+    ///\brief Whether loads of loadLibraryAsync() are waiting to be joined.
+    ///
+    bool hasPendingLoads() const { return !m_PendingLoads.empty(); }
+
+    ///\brief Goes on in a child that fork() made of the process, without the
+    /// threads that scan the libraries in the parent. There must be no
+    /// pending loads.
+    ///
+    void onForked();
+
     void unloadLibrary(llvm::StringRef libStem);
 
     ///\brief Returns true if the file was a dynamic library and it was already
@@ -161,6 +289,18 @@ namespace cling {
     std::string searchLibrariesForSymbol(const std::string& mangledName,
                                          bool searchSystem = true) const;
 
+    /// Find the first not-yet-loaded shared object of each symbol, in one
+    /// pass over the libraries for all of them.
+    ///
+    ///\param[in] mangledNames - the mangled names to look for.
+    ///\param[in] searchSystem - whether to decend into system libraries.
+    ///
+    ///\returns the library name of each symbol, or an empty string.
+    ///
+    std::vector<std::string>
+    searchLibrariesForSymbols(llvm::ArrayRef<std::string> mangledNames,
+                              bool searchSystem = true) const;
+
     void dump(llvm::raw_ostream* S = nullptr) const;
 
     /// On a success returns to full path to a shared object that holds the
@@ -28,7 +28,8 @@ namespace runtime {
   /// and runtime bindings. These builtins should be used for other purposes.
   namespace internal {
     /// \brief Outlined Evaluate() implementation to not include Interpreter.h
-    /// into the runtime.
+    /// into the runtime. Evaluates in Interpreter::getCurrent(), the one
+    /// running the calling thread's code; in interp if there is none.
     CLING_LIB_EXPORT
     Value EvaluateDynamicExpression(Interpreter* interp, DynamicExprInfo* DEI,
                                     clang::DeclContext* DC);
@@ -10,6 +10,7 @@
 #ifndef CLING_RUNTIME_EXCEPTION_H
 #define CLING_RUNTIME_EXCEPTION_H
 
+#include <cstdint>
 #include <stdexcept>
 
 namespace clang {
@@ -49,6 +50,22 @@ namespace cling {
     bool diagnose() const override;
   };
 
+  ///\brief Exception that is thrown out of the JITted code that went beyond
+  /// one of the ExecutionLimits of its interpreter.
+  ///
+  class ExecutionLimitException : public InterpreterException {
+  public:
+    enum LimitKind {WALL_TIME, CPU_TIME, HEAP};
+  private:
+    const LimitKind m_Kind;
+  public:
+    ///\param Limit - the limit, in milliseconds or bytes.
+    ExecutionLimitException(LimitKind Kind, uint64_t Limit);
+    ~ExecutionLimitException() noexcept;
+
+    LimitKind getKind() const { return m_Kind; }
+  };
+
   ///\brief Exception that pulls cling out of runtime-compilation (llvm + clang)
   ///       errors.
   ///
@@ -0,0 +1,66 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_EXECUTION_COUNTERS_H
+#define CLING_EXECUTION_COUNTERS_H
+
+#include <cstdint>
+
+namespace cling {
+
+  ///\brief CPU time and hardware events of running the wrappers of inputs,
+  /// accumulated by the interpreter once Interpreter::enableExecutionCounters()
+  /// was called.
+  ///
+  /// The hardware events are those of the thread running the wrappers,
+  /// counted in user space through perf_event_open(); they are missing where
+  /// that is unavailable or not permitted, see hasEvent().
+  ///
+  class ExecutionCounters {
+  public:
+    enum Event {
+      kCycles,       ///< CPU cycles.
+      kInstructions, ///< Retired instructions.
+      kCacheMisses,  ///< Last level cache misses.
+      kNumEvents
+    };
+
+  private:
+    ///\brief User and system CPU time of the process, in nanoseconds.
+    uint64_t m_CPUNanoseconds = 0;
+    uint64_t m_Events[kNumEvents] = {};
+
+    ///\brief Bit (1 << Event) is set for the events that are counted.
+    unsigned m_Available = 0;
+
+  public:
+    uint64_t getCPUNanoseconds() const { return m_CPUNanoseconds; }
+    void addCPUNanoseconds(uint64_t NS) { m_CPUNanoseconds += NS; }
+
+    bool hasEvent(Event E) const { return m_Available & (1u << E); }
+    uint64_t getEvent(Event E) const { return m_Events[E]; }
+    void addEvent(Event E, uint64_t N) {
+      m_Events[E] += N;
+      m_Available |= 1u << E;
+    }
+
+    ///\brief The counts since Before, a copy taken earlier.
+    ExecutionCounters operator-(const ExecutionCounters& Before) const {
+      ExecutionCounters Diff(*this);
+      Diff.m_CPUNanoseconds -= Before.m_CPUNanoseconds;
+      for (unsigned I = 0; I < kNumEvents; ++I)
+        Diff.m_Events[I] -= Before.m_Events[I];
+      return Diff;
+    }
+
+    ///\brief The name of an event, e.g. "cache-misses".
+    static const char* getEventName(Event E);
+  };
+} // end namespace cling
+
+#endif // CLING_EXECUTION_COUNTERS_H
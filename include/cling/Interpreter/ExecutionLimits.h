@@ -0,0 +1,40 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_EXECUTION_LIMITS_H
+#define CLING_EXECUTION_LIMITS_H
+
+#include <cstdint>
+
+namespace cling {
+  ///\brief The resources that the JITted code of an interpreter may use, see
+  /// Interpreter::setExecutionLimits(); 0 for no limit. Going beyond one
+  /// throws an ExecutionLimitException out of the code.
+  ///
+  /// The time limits are checked by a watchdog thread, and enforced at the
+  /// safe points that the code compiled under a limit gets on the back-edges
+  /// of its loops: code in libraries, or in functions that cannot throw,
+  /// runs to its end. The heap limit counts what the JITted code linked
+  /// under it allocates minus what it frees through malloc, calloc, realloc,
+  /// free and the global operators new and delete; operator new throws right
+  /// away, the other functions leave it to the next safe point.
+  ///
+  struct ExecutionLimits {
+    ///\brief The milliseconds each input or static initializer may run.
+    unsigned WallMs = 0;
+    ///\brief The milliseconds of CPU time of its thread each input or static
+    /// initializer may take; not available on all platforms.
+    unsigned CpuMs = 0;
+    ///\brief The bytes of heap that the code may have allocated.
+    uint64_t HeapBytes = 0;
+
+    bool any() const { return WallMs || CpuMs || HeapBytes; }
+  };
+} // end namespace cling
+
+#endif // CLING_EXECUTION_LIMITS_H
@@ -0,0 +1,82 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_HEAP_REPORT_H
+#define CLING_HEAP_REPORT_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace llvm {
+  class raw_ostream;
+}
+
+namespace cling {
+  class Transaction;
+
+  ///\brief Heap memory that the JITted code allocated and did not free yet.
+  struct HeapUsage {
+    size_t Bytes = 0;
+    size_t Allocations = 0;
+
+    HeapUsage& operator+=(const HeapUsage& Other) {
+      Bytes += Other.Bytes;
+      Allocations += Other.Allocations;
+      return *this;
+    }
+  };
+
+  ///\brief The live heap allocations of the JITted code, by the transaction
+  /// and the function that made them; see Interpreter::getHeapReport().
+  ///
+  /// Only the sessions started with CLING_HEAP_PROFILE set track them: the
+  /// JIT then links the calls of the JITted code to malloc, calloc, realloc,
+  /// free and the global operators new and delete to hooks that record each
+  /// allocation with its caller. Memory allocated by the JITted code and
+  /// freed by compiled code, e.g. inside a library, is not seen being freed
+  /// and stays in the report.
+  ///
+  class HeapReport {
+  public:
+    struct Function {
+      ///\brief Demangled, if possible.
+      std::string Name;
+      HeapUsage Usage;
+    };
+
+    struct Entry {
+      const Transaction* T;
+      ///\brief The position of T among the committed top-level
+      /// transactions, from 1.
+      size_t Index;
+      ///\brief Including the nested transactions of T.
+      HeapUsage Usage;
+      ///\brief The functions of T that allocated, by decreasing bytes.
+      std::vector<Function> Functions;
+    };
+
+    ///\brief Whether the allocations are tracked at all.
+    bool Enabled = false;
+
+    ///\brief The transactions with live allocations, in order.
+    std::vector<Entry> Transactions;
+
+    ///\brief The allocations of code that no live transaction owns, e.g.
+    /// code that got unloaded or compiled upon its first call.
+    HeapUsage Unattributed;
+
+    HeapUsage getTotal() const;
+
+    ///\brief Prints one line per transaction and one per function below it,
+    /// then the unattributed allocations and the total.
+    void print(llvm::raw_ostream& Out) const;
+  };
+} // end namespace cling
+
+#endif // CLING_HEAP_REPORT_H
@@ -12,8 +12,12 @@
 
 #include "clang/Basic/CodeGenOptions.h"
 #include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/Triple.h"
 
+#include <cstdint>
+#include <deque>
+#include <future>
 #include <string>
 #include <vector>
 
@@ -30,6 +34,8 @@ namespace clang {
 } // namespace clang
 
 namespace llvm {
+  class Module;
+  class raw_ostream;
   class StringRef;
 }
 
@@ -40,13 +46,47 @@ namespace cling {
   /// second interpreter instance.
   ///
   class IncrementalCUDADeviceCompiler {
+  public:
+    ///\brief Where the time of compiling and running the device code of an
+    /// input goes; see printStats().
+    struct InputStats {
+      ///\brief The beginning of the input.
+      std::string Label;
+      ///\brief Parsing and CodeGen in the PTX interpreter.
+      uint64_t PTXInterpNs = 0;
+      ///\brief The NVPTX backend; zero if all PTX code was cached.
+      uint64_t NVPTXNs = 0;
+      ///\brief Assembling and writing the fatbinary.
+      uint64_t FatbinNs = 0;
+      ///\brief The host waiting for the device compilation to finish.
+      uint64_t HostWaitNs = 0;
+      ///\brief The static initializers of the host module, which register
+      /// the fatbinary.
+      uint64_t RegistrationNs = 0;
+      ///\brief The GPU time of running the wrapper, if kernel timing is
+      /// enabled; see enableKernelTiming().
+      uint64_t KernelNs = 0;
+      ///\brief The size of the fatbinary written; zero if the file was up to
+      /// date.
+      uint64_t FatbinSize = 0;
+      ///\brief The architectures compiled by the NVPTX backend.
+      unsigned CompiledArchs = 0;
+    };
 
+    ///\brief Records the GPU time between a start (Stop == 0) and a stop
+    /// call; returns the milliseconds upon stop, negative on failure.
+    typedef float (*KernelTimer)(int Stop);
+
+  private:
     ///\brief Contains the arguments for cling nvptx and flags for fatbinary
     /// generation
     struct CUDACompilerArgs {
       const std::string cppStdVersion;
       ///\brief contains information about host architecture
       const llvm::Triple hostTriple;
+      ///\brief The SM versions of the fatbinary, in ascending order.
+      const std::vector<uint32_t> smVersions;
+      ///\brief The lowest of smVersions, which the device code is parsed for.
       const uint32_t smVersion;
       ///\brief see setCuArgs()
       const uint32_t fatbinFlags;
@@ -58,12 +98,14 @@ namespace cling {
       const std::vector<std::string> additionalPtxOpt;
 
       CUDACompilerArgs(const std::string cppStdVersion,
-                       const llvm::Triple hostTriple, const uint32_t smVersion,
+                       const llvm::Triple hostTriple,
+                       const std::vector<uint32_t> smVersions,
                        const uint32_t fatbinFlags, const bool verbose,
                        const bool debug,
                        const std::vector<std::string> additionalPtxOpt)
           : cppStdVersion(cppStdVersion),
-            hostTriple(hostTriple), smVersion(smVersion),
+            hostTriple(hostTriple), smVersions(smVersions),
+            smVersion(smVersions.front()),
             fatbinFlags(fatbinFlags), verbose(verbose), debug(debug),
             additionalPtxOpt(additionalPtxOpt) {}
     };
@@ -84,8 +126,33 @@ namespace cling {
     ///\brief Path to the fatbin file, which will used by the CUDACodeGen.
     const std::string m_FatbinFilePath;
 
-    ///\brief Contains the PTX code of the current input
-    llvm::SmallString<1024> m_PTX_code;
+    ///\brief Contains the fatbinary of the current input.
+    llvm::SmallString<1024> m_Fatbin;
+
+    ///\brief The PTX code compiled so far, by the hash of the device module,
+    /// fatbin flags and optimization level followed by the SM version:
+    /// inputs with unchanged device code skip the NVPTX backend.
+    llvm::StringMap<std::string> m_PTXCache;
+
+    ///\brief The key of the fatbinary in m_FatbinFilePath; empty if unknown.
+    std::string m_WrittenFatbinKey;
+
+    ///\brief The result of the input compiled on a worker thread by
+    /// processAsync() or declareAsync(), until wait() collects it.
+    std::future<bool> m_Pending;
+
+    ///\brief The stats of the last inputs, the current one at the back.
+    std::deque<InputStats> m_Stats;
+    InputStats m_TotalStats;
+    unsigned m_NumInputs = 0;
+
+    KernelTimer m_KernelTimer = nullptr;
+
+    ///\brief Starts the stats of a new input.
+    void beginStats(const std::string& input);
+
+    ///\brief Adds to a field of the current input's and the total stats.
+    void addStat(uint64_t InputStats::*Field, uint64_t Nanoseconds);
 
     ///\brief Keep the ptx compiler args for reflection during runtime.
     std::vector<std::string> argv;
@@ -101,17 +168,36 @@ namespace cling {
         std::vector<std::string>& argv,
         const std::shared_ptr<clang::HeaderSearchOptions> &headerSearchOptions);
 
-    ///\brief Compiles a PTX file from the current input. The PTX code is
-    /// written to cling.ptx.
+    ///\brief Compiles input in m_PTX_interp, by declare() if declaration is
+    /// true or else by process(), and then its fatbinary.
+    ///
+    ///\returns True, if all stages of generating fatbin runs right.
+    bool compile(const std::string& input, bool declaration);
+
+    ///\brief Compiles the module of the last transaction of m_PTX_interp to
+    /// a fatbinary, unless it is cached, and writes it to m_FatbinFilePath
+    /// unless the file holds it already.
+    ///
+    ///\returns True, if m_FatbinFilePath holds the fatbinary of the module.
+    bool compileDeviceCode();
+
+    ///\brief Compiles the PTX code of module for an architecture.
+    ///
+    ///\param [in] module - The device module; its data layout is set.
+    ///\param [in] smVersion - The SM version to compile for.
+    ///\param [in] optLevel - The level to optimize the module at before, see
+    ///       `#pragma cling cuda optimize`; negative to leave it as compiled.
+    ///\param [out] PTX - The PTX code.
     ///
-    ///\returns True, if the new cling.ptx was compiled.
-    bool generatePTX();
+    ///\returns True, if the PTX code was compiled.
+    bool generatePTX(llvm::Module& module, uint32_t smVersion, int optLevel,
+                     std::string& PTX);
 
-    ///\brief Wrap up the ptx_code in the NVIDIA fatbinary format. The fatbin
-    /// code is written to m_FatbinFilePath.
+    ///\brief Wrap up the PTX code in the NVIDIA fatbinary format, one entry
+    /// per architecture. The fatbin code is written to m_Fatbin.
     ///
-    ///\returns True, if the fatbinary tool returns 0.
-    bool generateFatbinary();
+    ///\param [in] PTX - The PTX code for each of m_CuArgs->smVersions.
+    void generateFatbinary(const std::vector<std::string>& PTX);
 
     ///\brief The function set the values of m_CuArgs.
     ///
@@ -141,11 +227,18 @@ namespace cling {
         const cling::InvocationOptions& invocationOptions,
         const clang::CompilerInstance& CI);
 
-    ///\brief Returns a reference to the PTX interpreter
+    ///\brief Waits for the input compiled on the worker thread, if any.
+    ~IncrementalCUDADeviceCompiler();
+
+    ///\brief Returns a reference to the PTX interpreter, once it is done with
+    /// the input compiled on the worker thread.
     ///
     ///\return std::unique_ptr< cling::Interpreter >&
     ///
-    Interpreter *getPTXInterpreter() { return m_PTX_interp.get(); }
+    Interpreter *getPTXInterpreter() {
+      wait();
+      return m_PTX_interp.get();
+    }
 
     ///\brief Generate an new fatbin file with the path in
     /// CudaGpuBinaryFileNames.
@@ -177,6 +270,24 @@ namespace cling {
     /// fatbin file is written.
     bool declare(const std::string& input);
 
+    ///\brief Runs process() on a worker thread, such that the device code is
+    /// compiled while the host compiles the same input. The host must call
+    /// wait() before its CodeGen reads the fatbin file.
+    ///
+    ///\param [in] input - See process().
+    void processAsync(const std::string& input);
+
+    ///\brief Runs declare() on a worker thread, see processAsync().
+    ///
+    ///\param [in] input - See declare().
+    void declareAsync(const std::string& input);
+
+    ///\brief Waits for the input compiled on the worker thread, if any.
+    ///
+    ///\returns false, if it was compiled by process() or declare() and that
+    /// failed.
+    bool wait();
+
     ///\brief Parses input line, which doesn't contain statements. No code
     /// generation is done.
     ///
@@ -186,7 +297,33 @@ namespace cling {
     ///\param[in] input - The input containing the declarations.
     ///
     ///\returns true if parsing of the input was correct
-    bool parse(const std::string& input) const;
+    bool parse(const std::string& input);
+
+    ///\brief The stats of the last inputs, oldest first, once the current
+    /// one is compiled.
+    const std::deque<InputStats>& getInputStats();
+
+    ///\brief The stats of all inputs since startup or resetStats().
+    const InputStats& getTotalStats();
+
+    ///\brief Adds the time the host module of the current input spent in
+    /// its static initializers.
+    void addRegistrationTime(uint64_t Nanoseconds);
+
+    ///\brief Adds the GPU time of the current input's wrapper.
+    void addKernelTime(uint64_t Nanoseconds);
+
+    ///\brief Times the wrappers with Timer, a function of the host
+    /// interpreter recording CUDA events; none stops timing them.
+    void enableKernelTiming(KernelTimer Timer);
+
+    ///\brief The timer of the wrappers, if they are timed.
+    KernelTimer getKernelTimer() const { return m_KernelTimer; }
+
+    ///\brief Prints one line per input of getInputStats() and the total.
+    void printStats(llvm::raw_ostream& Out);
+
+    void resetStats();
 
     ///\brief Print some information of the IncrementalCUDADeviceCompiler to
     /// llvm::outs().
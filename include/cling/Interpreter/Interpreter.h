@@ -10,15 +10,22 @@
 #ifndef CLING_INTERPRETER_H
 #define CLING_INTERPRETER_H
 
+#include "cling/Interpreter/CallWrapper.h"
 #include "cling/Interpreter/InvocationOptions.h"
 #include "cling/Interpreter/RuntimeOptions.h"
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
 #include "llvm/ADT/StringRef.h"
 
+#include <atomic>
 #include <cstdlib>
+#include <functional>
+#include <future>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace llvm {
   class raw_ostream;
@@ -64,16 +71,38 @@ namespace cling {
       class LifetimeHandler;
     }
   }
+  namespace utils {
+    struct DiagnosticRecord;
+    class PathSet;
+  }
+  class AsyncEvaluator;
+  class AutoloadCallback;
+  class AutoloadIndex;
+  class CellCache;
   class ClangInternalState;
   class CompilationOptions;
+  class CompletionCache;
   class DynamicLibraryManager;
+  class HotReload;
+  class ExecutionCounters;
+  struct ExecutionLimits;
+  class HeaderPCHCache;
+  class ImportSummaryCache;
   class IncrementalCUDADeviceCompiler;
   class IncrementalExecutor;
   class IncrementalParser;
   class InterpreterCallbacks;
   class LookupHelper;
+  class SessionJournal;
+  class StateLock;
+  class HeapReport;
+  class MemoryReport;
+  class ProfileReport;
+  class TimingStats;
   class Transaction;
+  class TransactionUnloader;
   class Value;
+  class ValuePool;
 
   ///\brief Class that implements the interpreter-like behavior. It manages the
   /// incremental compilation.
@@ -97,6 +126,21 @@ namespace cling {
       void pop() const;
     };
 
+    ///\brief Marks the calling thread as running the interpreter's code for
+    /// the lifetime of the object, e.g. in a thread that the code started.
+    /// Compiling and running other inputs can go on meanwhile; unloading
+    /// transactions on other threads reverts their declarations, but leaves
+    /// their code in place until no thread runs code anymore. The wrappers
+    /// of the inputs hold one while they run.
+    class RunningCodeRAII {
+    private:
+      struct Impl;
+      std::unique_ptr<Impl> m_Impl;
+    public:
+      RunningCodeRAII(const Interpreter& I);
+      ~RunningCodeRAII();
+    };
+
     class StateDebuggerRAII {
     private:
       const Interpreter* m_Interpreter;
@@ -106,6 +150,23 @@ namespace cling {
       ~StateDebuggerRAII();
     };
 
+    ///\brief A global mangled once, for repeated getAddressOfGlobal() calls;
+    /// see getSymbolHandle(). It remembers the address until the code or the
+    /// libraries change.
+    ///
+    class SymbolHandle {
+    private:
+      friend class Interpreter;
+      std::string m_Name;
+      mutable void* m_Address = nullptr;
+      mutable unsigned m_Generation = 0;
+      mutable bool m_FromJIT = false;
+    public:
+      ///\brief The mangled name of the global.
+      const std::string& getName() const { return m_Name; }
+      explicit operator bool() const { return !m_Name.empty(); }
+    };
+
     ///\brief Describes the return result of the different routines that do the
     /// incremental compilation.
     ///
@@ -166,9 +227,104 @@ namespace cling {
     ///
     std::unique_ptr<LookupHelper> m_LookupHelper;
 
+    ///\brief Serializes changes of the AST with read-only reflection queries.
+    ///
+    std::unique_ptr<StateLock> m_StateLock;
+
+    ///\brief The compile thread of evaluateAsync().
+    ///
+    std::unique_ptr<AsyncEvaluator> m_AsyncEvaluator;
+
+    ///\brief Precompiles the headers loaded at startup, if enabled through
+    /// CLING_HEADER_PCH_CACHE.
+    ///
+    std::unique_ptr<HeaderPCHCache> m_HeaderPCHCache;
+
+    ///\brief The journal of startJournal() and restoreJournal(); created on
+    /// first use.
+    ///
+    std::unique_ptr<SessionJournal> m_Journal;
+
+    ///\brief The inputs of process() to run again without compiling them,
+    /// see RuntimeOptions::CacheCells; created on first use.
+    ///
+    std::unique_ptr<CellCache> m_CellCache;
+
+    ///\brief The files loaded by loadReloadableFile(), for reloadFile();
+    /// created on first use.
+    ///
+    std::unique_ptr<HotReload> m_HotReload;
+
+    ///\brief The include paths of the CompilerInstance, for
+    /// AddIncludePaths() to skip duplicates; created on first use.
+    ///
+    std::unique_ptr<utils::PathSet> m_IncludePaths;
+
+    ///\brief The last transaction of the runtime's setup, which the exported
+    /// sessions leave out.
+    ///
+    const Transaction* m_LastStartupTransaction = nullptr;
+
+    ///\brief The completions of codeComplete(), valid until the next
+    /// transaction.
+    ///
+    mutable std::unique_ptr<CompletionCache> m_CompletionCache;
+
+    ///\brief What the child interpreters looked up in this one, shared by
+    /// all of them; created on first use.
+    ///
+    mutable std::unique_ptr<ImportSummaryCache> m_ImportSummaryCache;
+
+    ///\brief The storage of the objects held by Values; shared with the
+    /// Values that outlive the interpreter.
+    ///
+    llvm::IntrusiveRefCntPtr<ValuePool> m_ValuePool;
+
     ///\brief Cache of compiled destructors wrappers.
     std::unordered_map<const clang::RecordDecl*, void*> m_DtorWrappers;
 
+    ///\brief Cache of compiled value printing wrappers, by canonical type.
+    std::unordered_map<const clang::Type*, void*> m_PrintValueWrappers;
+
+    ///\brief Cache of compiled call wrappers, see getCallWrapper(). Dropped
+    /// on unload().
+    std::unordered_map<const clang::FunctionDecl*, CallWrapper_t>
+      m_CallWrappers;
+
+    ///\brief Cache of the mangled names of getAddressOfGlobal(), by opaque
+    /// GlobalDecl. Dropped on unload().
+    mutable std::unordered_map<void*, std::string> m_MangledNames;
+
+    ///\brief A wrapper compiled for an expression, see
+    /// RuntimeOptions::CacheExpressions.
+    struct CachedExpression {
+      ///\brief The mangled name of the wrapper function.
+      std::string WrapperName;
+      ///\brief The value printing mode the wrapper was compiled with.
+      unsigned ValuePrinting;
+      ///\brief Or the value the expression was folded to, without wrapper.
+      std::shared_ptr<Value> Folded;
+    };
+
+    ///\brief Wrappers of evaluated expressions, by normalized input and
+    /// compilation options. Cleared whenever declarations change.
+    mutable std::unordered_map<std::string, CachedExpression> m_ExpressionCache;
+
+    ///\brief Set by EvaluateInternal() while it compiles an expression whose
+    /// value is wanted: if the ValueExtractionSynthesizer can compute it with
+    /// clang's constant evaluator, it stores it here and drops the wrapper,
+    /// which is then neither emitted nor run.
+    Value* m_FoldTarget = nullptr;
+
+    ///\brief Where the wrappers of dynamic scope expressions read their
+    /// variables' addresses from, by expression template.
+    std::unordered_map<std::string, std::unique_ptr<void*[]>>
+      m_DynamicExprSlots;
+
+    ///\brief Set by cancelCompilation(), cleared when the next input starts.
+    ///
+    std::atomic<bool> m_CompilationCancelled{false};
+
     ///\brief Counter used when we need unique names.
     ///
     mutable unsigned long long m_UniqueCounter;
@@ -181,6 +337,25 @@ namespace cling {
     ///
     bool m_DynamicLookupDeclared;
 
+    ///\brief Whether Initialize() declared the runtime universe, whose
+    /// other parts are then declared by declareRuntimeFor().
+    ///
+    bool m_LazyRuntime = false;
+
+    ///\brief Whether ValueRuntimeUniverse.h has been parsed.
+    ///
+    bool m_ValueRuntimeDeclared = false;
+
+    ///\brief Whether NullDerefRuntimeUniverse.h has been parsed.
+    ///
+    bool m_NullDerefRuntimeDeclared = false;
+
+    ///\brief The transactions that parsed them, nested into the inputs that
+    /// needed them: unloading those forgets them, see forgetRuntimeOf().
+    ///
+    const Transaction* m_ValueRuntimeT = nullptr;
+    const Transaction* m_NullDerefRuntimeT = nullptr;
+
     ///\brief Flag toggling the dynamic scopes on or off.
     ///
     bool m_DynamicLookupEnabled;
@@ -189,6 +364,11 @@ namespace cling {
     ///
     bool m_RawInputEnabled;
 
+    ///\brief Whether this interpreter started the time trace profiler of
+    /// --time-trace, which it writes and stops on destruction.
+    ///
+    bool m_OwnsTimeTrace;
+
     ///\brief Configuration bits that can be changed at runtime. This allows the
     /// user to enable/disable specific interpreter extensions.
     cling::runtime::RuntimeOptions m_RuntimeOptions;
@@ -197,10 +377,25 @@ namespace cling {
     ///
     int m_OptLevel;
 
+    ///\brief Whether each module gets the optimization level its IR calls
+    /// for, m_OptLevel being the default (`.O auto`).
+    ///
+    bool m_AutoOptLevel;
+
+    ///\brief The milliseconds that optimizing an input may take, see
+    /// CompilationOptions::CompileBudgetMs.
+    ///
+    unsigned m_CompileBudgetMs;
+
     ///\brief Interpreter callbacks.
     ///
     std::unique_ptr<InterpreterCallbacks> m_Callbacks;
 
+    ///\brief The AutoloadCallback among m_Callbacks, which reads the
+    /// autoload indexes.
+    ///
+    AutoloadCallback* m_AutoloadCallback;
+
     ///\brief Information about the last stored states through .storeState
     ///
     mutable std::vector<ClangInternalState*> m_StoredStates;
@@ -225,7 +420,7 @@ namespace cling {
     ///
     ///\returns Whether the operation was fully successful.
     ///
-    CompilationResult DeclareInternal(const std::string& input,
+    CompilationResult DeclareInternal(llvm::StringRef input,
                                       const CompilationOptions& CO,
                                       Transaction** T = 0) const;
 
@@ -248,6 +443,12 @@ namespace cling {
                                        Transaction** T = 0,
                                        size_t wrapPoint = 0);
 
+    ///\brief Runs the compiled wrapper WrapperName again, printing its value
+    /// as the ValuePrinting it was compiled with requests.
+    ///
+    CompilationResult RunCachedWrapper(const std::string& WrapperName,
+                                       unsigned ValuePrinting, Value* V);
+
     ///\brief Worker function to code complete after all the mechanism
     /// has been set up.
     ///
@@ -259,6 +460,18 @@ namespace cling {
     CompilationResult CodeCompleteInternal(const std::string& input,
                                            unsigned offset);
 
+    ///\brief Runs Sema's code completion of line at cursor in a child
+    /// interpreter.
+    ///
+    ///\param [out] names - if not null, the name each of completions is
+    ///                     filtered by.
+    ///
+    CompilationResult codeCompleteUncached(const std::string& line,
+                                           size_t cursor,
+                                           std::vector<std::string>& completions,
+                                           std::vector<std::string>* names)
+                                           const;
+
     ///\brief Wraps a given input.
     ///
     /// The interpreter must be able to run statements on the fly, which is not
@@ -280,11 +493,36 @@ namespace cling {
     ///\param [in,out] res - The return result of the run function. Must be
     ///       initialized to point to the return value's location if the
     ///       expression result is an aggregate.
+    ///\param [in] T - The transaction FD is the wrapper of, if any: it runs
+    ///       from its entry point then, without mangling or lookup.
     ///
     ///\returns The result of the execution.
     ///
     ExecutionResult RunFunction(const clang::FunctionDecl* FD,
-                                Value* res = 0);
+                                Value* res = 0,
+                                const Transaction* T = nullptr);
+
+    ///\brief The mangled name of a global, from m_MangledNames.
+    ///
+    const std::string& getMangledName(const clang::GlobalDecl& GD) const;
+
+    ///\brief Gets the address of a global by the name the mangler gave it,
+    /// which on Windows might need to be corrected first.
+    ///
+    void* lookupMangledName(const std::string& mangledName,
+                            bool* fromJIT) const;
+
+    ///\brief Worker function of getFunction().
+    ///
+    ///\param[in] name - The qualified name of the function.
+    ///\param[in] spelling - The spelling of its signature by
+    ///   internal::spellType().
+    ///\param[out] address - The address of the function, if known.
+    ///\returns The wrapper of the function, or null.
+    ///
+    CallWrapper_t getFunctionWrapper(llvm::StringRef name,
+                                     llvm::StringRef spelling,
+                                     void*& address);
 
     ///\brief Forwards to cling::IncrementalExecutor::addSymbol.
     ///
@@ -316,6 +554,53 @@ namespace cling {
     ///
     void ShutDown();
 
+    ///\brief First step of unload(): forgets what refers to T and runs its
+    /// static destructors.
+    ///
+    ///\returns false if T must not be reverted (-errorout).
+    ///
+    bool prepareUnload(Transaction& T);
+
+    ///\brief Second step of unload(): reverts T from the AST and the JIT
+    /// using U, which can be shared by several transactions.
+    ///
+    void revertTransaction(Transaction& T, TransactionUnloader& U);
+
+    ///\brief Compiles input for evaluateAsync(), as evaluate() does.
+    ///
+    ///\param[out] T - The transaction whose wrapper runForAsync() runs.
+    ///
+    CompilationResult compileForAsync(const std::string& input,
+                                      Transaction*& T);
+
+    ///\brief Runs the wrapper of a transaction from compileForAsync().
+    ///
+    CompilationResult runForAsync(Transaction* T, Value& V);
+
+    friend class AddressSymbols;
+    friend class AsyncEvaluator;
+    friend class Value;
+    friend class ValueExtractionSynthesizer;
+
+    ///\brief Parses inFile in a new interpreter without runtime and passes
+    /// its transaction to Print, which forward declares its contents.
+    ///
+    ///\param[in] SyntaxOnly - whether the new interpreter needs no JIT; it
+    ///           can then run on any thread.
+    ///
+    ///\returns false if inFile could not be parsed.
+    ///
+    bool parseForForwardDeclarations(llvm::StringRef inFile,
+         const std::function<void(Interpreter&, Transaction&)>& Print,
+         bool SyntaxOnly = false);
+
+    ///\brief Adds the forward declarations of inFile to Index.
+    ///
+    ///\returns false if inFile could not be parsed.
+    ///
+    bool collectForwardDeclarations(llvm::StringRef inFile,
+                                    AutoloadIndex& Index, bool SyntaxOnly);
+
     ///\brief The target constructor to be called from both the delegating
     /// constructors. parentInterp might be nullptr.
     ///
@@ -369,6 +654,11 @@ namespace cling {
 
     LookupHelper& getLookupHelper() const { return *m_LookupHelper; }
 
+    ///\brief Returns the lock held exclusively while transactions are parsed,
+    /// committed or unloaded, and shared by read-only reflection queries.
+    ///
+    StateLock& getStateLock() const { return *m_StateLock; }
+
     const clang::Parser& getParser() const;
     clang::Parser& getParser();
 
@@ -386,12 +676,152 @@ namespace cling {
     ///
     bool isInSyntaxOnlyMode() const;
 
+    ///\brief true if the code runs in an executor process, see
+    /// CLING_REMOTE_EXECUTOR.
+    ///
+    bool isExecutorRemote() const;
+
+    ///\brief Precompiles the runtime headers and the given Headers into File,
+    /// for use with --snapshot=File, with the explicit instantiations of the
+    /// class template specializations Instantiations. Returns false on
+    /// failure.
+    ///
+    bool writeSnapshot(const std::string& File,
+                       const std::vector<std::string>& Headers,
+                       const std::vector<std::string>& Instantiations
+                         = std::vector<std::string>()) const;
+
+    ///\brief Compiles the code of the session, i.e. of the transactions since
+    /// the startup, into the shared library Path (an object file if Path ends
+    /// with ".o"), for use without the interpreter. A header next to it, Path
+    /// with the extension ".h", declares what the session defined.
+    ///
+    ///\param[in] Path - The library to write.
+    ///\param[in] OptLevel - The optimization level; -1 for the default one.
+    ///
+    ///\returns false on failure, which is reported.
+    ///
+    bool exportSession(llvm::StringRef Path, int OptLevel = -1);
+
+    ///\brief Compiles the code of T, with its nested transactions, into a
+    /// package for hosts without the interpreter, which add it through
+    /// ObjectRunner::addPackage(). Besides the relocatable object, the
+    /// package names the symbols that it needs and the libraries that the
+    /// session got them from; the code of earlier transactions must already
+    /// be on the host, through their packages.
+    ///
+    ///\param[in] T - The transaction to export, e.g. getLastTransaction().
+    ///\param[in] OS - The stream to write the package to.
+    ///\param[in] OptLevel - The optimization level; -1 for the default one.
+    ///
+    ///\returns false on failure, which is reported.
+    ///
+    bool exportPackage(const Transaction& T, llvm::raw_ostream& OS,
+                       int OptLevel = -1);
+
+    ///\brief Compiles Files into the caches of the interpreter without
+    /// running any of their code, for later sessions to start warm: headers
+    /// and scripts are parsed and compiled as by loadFile(), which fills
+    /// CLING_OBJECT_CACHE and, on exit, CLING_HEADER_PCH_CACHE; libraries are
+    /// not loaded, for that would run their initializers, but indexed for
+    /// the symbol search (CLING_DYLD_INDEX) with those on the library path.
+    ///
+    ///\param[in] Files - The headers, scripts and libraries to compile.
+    ///
+    ///\returns false if one of Files failed to compile, which is reported.
+    ///
+    bool warmCaches(const std::vector<std::string>& Files);
+
+    ///\brief Appends the inputs that process() and loadFile() commit from
+    /// now on to the journal File, for restoreJournal(). With
+    /// CLING_OBJECT_CACHE, each input also records the cache keys of the
+    /// objects of its code.
+    ///
+    ///\returns false if File cannot be written, which is reported.
+    ///
+    bool startJournal(llvm::StringRef File);
+    void stopJournal();
+
+    ///\brief Replays the inputs of the journal File, e.g. of a session of
+    /// an earlier process, until one fails. As long as the replayed inputs
+    /// compile to the same IR as when recorded, their code comes out of
+    /// CLING_OBJECT_CACHE without being optimized again; restore right after
+    /// the startup for that.
+    ///
+    ///\param[in] File - The journal to restore.
+    ///\param[in] DeclarationsOnly - Whether to defer the inputs that run
+    ///   statements to runDeferredJournalInputs(). The initializers of the
+    ///   variables declared still run.
+    ///
+    CompilationResult restoreJournal(llvm::StringRef File,
+                                     bool DeclarationsOnly = false);
+
+    ///\brief Replays the statements that restoreJournal() deferred, in
+    /// order, until one fails.
+    ///
+    CompilationResult runDeferredJournalInputs();
+    size_t getNumDeferredJournalInputs() const;
+
+    ///\brief The number of modules that the replays of restoreJournal()
+    /// compiled; Reused, if given, gets how many of them had their object
+    /// out of CLING_OBJECT_CACHE.
+    ///
+    size_t getNumReplayedJournalModules(size_t* Reused = nullptr) const;
+
+    ///\brief Starts or stops collecting the optimization remarks of the
+    /// code, see printOptimizationRemarks(). While collecting, the code
+    /// tracks its input lines, even without debug info.
+    ///
+    void enableOptimizationRemarks(bool Enable);
+    bool isCollectingOptimizationRemarks() const;
+
+    ///\brief Prints the optimization remarks of the code optimized since
+    /// they were last printed, as clang's -Rpass would, then drops them.
+    ///
+    ///\param[in] Out - The stream to print to.
+    ///\param[in] Passed - Whether to print what the passes achieved, e.g.
+    ///   the loops vectorized.
+    ///\param[in] Missed - Whether to print what they missed and why.
+    ///
+    ///\returns the number of remarks printed.
+    ///
+    size_t printOptimizationRemarks(llvm::raw_ostream& Out, bool Passed,
+                                    bool Missed);
+
+    ///\brief Starts or stops instrumenting the code compiled from now on
+    /// to collect the profile of its functions while it runs, see
+    /// optimizeWithProfile().
+    ///
+    ///\returns false if the code cannot be instrumented, e.g. because it
+    ///   runs in another process.
+    ///
+    bool enableProfileInstrumentation(bool Enable);
+    bool isInstrumentingForProfile() const;
+
+    ///\brief Re-optimizes the instrumented functions that ran, with the
+    /// profile they collected: their branch weights, with the cold code
+    /// split from the hot code. Their callers then call the result, which
+    /// stops collecting.
+    ///
+    ///\returns the number of functions re-optimized.
+    ///
+    unsigned optimizeWithProfile();
+
     ///\brief Shows the current version of the project.
     ///
     ///\returns The current svn revision (svn Id).
     ///
     static const char* getVersion();
 
+    ///\brief The interpreter whose code the calling thread runs: the input,
+    /// static initializer or RunningCodeRAII it entered last. Null if the
+    /// thread runs no interpreted code.
+    ///
+    /// The runtime helpers dispatch to it rather than to gCling, which code
+    /// reaching a parent's runtime through the bridge would share.
+    ///
+    static Interpreter* getCurrent();
+
     ///\brief Creates unique name that can be used for various aims.
     ///
     void createUniqueName(std::string& out);
@@ -453,6 +883,140 @@ namespace cling {
     ///
     void dump(llvm::StringRef what, llvm::StringRef filter);
 
+    ///\brief Time spent in the stages of compiling and running all input
+    /// since startup or the last resetTimingStats(). See
+    /// Transaction::getTimingStats() for the stats of a single input.
+    ///
+    const TimingStats& getTimingStats() const;
+
+    ///\brief Restarts the accumulation of getTimingStats().
+    ///
+    void resetTimingStats();
+
+    ///\brief How much trimMemory() gives back.
+    ///
+    enum TrimLevel {
+      ///\brief What is rebuilt on demand: the caches of completions and
+      /// mangled names, the backend's pass managers, the pooled transactions.
+      kTrimCaches,
+      ///\brief Also the free memory of the heap, to the operating system.
+      kTrimHeap
+    };
+
+    ///\brief Frees what the interpreter keeps around to be faster, e.g.
+    /// while a long-lived interpreter waits for input; the next inputs are
+    /// slower until it is rebuilt. Must not run concurrently with anything
+    /// else using the interpreter.
+    ///
+    void trimMemory(TrimLevel Level = kTrimHeap);
+
+    ///\brief Asks the compilation of the current input to stop where it
+    /// next checks: between the parser's declarations, at the next template
+    /// instantiation, before the next optimization pass and before the JIT.
+    /// The input then fails and is unloaded, as if it had errors. Can be
+    /// called from any thread or from a signal handler, e.g. for SIGINT.
+    ///
+    void cancelCompilation() {
+      m_CompilationCancelled.store(true, std::memory_order_relaxed);
+    }
+
+    ///\brief Whether cancelCompilation() was called since the current input
+    /// started.
+    ///
+    bool isCompilationCancelled() const {
+      return m_CompilationCancelled.load(std::memory_order_relaxed);
+    }
+
+    ///\brief Forgets a cancelCompilation(): done as each input starts.
+    ///
+    void clearCompilationCancelled() {
+      m_CompilationCancelled.store(false, std::memory_order_relaxed);
+    }
+
+    ///\brief Writes the sections recorded since startup for --time-trace,
+    /// cling's and clang's, as Chrome trace JSON to the file it names.
+    ///
+    ///\returns false if there is no time trace or it cannot be written.
+    ///
+    bool writeTimeTrace() const;
+
+    ///\brief The memory that each committed transaction allocated and keeps
+    /// alive: AST, source buffers, IR and JIT sections. See MemoryReport.
+    ///
+    MemoryReport getMemoryReport() const;
+
+    ///\brief The heap allocations of the JITted code that are still live,
+    /// by transaction and function; empty unless the session was started
+    /// with CLING_HEAP_PROFILE set. See HeapReport.
+    ///
+    HeapReport getHeapReport() const;
+
+    ///\brief Starts sampling the call stacks of the calling thread every
+    /// IntervalUs microseconds of CPU time, dropping the previous profile.
+    ///
+    ///\returns false if the platform cannot sample, the code runs in
+    /// another process or another interpreter of the process is sampling.
+    ///
+    bool startProfiling(unsigned IntervalUs = 1000);
+
+    ///\brief Stops the sampling, keeping the profile for getProfileReport().
+    ///
+    ///\returns false if it was not sampling.
+    ///
+    bool stopProfiling();
+
+    ///\brief Where the CPU time went during the last profile, by function
+    /// and calling context. See ProfileReport.
+    ///
+    ProfileReport getProfileReport() const;
+
+    ///\brief Starts or stops timing the GPU work of the inputs with CUDA
+    /// events, see IncrementalCUDADeviceCompiler::getInputStats().
+    ///
+    ///\returns false if the interpreter is not in CUDA mode or the timer
+    /// cannot be compiled.
+    ///
+    bool enableCUDAKernelTiming(bool Enable);
+
+    ///\brief Compiles the runtime of the `#pragma cling cuda_graph` regions,
+    /// once: the region types in cling::runtime::internal, and the hook of
+    /// cudaLaunchKernel that sends the launches on the default stream to the
+    /// stream being captured. The code JITted before keeps the library's
+    /// cudaLaunchKernel.
+    ///
+    ///\returns false if the interpreter is not in CUDA mode or the runtime
+    /// cannot be compiled.
+    ///
+    bool enableCUDAGraphs();
+
+    ///\brief Loads the OpenMP runtime that code compiled with -fopenmp
+    /// calls: Runtime, or else the first of libomp and libiomp5 found. This
+    /// is done when the interpreter starts with -fopenmp; OpenMP cannot be
+    /// enabled later, as clang sets up its parsing and code generation once.
+    ///
+    ///\returns false if OpenMP is not enabled or no runtime was loaded,
+    /// which is reported.
+    ///
+    bool loadOpenMPRuntime(llvm::StringRef Runtime = llvm::StringRef());
+
+    ///\brief Starts or stops accumulating the CPU time and the hardware
+    /// events of executing the inputs; stopping discards them.
+    ///
+    void enableExecutionCounters(bool Enable);
+
+    ///\brief Limits the time and the heap that the code of the inputs
+    /// compiled from now on may take, see ExecutionLimits; going beyond them
+    /// throws an ExecutionLimitException out of the code. The limits all 0
+    /// lift them for the inputs run from now on.
+    ///
+    void setExecutionLimits(const ExecutionLimits& Limits);
+    ExecutionLimits getExecutionLimits() const;
+
+    ///\brief The counters accumulated since enableExecutionCounters(true);
+    /// null if they are disabled or nothing is executed.
+    ///
+    const ExecutionCounters* getExecutionCounters() const;
+
     ///\brief Store the interpreter state in files
     /// Store the AST, the included files and the lookup tables
     ///
@@ -496,6 +1060,27 @@ namespace cling {
                               Transaction** T = 0,
                               bool disableValuePrinting = false);
 
+    ///\brief Compiles several independent inputs like process() does, but
+    /// as one transaction: they share one llvm::Module and one JIT link.
+    ///
+    /// The inputs are parsed in order; an input that does not compile is
+    /// reported and dropped without affecting the others. Once all are
+    /// compiled, the static initializers of all inputs run, then the
+    /// statements of each input in order.
+    ///
+    ///\param[in] inputs - The inputs to be compiled.
+    ///\param[out] Results - If non-null, the result of each input.
+    ///\param[out] Values - If non-null, the value of each input.
+    ///\param[in] disableValuePrinting - Whether to echo the expression
+    ///       results.
+    ///
+    ///\returns kSuccess if all inputs were successful.
+    ///
+    CompilationResult processBatch(llvm::ArrayRef<std::string> inputs,
+                                   std::vector<CompilationResult>* Results = 0,
+                                   std::vector<Value>* Values = 0,
+                                   bool disableValuePrinting = false);
+
     ///\brief Parses input line, which doesn't contain statements. No code
     /// generation is done.
     ///
@@ -527,6 +1112,13 @@ namespace cling {
     ///\returns true if the module was loaded or already visible.
     bool loadModule(clang::Module* M, bool complain = true);
 
+    ///\brief Writes which of the modules loaded so far declares each name
+    /// of the namespaces, for CLING_LAZY_MODULE_IMPORT to import the module
+    /// upon the lookup of a name instead, see tools/prebuild-modules.
+    ///
+    ///\returns false if File could not be written.
+    bool writeModuleIndex(llvm::StringRef File);
+
     ///\brief Parses input line, which doesn't contain statements. Code
     /// generation needed to make the module functional.
     ///
@@ -549,11 +1141,35 @@ namespace cling {
     /// @param[in] cursor - The offset for the completion point.
     /// @param[out] completions - The results for teh completion
     ///
+    /// The completions of the code before the identifier at cursor are
+    /// cached until the next transaction: as that identifier grows, they are
+    /// filtered again instead of running Sema.
+    ///
     ///\returns Whether the operation was fully successful.
     ///
     CompilationResult codeComplete(const std::string& line, size_t& cursor,
                                    std::vector<std::string>& completions) const;
 
+    ///\brief Forgets the completions cached by codeComplete(), which the
+    /// latest change of the AST might invalidate.
+    ///
+    void clearCompletionCache();
+
+    ///\brief The lookups of the child interpreters into this one, see
+    /// ExternalInterpreterSource.
+    ///
+    ImportSummaryCache& getImportSummaryCache() const;
+
+    ///\brief Forgets the lookups of the child interpreters, which the latest
+    /// change of the AST might invalidate.
+    ///
+    void clearImportSummaryCache();
+
+    ///\brief Forgets the value printing wrappers if T declares a
+    /// cling::printValue() overload, which they would not call.
+    ///
+    void clearPrintValueWrappers(const Transaction& T);
+
     ///\brief Compiles input line, which doesn't contain statements.
     ///
     /// The interface circumvents the most of the extra work necessary to
@@ -567,6 +1183,21 @@ namespace cling {
     ///
     CompilationResult declare(const std::string& input, Transaction** T = 0);
 
+    ///\brief Like declare(), without copying the input: the interpreter
+    /// refers to it for as long as it needs the source, e.g. for the
+    /// diagnostics, such that the caller must keep it, for large sources
+    /// that live anyway.
+    ///
+    /// @param[in] input - The declarations; null-terminated and ending in a
+    ///                    newline, else they get copied nevertheless. The
+    ///                    byte past its end must be readable.
+    /// @param[out] T - The cling::Transaction of the input
+    ///
+    ///\returns Whether the operation was fully successful.
+    ///
+    CompilationResult declareInPlace(llvm::StringRef input,
+                                     Transaction** T = 0);
+
     ///\brief Compiles input line, which contains only expressions.
     ///
     /// The interface circumvents the most of the extra work necessary extract
@@ -581,6 +1212,37 @@ namespace cling {
     ///
     CompilationResult evaluate(const std::string& input, Value& V);
 
+    ///\brief Runs a piece of user code, e.g. on the thread of an event loop.
+    /// It must call its argument, exactly once.
+    ///
+    typedef std::function<void(std::function<void()>)> AsyncExecutor;
+
+    ///\brief Like evaluate(), without blocking the caller.
+    ///
+    /// The input is compiled on a thread of the interpreter; inputs are
+    /// compiled and run in the order they were submitted. The wrapper runs
+    /// through the executor set by setAsyncExecutor(), if any, else on the
+    /// compile thread. Exceptions from the user code are stored in the
+    /// future.
+    ///
+    /// Other threads must not use the interpreter while evaluations are
+    /// pending, except from the user code being evaluated.
+    ///
+    ///\param[in] input - The input containing only expressions.
+    ///\param[out] V - The value of the executed input; it must stay alive
+    ///       until the future is ready.
+    ///
+    ///\returns Whether the operation was fully successful, once it is done.
+    ///
+    std::future<CompilationResult> evaluateAsync(const std::string& input,
+                                                 Value& V);
+
+    ///\brief Sets where evaluateAsync() runs user code; an empty executor
+    /// runs it on the compile thread. Applies to inputs whose compilation
+    /// did not start yet.
+    ///
+    void setAsyncExecutor(AsyncExecutor Exec);
+
     ///\brief Compiles input line, which contains only expressions and prints
     /// out the result of its execution.
     ///
@@ -630,12 +1292,15 @@ namespace cling {
     ///
     ///\param [in] filename - The file to loaded.
     ///\param [in] lookup - Whether to try to resolve the filepath
+    ///\param [in] async - Whether to only start loading it, see
+    ///   DynamicLibraryManager::loadLibraryAsync(); a failure then shows
+    ///   once the interpreter waits for it.
     ///
     ///\returns kMoreInputExpected is returned when file could not be found
     /// otherwise kSuccess or kFailure
     ///
     CompilationResult loadLibrary(const std::string& filename,
-                                  bool lookup = true);
+                                  bool lookup = true, bool async = false);
 
     ///\brief Loads header file
     ///
@@ -658,6 +1323,60 @@ namespace cling {
                                bool allowSharedLib = true,
                                Transaction** T = 0);
 
+    ///\brief Loads the files like loadFile(), in order; worker threads read
+    /// them and the headers they include meanwhile, such that the
+    /// preprocessor finds them in memory, see FilePrefetcher. The lexing
+    /// remains on this thread: it depends on the macros of what came before.
+    ///
+    ///\param [in] filenames - The files to be loaded.
+    ///\param [in] allowSharedLib - Whether to try to load the files as shared
+    ///                             libraries.
+    ///\param [in] Jobs - The threads reading the files, 0 for one per core.
+    ///\returns kSuccess if all files were loaded, else kFailure.
+    ///
+    CompilationResult loadFiles(llvm::ArrayRef<std::string> filenames,
+                                bool allowSharedLib = true,
+                                unsigned Jobs = 0);
+
+    ///\brief Loads a script compiled into a shared library, like `.L file+`.
+    ///
+    /// The library is built by the host compiler at the default opt level
+    /// and cached until the script, its headers or the flags change, see
+    /// ScriptLibraryCache. The script is then only parsed for its
+    /// declarations, without generating code: the uses of its functions and
+    /// variables bind to the library. Note that this requires the library
+    /// to export them; namespace scope inline and static functions are not.
+    ///
+    ///\param [in] filename - The script to be loaded.
+    ///\param [in] rebuild - Whether to compile the script even if cached.
+    ///\param [out] T -  Transaction containing the script's declarations.
+    ///\returns result of the compilation.
+    ///
+    CompilationResult loadCompiledScript(const std::string& filename,
+                                         bool rebuild = false,
+                                         Transaction** T = 0);
+
+    ///\brief Loads a source file like loadHeader(), calling its functions
+    /// through stubs, for reloadFile() to replace the bodies that change.
+    ///
+    ///\param [in] filename - The file to be loaded.
+    ///\param [out] T -  Transaction containing the loaded file.
+    ///\returns result of the compilation.
+    ///
+    CompilationResult loadReloadableFile(const std::string& filename,
+                                         Transaction** T = 0);
+
+    ///\brief Compiles the function bodies of a file loaded by
+    /// loadReloadableFile() that changed since, and makes the calls to
+    /// these functions run the new code. The globals keep their values.
+    ///
+    ///\param [in] filename - The file to be reloaded.
+    ///\returns kMoreInputExpected if the changes need the file to be
+    /// unloaded and loaded anew, e.g. a declaration changed, or if it was not
+    /// loaded by loadReloadableFile(); otherwise kSuccess or kFailure.
+    ///
+    CompilationResult reloadFile(const std::string& filename);
+
     ///\brief Unloads (forgets) a transaction from AST and JITed symbols.
     ///
     /// If one of the declarations caused error in clang it is rolled back from
@@ -682,6 +1401,20 @@ namespace cling {
     void enablePrintDebug(bool print = true) { m_PrintDebug = print; }
 
     void enableDynamicLookup(bool value = true);
+
+    ///\brief Declares the parts of the runtime universe that an input
+    /// compiled with CO needs, unless they are already: the capture of the
+    /// values of expressions and the pointer checks. An interpreter starts
+    /// with the declarations that every input needs only, see
+    /// RuntimeUniverse.h.
+    ///
+    void declareRuntimeFor(const CompilationOptions& CO);
+
+    ///\brief Forgets the parts of the runtime universe that T, about to be
+    /// unloaded, declared: they are to be declared anew, and the AST
+    /// transformers are to drop their cached lookups of them.
+    ///
+    void forgetRuntimeOf(const Transaction& T);
     bool isDynamicLookupEnabled() const { return m_DynamicLookupEnabled; }
 
     bool isRawInputEnabled() const { return m_RawInputEnabled; }
@@ -690,11 +1423,30 @@ namespace cling {
     int getDefaultOptLevel() const { return m_OptLevel; }
     void setDefaultOptLevel(int optLevel) { m_OptLevel = optLevel; }
 
+    bool isAutoOptLevel() const { return m_AutoOptLevel; }
+    void enableAutoOptLevel(bool value = true) { m_AutoOptLevel = value; }
+
+    ///\brief The milliseconds that optimizing an input may take before the
+    /// functions not optimized yet get emitted at O0; 0 for no limit.
+    unsigned getCompileBudget() const { return m_CompileBudgetMs; }
+    void setCompileBudget(unsigned Ms) { m_CompileBudgetMs = Ms; }
+
     clang::CompilerInstance* getCI() const;
     clang::CompilerInstance* getCIOrNull() const;
     clang::Sema& getSema() const;
     clang::DiagnosticsEngine& getDiagnostics() const;
 
+    ///\brief With InvocationOptions::StructuredDiagnostics, hands each
+    /// diagnostic to Callback as a record, see utils::StructuredDiagnostics.
+    ///
+    ///\param[in] Callback - Receives the records; none prints them.
+    ///\param[in] Notes - Whether to pass on the notes too.
+    ///\returns false if the interpreter does not use structured diagnostics.
+    ///
+    bool setDiagnosticsCallback(
+        std::function<void(const utils::DiagnosticRecord&)> Callback,
+        bool Notes = false);
+
     IncrementalCUDADeviceCompiler* getCUDACompiler() const {
       return m_CUDACompiler.get();
     }
@@ -721,6 +1473,19 @@ namespace cling {
     Value Evaluate(const char* expr, clang::DeclContext* DC,
                             bool ValuePrinterReq = false);
 
+    ///\brief Evaluates a dynamic scope expression. Its wrapper is compiled
+    /// once per expression template and reads the variables' addresses from
+    /// slots rebound upon each evaluation; it is recompiled only when
+    /// declarations changed in between.
+    ///
+    ///\param[in] DEI - The expression and the addresses of its variables.
+    ///\param[in] DC - The declaration context of the expression.
+    ///
+    ///\returns The result of the evaluation if the expression.
+    ///
+    Value EvaluateDynamic(runtime::internal::DynamicExprInfo* DEI,
+                          clang::DeclContext* DC);
+
     ///\brief Interpreter callbacks accessors.
     /// Note that this class takes ownership of any callback object given to it.
     ///
@@ -740,6 +1505,11 @@ namespace cling {
     ///
     const Transaction* getLatestTransaction() const;
 
+    ///\brief Returns a counter that changes whenever declarations get
+    /// unloaded. Caches of the AST compare it to know when to rebuild.
+    ///
+    unsigned getUnloadGeneration() const;
+
     ///\brief Returns a reference to a Transaction known to contain std::string.
     ///
     const Transaction*& getStdStringTransaction() const {
@@ -758,10 +1528,71 @@ namespace cling {
     void* compileFunction(llvm::StringRef name, llvm::StringRef code,
                           bool ifUniq = true, bool withAccessControl = true);
 
+    ///\brief An extern "C" function for compileFunctions().
+    struct FunctionSource {
+      llvm::StringRef Name; ///< The function name.
+      llvm::StringRef Code; ///< Its definition, containing 'extern "C"'.
+    };
+
+    ///\brief Compile extern "C" functions in one transaction, and thus one
+    /// module linked once, and return their addresses. Functions whose code
+    /// is the same but for their name are compiled once; the others are
+    /// defined as its aliases. If the batch fails to compile, the functions
+    /// are compiled one by one, such that only the bad ones get no address.
+    ///
+    ///\param[in] Functions - the functions to compile
+    ///\param[out] Addresses - the address of each function, or 0 if it
+    /// failed to compile
+    ///\param[in] ifUniq - only compile the functions whose name no function
+    /// has yet, else take the existing address
+    ///\param[in] withAccessControl - whether to enforce access restrictions
+    ///
+    ///\returns true if all functions got an address.
+    bool compileFunctions(llvm::ArrayRef<FunctionSource> Functions,
+                          llvm::SmallVectorImpl<void*>& Addresses,
+                          bool ifUniq = true, bool withAccessControl = true);
+
     ///\brief Compile (and cache) destructor calls for a record decl. Used by ~Value.
     /// They are of type extern "C" void()(void* pObj).
     void* compileDtorCallFor(const clang::RecordDecl* RD);
 
+    ///\brief Compile (and cache) a wrapper calling a function through the
+    /// generic signature of CallWrapper_t; used to call functions whose
+    /// signature is only known at runtime.
+    ///
+    ///\param[in] FD - The function to call; not a constructor, destructor or
+    ///   template.
+    ///\returns The wrapper or null if it could not be compiled.
+    ///
+    CallWrapper_t getCallWrapper(const clang::FunctionDecl* FD);
+
+    ///\brief Finds a function or static member function by its qualified
+    /// name and exact signature, compiling it as needed, for the host code to
+    /// call it like a function pointer:
+    ///   auto Add = gCling->getFunction<int(int, int)>("N::add");
+    ///   if (Add) Add(1, 2);
+    ///
+    ///\param[in] name - The qualified name of the function; overloads are
+    ///   resolved by the parameter types of Signature, which must match those
+    ///   of the function, including its return type.
+    ///\returns The function, null if none matches or it cannot be compiled.
+    ///
+    template <class Signature>
+    Function<Signature> getFunction(llvm::StringRef name) {
+      void* Address = nullptr;
+      CallWrapper_t Wrapper
+        = getFunctionWrapper(name, internal::spellType<Signature>(), Address);
+      return Function<Signature>(Wrapper, Address);
+    }
+
+    ///\brief Returns the cache entry for the value printing wrapper of a
+    /// canonical type. Used by the value printer; the entries are of type
+    /// std::string()(const void* pVal). Dropped on unload() and by
+    /// clearPrintValueWrappers().
+    void*& getPrintValueWrapper(const clang::Type* CanonTy) {
+      return m_PrintValueWrappers[CanonTy];
+    }
+
     ///\brief Gets the address of an existing global and whether it was JITted.
     ///
     /// JIT symbols might not be immediately convertible to e.g. a function
@@ -782,6 +1613,22 @@ namespace cling {
     ///
     void* getAddressOfGlobal(llvm::StringRef SymName, bool* fromJIT = 0) const;
 
+    ///\brief Mangles a global for getAddressOfGlobal(const SymbolHandle&),
+    /// to look it up repeatedly without mangling it each time.
+    ///
+    ///\param[in]  GD - the global's Decl
+    ///
+    SymbolHandle getSymbolHandle(const clang::GlobalDecl& GD) const;
+
+    ///\brief Gets the address of the global of a SymbolHandle and whether it
+    /// was JITted. Returns the address found last time, unless code was
+    /// unloaded or libraries were loaded or unloaded since.
+    ///
+    ///\param[in]  H       - the global, from getSymbolHandle()
+    ///\param[out] fromJIT - whether the symbol was JITted.
+    ///
+    void* getAddressOfGlobal(const SymbolHandle& H, bool* fromJIT = 0) const;
+
     ///\brief Get a given macro definition by name.
     ///
     ///\param[in]  Name - the name of the macro to look for
@@ -813,9 +1660,61 @@ namespace cling {
     ///
     void runAtExitFuncs();
 
+    ///\brief Waits for the threads of the interpreter to go idle, so that
+    /// none holds a lock or is amid work when fork() is called: the library
+    /// loads, the evaluations of evaluateAsync() and the compile jobs of the
+    /// JIT. The executor of evaluateAsync() must not be the calling thread.
+    ///
+    void prepareFork();
+
+    ///\brief Goes on in a child that fork() made of the process, of which
+    /// only the calling thread exists: the threads that the interpreter
+    /// uses are made anew, the work queued for the parent's is dropped.
+    /// Call it first thing in the child, having called prepareFork() before
+    /// the fork().
+    ///
+    void onForked();
+
+    ///\brief Ends the process with ExitCode without tearing down the
+    /// interpreter: runs the atexit functions and static destructors of the
+    /// interpreted code and writes what the session writes when it ends,
+    /// e.g. the time trace, flushes the output, then calls std::_Exit().
+    /// The atexit functions of the process itself do not run.
+    ///
+    [[noreturn]] void fastExit(int ExitCode);
+
     void GenerateAutoLoadingMap(llvm::StringRef inFile, llvm::StringRef outFile,
                                 bool enableMacros = false, bool enableLogs = true);
 
+    ///\brief Writes the forward declarations of inFile as a binary index,
+    /// from which loadAutoLoadingIndex() declares only what gets looked up.
+    ///
+    ///\returns false if inFile cannot be parsed or outFile written.
+    ///
+    bool GenerateAutoLoadingIndex(llvm::StringRef inFile,
+                                  llvm::StringRef outFile);
+
+    ///\brief Writes the forward declarations of all inFiles to outFile, as
+    /// a textual map or, if outFile ends in ".clidx", as an index. Each of
+    /// inFiles is parsed in an interpreter of its own, by Jobs threads (0:
+    /// one per core); declarations shared by several headers are written
+    /// once, and the result is independent of Jobs.
+    ///
+    ///\returns false if any of inFiles cannot be parsed, in which case the
+    /// declarations of the others are written nonetheless, or if outFile
+    /// cannot be written.
+    ///
+    bool GenerateAutoLoadingMaps(llvm::ArrayRef<std::string> inFiles,
+                                 llvm::StringRef outFile, unsigned Jobs = 0);
+
+    ///\brief Makes the names of an index written by GenerateAutoLoadingIndex()
+    /// known, declaring them upon their first lookup; unlike #including an
+    /// autoloading map, nothing is parsed before that.
+    ///
+    ///\returns false if File is not a valid index.
+    ///
+    bool loadAutoLoadingIndex(llvm::StringRef File);
+
     void forwardDeclare(Transaction& T, clang::Preprocessor& P,
                         clang::ASTContext& Ctx,
                         llvm::raw_ostream& out,
@@ -15,6 +15,9 @@
 #include "clang/Basic/SourceManager.h"
 
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/StringRef.h"
 
 #include <memory>
 
@@ -42,6 +45,43 @@ namespace cling {
   class InterpreterPPCallbacks;
   class Transaction;
 
+  ///\brief The names that a callback's LookupObject() overloads for names
+  /// can resolve, as hashes: lookups of names not in it skip the callback.
+  ///
+  /// Failing lookups are frequent as clang probes enclosing scopes, and each
+  /// one otherwise reaches every callback; this rejects them with one hash
+  /// and one probe. A name whose hash collides with one in the set still
+  /// reaches the callback, which then has to reject it itself.
+  ///
+  class LookupNameFilter {
+    llvm::DenseSet<uint64_t> m_Hashes;
+
+  public:
+    ///\brief The hash of Name: never 0, nor one of the keys that DenseSet
+    /// reserves.
+    static uint64_t hash(llvm::StringRef Name) {
+      return (uint64_t(llvm::hash_value(Name)) >> 1) | 1;
+    }
+
+    ///\brief The hash of a name or 0 for the names that are not
+    /// identifiers, which filtered callbacks do not resolve.
+    static uint64_t hash(clang::DeclarationName Name) {
+      if (const clang::IdentifierInfo* II = Name.getAsIdentifierInfo())
+        return hash(II->getName());
+      return 0;
+    }
+
+    void insert(llvm::StringRef Name) { m_Hashes.insert(hash(Name)); }
+    void clear() { m_Hashes.clear(); }
+    bool empty() const { return m_Hashes.empty(); }
+
+    ///\brief Whether the name of Hash, as returned by hash(), may be in the
+    /// set; has false positives, never false negatives.
+    bool mightContain(uint64_t Hash) const {
+      return Hash && m_Hashes.count(Hash);
+    }
+  };
+
   /// \brief  This interface provides a way to observe the actions of the
   /// interpreter as it does its thing.  Clients can define their hooks here to
   /// implement interpreter level tools.
@@ -130,6 +170,20 @@ namespace cling {
     virtual bool LookupObject(const clang::DeclContext*, clang::DeclarationName);
     virtual bool LookupObject(clang::TagDecl*);
 
+    ///\brief The names that the LookupObject() overloads for names can
+    /// resolve; lookups of other names do not call them. Null, the default,
+    /// if they might resolve any name, as for the dynamic scopes.
+    virtual const LookupNameFilter* getLookupNameFilter() const {
+      return nullptr;
+    }
+
+    ///\brief Whether the LookupObject() overloads for names might resolve
+    /// the name of Hash, as returned by LookupNameFilter::hash().
+    bool mightLookup(uint64_t Hash) const {
+      const LookupNameFilter* Filter = getLookupNameFilter();
+      return !Filter || Filter->mightContain(Hash);
+    }
+
     /// \brief This callback is invoked whenever the interpreter failed to load a library.
     ///
     /// \param[in] - Error message and parameters passed to loadLibrary
@@ -0,0 +1,159 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_INTERPRETER_POOL_H
+#define CLING_INTERPRETER_POOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace llvm {
+  class raw_ostream;
+}
+
+namespace cling {
+  class Interpreter;
+  class Transaction;
+
+  ///\brief A fixed number of interpreters, set up once and handed out to
+  /// threads that evaluate independent requests.
+  ///
+  /// All interpreters are created with the same arguments and then run the
+  /// same prelude; the last transaction of the prelude is their checkpoint.
+  /// When a lease ends, whatever was declared since the checkpoint is
+  /// unloaded, such that the next user gets the interpreter as it was after
+  /// the prelude. An interpreter that cannot be reset this way is replaced by
+  /// a new one.
+  ///
+  /// An interpreter is used by one thread at a time; different interpreters
+  /// of the pool can be used concurrently.
+  ///
+  class InterpreterPool {
+  public:
+    ///\brief Exclusive use of an interpreter of the pool; gives it back
+    /// when destroyed.
+    class Lease {
+      InterpreterPool* m_Pool;
+      unsigned m_Slot;
+
+      friend class InterpreterPool;
+      Lease(InterpreterPool* Pool, unsigned Slot):
+        m_Pool(Pool), m_Slot(Slot) {}
+
+    public:
+      Lease(): m_Pool(nullptr), m_Slot(0) {}
+      Lease(Lease&& Other): m_Pool(Other.m_Pool), m_Slot(Other.m_Slot) {
+        Other.m_Pool = nullptr;
+      }
+      Lease& operator=(Lease&& Other);
+      Lease(const Lease&) = delete;
+      Lease& operator=(const Lease&) = delete;
+      ~Lease() { release(); }
+
+      ///\brief Whether this lease holds an interpreter.
+      explicit operator bool() const { return m_Pool; }
+
+      Interpreter& operator*() const;
+      Interpreter* operator->() const { return &**this; }
+      Interpreter* get() const { return m_Pool ? &**this : nullptr; }
+
+      ///\brief Resets the interpreter to its checkpoint and gives it back
+      /// to the pool before the lease is destroyed.
+      void release();
+    };
+
+    ///\brief Utilization of the pool since its creation.
+    struct Stats {
+      unsigned Size;        ///< Interpreters in the pool.
+      unsigned InUse;       ///< Interpreters currently leased.
+      unsigned PeakInUse;   ///< Most interpreters leased at once.
+      uint64_t Leases;      ///< Leases handed out.
+      uint64_t Waits;       ///< Leases that had to wait for a release.
+      uint64_t Replacements; ///< Interpreters that failed to reset.
+      uint64_t WaitNs;      ///< Time spent waiting for a release.
+      uint64_t ResetNs;     ///< Time spent resetting to the checkpoint.
+      uint64_t LeasedNs;    ///< Time interpreters spent leased.
+    };
+
+  private:
+    struct Slot;
+
+    ///\brief Arguments to create interpreters with.
+    std::vector<std::string> m_Args;
+    std::string m_LLVMDir;
+    bool m_HasLLVMDir;
+
+    ///\brief The code every interpreter runs before its checkpoint.
+    std::string m_Prelude;
+
+    std::vector<std::unique_ptr<Slot>> m_Slots;
+
+    ///\brief Slots that can be leased.
+    std::vector<unsigned> m_Free;
+
+    mutable std::mutex m_Mutex;
+    std::condition_variable m_Released;
+    Stats m_Stats;
+
+    ///\brief Creates the interpreter of S and sets its checkpoint.
+    ///\returns false if the interpreter or its prelude failed.
+    bool setUp(Slot& S);
+
+    ///\brief Unloads what S's interpreter got since its checkpoint, or
+    /// replaces the interpreter if that is not possible.
+    void reset(Slot& S);
+
+    ///\brief Leases the next free slot; m_Mutex must be held by Lock.
+    Lease take(std::unique_lock<std::mutex>& Lock);
+
+    ///\brief Resets the interpreter of slot Index and makes it available.
+    void giveBack(unsigned Index);
+
+  public:
+    ///\brief Creates Size interpreters from the same arguments, each running
+    /// Prelude (passed to Interpreter::process()) before its checkpoint.
+    ///
+    ///\param[in] Size - number of interpreters; at least one is created.
+    ///\param[in] argc - no. of args, as for the Interpreter.
+    ///\param[in] argv - arguments, as for the Interpreter.
+    ///\param[in] llvmdir - as for the Interpreter.
+    ///\param[in] Prelude - the code shared by all uses of the interpreters.
+    ///
+    InterpreterPool(unsigned Size, int argc, const char* const* argv,
+                    const char* llvmdir = 0,
+                    const std::string& Prelude = std::string());
+    ~InterpreterPool();
+
+    InterpreterPool(const InterpreterPool&) = delete;
+    InterpreterPool& operator=(const InterpreterPool&) = delete;
+
+    ///\brief Whether all interpreters and their preludes were set up.
+    bool isValid() const;
+
+    ///\brief Leases an interpreter, waiting for one to be released if all
+    /// are in use.
+    Lease acquire();
+
+    ///\brief Leases an interpreter if one is available right away.
+    ///\returns an empty Lease otherwise.
+    Lease tryAcquire();
+
+    unsigned size() const { return m_Slots.size(); }
+
+    Stats getStats() const;
+
+    ///\brief Prints the utilization of the pool.
+    void printStats(llvm::raw_ostream& Out) const;
+  };
+} // namespace cling
+
+#endif // CLING_INTERPRETER_POOL_H
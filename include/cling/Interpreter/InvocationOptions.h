@@ -60,6 +60,9 @@ namespace cling {
     unsigned CxxModules : 1;
     unsigned CUDAHost : 1;
     unsigned CUDADevice : 1;
+    /// \brief -march, -mcpu or --target was given: the code is compiled for
+    /// that target, not for the host's CPU and its features.
+    unsigned TargetCPU : 1;
     /// \brief The output path of any C++ PCMs we're building on demand.
     /// Equal to ModuleCachePath in the HeaderSearchOptions.
     std::string CachePath;
@@ -70,6 +73,9 @@ namespace cling {
     /// \brief Architecture level of the CUDA gpu. Necessary for the
     /// NVIDIA fatbinary tool.
     std::string CUDAGpuArch;
+    /// \brief All architecture levels given, in order; CUDAGpuArch is the
+    /// last one.
+    std::vector<std::string> CUDAGpuArchs;
     /// \brief Contains arguments, which will passed to the nvidia tool
     /// fatbinary.
     std::vector<std::string> CUDAFatbinaryArgs;
@@ -90,6 +96,49 @@ namespace cling {
     std::vector<std::string> LibsToLoad;
     std::vector<std::string> LibSearchPath;
     std::vector<std::string> Inputs;
+
+    /// \brief The precompiled header of the runtime universe and the
+    ///        SnapshotPrelude: loaded if it exists, written otherwise.
+    std::string SnapshotFile;
+    std::vector<std::string> SnapshotPrelude;
+
+    /// \brief The class template specializations the snapshot explicitly
+    ///        instantiates, e.g. "std::vector<int>": later sessions read
+    ///        their members from it instead of instantiating them again.
+    std::vector<std::string> SnapshotInstantiations;
+
+    /// \brief The autoloading map to generate from the Inputs, instead of
+    ///        running them, and the number of threads doing so (0: one per
+    ///        core).
+    std::string AutoloadMapFile;
+    unsigned AutoloadMapJobs;
+
+    /// \brief The Unix socket to serve --fork-client jobs on, after running
+    ///        the Inputs as their prelude.
+    std::string ForkServerSocket;
+
+    /// \brief How many Inputs to run in parallel, each in its own fork of
+    ///        the interpreter, see -j (0: one per core). With 1, they run
+    ///        one after the other in the same interpreter.
+    unsigned Jobs;
+
+    /// \brief The directories whose headers get their function template
+    ///        bodies parsed on instantiation only, see --defer-bodies.
+    std::vector<std::string> DeferBodiesDirs;
+
+    /// \brief The directories whose headers keep their pointer checks when
+    ///        ScopedPointerChecks is set, see --pointer-checks-dir and
+    ///        `#pragma cling add_pointer_checks_path`.
+    std::vector<std::string> PointerChecksDirs;
+
+    /// \brief The milliseconds the optimization of each input may take,
+    ///        see --compile-budget and CompilationOptions::CompileBudgetMs.
+    unsigned CompileBudgetMs;
+
+    /// \brief Where to write the time trace of the session, see
+    ///        --time-trace.
+    std::string TimeTraceFile;
+
     CompilerOptions CompilerOpts;
 
     unsigned ErrorOut : 1;
@@ -97,6 +146,21 @@ namespace cling {
     unsigned ShowVersion : 1;
     unsigned Help : 1;
     unsigned NoRuntime : 1;
+    unsigned LazyFunctions : 1;
+    unsigned DeferSystemBodies : 1;
+    /// \brief Only the code of the inputs and of the PointerChecksDirs gets
+    ///        its dereferences checked, not the one of the other headers,
+    ///        see --pointer-checks-input and `#pragma cling
+    ///        pointer_checks(input)`.
+    unsigned ScopedPointerChecks : 1;
+    /// \brief Diagnostics go as records to a callback instead of being
+    ///        formatted for display, see --structured-diagnostics.
+    unsigned StructuredDiagnostics : 1;
+    /// \brief The driver ends the process through Interpreter::fastExit(),
+    ///        see --fast-exit.
+    unsigned FastExit : 1;
+    /// \brief A piped stdin runs in batches, see --batch-stdin.
+    unsigned BatchStdin : 1;
     bool Verbose() const { return CompilerOpts.Verbose; }
 
     static void PrintHelp();
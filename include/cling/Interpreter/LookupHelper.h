@@ -10,12 +10,16 @@
 #ifndef CLING_LOOKUP_HELPER_H
 #define CLING_LOOKUP_HELPER_H
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/SmallVector.h"
 
 #include <array>
 #include <map>
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace clang {
   class ClassTemplateDecl;
@@ -31,6 +35,7 @@ namespace clang {
 
 namespace llvm {
   template<typename T, unsigned N> class SmallVector;
+  template<typename Fn> class function_ref;
 }
 
 namespace cling {
@@ -55,6 +60,22 @@ namespace cling {
       NoDiagnostics,
       WithDiagnostics
     };
+
+    ///\brief The result of one lookup of a batch, see findScopes().
+    template <typename T>
+    struct BatchResult {
+      T Result{}; ///< What the single lookup returns.
+      /// The messages of the diagnostics the lookup issued, if asked for.
+      std::vector<std::string> Diagnostics;
+    };
+
+    ///\brief A query of findFunctionProtos(), see findFunctionProto().
+    struct FunctionProtoQuery {
+      const clang::Decl* Scope; ///< The scope searched for the function.
+      llvm::StringRef Name;     ///< The name of the function.
+      llvm::StringRef Proto;    ///< Its parameter list, e.g. "size_t,int".
+      bool ObjectIsConst;       ///< Whether it is called on a const object.
+    };
   private:
     std::unique_ptr<clang::Parser> m_Parser;
     Interpreter* m_Interpreter; // we do not own.
@@ -67,17 +88,102 @@ namespace cling {
     // We really need llvm::hash_code->clang::FileID mapping but we put opaque
     // source location as unsigned to compute the FileID when needed.
     std::map<llvm::hash_code, unsigned> m_ParseBufferCache;
+    ///\brief A buffer of fixed size, and thus of fixed source locations,
+    /// that a lookup writes its code into instead of creating a FileID in
+    /// the SourceManager. Used by StartParsingRAII.
+    struct PooledBuffer {
+      /// The opaque start location of its FileID, see m_ParseBufferCache.
+      unsigned FileStartLoc;
+      char* Data;
+    };
+    std::vector<PooledBuffer> m_PooledBuffers;
+    /// The number of pooled buffers used by the lookups running: nested
+    /// lookups and reparses use the next ones.
+    unsigned m_PooledBuffersInUse = 0;
+    /// Whether lookups use the pooled buffers; CLING_LOOKUP_BUFFER_POOL=0
+    /// turns them off.
+    bool m_UsePooledBuffers = true;
     /// Number of times we hit the cache.
     unsigned m_CacheHits = 0;
     /// Number of times we missed the cache.
     unsigned m_TotalParseRequests = 0;
     /// If we are called recursively.
     bool IsRecursivelyRunning = false;
+    /// Whether a batch lookup pushed the transaction of its items.
+    mutable bool m_InBatch = false;
+
+    ///\brief A cached lookup result: the found declaration or the opaque
+    /// QualType, and for findScope() the found type.
+    struct CachedLookup {
+      const void* Result;
+      const clang::Type* Type;
+    };
+    /// The results of findType(), findScope(), findDataMember(),
+    /// findFunctionProto() and matchFunctionProto(), keyed by the query.
+    mutable std::unordered_map<std::string, CachedLookup> m_LookupCache;
+    /// The DeclUnloader generation m_LookupCache was filled in.
+    mutable unsigned m_LookupCacheGeneration = 0;
+    /// Number of lookups answered by m_LookupCache.
+    mutable unsigned m_LookupCacheHits = 0;
+    /// Whether to use m_LookupCache, see setCaching().
+    bool m_UseLookupCache = true;
+
+    ///\brief Whether the current lookup may use m_LookupCache: not while
+    /// parsing, as declarations are visible before they are committed.
+    /// Flushes the cache if declarations were unloaded since it was filled.
+    bool canUseCache() const;
+
+    ///\brief Returns the cached result for Key or null.
+    const CachedLookup* getCached(const std::string& Key) const;
+
+    ///\brief Caches the result of a lookup; failures are only cached if
+    /// they were not diagnosed, such that repeating them diagnoses again.
+    void addCached(std::string Key, const void* Result,
+                   const clang::Type* Type, DiagSetting diagOnOff) const;
+
+    ///\brief Whether read-only queries can answer now.
+    bool mayQueryReadOnly() const;
+
+    ///\brief Returns the cached result for Key or null, without changing
+    /// the cache.
+    const CachedLookup* getCachedReadOnly(const std::string& Key) const;
+
+    clang::QualType findTypeUncached(llvm::StringRef typeName,
+                                     DiagSetting diagOnOff) const;
+    const clang::Decl* findScopeUncached(llvm::StringRef className,
+                                         DiagSetting diagOnOff,
+                                         const clang::Type** resultType,
+                                         bool instantiateTemplate) const;
+    const clang::ValueDecl*
+    findDataMemberUncached(const clang::Decl* scopeDecl,
+                           llvm::StringRef dataName,
+                           DiagSetting diagOnOff) const;
+
+    ///\brief Runs Lookup for the items Todo of a batch, in one transaction.
+    /// The diagnostics of item I go to DiagnosticsOf(I) rather than out.
+    void runBatch(llvm::ArrayRef<unsigned> Todo, DiagSetting diagOnOff,
+                  llvm::function_ref<std::vector<std::string>&(unsigned)>
+                    DiagnosticsOf,
+                  llvm::function_ref<void(unsigned)> Lookup) const;
 
   public:
     LookupHelper(clang::Parser* P, Interpreter* interp);
     ~LookupHelper();
 
+    ///\brief Enables or disables caching the results of findType(),
+    /// findScope(), findDataMember(), findFunctionProto() and
+    /// matchFunctionProto(). It is enabled unless $CLING_LOOKUP_CACHE is "0".
+    ///
+    void setCaching(bool Caching) {
+      m_UseLookupCache = Caching;
+      clearCache();
+    }
+
+    ///\brief Forgets all cached lookup results. Called whenever declarations
+    /// are committed or unloaded, as they might change the results.
+    ///
+    void clearCache() { m_LookupCache.clear(); }
+
     ///\brief Lookup a type by name, starting from the global
     /// namespace.
     ///
@@ -106,6 +212,25 @@ namespace cling {
                                  bool instantiateTemplate = true) const;
 
 
+    ///\brief Lookup a class, struct, union, enum or namespace by qualified
+    /// name like findScope(), but without parsing, deserializing, completing
+    /// or instantiating anything: it only finds declarations already in the
+    /// lookup tables of their contexts. It does not change the interpreter
+    /// and can be called concurrently, the interpreter's state lock is held
+    /// shared.
+    ///
+    ///\param [in] className - The qualified name of the scope; names with
+    ///                        template arguments are never answered.
+    ///\param [out] answered - Whether the result is what findScope() would
+    ///                        return. If not, call findScope().
+    ///\param [out] resultType - See findScope().
+    ///\returns The found declaration or null.
+    ///
+    const clang::Decl* findScopeReadOnly(llvm::StringRef className,
+                                         bool& answered,
+                                         const clang::Type** resultType = 0)
+      const;
+
     ///\brief Lookup a class template declaration by name, starting from
     /// the global namespace, also handles struct, union, namespace, and enum.
     ///
@@ -127,6 +252,19 @@ namespace cling {
                                            llvm::StringRef dataName,
                                            DiagSetting diagOnOff) const;
 
+    ///\brief Lookup a data member like findDataMember(), but without
+    /// changing the interpreter, see findScopeReadOnly().
+    ///
+    ///\param [in] scopeDecl - the scope (namespace or tag) that is searched for
+    ///   the data member.
+    ///\param [in] dataName  - the name of the data member to find.
+    ///\param [out] answered - Whether the result is what findDataMember()
+    ///   would return. If not, call findDataMember().
+    ///\returns The value/data member found or null.
+    const clang::ValueDecl* findDataMemberReadOnly(const clang::Decl* scopeDecl,
+                                                   llvm::StringRef dataName,
+                                                   bool& answered) const;
+
     ///\brief Lookup a function template based on its Decl(Context), name.
     ///
     ///\param [in] scopeDecl - the scope (namespace or tag) that is searched for
@@ -248,11 +386,56 @@ namespace cling {
     bool hasFunction(const clang::Decl* scopeDecl, llvm::StringRef funcName,
                      DiagSetting diagOnOff) const;
 
+    ///\brief Lookup many types like findType(), in one transaction rather
+    /// than one per type.
+    ///
+    /// A lookup failing with errors rolls back what the lookups before it
+    /// found in the transaction; they are redone in a new one, and it is
+    /// redone on its own, such that each result is that of findType().
+    ///
+    ///\param [in] typeNames - The types to lookup.
+    ///\param [in] diagOnOff - Whether to diagnose lookup failures; the
+    ///   diagnostics are returned with the results instead of reported.
+    ///\returns The result of each type, in order.
+    ///
+    std::vector<BatchResult<clang::QualType>>
+    findTypes(llvm::ArrayRef<std::string> typeNames,
+              DiagSetting diagOnOff) const;
+
+    ///\brief Lookup many scopes like findScope(), in one transaction rather
+    /// than one per scope, see findTypes().
+    ///
+    ///\param [in] classNames - The scopes to lookup.
+    ///\param [in] diagOnOff - Whether to diagnose lookup failures; the
+    ///   diagnostics are returned with the results instead of reported.
+    ///\param [out] resultTypes - If non-null, the type of each scope, see
+    ///   findScope().
+    ///\param [in] instantiateTemplate - See findScope().
+    ///\returns The result of each scope, in order.
+    ///
+    std::vector<BatchResult<const clang::Decl*>>
+    findScopes(llvm::ArrayRef<std::string> classNames, DiagSetting diagOnOff,
+               std::vector<const clang::Type*>* resultTypes = nullptr,
+               bool instantiateTemplate = true) const;
+
+    ///\brief Lookup many functions like findFunctionProto(), in one
+    /// transaction rather than one per function, see findTypes().
+    ///
+    ///\param [in] Queries - The functions to lookup.
+    ///\param [in] diagOnOff - Whether to diagnose lookup failures; the
+    ///   diagnostics are returned with the results instead of reported.
+    ///\returns The result of each query, in order.
+    ///
+    std::vector<BatchResult<const clang::FunctionDecl*>>
+    findFunctionProtos(llvm::ArrayRef<FunctionProtoQuery> Queries,
+                       DiagSetting diagOnOff) const;
+
     ///\brief Retrieve the StringType of given Type.
     StringType getStringType(const clang::Type* Type);
 
     void printStats() const;
     friend class StartParsingRAII;
+    friend class LookupTransactionRAII;
   };
 
 } // end namespace
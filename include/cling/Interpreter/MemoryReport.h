@@ -0,0 +1,77 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_MEMORY_REPORT_H
+#define CLING_MEMORY_REPORT_H
+
+#include <cstddef>
+#include <vector>
+
+namespace llvm {
+  class raw_ostream;
+}
+
+namespace cling {
+  class Transaction;
+
+  ///\brief The memory that a Transaction allocated and keeps alive.
+  ///
+  /// The parser records the AST, source and IR figures of each transaction,
+  /// not including its nested transactions. The JIT figures depend on what
+  /// got compiled so far; Interpreter::getMemoryReport() fills them in.
+  ///
+  struct MemoryStats {
+    size_t ASTBytes = 0;       ///< Allocated in the ASTContext.
+    size_t SourceBytes = 0;    ///< Of the SourceManager buffers entered.
+    size_t IRInstructions = 0; ///< Of its llvm::Module, when generated.
+    size_t JITCodeBytes = 0;   ///< Of its objects' code sections.
+    size_t JITRODataBytes = 0; ///< Of its objects' read-only data sections.
+    size_t JITRWDataBytes = 0; ///< Of its objects' read-write data sections.
+
+    MemoryStats& operator+=(const MemoryStats& Other) {
+      ASTBytes += Other.ASTBytes;
+      SourceBytes += Other.SourceBytes;
+      IRInstructions += Other.IRInstructions;
+      JITCodeBytes += Other.JITCodeBytes;
+      JITRODataBytes += Other.JITRODataBytes;
+      JITRWDataBytes += Other.JITRWDataBytes;
+      return *this;
+    }
+
+    size_t getJITBytes() const {
+      return JITCodeBytes + JITRODataBytes + JITRWDataBytes;
+    }
+  };
+
+  ///\brief The memory of the transactions of an Interpreter, see
+  /// Interpreter::getMemoryReport().
+  ///
+  class MemoryReport {
+  public:
+    struct Entry {
+      const Transaction* T;
+      ///\brief Including the nested transactions of T.
+      MemoryStats Stats;
+    };
+
+    ///\brief The committed top-level transactions, in order.
+    std::vector<Entry> Transactions;
+
+    ///\brief The JIT memory of objects that no live transaction owns, e.g.
+    /// the functions compiled upon their first call.
+    MemoryStats Unattributed;
+
+    MemoryStats getTotal() const;
+
+    ///\brief Prints one line per transaction, numbered from the first, then
+    /// the unattributed memory and the total.
+    void print(llvm::raw_ostream& Out) const;
+  };
+} // end namespace cling
+
+#endif // CLING_MEMORY_REPORT_H
@@ -0,0 +1,32 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+#ifndef CLING_NULL_DEREF_RUNTIME_UNIVERSE_H
+#define CLING_NULL_DEREF_RUNTIME_UNIVERSE_H
+
+#if !defined(__CLING__)
+#error "This file must not be included by compiled programs."
+#endif
+
+// The part of the runtime universe that the pointer checks of
+// NullDerefProtectionTransformer call. The interpreter declares it before
+// the first input that gets checked.
+
+#include "cling/Interpreter/Visibility.h"
+
+extern "C" {
+  ///\brief a function that throws InvalidDerefException. This allows to 'hide'
+  /// the definition of the exceptions from the RuntimeUniverse and allows us to
+  /// run cling in -no-rtti mode.
+  ///
+  CLING_LIB_EXPORT
+  void* cling_runtime_internal_throwIfInvalidPointer(void* Sema,
+                                                    void* Expr,
+                                                    const void* Arg);
+}
+
+#endif // CLING_NULL_DEREF_RUNTIME_UNIVERSE_H
@@ -0,0 +1,86 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_PROFILE_REPORT_H
+#define CLING_PROFILE_REPORT_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace llvm {
+  class raw_ostream;
+}
+
+namespace cling {
+
+  ///\brief Where the CPU time of the thread that started the sampling went,
+  /// see Interpreter::startProfiling().
+  ///
+  /// A SIGPROF timer interrupts the thread while it uses CPU time, and the
+  /// call stack it was interrupted in is walked through the frame pointers;
+  /// callers of frames without frame pointer are missed out. The addresses
+  /// are symbolized with the JITted functions, else with the symbols of the
+  /// libraries.
+  ///
+  class ProfileReport {
+  public:
+    struct Function {
+      ///\brief Demangled, if possible.
+      std::string Name;
+      ///\brief The position among the committed top-level transactions,
+      /// like "#3", of the input that defined the JITted function, or the
+      /// library of the compiled one; empty if unknown.
+      std::string Origin;
+      ///\brief The samples with the function on top of the stack.
+      size_t Self = 0;
+      ///\brief The samples with the function anywhere on the stack.
+      size_t Total = 0;
+    };
+
+    ///\brief A calling context: the samples of Function called through the
+    /// contexts above it.
+    struct Node {
+      ///\brief The index in Functions.
+      size_t Function;
+      size_t Samples;
+      std::vector<Node> Children;
+    };
+
+    ///\brief Whether the platform can sample at all.
+    bool Enabled = false;
+
+    ///\brief Whether the samples are still being taken.
+    bool Running = false;
+
+    ///\brief The microseconds of CPU time between samples.
+    unsigned Interval = 0;
+
+    size_t Samples = 0;
+
+    ///\brief The samples not taken because the buffer was full.
+    size_t Dropped = 0;
+
+    ///\brief The functions of the samples, by decreasing Self then Total.
+    std::vector<Function> Functions;
+
+    ///\brief The calling contexts of the samples in JITted code, from the
+    /// outermost JITted frame of their stacks.
+    std::vector<Node> CallTree;
+
+    ///\brief The samples without JITted code on their stacks, e.g. of the
+    /// compilation.
+    size_t OutsideJIT = 0;
+
+    ///\brief Prints the flat profile, then the call tree without the
+    /// contexts below MinPercent of the samples.
+    void print(llvm::raw_ostream& Out, double MinPercent = 1.0) const;
+  };
+} // end namespace cling
+
+#endif // CLING_PROFILE_REPORT_H
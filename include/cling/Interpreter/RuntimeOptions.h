@@ -14,11 +14,65 @@ namespace cling {
     /// \brief Interpreter configuration bits that can be changed at run-time
     /// by the user, e.g. to enable/disable extensions.
     struct RuntimeOptions {
-      RuntimeOptions() : AllowRedefinition(0) {}
+      RuntimeOptions()
+        : AllowRedefinition(0), CacheExpressions(0), CacheCells(0),
+          FossilizeWrappers(0), SignalPointerChecks(0), NoUnwindWrappers(0),
+          AsyncLibraryLoads(0), DeferHeaderInitializers(0),
+          MaxPrintedElements(100) {}
 
       /// \brief Allow the user to redefine entities (requests enabling the
       /// `DefinitionShadower` AST transformer).
       bool AllowRedefinition : 1;
+
+      /// \brief Re-run the wrapper compiled for an expression when the same
+      /// expression is evaluated again and no declaration changed meanwhile,
+      /// instead of compiling it anew. Function-local statics of the
+      /// expression then keep their values across evaluations.
+      bool CacheExpressions : 1;
+
+      /// \brief Do not compile an input that is processed again, e.g. a
+      /// notebook cell, as long as no other input redeclared what it declares
+      /// or uses: its declarations are still in effect, and its wrapper, if
+      /// any, runs again. Inputs that define variables, whose initializers
+      /// must run again, are compiled anew; so is everything after an input
+      /// that defines macros.
+      bool CacheCells : 1;
+
+      /// \brief Once the wrapper of an expression that declared nothing else
+      /// has run, free its IR and its input buffer. The transaction can still
+      /// be unloaded, but its machine code then stays in the JIT.
+      bool FossilizeWrappers : 1;
+
+      /// \brief Instead of checking each dereferenced pointer before the
+      /// access, run wrappers under a SIGSEGV / SIGBUS handler that turns a
+      /// fault into a cling::InvalidDerefException. Valid accesses then cost
+      /// nothing; the frames of the faulting wrapper are not unwound. Also
+      /// set by `#pragma cling pointer_checks(signals)`.
+      bool SignalPointerChecks : 1;
+
+      /// \brief Compile the code of the inputs that provably cannot throw,
+      /// as it only calls functions that do not, as nounwind and without
+      /// unwind tables or landing pads: the JIT then registers no EH frames
+      /// for it. The inputs that might throw still propagate exceptions.
+      bool NoUnwindWrappers : 1;
+      /// \brief Load the libraries of `#pragma cling load` on a thread of
+      /// their own while the input is parsed, waiting for them only once its
+      /// code is handed to the JIT. Their static constructors must then not
+      /// use the interpreter. See DynamicLibraryManager::loadLibraryAsync().
+      bool AsyncLibraryLoads : 1;
+      /// \brief Do not compile the code of a transaction that only declares
+      /// what its headers do, e.g. the one of an `#include`, nor run the
+      /// constructors of its globals, until a later transaction or a lookup
+      /// of a symbol needs its code: these constructors then run, in their
+      /// order, before anything else. Including a big header then costs no
+      /// JIT compilation for the globals that the session never uses.
+      bool DeferHeaderInitializers : 1;
+
+      /// \brief The number of elements of a collection or array that the
+      /// value printer shows; it elides the others, showing the size instead.
+      /// Printing a huge collection by accident then neither takes minutes
+      /// nor exhausts memory. 0 prints everything.
+      unsigned MaxPrintedElements;
     };
 
   } // end namespace runtime
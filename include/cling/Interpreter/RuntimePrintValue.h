@@ -16,6 +16,7 @@
 
 #include <cling/Interpreter/Visibility.h>
 
+#include <iterator>
 #include <memory>
 #include <string>
 #include <tuple>
@@ -148,6 +149,15 @@ namespace cling {
   namespace valuePrinterInternal {
     CLING_LIB_EXPORT
     extern const char* const kEmptyCollection;
+
+    // RuntimeOptions::MaxPrintedElements of the interpreter printing.
+    CLING_LIB_EXPORT
+    size_t getMaxPrintedElements();
+
+    // Completes Str, the first elements of a collection of Size elements.
+    inline std::string elideCollection(const std::string& Str, size_t Size) {
+      return "[" + std::to_string(Size) + " elements] " + Str + ", ... }";
+    }
   }
 
   // Collections internal
@@ -182,6 +192,18 @@ namespace cling {
       static constexpr const void* isMap(const void* M) { return nullptr; }
     };
 
+    // The size of a collection, also if it has no size(): std::forward_list.
+    template <typename CollectionType>
+    inline auto collectionSize(const CollectionType* obj, int)
+        -> decltype(obj->size(), size_t()) {
+      return obj->size();
+    }
+
+    template <typename CollectionType>
+    inline size_t collectionSize(const CollectionType* obj, long) {
+      return std::distance(obj->begin(), obj->end());
+    }
+
     // vector, set, deque etc.
     template <typename CollectionType>
     inline auto printValue_impl(
@@ -193,10 +215,14 @@ namespace cling {
       if (iter == iterEnd) return valuePrinterInternal::kEmptyCollection;
 
       const void* M = TypeTest::isMap(obj);
+      const size_t Max = valuePrinterInternal::getMaxPrintedElements();
 
       std::string str("{ ");
       str += printValue(&(*iter), M);
-      while (++iter != iterEnd) {
+      for (size_t N = 1; ++iter != iterEnd; ++N) {
+        if (N == Max)
+          return valuePrinterInternal::elideCollection(str,
+                                                       collectionSize(obj, 0));
         str += ", ";
         str += printValue(&(*iter), M);
       }
@@ -213,9 +239,14 @@ namespace cling {
       auto iter = obj->begin(), iterEnd = obj->end();
       if (iter == iterEnd) return valuePrinterInternal::kEmptyCollection;
 
+      const size_t Max = valuePrinterInternal::getMaxPrintedElements();
+
       std::string str("{ ");
       str += printValue(*iter);
-      while (++iter != iterEnd) {
+      for (size_t N = 1; ++iter != iterEnd; ++N) {
+        if (N == Max)
+          return valuePrinterInternal::elideCollection(str,
+                                                       collectionSize(obj, 0));
         str += ", ";
         str += printValue(*iter);
       }
@@ -236,9 +267,13 @@ namespace cling {
     if (N == 0)
       return valuePrinterInternal::kEmptyCollection;
 
+    const size_t Max = valuePrinterInternal::getMaxPrintedElements();
+
     std::string str = "{ ";
     str += printValue(*obj + 0);
     for (size_t i = 1; i < N; ++i) {
+      if (i == Max)
+        return valuePrinterInternal::elideCollection(str, N);
       str += ", ";
       str += printValue(*obj + i);
     }
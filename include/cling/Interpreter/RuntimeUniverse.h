@@ -21,6 +21,10 @@
 #define __STDC_CONSTANT_MACROS // needed by System/DataTypes.h
 #endif
 
+// The declarations that every input can use. The rest is declared upon the
+// first input needing it: ValueRuntimeUniverse.h, NullDerefRuntimeUniverse.h,
+// DynamicLookupRuntimeUniverse.h and RuntimePrintValue.h.
+
 #ifdef __cplusplus
 
 #include <cling/Interpreter/RuntimeOptions.h>
@@ -51,137 +55,6 @@ namespace cling {
       /// Use instead of SourceLocation() and SourceRange(). This might help,
       /// when clang emits diagnostics on artificially inserted AST node.
       int InterpreterGeneratedCodeDiagnosticsMaybeIncorrect;
-
-
-      ///\brief Set the type of a void expression evaluated at the prompt.
-      ///\param [in] vpI - The cling::Interpreter for Value.
-      ///\param [in] vpQT - The opaque ptr for the clang::QualType of value.
-      ///\param [in] vpT - The opaque ptr for the cling::Transaction.
-      ///\param [out] vpSVR - The Value that is created.
-      ///
-      CLING_LIB_EXPORT
-      void setValueNoAlloc(void* vpI, void* vpSVR, void* vpQT, char vpOn);
-
-      ///\brief Set the value of the GenericValue for the expression
-      /// evaluated at the prompt.
-      ///\param [in] vpI - The cling::Interpreter for Value.
-      ///\param [in] vpQT - The opaque ptr for the clang::QualType of value.
-      ///\param [in] value - The float value of the assignment to be stored
-      ///                    in GenericValue.
-      ///\param [in] vpT - The opaque ptr for the cling::Transaction.
-      ///\param [out] vpSVR - The Value that is created.
-      ///
-      CLING_LIB_EXPORT
-      void setValueNoAlloc(void* vpI, void* vpV, void* vpQT, char vpOn,
-                           float value);
-
-      ///\brief Set the value of the GenericValue for the expression
-      /// evaluated at the prompt.
-      ///\param [in] vpI - The cling::Interpreter for Value.
-      ///\param [in] vpQT - The opaque ptr for the clang::QualType of value.
-      ///\param [in] value - The double value of the assignment to be stored
-      ///                    in GenericValue.
-      ///\param [in] vpT - The opaque ptr for the cling::Transaction.
-      ///\param [out] vpSVR - The Value that is created.
-      ///
-      CLING_LIB_EXPORT
-      void setValueNoAlloc(void* vpI, void* vpV, void* vpQT, char vpOn,
-                           double value);
-
-      ///\brief Set the value of the GenericValue for the expression
-      ///   evaluated at the prompt. Extract through
-      ///   APFloat(ASTContext::getFloatTypeSemantics(QT), const APInt &)
-      ///\param [in] vpI - The cling::Interpreter for Value.
-      ///\param [in] vpQT - The opaque ptr for the clang::QualType of value.
-      ///\param [in] value - The value of the assignment to be stored
-      ///                    in GenericValue.
-      ///\param [in] vpT - The opaque ptr for the cling::Transaction.
-      ///\param [out] vpSVR - The Value that is created.
-      ///
-      CLING_LIB_EXPORT
-      void setValueNoAlloc(void* vpI, void* vpV, void* vpQT, char vpOn,
-                           long double value);
-
-      ///\brief Set the value of the GenericValue for the expression
-      /// evaluated at the prompt.
-      /// We are using unsigned long long instead of uint64, because we don't
-      /// want to #include the header.
-      ///\param [in] vpI - The cling::Interpreter for Value.
-      ///\param [in] vpQT - The opaque ptr for the clang::QualType of value.
-      ///\param [in] value - The uint64_t value of the assignment to be stored
-      ///                    in GenericValue.
-      ///\param [in] vpT - The opaque ptr for the cling::Transaction.
-      ///\param [out] vpSVR - The Value that is created.
-      ///
-      CLING_LIB_EXPORT
-      void setValueNoAlloc(void* vpI, void* vpV, void* vpQT, char vpOn,
-                           unsigned long long value);
-
-      ///\brief Set the value of the GenericValue for the expression
-      /// evaluated at the prompt.
-      ///\param [in] vpI - The cling::Interpreter for Value.
-      ///\param [in] vpQT - The opaque ptr for the clang::QualType of value.
-      ///\param [in] value - The void* value of the assignment to be stored
-      ///                    in GenericValue.
-      ///\param [in] vpT - The opaque ptr for the cling::Transaction.
-      ///\param [out] vpV - The Value that is created.
-      ///
-      CLING_LIB_EXPORT
-      void setValueNoAlloc(void* vpI, void* vpV, void* vpQT, char vpOn,
-                           const void* value);
-
-      ///\brief Set the value of the Generic value and return the address
-      /// for the allocated storage space.
-      ///\param [in] vpI - The cling::Interpreter for Value.
-      ///\param [in] vpQT - The opaque ptr for the clang::QualType of value.
-      ///\param [in] vpT - The opaque ptr for the cling::Transaction.
-      ///\param [out] vpV - The Value that is created.
-      ///
-      ///\returns the address where the value should be put.
-      ///
-      CLING_LIB_EXPORT
-      void* setValueWithAlloc(void* vpI, void* vpV, void* vpQT, char vpOn);
-
-      ///\brief Placement new doesn't work for arrays. It needs to be called on
-      /// each element. For non-PODs we also need to call the *structors. This
-      /// handles also multi dimension arrays since the init order is
-      /// independent on the dimensions.
-      ///
-      /// We must be consistent with clang. Eg:
-      ///\code
-      ///extern "C" int printf(const char*,...);
-      /// struct S {
-      ///    static int sI;
-      ///    int I;
-      ///    S(): I(sI++) {}
-      /// };
-      /// int S::sI = 0;
-      /// S arr[5][3];
-      /// int main() {
-      ///    for (int i = 0; i < 5; ++i)
-      ///    for (int j = 0; j < 3; ++j)
-      ///       printf("[%d][%d]%d\n", i, j, arr[i][j].I);
-      ///    return 0;
-      /// }
-      ///\endcode
-      /// must be consistent with what clang does, since it is not well defined
-      /// in the C++ standard.
-      ///
-      ///\param[in] src - array to copy
-      ///\param[in] placement - where to copy
-      ///\param[in] size - size of the array.
-      ///
-      template <class T, class = T (*)() /*disable for arrays*/>
-      void copyArray(T* src, void* placement, std::size_t size) {
-        for (std::size_t i = 0; i < size; ++i)
-          new ((void*)(((T*)placement) + i)) T(src[i]);
-      }
-
-      // "size" is the number of elements even for subarrays; flatten the type:
-      template <class T, std::size_t N>
-      void copyArray(const T (*src)[N], void* placement, std::size_t size) {
-        copyArray(src[0], placement, size);
-      }
     } // end namespace internal
   } // end namespace runtime
 } // end namespace cling
@@ -189,15 +62,12 @@ namespace cling {
 using namespace cling::runtime;
 
 extern "C" {
-  ///\brief a function that throws InvalidDerefException. This allows to 'hide'
-  /// the definition of the exceptions from the RuntimeUniverse and allows us to
-  /// run cling in -no-rtti mode.
-  ///
-  CLING_LIB_EXPORT
-  void* cling_runtime_internal_throwIfInvalidPointer(void* Sema,
-                                                    void* Expr,
-                                                    const void* Arg);
+  ///\brief The safe point that the loops of the inputs call while the
+  /// interpreter has ExecutionLimits; it throws once they are exceeded.
+  /// The JIT provides it.
+  void __cling_safe_point();
 }
+
 #endif // __cplusplus
 
 #endif // CLING_RUNTIME_UNIVERSE_H
@@ -0,0 +1,83 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_TIMING_STATS_H
+#define CLING_TIMING_STATS_H
+
+#include <cstdint>
+
+namespace llvm {
+  class raw_ostream;
+}
+
+namespace cling {
+
+  ///\brief Wall-clock time spent in the stages of compiling and running
+  /// input, per Transaction and accumulated in the Interpreter.
+  ///
+  /// Stages nest (e.g. the AST transformers run while parsing, and user code
+  /// can call back into the interpreter); each stage reports its time
+  /// exclusive of the stages it encloses.
+  ///
+  class TimingStats {
+  public:
+    enum Phase {
+      kParsing,         ///< Lexing, parsing and Sema.
+      kASTTransformers, ///< The ASTTransformers and WrapperTransformers.
+      kCodeGen,         ///< Emitting LLVM IR.
+      kBackendPasses,   ///< Optimizing the LLVM IR.
+      kJITLinking,      ///< Compiling to machine code, linking, resolving.
+      kStaticInit,      ///< Running static initializers.
+      kUserCode,        ///< Running the wrapper of an input.
+      kNumPhases
+    };
+
+  private:
+    ///\brief Nanoseconds spent per phase.
+    uint64_t m_Nanoseconds[kNumPhases];
+
+    ///\brief How often each phase was entered.
+    uint64_t m_Count[kNumPhases];
+
+  public:
+    TimingStats() { clear(); }
+
+    void clear() {
+      for (unsigned I = 0; I < kNumPhases; ++I)
+        m_Nanoseconds[I] = m_Count[I] = 0;
+    }
+
+    void add(Phase P, uint64_t Nanoseconds) { m_Nanoseconds[P] += Nanoseconds; }
+    void addEntry(Phase P) { ++m_Count[P]; }
+
+    TimingStats& operator+=(const TimingStats& Other) {
+      for (unsigned I = 0; I < kNumPhases; ++I) {
+        m_Nanoseconds[I] += Other.m_Nanoseconds[I];
+        m_Count[I] += Other.m_Count[I];
+      }
+      return *this;
+    }
+
+    ///\brief Nanoseconds spent in a phase.
+    uint64_t getNanoseconds(Phase P) const { return m_Nanoseconds[P]; }
+
+    ///\brief How often a phase was entered.
+    uint64_t getCount(Phase P) const { return m_Count[P]; }
+
+    ///\brief Nanoseconds spent in all phases.
+    uint64_t getTotalNanoseconds() const;
+
+    ///\brief The name of a phase as printed by print(), e.g. "codegen".
+    static const char* getPhaseName(Phase P);
+
+    ///\brief Prints one line per phase: name, count, milliseconds and share.
+    void print(llvm::raw_ostream& Out) const;
+  };
+} // end namespace cling
+
+#endif // CLING_TIMING_STATS_H
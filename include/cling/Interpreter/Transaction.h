@@ -11,6 +11,8 @@
 #define CLING_TRANSACTION_H
 
 #include "cling/Interpreter/CompilationOptions.h"
+#include "cling/Interpreter/MemoryReport.h"
+#include "cling/Interpreter/TimingStats.h"
 
 #include "clang/AST/DeclGroup.h"
 #include "clang/Basic/SourceLocation.h"
@@ -19,7 +21,11 @@
 #include "llvm/ADT/StringRef.h"
 #include "llvm/IR/Module.h"
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace clang {
   class ASTContext;
@@ -62,6 +68,9 @@ namespace cling {
       kCCIHandleCXXImplicitFunctionInstantiation,
       kCCIHandleCXXStaticMemberVarInstantiation,
       kCCICompleteTentativeDefinition,
+      ///\brief A function whose body got parsed anew, for Interpreter::
+      /// reloadFile(); it belongs to the transaction that declared it.
+      kCCIHandleReloadedDefinition,
       kCCINumStates
     };
 
@@ -112,8 +121,10 @@ namespace cling {
 
   private:
     // Intentionally use struct instead of pair because we don't need default
-    // init.
-    typedef llvm::SmallVector<DelayCallInfo, 64> DeclQueue;
+    // init. Sessions keep every transaction: the inline storage is small,
+    // most inputs are a wrapper and a few declarations.
+    typedef llvm::SmallVector<DelayCallInfo, 4> DeclQueue;
+    typedef llvm::SmallVector<DelayCallInfo, 0> DeserializedDeclQueue;
     typedef llvm::SmallVector<Transaction*, 2> NestedTransactions;
 
     ///\brief All seen declarations, except the deserialized ones.
@@ -123,9 +134,10 @@ namespace cling {
     DeclQueue m_DeclQueue;
 
     ///\brief All declarations that the transaction caused to be deserialized,
-    /// either from the PCH or the PCM.
+    /// either from the PCH or the PCM. Out of line: most transactions
+    /// deserialize nothing.
     ///
-    DeclQueue m_DeserializedDeclQueue;
+    DeserializedDeclQueue m_DeserializedDeclQueue;
 
     ///\brief List of nested transactions if any.
     ///
@@ -148,6 +160,49 @@ namespace cling {
     ///
     CompilationOptions m_Opts;
 
+    ///\brief Time spent compiling and running this transaction.
+    ///
+    TimingStats m_TimingStats;
+
+    ///\brief Memory allocated while parsing and generating this transaction.
+    ///
+    MemoryStats m_MemoryStats;
+
+  public:
+    ///\brief A function registered with __cxa_atexit or atexit, to be run
+    /// when the transaction is unloaded or the interpreter shuts down.
+    ///
+    struct AtExitFunc {
+      void (*Func)(void*);
+      void* Arg;
+      AtExitFunc* Next;
+    };
+
+    ///\brief A function that running the transaction calls - its wrapper
+    /// or one of its static initializers - and where the JIT loaded it.
+    ///
+    struct EntryPoint {
+      std::string Name; ///< Mangled.
+      uint64_t Address = 0; ///< 0 until its object got loaded.
+    };
+
+    ///\brief What running the transaction calls: noted when its module
+    /// reaches the JIT, located as the JIT loads its object. Its code then
+    /// runs without a symbol lookup.
+    ///
+    struct EntryPoints {
+      EntryPoint Wrapper;
+      ///\brief In the order of llvm.global_ctors; taken once they ran.
+      std::vector<EntryPoint> Initializers;
+    };
+
+  private:
+    ///\brief The functions registered while the transaction was the latest,
+    /// the last registered first. Registering does not lock: the user code of
+    /// several threads might register at once.
+    ///
+    mutable std::atomic<AtExitFunc*> m_AtExitFuncs;
+
     ///\brief If DefinitionShadower is enabled, the `__cling_N5xxx' namespace
     /// in which to nest global definitions (if any).
     ///
@@ -165,6 +220,10 @@ namespace cling {
     ///
     clang::FunctionDecl* m_WrapperFD;
 
+    ///\brief The entry points of m_Module, see IncrementalExecutor.
+    ///
+    EntryPoints m_EntryPoints;
+
     ///\brief Next transaction in if any.
     ///
     const Transaction* m_Next;
@@ -187,11 +246,25 @@ namespace cling {
     ///
     clang::FileID m_BufferFID;
 
+    ///\brief The last declaration of the translation unit when the
+    /// transaction began, if any: the ones it adds to it come after.
+    ///
+    clang::Decl* m_DeclCheckpoint;
+
     /// TransactionPool needs direct access to m_State as setState asserts
     friend class TransactionPool;
 
     void Initialize();
 
+    ///\brief Frees the atexit functions that did not run.
+    ///
+    void dropAtExitFuncs();
+
+    ///\brief Brings a transaction without nested transactions back to its
+    /// initial state, keeping the storage of its queues for reuse.
+    ///
+    void reset();
+
   public:
     enum State {
       kCollecting,
@@ -464,6 +537,13 @@ namespace cling {
     ///\brief Appends the declaration of a macro.
     void append(MacroDirectiveInfo MDE);
 
+    ///\brief Releases what a committed transaction no longer needs: the
+    /// deserialized declarations that all come from an AST file, which
+    /// unloading leaves alone, and the spare capacity of its queues. The
+    /// transaction can still be appended to, printed and unloaded.
+    ///
+    void compact();
+
     ///\brief Clears all declarations in the transaction.
     ///
     void clear() {
@@ -482,13 +562,37 @@ namespace cling {
 
     IncrementalExecutor* getExecutor() const { return m_Exe; }
 
+    ///\brief Time spent in the stages of compiling and running the
+    /// transaction, not including its nested transactions.
+    const TimingStats& getTimingStats() const { return m_TimingStats; }
+    TimingStats& getTimingStats() { return m_TimingStats; }
+
+    ///\brief The AST, source and IR memory of the transaction, not including
+    /// its nested transactions; the JIT figures are left to the executor.
+    const MemoryStats& getMemoryStats() const { return m_MemoryStats; }
+    MemoryStats& getMemoryStats() { return m_MemoryStats; }
+
+    ///\brief Registers Func(Arg) to be run when the transaction is unloaded;
+    /// safe to call concurrently.
+    void addAtExitFunc(void (*Func)(void*), void* Arg) const;
+
+    ///\brief Takes the functions registered so far, the last first; the
+    /// caller owns the list. Those registered afterwards are kept.
+    AtExitFunc* takeAtExitFuncs() { return m_AtExitFuncs.exchange(nullptr); }
+
     clang::FunctionDecl* getWrapperFD() const { return m_WrapperFD; }
 
+    EntryPoints& getEntryPoints() { return m_EntryPoints; }
+    const EntryPoints& getEntryPoints() const { return m_EntryPoints; }
+
     const Transaction* getNext() const { return m_Next; }
     void setNext(Transaction* T) { m_Next = T; }
 
     void setBufferFID(clang::FileID FID) { m_BufferFID = FID; }
     clang::FileID getBufferFID() const { return m_BufferFID; }
+
+    void setDeclCheckpoint(clang::Decl* D) { m_DeclCheckpoint = D; }
+    clang::Decl* getDeclCheckpoint() const { return m_DeclCheckpoint; }
     clang::SourceLocation getSourceStart(const clang::SourceManager& SM) const;
 
     ///\brief The transactions could be reused and the pointer couldn't serve
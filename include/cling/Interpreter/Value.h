@@ -18,6 +18,7 @@
 
 namespace llvm {
   class raw_ostream;
+  class StringRef;
 }
 
 namespace clang {
@@ -263,6 +264,40 @@ namespace cling {
     long long getLL() const { return m_Storage.m_LL; }
     unsigned long long getULL() const { return m_Storage.m_ULL; }
 
+    ///\brief The elements of an array that a Value holds or references, in
+    /// place; see getArrayView().
+    struct ArrayView {
+      ///\brief The first element; null for an empty container.
+      void* Data = nullptr;
+
+      ///\brief The number of elements.
+      size_t Extent = 0;
+
+      ///\brief The size of an element in bytes, i.e. the stride.
+      size_t ElementSize = 0;
+
+      ///\brief The type of the elements, as opaque clang::QualType.
+      void* ElementType = nullptr;
+
+      ///\brief Whether the Value has elements to view.
+      bool isValid() const { return ElementType; }
+
+      clang::QualType getElementType() const;
+    };
+
+    ///\brief The elements of the C array, std::array, std::vector or span
+    /// (a class template named span, e.g. std::span or gsl::span) that the
+    /// Value holds or references, without copying them. Arrays of arrays
+    /// are viewed flat, as arrays of their innermost elements.
+    ///
+    /// The view is valid while the Value lives and, if the Value references
+    /// the object or the object is a container, until the object changes.
+    ///
+    ///\returns An invalid view for other types, including pointers, whose
+    /// extent is unknown, and std::vector<bool>, which has no elements.
+    ///
+    ArrayView getArrayView() const;
+
     /// \brief Get the value with cast.
     //
     /// Get the value cast to T. This is similar to reinterpret_cast<T>(value),
@@ -273,6 +308,36 @@ namespace cling {
       return CastFwd<T>::cast(*this);
     }
 
+    ///\brief Writes the value in a compact binary form, for deserialize()
+    /// to reconstruct it in another interpreter, e.g. in another process:
+    /// the spelling of the type, then the builtin value, the address of a
+    /// pointer, or the bytes of a trivially copyable object (also of one
+    /// that a reference refers to).
+    ///
+    /// Addresses, be they pointers or member pointers, and the bits of long
+    /// double only mean something in the writing process respectively on
+    /// its target; their encoding is flagged as non-portable. Objects are
+    /// copied as laid out for the target of the writer.
+    ///
+    ///\returns false if the value cannot be encoded: it is not trivially
+    /// copyable, or its type cannot be named from the global scope.
+    ///
+    bool serialize(llvm::raw_ostream& Out) const;
+
+    ///\brief Reads a value written by serialize(), looking its type up in
+    /// Interp through LookupHelper::findType().
+    ///
+    ///\param[in,out] Data - The encoding; what follows the value on return,
+    ///   for encodings that were concatenated.
+    ///\param[out] V - The value read.
+    ///\param[out] NonPortable - Whether the encoding was flagged so.
+    ///
+    ///\returns false if Data is no valid encoding, or the type is not known
+    ///   to Interp or has a different size there.
+    ///
+    static bool deserialize(llvm::StringRef& Data, Interpreter& Interp,
+                            Value& V, bool* NonPortable = nullptr);
+
     ///\brief Generic interface to value printing.
     ///
     /// Can be re-implemented to print type-specific details, e.g. as
@@ -10,7 +10,19 @@
 #ifndef CLING_DISPLAY_H
 #define CLING_DISPLAY_H
 
+#include "llvm/ADT/StringRef.h"
+
+#include <cstddef>
+#include <set>
 #include <string>
+#include <utility>
+#include <vector>
+
+namespace clang {
+  class ClassTemplateDecl;
+  class Decl;
+  class DeclContext;
+}
 
 namespace llvm {
   class raw_ostream;
@@ -19,19 +31,123 @@ namespace llvm {
 namespace cling {
 class Interpreter;
 
+///\brief Selects the entries a listing shows, by their qualified names, and
+/// the page of them to show.
+struct DisplayFilter {
+  enum MatchKind {
+    kAll,
+    kPrefix,
+    kRegex
+  };
+
+  MatchKind Match = kAll;
+  std::string Pattern;
+  ///\brief The page to show, from 1, of PageSize entries; if PageSize is 0
+  /// all the entries are shown.
+  size_t Page = 1;
+  size_t PageSize = 0;
+
+  ///\brief Parses the options of the listing meta commands:
+  /// [-p <prefix> | -r <regex>] [-n <page size>] [-page <page>].
+  ///\returns false and describes the problem in Error if they are invalid.
+  bool parse(llvm::StringRef Options, std::string& Error);
+};
+
+///\brief The declarations the listings show, by kind, in the order they
+/// were declared.
+///
+/// The index is built by the first listing and then kept up to date lazily:
+/// each listing only indexes the declarations added since the previous one,
+/// or rebuilds the index if declarations were unloaded. Only declarations
+/// already in memory are indexed, not whole modules or PCHs; the commands
+/// that take a name, e.g. `.class <name>`, look the others up.
+///
+class DisplayIndex {
+public:
+  enum Kind {
+    kClasses,
+    kNamespaces,
+    kTypedefs,
+    kGlobals,
+    kNumKinds
+  };
+
+  struct Entry {
+    ///\brief What a DisplayFilter matches.
+    std::string Name;
+    const clang::Decl* D;
+  };
+
+private:
+  ///\brief A declaration context that can get more declarations, with the
+  /// first and the last of them indexed.
+  struct Context {
+    const clang::DeclContext* DC;
+    const clang::Decl* First;
+    const clang::Decl* Last;
+    ///\brief The qualified name of the enclosing namespace.
+    std::string Scope;
+    ///\brief Whether its namespaces are listed, i.e. it is not inside an
+    /// anonymous namespace or a class.
+    bool Namespaces;
+    ///\brief Whether its variables are listed, i.e. it is the translation
+    /// unit or an inline namespace of it.
+    bool Globals;
+  };
+
+  const Interpreter& m_Interpreter;
+  std::vector<Entry> m_Entries[kNumKinds];
+  std::vector<Context> m_Contexts;
+  ///\brief The class templates, with the number of their specializations
+  /// indexed.
+  std::vector<std::pair<const clang::ClassTemplateDecl*, size_t>>
+    m_Templates;
+  ///\brief The classes and templates indexed, by definition if any.
+  std::set<const clang::Decl*> m_Seen;
+  ///\brief The unload generation of the interpreter the index is for.
+  unsigned m_Generation = 0;
+
+  void update();
+  void indexContext(size_t I);
+  void indexTemplate(size_t I);
+  void indexDecls(const clang::DeclContext* DC, const Context& Ctx);
+  void indexDecl(const clang::Decl* D, const Context& Ctx);
+  void indexClass(const clang::Decl* D, const Context& Ctx);
+  void addContext(const clang::DeclContext* DC, const Context& Ctx);
+
+public:
+  explicit DisplayIndex(const Interpreter& interpreter)
+    : m_Interpreter(interpreter) {}
+
+  const Interpreter& getInterpreter() const { return m_Interpreter; }
+
+  ///\brief Indexes the declarations added since the last call and returns
+  /// the entries of kind K.
+  const std::vector<Entry>& get(Kind K);
+};
+
 void DisplayClasses(llvm::raw_ostream &stream,
                     const Interpreter *interpreter, bool verbose);
 void DisplayClass(llvm::raw_ostream &stream,
                   const Interpreter *interpreter, const char *className,
                   bool verbose);
 
+void DisplayClasses(llvm::raw_ostream &stream, DisplayIndex &index,
+                    bool verbose, const DisplayFilter &filter);
+
 void DisplayNamespaces(llvm::raw_ostream &stream, const Interpreter *interpreter);
+void DisplayNamespaces(llvm::raw_ostream &stream, DisplayIndex &index,
+                       const DisplayFilter &filter);
 
 void DisplayGlobals(llvm::raw_ostream &stream, const Interpreter *interpreter);
+void DisplayGlobals(llvm::raw_ostream &stream, DisplayIndex &index,
+                    const DisplayFilter &filter);
 void DisplayGlobal(llvm::raw_ostream &stream, const Interpreter *interpreter,
                    const std::string &name);
 
 void DisplayTypedefs(llvm::raw_ostream &stream, const Interpreter *interpreter);
+void DisplayTypedefs(llvm::raw_ostream &stream, DisplayIndex &index,
+                     const DisplayFilter &filter);
 void DisplayTypedef(llvm::raw_ostream &stream, const Interpreter *interpreter,
                     const std::string &name);
 
@@ -35,6 +35,10 @@ namespace cling {
     ///
     std::deque<int> m_ParenStack;
 
+    ///\brief Whether the input so far ends within a multi-line comment.
+    ///
+    bool m_InBlockComment = false;
+
   public:
     InputValidator() {}
     ~InputValidator() {}
@@ -54,6 +58,15 @@ namespace cling {
     ///
     ValidationResult validate(llvm::StringRef line);
 
+    ///\brief Validates a buffer of many lines in one pass, as if each line
+    /// was passed to validate().
+    ///
+    ///\param[in] buffer - Input lines, separated by '\n'.
+    ///\returns Information about the outcome of the validation: that of the
+    /// last line, or the first mismatch.
+    ///
+    ValidationResult validateBuffer(llvm::StringRef buffer);
+
     ///\brief Retrieves the number of spaces that the next input line should be
     /// indented.
     ///
@@ -69,7 +82,18 @@ namespace cling {
     ///
     ///\returns true if currently inside a multi-line comment block
     ///
-    bool inBlockComment() const;
+    bool inBlockComment() const { return m_InBlockComment; }
+
+  private:
+    ///\brief Lexes one null terminated line, continuing from the state the
+    /// previous ones left: the brace stack, the comment and a literal spliced
+    /// by a trailing backslash.
+    ///
+    ValidationResult lexLine(const char* curPos);
+
+    ///\brief Appends input to the collected input, on a new line.
+    ///
+    void appendInput(llvm::StringRef input);
   };
 }
 #endif // CLING_INPUT_VALIDATOR_H
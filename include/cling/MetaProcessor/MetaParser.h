@@ -32,7 +32,10 @@ namespace cling {
   //                            PrintDebugCommand | DynamicExtensionsCommand |
   //                            HelpCommand | FileExCommand | FilesCommand |
   //                            ClassCommand | GCommand | StoreStateCommand |
-  //                            CompareStateCommand | StatsCommand | undoCommand
+  //                            CompareStateCommand | StatsCommand | undoCommand |
+  //                            TimingCommand | ExportCommand |
+  //                            RemarksCommand | PgoCommand | ProfileCommand |
+  //                            ReloadCommand
   //                 LCommand := 'L' [FilePath]
   //                 TCommand := 'T' FilePath FilePath
   //                 >Command := '>' FilePath
@@ -49,6 +52,17 @@ namespace cling {
   //                 StatsCommand := 'stats' ['ast']
   //                 traceCommand := 'trace' ['ast'] ["Ident"]
   //                 undoCommand := 'undo' [Constant]
+  //                 TimingCommand := 'timing' ['on' | 'off' | Constant]
+  //                 ExportCommand := ('export' | 'package') ['-O'Constant]
+  //                                  FilePath
+  //                 RemarksCommand := 'remarks' ['missed' | 'passed' | 'all' |
+  //                                              'off']
+  //                 PgoCommand := 'pgo' ['on' | 'off' | 'optimize']
+  //                 ProfileCommand := 'profile' ['start' | 'stop' | 'report']
+  //                 JournalCommand := 'journal' [FilePath]
+  //                 RestoreCommand := 'restore' ['-declarations'] [FilePath]
+  //                 ReloadCommand := 'reload' FilePath
+  //                 TryCommand := 'try' ['adopt' | 'discard' | AnyString]
   //                 DynamicExtensionsCommand := 'dynamicExtensions' [Constant]
   //                 HelpCommand := 'help'
   //                 FileExCommand := 'fileEx'
@@ -102,6 +116,15 @@ namespace cling {
     bool isstatsCommand();
     bool istraceCommand();
     bool isundoCommand();
+    bool istimingCommand();
+    bool isexportCommand(MetaSema::ActionResult& actionResult);
+    bool isremarksCommand(MetaSema::ActionResult& actionResult);
+    bool ispgoCommand(MetaSema::ActionResult& actionResult);
+    bool isprofileCommand(MetaSema::ActionResult& actionResult);
+    bool isjournalCommand(MetaSema::ActionResult& actionResult);
+    bool isrestoreCommand(MetaSema::ActionResult& actionResult);
+    bool isreloadCommand(MetaSema::ActionResult& actionResult);
+    bool istryCommand(MetaSema::ActionResult& actionResult);
     bool isdynamicExtensionsCommand();
     bool ishelpCommand();
     bool isfileExCommand();
@@ -25,6 +25,7 @@ namespace cling {
   class Interpreter;
   class InputValidator;
   class MetaSema;
+  class Speculation;
   class Value;
 
   ///\brief Class that helps processing meta commands, which add extra
@@ -62,6 +63,29 @@ namespace cling {
     class RedirectOutput;
     std::unique_ptr<RedirectOutput> m_RedirectOutput;
 
+    ///\brief Processes the file content in chunks of top-level declarations,
+    /// unless it must be wrapped as a whole.
+    ///
+    ///\param [out] ret - The result of the last chunk processed.
+    ///
+    ///\returns false if the content must be processed as one input.
+    ///
+    bool readInputInChunks(llvm::StringRef filename, llvm::StringRef content,
+                           Value* result, Interpreter::CompilationResult& ret);
+
+    ///\brief Whether process() reports the time and resources taken by each
+    /// input, see .timing.
+    ///
+    bool m_ReportTiming = false;
+
+    ///\brief The child of the last .try, if it is pending or adopted.
+    ///
+    std::unique_ptr<Speculation> m_Speculation;
+
+    ///\brief Whether the next complete input gets tried, see beginTry().
+    ///
+    mutable bool m_TryNext = false;
+
   public:
     enum RedirectionScope {
       kSTDOUT = 1,
@@ -70,6 +94,14 @@ namespace cling {
       kSTDSTRM  // "&1" or "&2" is not a filename
     };
 
+    ///\brief How a redirection writes to its file.
+    enum RedirectionFlags {
+      ///\brief Through a buffer, which a thread writes to the file.
+      kRedirectBuffered = 1,
+      ///\brief gzip compressed, by the thread; implies kRedirectBuffered.
+      kRedirectCompressed = 2
+    };
+
     ///\brief Class to be created for each processing input to be
     /// able to redirect std.
     class MaybeRedirectOutputRAII {
@@ -84,6 +116,7 @@ namespace cling {
     ~MetaProcessor();
 
     const Interpreter& getInterpreter() const { return m_Interp; }
+    Interpreter& getInterpreter() { return m_Interp; }
 
     ///\brief Get the output stream used by the MetaProcessor for its output.
     /// (in contrast to the interpreter's output which is redirected using
@@ -101,6 +134,14 @@ namespace cling {
       return prev;
     }
 
+    ///\brief Starts or stops reporting the time and resources taken by each
+    /// input: wall and CPU time, split into compiling and executing, the
+    /// growth of the peak resident set size and, where available, hardware
+    /// event counts of the execution.
+    ///
+    void enableTimingReport(bool Enable);
+    bool isReportingTiming() const { return m_ReportTiming; }
+
     ///\brief Process the input coming from the prompt and possibly returns
     /// result of the execution of the last statement.
     /// @param[in] input_line - the user input
@@ -119,6 +160,25 @@ namespace cling {
                 cling::Value* result = nullptr,
                 bool disableValuePrinting = false);
 
+    ///\brief Runs the next complete input, the one that Code starts, in a
+    /// child that fork() makes of the process, see .try: the session stays
+    /// as it is until the child gets adopted. A pending child is discarded.
+    ///
+    ///\param[in] Code - The start of the input; empty to try the next one.
+    ///\param[out] compRes - The result of the input, if complete.
+    ///
+    ///\returns false if the platform cannot fork.
+    ///
+    bool beginTry(llvm::StringRef Code,
+                  Interpreter::CompilationResult& compRes);
+
+    ///\brief Goes on with the session of the pending .try, or discards it.
+    ///
+    ///\returns false if there is no pending .try.
+    ///
+    bool adoptTry();
+    bool discardTry();
+
     ///\brief When continuation is requested, this cancels and ignores previous
     /// input, resetting the continuation to a new line.
     void cancelContinuation() const;
@@ -129,6 +189,10 @@ namespace cling {
 
     ///\brief Reads prompt input from file.
     ///
+    /// Large files that need no wrapping, e.g. generated declarations, are
+    /// processed in chunks of top-level declarations, each a transaction of
+    /// its own.
+    ///
     ///\param [in] filename - The file to read.
     /// @param[out] result - the cling::Value as result of the
     ///             execution of the last statement
@@ -148,9 +212,15 @@ namespace cling {
     ///\param [in] file - The file for the redirection.
     ///\param [in] stream - Which stream to redirect: stdout, stderr or both.
     ///\param [in] append - Write in append mode.
+    ///\param [in] flags - RedirectionFlags for the file.
     ///
     void setStdStream(llvm::StringRef file, RedirectionScope stream,
-                      bool append);
+                      bool append, unsigned flags = 0);
+
+    ///\brief Ends all redirections, writing out what they buffered, as the
+    /// destruction does.
+    ///
+    void resetStdStreams();
 
     ///\brief Register the file as an upload point for the Transaction T
     ///  when unloading that file, all transactions after T will be reverted.
@@ -18,12 +18,16 @@
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/Optional.h"
 
+#include <memory>
+
 namespace llvm {
   class StringRef;
   class raw_ostream;
 }
 
 namespace cling {
+  struct DisplayFilter;
+  class DisplayIndex;
   class Interpreter;
   class MetaProcessor;
   class Value;
@@ -38,6 +42,18 @@ namespace cling {
 
     llvm::DenseMap<const clang::FileEntry*, const Transaction*> m_FEToTransaction;
     llvm::DenseMap<const Transaction*, const clang::FileEntry*> m_TransactionToFE;
+
+    ///\brief The index of the listings of .class, .namespace, .g and
+    /// .typedef, see getDisplayIndex().
+    mutable std::unique_ptr<DisplayIndex> m_DisplayIndex;
+
+    ///\brief Creates the index on first use.
+    DisplayIndex& getDisplayIndex() const;
+
+    ///\brief Parses the listing options of Options into Filter. Reports the
+    /// problem and returns false if they are invalid.
+    bool parseDisplayFilter(llvm::StringRef Options,
+                            DisplayFilter& Filter) const;
   public:
     enum SwitchMode {
       kOff = 0,
@@ -50,6 +66,7 @@ namespace cling {
     };
 
     MetaSema(Interpreter& interp, MetaProcessor& meta);
+    ~MetaSema();
 
     const Interpreter& getInterpreter() const { return m_Interpreter; }
     bool isQuitRequested() const { return m_IsQuitRequested; }
@@ -73,6 +90,11 @@ namespace cling {
     ///
     void actOnOCommand();
 
+    ///\brief O auto command lets each module get the optimization level
+    /// its code calls for; `.O <level>` sets a fixed one again.
+    ///
+    ActionResult actOnOAutoCommand();
+
     ///\brief T command prepares the tag files for giving semantic hints.
     ///
     ///\param[in] inputFile - The source file of the map.
@@ -86,10 +108,12 @@ namespace cling {
     ///\param[in] file - The file where the output is redirected
     ///\param[in] stream - The optional stream to redirect.
     ///\param[in] append - Write or append to the file.
+    ///\param[in] flags - The MetaProcessor::RedirectionFlags of --buffered
+    /// and --gzip.
     ///
     ActionResult actOnRedirectCommand(llvm::StringRef file,
                                       MetaProcessor::RedirectionScope stream,
-                                      bool append);
+                                      bool append, unsigned flags = 0);
 
     ///\brief Actions that need to be performed on occurance of a comment.
     ///
@@ -181,6 +205,88 @@ namespace cling {
     void actOnstatsCommand(llvm::StringRef name,
                            llvm::StringRef filter = llvm::StringRef()) const;
 
+    ///\brief Switches on/off the report of the time and resources taken by
+    /// each input, see MetaProcessor::enableTimingReport().
+    ///
+    ///\param[in] mode - either on/off or toggle.
+    ///
+    void actOntimingCommand(SwitchMode mode = kToggle) const;
+
+    ///\brief Compiles the code of the session into a shared library, see
+    /// Interpreter::exportSession().
+    ///
+    ///\param[in] path - The library, or the object file if it ends in ".o".
+    ///\param[in] optLevel - The optimization level; -1 for the default one.
+    ///
+    ActionResult actOnexportCommand(llvm::StringRef path,
+                                    int optLevel = -1) const;
+
+    ///\brief Compiles the code of the last input into a package for hosts
+    /// running libclingExec, see Interpreter::exportPackage().
+    ///
+    ///\param[in] path - The package to write.
+    ///\param[in] optLevel - The optimization level; -1 for the default one.
+    ///
+    ActionResult actOnpackageCommand(llvm::StringRef path,
+                                     int optLevel = -1) const;
+
+    ///\brief Prints the optimization remarks of the inputs since the last
+    /// .remarks, see Interpreter::printOptimizationRemarks(); starts
+    /// collecting them if they are not yet.
+    ///
+    ///\param[in] what - "missed", "passed", "all" (the default) or "off" to
+    ///   stop collecting them.
+    ///
+    ActionResult actOnremarksCommand(llvm::StringRef what) const;
+
+    ///\brief Instruments the code of the next inputs to collect its profile,
+    /// or re-optimizes it with the profile collected, see
+    /// Interpreter::optimizeWithProfile().
+    ///
+    ///\param[in] what - "on", "off" or "optimize" (the default).
+    ///
+    ActionResult actOnpgoCommand(llvm::StringRef what) const;
+
+    ///\brief Starts or stops sampling where the CPU time of this thread
+    /// goes, or prints the profile, see Interpreter::startProfiling().
+    ///
+    ///\param[in] what - "start", "stop" or "report" (the default).
+    ///
+    ActionResult actOnprofileCommand(llvm::StringRef what) const;
+
+    ///\brief Records the next inputs into a journal, see
+    /// Interpreter::startJournal().
+    ///
+    ///\param[in] path - The journal to append to; empty to stop recording.
+    ///
+    ActionResult actOnjournalCommand(llvm::StringRef path) const;
+
+    ///\brief Restores a session from its journal, see
+    /// Interpreter::restoreJournal().
+    ///
+    ///\param[in] path - The journal; empty to run the inputs that an earlier
+    ///   .restore -declarations deferred.
+    ///\param[in] declarationsOnly - Whether to defer the statements.
+    ///
+    ActionResult actOnrestoreCommand(llvm::StringRef path,
+                                     bool declarationsOnly) const;
+
+    ///\brief Compiles the function bodies of a file that changed since it
+    /// was reloaded, see Interpreter::reloadFile(). Loads the file anew if
+    /// other changes need it, or if it was not loaded by .reload yet.
+    ///
+    ///\param[in] file - The file to reload.
+    ///
+    ActionResult actOnreloadCommand(llvm::StringRef file);
+
+    ///\brief Runs code in a fork of the process, leaving the session as it
+    /// is until the fork is adopted, see MetaProcessor::beginTry().
+    ///
+    ///\param[in] what - "adopt" or "discard" for the pending fork, or the
+    ///   start of the input to try; empty to try the next input.
+    ///
+    ActionResult actOntryCommand(llvm::StringRef what);
+
     ///\brief Switches on/off the experimental dynamic extensions (dynamic
     /// scopes) and late binding.
     ///
@@ -203,28 +309,34 @@ namespace cling {
 
     ///\brief Prints out class CINT-like style.
     ///
-    ///\param[in] className - the specific class to be printed.
+    ///\param[in] className - the specific class to be printed, or the
+    ///                        listing options, see DisplayFilter::parse().
     ///
     void actOnclassCommand(llvm::StringRef className) const;
 
     ///\brief Prints out class CINT-like style more verbosely.
     ///
-    void actOnClassCommand() const;
+    ///\param[in] options - the listing options, see DisplayFilter::parse().
+    ///
+    void actOnClassCommand(llvm::StringRef options) const;
 
     ///\brief Prints out namespace names.
     ///
-    void actOnNamespaceCommand() const;
+    ///\param[in] options - the listing options, see DisplayFilter::parse().
+    ///
+    void actOnNamespaceCommand(llvm::StringRef options) const;
 
     ///\brief Prints out information about global variables.
     ///
-    ///\param[in] varName - The name of the global variable
-    //                      if empty prints them all.
+    ///\param[in] varName - The name of the global variable, or the listing
+    //                      options; if empty prints them all.
     ///
     void actOngCommand(llvm::StringRef varName) const;
 
     ///\brief Prints out information about typedefs.
     ///
-    ///\param[in] typedefName - The name of typedef if empty prints them all.
+    ///\param[in] typedefName - The name of typedef, or the listing options;
+    ///                          if empty prints them all.
     ///
     void actOnTypedefCommand(llvm::StringRef typedefName) const;
 
@@ -113,6 +113,12 @@ namespace utils {
 
     extern const char* const UniquePrefix;
 
+    ///\brief What follows the name of an input's wrapper, "void " and a
+    /// UniquePrefix name, in its code: the parameter for its value and the
+    /// start of the body, on the next line.
+    ///
+    extern const char* const WrapperTail;
+
     ///\brief Synthesizes c-style cast in the AST from given pointer and type to
     /// cast to.
     ///
@@ -12,6 +12,14 @@
 
 #include "clang/Basic/Diagnostic.h"
 
+#include "llvm/ADT/StringRef.h"
+
+#include <functional>
+
+namespace llvm {
+  class raw_ostream;
+}
+
 namespace cling {
 namespace utils {
 
@@ -114,6 +122,57 @@ namespace utils {
       }
     };
 
+    ///\brief A diagnostic as handed to a StructuredDiagnostics callback; the
+    /// strings are only valid during the call.
+    ///
+    struct DiagnosticRecord {
+      clang::DiagnosticsEngine::Level Level;
+      ///\brief The clang diagnostic ID, e.g. diag::err_undeclared_var_use.
+      unsigned ID;
+      ///\brief The presumed location: empty File, and 0, without one.
+      llvm::StringRef File;
+      unsigned Line;
+      unsigned Column;
+      ///\brief The formatted message, without snippet, fix-it or notes.
+      llvm::StringRef Message;
+
+      ///\brief Prints the record as one tab separated line: the level, the
+      /// ID, the location as file:line:column and the message.
+      ///
+      void print(llvm::raw_ostream& Out) const;
+    };
+
+    ///\brief A DiagnosticConsumer for programs rather than people: it hands
+    /// each diagnostic to a callback as a DiagnosticRecord, without the
+    /// source snippets, fix-its and colors of the TextDiagnosticPrinter.
+    /// Notes, e.g. template instantiation backtraces, are dropped unless
+    /// asked for.
+    ///
+    class StructuredDiagnostics : public clang::DiagnosticConsumer {
+    public:
+      typedef std::function<void(const DiagnosticRecord&)> Callback;
+
+    private:
+      Callback m_Callback;
+      bool m_Notes;
+
+      void HandleDiagnostic(clang::DiagnosticsEngine::Level Level,
+                            const clang::Diagnostic& Info) override;
+
+    public:
+      ///\param[in] CB - Called for each diagnostic; none prints the records
+      ///   to cling::errs()
+      ///\param[in] Notes - Whether to pass on the notes too
+      ///
+      StructuredDiagnostics(Callback CB = Callback(), bool Notes = false)
+        : m_Callback(std::move(CB)), m_Notes(Notes) {}
+
+      void setCallback(Callback CB, bool Notes = false) {
+        m_Callback = std::move(CB);
+        m_Notes = Notes;
+      }
+    };
+
 } // namespace utils
 } // namespace cling
 
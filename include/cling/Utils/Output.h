@@ -31,9 +31,15 @@ namespace cling {
     
     ///\brief The 'stdout' stream. llvm::raw_ostream wrapper of std::cout
     ///
+    /// The thread which first uses it writes to std::cout as it goes. The
+    /// other threads each get their own stream, which writes whole lines, so
+    /// that the lines of threads do not mix; the rest of a line without its
+    /// newline is written when the thread ends.
+    ///
     llvm::raw_ostream& outs();
 
-    ///\brief The 'stderr' stream. llvm::raw_ostream wrapper of std::cerr
+    ///\brief The 'stderr' stream. llvm::raw_ostream wrapper of std::cerr,
+    /// per thread like outs().
     ///
     llvm::raw_ostream& errs();
 
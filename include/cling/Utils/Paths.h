@@ -12,6 +12,7 @@
 
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
 #include <string>
 #include <vector>
 
@@ -85,18 +86,48 @@ namespace cling {
                      const clang::FileManager* FM = nullptr,
                      const char* FileType = nullptr);
     
+    ///\brief A set of paths, finding with one hash lookup whether a path
+    /// names the same directory as one in the set, also through symbolic
+    /// links.
+    ///
+    class PathSet {
+      llvm::StringSet<> m_Keys;
+
+    public:
+      ///\brief The key of Path in the set: its real path if it is absolute
+      /// and exists, else Path without "." and trailing separators.
+      ///
+      static std::string getKey(llvm::StringRef Path);
+
+      ///\returns false if the set had a path for the same directory.
+      ///
+      bool insert(llvm::StringRef Path) {
+        return m_Keys.insert(getKey(Path)).second;
+      }
+
+      bool count(llvm::StringRef Path) const {
+        return m_Keys.count(getKey(Path));
+      }
+
+      bool empty() const { return m_Keys.empty(); }
+    };
+
     ///\brief Adds multiple include paths separated by a delimter into the
     /// given HeaderSearchOptions.  This adds the paths but does no further
     /// processing. See Interpreter::AddIncludePaths or CIFactory::createCI
     /// for examples of what needs to be done once the paths have been added.
+    /// Paths naming a directory that Opts or PathStr already has are skipped.
     ///
     ///\param[in] PathStr - Path(s)
     ///\param[in] Opts - HeaderSearchOptions to add paths into
     ///\param[in] Delim - Delimiter to separate paths or NULL if a single path
+    ///\param[in,out] Known - The paths of Opts.UserEntries, updated with the
+    /// paths added; if null, it is computed for this call.
     ///
     void AddIncludePaths(llvm::StringRef PathStr,
                          clang::HeaderSearchOptions& Opts,
-                         const char* Delim = platform::kEnvDelim);
+                         const char* Delim = platform::kEnvDelim,
+                         PathSet* Known = nullptr);
 
     ///\brief Write to cling::errs that directory does not exist in a format
     /// matching what 'clang -v' would do
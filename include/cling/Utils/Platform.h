@@ -71,6 +71,42 @@ namespace platform {
   ///
   bool IsMemoryValid(const void *P);
 
+  ///\brief Ask the system to back the mapped memory at Addr with huge pages.
+  ///
+  /// \returns false if the system does not support it.
+  ///
+  bool AdviseHugePages(void* Addr, size_t Size);
+
+  ///\brief The peak resident set size of the process in kB.
+  ///
+  /// \returns -1 if the system cannot tell.
+  ///
+  long GetPeakRSS();
+
+  ///\brief Run Func(Arg), recovering from invalid memory accesses in it.
+  ///
+  /// \param [out] FaultAddr - The address of the faulting access, if any.
+  ///
+  /// \returns false if Func performed an invalid memory access.
+  ///
+  bool RunGuarded(void (*Func)(void*), void* Arg, const void** FaultAddr);
+
+  ///\brief Start the program Path, passing it the descriptors of two pipes
+  /// as its arguments: the one to read, then the one to write.
+  ///
+  /// \param [out] ReadFD - The pipe to read what the program writes.
+  /// \param [out] WriteFD - The pipe to write what the program reads.
+  ///
+  /// \returns The id of the started process, or -1 on failure.
+  ///
+  int SpawnPiped(const std::string& Path, int& ReadFD, int& WriteFD);
+
+  ///\brief Open a TCP connection to Host:Port.
+  ///
+  /// \returns The descriptor of the socket, or -1 on failure.
+  ///
+  int ConnectTCP(const std::string& Host, const std::string& Port);
+
   ///\brief Invoke a command and read it's output.
   ///
   /// \param [in] Cmd - Command and arguments to invoke.
@@ -48,6 +48,21 @@ namespace utils {
   /// \return The position where the function signature and '{' should be
   ///     inserted; std::string::npos if this source should not be wrapped.
   size_t getWrapPoint(std::string& source, const clang::LangOptions& LangOpts);
+
+  ///\brief Find where source can be split into separately parsed chunks.
+  ///
+  /// Returns the end of the first top-level declaration that ends at or
+  /// after minSize, outside of preprocessor conditionals: after its ';', or
+  /// after the '}' of a namespace, linkage specification or function body.
+  ///
+  /// \param source - The source code to analyze; it must be followed by a
+  ///        null character, as in a MemoryBuffer.
+  /// \param minSize - The minimal size of the chunk.
+  /// \param LangOpts - LangOptions to use for lexing.
+  /// \return The size of the chunk; source.size() if the rest of the source
+  ///     has to stay together.
+  size_t getChunkEnd(llvm::StringRef source, size_t minSize,
+                     const clang::LangOptions& LangOpts);
 } // namespace utils
 } // namespace cling
 
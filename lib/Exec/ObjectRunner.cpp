@@ -0,0 +1,230 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "cling/Exec/ObjectRunner.h"
+
+#include "llvm/ExecutionEngine/RuntimeDyld.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+#include <tuple>
+
+using namespace llvm;
+
+namespace {
+#ifdef __APPLE__
+  static const char kGlobalPrefix[] = "_";
+#else
+  static const char kGlobalPrefix[] = "";
+#endif
+} // unnamed namespace
+
+namespace cling {
+
+  ///\brief Records where the static initializers of the objects land.
+  class ObjectRunner::MemoryManager final: public SectionMemoryManager {
+  public:
+    ///\brief The arrays of initializers allocated since the last take.
+    std::vector<std::pair<uint8_t*, uintptr_t>> m_Initializers;
+
+    uint8_t* allocateDataSection(uintptr_t Size, unsigned Alignment,
+                                 unsigned SectionID, StringRef SectionName,
+                                 bool IsReadOnly) override {
+      uint8_t* Addr = SectionMemoryManager::allocateDataSection(
+        Size, Alignment, SectionID, SectionName, IsReadOnly);
+      if (Addr && (SectionName.startswith(".init_array")
+                   || SectionName == "__mod_init_func"))
+        m_Initializers.push_back({Addr, Size});
+      return Addr;
+    }
+  };
+
+  ///\brief Resolves to the ObjectRunner's runtime, then to the process.
+  class ObjectRunner::Resolver final: public LegacyJITSymbolResolver {
+    ObjectRunner& m_Runner;
+
+  public:
+    Resolver(ObjectRunner& Runner): m_Runner(Runner) {}
+
+    JITSymbol findSymbolInLogicalDylib(const std::string&) override {
+      // The objects' own symbols are resolved by the RuntimeDyld.
+      return nullptr;
+    }
+
+    JITSymbol findSymbol(const std::string& Name) override {
+      StringRef Unprefixed = Name;
+      Unprefixed.consume_front(kGlobalPrefix);
+      void* Addr = nullptr;
+      if (Unprefixed == "__cxa_atexit")
+        Addr = reinterpret_cast<void*>(&ObjectRunner::AtExit);
+      else if (Unprefixed == "__dso_handle")
+        Addr = m_Runner.m_DSOHandle;
+      if (Addr)
+        return JITSymbol(reinterpret_cast<uintptr_t>(Addr),
+                         JITSymbolFlags::Exported);
+      if (uint64_t InProcess
+            = RTDyldMemoryManager::getSymbolAddressInProcess(Name))
+        return JITSymbol(InProcess, JITSymbolFlags::Exported);
+      return nullptr;
+    }
+  };
+
+  ObjectRunner::ObjectRunner():
+    m_MM(new MemoryManager()), m_Resolver(new Resolver(*this)),
+    m_Dyld(new RuntimeDyld(*m_MM, *m_Resolver)) {
+    sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+    // The code addresses __dso_handle relative to itself: it must be close
+    // to it, in the memory of the objects.
+    m_DSOHandle = reinterpret_cast<ObjectRunner**>(
+      m_MM->allocateDataSection(sizeof(ObjectRunner*), alignof(ObjectRunner*),
+                                /*SectionID*/ 0, "__dso_handle",
+                                /*IsReadOnly*/ false));
+    *m_DSOHandle = this;
+  }
+
+  ObjectRunner::~ObjectRunner() {
+    while (!m_AtExit.empty()) {
+      std::pair<void (*)(void*), void*> Dtor = m_AtExit.back();
+      m_AtExit.pop_back();
+      Dtor.first(Dtor.second);
+    }
+    m_Dyld->deregisterEHFrames();
+  }
+
+  int ObjectRunner::AtExit(void (*Func)(void*), void* Arg, void* DSO) {
+    (*static_cast<ObjectRunner**>(DSO))->m_AtExit.push_back({Func, Arg});
+    return 0;
+  }
+
+  bool ObjectRunner::loadLibrary(StringRef Path, std::string& Err) {
+    return !sys::DynamicLibrary::LoadLibraryPermanently(Path.str().c_str(),
+                                                        &Err);
+  }
+
+  bool ObjectRunner::addObject(std::unique_ptr<MemoryBuffer> Object,
+                               std::string& Err) {
+    auto Obj = object::ObjectFile::createObjectFile(Object->getMemBufferRef());
+    if (!Obj) {
+      Err = toString(Obj.takeError());
+      return false;
+    }
+    if (!m_Dyld->loadObject(**Obj) || m_Dyld->hasError()) {
+      Err = m_Dyld->getErrorString().str();
+      return false;
+    }
+    m_Objects.push_back(std::move(Object));
+    m_Dyld->resolveRelocations();
+    m_Dyld->registerEHFrames();
+    if (m_MM->finalizeMemory(&Err))
+      return false;
+    if (m_Dyld->hasError()) {
+      Err = m_Dyld->getErrorString().str();
+      return false;
+    }
+
+    std::vector<std::pair<uint8_t*, uintptr_t>> Initializers;
+    Initializers.swap(m_MM->m_Initializers);
+    typedef void (*Initializer_t)();
+    for (const auto& Array : Initializers) {
+      Initializer_t* Begin = reinterpret_cast<Initializer_t*>(Array.first);
+      for (uintptr_t I = 0, N = Array.second / sizeof(Initializer_t); I < N;
+           ++I)
+        Begin[I]();
+    }
+    return true;
+  }
+
+  bool ObjectRunner::addObjectFile(StringRef Path, std::string& Err) {
+    auto Buf = MemoryBuffer::getFile(Path, /*FileSize*/ -1,
+                                     /*RequiresNullTerminator*/ false);
+    if (!Buf) {
+      Err = "cannot read '" + Path.str() + "': " + Buf.getError().message();
+      return false;
+    }
+    return addObject(std::move(*Buf), Err);
+  }
+
+  bool ObjectRunner::addPackage(std::unique_ptr<MemoryBuffer> Package,
+                                std::string& Err) {
+    StringRef Rest = Package->getBuffer();
+    StringRef Line;
+    std::tie(Line, Rest) = Rest.split('\n');
+    if (Line != "cling package 1") {
+      Err = "not a package: '" + Package->getBufferIdentifier().str() + "'";
+      return false;
+    }
+
+    std::vector<std::string> Needs;
+    size_t ObjectSize = 0;
+    while (true) {
+      std::tie(Line, Rest) = Rest.split('\n');
+      StringRef Key, Value;
+      std::tie(Key, Value) = Line.split(' ');
+      if (Key == "object") {
+        if (Value.getAsInteger(10, ObjectSize) || ObjectSize > Rest.size()) {
+          Err = "truncated package: '"
+                + Package->getBufferIdentifier().str() + "'";
+          return false;
+        }
+        break;
+      }
+      if (Key == "needs")
+        Needs.push_back(Value.str());
+      else if (Key == "library") {
+        std::string LibErr;
+        if (!loadLibrary(Value, LibErr)
+            && !loadLibrary(sys::path::filename(Value), Err))
+          return false;
+      } else {
+        Err = "malformed package: '"
+              + Package->getBufferIdentifier().str() + "'";
+        return false;
+      }
+    }
+
+    std::string Missing;
+    for (const std::string& Name : Needs) {
+      if (!m_Dyld->getSymbol(Name) && !m_Resolver->findSymbol(Name))
+        Missing += ' ' + Name;
+    }
+    if (!Missing.empty()) {
+      Err = "no object, library or the process defines the symbols that '"
+            + Package->getBufferIdentifier().str() + "' needs:" + Missing;
+      return false;
+    }
+    return addObject(MemoryBuffer::getMemBufferCopy(
+                       Rest.substr(0, ObjectSize),
+                       Package->getBufferIdentifier()), Err);
+  }
+
+  bool ObjectRunner::addPackageFile(StringRef Path, std::string& Err) {
+    auto Buf = MemoryBuffer::getFile(Path, /*FileSize*/ -1,
+                                     /*RequiresNullTerminator*/ false);
+    if (!Buf) {
+      Err = "cannot read '" + Path.str() + "': " + Buf.getError().message();
+      return false;
+    }
+    return addPackage(std::move(*Buf), Err);
+  }
+
+  void* ObjectRunner::getAddress(StringRef Name) const {
+    JITEvaluatedSymbol Sym = m_Dyld->getSymbol((kGlobalPrefix + Name).str());
+    return reinterpret_cast<void*>(uintptr_t(Sym.getAddress()));
+  }
+
+  bool ObjectRunner::run(StringRef Name) const {
+    void (*Func)() = getFunction<void()>(Name);
+    if (!Func)
+      return false;
+    Func();
+    return true;
+  }
+} // end namespace cling
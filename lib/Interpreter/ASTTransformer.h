@@ -98,6 +98,17 @@ namespace cling {
       return Transform(D);
     }
 
+    ///\brief The parts of the runtime universe that were declared lazily,
+    /// see Interpreter::declareRuntimeFor(), got unloaded: drop what refers
+    /// to their declarations.
+    ///
+    virtual void ForgetRuntime() {}
+
+    ///\brief T is about to be unloaded: drop what refers to its
+    /// declarations.
+    ///
+    virtual void TransactionUnloading(const Transaction& T) {}
+
   protected:
     ///\brief Transforms the declaration.
     ///
@@ -0,0 +1,76 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "AddressSymbols.h"
+
+#include "IncrementalExecutor.h"
+
+#include "cling/Interpreter/Interpreter.h"
+#include "cling/Utils/AST.h"
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Attr.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/Expr.h"
+#include "clang/Sema/Sema.h"
+
+#include "llvm/Support/MD5.h"
+
+using namespace clang;
+
+namespace cling {
+  Expr* AddressSymbols::get(Sema& S, llvm::StringRef Key,
+                            const void* Address) {
+    ASTContext& C = S.getASTContext();
+    // Nothing links the symbols without a JIT.
+    if (m_Interp.isInSyntaxOnlyMode())
+      return utils::Synthesize::CStyleCastPtrExpr(&S, C.VoidPtrTy,
+                                                  (uintptr_t)Address);
+
+    // Keys are type names or source locations, which make no symbol names.
+    llvm::MD5 Hash;
+    Hash.update(Key);
+    llvm::MD5::MD5Result Digest;
+    Hash.final(Digest);
+    const std::string Base = m_Prefix + Digest.digest().str().str();
+    std::string Name = Base;
+    Symbol* Sym = &m_Symbols[Name];
+    for (unsigned N = 1; Sym->VD && Sym->Address != Address; ++N) {
+      Name = Base + "_" + std::to_string(N);
+      Sym = &m_Symbols[Name];
+    }
+
+    if (!Sym->VD) {
+      // extern char <Name>; outside of any DeclContext, not to be found by
+      // lookups, and named by its label such that it is not mangled.
+      IdentifierInfo* II = &C.Idents.get(Name);
+      VarDecl* VD = VarDecl::Create(C, C.getTranslationUnitDecl(),
+                                    SourceLocation(), SourceLocation(), II,
+                                    C.CharTy,
+                                    C.getTrivialTypeSourceInfo(C.CharTy),
+                                    SC_Extern);
+      VD->addAttr(AsmLabelAttr::CreateImplicit(C, Name));
+      VD->setImplicit();
+      // Into the JIT's own symbols: another interpreter of the process has
+      // its own address for the same Name.
+      if (!m_Interp.m_Executor->addSymbol(Name.c_str(),
+                                          const_cast<void*>(Address),
+                                          /*Jit*/ true))
+        return utils::Synthesize::CStyleCastPtrExpr(&S, C.VoidPtrTy,
+                                                    (uintptr_t)Address);
+      Sym->Address = Address;
+      Sym->VD = VD;
+    }
+
+    Expr* Ref = S.BuildDeclRefExpr(Sym->VD, C.CharTy, VK_LValue,
+                                   SourceLocation());
+    Expr* AddrOf
+      = S.CreateBuiltinUnaryOp(SourceLocation(), UO_AddrOf, Ref).get();
+    return utils::Synthesize::CStyleCastPtrExpr(&S, C.VoidPtrTy, AddrOf);
+  }
+} // end namespace cling
@@ -0,0 +1,58 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_ADDRESS_SYMBOLS_H
+#define CLING_ADDRESS_SYMBOLS_H
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+
+namespace clang {
+  class Expr;
+  class Sema;
+  class VarDecl;
+}
+
+namespace cling {
+  class Interpreter;
+
+  ///\brief Passes the addresses of this process that synthesized code hands
+  /// to the runtime, e.g. the clang::QualType of a cling::Value, through
+  /// symbols that the JIT resolves to them, instead of as constants.
+  ///
+  /// The symbols are named after a key that does not depend on where the
+  /// process allocated them, e.g. the name of the type: the IR of an input,
+  /// hence its SessionJournal key, is then the same in the next session,
+  /// whose JIT can link the cached object to its own addresses.
+  ///
+  class AddressSymbols {
+    struct Symbol {
+      const void* Address = nullptr;
+      clang::VarDecl* VD = nullptr;
+    };
+
+    Interpreter& m_Interp;
+    std::string m_Prefix;
+    llvm::StringMap<Symbol> m_Symbols;
+
+  public:
+    AddressSymbols(Interpreter& I, llvm::StringRef Prefix)
+      : m_Interp(I), m_Prefix(Prefix.str()) {}
+
+    ///\brief An expression of type void* for Address, through the symbol of
+    /// Key; keys that refer to several addresses get a symbol per address,
+    /// numbered in the order they were seen.
+    ///
+    clang::Expr* get(clang::Sema& S, llvm::StringRef Key,
+                     const void* Address);
+  };
+} // end namespace cling
+
+#endif // CLING_ADDRESS_SYMBOLS_H
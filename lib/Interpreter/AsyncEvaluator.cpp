@@ -0,0 +1,108 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "AsyncEvaluator.h"
+
+#include "cling/Interpreter/Value.h"
+
+#include <exception>
+
+namespace cling {
+
+  AsyncEvaluator::~AsyncEvaluator() {
+    {
+      std::lock_guard<std::mutex> Lock(m_Mutex);
+      m_Stopping = true;
+    }
+    m_Submitted.notify_one();
+    if (m_Thread.joinable())
+      m_Thread.join();
+  }
+
+  std::future<Interpreter::CompilationResult>
+  AsyncEvaluator::submit(const std::string& Input, Value& V) {
+    std::future<Interpreter::CompilationResult> Result;
+    {
+      std::lock_guard<std::mutex> Lock(m_Mutex);
+      m_Queue.push_back(Request{Input, &V, {}});
+      Result = m_Queue.back().Result.get_future();
+      if (!m_Thread.joinable())
+        m_Thread = std::thread(&AsyncEvaluator::run, this);
+    }
+    m_Submitted.notify_one();
+    return Result;
+  }
+
+  void AsyncEvaluator::setExecutor(Interpreter::AsyncExecutor Exec) {
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+    m_Executor = std::move(Exec);
+  }
+
+  void AsyncEvaluator::run() {
+    while (true) {
+      Request R;
+      Interpreter::AsyncExecutor Exec;
+      {
+        std::unique_lock<std::mutex> Lock(m_Mutex);
+        m_Submitted.wait(Lock, [this] {
+          return m_Stopping || !m_Queue.empty();
+        });
+        // Finish what was submitted before stopping.
+        if (m_Queue.empty())
+          return;
+        R = std::move(m_Queue.front());
+        m_Queue.pop_front();
+        Exec = m_Executor;
+        m_Busy = true;
+      }
+      evaluate(R, Exec);
+      {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        m_Busy = false;
+      }
+      m_Idle.notify_all();
+    }
+  }
+
+  void AsyncEvaluator::drain() {
+    std::unique_lock<std::mutex> Lock(m_Mutex);
+    m_Idle.wait(Lock, [this] { return m_Queue.empty() && !m_Busy; });
+  }
+
+  void AsyncEvaluator::evaluate(Request& R,
+                                const Interpreter::AsyncExecutor& Exec) {
+    try {
+      Transaction* T = nullptr;
+      if (m_Interpreter.compileForAsync(R.Input, T) != Interpreter::kSuccess) {
+        *R.V = Value();
+        R.Result.set_value(Interpreter::kFailure);
+        return;
+      }
+      if (!Exec) {
+        R.Result.set_value(m_Interpreter.runForAsync(T, *R.V));
+        return;
+      }
+
+      // Wait for the executor: the next input must not be compiled while
+      // this one runs.
+      std::promise<void> Ran;
+      Exec([&] {
+        try {
+          R.Result.set_value(m_Interpreter.runForAsync(T, *R.V));
+        } catch (...) {
+          R.Result.set_exception(std::current_exception());
+        }
+        Ran.set_value();
+      });
+      Ran.get_future().wait();
+    } catch (...) {
+      R.Result.set_exception(std::current_exception());
+    }
+  }
+
+} // end namespace cling
@@ -0,0 +1,73 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_ASYNC_EVALUATOR_H
+#define CLING_ASYNC_EVALUATOR_H
+
+#include "cling/Interpreter/Interpreter.h"
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace cling {
+
+  ///\brief The compile thread behind Interpreter::evaluateAsync().
+  ///
+  /// Inputs are compiled one after the other, in the order they were
+  /// submitted. The wrapper of each is run by the executor, or on the compile
+  /// thread if there is none, and must return before the next input gets
+  /// compiled: compilation runs static initializers, and the JIT compiles
+  /// functions upon their first call, so neither can overlap with user code.
+  ///
+  class AsyncEvaluator {
+    struct Request {
+      std::string Input;
+      Value* V;
+      std::promise<Interpreter::CompilationResult> Result;
+    };
+
+    Interpreter& m_Interpreter;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_Submitted;
+    std::condition_variable m_Idle;
+    std::deque<Request> m_Queue;
+    Interpreter::AsyncExecutor m_Executor;
+    bool m_Stopping = false;
+    ///\brief Whether the compile thread evaluates a request.
+    bool m_Busy = false;
+
+    ///\brief Started upon the first submission.
+    std::thread m_Thread;
+
+    void run();
+    void evaluate(Request& R, const Interpreter::AsyncExecutor& Exec);
+
+  public:
+    AsyncEvaluator(Interpreter& Interp): m_Interpreter(Interp) {}
+
+    ///\brief Evaluates what was submitted, then stops the compile thread.
+    ~AsyncEvaluator();
+
+    std::future<Interpreter::CompilationResult>
+    submit(const std::string& Input, Value& V);
+
+    void setExecutor(Interpreter::AsyncExecutor Exec);
+
+    ///\brief Waits until what was submitted is evaluated. The executor must
+    /// not be the calling thread.
+    void drain();
+  };
+
+} // end namespace cling
+
+#endif // CLING_ASYNC_EVALUATOR_H
@@ -84,7 +84,7 @@ namespace cling {
 
 namespace cling {
   AutoSynthesizer::AutoSynthesizer(clang::Sema* S)
-    : ASTTransformer(S) {
+    : WrapperTransformer(S) {
     // TODO: We would like to keep that local without keeping track of all
     // decls that were handled in the AutoFixer. This can be done by removing
     // the __Auto attribute, but for now I am still hesitant to do it. Having
@@ -22,7 +22,10 @@ namespace clang {
 namespace cling {
   class AutoFixer;
 
-  class AutoSynthesizer : public ASTTransformer {
+  ///\brief Declares the variables that the prompt introduced without a type,
+  /// e.g. `a = 5`, which only exist in the wrappers.
+  ///
+  class AutoSynthesizer : public WrapperTransformer {
   private:
     std::unique_ptr<AutoFixer> m_AutoFixer;
 
@@ -11,6 +11,8 @@
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/Support/Path.h"
 
+#include "clang/Parse/Parser.h"
+#include "clang/Sema/Lookup.h"
 #include "clang/Sema/Sema.h"
 #include "clang/Basic/Diagnostic.h"
 #include "clang/AST/AST.h"
@@ -25,12 +27,17 @@
 #include "cling/Interpreter/AutoloadCallback.h"
 #include "cling/Interpreter/Transaction.h"
 #include "cling/Utils/Output.h"
+#include "AutoloadIndex.h"
 #include "DeclUnloader.h"
+#include "EventTrace.h"
 
 
 
 #include <clang/Lex/HeaderSearch.h>
 
+#include <algorithm>
+#include <cstdlib>
+
 namespace {
   static const char annoTag[] = "$clingAutoload$";
   static const size_t lenAnnoTag = sizeof(annoTag) - 1;
@@ -56,7 +63,206 @@ namespace cling {
 
   }
 
+  AutoloadCallback::AutoloadCallback(cling::Interpreter* interp,
+                                     bool showSuggestions)
+    : InterpreterCallbacks(interp), m_ShowSuggestions(showSuggestions),
+      m_IsDeclaring(false),
+      m_IncludeOnCompletion(::getenv("CLING_AUTOLOAD_ON_COMPLETION")
+                            != nullptr) {}
+
+  ///\brief Adds the last component of Key, a qualified name.
+  static void addUnqualifiedName(llvm::StringRef Key,
+                                 LookupNameFilter& Filter) {
+    size_t Pos = Key.rfind("::");
+    Filter.insert(Pos == llvm::StringRef::npos ? Key : Key.substr(Pos + 2));
+  }
+
+  void AutoloadCallback::addIndex(std::unique_ptr<AutoloadIndex> Index) {
+    for (const auto& Name : Index->names())
+      addUnqualifiedName(Name.first(), m_NameFilter);
+    for (const auto& NS : Index->namespaces())
+      addUnqualifiedName(NS.first(), m_NameFilter);
+    m_Declared.emplace_back(Index->size(), false);
+    m_Indexes.push_back(std::move(Index));
+    TranslationUnitDecl* TU
+      = m_Interpreter->getSema().getASTContext().getTranslationUnitDecl();
+    for (Decl* D : TU->noload_decls())
+      markIndexedNamespaces(D);
+  }
+
+  void AutoloadCallback::markIndexedNamespaces(Decl* D) {
+    if (auto LSD = dyn_cast<LinkageSpecDecl>(D)) {
+      for (Decl* Inner : LSD->noload_decls())
+        markIndexedNamespaces(Inner);
+      return;
+    }
+    auto NSD = dyn_cast<NamespaceDecl>(D);
+    if (!NSD)
+      return;
+    if (!NSD->isInline() && !NSD->isAnonymousNamespace()) {
+      std::string Key = AutoloadIndex::getKey(NSD->getDeclContext(),
+                                              NSD->getName());
+      bool Indexed = false;
+      for (auto&& Index : m_Indexes)
+        Indexed |= Index->isNamespace(Key);
+      if (!Indexed)
+        return;
+      // Qualified lookups only ask for external decls in such contexts.
+      NSD->getPrimaryContext()->setHasExternalVisibleStorage(true);
+    }
+    for (Decl* Inner : NSD->noload_decls())
+      markIndexedNamespaces(Inner);
+  }
+
+  bool AutoloadCallback::declareFromIndexes(llvm::StringRef Key) {
+    std::string Code;
+    for (size_t I = 0, E = m_Indexes.size(); I != E; ++I) {
+      const AutoloadIndex& Index = *m_Indexes[I];
+      std::vector<bool>& Declared = m_Declared[I];
+      llvm::ArrayRef<unsigned> Found = Index.lookup(Key);
+      llvm::SmallVector<unsigned, 8> Worklist(Found.begin(), Found.end());
+      std::vector<unsigned> Chunks;
+      while (!Worklist.empty()) {
+        unsigned C = Worklist.pop_back_val();
+        if (Declared[C])
+          continue;
+        Declared[C] = true;
+        Chunks.push_back(C);
+        const std::vector<unsigned>& Deps = Index.getChunk(C).Deps;
+        Worklist.append(Deps.begin(), Deps.end());
+      }
+      if (!Chunks.empty()) {
+        // Chunks come after those they depend on.
+        std::sort(Chunks.begin(), Chunks.end());
+        Code += Index.getPrelude();
+        for (unsigned C : Chunks)
+          Code += Index.getChunk(C).Text;
+      } else if (Code.empty() && Index.isNamespace(Key)) {
+        // Only "ns" of "ns::Name" is looked up; declare the namespace, and
+        // the lookups into it get to the index.
+        llvm::SmallVector<llvm::StringRef, 4> Names;
+        Key.split(Names, "::");
+        for (llvm::StringRef Name : Names)
+          Code += "namespace " + Name.str() + " {";
+        Code += std::string(Names.size(), '}') + "\n";
+      }
+    }
+    if (Code.empty())
+      return false;
+    CLING_TRACE_SCOPE(Trace, kAutoload, Key);
+    return declare(Code);
+  }
+
+  bool AutoloadCallback::declare(const std::string& Code) {
+    // We are in the middle of a lookup; parse the code from a clean state,
+    // as ClingPragmas does for #pragma cling load.
+    Sema& SemaR = m_Interpreter->getSema();
+    Preprocessor& PP = SemaR.getPreprocessor();
+    Parser& P = m_Interpreter->getParser();
+    Parser::ParserCurTokRestoreRAII SavedCurToken(P);
+    // After we have saved the token reset the current one to something
+    // which is safe (semi colon usually means empty decl)
+    Token& CurTok = const_cast<Token&>(P.getCurToken());
+    CurTok.setKind(tok::semi);
+    Preprocessor::CleanupAndRestoreCacheRAII CleanupRAII(PP);
+    Sema::ContextAndScopeRAII PushedDCAndS(SemaR,
+                              SemaR.getASTContext().getTranslationUnitDecl(),
+                                           SemaR.TUScope);
+    Interpreter::PushTransactionRAII PushedT(m_Interpreter);
+
+    m_IsDeclaring = true;
+    Interpreter::CompilationResult Result = m_Interpreter->declare(Code);
+    m_IsDeclaring = false;
+    return Result == Interpreter::kSuccess;
+  }
+
+  bool AutoloadCallback::LookupObject(LookupResult& R, Scope* S) {
+    if (m_Indexes.empty() || m_IsDeclaring)
+      return false;
+    IdentifierInfo* II = R.getLookupName().getAsIdentifierInfo();
+    if (!II)
+      return false;
+
+    // The name might be declared in any of the enclosing namespaces.
+    llvm::SmallVector<std::string, 4> Keys;
+    for (DeclContext* DC = m_Interpreter->getSema().CurContext; DC;
+         DC = DC->getParent())
+      if (DC->isNamespace() || DC->isTranslationUnit()) {
+        std::string Key = AutoloadIndex::getKey(DC, II->getName());
+        if (!Key.empty())
+          Keys.push_back(std::move(Key));
+      }
+    bool Declared = false;
+    for (const std::string& Key : Keys)
+      Declared |= declareFromIndexes(Key);
+    if (!Declared)
+      return false;
+
+    // Find what was just declared; a failing lookup gets here again, but
+    // has nothing left to declare.
+    R.clear();
+    return m_Interpreter->getSema().LookupName(R, S) && !R.empty();
+  }
+
+  bool AutoloadCallback::LookupObject(const DeclContext* DC,
+                                      DeclarationName Name) {
+    if (m_Indexes.empty() || m_IsDeclaring)
+      return false;
+    IdentifierInfo* II = Name.getAsIdentifierInfo();
+    if (!II)
+      return false;
+    std::string Key = AutoloadIndex::getKey(DC, II->getName());
+    // The declarations end up in DC's lookup table, where our caller,
+    // DeclContext::lookup(), looks again.
+    return !Key.empty() && declareFromIndexes(Key);
+  }
+
+  ///\brief The header of the autoload annotation of a redeclaration of D.
+  static llvm::StringRef getAutoloadHeader(const Decl* D) {
+    for (const Decl* Redecl : D->redecls())
+      for (const AnnotateAttr* A : Redecl->specific_attrs<AnnotateAttr>()) {
+        llvm::StringRef Annotation = A->getAnnotation();
+        // The first one names the header #included by the user.
+        if (!A->isInherited()
+            && Annotation.startswith(llvm::StringRef(annoTag, lenAnnoTag)))
+          return Annotation.drop_front(lenAnnoTag);
+      }
+    return llvm::StringRef();
+  }
+
+  void AutoloadCallback::markForCompletion(Decl* D) {
+    if (auto LSD = dyn_cast<LinkageSpecDecl>(D)) {
+      for (Decl* Inner : LSD->noload_decls())
+        markForCompletion(Inner);
+    } else if (auto NSD = dyn_cast<NamespaceDecl>(D)) {
+      for (Decl* Inner : NSD->noload_decls())
+        markForCompletion(Inner);
+    } else if (auto TD = dyn_cast<TagDecl>(D)) {
+      if (TD->getDefinition() || getAutoloadHeader(TD).empty())
+        return;
+      // Sema asks the external source to complete the type only then; the
+      // type's decl is the first one.
+      TD->getCanonicalDecl()->setHasExternalLexicalStorage();
+    }
+  }
+
+  bool AutoloadCallback::includeHeaderOf(TagDecl* t) {
+    TagDecl* First = t->getCanonicalDecl();
+    if (m_IsDeclaring || !First->hasExternalLexicalStorage())
+      return false;
+    llvm::StringRef Header = getAutoloadHeader(First);
+    if (Header.empty())
+      return false;
+    // Once: if the #include fails, the type stays incomplete.
+    First->setHasExternalLexicalStorage(false);
+    CLING_TRACE_SCOPE(Trace, kAutoload, Header);
+    return declare("#include \"" + Header.str() + "\"\n")
+      && t->getDefinition();
+  }
+
   bool AutoloadCallback::LookupObject (TagDecl *t) {
+    if (m_IncludeOnCompletion && includeHeaderOf(t))
+      return true;
     if (m_ShowSuggestions && t->hasAttr<AnnotateAttr>())
       report(t->getLocation(),t->getNameAsString(),t->getAttr<AnnotateAttr>()->getAnnotation());
     return false;
@@ -357,6 +563,14 @@ namespace cling {
   void AutoloadCallback::TransactionCommitted(const Transaction &T) {
     if (T.decls_begin() == T.decls_end())
       return;
+
+    // Namespaces declared from now on can have names in the indexes, too.
+    if (!m_Indexes.empty())
+      for (auto I = T.decls_begin(), E = T.decls_end(); I != E; ++I)
+        if (I->m_Call == Transaction::kCCIHandleTopLevelDecl)
+          for (auto&& D: I->m_DGR)
+            markIndexedNamespaces(D);
+
     if (T.decls_begin()->m_DGR.isNull())
       return;
 
@@ -388,8 +602,11 @@ namespace cling {
     AutoLoadingVisitor defaultArgsStateCollector;
     Preprocessor& PP = m_Interpreter->getCI()->getPreprocessor();
     for (auto I = T.decls_begin(), E = T.decls_end(); I != E; ++I)
-      for (auto&& D: I->m_DGR)
+      for (auto&& D: I->m_DGR) {
         defaultArgsStateCollector.TrackDefaultArgStateOf(D, m_Map, PP);
+        if (m_IncludeOnCompletion)
+          markForCompletion(D);
+      }
   }
 
 } //end namespace cling
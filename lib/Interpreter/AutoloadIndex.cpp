@@ -0,0 +1,194 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "AutoloadIndex.h"
+
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclBase.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+namespace {
+  static const char kMagic[] = "CLINGAIX";
+  static const size_t kMagicSize = sizeof(kMagic) - 1;
+  static const uint32_t kVersion = 1;
+
+  ///\brief Reads the little endian records of an index, failing on
+  /// truncation.
+  class Reader {
+    const char* m_Cur;
+    const char* m_End;
+
+  public:
+    Reader(StringRef Buf): m_Cur(Buf.begin()), m_End(Buf.end()) {}
+
+    bool read(uint32_t& V) {
+      if (m_End - m_Cur < 4)
+        return false;
+      V = support::endian::read32le(m_Cur);
+      m_Cur += 4;
+      return true;
+    }
+
+    bool read(std::string& S) {
+      uint32_t Size;
+      if (!read(Size) || uint32_t(m_End - m_Cur) < Size)
+        return false;
+      S.assign(m_Cur, Size);
+      m_Cur += Size;
+      return true;
+    }
+  };
+
+  static void writeString(support::endian::Writer& W, StringRef S) {
+    W.write<uint32_t>(S.size());
+    W.OS << S;
+  }
+} // unnamed namespace
+
+namespace cling {
+
+unsigned AutoloadIndex::addChunk(std::string Text, std::vector<unsigned> Deps) {
+  m_Chunks.push_back(Chunk{std::move(Text), std::move(Deps)});
+  return m_Chunks.size() - 1;
+}
+
+void AutoloadIndex::addName(StringRef Key, unsigned Chunk) {
+  std::vector<unsigned>& Chunks = m_Names[Key];
+  if (std::find(Chunks.begin(), Chunks.end(), Chunk) != Chunks.end())
+    return;
+  Chunks.push_back(Chunk);
+  for (size_t Pos = Key.find("::"); Pos != StringRef::npos;
+       Pos = Key.find("::", Pos + 2))
+    m_Namespaces.insert(Key.substr(0, Pos));
+}
+
+ArrayRef<unsigned> AutoloadIndex::lookup(StringRef Key) const {
+  auto I = m_Names.find(Key);
+  if (I == m_Names.end())
+    return None;
+  return I->second;
+}
+
+std::string AutoloadIndex::getKey(const clang::DeclContext* DC,
+                                  StringRef Name) {
+  SmallVector<StringRef, 4> Scopes;
+  for (; !DC->isTranslationUnit(); DC = DC->getParent()) {
+    if (DC->getDeclKind() == clang::Decl::LinkageSpec)
+      continue;
+    const auto* NSD = dyn_cast<clang::NamespaceDecl>(DC);
+    if (!NSD)
+      return std::string();
+    if (NSD->isInline() || NSD->isAnonymousNamespace())
+      continue;
+    Scopes.push_back(NSD->getName());
+  }
+  std::string Key;
+  for (auto I = Scopes.rbegin(), E = Scopes.rend(); I != E; ++I)
+    Key += I->str() + "::";
+  return Key + Name.str();
+}
+
+bool AutoloadIndex::write(StringRef File, std::string& Error) const {
+  std::error_code EC;
+  raw_fd_ostream OS(File, EC, sys::fs::F_None);
+  if (EC) {
+    Error = EC.message();
+    return false;
+  }
+  support::endian::Writer W(OS, support::little);
+  OS << StringRef(kMagic, kMagicSize);
+  W.write<uint32_t>(kVersion);
+  writeString(W, m_Prelude);
+
+  W.write<uint32_t>(m_Chunks.size());
+  for (const Chunk& C : m_Chunks) {
+    writeString(W, C.Text);
+    W.write<uint32_t>(C.Deps.size());
+    for (unsigned D : C.Deps)
+      W.write<uint32_t>(D);
+  }
+
+  W.write<uint32_t>(m_Names.size());
+  for (const auto& Name : m_Names) {
+    writeString(W, Name.getKey());
+    W.write<uint32_t>(Name.getValue().size());
+    for (unsigned C : Name.getValue())
+      W.write<uint32_t>(C);
+  }
+  OS.close();
+  if (OS.has_error()) {
+    OS.clear_error();
+    Error = "cannot write " + File.str();
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<AutoloadIndex> AutoloadIndex::read(StringRef File,
+                                                   std::string& Error) {
+  auto Buf = MemoryBuffer::getFile(File, /*FileSize*/ -1,
+                                   /*RequiresNullTerminator*/ false);
+  if (!Buf) {
+    Error = Buf.getError().message();
+    return nullptr;
+  }
+  StringRef Contents = (*Buf)->getBuffer();
+  if (!Contents.startswith(StringRef(kMagic, kMagicSize))) {
+    Error = "not an autoload index";
+    return nullptr;
+  }
+
+  Reader R(Contents.drop_front(kMagicSize));
+  std::unique_ptr<AutoloadIndex> Index(new AutoloadIndex());
+  uint32_t Version, NumChunks, NumNames;
+  if (!R.read(Version) || Version != kVersion) {
+    Error = "unsupported autoload index version";
+    return nullptr;
+  }
+  bool Valid = R.read(Index->m_Prelude) && R.read(NumChunks);
+  for (uint32_t I = 0; Valid && I < NumChunks; ++I) {
+    Chunk C;
+    uint32_t NumDeps;
+    Valid = R.read(C.Text) && R.read(NumDeps);
+    for (uint32_t J = 0; Valid && J < NumDeps; ++J) {
+      uint32_t D;
+      // Dependencies are printed, and thus numbered, first.
+      Valid = R.read(D) && D < I;
+      C.Deps.push_back(D);
+    }
+    Index->m_Chunks.push_back(std::move(C));
+  }
+  Valid = Valid && R.read(NumNames);
+  for (uint32_t I = 0; Valid && I < NumNames; ++I) {
+    std::string Key;
+    uint32_t NumIds;
+    Valid = R.read(Key) && R.read(NumIds);
+    for (uint32_t J = 0; Valid && J < NumIds; ++J) {
+      uint32_t C;
+      Valid = R.read(C) && C < NumChunks;
+      if (Valid)
+        Index->addName(Key, C);
+    }
+  }
+  if (!Valid) {
+    Error = "truncated autoload index";
+    return nullptr;
+  }
+  return Index;
+}
+
+} // end namespace cling
@@ -0,0 +1,99 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_AUTOLOAD_INDEX_H
+#define CLING_AUTOLOAD_INDEX_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace clang {
+  class DeclContext;
+}
+
+namespace cling {
+
+  ///\brief The forward declarations of an autoloading map, by name.
+  ///
+  /// Instead of one header that must be parsed as a whole, the index holds
+  /// each declaration printed by the ForwardDeclPrinter as a chunk of code,
+  /// along with the chunks it refers to. The chunks are found by the
+  /// qualified name of what they declare, such that AutoloadCallback parses
+  /// only those that a lookup needs. Their $clingAutoload$ annotations, and
+  /// thus the headers and default arguments, are those of the textual map.
+  ///
+  class AutoloadIndex {
+  public:
+    struct Chunk {
+      std::string Text;
+      ///\brief The chunks Text refers to, to be declared before it.
+      std::vector<unsigned> Deps;
+    };
+
+  private:
+    ///\brief The code to declare before any chunk: the pragmas and the
+    /// marker of the autoloading map.
+    std::string m_Prelude;
+    std::vector<Chunk> m_Chunks;
+    llvm::StringMap<std::vector<unsigned>> m_Names;
+
+    ///\brief The enclosing namespaces of the names, e.g. "a" and "a::b" for
+    /// "a::b::C".
+    llvm::StringSet<> m_Namespaces;
+
+  public:
+    void setPrelude(std::string Prelude) { m_Prelude = std::move(Prelude); }
+    const std::string& getPrelude() const { return m_Prelude; }
+
+    unsigned addChunk(std::string Text, std::vector<unsigned> Deps);
+    const Chunk& getChunk(unsigned I) const { return m_Chunks[I]; }
+    size_t size() const { return m_Chunks.size(); }
+
+    ///\brief Makes Chunk found under Key, a qualified name as returned by
+    /// getKey(), unless it is already.
+    void addName(llvm::StringRef Key, unsigned Chunk);
+
+    const llvm::StringMap<std::vector<unsigned>>& names() const {
+      return m_Names;
+    }
+
+    ///\brief The chunks declaring Key.
+    llvm::ArrayRef<unsigned> lookup(llvm::StringRef Key) const;
+
+    const llvm::StringSet<>& namespaces() const { return m_Namespaces; }
+
+    ///\brief Whether Key is the namespace of any name in the index.
+    bool isNamespace(llvm::StringRef Key) const {
+      return m_Namespaces.count(Key);
+    }
+
+    ///\brief The key of Name declared in DC: the names of the enclosing
+    /// namespaces and Name, separated by "::". Inline and anonymous
+    /// namespaces and linkage specifications are left out, as lookup sees
+    /// through them. Empty if DC is not a namespace or the translation unit.
+    static std::string getKey(const clang::DeclContext* DC,
+                              llvm::StringRef Name);
+
+    ///\brief Writes the index to File; sets Error and returns false on
+    /// failure.
+    bool write(llvm::StringRef File, std::string& Error) const;
+
+    ///\brief Reads an index written by write(); sets Error and returns null
+    /// on failure.
+    static std::unique_ptr<AutoloadIndex> read(llvm::StringRef File,
+                                               std::string& Error);
+  };
+} // end namespace cling
+
+#endif // CLING_AUTOLOAD_INDEX_H
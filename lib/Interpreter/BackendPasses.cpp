@@ -9,24 +9,64 @@
 
 #include "BackendPasses.h"
 
+#include "llvm/ADT/Any.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Analysis/CFG.h"
 #include "llvm/Analysis/InlineCost.h"
+#include "llvm/Analysis/LazyCallGraph.h"
+#include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/DiagnosticHandler.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/OptBisect.h"
+#include "llvm/IR/PassInstrumentation.h"
+#include "llvm/IR/PassManager.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/ProfileData/InstrProf.h"
+#include "llvm/ProfileData/ProfileCommon.h"
+#include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Transforms/IPO.h"
 #include "llvm/Transforms/IPO/AlwaysInliner.h"
 #include "llvm/Transforms/IPO/Inliner.h"
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/InstCombine/InstCombine.h"
 #include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Scalar/EarlyCSE.h"
+#include "llvm/Transforms/Scalar/SROA.h"
+#include "llvm/Transforms/Scalar/SimplifyCFG.h"
 #include "llvm/Transforms/Utils.h"
+#include "llvm/Transforms/Utils/AddDiscriminators.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
 
 //#include "clang/Basic/LangOptions.h"
-//#include "clang/Basic/TargetOptions.h"
 #include "clang/Basic/CharInfo.h"
 #include "clang/Basic/CodeGenOptions.h"
+#include "clang/Basic/TargetOptions.h"
+
+#include "cling/Interpreter/BackendPassExtension.h"
+#include "cling/Utils/AST.h"
+#include "cling/Utils/Platform.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <mutex>
 
 using namespace cling;
 using namespace clang;
@@ -37,7 +77,7 @@ namespace {
   class KeepLocalGVPass: public ModulePass {
     static char ID;
 
-    bool runOnGlobal(GlobalValue& GV) {
+    static bool runOnGlobal(GlobalValue& GV) {
       if (GV.isDeclaration())
         return false; // no change.
 
@@ -58,7 +98,7 @@ namespace {
   public:
     KeepLocalGVPass() : ModulePass(ID) {}
 
-    bool runOnModule(Module &M) override {
+    static bool keepLocalGVs(Module &M) {
       bool ret = false;
       for (auto &&F: M)
         ret |= runOnGlobal(F);
@@ -66,6 +106,18 @@ namespace {
         ret |= runOnGlobal(G);
       return ret;
     }
+
+    bool runOnModule(Module &M) override {
+      return keepLocalGVs(M);
+    }
+  };
+
+  // KeepLocalGVPass for the new pass manager.
+  struct KeepLocalGV : PassInfoMixin<KeepLocalGV> {
+    PreservedAnalyses run(Module& M, ModuleAnalysisManager&) {
+      return KeepLocalGVPass::keepLocalGVs(M) ? PreservedAnalyses::none()
+                                              : PreservedAnalyses::all();
+    }
   };
 }
 
@@ -79,7 +131,7 @@ namespace {
   class UniqueCUDAStructorName : public ModulePass {
     static char ID;
 
-    bool runOnFunction(Function& F, const StringRef ModuleName){
+    static bool runOnFunction(Function& F, const StringRef ModuleName){
       if(F.hasName() && (F.getName() == "__cuda_module_ctor"
           || F.getName() == "__cuda_module_dtor") ){
         llvm::SmallString<128> NewFunctionName;
@@ -105,33 +157,725 @@ namespace {
   public:
     UniqueCUDAStructorName() : ModulePass(ID) {}
 
-    bool runOnModule(Module &M) override {
+    static bool renameStructors(Module &M) {
       bool ret = false;
       const StringRef ModuleName = M.getName();
       for (auto &&F: M)
         ret |= runOnFunction(F, ModuleName);
       return ret;
     }
+
+    bool runOnModule(Module &M) override {
+      return renameStructors(M);
+    }
+  };
+
+  // UniqueCUDAStructorName for the new pass manager.
+  struct UniqueCUDAStructorNames : PassInfoMixin<UniqueCUDAStructorNames> {
+    PreservedAnalyses run(Module& M, ModuleAnalysisManager&) {
+      return UniqueCUDAStructorName::renameStructors(M)
+        ? PreservedAnalyses::none() : PreservedAnalyses::all();
+    }
   };
 }
 
 char UniqueCUDAStructorName::ID = 0;
 
+namespace {
+
+  // Tiered compilation: move the body of each eligible function F into
+  // F.tier0 and turn F into a stub that counts its invocations and calls
+  // through the pointer F.tierptr, initially pointing to F.tier0. Once hot,
+  // the stub invokes the JIT's tier-up hook which eventually re-points
+  // F.tierptr to an optimized F.tier2.
+  class TierUpCountersPass : public ModulePass {
+    static char ID;
+
+    uint64_t m_Threshold;
+
+    static bool isEligible(const Function& F) {
+      if (F.isDeclaration() || F.isVarArg() || !F.hasExternalLinkage())
+        return false;
+      if (F.hasFnAttribute(Attribute::Naked)
+          || F.hasFnAttribute(Attribute::AlwaysInline))
+        return false;
+      // Skip wrappers and initializers: they run once.
+      StringRef Name = F.getName();
+      return !Name.empty() && !Name.startswith("__cling")
+        && !Name.startswith("_GLOBAL__") && !Name.startswith("__cxx_global")
+        && !Name.startswith("__cuda") && !Name.endswith(".tier0");
+    }
+
+    void runOnFunction(Function& F, Constant* JITVar, FunctionCallee Hook) {
+      Module& M = *F.getParent();
+      LLVMContext& C = M.getContext();
+      const std::string Name = F.getName().str();
+      FunctionType* FTy = F.getFunctionType();
+
+      Function* Impl = Function::Create(FTy, GlobalValue::ExternalLinkage,
+                                        Name + ".tier0", &M);
+      Impl->copyAttributesFrom(&F);
+      Impl->getBasicBlockList().splice(Impl->begin(), F.getBasicBlockList());
+      for (auto AI = F.arg_begin(), NI = Impl->arg_begin(), AE = F.arg_end();
+           AI != AE; ++AI, ++NI) {
+        AI->replaceAllUsesWith(&*NI);
+        NI->takeName(&*AI);
+      }
+      if (DISubprogram* SP = F.getSubprogram()) {
+        Impl->setSubprogram(SP);
+        F.setSubprogram(nullptr);
+      }
+
+      Type* I64 = Type::getInt64Ty(C);
+      Type* I8Ptr = Type::getInt8PtrTy(C);
+      PointerType* FPtrTy = FTy->getPointerTo();
+      auto* Counter = new GlobalVariable(M, I64, /*isConstant*/ false,
+                                         GlobalValue::InternalLinkage,
+                                         ConstantInt::get(I64, 0),
+                                         Name + ".tiercount");
+      auto* Target = new GlobalVariable(M, FPtrTy, /*isConstant*/ false,
+                                        GlobalValue::InternalLinkage, Impl,
+                                        Name + ".tierptr");
+
+      BasicBlock* Entry = BasicBlock::Create(C, "entry", &F);
+      BasicBlock* TierUp = BasicBlock::Create(C, "tierup", &F);
+      BasicBlock* Call = BasicBlock::Create(C, "call", &F);
+
+      // Call the hook when reaching the threshold, and then every 1024 calls
+      // until the hook disables the counter; the optimized code might take a
+      // while.
+      IRBuilder<> B(Entry);
+      Constant* Threshold = ConstantInt::get(I64, m_Threshold);
+      Value* N = B.CreateAdd(B.CreateLoad(I64, Counter),
+                             ConstantInt::get(I64, 1));
+      B.CreateStore(N, Counter);
+      Value* Poll = B.CreateAnd(B.CreateICmpSGT(N, Threshold),
+                                B.CreateICmpEQ(B.CreateAnd(N, 1023),
+                                               ConstantInt::get(I64, 0)));
+      B.CreateCondBr(B.CreateOr(B.CreateICmpEQ(N, Threshold), Poll),
+                     TierUp, Call);
+
+      B.SetInsertPoint(TierUp);
+      B.CreateCall(Hook, {B.CreateLoad(I8Ptr, JITVar),
+                          B.CreateGlobalStringPtr(F.getName()),
+                          B.CreatePointerCast(Target, I8Ptr), Counter});
+      B.CreateBr(Call);
+
+      B.SetInsertPoint(Call);
+      SmallVector<Value*, 8> Args;
+      for (Argument& A : F.args())
+        Args.push_back(&A);
+      CallInst* CI = B.CreateCall(FTy, B.CreateLoad(FPtrTy, Target), Args);
+      CI->setCallingConv(F.getCallingConv());
+      CI->setAttributes(F.getAttributes());
+      if (FTy->getReturnType()->isVoidTy())
+        B.CreateRetVoid();
+      else
+        B.CreateRet(CI);
+    }
+
+  public:
+    TierUpCountersPass(uint64_t Threshold = 0):
+      ModulePass(ID), m_Threshold(Threshold) {}
+
+    bool runOnModule(Module &M) override {
+      SmallVector<Function*, 32> Candidates;
+      for (auto &&F: M)
+        if (isEligible(F))
+          Candidates.push_back(&F);
+      if (Candidates.empty())
+        return false;
+
+      LLVMContext& C = M.getContext();
+      Type* I8Ptr = Type::getInt8PtrTy(C);
+      Constant* JITVar
+        = M.getOrInsertGlobal(BackendPasses::getTierUpJITName(), I8Ptr);
+      FunctionCallee Hook
+        = M.getOrInsertFunction(BackendPasses::getTierUpHookName(),
+                                Type::getVoidTy(C), I8Ptr, I8Ptr, I8Ptr,
+                                Type::getInt64PtrTy(C));
+      for (Function* F : Candidates)
+        runOnFunction(*F, JITVar, Hook);
+      return true;
+    }
+  };
+}
+
+char TierUpCountersPass::ID = 0;
+
+namespace {
+  ///\brief The metadata giving a branch's first slot in the counters.
+  static const char kProfileSlotMD[] = "cling.pgo";
+
+  // Counts the executions of the tier-0 body F: its entry in slot 0, then
+  // each edge of the branches and switches, whose terminator records its
+  // first slot. The counters are the array F.pgocounts.
+  static void addProfileCountersTo(Function& F) {
+    Module& M = *F.getParent();
+    LLVMContext& C = M.getContext();
+    Type* I64 = Type::getInt64Ty(C);
+
+    SmallVector<Instruction*, 32> Branches;
+    for (BasicBlock& BB : F) {
+      Instruction* T = BB.getTerminator();
+      if ((isa<BranchInst>(T) && cast<BranchInst>(T)->isConditional())
+          || isa<SwitchInst>(T))
+        Branches.push_back(T);
+    }
+    unsigned NumSlots = 1;
+    for (Instruction* T : Branches)
+      NumSlots += T->getNumSuccessors();
+
+    ArrayType* CountsTy = ArrayType::get(I64, NumSlots);
+    StringRef Name = F.getName();
+    Name.consume_back(".tier0");
+    auto* Counts = new GlobalVariable(M, CountsTy, /*isConstant*/ false,
+                                      GlobalValue::ExternalLinkage,
+                                      ConstantAggregateZero::get(CountsTy),
+                                      Name + BackendPasses::getProfileSuffix());
+    auto Count = [&](Instruction* Before, unsigned Slot) {
+      IRBuilder<> B(Before);
+      Value* Ptr = B.CreateConstInBoundsGEP2_64(Counts, 0, Slot);
+      B.CreateStore(B.CreateAdd(B.CreateLoad(I64, Ptr),
+                                ConstantInt::get(I64, 1)), Ptr);
+    };
+
+    Count(&*F.getEntryBlock().getFirstInsertionPt(), 0);
+    unsigned Slot = 1;
+    for (Instruction* T : Branches) {
+      T->setMetadata(kProfileSlotMD, MDNode::get(C,
+        ConstantAsMetadata::get(ConstantInt::get(I64, Slot))));
+      for (unsigned I = 0, N = T->getNumSuccessors(); I < N; ++I) {
+        // Count in the successor if the edge is its only way in.
+        BasicBlock* Edge = SplitCriticalEdge(T, I);
+        if (!Edge)
+          Edge = T->getSuccessor(I);
+        Count(&*Edge->getFirstInsertionPt(), Slot++);
+      }
+    }
+  }
+} // unnamed namespace
+
+namespace {
+  ///\brief Whether nothing can unwind out of or through the body of F: it
+  /// has no landing pads and only calls what does not throw, which includes
+  /// the functions of its module in NoUnwind.
+  static bool cannotUnwind(const Function& F,
+                           const SmallPtrSetImpl<const Function*>& NoUnwind) {
+    for (const Instruction& I : instructions(F)) {
+      if (I.isEHPad() || isa<InvokeInst>(I))
+        return false;
+      const auto* Call = dyn_cast<CallInst>(&I);
+      if (!Call) {
+        if (I.mayThrow())
+          return false;
+        continue;
+      }
+      if (Call->doesNotThrow())
+        continue;
+      const auto* Callee
+        = dyn_cast<Function>(Call->getCalledValue()->stripPointerCasts());
+      if (!Callee || !NoUnwind.count(Callee))
+        return false;
+    }
+    return true;
+  }
+} // unnamed namespace
+
+namespace {
+
+  // Pointer checks injected by the NullDerefProtectionTransformer differ in
+  // their Expr argument (used for the diagnostic), so no generic pass merges
+  // them, and they may throw, so LICM does not hoist them. Once a pointer was
+  // checked, later checks of the same pointer that are dominated by the first
+  // one reuse its result. A check of a loop-invariant pointer at the top of a
+  // loop header, before anything with side effects, is moved to the
+  // preheader: it would run on the first iteration anyway.
+  class MergePointerChecksPass : public FunctionPass {
+    static char ID;
+
+    static bool isPointerCheck(const Instruction& I) {
+      const auto* CI = dyn_cast<CallInst>(&I);
+      if (!CI || CI->getNumArgOperands() != 3)
+        return false;
+      const Function* Callee = CI->getCalledFunction();
+      return Callee && Callee->getName()
+        == "cling_runtime_internal_throwIfInvalidPointer";
+    }
+
+    static Value* getCheckedPointer(CallInst* CI) {
+      return CI->getArgOperand(2)->stripPointerCasts();
+    }
+
+    static bool hoistFromHeader(CallInst* CI, LoopInfo& LI) {
+      Loop* L = LI.getLoopFor(CI->getParent());
+      if (!L || L->getHeader() != CI->getParent())
+        return false;
+      BasicBlock* Preheader = L->getLoopPreheader();
+      if (!Preheader)
+        return false;
+      for (const Use& Op : CI->arg_operands())
+        if (!L->isLoopInvariant(Op.get()))
+          return false;
+      for (Instruction& I : *L->getHeader()) {
+        if (&I == CI)
+          break;
+        if (!isa<PHINode>(I) && I.mayHaveSideEffects())
+          return false;
+      }
+      CI->moveBefore(Preheader->getTerminator());
+      return true;
+    }
+
+  public:
+    MergePointerChecksPass() : FunctionPass(ID) {}
+
+    void getAnalysisUsage(AnalysisUsage& AU) const override {
+      AU.addRequired<DominatorTreeWrapperPass>();
+      AU.addRequired<LoopInfoWrapperPass>();
+      AU.setPreservesCFG();
+    }
+
+    bool runOnFunction(Function& F) override {
+      if (!hasPointerChecks(F))
+        return false;
+      return mergeChecks(F,
+                         getAnalysis<DominatorTreeWrapperPass>().getDomTree(),
+                         getAnalysis<LoopInfoWrapperPass>().getLoopInfo());
+    }
+
+    static bool hasPointerChecks(Function& F) {
+      for (Instruction& I : instructions(F))
+        if (isPointerCheck(I))
+          return true;
+      return false;
+    }
+
+    static bool mergeChecks(Function& F, DominatorTree& DT, LoopInfo& LI) {
+      SmallVector<CallInst*, 16> Checks;
+      for (Instruction& I : instructions(F))
+        if (isPointerCheck(I))
+          Checks.push_back(cast<CallInst>(&I));
+      bool Changed = false;
+      for (CallInst* CI : Checks)
+        Changed |= hoistFromHeader(CI, LI);
+
+      // Hoisting leaves the CFG and thus the dominator tree intact. Checks
+      // are in block layout order, which usually but not always lists a
+      // dominating check first; missing one only keeps a redundant check.
+      SmallVector<CallInst*, 16> Kept;
+      for (CallInst* CI : Checks) {
+        Value* Ptr = getCheckedPointer(CI);
+        CallInst* Dom = nullptr;
+        for (CallInst* K : Kept)
+          if (getCheckedPointer(K) == Ptr && DT.dominates(K, CI)) {
+            Dom = K;
+            break;
+          }
+        if (!Dom) {
+          Kept.push_back(CI);
+          continue;
+        }
+        Value* Repl = Dom;
+        if (Repl->getType() != CI->getType())
+          Repl = CastInst::CreatePointerCast(Repl, CI->getType(), "", CI);
+        CI->replaceAllUsesWith(Repl);
+        CI->eraseFromParent();
+        Changed = true;
+      }
+      return Changed;
+    }
+  };
+
+  // MergePointerChecksPass for the new pass manager.
+  struct MergePointerChecks : PassInfoMixin<MergePointerChecks> {
+    PreservedAnalyses run(Function& F, FunctionAnalysisManager& AM) {
+      // Most functions have none; spare them the analyses.
+      if (!MergePointerChecksPass::hasPointerChecks(F))
+        return PreservedAnalyses::all();
+      if (!MergePointerChecksPass::mergeChecks(
+            F, AM.getResult<DominatorTreeAnalysis>(F),
+            AM.getResult<LoopAnalysis>(F)))
+        return PreservedAnalyses::all();
+      PreservedAnalyses PA;
+      PA.preserveSet<CFGAnalyses>();
+      return PA;
+    }
+  };
+}
+
+char MergePointerChecksPass::ID = 0;
+
+namespace {
+  ///\brief The number of instructions up to which a function is given to
+  /// the modules after the one defining it.
+  static const unsigned kMaxInlineCandidateSize = 64;
+
+  // Declares what the copy of a function of another module refers to.
+  class DeclareInModule final : public ValueMaterializer {
+    Module& m_M;
+
+  public:
+    DeclareInModule(Module& M): m_M(M) {}
+
+    Value* materialize(Value* V) override {
+      auto* GV = dyn_cast<GlobalValue>(V);
+      if (!GV || GV->getParent() == &m_M)
+        return nullptr;
+      if (auto* FTy = dyn_cast<FunctionType>(GV->getValueType()))
+        return m_M.getOrInsertFunction(GV->getName(), FTy).getCallee();
+      return m_M.getOrInsertGlobal(GV->getName(), GV->getValueType());
+    }
+  };
+
+  // Makes the declaration Dst a copy of Src, defined by another module.
+  static void cloneBody(Function& Dst, const Function& Src) {
+    ValueToValueMapTy VMap;
+    auto DstArg = Dst.arg_begin();
+    for (const Argument& A : Src.args()) {
+      DstArg->setName(A.getName());
+      VMap[&A] = &*DstArg++;
+    }
+    SmallVector<ReturnInst*, 8> Returns;
+    DeclareInModule Materializer(*Dst.getParent());
+    CloneFunctionInto(&Dst, &Src, VMap, /*ModuleLevelChanges*/ true, Returns,
+                      "", /*CodeInfo*/ nullptr, /*TypeMapper*/ nullptr,
+                      &Materializer);
+    Dst.setComdat(nullptr);
+  }
+
+  static bool isInlineCandidate(const Function& F) {
+    if (F.isDeclaration() || !F.hasExternalLinkage() || F.isVarArg()
+        || F.hasComdat())
+      return false;
+    if (F.hasFnAttribute(Attribute::NoInline)
+        || F.hasFnAttribute(Attribute::OptimizeNone)
+        || F.hasFnAttribute(Attribute::Naked))
+      return false;
+    // Wrappers and initializers run once; the tier-up stubs must stay.
+    StringRef Name = F.getName();
+    if (Name.empty() || Name.startswith("__cling")
+        || Name.startswith("_GLOBAL__") || Name.startswith("__cxx_global")
+        || Name.startswith("__cuda") || Name.contains(".tier"))
+      return false;
+    return F.getInstructionCount() <= kMaxInlineCandidateSize;
+  }
+
+  // Whether another module can refer to all globals that F uses by their
+  // name: none is local to F's module, or was before KeepLocalGVPass.
+  static bool usesOnlyNamedGlobals(const Function& F,
+                                   const StringSet<>& Local) {
+    SmallVector<const Constant*, 16> Worklist;
+    SmallPtrSet<const Constant*, 16> Seen;
+    auto Push = [&](const Value* V) {
+      if (const auto* C = dyn_cast<Constant>(V))
+        if (Seen.insert(C).second)
+          Worklist.push_back(C);
+    };
+    for (const Instruction& I : instructions(F))
+      for (const Value* Op : I.operands())
+        Push(Op);
+    if (F.hasPersonalityFn())
+      Push(F.getPersonalityFn());
+    while (!Worklist.empty()) {
+      const Constant* C = Worklist.pop_back_val();
+      if (isa<BlockAddress>(C))
+        return false;
+      if (const auto* GV = dyn_cast<GlobalValue>(C)) {
+        if (GV->hasLocalLinkage() || !GV->hasName()
+            || Local.count(GV->getName()))
+          return false;
+        continue;
+      }
+      for (const Value* Op : C->operands())
+        Push(Op);
+    }
+    return true;
+  }
+} // unnamed namespace
+
+namespace {
+  ///\brief The extensions of registerBackendPassExtension().
+  class PassExtensionRegistry {
+    struct Entry {
+      unsigned ID;
+      PassManagerBuilder::ExtensionPointTy EP;
+      BackendPassExtension Extension;
+      unsigned OptLevels;
+    };
+    std::mutex m_Mutex;
+    std::vector<Entry> m_Entries;
+    unsigned m_NextID = 1;
+    /// Changes whenever the extensions do.
+    std::atomic<unsigned> m_Generation{0};
+
+  public:
+    static PassExtensionRegistry& get() {
+      // Leaked: plugins might unregister from their static destructors.
+      static PassExtensionRegistry* Registry = new PassExtensionRegistry();
+      return *Registry;
+    }
+
+    unsigned add(PassManagerBuilder::ExtensionPointTy EP,
+                 BackendPassExtension Extension, unsigned OptLevels) {
+      std::lock_guard<std::mutex> Lock(m_Mutex);
+      m_Entries.push_back({m_NextID, EP, std::move(Extension), OptLevels});
+      ++m_Generation;
+      return m_NextID++;
+    }
+
+    void remove(unsigned ID) {
+      std::lock_guard<std::mutex> Lock(m_Mutex);
+      auto I = std::find_if(m_Entries.begin(), m_Entries.end(),
+                            [ID](const Entry& E) { return E.ID == ID; });
+      if (I == m_Entries.end())
+        return;
+      m_Entries.erase(I);
+      ++m_Generation;
+    }
+
+    unsigned getGeneration() const { return m_Generation; }
+
+    ///\brief Adds the extensions for OptLevel to Builder.
+    void addTo(PassManagerBuilder& Builder, int OptLevel) {
+      std::lock_guard<std::mutex> Lock(m_Mutex);
+      for (const Entry& E : m_Entries)
+        if (E.OptLevels & (1u << OptLevel))
+          Builder.addExtension(E.EP, E.Extension);
+    }
+  };
+} // unnamed namespace
+
+unsigned
+cling::registerBackendPassExtension(PassManagerBuilder::ExtensionPointTy EP,
+                                    BackendPassExtension Extension,
+                                    unsigned OptLevels /*= kAllOptLevels*/) {
+  return PassExtensionRegistry::get().add(EP, std::move(Extension),
+                                          OptLevels);
+}
+
+void cling::unregisterBackendPassExtension(unsigned ID) {
+  PassExtensionRegistry::get().remove(ID);
+}
+
+struct BackendPasses::CompileBudget {
+  std::chrono::steady_clock::time_point Deadline;
+  bool Exceeded = false;
+  ///\brief The function that the legacy passes ran on last: the loop
+  /// passes do not tell theirs.
+  std::string Current;
+  std::vector<std::string> Demoted;
+  StringSet<> IsDemoted;
+
+  CompileBudget(unsigned Ms):
+    Deadline(std::chrono::steady_clock::now()
+             + std::chrono::milliseconds(Ms)) {}
+
+  ///\brief Whether a pass may still run on the functions Fs; if not, they
+  /// get demoted. A module pass has none.
+  bool allows(ArrayRef<StringRef> Fs) {
+    if (!Exceeded && std::chrono::steady_clock::now() < Deadline)
+      return true;
+    Exceeded = true;
+    for (StringRef F : Fs)
+      if (!F.empty() && IsDemoted.insert(F).second)
+        Demoted.push_back(F.str());
+    return false;
+  }
+
+  ///\brief allows() for a legacy pass on the IR that IRDescription names,
+  /// e.g. "function (f)" or "SCC (f, g)".
+  bool allowsLegacy(StringRef IRDescription) {
+    SmallVector<StringRef, 4> Fs;
+    if (IRDescription.consume_front("SCC (")) {
+      IRDescription.consume_back(")");
+      IRDescription.split(Fs, ", ");
+      // No name for the external node of the call graph.
+      Fs.erase(std::remove_if(Fs.begin(), Fs.end(), [](StringRef F) {
+                 return F.startswith("<<");
+               }), Fs.end());
+    } else {
+      const size_t Pos = IRDescription.find("function (");
+      if (Pos != StringRef::npos)
+        Current = IRDescription.substr(Pos + 10).split(')').first.str();
+      else if (IRDescription != "loop")
+        return allows(None);
+      Fs.push_back(Current);
+    }
+    return allows(Fs);
+  }
+
+  ///\brief allows() for a pass of the new pass manager on IR.
+  bool allowsNewPM(const Any& IR) {
+    SmallVector<StringRef, 4> Fs;
+    if (any_isa<const Function*>(IR))
+      Fs.push_back(any_cast<const Function*>(IR)->getName());
+    else if (any_isa<const Loop*>(IR))
+      Fs.push_back(any_cast<const Loop*>(IR)->getHeader()->getParent()
+                     ->getName());
+    else if (any_isa<const LazyCallGraph::SCC*>(IR))
+      for (const LazyCallGraph::Node& N
+             : *any_cast<const LazyCallGraph::SCC*>(IR))
+        Fs.push_back(N.getFunction().getName());
+    return allows(Fs);
+  }
+
+  ///\brief Makes the demoted functions of M optnone, for the code
+  /// generator to emit them at O0, and appends their names to Out.
+  void demote(Module& M, std::vector<std::string>* Out) const {
+    for (const std::string& Name : Demoted) {
+      Function* F = M.getFunction(Name);
+      if (!F || F->isDeclaration()
+          || F->hasFnAttribute(Attribute::AlwaysInline))
+        continue;
+      F->addFnAttr(Attribute::OptimizeNone);
+      F->addFnAttr(Attribute::NoInline);
+      if (Out)
+        Out->push_back(Name);
+    }
+  }
+};
+
+///\brief The legacy passes that only optimize ask through skipFunction()
+/// and its siblings, which those the JIT needs, e.g. KeepLocalGVPass, do not
+/// call.
+class BackendPasses::PassGate : public OptPassGate {
+  const BackendPasses& m_BP;
+  OptPassGate& m_Prev;
+
+public:
+  PassGate(const BackendPasses& BP, OptPassGate& Prev):
+    m_BP(BP), m_Prev(Prev) {}
+
+  bool shouldRunPass(const Pass* P, StringRef IRDescription) override {
+    if (m_BP.isCancelled())
+      return false;
+    if (m_BP.m_Budget && !m_BP.m_Budget->allowsLegacy(IRDescription))
+      return false;
+    return !m_Prev.isEnabled() || m_Prev.shouldRunPass(P, IRDescription);
+  }
+
+  bool isEnabled() const override { return true; }
+};
+
+struct BackendPasses::NewPM {
+  TargetLibraryInfoImpl TLII;
+  PassInstrumentationCallbacks PIC;
+  PassBuilder PB;
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+  std::array<std::unique_ptr<ModulePassManager>, 4> MPM;
+
+  static PipelineTuningOptions getTuningOptions(const CodeGenOptions& CGOpts) {
+    // Only the default pipelines of O2 and O3 use them.
+    PipelineTuningOptions PTO;
+    PTO.LoopVectorization = true;
+    PTO.SLPVectorization = true;
+    PTO.LoopUnrolling = CGOpts.UnrollLoops;
+    return PTO;
+  }
+
+  NewPM(TargetMachine& TM, const CodeGenOptions& CGOpts,
+        const BackendPasses& BP):
+    TLII(TM.getTargetTriple()),
+    PB(&TM, getTuningOptions(CGOpts), None, &PIC) {
+    // Once cancelled or out of budget, only the passes that the JIT needs
+    // still run.
+    PIC.registerBeforePassCallback([&BP](StringRef Pass, Any IR) {
+      if (Pass == KeepLocalGV::name()
+          || Pass == UniqueCUDAStructorNames::name())
+        return true;
+      if (BP.isCancelled())
+        return false;
+      return !BP.m_Budget || BP.m_Budget->allowsNewPM(IR);
+    });
+    // Registered first, it takes the place of the default one.
+    FAM.registerPass([this] { return TargetLibraryAnalysis(TLII); });
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+    // Once inlining and loop rotation are done, merge and hoist the checks
+    // of the NullDerefProtectionTransformer.
+    PB.registerScalarOptimizerLateEPCallback(
+      [](FunctionPassManager& FPM, PassBuilder::OptimizationLevel) {
+        FPM.addPass(MergePointerChecks());
+      });
+  }
+
+  ModulePassManager& getPipeline(int OptLevel, const CodeGenOptions& CGOpts) {
+    if (MPM[OptLevel])
+      return *MPM[OptLevel];
+    MPM[OptLevel].reset(new ModulePassManager());
+    ModulePassManager& PM = *MPM[OptLevel];
+
+    if (CGOpts.VerifyModule)
+      PM.addPass(VerifierPass());
+    PM.addPass(KeepLocalGV());
+    // See CreatePasses().
+    if (!CGOpts.CudaGpuBinaryFileName.empty())
+      PM.addPass(UniqueCUDAStructorNames());
+    PM.addPass(createModuleToFunctionPassAdaptor(AddDiscriminatorsPass()));
+
+    if (OptLevel == 0 || CGOpts.DisableLLVMPasses) {
+      PM.addPass(AlwaysInlinerPass(/*InsertLifetimeIntrinsics*/ false));
+    } else if (OptLevel == 1) {
+      // Most modules are a statement's wrapper with a few calls: clean up
+      // what the frontend emitted, without the cost of the full pipeline's
+      // analyses, which would dominate the optimization of so little code.
+      PM.addPass(AlwaysInlinerPass(/*InsertLifetimeIntrinsics*/ true));
+      FunctionPassManager FPM;
+      FPM.addPass(SROA());
+      FPM.addPass(EarlyCSEPass());
+      FPM.addPass(InstCombinePass());
+      FPM.addPass(SimplifyCFGPass());
+      FPM.addPass(MergePointerChecks());
+      PM.addPass(createModuleToFunctionPassAdaptor(std::move(FPM)));
+    } else {
+      PassBuilder::OptimizationLevel Level
+        = OptLevel == 2 ? PassBuilder::O2 : PassBuilder::O3;
+      if (CGOpts.OptimizeSize == 1)
+        Level = PassBuilder::Os;
+      else if (CGOpts.OptimizeSize == 2)
+        Level = PassBuilder::Oz;
+      PM.addPass(PB.buildPerModuleDefaultPipeline(Level));
+    }
+    return PM;
+  }
+};
+
 BackendPasses::BackendPasses(const clang::CodeGenOptions &CGOpts,
-                             const clang::TargetOptions & /*TOpts*/,
+                             const clang::TargetOptions &TOpts,
                              const clang::LangOptions & /*LOpts*/,
                              llvm::TargetMachine& TM):
    m_TM(TM),
-   m_CGOpts(CGOpts) //,
+   m_CGOpts(CGOpts),
    //m_TOpts(TOpts),
    //m_LOpts(LOpts)
-{}
+   m_FrontendCPU(TOpts.CPU) {
+  // As CodeGenModule::GetCPUAndFeaturesAttributes() spells them.
+  std::vector<std::string> Features = TOpts.Features;
+  llvm::sort(Features);
+  m_FrontendFeatures = llvm::join(Features, ",");
+}
 
 
 BackendPasses::~BackendPasses() {
   //delete m_PMBuilder->Inliner;
 }
 
+void BackendPasses::releasePassManagers() {
+  for (auto& MPM : m_MPM)
+    MPM.reset();
+  for (auto& FPM : m_FPM)
+    FPM.reset();
+  m_NewPM.reset();
+}
+
 void BackendPasses::CreatePasses(llvm::Module& M, int OptLevel)
 {
   // From BackEndUtil's clang::EmitAssemblyHelper::CreatePasses().
@@ -215,9 +959,20 @@ void BackendPasses::CreatePasses(llvm::Module& M, int OptLevel)
                               PM.add(createAddDiscriminatorsPass());
                             });
 
+  // Once inlining and loop rotation are done, merge and hoist the checks
+  // of the NullDerefProtectionTransformer.
+  if (OptLevel > 0)
+    PMBuilder.addExtension(PassManagerBuilder::EP_ScalarOptimizerLate,
+                           [&](const PassManagerBuilder &,
+                               legacy::PassManagerBase &PM) {
+                             PM.add(new MergePointerChecksPass());
+                           });
+
   //if (!CGOpts.RewriteMapFiles.empty())
   //  addSymbolRewriterPass(CGOpts, m_MPM);
 
+  PassExtensionRegistry::get().addTo(PMBuilder, OptLevel);
+
   PMBuilder.populateModulePassManager(*m_MPM[OptLevel]);
 
   m_FPM[OptLevel].reset(new legacy::FunctionPassManager(&M));
@@ -228,15 +983,184 @@ void BackendPasses::CreatePasses(llvm::Module& M, int OptLevel)
   PMBuilder.populateFunctionPassManager(*m_FPM[OptLevel]);
 }
 
-void BackendPasses::runOnModule(Module& M, int OptLevel) {
+void BackendPasses::adoptTargetCPU(Module& M) const {
+  const StringRef CPU = m_TM.getTargetCPU();
+  const StringRef Features = m_TM.getTargetFeatureString();
+  if (CPU == m_FrontendCPU && Features == m_FrontendFeatures)
+    return;
+  for (Function& F : M.functions()) {
+    if (F.isDeclaration())
+      continue;
+    if (F.getFnAttribute("target-cpu").getValueAsString() == m_FrontendCPU)
+      F.addFnAttr("target-cpu", CPU);
+    if (F.getFnAttribute("target-features").getValueAsString()
+        == m_FrontendFeatures)
+      F.addFnAttr("target-features", Features);
+  }
+}
+
+void BackendPasses::importInlineCandidates(Module& M) const {
+  if (!m_InlineCandidates
+      || &m_InlineCandidates->getContext() != &M.getContext())
+    return;
+  // The bodies might call further candidates, which get declared at the end.
+  for (Function& F : M) {
+    if (!F.isDeclaration() || F.isIntrinsic())
+      continue;
+    const Function* C = m_InlineCandidates->getFunction(F.getName());
+    if (!C || C->isDeclaration()
+        || C->getFunctionType() != F.getFunctionType())
+      continue;
+    cloneBody(F, *C);
+    F.setLinkage(GlobalValue::AvailableExternallyLinkage);
+  }
+}
+
+void BackendPasses::recordInlineCandidates(const Module& M,
+                                           const StringSet<>& Local) {
+  if (m_InlineCandidates
+      && &m_InlineCandidates->getContext() != &M.getContext())
+    return;
+  for (const Function& F : M) {
+    if (F.isDeclaration() || F.hasAvailableExternallyLinkage())
+      continue;
+    Function* C
+      = m_InlineCandidates ? m_InlineCandidates->getFunction(F.getName())
+                           : nullptr;
+    // F replaces what an unloaded module defined.
+    if (C)
+      C->deleteBody();
+    if (!isInlineCandidate(F) || !usesOnlyNamedGlobals(F, Local))
+      continue;
+    if (!m_InlineCandidates)
+      m_InlineCandidates.reset(new Module("cling-inline-candidates",
+                                          M.getContext()));
+    if (!C)
+      C = Function::Create(F.getFunctionType(), GlobalValue::ExternalLinkage,
+                           F.getName(), m_InlineCandidates.get());
+    if (C->getName() != F.getName()
+        || C->getFunctionType() != F.getFunctionType())
+      continue;
+    cloneBody(*C, F);
+    // Its debug info describes the other module.
+    stripDebugInfo(*C);
+  }
+}
+
+void BackendPasses::forgetDefinitions(const Module& M) {
+  if (!m_InlineCandidates)
+    return;
+  for (const Function& F : M)
+    if (!F.isDeclaration())
+      if (Function* C = m_InlineCandidates->getFunction(F.getName()))
+        C->deleteBody();
+}
+
+namespace {
+  ///\brief Records the optimization remarks, passes the other diagnostics
+  /// on to the handler it replaces.
+  class RemarkCollector: public DiagnosticHandler {
+    std::vector<BackendPasses::Remark>& m_Remarks;
+
+  public:
+    std::unique_ptr<DiagnosticHandler> m_Prev;
+
+    RemarkCollector(std::vector<BackendPasses::Remark>& Remarks,
+                    std::unique_ptr<DiagnosticHandler> Prev):
+      m_Remarks(Remarks), m_Prev(std::move(Prev)) {}
+
+    bool isAnalysisRemarkEnabled(StringRef) const override { return true; }
+    bool isMissedOptRemarkEnabled(StringRef) const override { return true; }
+    bool isPassedOptRemarkEnabled(StringRef) const override { return true; }
+    bool isAnyRemarkEnabled() const override { return true; }
+
+    bool handleDiagnostics(const DiagnosticInfo& DI) override {
+      auto* OR = dyn_cast<DiagnosticInfoOptimizationBase>(&DI);
+      if (!OR)
+        return m_Prev && m_Prev->handleDiagnostics(DI);
+
+      BackendPasses::Remark R;
+      const char* Option = "-Rpass-missed=";
+      R.Kind = BackendPasses::kMissedRemarks;
+      if (OR->isPassed()) {
+        R.Kind = BackendPasses::kPassedRemarks;
+        Option = "-Rpass=";
+      } else if (OR->isAnalysis()) {
+        R.Kind = BackendPasses::kAnalysisRemarks;
+        Option = "-Rpass-analysis=";
+      }
+
+      raw_string_ostream Out(R.Text);
+      // The inputs are the buffers input_line_N, as in the diagnostics of
+      // the frontend.
+      if (OR->isLocationAvailable()) {
+        DiagnosticLocation Loc = OR->getLocation();
+        Out << Loc.getRelativePath() << ':' << Loc.getLine() << ':'
+            << Loc.getColumn() << ": ";
+      } else {
+        std::string Name = OR->getFunction().getName().str();
+        std::string Demangled = utils::platform::Demangle(Name);
+        Out << "in '" << (Demangled.empty() ? Name : Demangled) << "': ";
+      }
+      Out << "remark: " << OR->getMsg() << " [" << Option
+          << OR->getPassName() << ']';
+      Out.flush();
+      m_Remarks.push_back(std::move(R));
+      return true;
+    }
+  };
+} // unnamed namespace
+
+void BackendPasses::runNewPM(Module& M, int OptLevel) {
+  if (!m_NewPM)
+    m_NewPM.reset(new NewPM(m_TM, m_CGOpts, *this));
+  m_NewPM->getPipeline(OptLevel, m_CGOpts).run(M, m_NewPM->MAM);
+  // The JIT takes M over; the next module might get its address, and the
+  // results cached for this one.
+  m_NewPM->LAM.clear();
+  m_NewPM->FAM.clear();
+  m_NewPM->CGAM.clear();
+  m_NewPM->MAM.clear();
+}
+
+size_t BackendPasses::printRemarks(raw_ostream& Out, unsigned Kinds) {
+  size_t Printed = 0;
+  for (const Remark& R : m_Remarks)
+    if (R.Kind & Kinds) {
+      Out << R.Text << '\n';
+      ++Printed;
+    }
+  m_Remarks.clear();
+  return Printed;
+}
+
+void BackendPasses::runOnModule(Module& M, int OptLevel, unsigned BudgetMs,
+                                std::vector<std::string>* Demoted) {
+  adoptTargetCPU(M);
+
+  // The remarks of the passes go to a handler of ours while they run.
+  RemarkCollector* Collector = nullptr;
+  if (m_CollectRemarks) {
+    LLVMContext& C = M.getContext();
+    Collector = new RemarkCollector(m_Remarks, C.getDiagnosticHandler());
+    C.setDiagnosticHandler(std::unique_ptr<DiagnosticHandler>(Collector));
+  }
 
   if (OptLevel < 0)
     OptLevel = 0;
   if (OptLevel > 3)
     OptLevel = 3;
 
-  if (!m_MPM[OptLevel])
-    CreatePasses(M, OptLevel);
+  // What is local to M now becomes external through KeepLocalGVPass, but
+  // the other modules cannot refer to it: the names are not unique.
+  StringSet<> Local;
+  for (const GlobalValue& GV : M.global_values())
+    if (GV.hasLocalLinkage())
+      Local.insert(GV.getName());
+  // Only the inliner of the higher levels makes use of them; the
+  // EliminateAvailableExternally pass drops them after it ran.
+  if (OptLevel > 1)
+    importInlineCandidates(M);
 
   static constexpr std::array<llvm::CodeGenOpt::Level, 4> CGOptLevel {{
     llvm::CodeGenOpt::None,
@@ -247,12 +1171,412 @@ void BackendPasses::runOnModule(Module& M, int OptLevel) {
   // TM's OptLevel is used to build orc::SimpleCompiler passes for every Module.
   m_TM.setOptLevel(CGOptLevel[OptLevel]);
 
-  // Run the per-function passes on the module.
-  m_FPM[OptLevel]->doInitialization();
+  // The pipelines built before extensions were registered lack them.
+  const unsigned Generation = PassExtensionRegistry::get().getGeneration();
+  if (Generation != m_ExtensionsGeneration) {
+    releasePassManagers();
+    m_ExtensionsGeneration = Generation;
+  }
+
+  if (!m_CGOpts.ExperimentalNewPassManager && !m_MPM[OptLevel])
+    CreatePasses(M, OptLevel);
+
+  // The time spent optimizing counts against the budget, from here.
+  std::unique_ptr<CompileBudget> Budget;
+  if (BudgetMs && OptLevel > 0)
+    Budget.reset(new CompileBudget(BudgetMs));
+  m_Budget = Budget.get();
+
+  if (m_CGOpts.ExperimentalNewPassManager) {
+    runNewPM(M, OptLevel);
+  } else {
+    LLVMContext& C = M.getContext();
+    OptPassGate& PrevGate = C.getOptPassGate();
+    PassGate Gate(*this, PrevGate);
+    if (m_IsCancelled || m_Budget)
+      C.setOptPassGate(Gate);
+
+    // Run the per-function passes on the module.
+    m_FPM[OptLevel]->doInitialization();
+    for (auto&& I: M.functions())
+      if (!I.isDeclaration() && !isCancelled())
+        m_FPM[OptLevel]->run(I);
+    m_FPM[OptLevel]->doFinalization();
+
+    m_MPM[OptLevel]->run(M);
+    C.setOptPassGate(PrevGate);
+  }
+
+  if (m_Budget) {
+    m_Budget->demote(M, Demoted);
+    m_Budget = nullptr;
+  }
+
+  if (Collector)
+    M.getContext().setDiagnosticHandler(std::move(Collector->m_Prev));
+
+  recordInlineCandidates(M, Local);
+}
+
+namespace {
+  ///\brief The bound that the branch ending BB compares with, if it is a
+  /// constant: a hint at the trip count of the loop BB belongs to.
+  static double getTripCountHint(const BasicBlock& BB) {
+    const BranchInst* Br = dyn_cast<BranchInst>(BB.getTerminator());
+    const CmpInst* Cmp = Br && Br->isConditional()
+      ? dyn_cast<CmpInst>(Br->getCondition()) : nullptr;
+    if (!Cmp)
+      return 0.;
+    double Hint = 0.;
+    for (const Value* Op : Cmp->operands()) {
+      if (const ConstantInt* CI = dyn_cast<ConstantInt>(Op)) {
+        if (CI->getValue().getMinSignedBits() <= 64)
+          Hint = std::max(Hint, std::abs(double(CI->getSExtValue())));
+      } else if (const ConstantFP* CFP = dyn_cast<ConstantFP>(Op))
+        Hint = std::max(Hint,
+                        std::abs(CFP->getValueAPF().convertToDouble()));
+    }
+    return Hint;
+  }
+} // unnamed namespace
+
+int BackendPasses::selectOptLevel(const Module& M, int OptLevel) {
+  // Loops running about this often are worth the passes of -O3...
+  static constexpr double kLongTripCount = 1024.;
+  // ...unless there is that much code to run them on.
+  static constexpr unsigned kLargeModule = 4096;
+
+  bool OnlyWrappers = true, Loops = false, LongLoops = false;
+  unsigned Instructions = 0;
+  for (const Function& F : M) {
+    if (F.isDeclaration())
+      continue;
+    // The wrappers of the input, those of EnforceInitOrder() and the static
+    // initializers: code that runs once.
+    const StringRef Name = F.getName();
+    if (!Name.contains(utils::Synthesize::UniquePrefix)
+        && !Name.startswith("__cxx_global_var_init")
+        && !Name.startswith("_GLOBAL__sub_I_"))
+      OnlyWrappers = false;
+    Instructions += F.getInstructionCount();
+
+    SmallVector<std::pair<const BasicBlock*, const BasicBlock*>, 8> Backedges;
+    FindFunctionBackedges(F, Backedges);
+    for (const auto& Edge : Backedges) {
+      Loops = true;
+      // The exit test is in the latch once rotated, else in the header.
+      if (std::max(getTripCountHint(*Edge.first),
+                   getTripCountHint(*Edge.second)) >= kLongTripCount)
+        LongLoops = true;
+    }
+  }
+
+  if (!Loops)
+    return OnlyWrappers ? 0 : OptLevel;
+  if (LongLoops && Instructions < kLargeModule)
+    return 3;
+  return std::max(OptLevel, 2);
+}
+
+void BackendPasses::inferNoUnwind(Module& M) {
+  // Assume that none of M's exact definitions can unwind, then drop those that
+  // call what can until no assumption is contradicted: the functions of a
+  // cycle that throws nowhere stay nounwind.
+  SmallPtrSet<const Function*, 16> NoUnwind;
+  for (const Function& F : M)
+    if (!F.isDeclaration() && F.hasExactDefinition())
+      NoUnwind.insert(&F);
+  for (bool Changed = true; Changed;) {
+    Changed = false;
+    for (const Function& F : M)
+      if (NoUnwind.count(&F) && !F.doesNotThrow()
+          && !cannotUnwind(F, NoUnwind)) {
+        NoUnwind.erase(&F);
+        Changed = true;
+      }
+  }
+
+  for (Function& F : M) {
+    if (F.isDeclaration() || !cannotUnwind(F, NoUnwind))
+      continue;
+    // Another module might provide the definition of an inexact one.
+    if (F.hasExactDefinition())
+      F.setDoesNotThrow();
+    // No exception passes through its frames: they need no unwind tables.
+    F.removeFnAttr(Attribute::UWTable);
+    if (F.hasPersonalityFn())
+      F.setPersonalityFn(nullptr);
+  }
+}
+
+void BackendPasses::addProfileCounters(Module& M) {
+  for (Function& F : M)
+    if (!F.isDeclaration() && F.getName().endswith(".tier0"))
+      addProfileCountersTo(F);
+  // The JIT swaps in the profiled code itself, see
+  // IncrementalJIT::optimizeWithProfile().
+  for (GlobalVariable& GV : M.globals())
+    if (GV.getName().endswith(".tierptr"))
+      GV.setLinkage(GlobalValue::ExternalLinkage);
+}
+
+void BackendPasses::applyProfile(Module& M, Function& F,
+                                 ArrayRef<uint64_t> Counts) {
+  LLVMContext& C = M.getContext();
+  MDBuilder MDB(C);
+  F.setEntryCount(Counts[0]);
+  SmallVector<StoreInst*, 32> Increments;
+  for (Instruction& I : instructions(F)) {
+    if (auto* Store = dyn_cast<StoreInst>(&I)) {
+      auto* GV = dyn_cast<GlobalVariable>(
+        Store->getPointerOperand()->stripInBoundsConstantOffsets());
+      if (GV && GV->getName().endswith(getProfileSuffix()))
+        Increments.push_back(Store);
+      continue;
+    }
+    MDNode* SlotMD = I.getMetadata(kProfileSlotMD);
+    if (!SlotMD)
+      continue;
+    I.setMetadata(kProfileSlotMD, nullptr);
+    const uint64_t Slot
+      = mdconst::extract<ConstantInt>(SlotMD->getOperand(0))->getZExtValue();
+    const unsigned N = I.getNumSuccessors();
+    if (Slot + N > Counts.size())
+      continue;
+    // The weights are 32 bits wide.
+    uint64_t Max = *std::max_element(&Counts[Slot], &Counts[Slot] + N);
+    const uint64_t Scale = Max / std::numeric_limits<uint32_t>::max() + 1;
+    SmallVector<uint32_t, 4> Weights;
+    for (unsigned S = 0; S < N; ++S)
+      Weights.push_back(uint32_t(Counts[Slot + S] / Scale));
+    I.setMetadata(LLVMContext::MD_prof, MDB.createBranchWeights(Weights));
+  }
+  // What remains of the counting goes away with the dead loads.
+  for (StoreInst* Store : Increments)
+    Store->eraseFromParent();
+
+  InstrProfSummaryBuilder Summary(ProfileSummaryBuilder::DefaultCutoffs);
+  Summary.addRecord(InstrProfRecord(Counts.vec()));
+  M.setProfileSummary(Summary.getSummary()->getMD(C),
+                      ProfileSummary::PSK_Instr);
+}
+
+void BackendPasses::addTierUpCounters(Module& M, unsigned Threshold,
+                                      int TierUpOptLevel) {
+  legacy::PassManager PM;
+  PM.add(new TierUpCountersPass(Threshold));
+  if (PM.run(M))
+    M.addModuleFlag(Module::Warning, getTierUpFlagName(),
+                    std::min(std::max(TierUpOptLevel, 0), 3));
+}
+
+///\brief Runs the call site CB of the hook, which SafePointTransformer put
+/// first thing in the body of a loop, only while Pending is set; as an
+/// invoke, with the unwind destination that clang gave it.
+static void guardSafePoint(CallBase& CB, Constant* Pending, MDNode* Weights) {
+  Type* I32 = Type::getInt32Ty(CB.getContext());
+  IRBuilder<> B(&CB);
+  LoadInst* Flag = B.CreateAlignedLoad(I32, Pending, 4, "safepoint");
+  Flag->setAtomic(AtomicOrdering::Monotonic);
+  Value* IsSet = B.CreateIsNotNull(Flag);
+  auto* II = dyn_cast<InvokeInst>(&CB);
+  if (!II) {
+    Instruction* Poll = SplitBlockAndInsertIfThen(IsSet, &CB,
+                                                  /*Unreachable*/ false,
+                                                  Weights);
+    CB.moveBefore(Poll);
+    return;
+  }
+  BasicBlock* BB = II->getParent();
+  BasicBlock* Normal = II->getNormalDest();
+  BasicBlock* Poll = BasicBlock::Create(CB.getContext(), "safepoint.poll",
+                                        BB->getParent(), Normal);
+  II->removeFromParent();
+  Poll->getInstList().push_back(II);
+  B.SetInsertPoint(BB);
+  B.CreateCondBr(IsSet, Poll, Normal, Weights);
+  // Normal is now reached from both; the landing pad from Poll only.
+  for (PHINode& PN : Normal->phis())
+    PN.addIncoming(PN.getIncomingValueForBlock(BB), Poll);
+  for (PHINode& PN : II->getUnwindDest()->phis())
+    PN.setIncomingBlock(PN.getBasicBlockIndex(BB), Poll);
+}
+
+///\brief Removes the call site CB of the hook.
+static void removeSafePoint(CallBase& CB) {
+  if (auto* II = dyn_cast<InvokeInst>(&CB)) {
+    II->getUnwindDest()->removePredecessor(II->getParent());
+    BranchInst::Create(II->getNormalDest(), II);
+  }
+  CB.eraseFromParent();
+}
+
+void BackendPasses::addSafePoints(Module& M, bool Poll) {
+  LLVMContext& C = M.getContext();
+  Type* I32 = Type::getInt32Ty(C);
+  MDBuilder MDB(C);
+  MDNode* Weights = MDB.createBranchWeights(1, 1 << 20);
+  Constant* Pending = nullptr;
+  FunctionCallee Hook;
+  if (!Poll) {
+    if (Function* Declared = M.getFunction(getSafePointHookName()))
+      for (User* U : llvm::make_early_inc_range(Declared->users()))
+        if (auto* CB = dyn_cast<CallBase>(U))
+          removeSafePoint(*CB);
+    return;
+  }
+
+  for (Function& F : M) {
+    if (F.isDeclaration())
+      continue;
+    SmallVector<CallBase*, 8> Marked;
+    bool HasEHPads = false;
+    for (BasicBlock& BB : F) {
+      HasEHPads |= BB.isEHPad();
+      for (Instruction& I : BB)
+        if (auto* CB = dyn_cast<CallBase>(&I))
+          if (CB->getCalledFunction()
+              && CB->getCalledFunction()->getName()
+                   == getSafePointHookName())
+            Marked.push_back(CB);
+    }
+    // An exception cannot leave those; they run to their end.
+    if (F.doesNotThrow()) {
+      for (CallBase* CB : Marked)
+        removeSafePoint(*CB);
+      continue;
+    }
+
+    // The loops that SafePointTransformer did not see, e.g. of template
+    // instantiations, poll in their header. Nothing tells which cleanups
+    // are due there: only the functions without any poll with a call.
+    SmallVector<BasicBlock*, 8> Headers;
+    if (!HasEHPads) {
+      SmallPtrSet<const BasicBlock*, 8> MarkedBlocks;
+      for (CallBase* CB : Marked)
+        MarkedBlocks.insert(CB->getParent());
+      DominatorTree DT(F);
+      LoopInfo LI(DT);
+      for (Loop* L : LI.getLoopsInPreorder()) {
+        bool IsMarked = false;
+        for (BasicBlock* BB : L->blocks())
+          if ((IsMarked = MarkedBlocks.count(BB)))
+            break;
+        if (!IsMarked)
+          Headers.push_back(L->getHeader());
+      }
+    }
+    if (Headers.empty() && Marked.empty())
+      continue;
+    if (!Pending) {
+      Pending = M.getOrInsertGlobal(getSafePointFlagName(), I32);
+      Hook = M.getOrInsertFunction(getSafePointHookName(),
+                                   Type::getVoidTy(C));
+    }
+    for (CallBase* CB : Marked)
+      guardSafePoint(*CB, Pending, Weights);
+    // Each iteration goes through the header: poll the flag there, and
+    // call the hook on the rare occasions it is set.
+    for (BasicBlock* Header : Headers) {
+      Instruction* At = &*Header->getFirstInsertionPt();
+      IRBuilder<> B(At);
+      B.SetCurrentDebugLocation(Header->getTerminator()->getDebugLoc());
+      LoadInst* Flag = B.CreateAlignedLoad(I32, Pending, 4, "safepoint");
+      Flag->setAtomic(AtomicOrdering::Monotonic);
+      Instruction* Poll
+        = SplitBlockAndInsertIfThen(B.CreateIsNotNull(Flag), At,
+                                    /*Unreachable*/ false, Weights);
+      B.SetInsertPoint(Poll);
+      B.CreateCall(Hook);
+    }
+  }
+}
+
+bool BackendPasses::isReloadable(const Function& F) {
+  if (F.isDeclaration() || F.isVarArg() || !F.hasExternalLinkage())
+    return false;
+  if (F.hasFnAttribute(Attribute::Naked)
+      || F.hasFnAttribute(Attribute::AlwaysInline))
+    return false;
+  // The wrappers and initializers run once.
+  StringRef Name = F.getName();
+  return !Name.empty() && !Name.startswith("__cling")
+    && !Name.startswith("_GLOBAL__") && !Name.startswith("__cxx_global")
+    && !Name.startswith("__cuda") && !Name.contains(".reload");
+}
+
+void BackendPasses::addReloadStubs(Module& M, ArrayRef<Function*> Fs) {
+  LLVMContext& C = M.getContext();
+  for (Function* F : Fs) {
+    const std::string Name = F->getName().str();
+    FunctionType* FTy = F->getFunctionType();
+
+    // As TierUpCountersPass does, without the counting.
+    Function* Impl = Function::Create(FTy, GlobalValue::ExternalLinkage,
+                                      Name + ".reload0", &M);
+    Impl->copyAttributesFrom(F);
+    Impl->getBasicBlockList().splice(Impl->begin(), F->getBasicBlockList());
+    for (auto AI = F->arg_begin(), NI = Impl->arg_begin(),
+           AE = F->arg_end(); AI != AE; ++AI, ++NI) {
+      AI->replaceAllUsesWith(&*NI);
+      NI->takeName(&*AI);
+    }
+    if (DISubprogram* SP = F->getSubprogram()) {
+      Impl->setSubprogram(SP);
+      F->setSubprogram(nullptr);
+    }
+
+    // External, such that the optimizer cannot see through it and the JIT
+    // finds it.
+    PointerType* FPtrTy = FTy->getPointerTo();
+    auto* Target = new GlobalVariable(M, FPtrTy, /*isConstant*/ false,
+                                      GlobalValue::ExternalLinkage, Impl,
+                                      Name + getReloadPtrSuffix());
+
+    IRBuilder<> B(BasicBlock::Create(C, "entry", F));
+    SmallVector<Value*, 8> Args;
+    for (Argument& A : F->args())
+      Args.push_back(&A);
+    CallInst* CI = B.CreateCall(FTy, B.CreateLoad(FPtrTy, Target), Args);
+    CI->setCallingConv(F->getCallingConv());
+    CI->setAttributes(F->getAttributes());
+    if (FTy->getReturnType()->isVoidTy())
+      B.CreateRetVoid();
+    else
+      B.CreateRet(CI);
+  }
+}
+
+void BackendPasses::runStandalone(Module& M, TargetMachine& TM,
+                                  int OptLevel, bool HotColdSplit) {
+  llvm::PassManagerBuilder PMBuilder;
+  PMBuilder.OptLevel = OptLevel;
+  PMBuilder.SLPVectorize = OptLevel > 1 ? 1 : 0;
+  PMBuilder.LoopVectorize = OptLevel > 1 ? 1 : 0;
+  PMBuilder.LibraryInfo = new TargetLibraryInfoImpl(TM.getTargetTriple());
+  if (OptLevel <= 1)
+    PMBuilder.Inliner = createAlwaysInlinerLegacyPass(OptLevel != 0);
+  else
+    PMBuilder.Inliner = createFunctionInliningPass(OptLevel, 0, false);
+  TM.adjustPassManager(PMBuilder);
+  PassExtensionRegistry::get().addTo(PMBuilder, OptLevel);
+
+  legacy::PassManager MPM;
+  MPM.add(createTargetTransformInfoWrapperPass(TM.getTargetIRAnalysis()));
+  PMBuilder.populateModulePassManager(MPM);
+  // Move what the profile says is cold out of the way of the hot code.
+  if (HotColdSplit)
+    MPM.add(createHotColdSplittingPass());
+
+  legacy::FunctionPassManager FPM(&M);
+  FPM.add(createTargetTransformInfoWrapperPass(TM.getTargetIRAnalysis()));
+  PMBuilder.populateFunctionPassManager(FPM);
+
+  FPM.doInitialization();
   for (auto&& I: M.functions())
     if (!I.isDeclaration())
-      m_FPM[OptLevel]->run(I);
-  m_FPM[OptLevel]->doFinalization();
+      FPM.run(I);
+  FPM.doFinalization();
 
-  m_MPM[OptLevel]->run(M);
+  MPM.run(M);
 }
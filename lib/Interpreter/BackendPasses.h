@@ -10,16 +10,22 @@
 #ifndef CLING_BACKENDPASSES_H
 #define CLING_BACKENDPASSES_H
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/IR/LegacyPassManager.h"
 
 #include <array>
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace llvm {
   class Function;
   class LLVMContext;
   class Module;
   class PassManagerBuilder;
+  class raw_ostream;
   class TargetMachine;
 
   namespace legacy {
@@ -38,6 +44,22 @@ namespace cling {
   ///\brief Runs passes on IR. Remove once we can migrate from ModuleBuilder to
   /// what's in clang's CodeGen/BackendUtil.
   class BackendPasses {
+  public:
+    ///\brief The kinds of optimization remarks, to select them.
+    enum RemarkKind {
+      kPassedRemarks = 1,
+      kMissedRemarks = 2,
+      kAnalysisRemarks = 4,
+      kAllRemarks = kPassedRemarks | kMissedRemarks | kAnalysisRemarks
+    };
+
+    ///\brief An optimization remark, as clang's -Rpass would print it.
+    struct Remark {
+      RemarkKind Kind;
+      std::string Text;
+    };
+
+  private:
     std::array<std::unique_ptr<llvm::legacy::PassManager>, 4> m_MPM;
     std::array<std::unique_ptr<llvm::legacy::FunctionPassManager>, 4> m_FPM;
 
@@ -46,16 +68,182 @@ namespace cling {
     //const clang::TargetOptions &m_TOpts;
     //const clang::LangOptions &m_LOpts;
 
+    ///\brief The "target-cpu" and "target-features" attributes that clang
+    /// gives the functions not asking for a target of their own.
+    std::string m_FrontendCPU;
+    std::string m_FrontendFeatures;
+
+    ///\brief Optimized copies of the small functions that earlier modules
+    /// define, see importInlineCandidates().
+    std::unique_ptr<llvm::Module> m_InlineCandidates;
+
+    ///\brief Whether runOnModule() collects the optimization remarks.
+    bool m_CollectRemarks = false;
+
+    ///\brief The remarks collected since they were last printed.
+    std::vector<Remark> m_Remarks;
+
+    ///\brief Whether the compilation got cancelled, see isCancelled().
+    std::function<bool()> m_IsCancelled;
+
+    ///\brief The time the passes on the module of runOnModule() have left,
+    /// and the functions whose passes got skipped once it ran out; null
+    /// without budget.
+    struct CompileBudget;
+    CompileBudget* m_Budget = nullptr;
+
+    ///\brief Skips the passes of the legacy pass manager that only
+    /// optimize, once cancelled or out of budget.
+    class PassGate;
+
+    ///\brief The pipelines of the new pass manager, with the analysis
+    /// managers they share; created on first use.
+    struct NewPM;
+    std::unique_ptr<NewPM> m_NewPM;
+
+    ///\brief The generation of the registered pass extensions the pass
+    /// managers were created with, see registerBackendPassExtension().
+    unsigned m_ExtensionsGeneration = 0;
+
     void CreatePasses(llvm::Module& M, int OptLevel);
 
+    ///\brief Optimizes M with the new pass manager, when the frontend was
+    /// asked for it with -fexperimental-new-pass-manager.
+    void runNewPM(llvm::Module& M, int OptLevel);
+
+    ///\brief Give M the bodies of the m_InlineCandidates it calls, as
+    /// available_externally definitions: the inliner and the vectorizer see
+    /// across inputs, and the copies are dropped once optimized.
+    void importInlineCandidates(llvm::Module& M) const;
+
+    ///\brief Copy M's small functions into m_InlineCandidates, unless they
+    /// use the globals in Local, which only M can refer to.
+    void recordInlineCandidates(const llvm::Module& M,
+                                const llvm::StringSet<>& Local);
+
+    ///\brief Make the functions that target the frontend's CPU target m_TM's
+    /// instead, e.g. the host's when the frontend's came from a PCH.
+    void adoptTargetCPU(llvm::Module& M) const;
+
   public:
     BackendPasses(const clang::CodeGenOptions &CGOpts,
-                  const clang::TargetOptions & /*TOpts*/,
+                  const clang::TargetOptions &TOpts,
                   const clang::LangOptions & /*LOpts*/,
                   llvm::TargetMachine& TM);
     ~BackendPasses();
 
-    void runOnModule(llvm::Module& M, int OptLevel);
+    ///\brief Optimizes M at OptLevel.
+    ///\param BudgetMs - if not 0, the milliseconds the passes may take: the
+    /// functions not optimized by then get emitted at O0, as optnone.
+    ///\param Demoted - if given, gets the names of those functions.
+    void runOnModule(llvm::Module& M, int OptLevel, unsigned BudgetMs = 0,
+                     std::vector<std::string>* Demoted = nullptr);
+
+    ///\brief Sets what tells whether the compilation got cancelled, e.g.
+    /// through Interpreter::cancelCompilation(): runOnModule() then skips
+    /// the passes that only optimize.
+    void setCancellationCheck(std::function<bool()> Check) {
+      m_IsCancelled = std::move(Check);
+    }
+    bool isCancelled() const { return m_IsCancelled && m_IsCancelled(); }
+
+    ///\brief Starts or stops collecting the optimization remarks of the
+    /// passes, through a diagnostic handler on the module's LLVMContext for
+    /// the time they run.
+    void collectRemarks(bool Collect) {
+      m_CollectRemarks = Collect;
+      if (!Collect)
+        m_Remarks.clear();
+    }
+    bool isCollectingRemarks() const { return m_CollectRemarks; }
+
+    ///\brief Prints the remarks collected of the kinds in the RemarkKind
+    /// mask Kinds, then drops them all.
+    ///\returns the number of remarks printed.
+    size_t printRemarks(llvm::raw_ostream& Out, unsigned Kinds);
+
+    ///\brief Forget the inline candidates that M defines, e.g. because it
+    /// gets unloaded.
+    void forgetDefinitions(const llvm::Module& M);
+
+    ///\brief Free the pass managers and the analyses they hold; the next
+    /// runOnModule() creates the ones it needs again.
+    void releasePassManagers();
+
+    ///\brief Route calls to the module's functions through counting stubs,
+    /// for tiered compilation: once a function got called Threshold times
+    /// the stub asks the JIT to re-optimize it at TierUpOptLevel and to swap
+    /// in the result, see IncrementalJIT::tierUp().
+    void addTierUpCounters(llvm::Module& M, unsigned Threshold,
+                           int TierUpOptLevel);
+
+    ///\brief Give the loops of M's functions that can throw a safe point,
+    /// for the ExecutionLimits: each iteration polls the flag of
+    /// getSafePointFlagName(), and calls the hook of getSafePointHookName()
+    /// while it is set, which throws if the limits of the code are exceeded.
+    /// The calls of the hook that SafePointTransformer put into the loops
+    /// become the polls, and unwind through the cleanups of their scopes;
+    /// the other loops get one only in functions without cleanups to skip.
+    /// Unless Poll, the calls of the hook are removed instead. Done before
+    /// the optimizations, which then know that the loops call what might
+    /// throw.
+    static void addSafePoints(llvm::Module& M, bool Poll = true);
+
+    ///\brief Whether addReloadStubs() can route the calls to F.
+    static bool isReloadable(const llvm::Function& F);
+
+    ///\brief Route calls to the functions Fs of M through stubs, for
+    /// Interpreter::reloadFile(): the body of F moves to F.reload0, and F
+    /// calls through the pointer F.reloadptr, which a reload of F re-points
+    /// to its new body.
+    static void addReloadStubs(llvm::Module& M,
+                               llvm::ArrayRef<llvm::Function*> Fs);
+
+    ///\brief Count how often the tier-0 bodies of addTierUpCounters() run
+    /// and take each edge of their branches, into the arrays F.pgocounts,
+    /// for profile-guided re-optimization; see applyProfile().
+    void addProfileCounters(llvm::Module& M);
+
+    ///\brief Make F, a copy of a tier-0 body of addProfileCounters(), stop
+    /// counting, and give it and M the profile in Counts: F's entry count
+    /// and branch weights, and M's profile summary.
+    static void applyProfile(llvm::Module& M, llvm::Function& F,
+                             llvm::ArrayRef<uint64_t> Counts);
+
+    ///\brief The opt level for M in the `.O auto` mode, from its IR: 0 for
+    /// the wrappers without loops, which run once; at least 2 for the code
+    /// with loops, 3 if they seem to run long; else OptLevel, the default.
+    static int selectOptLevel(const llvm::Module& M, int OptLevel);
+
+    ///\brief Make the functions of M that only call what does not throw
+    /// nounwind, and drop their unwind tables and personality: the JIT then
+    /// has no EH frames to register for a module made of those only. Without
+    /// unwind tables, debuggers need frame pointers to walk their frames.
+    static void inferNoUnwind(llvm::Module& M);
+
+    ///\brief Optimize a module without any BackendPasses instance, e.g. on
+    /// a background thread with its own LLVMContext and TargetMachine.
+    ///\param HotColdSplit - whether to outline the code that the profile
+    /// of the module says is cold.
+    static void runStandalone(llvm::Module& M, llvm::TargetMachine& TM,
+                              int OptLevel, bool HotColdSplit = false);
+
+    ///\brief The runtime function called by the tier-up stubs.
+    static const char* getTierUpHookName() { return "__cling_tier_up"; }
+    ///\brief The global holding the IncrementalJIT* passed to the hook.
+    static const char* getTierUpJITName() { return "__cling_tier_jit"; }
+    ///\brief The suffix of the counters of addProfileCounters().
+    static const char* getProfileSuffix() { return ".pgocounts"; }
+    ///\brief The module flag holding the tier-up opt level.
+    static const char* getTierUpFlagName() { return "cling.tierup"; }
+    ///\brief The runtime function called by the safe points.
+    static const char* getSafePointHookName() { return "__cling_safe_point"; }
+    ///\brief The int32 that the safe points poll.
+    static const char* getSafePointFlagName() {
+      return "__cling_safe_point_pending";
+    }
+    ///\brief The suffix of the pointers of addReloadStubs().
+    static const char* getReloadPtrSuffix() { return ".reloadptr"; }
   };
 }
 
@@ -8,6 +8,9 @@
 //------------------------------------------------------------------------------
 
 #include "ClingUtils.h"
+#include "EmbeddedHeaders.h"
+#include "HeaderSnapshot.h"
+#include "StatCacheFileSystem.h"
 #include <cling-compiledata.h>
 
 #include "cling/Interpreter/CIFactory.h"
@@ -42,16 +45,20 @@
 #include "llvm/Option/ArgList.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Host.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Process.h"
+#include "llvm/Support/Program.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/TimeProfiler.h"
 #include "llvm/Target/TargetOptions.h"
 
 #include <cstdio>
 #include <ctime>
 #include <limits>
 #include <memory>
+#include <mutex>
 
 using namespace clang;
 using namespace cling;
@@ -103,10 +110,115 @@ namespace {
 
 #ifndef _MSC_VER
 
+  ///\brief Returns the file caching the include paths of the Compiler
+  /// command, or an empty string if they should not be cached.
+  ///
+  /// The cache lives in $CLING_INCLUDE_CACHE if set (an empty value disables
+  /// caching), otherwise in the user's cache directory. The file name hashes
+  /// the command (i.e. the compiler and its flags) together with the size
+  /// and modification time of the compiler executable, so that updating or
+  /// replacing the compiler causes a new probe.
+  static std::string GetIncludePathCacheFile(const char* Compiler) {
+    llvm::SmallString<256> CacheFile;
+    if (const char* Env = ::getenv("CLING_INCLUDE_CACHE")) {
+      if (!*Env)
+        return std::string();
+      CacheFile = Env;
+    } else if (llvm::sys::path::cache_directory(CacheFile))
+      llvm::sys::path::append(CacheFile, "cling");
+    else
+      return std::string();
+
+    // The command's first word is the compiler, possibly found in $PATH.
+    llvm::StringRef Exe = llvm::StringRef(Compiler).split(' ').first;
+    llvm::ErrorOr<std::string> ExePath = llvm::sys::findProgramByName(Exe);
+    llvm::sys::fs::file_status Status;
+    if (!ExePath || llvm::sys::fs::status(*ExePath, Status))
+      return std::string();
+
+    llvm::MD5 Hash;
+    Hash.update(Compiler);
+    Hash.update(*ExePath);
+    Hash.update(std::to_string(Status.getSize()));
+    Hash.update(std::to_string(llvm::sys::toTimeT(
+                                 Status.getLastModificationTime())));
+    llvm::MD5::MD5Result Result;
+    Hash.final(Result);
+    llvm::sys::path::append(CacheFile,
+                            "cxx-includes-" + Result.digest().str() + ".txt");
+    return CacheFile.str();
+  }
+
+  ///\brief Reads the include paths cached in CacheFile, one per line.
+  ///
+  ///\returns false, adding nothing to Args, if there is no cache or one of
+  /// the paths does not exist anymore.
+  static bool ReadCachedIncludePaths(const std::string& CacheFile,
+                                     AdditionalArgList& Args, bool Verbose) {
+    auto Buffer = llvm::MemoryBuffer::getFile(CacheFile);
+    if (!Buffer)
+      return false;
+
+    llvm::SmallVector<llvm::StringRef, 8> Paths;
+    (*Buffer)->getBuffer().split(Paths, '\n', -1, /*KeepEmpty*/ false);
+    if (Paths.empty())
+      return false;
+    for (llvm::StringRef Path : Paths) {
+      if (!llvm::sys::fs::is_directory(Path)) {
+        if (Verbose)
+          cling::log() << "Ignoring stale include path cache " << CacheFile
+                       << "\n";
+        return false;
+      }
+    }
+
+    if (Verbose)
+      cling::log() << "Found in " << CacheFile << ":\n";
+    for (llvm::StringRef Path : Paths) {
+      if (Verbose)
+        cling::log() << "  " << Path << "\n";
+      Args.addArgument("-cxx-isystem", Path.str());
+    }
+    return true;
+  }
+
+  ///\brief Stores the paths of the -cxx-isystem Args in CacheFile.
+  static void WriteCachedIncludePaths(const std::string& CacheFile,
+                                      const AdditionalArgList& Args) {
+    if (llvm::sys::fs::create_directories(
+          llvm::sys::path::parent_path(CacheFile)))
+      return;
+
+    // Write to a unique temporary, then rename: concurrent processes must
+    // never see a partially written cache.
+    int FD;
+    llvm::SmallString<256> TmpPath;
+    if (llvm::sys::fs::createUniqueFile(CacheFile + ".%%%%%%.tmp", FD,
+                                        TmpPath))
+      return;
+    {
+      llvm::raw_fd_ostream OS(FD, /*shouldClose*/ true);
+      for (const auto& Arg : Args)
+        OS << Arg.second << '\n';
+      if (OS.has_error()) {
+        OS.clear_error();
+        OS.close();
+        llvm::sys::fs::remove(TmpPath);
+        return;
+      }
+    }
+    if (llvm::sys::fs::rename(TmpPath, CacheFile))
+      llvm::sys::fs::remove(TmpPath);
+  }
+
   static void ReadCompilerIncludePaths(const char* Compiler,
                                        llvm::SmallVectorImpl<char>& Buf,
                                        AdditionalArgList& Args,
                                        bool Verbose) {
+    const std::string CacheFile = GetIncludePathCacheFile(Compiler);
+    if (!CacheFile.empty() && ReadCachedIncludePaths(CacheFile, Args, Verbose))
+      return;
+
     std::string CppInclQuery("LC_ALL=C ");
     CppInclQuery.append(Compiler);
 
@@ -143,10 +255,14 @@ namespace {
     if (Args.empty()) {
       Buf.resize(0);
       Buf.insert(Buf.begin(), CppInclQuery.begin(), CppInclQuery.end());
-    } else if (Verbose) {
-      cling::log() << "Found:\n";
-      for (const auto& Arg : Args)
-        cling::log() << "  " << Arg.second << "\n";
+    } else {
+      if (Verbose) {
+        cling::log() << "Found:\n";
+        for (const auto& Arg : Args)
+          cling::log() << "  " << Arg.second << "\n";
+      }
+      if (!CacheFile.empty())
+        WriteCachedIncludePaths(CacheFile, Args);
     }
   }
 
@@ -203,7 +319,10 @@ namespace {
                                std::vector<const char*>& args,
                                const char* llvmdir, const CompilerOptions& opts) {
     (void)clingBin;
+    // Probed once per process; interpreters may get created concurrently.
     static AdditionalArgList sArguments;
+    static std::mutex sArgumentsMutex;
+    std::lock_guard<std::mutex> Lock(sArgumentsMutex);
     if (sArguments.empty()) {
       const bool Verbose = opts.Verbose;
 #ifdef _MSC_VER
@@ -538,11 +657,27 @@ namespace {
   }
 
   /// \brief Adds all the paths to the prebuilt module paths of the given
-  /// HeaderSearchOptions.
-  static void addPrebuiltModulePaths(clang::HeaderSearchOptions& Opts,
+  /// CompilerInstance, skipping those whose stamp says that their modules
+  /// were built for a different setup.
+  static void addPrebuiltModulePaths(clang::CompilerInstance& CI,
                                      const SmallVectorImpl<StringRef>& Paths) {
-    for (StringRef ModulePath : Paths)
+    clang::HeaderSearchOptions& Opts = CI.getHeaderSearchOpts();
+    std::string Fingerprint;
+    for (StringRef ModulePath : Paths) {
+      std::string Stamp;
+      if (CIFactory::readPrebuiltModulesStamp(ModulePath, Stamp)) {
+        if (Fingerprint.empty())
+          Fingerprint = CIFactory::getPrebuiltModulesFingerprint(CI);
+        if (Stamp != Fingerprint) {
+          // Using them would rebuild them implicitly, upon the first import.
+          cling::errs() << "cling: warning: ignoring out of date prebuilt "
+                           "modules in '" << ModulePath << "'; rebuild them "
+                           "with cling-prebuild-modules\n";
+          continue;
+        }
+      }
       Opts.AddPrebuiltModulePath(ModulePath);
+    }
   }
 
   static std::string getIncludePathForHeader(const clang::HeaderSearch& HS,
@@ -736,11 +871,9 @@ namespace {
   }
 
   static void setupCxxModules(clang::CompilerInstance& CI) {
+    llvm::TimeTraceScope TimeScope("SetupModules", llvm::StringRef());
     assert(CI.getLangOpts().Modules);
     clang::HeaderSearchOptions& HSOpts = CI.getHeaderSearchOpts();
-    // Register prebuilt module paths where we will lookup module files.
-    addPrebuiltModulePaths(HSOpts,
-                           getPathsFromEnv(getenv("CLING_PREBUILT_MODULE_PATH")));
 
     // Register all modulemaps necessary for cling to run. If we have specified
     // -fno-implicit-module-maps then we have to add them explicitly to the list
@@ -749,6 +882,10 @@ namespace {
 
     collectModuleMaps(CI, ModuleMaps);
 
+    // Register prebuilt module paths where we will lookup module files.
+    addPrebuiltModulePaths(CI,
+                           getPathsFromEnv(getenv("CLING_PREBUILT_MODULE_PATH")));
+
     assert(HSOpts.ImplicitModuleMaps == ModuleMaps.empty() &&
            "We must have register the modulemaps by hand!");
     // Prepend the modulemap files we attached so that they will be loaded.
@@ -843,6 +980,33 @@ static void stringifyPreprocSetting(PreprocessorOptions& PPOpts,
     }
   }
 
+  /// Target the CPU the code runs on, with all its features, as -march=native
+  /// does: the vectorizers can then use its widest vectors.
+  static void SetTargetFromHost(TargetOptions& TargetOpts) {
+    // Probed once per process, for all its interpreters.
+    struct HostTarget {
+      std::string CPU;
+      std::vector<std::string> Features;
+    };
+    static const HostTarget Host = []() {
+      HostTarget H;
+      H.CPU = llvm::sys::getHostCPUName();
+      llvm::StringMap<bool> Features;
+      if (llvm::sys::getHostCPUFeatures(Features))
+        for (const auto& Feature : Features)
+          H.Features.push_back(
+            (Feature.second ? "+" : "-") + Feature.first().str());
+      return H;
+    }();
+    if (Host.CPU.empty() || Host.CPU == "generic")
+      return;
+    TargetOpts.CPU = Host.CPU;
+    // The host's features come last, overriding the driver's.
+    TargetOpts.FeaturesAsWritten.insert(TargetOpts.FeaturesAsWritten.end(),
+                                        Host.Features.begin(),
+                                        Host.Features.end());
+  }
+
   template <class CONTAINER>
   static void insertBehind(CONTAINER& To, const CONTAINER& From) {
     To.insert(To.end(), From.begin(), From.end());
@@ -939,6 +1103,12 @@ static void stringifyPreprocSetting(PreprocessorOptions& PPOpts,
       return false;
     }
 
+    // Unless the target was requested, or comes from a PCH (whose target
+    // must match), or the output might run elsewhere.
+    if (Targ && !CompilerOpts.TargetCPU && !CompilerOpts.HasOutput
+        && !CompilerOpts.CUDADevice)
+      SetTargetFromHost(CI->getTargetOpts());
+
     CI->setTarget(TargetInfo::CreateTargetInfo(CI->getDiagnostics(),
                                                CI->getInvocation().TargetOpts));
     if (!CI->hasTarget()) {
@@ -1217,6 +1387,8 @@ static void stringifyPreprocSetting(PreprocessorOptions& PPOpts,
                std::unique_ptr<clang::ASTConsumer> customConsumer,
                const CIFactory::ModuleFileExtensions& moduleExtensions,
                bool OnlyLex, bool HasInput = false) {
+    llvm::TimeTraceScope TimeScope("CreateCI", llvm::StringRef());
+
     // Follow clang -v convention of printing version on first line
     if (COpts.Verbose)
       cling::log() << "cling version " << ClingStringify(CLING_VERSION) << '\n';
@@ -1325,7 +1497,10 @@ static void stringifyPreprocSetting(PreprocessorOptions& PPOpts,
 
     // Add host specific includes, -resource-dir if necessary, and -isysroot
     std::string ClingBin = GetExecutablePath(argv[0]);
-    AddHostArguments(ClingBin, argvCompile, LLVMDir, COpts);
+    {
+      llvm::TimeTraceScope TimeScope("IncludePaths", llvm::StringRef());
+      AddHostArguments(ClingBin, argvCompile, LLVMDir, COpts);
+    }
 
     // Be explicit about the stdlib on OS X
     // Would be nice on Linux but will warn 'argument unused during compilation'
@@ -1426,7 +1601,19 @@ static void stringifyPreprocSetting(PreprocessorOptions& PPOpts,
       return CI.release();
     }
 
-    CI->createFileManager();
+    // With CLING_STAT_CACHE, the header search skips the misses of earlier
+    // sessions; with CLING_HEADER_SNAPSHOT, it finds the system headers in
+    // one archive. cling's runtime headers come from libcling.
+    IntrusiveRefCntPtr<llvm::vfs::FileSystem> VFS
+      = StatCacheFileSystem::createFromEnv(
+          createVFSFromCompilerInvocation(CI->getInvocation(),
+                                          CI->getDiagnostics()),
+          CI->getInvocation().getHeaderSearchOptsPtr());
+    VFS = EmbeddedHeadersFileSystem::create(std::move(VFS),
+                                            CI->getHeaderSearchOpts(),
+                                            COpts.CxxModules);
+    CI->createFileManager(HeaderSnapshotFileSystem::createFromEnv(
+        std::move(VFS), CI->getHeaderSearchOpts()));
     clang::CompilerInvocation& Invocation = CI->getInvocation();
     std::string& PCHFile = Invocation.getPreprocessorOpts().ImplicitPCHInclude;
     bool InitLang = true, InitTarget = true;
@@ -1445,7 +1632,18 @@ static void stringifyPreprocSetting(PreprocessorOptions& PPOpts,
           bool ReadLanguageOptions(const LangOptions &LangOpts,
                                    bool /*Complain*/,
                                    bool /*AllowCompatibleDifferences*/) override {
-            *m_Invocation.getLangOpts() = LangOpts;
+            LangOptions& Opts = *m_Invocation.getLangOpts();
+            // OpenMP is enabled per session, with -fopenmp: the PCH is not
+            // built for it, which would silently ignore `#pragma omp`.
+            const unsigned OpenMP = Opts.OpenMP;
+            const unsigned OpenMPSimd = Opts.OpenMPSimd;
+            const unsigned OpenMPUseTLS = Opts.OpenMPUseTLS;
+            Opts = LangOpts;
+            if (OpenMP || OpenMPSimd) {
+              Opts.OpenMP = OpenMP;
+              Opts.OpenMPSimd = OpenMPSimd;
+              Opts.OpenMPUseTLS = OpenMPUseTLS;
+            }
             m_ReadLang = true;
             return false;
           }
@@ -1732,5 +1930,58 @@ CompilerInstance* CIFactory::createCI(
                       std::move(consumer), moduleExtensions, OnlyLex);
 }
 
+const char* const CIFactory::PrebuiltModulesStampName = "cling-modules.stamp";
+const char* const CIFactory::PrebuiltModuleIndexName = "cling-modules.idx";
+
+std::string
+CIFactory::getPrebuiltModulesFingerprint(const clang::CompilerInstance& CI) {
+  // Clang checks the headers of a module when loading it, but neither the
+  // options nor the headers it would find now instead: hash the options, and
+  // the header search directories, whose time stamps change when headers get
+  // added, removed or installed.
+  llvm::MD5 Hash;
+  Hash.update(clang::getClangFullVersion());
+  Hash.update(CI.getInvocation().getModuleHash());
+  const clang::HeaderSearchOptions& HSOpts = CI.getHeaderSearchOpts();
+  auto addDirectory = [&Hash](llvm::StringRef Dir) {
+    Hash.update(Dir);
+    llvm::sys::fs::file_status Status;
+    if (!llvm::sys::fs::status(Dir, Status))
+      Hash.update(std::to_string(llvm::sys::toTimeT(
+                                   Status.getLastModificationTime())));
+    Hash.update(llvm::StringRef("", 1)); // Separates the entries.
+  };
+  addDirectory(HSOpts.ResourceDir);
+  for (const clang::HeaderSearchOptions::Entry& E : HSOpts.UserEntries)
+    addDirectory(E.Path);
+  llvm::MD5::MD5Result Result;
+  Hash.final(Result);
+  return Result.digest().str();
+}
+
+bool CIFactory::readPrebuiltModulesStamp(llvm::StringRef Dir,
+                                         std::string& Fingerprint) {
+  llvm::SmallString<256> StampFile(Dir);
+  llvm::sys::path::append(StampFile, PrebuiltModulesStampName);
+  auto Buffer = llvm::MemoryBuffer::getFile(StampFile);
+  if (!Buffer)
+    return false;
+  Fingerprint = (*Buffer)->getBuffer().trim().str();
+  return true;
+}
+
+bool CIFactory::writePrebuiltModulesStamp(llvm::StringRef Dir,
+                                          llvm::StringRef Fingerprint) {
+  llvm::SmallString<256> StampFile(Dir);
+  llvm::sys::path::append(StampFile, PrebuiltModulesStampName);
+  std::error_code EC;
+  llvm::raw_fd_ostream Out(StampFile, EC, llvm::sys::fs::F_Text);
+  if (EC)
+    return false;
+  Out << Fingerprint << '\n';
+  Out.close();
+  return !Out.has_error();
+}
+
 } // namespace cling
 
@@ -0,0 +1,202 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "CellCache.h"
+
+#include "cling/Interpreter/CompilationOptions.h"
+#include "cling/Interpreter/Interpreter.h"
+#include "cling/Interpreter/Transaction.h"
+#include "cling/Utils/AST.h"
+
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/AST/DeclTemplate.h"
+#include "clang/AST/ExprCXX.h"
+#include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+
+using namespace clang;
+
+namespace {
+  ///\brief Adds the name that lookups find D by: that of the declaration at
+  /// namespace scope that contains it, e.g. its class.
+  static void addName(const Decl* D, llvm::StringSet<>& Names) {
+    if (!D)
+      return;
+    const DeclContext* DC = D->getDeclContext()->getRedeclContext();
+    while (!DC->isFileContext()) {
+      D = Decl::castFromDeclContext(DC);
+      DC = D->getDeclContext()->getRedeclContext();
+    }
+    if (const NamedDecl* ND = dyn_cast<NamedDecl>(D))
+      if (ND->getDeclName())
+        Names.insert(ND->getDeclName().getAsString());
+  }
+
+  ///\brief Collects the names of the declarations that code refers to.
+  class UseCollector : public RecursiveASTVisitor<UseCollector> {
+    llvm::StringSet<>& m_Used;
+
+  public:
+    UseCollector(llvm::StringSet<>& Used): m_Used(Used) {}
+
+    bool VisitDeclRefExpr(DeclRefExpr* E) {
+      addName(E->getDecl(), m_Used);
+      return true;
+    }
+    bool VisitMemberExpr(MemberExpr* E) {
+      addName(E->getMemberDecl(), m_Used);
+      return true;
+    }
+    bool VisitCXXConstructExpr(CXXConstructExpr* E) {
+      addName(E->getConstructor(), m_Used);
+      return true;
+    }
+    bool VisitOverloadExpr(OverloadExpr* E) {
+      for (const NamedDecl* D : E->decls())
+        addName(D, m_Used);
+      return true;
+    }
+    bool VisitUsingDirectiveDecl(UsingDirectiveDecl* D) {
+      addName(D->getNominatedNamespace(), m_Used);
+      return true;
+    }
+    bool VisitTagType(TagType* T) {
+      addName(T->getDecl(), m_Used);
+      return true;
+    }
+    bool VisitTypedefType(TypedefType* T) {
+      addName(T->getDecl(), m_Used);
+      return true;
+    }
+    bool VisitTemplateSpecializationType(TemplateSpecializationType* T) {
+      addName(T->getTemplateName().getAsTemplateDecl(), m_Used);
+      return true;
+    }
+  };
+
+  ///\brief Gathers what a sequence of transactions declares and, for those
+  /// of an input, uses.
+  struct Collector {
+    cling::CellCache::Cell Cell;
+    const SourceManager* SM = nullptr;
+    unsigned NumWrappers = 0;
+    bool Cacheable = true;
+    bool Macros = false;
+
+    void addDeclared(const Decl* D) {
+      if (const auto* LSD = dyn_cast<LinkageSpecDecl>(D)) {
+        for (const Decl* Child : LSD->decls())
+          addDeclared(Child);
+        return;
+      }
+      if (const auto* VD = dyn_cast<VarDecl>(D)) {
+        // Its initializer would not run again.
+        if (VD->isThisDeclarationADefinition() != VarDecl::DeclarationOnly)
+          Cacheable = false;
+      }
+      addName(D, Cell.Declared);
+      if (const auto* NSD = dyn_cast<NamespaceDecl>(D)) {
+        // Also the redefinitions that DefinitionShadower nests.
+        for (const Decl* Child : NSD->decls())
+          addDeclared(Child);
+      }
+    }
+
+    void collect(const cling::Transaction& T) {
+      if (T.getState() != cling::Transaction::kCommitted)
+        return;
+      if (T.macros_begin() != T.macros_end())
+        Macros = true;
+      for (auto I = T.decls_begin(), E = T.decls_end(); I != E; ++I) {
+        if (I->m_Call != cling::Transaction::kCCIHandleTopLevelDecl)
+          continue;
+        for (Decl* D : I->m_DGR) {
+          if (D == T.getWrapperFD()) {
+            ++NumWrappers;
+            cling::utils::Analyze::maybeMangleDeclName(T.getWrapperFD(),
+                                                       Cell.WrapperName);
+            Cell.ValuePrinting = T.getCompilationOpts().ValuePrinting;
+          } else
+            addDeclared(D);
+          // What headers use does not change with the cells; they are
+          // many declarations.
+          if (SM && SM->getFileID(SM->getExpansionLoc(D->getBeginLoc()))
+                      == T.getBufferFID())
+            UseCollector(Cell.Used).TraverseDecl(D);
+        }
+      }
+      for (auto I = T.nested_begin(), E = T.nested_end(); I != E; ++I)
+        collect(**I);
+    }
+  };
+} // unnamed namespace
+
+namespace cling {
+
+  void CellCache::invalidate(const llvm::StringSet<>& Names) {
+    for (auto I = m_Cells.begin(), E = m_Cells.end(); I != E;) {
+      const Cell& C = I->second;
+      bool Invalid = false;
+      for (const auto& Name : Names) {
+        if (C.Used.count(Name.first()) || C.Declared.count(Name.first())) {
+          Invalid = true;
+          break;
+        }
+      }
+      auto Cur = I++;
+      if (Invalid)
+        m_Cells.erase(Cur);
+    }
+  }
+
+  void CellCache::update() {
+    const Transaction* Last = m_Interp.getLastTransaction();
+    if (!m_Cells.empty() && Last != m_LastSeen) {
+      Collector C;
+      for (const Transaction* T = m_LastSeen ? m_LastSeen->getNext()
+                                             : m_Interp.getFirstTransaction();
+           T; T = T->getNext())
+        C.collect(*T);
+      if (C.Macros)
+        clear();
+      else
+        invalidate(C.Cell.Declared);
+    }
+    m_LastSeen = Last;
+  }
+
+  const CellCache::Cell* CellCache::find(llvm::StringRef Key) const {
+    auto I = m_Cells.find(Key);
+    return I == m_Cells.end() ? nullptr : &I->second;
+  }
+
+  void CellCache::add(llvm::StringRef Key, const Transaction* Before) {
+    Collector C;
+    C.SM = &m_Interp.getCI()->getSourceManager();
+    for (const Transaction* T = Before ? Before->getNext()
+                                       : m_Interp.getFirstTransaction();
+         T; T = T->getNext())
+      C.collect(*T);
+    if (C.Macros)
+      clear();
+    else
+      invalidate(C.Cell.Declared);
+    m_LastSeen = m_Interp.getLastTransaction();
+    // More than one wrapper means that the input ran others, e.g. through
+    // Interpreter::process(): those would not run again.
+    if (C.Cacheable && !C.Macros && C.NumWrappers <= 1)
+      m_Cells[Key] = std::move(C.Cell);
+  }
+
+  void CellCache::clear() {
+    m_Cells.clear();
+    m_LastSeen = nullptr;
+  }
+} // end namespace cling
@@ -0,0 +1,74 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_CELL_CACHE_H
+#define CLING_CELL_CACHE_H
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+
+#include <string>
+
+namespace cling {
+  class Interpreter;
+  class Transaction;
+
+  ///\brief The inputs that Interpreter::process() compiled, to run them
+  /// again without compiling them when they are processed again; see
+  /// RuntimeOptions::CacheCells.
+  ///
+  /// Each input records the names it declared and the names of the
+  /// declarations it used. Its entry remains valid as long as no other input
+  /// declares either again: its declarations are then still those in effect,
+  /// and what it refers to is what it was compiled against. Re-running it
+  /// then only runs its wrapper again, if it has one. Inputs that define
+  /// variables are not cached, as their initializers would not run again;
+  /// macros drop the whole cache, as their uses are not tracked.
+  ///
+  class CellCache {
+  public:
+    struct Cell {
+      ///\brief The mangled name of the wrapper of the input, if any.
+      std::string WrapperName;
+      ///\brief The value printing mode the wrapper was compiled with.
+      unsigned ValuePrinting = 0;
+      llvm::StringSet<> Declared;
+      llvm::StringSet<> Used;
+    };
+
+  private:
+    const Interpreter& m_Interp;
+    llvm::StringMap<Cell> m_Cells;
+
+    ///\brief The last transaction whose declarations invalidated the cells.
+    const Transaction* m_LastSeen = nullptr;
+
+    ///\brief Drops the cells that use or declare what Names holds.
+    void invalidate(const llvm::StringSet<>& Names);
+
+  public:
+    CellCache(const Interpreter& Interp): m_Interp(Interp) {}
+
+    ///\brief Drops the cells that the transactions committed since the last
+    /// call invalidate.
+    void update();
+
+    ///\brief The cell of Key, or null; call update() first.
+    const Cell* find(llvm::StringRef Key) const;
+
+    ///\brief Records the input Key, which committed the transactions after
+    /// Before, and invalidates the cells that they redeclare.
+    void add(llvm::StringRef Key, const Transaction* Before);
+
+    ///\brief Drops all cells, e.g. as a transaction got unloaded.
+    void clear();
+  };
+} // end namespace cling
+
+#endif // CLING_CELL_CACHE_H
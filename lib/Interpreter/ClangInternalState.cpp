@@ -9,7 +9,6 @@
 
 #include "cling/Interpreter/ClangInternalState.h"
 #include "cling/Utils/Output.h"
-#include "cling/Utils/Platform.h"
 
 #include "clang/AST/ASTContext.h"
 #include "clang/Lex/Preprocessor.h"
@@ -19,19 +18,197 @@
 #include "clang/Basic/TargetInfo.h"
 #include "clang/CodeGen/ModuleBuilder.h"
 
-#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/IR/Module.h"
-#include "llvm/Support/FileSystem.h"
-#include "llvm/Support/Path.h"
-#include "llvm/Support/Signals.h"
+#include "llvm/Support/Regex.h"
+#include "llvm/Support/raw_ostream.h"
 
-#include <cstdio>
+#include <algorithm>
 #include <sstream>
 #include <string>
-#include <time.h>
+#include <vector>
 
 using namespace clang;
 
+namespace {
+  ///\brief An operation of an edit script: ' ' keeps, '-' deletes and '+'
+  /// inserts a line. A and B are the indices of the line in the old and new
+  /// contents, or where it would be had it been kept.
+  struct Edit {
+    char Op;
+    size_t A, B;
+  };
+
+  ///\brief Past this number of differences the contents are taken to be
+  /// replaced as a whole; the trace of the diff grows with its square.
+  static const size_t kMaxDifferences = 4096;
+
+  ///\brief Computes the shortest edit script from A to B with Myers' greedy
+  /// algorithm. Both ends cut first, they are the same in most comparisons.
+  static void diffLines(llvm::ArrayRef<llvm::StringRef> A,
+                        llvm::ArrayRef<llvm::StringRef> B,
+                        std::vector<Edit>& Script) {
+    size_t Prefix = 0;
+    while (Prefix < A.size() && Prefix < B.size() && A[Prefix] == B[Prefix])
+      ++Prefix;
+    size_t Suffix = 0;
+    while (Suffix < A.size() - Prefix && Suffix < B.size() - Prefix
+           && A[A.size() - 1 - Suffix] == B[B.size() - 1 - Suffix])
+      ++Suffix;
+
+    for (size_t I = 0; I < Prefix; ++I)
+      Script.push_back(Edit{' ', I, I});
+
+    const long N = A.size() - Prefix - Suffix, M = B.size() - Prefix - Suffix;
+    auto Same = [&](long X, long Y) {
+      return A[Prefix + X] == B[Prefix + Y];
+    };
+
+    // V[Off + k] is the furthest x on diagonal k = x - y; Trace[d] keeps the
+    // diagonals -d..d after d differences, to walk the path back.
+    const long Max = std::min<long>(N + M, kMaxDifferences);
+    const long Off = Max + 1;
+    std::vector<long> V(2 * Max + 3, 0);
+    std::vector<std::vector<long>> Trace;
+    bool Found = N == 0 && M == 0;
+    for (long D = 0; !Found && D <= Max; ++D) {
+      for (long K = -D; K <= D; K += 2) {
+        long X = (K == -D || (K != D && V[Off + K - 1] < V[Off + K + 1]))
+          ? V[Off + K + 1] : V[Off + K - 1] + 1;
+        long Y = X - K;
+        while (X < N && Y < M && Same(X, Y))
+          ++X, ++Y;
+        V[Off + K] = X;
+        if (X >= N && Y >= M) {
+          Found = true;
+          break;
+        }
+      }
+      Trace.emplace_back(V.begin() + Off - D, V.begin() + Off + D + 1);
+    }
+
+    std::vector<Edit> Middle;
+    if (!Found) {
+      for (long X = 0; X < N; ++X)
+        Middle.push_back(Edit{'-', size_t(Prefix + X), Prefix});
+      for (long Y = 0; Y < M; ++Y)
+        Middle.push_back(Edit{'+', size_t(Prefix + N), size_t(Prefix + Y)});
+    } else {
+      long X = N, Y = M;
+      for (long D = Trace.size() - 1; D > 0; --D) {
+        const std::vector<long>& Prev = Trace[D - 1];
+        long K = X - Y;
+        bool Down = K == -D
+          || (K != D && Prev[K - 1 + D - 1] < Prev[K + 1 + D - 1]);
+        long PrevK = Down ? K + 1 : K - 1;
+        long PrevX = Prev[PrevK + D - 1];
+        long PrevY = PrevX - PrevK;
+        while (X > PrevX && Y > PrevY) {
+          --X, --Y;
+          Middle.push_back(Edit{' ', size_t(Prefix + X), size_t(Prefix + Y)});
+        }
+        if (Down)
+          Middle.push_back(Edit{'+', size_t(Prefix + X),
+                                size_t(Prefix + PrevY)});
+        else
+          Middle.push_back(Edit{'-', size_t(Prefix + PrevX),
+                                size_t(Prefix + Y)});
+        X = PrevX;
+        Y = PrevY;
+      }
+      while (X > 0 && Y > 0) {
+        --X, --Y;
+        Middle.push_back(Edit{' ', size_t(Prefix + X), size_t(Prefix + Y)});
+      }
+      std::reverse(Middle.begin(), Middle.end());
+    }
+    Script.insert(Script.end(), Middle.begin(), Middle.end());
+
+    for (size_t I = 0; I < Suffix; ++I)
+      Script.push_back(Edit{' ', A.size() - Suffix + I, B.size() - Suffix + I});
+  }
+
+  ///\brief Whether Line matches one of the ignored patterns, which like
+  /// those of `diff --ignore-matching-lines` match anywhere in the line.
+  class LineIgnorer {
+    std::vector<llvm::StringRef> m_Literals;
+    std::vector<std::unique_ptr<llvm::Regex>> m_Regexes;
+
+  public:
+    LineIgnorer(const llvm::SmallVectorImpl<llvm::StringRef>* Ignores) {
+      if (!Ignores)
+        return;
+      for (llvm::StringRef Ignore : *Ignores) {
+        if (llvm::Regex::isLiteralERE(Ignore))
+          m_Literals.push_back(Ignore);
+        else
+          m_Regexes.emplace_back(new llvm::Regex(Ignore));
+      }
+    }
+
+    bool operator()(llvm::StringRef Line) const {
+      for (llvm::StringRef Literal : m_Literals)
+        if (Line.contains(Literal))
+          return true;
+      for (const auto& Regex : m_Regexes)
+        if (Regex->match(Line))
+          return true;
+      return false;
+    }
+  };
+
+  ///\brief Prints the lines of Script that differ in the unified format,
+  /// leaving hunks out if all their changes are ignored lines.
+  ///\returns true if any hunk got printed.
+  static bool printHunks(llvm::raw_ostream& Out,
+                         const std::vector<Edit>& Script,
+                         llvm::ArrayRef<llvm::StringRef> A,
+                         llvm::ArrayRef<llvm::StringRef> B,
+                         const LineIgnorer& Ignored) {
+    const size_t Context = 3;
+    bool Printed = false;
+    size_t I = 0, E = Script.size();
+    while (I < E) {
+      if (Script[I].Op == ' ') {
+        ++I;
+        continue;
+      }
+      // Extend the hunk up to the first run of unchanged lines that is too
+      // long to only be context.
+      size_t Begin = I > Context ? I - Context : 0;
+      size_t Last = I;
+      for (size_t J = I; J < E && J - Last <= 2 * Context; ++J)
+        if (Script[J].Op != ' ')
+          Last = J;
+      size_t End = std::min(E, Last + Context + 1);
+
+      bool AllIgnored = true;
+      for (size_t J = I; AllIgnored && J <= Last; ++J)
+        if (Script[J].Op == '-')
+          AllIgnored = Ignored(A[Script[J].A]);
+        else if (Script[J].Op == '+')
+          AllIgnored = Ignored(B[Script[J].B]);
+
+      if (!AllIgnored) {
+        size_t ALen = 0, BLen = 0;
+        for (size_t J = Begin; J < End; ++J) {
+          ALen += Script[J].Op != '+';
+          BLen += Script[J].Op != '-';
+        }
+        Out << "@@ -" << Script[Begin].A + (ALen != 0) << ',' << ALen
+            << " +" << Script[Begin].B + (BLen != 0) << ',' << BLen << " @@\n";
+        for (size_t J = Begin; J < End; ++J) {
+          const Edit& Ed = Script[J];
+          Out << Ed.Op << (Ed.Op == '+' ? B[Ed.B] : A[Ed.A]) << '\n';
+        }
+        Printed = true;
+      }
+      I = Last + 1;
+    }
+    return Printed;
+  }
+} // unnamed namespace
+
 namespace cling {
 
   ClangInternalState::ClangInternalState(const ASTContext& AC,
@@ -40,97 +217,39 @@ namespace cling {
                                          CodeGenerator* CG,
                                          const std::string& name)
     : m_ASTContext(AC), m_Preprocessor(PP), m_CodeGen(CG), m_Module(M),
-#if defined(_WIN32)
-      m_DiffCommand("diff.exe -u --text "),
-#else
-      m_DiffCommand("diff -u --text "),
-#endif
       m_Name(name), m_DiffPair(nullptr) {
     store();
   }
 
-  ClangInternalState::~ClangInternalState() {
-    // cleanup the temporary files:
-    remove(m_LookupTablesFile.c_str());
-    remove(m_IncludedFilesFile.c_str());
-    remove(m_ASTFile.c_str());
-    remove(m_LLVMModuleFile.c_str());
-    remove(m_MacrosFile.c_str());
-  }
+  ClangInternalState::~ClangInternalState() {}
 
   void ClangInternalState::store() {
-    // Cannot use the stack (private copy ctor)
-    std::unique_ptr<llvm::raw_fd_ostream> m_LookupTablesOS;
-    std::unique_ptr<llvm::raw_fd_ostream> m_IncludedFilesOS;
-    std::unique_ptr<llvm::raw_fd_ostream> m_ASTOS;
-    std::unique_ptr<llvm::raw_fd_ostream> m_LLVMModuleOS;
-    std::unique_ptr<llvm::raw_fd_ostream> m_MacrosOS;
-
-    m_LookupTablesOS.reset(createOutputFile("lookup",
-                                            &m_LookupTablesFile));
-    m_IncludedFilesOS.reset(createOutputFile("included",
-                                             &m_IncludedFilesFile));
-    m_ASTOS.reset(createOutputFile("ast", &m_ASTFile));
-    m_LLVMModuleOS.reset(createOutputFile("module", &m_LLVMModuleFile));
-    m_MacrosOS.reset(createOutputFile("macros", &m_MacrosFile));
-
-    printLookupTables(*m_LookupTablesOS.get(), m_ASTContext);
-    printIncludedFiles(*m_IncludedFilesOS.get(),
-                       m_ASTContext.getSourceManager());
-    printAST(*m_ASTOS.get(), m_ASTContext);
-    if (m_Module)
-      printLLVMModule(*m_LLVMModuleOS.get(), *m_Module, *m_CodeGen);
-    printMacroDefinitions(*m_MacrosOS.get(), m_Preprocessor);
-  }
-  namespace {
-    std::string getCurrentTimeAsString() {
-      time_t rawtime;
-      struct tm * timeinfo;
-      char buffer [80];
-
-      time (&rawtime);
-      timeinfo = localtime (&rawtime);
-
-      strftime (buffer, 80, "%I_%M_%S", timeinfo);
-      return buffer;
-    }
-  }
-
-  // Copied with modifications from CompilerInstance.cpp
-  llvm::raw_fd_ostream*
-  ClangInternalState::createOutputFile(llvm::StringRef OutFile,
-                                       std::string *TempPathName/*=0*/,
-                                       bool RemoveFileOnSignal/*=true*/) {
-    std::unique_ptr<llvm::raw_fd_ostream> OS;
-    std::string OSFile;
-    llvm::SmallString<256> OutputPath;
-    llvm::sys::path::system_temp_directory(/*erasedOnReboot*/false, OutputPath);
-
-    // Only create the temporary if the parent directory exists (or create
-    // missing directories is true) and we can actually write to OutPath,
-    // otherwise we want to fail early.
-    llvm::SmallString<256> TempPath(OutputPath);
-    llvm::sys::fs::make_absolute(TempPath);
-    assert(llvm::sys::fs::is_directory(TempPath.str()) && "Must be a folder.");
-    // Create a temporary file.
-    llvm::sys::path::append(TempPath, "cling-" + OutFile);
-    TempPath += "-" + getCurrentTimeAsString();
-    TempPath += "-%%%%%%%%";
-    int fd;
-    if (llvm::sys::fs::createUniqueFile(TempPath.str(), fd, TempPath)
-        != std::errc::no_such_file_or_directory) {
-      OS.reset(new llvm::raw_fd_ostream(fd, /*shouldClose=*/true));
-      OSFile = TempPath.str();
+    for (unsigned C = 0; C < kNumCategories; ++C) {
+      m_Contents[C].clear();
+      llvm::raw_string_ostream OS(m_Contents[C]);
+      switch (C) {
+      case kLookupTables:
+        printLookupTables(OS, m_ASTContext);
+        break;
+      case kIncludedFiles:
+        printIncludedFiles(OS, m_ASTContext.getSourceManager());
+        break;
+      case kAST:
+        printAST(OS, m_ASTContext);
+        break;
+      case kLLVMModule:
+        if (m_Module)
+          printLLVMModule(OS, *m_Module, *m_CodeGen);
+        break;
+      case kMacros:
+        printMacroDefinitions(OS, m_Preprocessor);
+        break;
+      }
+      OS.flush();
+      llvm::MD5 Hash;
+      Hash.update(m_Contents[C]);
+      Hash.final(m_Hashes[C]);
     }
-
-    // Make sure the out stream file gets removed if we crash.
-    if (RemoveFileOnSignal)
-      llvm::sys::RemoveFileOnSignal(OSFile);
-
-    if (TempPathName)
-      *TempPathName = OSFile;
-
-    return OS.release();
   }
 
   void ClangInternalState::compare(const std::string& name, bool verbose) {
@@ -161,16 +280,16 @@ namespace cling {
 
     builtinNames.push_back(".*__builtin.*");
 
-    differentContent(m_LookupTablesFile, m_DiffPair->m_LookupTablesFile,
-                     "lookup tables", verbose, &builtinNames);
+    differentContent(kLookupTables, *m_DiffPair, "lookup tables", verbose,
+                     &builtinNames);
 
     // We create a virtual file for each input line in the format input_line_N.
     llvm::SmallVector<llvm::StringRef, 2> input_lines;
     input_lines.push_back("input_line_[0-9].*");
-    differentContent(m_IncludedFilesFile, m_DiffPair->m_IncludedFilesFile,
-                     "included files", verbose, &input_lines);
+    differentContent(kIncludedFiles, *m_DiffPair, "included files", verbose,
+                     &input_lines);
 
-    differentContent(m_ASTFile, m_DiffPair->m_ASTFile, "AST", verbose);
+    differentContent(kAST, *m_DiffPair, "AST", verbose);
 
     if (m_Module) {
       assert(m_CodeGen && "Must have CodeGen set");
@@ -180,41 +299,45 @@ namespace cling {
         if (Func.isIntrinsic())
           builtinNames.emplace_back(Func.getName());
       }
-      differentContent(m_LLVMModuleFile, m_DiffPair->m_LLVMModuleFile,
-                       "llvm Module", verbose, &builtinNames);
+      differentContent(kLLVMModule, *m_DiffPair, "llvm Module", verbose,
+                       &builtinNames);
     }
 
-    differentContent(m_MacrosFile, m_DiffPair->m_MacrosFile,
-                     "Macro Definitions", verbose);
+    differentContent(kMacros, *m_DiffPair, "Macro Definitions", verbose);
   }
 
-  bool ClangInternalState::differentContent(const std::string& file1,
-                                            const std::string& file2,
+  bool ClangInternalState::differentContent(Category C,
+                                            const ClangInternalState& Other,
                                             const char* type,
                                             bool verbose,
             const llvm::SmallVectorImpl<llvm::StringRef>* ignores/*=0*/) const {
-
-    std::string diffCall = m_DiffCommand;
-    if (ignores) {
-      for (const llvm::StringRef& ignore : *ignores) {
-        diffCall += " --ignore-matching-lines=\".*";
-        diffCall += ignore;
-        diffCall += ".*\"";
-      }
-    }
-    diffCall += " ";
-    diffCall += file1;
-    diffCall += " ";
-    diffCall += file2;
-
-    llvm::SmallString<1024> Difs;
-    platform::Popen(diffCall, Difs);
-
     if (verbose)
-      cling::log() << diffCall << "\n";
+      cling::log() << "Comparing the " << (type ? type : "contents") << ": "
+                   << m_Hashes[C].digest() << " and "
+                   << Other.m_Hashes[C].digest() << "\n";
 
-    if (Difs.empty())
+    if (m_Hashes[C] == Other.m_Hashes[C])
+      return false;
+
+    // Lines, not what follows the last newline.
+    auto Split = [](llvm::StringRef Contents,
+                    llvm::SmallVectorImpl<llvm::StringRef>& Lines) {
+      if (Contents.endswith("\n"))
+        Contents = Contents.drop_back();
+      Contents.split(Lines, '\n');
+    };
+    llvm::SmallVector<llvm::StringRef, 1024> Old, New;
+    Split(m_Contents[C], Old);
+    Split(Other.m_Contents[C], New);
+    std::vector<Edit> Script;
+    diffLines(Old, New, Script);
+
+    std::string Difs;
+    llvm::raw_string_ostream OS(Difs);
+    OS << "--- " << m_Name << "\n+++ " << Other.m_Name << " (current)\n";
+    if (!printHunks(OS, Script, Old, New, LineIgnorer(ignores)))
       return false;
+    OS.flush();
 
     if (type) {
       cling::log() << "Differences in the " << type << ":\n";
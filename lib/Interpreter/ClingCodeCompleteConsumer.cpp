@@ -25,6 +25,7 @@ namespace cling {
     for (unsigned I = 0; I != NumResults; ++I) {
       if (!Filter.empty() && isResultFilteredOut(Filter, Results[I]))
         continue;
+      const size_t NumCompletions = m_Completions.size();
       switch (Results[I].Kind) {
         case CodeCompletionResult::RK_Declaration:
           if (CodeCompletionString *CCS
@@ -54,6 +55,25 @@ namespace cling {
           m_Completions.push_back(Results[I].Pattern->getAsString());
           break;
       }
+      if (m_Names && m_Completions.size() != NumCompletions)
+        m_Names->push_back(getFilterName(Results[I]));
+    }
+  }
+
+  std::string ClingCodeCompleteConsumer::getFilterName(
+                                    const CodeCompletionResult &Result) const {
+    switch (Result.Kind) {
+      case CodeCompletionResult::RK_Declaration:
+        if (const IdentifierInfo *II = Result.Declaration->getIdentifier())
+          return II->getName().str();
+        return std::string();
+      case CodeCompletionResult::RK_Keyword:
+        return Result.Keyword;
+      case CodeCompletionResult::RK_Macro:
+        return Result.Macro->getName().str();
+      case CodeCompletionResult::RK_Pattern:
+        return Result.Pattern->getAsString();
+      default: llvm_unreachable("Unknown code completion result Kind.");
     }
   }
 
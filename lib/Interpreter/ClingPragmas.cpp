@@ -15,16 +15,21 @@
 #include "cling/Utils/Paths.h"
 
 #include "clang/AST/ASTContext.h"
+#include "clang/Basic/SourceManager.h"
 #include "clang/Basic/TokenKinds.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Lex/HeaderSearch.h"
 #include "clang/Lex/LexDiagnostic.h"
+#include "clang/Lex/Lexer.h"
 #include "clang/Lex/LiteralSupport.h"
 #include "clang/Lex/Preprocessor.h"
 #include "clang/Lex/Token.h"
 #include "clang/Parse/Parser.h"
 #include "clang/Parse/ParseDiagnostic.h"
 
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <algorithm>
 #include <cstdlib>
 
 using namespace cling;
@@ -52,6 +57,8 @@ namespace {
       kLoadFile,
       kAddLibrary,
       kAddInclude,
+      kAddPointerChecks,
+      kOpenMP,
       // Put all commands that expand environment variables above this
       kExpandEnvCommands,
 
@@ -59,6 +66,9 @@ namespace {
       kArgumentsAreLiterals,
 
       kOptimize,
+      kPointerChecks,
+      kCUDAGraph,
+      kCUDA,
       kInvalidCommand,
     };
 
@@ -117,11 +127,50 @@ namespace {
         return kAddLibrary;
       else if (CommandStr == "add_include_path")
         return kAddInclude;
+      else if (CommandStr == "add_pointer_checks_path")
+        return kAddPointerChecks;
+      else if (CommandStr == "openmp")
+        return kOpenMP;
       else if (CommandStr == "optimize")
         return kOptimize;
+      else if (CommandStr == "pointer_checks")
+        return kPointerChecks;
+      else if (CommandStr == "cuda_graph")
+        return kCUDAGraph;
+      else if (CommandStr == "cuda")
+        return kCUDA;
       return kInvalidCommand;
     }
 
+    ///\brief Lets the handler parse declarations of its own, on the global
+    /// context and into a transaction of their own.
+    class ParseAtTopLevelRAII {
+      Parser::ParserCurTokRestoreRAII m_SavedCurToken;
+      Preprocessor::CleanupAndRestoreCacheRAII m_CleanupRAII;
+      Sema::ContextAndScopeRAII m_PushedDCAndS;
+      Interpreter::PushTransactionRAII m_PushedT;
+
+      static TranslationUnitDecl* getTU(Interpreter& Interp) {
+        return Interp.getCI()->getASTContext().getTranslationUnitDecl();
+      }
+
+    public:
+      // We can't PushDeclContext, because we go up and the routine that
+      // pops the DeclContext assumes that we drill down always.
+      // We have to be on the global context. At that point we are in a
+      // wrapper function so the parent context must be the global.
+      ParseAtTopLevelRAII(Interpreter& Interp, Preprocessor& PP):
+        m_SavedCurToken(Interp.getParser()), m_CleanupRAII(PP),
+        m_PushedDCAndS(Interp.getSema(), getTU(Interp),
+                       Interp.getSema().TUScope),
+        m_PushedT(&Interp) {
+        // After we have saved the token reset the current one to something
+        // which is safe (semi colon usually means empty decl)
+        Token& CurTok = const_cast<Token&>(Interp.getParser().getCurToken());
+        CurTok.setKind(tok::semi);
+      }
+    };
+
     void LoadCommand(Preprocessor& PP, Token& Tok, std::string Literal) {
       // No need to load libraries when not executing anything.
       if (m_Interp.isInSyntaxOnlyMode())
@@ -138,29 +187,16 @@ namespace {
       while (GetNextLiteral(PP, Tok, Literal, kLoadFile))
         FileInfos.push_back({std::move(Literal), Tok.getLocation()});
 
-      clang::Parser& P = m_Interp.getParser();
-      Parser::ParserCurTokRestoreRAII savedCurToken(P);
-      // After we have saved the token reset the current one to something
-      // which is safe (semi colon usually means empty decl)
-      Token& CurTok = const_cast<Token&>(P.getCurToken());
-      CurTok.setKind(tok::semi);
-
-      Preprocessor::CleanupAndRestoreCacheRAII cleanupRAII(PP);
-      // We can't PushDeclContext, because we go up and the routine that
-      // pops the DeclContext assumes that we drill down always.
-      // We have to be on the global context. At that point we are in a
-      // wrapper function so the parent context must be the global.
-      TranslationUnitDecl* TU =
-      m_Interp.getCI()->getASTContext().getTranslationUnitDecl();
-      Sema::ContextAndScopeRAII pushedDCAndS(m_Interp.getSema(),
-                                            TU, m_Interp.getSema().TUScope);
-      Interpreter::PushTransactionRAII pushedT(&m_Interp);
-
+      ParseAtTopLevelRAII parseAtTopLevel(m_Interp, PP);
+      // Loading in the background, the libraries load while the rest of the
+      // input is parsed.
+      const bool Async = m_Interp.getRuntimeOptions().AsyncLibraryLoads;
       for (const LibraryFileInfo& FI : FileInfos) {
         // FIXME: Consider the case where the library static init section has
         // a call to interpreter parsing header file. It will suffer the same
         // issue as if we included the file within the pragma.
-        if (m_Interp.loadLibrary(FI.FileName, true) != Interpreter::kSuccess) {
+        if (m_Interp.loadLibrary(FI.FileName, true, Async)
+            != Interpreter::kSuccess) {
           const clang::DirectoryLookup *CurDir = nullptr;
           if (PP.getHeaderSearchInfo().LookupFile(FI.FileName, FI.StartLoc,
               /*isAngled*/ false, /*fromDir*/ nullptr, /*CurDir*/ CurDir, /*Includers*/ {},
@@ -206,8 +242,130 @@ namespace {
         }
       } else
         CO.OptLevel = OptLevel;
+      // The level asked for, not one picked by `.O auto`.
+      CO.AutoOptLevel = 0;
   }
 
+    void PointerChecksCommand(const std::string& Mode) {
+      runtime::RuntimeOptions& Opts = m_Interp.getRuntimeOptions();
+      if (Mode == "signals")
+        Opts.SignalPointerChecks = 1;
+      else if (Mode == "calls")
+        Opts.SignalPointerChecks = 0;
+      else if (Mode == "input")
+        m_Interp.getOptions().ScopedPointerChecks = 1;
+      else if (Mode == "user")
+        m_Interp.getOptions().ScopedPointerChecks = 0;
+      else
+        cling::errs() << "cling::PHPointerChecks: "
+          "expected `signals`, `calls`, `input` or `user`, got `" << Mode
+          << "`\n";
+    }
+
+    ///\brief Puts the statement after the pragma into a region that captures
+    /// its kernel launches into a CUDA graph on its first run, and launches
+    /// the graph from then on; see Interpreter::enableCUDAGraphs().
+    void CUDAGraphCommand(Preprocessor& PP, Token& Tok) {
+      // The device compiler sees the statement as is.
+      if (m_Interp.getOptions().CompilerOpts.CUDADevice)
+        return;
+      if (Tok.isNot(tok::eod)) {
+        PP.Diag(Tok.getLocation(), diag::ext_pp_extra_tokens_at_eol)
+          << "pragma cling cuda_graph";
+        while (!Tok.isOneOf(tok::eod, tok::eof))
+          PP.LexUnexpandedToken(Tok);
+        if (Tok.is(tok::eof))
+          return;
+      }
+      bool Enabled;
+      {
+        ParseAtTopLevelRAII parseAtTopLevel(m_Interp, PP);
+        Enabled = m_Interp.enableCUDAGraphs();
+      }
+      if (!Enabled) {
+        cling::errs() << "cling::PHCUDAGraph: "
+          "not in CUDA mode, or the graph runtime cannot be compiled; "
+          "the statement runs uncaptured.\n";
+        return;
+      }
+
+      // Each region has a graph of its own: the static of its lambda.
+      static const char Region[]
+        = "for (::cling::runtime::internal::CUDAGraphRegion\n"
+          "       __cling_CUDAGraphRegion([]()\n"
+          "         -> ::cling::runtime::internal::CUDAGraph& {\n"
+          "           static ::cling::runtime::internal::CUDAGraph G;\n"
+          "           return G;\n"
+          "         }());\n"
+          "     __cling_CUDAGraphRegion.next();)\n";
+      SourceManager& SM = PP.getSourceManager();
+      FileID FID = SM.createFileID(
+          llvm::MemoryBuffer::getMemBuffer(Region, "<pragma cling cuda_graph>"),
+          SrcMgr::C_User, /*LoadedID*/0, /*LoadedOffset*/0,
+          Tok.getLocation());
+      Lexer RawLex(FID, SM.getBuffer(FID), SM, PP.getLangOpts());
+      SmallVector<Token, 64> Toks;
+      Token RawTok;
+      while (!RawLex.LexFromRawLexer(RawTok)) {
+        if (RawTok.is(tok::raw_identifier))
+          PP.LookUpIdentifierInfo(RawTok);
+        Toks.push_back(RawTok);
+      }
+      // The tokens come before the rest of the function, once the
+      // directive is done.
+      auto Stream = llvm::make_unique<Token[]>(Toks.size());
+      std::copy(Toks.begin(), Toks.end(), Stream.get());
+      PP.EnterTokenStream(std::move(Stream), Toks.size(),
+                          /*DisableMacroExpansion*/true, /*IsReinject*/false);
+    }
+
+    ///\brief `#pragma cling cuda optimize(N)` and `#pragma cling cuda
+    /// fast_math[(on|off)]` set how the CUDA device compiler compiles the
+    /// device code of the input; the host code is not affected.
+    void CUDACommand(Preprocessor& PP, Token& Tok) {
+      const CompilerOptions& CompilerOpts = m_Interp.getOptions().CompilerOpts;
+      PP.Lex(Tok);
+      if (Tok.isNot(tok::identifier)) {
+        PP.Diag(Tok.getLocation(), diag::err_expected)
+          << "optimize or fast_math";
+        return;
+      }
+      const StringRef Setting = Tok.getIdentifierInfo()->getName();
+      const bool IsOptimize = Setting == "optimize";
+      if (!IsOptimize && Setting != "fast_math") {
+        PP.Diag(Tok.getLocation(), diag::err_expected)
+          << "optimize or fast_math";
+        return;
+      }
+      std::string Literal;
+      const bool HasArg
+        = GetNextLiteral(PP, Tok, Literal, kOptimize, Setting.data());
+      if (IsOptimize && !HasArg) {
+        PP.Diag(Tok.getLocation(), diag::err_expected_after)
+          << "cuda optimize" << "argument";
+        return;
+      }
+      if (!IsOptimize && HasArg && Literal != "on" && Literal != "off") {
+        cling::errs() << "cling::PHCUDA: "
+          "expected `on` or `off`, got `" << Literal << "`\n";
+        return;
+      }
+      // The host interpreter leaves the setting to its device compiler.
+      if (!CompilerOpts.CUDADevice) {
+        if (!CompilerOpts.CUDAHost)
+          cling::errs() << "cling::PHCUDA: "
+            "not in CUDA mode, ignoring `#pragma cling cuda " << Setting
+            << "`\n";
+        return;
+      }
+      if (IsOptimize)
+        return OptimizeCommand(Literal.c_str());
+      auto T = const_cast<Transaction*>(m_Interp.getCurrentTransaction());
+      assert(T && "Parsing code without transaction!");
+      T->getTopmostParent()->getCompilationOpts().FastMath
+        = !HasArg || Literal == "on";
+    }
+
   public:
     ClingPragmaHandler(Interpreter& interp):
       PragmaHandler("cling"), m_Interp(interp) {}
@@ -238,7 +396,18 @@ namespace {
       }
 
       std::string Literal;
-      if (!GetNextLiteral(PP, Tok, Literal, Command, CommandStr.data())) {
+      // The runtime is optional for #pragma cling openmp, cuda_graph has
+      // no argument.
+      if (Command == kCUDAGraph) {
+        PP.Lex(Tok);
+        if (Tok.is(tok::r_paren))
+          PP.Lex(Tok);
+        return CUDAGraphCommand(PP, Tok);
+      }
+      if (Command == kCUDA)
+        return CUDACommand(PP, Tok);
+      if (!GetNextLiteral(PP, Tok, Literal, Command, CommandStr.data())
+          && Command != kOpenMP) {
         PP.Diag(Tok.getLocation(), diag::err_expected_after)
           << CommandStr << "argument";
         return;
@@ -247,8 +416,16 @@ namespace {
       switch (Command) {
         case kLoadFile:
         return LoadCommand(PP, Tok, std::move(Literal));
+        case kOpenMP:
+          m_Interp.loadOpenMPRuntime(Literal);
+          return;
         case kOptimize:
+          // The device code has #pragma cling cuda optimize.
+          if (m_Interp.getOptions().CompilerOpts.CUDADevice)
+            return;
           return OptimizeCommand(Literal.c_str());
+        case kPointerChecks:
+          return PointerChecksCommand(Literal);
 
         default:
           do {
@@ -256,6 +433,11 @@ namespace {
               m_Interp.getOptions().LibSearchPath.push_back(std::move(Literal));
             else if (Command == kAddInclude)
               m_Interp.AddIncludePath(Literal);
+            else if (Command == kAddPointerChecks) {
+              InvocationOptions& Opts = m_Interp.getOptions();
+              Opts.PointerChecksDirs.push_back(std::move(Literal));
+              Opts.ScopedPointerChecks = 1;
+            }
           } while (GetNextLiteral(PP, Tok, Literal, Command));
           break;
       }
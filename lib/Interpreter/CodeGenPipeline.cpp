@@ -0,0 +1,350 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "CodeGenPipeline.h"
+
+#include "BackendPasses.h"
+
+#include "cling/Utils/AST.h"
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalAlias.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+namespace {
+  ///\brief How many top-level declarations to handle between two looks
+  /// into the module, which go through all of its functions.
+  static constexpr unsigned kScanInterval = 16;
+
+  static bool refersToGlobals(const Constant& C) {
+    if (isa<GlobalValue>(C) || isa<BlockAddress>(C))
+      return true;
+    for (const Use& Op : C.operands())
+      if (refersToGlobals(*cast<Constant>(Op.get())))
+        return true;
+    return false;
+  }
+
+  ///\brief Whether a partition can refer to GV: by its name, or by a copy
+  /// of its own for a constant whose address nobody compares.
+  static bool canRefer(const GlobalValue& GV) {
+    if (isa<GlobalAlias>(GV) || isa<GlobalIFunc>(GV) || GV.isThreadLocal())
+      return false;
+    if (!GV.hasLocalLinkage())
+      return true;
+    const GlobalVariable* V = dyn_cast<GlobalVariable>(&GV);
+    return V && V->isConstant() && V->hasGlobalUnnamedAddr()
+      && V->hasInitializer() && !refersToGlobals(*V->getInitializer());
+  }
+
+  ///\brief Declares GV of another module in Part, or copies it there if it
+  /// is local, see canRefer().
+  static GlobalValue* declare(Module& Part, const GlobalValue& GV) {
+    if (const Function* F = dyn_cast<Function>(&GV)) {
+      Function* D = Function::Create(F->getFunctionType(),
+                                     GlobalValue::ExternalLinkage,
+                                     F->getAddressSpace(), F->getName(),
+                                     &Part);
+      D->copyAttributesFrom(F);
+      // Those would refer to the globals of the other module.
+      if (D->hasPersonalityFn())
+        D->setPersonalityFn(nullptr);
+      if (D->hasPrefixData())
+        D->setPrefixData(nullptr);
+      if (D->hasPrologueData())
+        D->setPrologueData(nullptr);
+      return D;
+    }
+    const GlobalVariable* V = cast<GlobalVariable>(&GV);
+    const bool Local = V->hasLocalLinkage();
+    GlobalVariable* D
+      = new GlobalVariable(Part, V->getValueType(), V->isConstant(),
+                           Local ? V->getLinkage()
+                                 : GlobalValue::ExternalLinkage,
+                           Local ? const_cast<Constant*>(V->getInitializer())
+                                 : nullptr,
+                           V->getName(), /*InsertBefore*/ nullptr,
+                           GlobalVariable::NotThreadLocal,
+                           V->getType()->getAddressSpace());
+    D->copyAttributesFrom(V);
+    return D;
+  }
+} // unnamed namespace
+
+namespace cling {
+
+CodeGenPipeline::CodeGenPipeline(const TargetMachine& TM,
+                                 unsigned PartitionSize):
+  m_Target(TM.getTarget()), m_Triple(TM.getTargetTriple().str()),
+  m_CPU(TM.getTargetCPU().str()),
+  m_Features(TM.getTargetFeatureString().str()), m_Options(TM.Options),
+  m_RelocModel(TM.getRelocationModel()), m_CodeModel(TM.getCodeModel()),
+  m_PartitionSize(PartitionSize) {}
+
+CodeGenPipeline::~CodeGenPipeline() {
+  // The workers write into the partitions.
+  if (m_Pool)
+    m_Pool->wait();
+}
+
+bool CodeGenPipeline::isCuttable(const Function& F,
+                                 std::vector<const GlobalValue*>& Uses) {
+  // The wrappers are looked up as the entry points of their transaction;
+  // what has debug info would need the compile unit along.
+  if (F.isDeclaration() || !F.hasExternalLinkage() || F.hasComdat()
+      || F.getSubprogram() || F.hasPrefixData() || F.hasPrologueData()
+      || F.getName().contains(utils::Synthesize::UniquePrefix))
+    return false;
+
+  SmallPtrSet<const Value*, 32> Visited;
+  SmallVector<const Value*, 32> Worklist;
+  auto Push = [&](const Value* V) {
+    if (const MetadataAsValue* MAV = dyn_cast<MetadataAsValue>(V))
+      if (const ValueAsMetadata* VAM
+            = dyn_cast<ValueAsMetadata>(MAV->getMetadata()))
+        V = VAM->getValue();
+    if (isa<Constant>(V) && Visited.insert(V).second)
+      Worklist.push_back(V);
+  };
+  if (F.hasPersonalityFn())
+    Push(F.getPersonalityFn());
+  for (const BasicBlock& BB : F)
+    for (const Instruction& I : BB)
+      for (const Use& Op : I.operands())
+        Push(Op.get());
+
+  while (!Worklist.empty()) {
+    const Value* V = Worklist.pop_back_val();
+    if (const GlobalValue* GV = dyn_cast<GlobalValue>(V)) {
+      if (GV == &F)
+        continue;
+      if (!canRefer(*GV))
+        return false;
+      Uses.push_back(GV);
+      continue;
+    }
+    for (const Use& Op : cast<Constant>(V)->operands())
+      Push(Op.get());
+  }
+  return true;
+}
+
+void CodeGenPipeline::collect(const Module& M, int OptLevel) {
+  if (m_Current.M != &M || m_Current.Name != M.getName()) {
+    m_Current = ModuleParts();
+    m_Current.M = &M;
+    m_Current.Name = M.getName().str();
+    m_Current.OptLevel = OptLevel;
+  } else if (m_Current.OptLevel != OptLevel)
+    return;
+  if (++m_Current.Decls % kScanInterval)
+    return;
+
+  std::vector<const GlobalValue*> Uses;
+  for (const Function& F : M) {
+    if (F.isDeclaration() || !m_Current.Seen.insert(&F).second)
+      continue;
+    Uses.clear();
+    if (isCuttable(F, Uses))
+      m_Current.Pending.push_back(F.getName().str());
+  }
+  if (m_Current.Pending.size() >= m_PartitionSize)
+    cut();
+}
+
+void CodeGenPipeline::cut() {
+  const Module& M = *m_Current.M;
+  // What clang emitted since might have replaced the declarations that the
+  // functions refer to.
+  std::vector<std::pair<const Function*, std::vector<const GlobalValue*>>>
+    Cut;
+  for (const std::string& Name : m_Current.Pending) {
+    const Function* F = M.getFunction(Name);
+    std::vector<const GlobalValue*> Uses;
+    if (F && isCuttable(*F, Uses))
+      Cut.emplace_back(F, std::move(Uses));
+  }
+  m_Current.Pending.clear();
+  if (Cut.empty())
+    return;
+
+  auto Part = std::make_shared<Partition>();
+  Module PM(M.getName().str() + ".part"
+            + std::to_string(m_Current.Parts.size()), M.getContext());
+  PM.setTargetTriple(M.getTargetTriple());
+  PM.setDataLayout(M.getDataLayout());
+
+  // The functions first: they keep their names only if nothing that refers
+  // to them declared them before.
+  ValueToValueMapTy VMap;
+  for (const auto& C : Cut) {
+    const Function* F = C.first;
+    Function* NF = Function::Create(F->getFunctionType(),
+                                    GlobalValue::ExternalLinkage,
+                                    F->getAddressSpace(), F->getName(), &PM);
+    NF->copyAttributesFrom(F);
+    VMap[F] = NF;
+    Part->Functions.push_back(F->getName().str());
+  }
+  for (const auto& C : Cut)
+    for (const GlobalValue* GV : C.second) {
+      if (VMap.count(GV))
+        continue;
+      VMap[GV] = declare(PM, *GV);
+      if (!GV->hasLocalLinkage())
+        Part->Uses.push_back(GV->getName().str());
+    }
+  for (const auto& C : Cut) {
+    const Function* F = C.first;
+    Function* NF = cast<Function>(VMap[F]);
+    Function::arg_iterator NewArg = NF->arg_begin();
+    for (const Argument& A : F->args()) {
+      NewArg->setName(A.getName());
+      VMap[&A] = &*NewArg++;
+    }
+    SmallVector<ReturnInst*, 8> Returns;
+    CloneFunctionInto(NF, F, VMap, /*ModuleLevelChanges*/ true, Returns);
+    // See IncrementalJIT::addModule().
+    NF->setSection("");
+  }
+
+  raw_svector_ostream BCOS(Part->Bitcode);
+  WriteBitcodeToFile(PM, BCOS);
+  m_Current.Parts.push_back(Part);
+
+  const int OptLevel = m_Current.OptLevel;
+  if (!m_Pool)
+    m_Pool.reset(new ThreadPool());
+  m_Pool->async([this, Part, OptLevel]() {
+    LLVMContext Ctx;
+    Expected<std::unique_ptr<Module>> PartM
+      = parseBitcodeFile(MemoryBufferRef(StringRef(Part->Bitcode.data(),
+                                                   Part->Bitcode.size()),
+                                         "<pipelined>"), Ctx);
+    if (!PartM) {
+      consumeError(PartM.takeError());
+      return;
+    }
+    static constexpr CodeGenOpt::Level CGOptLevel[] = {
+      CodeGenOpt::None, CodeGenOpt::Less, CodeGenOpt::Default,
+      CodeGenOpt::Aggressive
+    };
+    // A TargetMachine is not thread-safe; mirror the one of the JIT.
+    std::unique_ptr<TargetMachine> TM(m_Target.createTargetMachine(
+        m_Triple, m_CPU, m_Features, m_Options, m_RelocModel, m_CodeModel,
+        CGOptLevel[OptLevel], /*JIT*/ true));
+    TM->setGlobalISel(false);
+    (*PartM)->setDataLayout(TM->createDataLayout());
+    BackendPasses::runStandalone(**PartM, *TM, OptLevel);
+    Part->Object = llvm::orc::SimpleCompiler(*TM)(**PartM);
+  });
+}
+
+void CodeGenPipeline::release(const Module* M) {
+  if (M && M == m_Current.M && M->getName() == m_Current.Name
+      && !m_Current.Parts.empty())
+    m_Released = std::move(m_Current);
+  else
+    m_Released = ModuleParts();
+  m_Current = ModuleParts();
+}
+
+bool CodeGenPipeline::canReplace(const Module& M, const Partition& P) {
+  for (const std::string& Name : P.Functions) {
+    const Function* F = M.getFunction(Name);
+    if (!F || F->isDeclaration() || !F->hasExternalLinkage()
+        || F->hasComdat())
+      return false;
+  }
+  // An alias must not end up aliasing a declaration.
+  for (const GlobalAlias& A : M.aliases())
+    if (const GlobalObject* Base = A.getBaseObject())
+      if (std::find(P.Functions.begin(), P.Functions.end(), Base->getName())
+          != P.Functions.end())
+        return false;
+  return true;
+}
+
+bool CodeGenPipeline::hasPartitions(const Module& M) const {
+  return &M == m_Released.M && M.getName() == m_Released.Name;
+}
+
+void CodeGenPipeline::take(Module& M, int OptLevel, bool Use,
+                       std::vector<std::unique_ptr<MemoryBuffer>>& Objects) {
+  if (!hasPartitions(M))
+    return;
+  ModuleParts Released = std::move(m_Released);
+  m_Released = ModuleParts();
+  // The workers still busy with the partitions let go of them once done.
+  if (!Use || OptLevel != Released.OptLevel)
+    return;
+  m_Pool->wait();
+
+  std::vector<const std::string*> Uses;
+  bool Replaced = false;
+  for (const std::shared_ptr<Partition>& P : Released.Parts) {
+    if (!P->Object || !canReplace(M, *P))
+      continue;
+    for (const std::string& Name : P->Functions)
+      M.getFunction(Name)->deleteBody();
+    for (const std::string& Name : P->Uses)
+      Uses.push_back(&Name);
+    Objects.push_back(std::move(P->Object));
+    Replaced = true;
+  }
+  if (!Replaced)
+    return;
+
+  // Nothing in M might refer to the inline functions and the templates
+  // that the partitions call anymore; they must be emitted all the same.
+  std::vector<GlobalValue*> Used;
+  for (const std::string* Name : Uses) {
+    GlobalValue* GV = M.getNamedValue(*Name);
+    if (GV && !GV->isDeclaration() && GV->isDiscardableIfUnused()
+        && !GV->hasAvailableExternallyLinkage())
+      Used.push_back(GV);
+  }
+  if (!Used.empty())
+    appendToCompilerUsed(M, Used);
+  M.addModuleFlag(Module::Warning, getFlagName(), 1);
+}
+
+void CodeGenPipeline::waitIdle() {
+  if (m_Pool)
+    m_Pool->wait();
+}
+
+void CodeGenPipeline::onForked() {
+  // Destroying it would join threads that this process does not have.
+  m_Pool.release();
+  m_Current = ModuleParts();
+  m_Released = ModuleParts();
+}
+
+} // end namespace cling
@@ -0,0 +1,142 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_CODEGEN_PIPELINE_H
+#define CLING_CODEGEN_PIPELINE_H
+
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/CodeGen.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Target/TargetOptions.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+  class Function;
+  class GlobalValue;
+  class MemoryBuffer;
+  class Module;
+  class Target;
+  class TargetMachine;
+}
+
+namespace cling {
+  ///\brief Optimizes and compiles the functions of a large input while clang
+  /// still parses and emits the rest of it, if CLING_PIPELINE_CODEGEN is set
+  /// to the number of functions to compile together.
+  ///
+  /// After each top-level declaration, the functions that clang completed in
+  /// the module it emits are collected; once there are enough of them, they
+  /// are cloned into a partition, which travels as bitcode to a thread that
+  /// compiles it in an LLVMContext of its own, like the partitions of
+  /// IncrementalJIT::addModuleConcurrently() do. When the module gets to the
+  /// JIT, the objects of the partitions replace the bodies of their
+  /// functions, and the rest of the module refers to them.
+  ///
+  /// Only the functions with a strong external definition outside of a
+  /// comdat are cut, and only when they refer to nothing that is local to
+  /// the module, but for the constants they take along: their names are
+  /// then what links the objects together.
+  ///
+  class CodeGenPipeline {
+    struct Partition {
+      ///\brief The functions it defines.
+      std::vector<std::string> Functions;
+      ///\brief The globals of the module that it refers to.
+      std::vector<std::string> Uses;
+      llvm::SmallString<0> Bitcode;
+      ///\brief Set by the worker, none if the partition failed.
+      std::unique_ptr<llvm::MemoryBuffer> Object;
+    };
+
+    ///\brief The partitions cut from one module.
+    struct ModuleParts {
+      const llvm::Module* M = nullptr;
+      ///\brief Its name, which is unique: M might be the address of a
+      /// module that was freed.
+      std::string Name;
+      int OptLevel = 0;
+      ///\brief The number of top-level declarations seen.
+      unsigned Decls = 0;
+      ///\brief The definitions that were looked at already.
+      llvm::DenseSet<const llvm::Function*> Seen;
+      ///\brief The functions to cut into the next partition.
+      std::vector<std::string> Pending;
+      std::vector<std::shared_ptr<Partition>> Parts;
+    };
+
+    // The target of the JIT, to mirror on the workers.
+    const llvm::Target& m_Target;
+    std::string m_Triple;
+    std::string m_CPU;
+    std::string m_Features;
+    llvm::TargetOptions m_Options;
+    llvm::Reloc::Model m_RelocModel;
+    llvm::CodeModel::Model m_CodeModel;
+
+    ///\brief The number of functions per partition.
+    unsigned m_PartitionSize;
+    ///\brief The workers, started with the first partition.
+    std::unique_ptr<llvm::ThreadPool> m_Pool;
+
+    ///\brief What is cut from the module that clang emits.
+    ModuleParts m_Current;
+    ///\brief What was cut from the module that clang emitted last, until
+    /// it gets to the JIT.
+    ModuleParts m_Released;
+
+    ///\brief Whether F can be cut, collecting the globals it refers to.
+    static bool isCuttable(const llvm::Function& F,
+                           std::vector<const llvm::GlobalValue*>& Uses);
+
+    ///\brief Clones m_Current.Pending into a partition, and has it compiled.
+    void cut();
+
+    ///\brief Whether the functions of P are still what P compiled in M.
+    static bool canReplace(const llvm::Module& M, const Partition& P);
+
+  public:
+    CodeGenPipeline(const llvm::TargetMachine& TM, unsigned PartitionSize);
+    ~CodeGenPipeline();
+
+    ///\brief The flag of the modules whose functions were replaced by the
+    /// objects of their partitions.
+    static const char* getFlagName() { return "cling.pipelined"; }
+
+    ///\brief Looks for the functions completed in M, the module of clang's
+    /// code generator, once it handled a top-level declaration of an input
+    /// to be optimized at OptLevel.
+    void collect(const llvm::Module& M, int OptLevel);
+
+    ///\brief The module of clang's code generator was released: to the
+    /// transaction to be committed if M, or to be unloaded.
+    void release(const llvm::Module* M);
+
+    ///\brief Whether partitions were cut from M, which was released last.
+    bool hasPartitions(const llvm::Module& M) const;
+
+    ///\brief Waits for the partitions of M, the module that got to the JIT,
+    /// if it was released last and is to be optimized at OptLevel.
+    /// Unless !Use, the bodies of their functions are dropped from M, and
+    /// their objects appended to Objects.
+    void take(llvm::Module& M, int OptLevel, bool Use,
+              std::vector<std::unique_ptr<llvm::MemoryBuffer>>& Objects);
+
+    ///\brief Waits for the partitions being compiled, before a fork().
+    void waitIdle();
+
+    ///\brief The threads are gone in a child process, see
+    /// Interpreter::onForked().
+    void onForked();
+  };
+} // namespace cling
+
+#endif // CLING_CODEGEN_PIPELINE_H
@@ -0,0 +1,59 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "CompletionCache.h"
+
+#include "clang/Basic/CharInfo.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+namespace {
+  ///\brief Above this, the cache is cleared rather than grown: contexts are
+  /// typed by a user, and the recent ones are those completed again.
+  static const unsigned kMaxEntries = 64;
+}
+
+namespace cling {
+
+void CompletionCache::split(StringRef Line, size_t Cursor, StringRef& Context,
+                            StringRef& Prefix) {
+  Cursor = std::min(Cursor, Line.size());
+  size_t Begin = Cursor;
+  while (Begin && clang::isIdentifierBody(Line[Begin - 1]))
+    --Begin;
+  Context = Line.substr(0, Begin);
+  Prefix = Line.substr(Begin, Cursor - Begin);
+}
+
+const CompletionCache::Entry*
+CompletionCache::find(StringRef Context) const {
+  auto I = m_Entries.find(getKey(Context));
+  if (I == m_Entries.end())
+    return nullptr;
+  return &I->second;
+}
+
+const CompletionCache::Entry& CompletionCache::insert(StringRef Context,
+                                                      Entry E) {
+  if (m_Entries.size() >= kMaxEntries)
+    m_Entries.clear();
+  Entry& Cached = m_Entries[getKey(Context)];
+  Cached = std::move(E);
+  return Cached;
+}
+
+void CompletionCache::filter(const Entry& E, StringRef Prefix,
+                             std::vector<std::string>& Completions) {
+  for (size_t I = 0, N = E.Completions.size(); I < N; ++I)
+    if (StringRef(E.Names[I]).startswith(Prefix))
+      Completions.push_back(E.Completions[I]);
+}
+
+} // end namespace cling
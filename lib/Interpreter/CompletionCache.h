@@ -0,0 +1,66 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_COMPLETION_CACHE_H
+#define CLING_COMPLETION_CACHE_H
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+#include <vector>
+
+namespace cling {
+
+  ///\brief The completions of Interpreter::codeComplete(), by the code
+  /// before the identifier being completed.
+  ///
+  /// What Sema proposes depends on that code and on the AST only, not on the
+  /// part of the identifier typed so far. The completions are thus computed
+  /// once per context and filtered as the user types on; the interpreter
+  /// clears the cache whenever a transaction is committed or unloaded.
+  ///
+  class CompletionCache {
+  public:
+    struct Entry {
+      std::vector<std::string> Completions;
+      ///\brief The name each of Completions is filtered by.
+      std::vector<std::string> Names;
+    };
+
+  private:
+    llvm::StringMap<Entry> m_Entries;
+
+    static llvm::StringRef getKey(llvm::StringRef Context) {
+      // Leading whitespace changes nothing; this gives all inputs completed
+      // at the start of a statement the same entry.
+      return Context.ltrim();
+    }
+
+  public:
+    ///\brief Splits Line at Cursor into the code before the identifier that
+    /// is being completed, and the part of the identifier before Cursor.
+    static void split(llvm::StringRef Line, size_t Cursor,
+                      llvm::StringRef& Context, llvm::StringRef& Prefix);
+
+    ///\brief The completions of Context, or null if they are not cached.
+    const Entry* find(llvm::StringRef Context) const;
+
+    ///\brief Caches the completions of Context.
+    const Entry& insert(llvm::StringRef Context, Entry E);
+
+    ///\brief Appends those of E's completions whose names start with
+    /// Prefix to Completions.
+    static void filter(const Entry& E, llvm::StringRef Prefix,
+                       std::vector<std::string>& Completions);
+
+    void clear() { m_Entries.clear(); }
+  };
+} // end namespace cling
+
+#endif // CLING_COMPLETION_CACHE_H
@@ -10,6 +10,7 @@
 #include "DeclCollector.h"
 
 #include "IncrementalParser.h"
+#include "PhaseTimers.h"
 #include "cling/Interpreter/Transaction.h"
 #include "cling/Utils/AST.h"
 
@@ -131,6 +132,10 @@ namespace cling {
   // pin the vtable here.
   DeclCollector::~DeclCollector() { }
 
+  PhaseTimers* DeclCollector::getTimers() const {
+    return m_IncrParser ? &m_IncrParser->getPhaseTimers() : nullptr;
+  }
+
  ASTTransformer::Result DeclCollector::TransformDecl(Decl* D) const {
     // We are sure it's safe to pipe it through the transformers
     // Consume late transformers init
@@ -172,6 +177,9 @@ namespace cling {
       ~TransformingRAII() { m_Transforming = false; }
     } transformingUpdater(m_Transforming);
 
+    PhaseTimers::Scope Timer(getTimers(), TimingStats::kASTTransformers,
+                             m_CurTransaction);
+
     llvm::SmallVector<Decl*, 4> ReplacedDecls;
     bool HaveReplacement = false;
     for (Decl* D: DGR) {
@@ -206,6 +214,8 @@ namespace cling {
     if (getTransaction()->getIssuedDiags() == Transaction::kErrors)
       return true;
 
+    PhaseTimers::Scope Timer(getTimers(), TimingStats::kCodeGen,
+                             m_CurTransaction);
     if (comesFromASTReader(DGR)) {
       for (DeclGroupRef::iterator DI = DGR.begin(), DE = DGR.end();
            DI != DE; ++DI) {
@@ -254,8 +264,11 @@ namespace cling {
     Transaction::DelayCallInfo DCI(DGR, Transaction::kCCIHandleInterestingDecl);
     m_CurTransaction->append(DCI);
     if (m_Consumer
-        && (!comesFromASTReader(DGR) || !shouldIgnore(*DGR.begin())))
+        && (!comesFromASTReader(DGR) || !shouldIgnore(*DGR.begin()))) {
+      PhaseTimers::Scope Timer(getTimers(), TimingStats::kCodeGen,
+                               m_CurTransaction);
       m_Consumer->HandleTopLevelDecl(DGR);
+    }
   }
 
   void DeclCollector::HandleTagDeclDefinition(TagDecl* TD) {
@@ -269,8 +282,11 @@ namespace cling {
     }
     if (m_Consumer
         && (!comesFromASTReader(DeclGroupRef(TD))
-            || !shouldIgnore(TD)))
+            || !shouldIgnore(TD))) {
+      PhaseTimers::Scope Timer(getTimers(), TimingStats::kCodeGen,
+                               m_CurTransaction);
       m_Consumer->HandleTagDeclDefinition(TD);
+    }
   }
 
   void DeclCollector::HandleVTable(CXXRecordDecl* RD) {
@@ -281,8 +297,11 @@ namespace cling {
 
     if (m_Consumer
         && (!comesFromASTReader(DeclGroupRef(RD))
-            || !shouldIgnore(RD)))
+            || !shouldIgnore(RD))) {
+      PhaseTimers::Scope Timer(getTimers(), TimingStats::kCodeGen,
+                               m_CurTransaction);
       m_Consumer->HandleVTable(RD);
+    }
     // Intentional no-op. It comes through Sema::DefineUsedVTables, which
     // comes either Sema::ActOnEndOfTranslationUnit or while instantiating a
     // template. In our case we will do it on transaction commit, without
@@ -300,8 +319,11 @@ namespace cling {
     m_CurTransaction->append(DCI);
     if (m_Consumer
         && (!comesFromASTReader(DeclGroupRef(VD))
-            || !shouldIgnore(VD)))
-    m_Consumer->CompleteTentativeDefinition(VD);
+            || !shouldIgnore(VD))) {
+      PhaseTimers::Scope Timer(getTimers(), TimingStats::kCodeGen,
+                               m_CurTransaction);
+      m_Consumer->CompleteTentativeDefinition(VD);
+    }
   }
 
   void DeclCollector::HandleTranslationUnit(ASTContext& /*Ctx*/) {
@@ -316,8 +338,33 @@ namespace cling {
     m_CurTransaction->append(DCI);
     if (m_Consumer
         && (!comesFromASTReader(DeclGroupRef(D))
-            || !shouldIgnore(D)))
-    m_Consumer->HandleCXXImplicitFunctionInstantiation(D);
+            || !shouldIgnore(D))) {
+      PhaseTimers::Scope Timer(getTimers(), TimingStats::kCodeGen,
+                               m_CurTransaction);
+      m_Consumer->HandleCXXImplicitFunctionInstantiation(D);
+    }
+  }
+
+  void DeclCollector::HandleReloadedDefinition(FunctionDecl* FD) {
+    assertHasTransaction(m_CurTransaction);
+    // The new body goes through the transformers as the old one did, e.g.
+    // for the checks of the pointers it dereferences.
+    DeclGroupRef DGR(FD);
+    if (!Transform(DGR)) {
+      m_CurTransaction->setIssuedDiags(Transaction::kErrors);
+      return;
+    }
+    if (DGR.isNull())
+      return;
+    Transaction::DelayCallInfo DCI(DGR,
+                                   Transaction::kCCIHandleReloadedDefinition);
+    m_CurTransaction->append(DCI);
+    if (m_Consumer
+        && getTransaction()->getIssuedDiags() != Transaction::kErrors) {
+      PhaseTimers::Scope Timer(getTimers(), TimingStats::kCodeGen,
+                               m_CurTransaction);
+      m_Consumer->HandleTopLevelDecl(DGR);
+    }
   }
 
   void DeclCollector::HandleCXXStaticMemberVarInstantiation(VarDecl *D) {
@@ -327,8 +374,11 @@ namespace cling {
     m_CurTransaction->append(DCI);
     if (m_Consumer
         && (!comesFromASTReader(DeclGroupRef(D))
-            || !shouldIgnore(D)))
-    m_Consumer->HandleCXXStaticMemberVarInstantiation(D);
+            || !shouldIgnore(D))) {
+      PhaseTimers::Scope Timer(getTimers(), TimingStats::kCodeGen,
+                               m_CurTransaction);
+      m_Consumer->HandleCXXStaticMemberVarInstantiation(D);
+    }
   }
 
 } // namespace cling
@@ -32,6 +32,7 @@ namespace cling {
   class WrapperTransformer;
   class DeclCollector;
   class IncrementalParser;
+  class PhaseTimers;
   class Transaction;
 
   ///\brief Collects declarations and fills them in cling::Transaction.
@@ -67,6 +68,9 @@ namespace cling {
 
     bool Transform(clang::DeclGroupRef& DGR);
 
+    ///\brief The timers of the IncrementalParser, if set up.
+    PhaseTimers* getTimers() const;
+
     ///\brief Runs AST transformers on a transaction.
     ///
     ///\param[in] D - the decl to be transformed.
@@ -103,6 +107,28 @@ namespace cling {
     void HandleCXXStaticMemberVarInstantiation(clang::VarDecl *D) final;
     /// \}
 
+    ///\brief Codegens FD, whose body got parsed anew, without transforming
+    /// it; see Interpreter::reloadFile().
+    void HandleReloadedDefinition(clang::FunctionDecl* FD);
+
+    ///\brief Tells the transformers that the lazily declared parts of the
+    /// runtime universe got unloaded, see ASTTransformer::ForgetRuntime().
+    void ForgetRuntime() {
+      for (auto&& TT: m_TransactionTransformers)
+        TT->ForgetRuntime();
+      for (auto&& WT: m_WrapperTransformers)
+        WT->ForgetRuntime();
+    }
+
+    ///\brief Tells the transformers that T is about to be unloaded, see
+    /// ASTTransformer::TransactionUnloading().
+    void TransactionUnloading(const Transaction& T) {
+      for (auto&& TT: m_TransactionTransformers)
+        TT->TransactionUnloading(T);
+      for (auto&& WT: m_WrapperTransformers)
+        WT->TransactionUnloading(T);
+    }
+
     /// \{
     /// \name Transaction Support
 
@@ -19,6 +19,8 @@
 #include "clang/Sema/Sema.h"
 #include "clang/Sema/SemaDiagnostic.h"
 
+#include <memory>
+
 using namespace clang;
 
 namespace {
@@ -38,6 +40,19 @@ namespace {
     }
   }
 
+  ///\brief Whether the body declares something that DeclExtractor moves out.
+  static bool hasExtractableDecls(const CompoundStmt* CS) {
+    for (const Stmt* S : CS->body()) {
+      const DeclStmt* DS = dyn_cast<DeclStmt>(S);
+      if (!DS)
+        continue;
+      for (const Decl* D : DS->decls())
+        if (isa<NamedDecl>(D) && !isa<UsingDirectiveDecl>(D))
+          return true;
+    }
+    return false;
+  }
+
   static void clearLinkage(NamedDecl *ND) {
     BreakProtection::resetCachedLinkage(ND);
     if (const CXXRecordDecl* CXXRD = dyn_cast<CXXRecordDecl>(ND))
@@ -117,9 +132,25 @@ namespace cling {
     Scope* TUScope = m_Sema->TUScope;
     llvm::SmallVector<Stmt*, 4> Stmts;
 
-    if (CS->body_empty())
+    // Most wrappers are statements only: leave them as they are.
+    if (!hasExtractableDecls(CS))
       return FD;
 
+    // The decls of the body are in the wrapper and, while it is being parsed,
+    // in its scope.
+    Scope* WrapperScope = m_Sema->getScopeForContext(FD);
+
+    // The decls extracted since the last statement; they are emitted as one
+    // group, before the wrapper of the statements that follow them.
+    llvm::SmallVector<Decl*, 16> Extracted;
+    auto emitExtracted = [&]() {
+      if (Extracted.empty())
+        return;
+      Emit(DeclGroupRef::Create(*m_Context, Extracted.data(),
+                                Extracted.size()));
+      Extracted.clear();
+    };
+
     for (CompoundStmt::body_iterator I = CS->body_begin(), EI = CS->body_end();
          I != EI; ++I) {
       DeclStmt* DS = dyn_cast<DeclStmt>(*I);
@@ -136,16 +167,15 @@ namespace cling {
         if (ND) {
           if (Stmts.size()) {
             // We need to emit a new custom wrapper wrapping the stmts
+            emitExtracted();
             EnforceInitOrder(Stmts);
             assert(!Stmts.size() && "Stmt list must be flushed.");
           }
 
-          DeclContext* OldDC = ND->getDeclContext();
-
           // Make sure the decl is not found at its old possition
           ND->getLexicalDeclContext()->removeDecl(ND);
-          if (Scope* S = m_Sema->getScopeForContext(OldDC)) {
-            S->RemoveDecl(ND);
+          if (WrapperScope) {
+            WrapperScope->RemoveDecl(ND);
             if (utils::Analyze::isOnScopeChains(ND, *m_Sema))
               m_Sema->IdResolver.RemoveDecl(ND);
           }
@@ -166,28 +196,39 @@ namespace cling {
           ND->setDeclContext(NewDC);
 
           if (VarDecl* VD = dyn_cast<VarDecl>(ND)) {
-            if (!ValidateCXXRecord(VD))
+            if (!ValidateCXXRecord(VD)) {
+              emitExtracted();
               return false;
+            }
             VD->setStorageClass(SC_None);
           }
 
           clearLinkage(ND);
 
           TouchedDecls.push_back(ND);
-
-          Emit(DeclGroupRef(ND));
+          Extracted.push_back(ND);
         }
       }
     }
+    emitExtracted();
+
     bool hasNoErrors = !CheckForClashingNames(TouchedDecls, WrapperDC);
     if (hasNoErrors) {
+      // The decls go to WrapperDC or, the tags, to the TU: switch the context
+      // only where it changes.
+      DeclContext* CurDC = nullptr;
+      std::unique_ptr<Sema::ContextRAII> RAII;
       for (size_t i = 0; i < TouchedDecls.size(); ++i) {
         // We should skip the checks for annonymous decls and we should not
         // register them in the lookup.
         if (!TouchedDecls[i]->getDeclName())
           continue;
 
-        Sema::ContextRAII RAII(*m_Sema, TouchedDecls[i]->getDeclContext());
+        if (TouchedDecls[i]->getDeclContext() != CurDC) {
+          CurDC = TouchedDecls[i]->getDeclContext();
+          RAII.reset();
+          RAII.reset(new Sema::ContextRAII(*m_Sema, CurDC));
+        }
         m_Sema->PushOnScopeChains(TouchedDecls[i],
                                   TUScope,
                     /*AddCurContext*/!isa<UsingDirectiveDecl>(TouchedDecls[i]));
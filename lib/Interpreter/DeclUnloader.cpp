@@ -29,6 +29,8 @@
 namespace cling {
 using namespace clang;
 
+std::atomic<unsigned> DeclUnloader::s_Generation(0);
+
 ///\brief Return whether `D' is a template that was first instantiated non-
 /// locally, i.e. in a PCH/module. If `D' is not an instantiation, return false.
 bool DeclUnloader::isInstantiatedInPCH(const Decl *D) {
@@ -372,6 +374,82 @@ bool DeclUnloader::VisitRedeclarable(clang::Redeclarable<T>* R, DeclContext* DC)
     }
   };
 
+  namespace {
+    ///\brief Gives access to the ends of the lexical decl chain, protected
+    /// members.
+    struct DeclChainAccess : public DeclContext {
+      static Decl*& getFirstDecl(DeclContext* DC) {
+        return DC->*(&DeclChainAccess::FirstDecl);
+      }
+      static Decl* getLastDecl(const DeclContext* DC) {
+        return DC->*(&DeclChainAccess::LastDecl);
+      }
+    };
+  }
+
+  Decl* DeclUnloader::getLastDecl(const DeclContext* DC) {
+    return DeclChainAccess::getLastDecl(DC);
+  }
+
+  void DeclUnloader::setCheckpoint(DeclContext* DC, Decl* Last) {
+    if (DC == m_CheckpointDC && Last == m_Checkpoint)
+      return;
+    // An index of the chain after the previous checkpoint would miss decls.
+    if (m_CheckpointDC)
+      m_PrevDecls.erase(m_CheckpointDC);
+    m_CheckpointDC = DC;
+    m_Checkpoint = Last;
+  }
+
+  void DeclUnloader::removeFromDeclContext(DeclContext* DC, Decl* D) {
+    // The unloaded decls of DC follow the checkpoint, if it is still there.
+    Decl* Start = nullptr;
+    if (DC == m_CheckpointDC && m_Checkpoint && DC->containsDecl(m_Checkpoint))
+      Start = m_Checkpoint;
+
+    auto IPrev = m_PrevDecls.find(DC);
+    if (IPrev == m_PrevDecls.end() && !Start) {
+      // A single removal is not worth the index; remember DC for the next.
+      m_PrevDecls[DC];
+      DC->removeDecl(D);
+      return;
+    }
+
+    PrevDecls& Prev = m_PrevDecls[DC];
+    Decl*& First = DeclChainAccess::getFirstDecl(DC);
+    if (Prev.empty()) {
+      // Walk the chain as stored: decls_begin() would deserialize. Only the
+      // decls added since the checkpoint are worth an index.
+      Decl* P = Start;
+      for (Decl* I = Start ? Start->getNextDeclInContext() : First; I;
+           P = I, I = I->getNextDeclInContext())
+        Prev[I] = P;
+    }
+
+    auto I = Prev.find(D);
+    Decl* P = I != Prev.end() ? I->second : nullptr;
+    if (I == Prev.end() || (P ? P->getNextDeclInContext() != D : First != D)) {
+      // The chain changed behind our back; rebuild the index next time.
+      Prev.clear();
+      DC->removeDecl(D);
+      return;
+    }
+
+    Decl* Next = D->getNextDeclInContext();
+    Prev.erase(I);
+    if (Next)
+      Prev[Next] = P;
+    if (!P) {
+      DC->removeDecl(D); // Constant time for the first decl.
+      return;
+    }
+    // Let removeDecl() start its search right before D.
+    Decl* SavedFirst = First;
+    First = P;
+    DC->removeDecl(D);
+    First = SavedFirst;
+  }
+
   DeclUnloader::~DeclUnloader() {
     SourceManager& SM = m_Sema->getSourceManager();
     for (FileIDs::iterator I = m_FilesToUncache.begin(),
@@ -398,7 +476,7 @@ bool DeclUnloader::VisitRedeclarable(clang::Redeclarable<T>* R, DeclContext* DC)
     DeclContext* DC = D->getLexicalDeclContext();
 
     if (DC->containsDecl(D))
-      DC->removeDecl(D);
+      removeFromDeclContext(DC, D);
 
     // With the bump allocator this is a no-op.
     m_Sema->getASTContext().Deallocate(D);
@@ -574,6 +652,9 @@ bool DeclUnloader::VisitRedeclarable(clang::Redeclarable<T>* R, DeclContext* DC)
         MaybeRemoveDeclFromModule(GD);
       }
     }
+    // The tokens of a body that was not parsed yet, see DeferredBodies.
+    m_Sema->LateParsedTemplateMap.erase(FD);
+
     // VisitRedeclarable() will mess around with this!
     bool wasCanonical = FD->isCanonicalDecl();
     // FunctionDecl : DeclaratiorDecl, DeclContext, Redeclarable
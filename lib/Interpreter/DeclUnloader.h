@@ -14,6 +14,9 @@
 
 #include "clang/AST/DeclVisitor.h"
 
+#include "llvm/ADT/DenseMap.h"
+
+#include <atomic>
 
 namespace clang {
   class CodeGenerator;
@@ -49,11 +52,52 @@ namespace cling {
     ///
     FileIDs m_FilesToUncache;
 
+    typedef llvm::DenseMap<clang::Decl*, clang::Decl*> PrevDecls;
+
+    ///\brief The predecessor of each declaration in the lexical chain of the
+    /// DeclContexts declarations were removed from more than once: clang's
+    /// removeDecl() walks the chain from its start to find it, which makes
+    /// unloading many declarations of a large context quadratic.
+    ///
+    llvm::DenseMap<clang::DeclContext*, PrevDecls> m_PrevDecls;
+
+    ///\brief A DeclContext whose declarations up to m_Checkpoint predate the
+    /// transactions being unloaded, see setCheckpoint().
+    ///
+    clang::DeclContext* m_CheckpointDC = nullptr;
+    clang::Decl* m_Checkpoint = nullptr;
+
+    ///\brief Incremented by each unloaded declaration, see getGeneration().
+    ///
+    static std::atomic<unsigned> s_Generation;
+
+    ///\brief Removes D from the lexical chain of DC, and from the lookup
+    /// table of its semantic context.
+    ///
+    void removeFromDeclContext(clang::DeclContext* DC, clang::Decl* D);
+
   public:
     DeclUnloader(clang::Sema* S, clang::CodeGenerator* CG, const Transaction* T)
       : m_Sema(S), m_CodeGen(CG), m_CurTransaction(T) { }
     ~DeclUnloader();
 
+    ///\brief Continue with the declarations of another transaction, e.g. the
+    /// previous one when unloading several.
+    ///
+    void setTransaction(const Transaction* T) { m_CurTransaction = T; }
+
+    ///\brief Declares that the declarations to remove from DC all come after
+    /// Last, e.g. the last declaration of the translation unit when the
+    /// transaction began: finding them then only walks the declarations added
+    /// since, not the whole context. Ignored once Last is not in DC anymore.
+    ///
+    void setCheckpoint(clang::DeclContext* DC, clang::Decl* Last);
+
+    ///\brief The current end of the lexical chain of DC, without loading
+    /// the declarations of an external source; for setCheckpoint().
+    ///
+    static clang::Decl* getLastDecl(const clang::DeclContext* DC);
+
     ///\brief Forwards to Visit(), excluding PCH declarations (known to cause
     /// problems).  If unsure, call this function instead of plain `Visit()'.
     ///\param[in] D - The declaration to unload
@@ -62,9 +106,16 @@ namespace cling {
     bool UnloadDecl(clang::Decl* D) {
       if (D->isFromASTFile() || isInstantiatedInPCH(D))
         return true;
+      ++s_Generation;
       return Visit(D);
     }
 
+    ///\brief Returns a counter that changes whenever a declaration is
+    /// unloaded, by any DeclUnloader. Caches of declarations, e.g. the
+    /// LookupHelper's, compare it to know when they must be flushed.
+    ///
+    static unsigned getGeneration() { return s_Generation; }
+
     ///\brief If it falls back in the base class just remove the declaration
     /// only from the declaration context.
     /// @param[in] D - The declaration to be removed.
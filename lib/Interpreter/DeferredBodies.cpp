@@ -0,0 +1,90 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "DeferredBodies.h"
+
+#include "cling/Interpreter/InvocationOptions.h"
+
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
+using namespace clang;
+
+namespace {
+  static void getRealPath(llvm::StringRef Path,
+                          llvm::SmallVectorImpl<char>& Real) {
+    if (llvm::sys::fs::real_path(Path, Real)) {
+      Real.assign(Path.begin(), Path.end());
+      llvm::sys::fs::make_absolute(Real);
+    }
+  }
+} // unnamed namespace
+
+namespace cling {
+  DeferredBodies::DeferredBodies(CompilerInstance& CI, bool SystemHeaders,
+                                 const std::vector<std::string>& Dirs):
+    m_SM(CI.getSourceManager()), m_LangOpts(CI.getLangOpts()),
+    m_SystemHeaders(SystemHeaders) {
+    for (const std::string& Dir : Dirs) {
+      llvm::SmallString<256> Real;
+      getRealPath(Dir, Real);
+      if (!llvm::sys::path::is_separator(Real.back()))
+        Real += llvm::sys::path::get_separator();
+      m_Dirs.push_back(Real.str());
+    }
+  }
+
+  std::unique_ptr<DeferredBodies>
+  DeferredBodies::create(const InvocationOptions& Opts,
+                         CompilerInstance& CI) {
+    if ((!Opts.DeferSystemBodies && Opts.DeferBodiesDirs.empty())
+        || CI.getLangOpts().DelayedTemplateParsing)
+      return nullptr;
+    return std::unique_ptr<DeferredBodies>(
+      new DeferredBodies(CI, Opts.DeferSystemBodies, Opts.DeferBodiesDirs));
+  }
+
+  bool DeferredBodies::isDeferred(SourceLocation Loc,
+                                  SrcMgr::CharacteristicKind FileType) {
+    if (m_SystemHeaders && SrcMgr::isSystem(FileType))
+      return true;
+    if (m_Dirs.empty())
+      return false;
+    const FileEntry* FE
+      = m_SM.getFileEntryForID(m_SM.getFileID(m_SM.getExpansionLoc(Loc)));
+    // The inputs have no file (their buffers are virtual files of the
+    // FileManager, named input_line_N, without a real path).
+    if (!FE || FE->tryGetRealPathName().empty())
+      return false;
+    auto Known = m_InDirs.find(FE);
+    if (Known != m_InDirs.end())
+      return Known->second;
+    llvm::SmallString<256> Real;
+    getRealPath(FE->tryGetRealPathName(), Real);
+    bool& InDirs = m_InDirs[FE];
+    for (const std::string& Dir : m_Dirs)
+      if ((InDirs = Real.startswith(Dir)))
+        break;
+    return InDirs;
+  }
+
+  void DeferredBodies::FileChanged(SourceLocation Loc, FileChangeReason Reason,
+                                   SrcMgr::CharacteristicKind FileType,
+                                   FileID /*PrevFID*/) {
+    // Loc is in the file entered, or the one returned to.
+    if (Reason != EnterFile && Reason != ExitFile)
+      return;
+    m_LangOpts.DelayedTemplateParsing = isDeferred(Loc, FileType);
+  }
+} // end namespace cling
@@ -0,0 +1,73 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_DEFERRED_BODIES_H
+#define CLING_DEFERRED_BODIES_H
+
+#include "clang/Lex/PPCallbacks.h"
+
+#include "llvm/ADT/DenseMap.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace clang {
+  class CompilerInstance;
+  class FileEntry;
+  class LangOptions;
+  class SourceManager;
+}
+
+namespace cling {
+  class InvocationOptions;
+
+  ///\brief Delays the parsing of the function template bodies of selected
+  /// headers until they get instantiated, see --defer-bodies.
+  ///
+  /// The parser stores the tokens of a function template's body instead of
+  /// parsing it while LangOptions::DelayedTemplateParsing is set: this sets it
+  /// while the preprocessor is in a selected header, and resets it in the
+  /// other files, such that the inputs keep two-phase lookup. Bodies that are
+  /// never instantiated are never parsed nor checked. Non-template functions
+  /// are parsed as usual: codegen might need them without any use in sight.
+  ///
+  class DeferredBodies : public clang::PPCallbacks {
+    const clang::SourceManager& m_SM;
+    clang::LangOptions& m_LangOpts;
+
+    ///\brief Whether to defer the bodies of all system headers.
+    bool m_SystemHeaders;
+
+    ///\brief The directories whose headers' bodies are deferred, real paths
+    /// ending in a separator.
+    std::vector<std::string> m_Dirs;
+
+    ///\brief Whether a file is under one of m_Dirs.
+    llvm::DenseMap<const clang::FileEntry*, bool> m_InDirs;
+
+    DeferredBodies(clang::CompilerInstance& CI, bool SystemHeaders,
+                   const std::vector<std::string>& Dirs);
+
+    bool isDeferred(clang::SourceLocation Loc,
+                    clang::SrcMgr::CharacteristicKind FileType);
+
+  public:
+    ///\brief Creates the callbacks for the preprocessor of CI if Opts
+    /// select headers, returns null otherwise, or if all bodies are delayed
+    /// already, e.g. with -fdelayed-template-parsing.
+    static std::unique_ptr<DeferredBodies>
+    create(const InvocationOptions& Opts, clang::CompilerInstance& CI);
+
+    void FileChanged(clang::SourceLocation Loc, FileChangeReason Reason,
+                     clang::SrcMgr::CharacteristicKind FileType,
+                     clang::FileID PrevFID) override;
+  };
+} // end namespace cling
+
+#endif // CLING_DEFERRED_BODIES_H
@@ -16,7 +16,6 @@
 #include "clang/AST/Decl.h"
 #include "clang/AST/DeclContextInternals.h"
 #include "clang/AST/Stmt.h"
-#include "clang/Sema/Lookup.h"
 #include "clang/Sema/Sema.h"
 
 #include <algorithm>
@@ -70,7 +69,7 @@ namespace cling {
     return NS && NS->getName().startswith("__cling_N5");
   }
 
-  void DefinitionShadower::hideDecl(clang::NamedDecl *D) const {
+  void DefinitionShadower::hideDecl(clang::NamedDecl *D) {
     // FIXME: this hides a decl from SemaLookup (there is no unloading). For
     // (large) L-values, this might be a memory leak. Should this be fixed?
     if (Scope* S = m_Sema->getScopeForContext(m_TU)) {
@@ -89,18 +88,27 @@ namespace cling {
                  Vec->end());
     }
 
+    if (isClingShadowNamespace(D->getDeclContext()))
+      m_Shadowed.insert(cast<NamespaceDecl>(D->getDeclContext()));
+
     if (InterpreterCallbacks *IC = m_Interp.getCallbacks())
       IC->DefinitionShadowed(D);
   }
 
-  void DefinitionShadower::invalidatePreviousDefinitions(NamedDecl *D) const {
-    LookupResult Previous(*m_Sema, D->getDeclName(), D->getLocation(),
-                   Sema::LookupOrdinaryName, Sema::ForVisibleRedeclaration);
-    m_Sema->LookupQualifiedName(Previous, m_TU);
+  void DefinitionShadower::invalidatePreviousDefinitions(NamedDecl *D) {
+    // The lookup table of the TU is keyed by name and holds the members of
+    // the inline `__cling_N5xxx' namespaces, too: it indexes all definitions
+    // that might be shadowed, and DeclUnloader keeps it up to date. Copy the
+    // result, as hideDecl() changes it.
+    llvm::SmallVector<NamedDecl*, 4> Previous;
+    for (NamedDecl *Prev : m_TU->lookup(D->getDeclName()))
+      if (Prev != D && Prev->isInIdentifierNamespace(Decl::IDNS_Ordinary
+                                                     | Decl::IDNS_Tag
+                                                     | Decl::IDNS_Member
+                                                     | Decl::IDNS_Namespace))
+        Previous.push_back(Prev);
 
     for (auto Prev : Previous) {
-      if (Prev == D)
-        continue;
       if (isDefinition(Prev) && !isDefinition(D))
         continue;
       // If the found declaration is a function overload, do not invalidate it.
@@ -134,7 +142,7 @@ namespace cling {
       D->setInvalidDecl();
   }
 
-  void DefinitionShadower::invalidatePreviousDefinitions(FunctionDecl *D) const {
+  void DefinitionShadower::invalidatePreviousDefinitions(FunctionDecl *D) {
     const CompilationOptions &CO = getTransaction()->getCompilationOpts();
     if (utils::Analyze::IsWrapper(D)) {
       if (!CO.DeclarationExtraction)
@@ -155,7 +163,7 @@ namespace cling {
       invalidatePreviousDefinitions(cast<NamedDecl>(D));
   }
 
-  void DefinitionShadower::invalidatePreviousDefinitions(Decl *D) const {
+  void DefinitionShadower::invalidatePreviousDefinitions(Decl *D) {
     if (auto FD = dyn_cast<FunctionDecl>(D))
       invalidatePreviousDefinitions(FD);
     else if (auto ND = dyn_cast<NamedDecl>(D))
@@ -209,6 +217,41 @@ namespace cling {
     // Invalidate previous definitions so that LookupResult::resolveKind() does not
     // mark resolution as ambiguous.
     invalidatePreviousDefinitions(D);
+
+    if (m_Shadowed.size() >= kCompactionThreshold)
+      compactShadowNamespaces();
     return Result(D, true);
   }
+
+  void DefinitionShadower::TransactionUnloading(const Transaction& T) {
+    if (NamespaceDecl *NS = T.getDefinitionShadowNS())
+      m_Shadowed.erase(NS);
+    for (auto I = T.nested_begin(), E = T.nested_end(); I != E; ++I)
+      TransactionUnloading(**I);
+  }
+
+  void DefinitionShadower::compactShadowNamespaces() {
+    const NamespaceDecl *Current = getTransaction()->getDefinitionShadowNS();
+    llvm::SmallPtrSet<NamespaceDecl*, 8> Remaining;
+    for (NamespaceDecl *NS : m_Shadowed) {
+      bool Visible = NS == Current;
+      for (auto I = NS->decls_begin(), E = NS->decls_end();
+           I != E && !Visible; ++I) {
+        auto ND = dyn_cast<NamedDecl>(*I);
+        if (!ND)
+          continue;
+        auto R = m_TU->noload_lookup(ND->getDeclName());
+        Visible = std::find(R.begin(), R.end(), ND) != R.end();
+      }
+      if (Visible) {
+        Remaining.insert(NS);
+        continue;
+      }
+      // Take the namespace out of the TU's decls, which removeDecl() scans
+      // for every shadowed declaration, but keep `__cling_N5xxx::yyy' valid.
+      m_TU->removeDecl(NS);
+      m_TU->makeDeclVisibleInContext(NS);
+    }
+    m_Shadowed.swap(Remaining);
+  }
 } // end namespace cling
@@ -12,11 +12,14 @@
 
 #include "ASTTransformer.h"
 
+#include "llvm/ADT/SmallPtrSet.h"
+
 namespace clang {
   class ASTContext;
   class Decl;
   class TranslationUnitDecl;
   class NamedDecl;
+  class NamespaceDecl;
   class FunctionDecl;
   class Sema;
 }
@@ -56,31 +59,45 @@ namespace cling {
 
     unsigned long long m_UniqueNameCounter = 0;
 
+    /// \brief The `__cling_N5xxx' namespaces that had a declaration hidden
+    /// since the last `compactShadowNamespaces()'.
+    llvm::SmallPtrSet<clang::NamespaceDecl*, 64> m_Shadowed;
+
+    /// \brief How many namespaces `m_Shadowed' collects before compacting.
+    static constexpr unsigned kCompactionThreshold = 64;
+
     /// \brief Hide a global declaration from SemaLookup; internally used in
     /// `invalidatePreviousDefinitions()'. This directly manipulates lookup
     /// tables to avoid a patch to Clang.
     ///
-    void hideDecl(clang::NamedDecl *D) const;
+    void hideDecl(clang::NamedDecl *D);
+
+    /// \brief Remove the namespaces of `m_Shadowed' whose declarations are
+    /// all hidden from the TU's list of declarations, such that it does not
+    /// grow with every input that redefines something. They stay visible to
+    /// qualified lookup.
+    ///
+    void compactShadowNamespaces();
 
     /// \brief Lookup the given name and invalidate all clashing declarations
     /// (as seen from the TU).  `D' may be invalidated (if not a definition)
     /// and a definition for that declaration is in scope, e.g.
     /// \code class C {}; class C; \endcode
     ///
-    void invalidatePreviousDefinitions(clang::NamedDecl *D) const;
+    void invalidatePreviousDefinitions(clang::NamedDecl *D);
 
     /// \brief Invalidate previous function definition.  If `D` is a wrapper,
     /// local declararations may be moved by DeclExtractor; in that case,
     /// invalidate all those before DeclExtractor runs.
     ///
-    void invalidatePreviousDefinitions(clang::FunctionDecl *D) const;
+    void invalidatePreviousDefinitions(clang::FunctionDecl *D);
 
     /// \brief Invalidate a previous decl of `D' that provide a definition.
     ///
     /// \param D[in] - Declaration whose name will be used to lookup existing
     /// definitions.
     ///
-    void invalidatePreviousDefinitions(clang::Decl *D) const;
+    void invalidatePreviousDefinitions(clang::Decl *D);
 
   public:
     DefinitionShadower(clang::Sema& S, Interpreter& I);
@@ -91,6 +108,11 @@ namespace cling {
     ///
     Result Transform(clang::Decl* D) override;
 
+    /// \brief Forget the `__cling_N5xxx' namespaces of `T' and of its nested
+    /// transactions, which are about to be removed.
+    ///
+    void TransactionUnloading(const Transaction& T) override;
+
     /// \brief Return whether `DC` is a `__cling_N5xxx` inline namespace used
     /// for definition shadowing.
     ///
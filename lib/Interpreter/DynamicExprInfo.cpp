@@ -31,6 +31,30 @@ namespace runtime {
 
       return m_Result.c_str();
     }
+
+    std::string DynamicExprInfo::getExprReadingFrom(void* const* Slots) const {
+      std::string Result;
+      llvm::raw_string_ostream Strm(Result);
+      for (const char* C = m_Template; *C; ++C) {
+        if (*C == '@')
+          Strm << "(*(void**)" << (const void*)Slots++ << ')';
+        else
+          Strm << *C;
+      }
+      return Strm.str();
+    }
+
+    unsigned DynamicExprInfo::getNumAddresses() const {
+      unsigned N = 0;
+      for (const char* C = m_Template; *C; ++C)
+        N += *C == '@';
+      return N;
+    }
+
+    void DynamicExprInfo::bind(void** Slots) const {
+      for (unsigned I = 0, E = getNumAddresses(); I < E; ++I)
+        Slots[I] = m_Addresses[I];
+    }
   } // end namespace internal
 } // end namespace runtime
 } // end namespace cling
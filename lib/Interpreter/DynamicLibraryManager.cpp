@@ -12,11 +12,15 @@
 #include "cling/Utils/Paths.h"
 #include "cling/Utils/Platform.h"
 #include "cling/Utils/Output.h"
+#include "EventTrace.h"
 
 #include "llvm/BinaryFormat/Magic.h"
 #include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
 
+#include <algorithm>
+#include <future>
 #include <system_error>
 #include <sys/stat.h>
 
@@ -59,10 +63,75 @@ namespace cling {
       addSearchPath(P, /*IsUser*/ false);
   }
 
+  void DynamicLibraryManager::addSearchPath(llvm::StringRef dir, bool isUser,
+                                            bool prepend) {
+    if (!m_SearchPathSet.insert(dir)) {
+      if (!prepend)
+        return;
+      // Searched first from now on.
+      const std::string Key = utils::PathSet::getKey(dir);
+      auto I = std::find_if(m_SearchPaths.begin(), m_SearchPaths.end(),
+                            [&Key](const SearchPathInfo& Info) {
+                              return utils::PathSet::getKey(Info.Path) == Key;
+                            });
+      if (I != m_SearchPaths.end())
+        m_SearchPaths.erase(I);
+    }
+    auto pos = prepend ? m_SearchPaths.begin() : m_SearchPaths.end();
+    pos = m_SearchPaths.insert(pos, SearchPathInfo{dir, isUser});
+    updateDyld(*pos, prepend);
+    invalidateSymbolSearches();
+  }
+
+  static std::string listingKey(llvm::StringRef Name) {
+#if defined(_WIN32) || defined(__APPLE__)
+    // The file system is likely case-insensitive; a false match only costs
+    // the probe that the listing would have spared.
+    return Name.lower();
+#else
+    return Name.str();
+#endif
+  }
+
+  bool DynamicLibraryManager::mayContain(llvm::StringRef Dir,
+                                         llvm::StringRef Name) const {
+    using namespace llvm::sys;
+    // "." and other relative paths change their meaning with the CWD.
+    if (!path::is_absolute(Dir) || path::filename(Name) != Name)
+      return true;
+
+    DirListing& L = m_DirListings[Dir];
+    if (L.Epoch != m_LookupEpoch) {
+      L.Epoch = m_LookupEpoch;
+      fs::file_status Status;
+      if (fs::status(Dir, Status) || !fs::is_directory(Status)) {
+        L.Valid = false;
+        L.Names.clear();
+      } else if (!L.Valid || Status.getLastModificationTime() != L.ModTime) {
+        L.Names.clear();
+        std::error_code EC;
+        for (fs::directory_iterator DirIt(Dir, EC), DirEnd;
+             DirIt != DirEnd && !EC; DirIt.increment(EC))
+          L.Names.insert(listingKey(path::filename(DirIt->path())));
+        L.Valid = !EC;
+        // A file added within the time stamp's resolution would not change
+        // it; list such a fresh directory again next time.
+        L.ModTime = Status.getLastModificationTime();
+        if (std::chrono::system_clock::now() - L.ModTime
+            < std::chrono::seconds(2))
+          L.ModTime = TimePoint<>();
+      }
+    }
+    // Without a usable listing, probe as usual.
+    return !L.Valid || L.Names.count(listingKey(Name));
+  }
+
   std::string
   DynamicLibraryManager::lookupLibInPaths(llvm::StringRef libStem) const {
     llvm::SmallString<512> ThisPath;
     for (const SearchPathInfo& Info : m_SearchPaths) {
+      if (!mayContain(Info.Path, libStem))
+        continue;
       ThisPath = Info.Path;
       llvm::sys::path::append(ThisPath, libStem);
       bool exists;
@@ -140,6 +209,8 @@ namespace cling {
         return std::string();
     }
 
+    // Check each search path for modifications once for all variants.
+    ++m_LookupEpoch;
     std::string foundName = lookupLibMaybeAddExt(libStem);
     if (foundName.empty() && !libStem.startswith("lib")) {
       // try with "lib" prefix:
@@ -155,6 +226,10 @@ namespace cling {
   DynamicLibraryManager::LoadLibResult
   DynamicLibraryManager::loadLibrary(const std::string& libStem,
                                      bool permanent, bool resolved) {
+    CLING_TRACE_SCOPE(Trace, kLibraryLoad, libStem);
+    // The libraries load in the order they were asked for.
+    joinPendingLoads();
+
     std::string lResolved;
     const std::string& canonicalLoadedLib = resolved ? libStem : lResolved;
     if (!resolved) {
@@ -170,30 +245,87 @@ namespace cling {
 
     std::string errMsg;
     DyLibHandle dyLibHandle = platform::DLOpen(canonicalLoadedLib, &errMsg);
-    if (!dyLibHandle) {
+    return completeLoad(canonicalLoadedLib, libStem, permanent, resolved,
+                        dyLibHandle, errMsg);
+  }
+
+  DynamicLibraryManager::LoadLibResult
+  DynamicLibraryManager::completeLoad(const std::string& Path,
+                                      const std::string& LibStem,
+                                      bool Permanent, bool Resolved,
+                                      DyLibHandle Handle,
+                                      const std::string& ErrMsg) {
+    if (!Handle) {
       // We emit callback to LibraryLoadingFailed when we get error with error message.
       if (InterpreterCallbacks* C = getCallbacks()) {
-        if (C->LibraryLoadingFailed(errMsg, libStem, permanent, resolved))
+        if (C->LibraryLoadingFailed(ErrMsg, LibStem, Permanent, Resolved)) {
+          invalidateSymbolSearches();
           return kLoadLibSuccess;
+        }
       }
 
-      cling::errs() << "cling::DynamicLibraryManager::loadLibrary(): " << errMsg
+      cling::errs() << "cling::DynamicLibraryManager::loadLibrary(): " << ErrMsg
                     << '\n';
       return kLoadLibLoadError;
     }
     else if (InterpreterCallbacks* C = getCallbacks())
-      C->LibraryLoaded(dyLibHandle, canonicalLoadedLib);
+      C->LibraryLoaded(Handle, Path);
 
     std::pair<DyLibs::iterator, bool> insRes
-      = m_DyLibs.insert(std::pair<DyLibHandle, std::string>(dyLibHandle,
-                                                            canonicalLoadedLib));
+      = m_DyLibs.insert(std::pair<DyLibHandle, std::string>(Handle, Path));
     if (!insRes.second)
       return kLoadLibAlreadyLoaded;
-    m_LoadedLibraries.insert(canonicalLoadedLib);
+    m_LoadedLibraries.insert(Path);
+    updateDyld(Path, /*Loaded*/ true);
+    invalidateSymbolSearches();
     return kLoadLibSuccess;
   }
 
+  DynamicLibraryManager::LoadLibResult
+  DynamicLibraryManager::loadLibraryAsync(const std::string& libStem,
+                                          bool permanent, bool resolved) {
+    const std::string Path = resolved ? libStem : lookupLibrary(libStem);
+    if (Path.empty())
+      return kLoadLibNotFound;
+    if (isLibraryLoaded(Path))
+      return kLoadLibAlreadyLoaded;
+
+    // dlopen() should see the libraries loaded before, as loadLibrary()
+    // would have loaded them.
+    std::shared_future<std::pair<DyLibHandle, std::string>> Prev;
+    if (!m_PendingLoads.empty())
+      Prev = m_PendingLoads.back().Result;
+    std::shared_future<std::pair<DyLibHandle, std::string>> Result
+      = std::async(std::launch::async, [Path, Prev] {
+          if (Prev.valid())
+            Prev.wait();
+          std::string ErrMsg;
+          DyLibHandle Handle = platform::DLOpen(Path, &ErrMsg);
+          return std::make_pair(Handle, std::move(ErrMsg));
+        }).share();
+    m_PendingLoads.push_back({Path, libStem, permanent, resolved,
+                              std::move(Result)});
+    return kLoadLibSuccess;
+  }
+
+  bool DynamicLibraryManager::joinPendingLoads() {
+    // The callbacks of completeLoad() might load libraries, too.
+    std::vector<PendingLoad> Pending;
+    Pending.swap(m_PendingLoads);
+    bool Success = true;
+    for (const PendingLoad& P : Pending) {
+      CLING_TRACE_SCOPE(Trace, kLibraryLoad, P.LibStem);
+      const std::pair<DyLibHandle, std::string>& Loaded = P.Result.get();
+      if (completeLoad(P.Path, P.LibStem, P.Permanent, P.Resolved,
+                       Loaded.first, Loaded.second) == kLoadLibLoadError)
+        Success = false;
+    }
+    return Success;
+  }
+
   void DynamicLibraryManager::unloadLibrary(llvm::StringRef libStem) {
+    CLING_TRACE_SCOPE(Trace, kLibraryUnload, libStem);
+    joinPendingLoads();
     std::string canonicalLoadedLib = lookupLibrary(libStem);
     if (!isLibraryLoaded(canonicalLoadedLib))
       return;
@@ -221,12 +353,19 @@ namespace cling {
 
     m_DyLibs.erase(dyLibHandle);
     m_LoadedLibraries.erase(canonicalLoadedLib);
+    updateDyld(canonicalLoadedLib, /*Loaded*/ false);
+    ++m_NumUnloads;
+    invalidateSymbolSearches();
   }
 
   bool DynamicLibraryManager::isLibraryLoaded(llvm::StringRef fullPath) const {
     std::string canonPath = normalizePath(fullPath);
     if (m_LoadedLibraries.find(canonPath) != m_LoadedLibraries.end())
       return true;
+    // Or about to be.
+    for (const PendingLoad& P : m_PendingLoads)
+      if (P.Path == canonPath)
+        return true;
     return false;
   }
 
@@ -10,19 +10,35 @@
 
 #include "cling/Interpreter/DynamicLibraryManager.h"
 #include "cling/Utils/Output.h"
+#include "EventTrace.h"
+#include "SharedCache.h"
 
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/StringSet.h"
 #include "llvm/Object/COFF.h"
 #include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Object/MachO.h"
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
 #include <list>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_set>
 #include <vector>
 
@@ -85,14 +101,20 @@ struct BloomFilter {
   uint32_t m_BloomShift = 0;
   std::vector<uint64_t> m_BloomTable;
 
-  bool TestHash(uint32_t hash) const {
+  static bool TestHash(const uint64_t* Table, uint32_t Size, uint32_t Shift,
+                       uint32_t hash) {
     // This function is superhot. No branches here, breaks inlining and makes
     // overall performance around 4x slower.
+    const int Bits = 8 * sizeof(uint64_t);
+    uint32_t hash2 = hash >> Shift;
+    uint32_t n = (hash >> log2u(Bits)) % Size;
+    uint64_t mask = ((1ULL << (hash % Bits)) | (1ULL << (hash2 % Bits)));
+    return (mask & Table[n]) == mask;
+  }
+
+  bool TestHash(uint32_t hash) const {
     assert(m_IsInitialized && "Not yet initialized!");
-    uint32_t hash2 = hash >> m_BloomShift;
-    uint32_t n = (hash >> log2u(m_Bits)) % m_BloomSize;
-    uint64_t mask = ((1ULL << (hash % m_Bits)) | (1ULL << (hash2 % m_Bits)));
-    return (mask & m_BloomTable[n]) == mask;
+    return TestHash(m_BloomTable.data(), m_BloomSize, m_BloomShift, hash);
   }
 
   void AddHash(uint32_t hash) {
@@ -114,6 +136,324 @@ struct BloomFilter {
 };
 
 
+/// The BloomFilter and the symbols of a library as stored on disk, mapped in
+/// memory: processes share the pages of the libraries they look at. There is
+/// one file per library and set of ignored symbol flags, in the directory
+/// $CLING_DYLD_INDEX or else the user's cache directory; an empty
+/// CLING_DYLD_INDEX disables the index. A file is only used while the
+/// library keeps its path, device, inode, size and modification time.
+/// $CLING_DYLD_INDEX_SIZE, e.g. "200M", bounds the size of the directory by
+/// evicting the files used least recently.
+///
+/// The file holds, in host byte order, a Header, the bloom table (BloomSize
+/// words), the open addressing hash table of the symbols (NumBuckets
+/// entries, each 0 or 1 + the index of a symbol), the offsets of the symbol
+/// names (SymbolsCount entries), the NUL-terminated names and the library's
+/// path. Libraries that must be ignored get a file without symbols.
+class SymbolIndex {
+  struct Header {
+    char Magic[8];
+    uint64_t Device;
+    uint64_t Inode;
+    uint64_t Size;
+    int64_t MTime;
+    uint32_t Version;
+    uint32_t IgnoreFlags;
+    uint32_t Ignored;
+    uint32_t SymbolsCount;
+    uint32_t BloomSize;
+    uint32_t BloomShift;
+    uint32_t NumBuckets;
+    uint32_t NamesSize;
+    uint32_t PathSize;
+    uint32_t Reserved;
+  };
+  static constexpr uint32_t kVersion = 1;
+
+  std::unique_ptr<llvm::MemoryBuffer> m_Buffer;
+  const Header* m_Header = nullptr;
+  const uint64_t* m_Bloom = nullptr;
+  const uint32_t* m_Buckets = nullptr;
+  const uint32_t* m_Offsets = nullptr;
+  const char* m_Names = nullptr;
+
+  static bool GetStamp(llvm::StringRef Lib, Header& H) {
+    llvm::sys::fs::file_status Status;
+    if (llvm::sys::fs::status(Lib, Status))
+      return false;
+    H.Device = Status.getUniqueID().getDevice();
+    H.Inode = Status.getUniqueID().getFile();
+    H.Size = Status.getSize();
+    H.MTime = Status.getLastModificationTime().time_since_epoch().count();
+    return true;
+  }
+
+  static const std::string& GetDirectory() {
+    static const std::string Dir = []() -> std::string {
+      llvm::SmallString<256> Dir;
+      if (const char* Env = ::getenv("CLING_DYLD_INDEX"))
+        Dir = Env;
+      else if (llvm::sys::path::cache_directory(Dir))
+        llvm::sys::path::append(Dir, "cling", "dyld-index");
+      return Dir.str();
+    }();
+    return Dir;
+  }
+
+  ///\brief The index of the filter and the symbols of Lib, which may repeat;
+  /// without Symbols, records that Lib is to be ignored. Empty if Lib is gone.
+  static std::string Serialize(llvm::StringRef Lib, unsigned IgnoreFlags,
+                               const BloomFilter* Filter,
+                               const std::vector<llvm::StringRef>* Symbols) {
+    Header H;
+    std::memset(&H, 0, sizeof(H));
+    std::memcpy(H.Magic, "CLNGDYLD", sizeof(H.Magic));
+    if (!GetStamp(Lib, H))
+      return std::string();
+    H.Version = kVersion;
+    H.IgnoreFlags = IgnoreFlags;
+    H.Ignored = !Symbols;
+
+    std::vector<uint32_t> Buckets(1, 0);
+    std::vector<uint32_t> Offsets;
+    std::string Names;
+    if (Symbols && !Symbols->empty()) {
+      H.BloomSize = Filter->m_BloomSize;
+      H.BloomShift = Filter->m_BloomShift;
+      uint32_t NumBuckets = 1;
+      while (NumBuckets < 2 * Symbols->size())
+        NumBuckets <<= 1;
+      const uint32_t Mask = NumBuckets - 1;
+      Buckets.assign(NumBuckets, 0);
+      // The names of the buckets, to skip the repeated ones: ELF lists most
+      // symbols in both .symtab and .dynsym.
+      std::vector<llvm::StringRef> Kept;
+      Kept.reserve(Symbols->size());
+      for (llvm::StringRef Sym : *Symbols) {
+        uint32_t Slot = GNUHash(Sym) & Mask;
+        while (Buckets[Slot] && Kept[Buckets[Slot] - 1] != Sym)
+          Slot = (Slot + 1) & Mask;
+        if (Buckets[Slot])
+          continue;
+        Kept.push_back(Sym);
+        Buckets[Slot] = Kept.size();
+        Offsets.push_back(Names.size());
+        Names += Sym;
+        Names += '\0';
+      }
+      H.SymbolsCount = Kept.size();
+    }
+    H.NumBuckets = Buckets.size();
+    H.NamesSize = Names.size();
+    H.PathSize = Lib.size();
+
+    std::string Data;
+    llvm::raw_string_ostream OS(Data);
+    OS.write(reinterpret_cast<const char*>(&H), sizeof(H));
+    if (H.SymbolsCount)
+      OS.write(reinterpret_cast<const char*>(Filter->m_BloomTable.data()),
+               H.BloomSize * sizeof(uint64_t));
+    OS.write(reinterpret_cast<const char*>(Buckets.data()),
+             Buckets.size() * sizeof(uint32_t));
+    OS.write(reinterpret_cast<const char*>(Offsets.data()),
+             Offsets.size() * sizeof(uint32_t));
+    OS << Names << Lib;
+    return OS.str();
+  }
+
+  ///\brief Uses Buffer if it is a valid index of Lib.
+  bool Load(std::unique_ptr<llvm::MemoryBuffer> Buffer, llvm::StringRef Lib,
+            unsigned IgnoreFlags) {
+    if (Buffer->getBufferSize() < sizeof(Header))
+      return false;
+    const char* Data = Buffer->getBufferStart();
+    const Header* H = reinterpret_cast<const Header*>(Data);
+    Header Now;
+    if (std::memcmp(H->Magic, "CLNGDYLD", sizeof(H->Magic))
+        || H->Version != kVersion || H->IgnoreFlags != IgnoreFlags
+        || !GetStamp(Lib, Now) || H->Device != Now.Device
+        || H->Inode != Now.Inode || H->Size != Now.Size
+        || H->MTime != Now.MTime)
+      return false;
+
+    // Reject anything a lookup could overrun.
+    const uint64_t Expected = sizeof(Header)
+      + uint64_t(H->BloomSize) * sizeof(uint64_t)
+      + uint64_t(H->NumBuckets) * sizeof(uint32_t)
+      + uint64_t(H->SymbolsCount) * sizeof(uint32_t)
+      + H->NamesSize + H->PathSize;
+    if (Expected != Buffer->getBufferSize()
+        || (H->NumBuckets & (H->NumBuckets - 1))
+        || H->NumBuckets <= H->SymbolsCount
+        || (H->SymbolsCount && !H->BloomSize))
+      return false;
+
+    m_Bloom = reinterpret_cast<const uint64_t*>(Data + sizeof(Header));
+    m_Buckets = reinterpret_cast<const uint32_t*>(m_Bloom + H->BloomSize);
+    m_Offsets = m_Buckets + H->NumBuckets;
+    m_Names = reinterpret_cast<const char*>(m_Offsets + H->SymbolsCount);
+    if ((H->NamesSize && m_Names[H->NamesSize - 1])
+        || llvm::StringRef(m_Names + H->NamesSize, H->PathSize) != Lib)
+      return false;
+
+    m_Header = H;
+    m_Buffer = std::move(Buffer);
+    return true;
+  }
+
+public:
+  ///\returns the index file of the library Lib, or an empty string if the
+  /// index is disabled.
+  static std::string GetFile(llvm::StringRef Lib, unsigned IgnoreFlags) {
+    const std::string& Dir = GetDirectory();
+    if (Dir.empty())
+      return std::string();
+    llvm::MD5 Hash;
+    Hash.update(Lib);
+    Hash.update(std::to_string(IgnoreFlags));
+    llvm::MD5::MD5Result Result;
+    Hash.final(Result);
+    llvm::SmallString<256> File(Dir);
+    llvm::sys::path::append(File, Result.digest().str() + ".idx");
+    return File.str();
+  }
+
+  ///\brief Indexes the filter and the symbols of Lib in memory; without
+  /// Symbols, records that Lib is to be ignored.
+  static std::shared_ptr<const SymbolIndex>
+  Create(llvm::StringRef Lib, unsigned IgnoreFlags, const BloomFilter* Filter,
+         const std::vector<llvm::StringRef>* Symbols) {
+    const std::string Data = Serialize(Lib, IgnoreFlags, Filter, Symbols);
+    if (Data.empty())
+      return nullptr;
+    auto I = std::make_shared<SymbolIndex>();
+    if (!I->Load(llvm::MemoryBuffer::getMemBufferCopy(Data, Lib), Lib,
+                 IgnoreFlags))
+      return nullptr;
+    return I;
+  }
+
+  ///\brief Stores the index in File.
+  ///\returns whether File now holds it.
+  bool Write(const std::string& File) const {
+    if (llvm::sys::fs::create_directories(llvm::sys::path::parent_path(File)))
+      return false;
+    // Write to a unique temporary, then rename: concurrent processes must
+    // never map a partially written index.
+    int FD;
+    llvm::SmallString<256> TmpPath;
+    if (llvm::sys::fs::createUniqueFile(File + ".%%%%%%.tmp", FD, TmpPath))
+      return false;
+    {
+      llvm::raw_fd_ostream OS(FD, /*shouldClose*/ true);
+      OS << m_Buffer->getBuffer();
+      if (OS.has_error()) {
+        OS.clear_error();
+        OS.close();
+        llvm::sys::fs::remove(TmpPath);
+        return false;
+      }
+    }
+    if (llvm::sys::fs::rename(TmpPath, File)) {
+      llvm::sys::fs::remove(TmpPath);
+      return false;
+    }
+    static const uint64_t MaxBytes
+      = cling::cache::getSizeLimit("CLING_DYLD_INDEX_SIZE");
+    cling::cache::prune(GetDirectory(), MaxBytes, {".idx"});
+    return true;
+  }
+
+  ///\brief Maps File if it is the valid index of Lib.
+  bool Load(const std::string& File, llvm::StringRef Lib,
+            unsigned IgnoreFlags) {
+    auto Buffer = llvm::MemoryBuffer::getFile(File, /*FileSize*/ -1,
+                                              /*RequiresNullTerminator*/ false);
+    if (!Buffer || !Load(std::move(*Buffer), Lib, IgnoreFlags))
+      return false;
+    cling::cache::touch(File);
+    return true;
+  }
+
+  ///\brief Whether the library is still the one indexed.
+  bool IsCurrent(llvm::StringRef Lib) const {
+    Header Now;
+    return GetStamp(Lib, Now) && m_Header->Device == Now.Device
+      && m_Header->Inode == Now.Inode && m_Header->Size == Now.Size
+      && m_Header->MTime == Now.MTime;
+  }
+
+  bool IsIgnored() const { return m_Header->Ignored; }
+
+  ///\brief The bloom table, empty if the library has no symbols.
+  void GetBloomTable(const uint64_t*& Table, uint32_t& Size,
+                     uint32_t& Shift) const {
+    Table = m_Bloom;
+    Size = m_Header->SymbolsCount ? m_Header->BloomSize : 0;
+    Shift = m_Header->BloomShift;
+  }
+
+  bool MayExistSymbol(uint32_t hash) const {
+    if (!m_Header->SymbolsCount)
+      return false;
+    return BloomFilter::TestHash(m_Bloom, m_Header->BloomSize,
+                                 m_Header->BloomShift, hash);
+  }
+
+  bool ExistSymbol(llvm::StringRef symbol, uint32_t hash) const {
+    const uint32_t Mask = m_Header->NumBuckets - 1;
+    for (uint32_t Slot = hash & Mask; m_Buckets[Slot];
+         Slot = (Slot + 1) & Mask) {
+      const uint32_t Idx = m_Buckets[Slot] - 1;
+      if (Idx >= m_Header->SymbolsCount
+          || m_Offsets[Idx] >= m_Header->NamesSize)
+        return false;
+      if (symbol == m_Names + m_Offsets[Idx])
+        return true;
+    }
+    return false;
+  }
+};
+
+
+/// The SymbolIndex of each library, as long as a Dyld of the process uses
+/// it: the interpreters of a process share their filters and verdicts, also
+/// when the index is not kept on disk.
+class SharedSymbolIndexes {
+  std::mutex m_Mutex;
+  std::map<std::pair<std::string, unsigned>,
+           std::weak_ptr<const SymbolIndex>> m_Indexes;
+
+public:
+  static SharedSymbolIndexes& Get() {
+    // Leaked, for the interpreters destroyed at exit.
+    static SharedSymbolIndexes* Indexes = new SharedSymbolIndexes();
+    return *Indexes;
+  }
+
+  ///\returns the index of Lib that another Dyld uses, if it is current.
+  std::shared_ptr<const SymbolIndex> Find(const std::string& Lib,
+                                          unsigned IgnoreFlags) {
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+    auto Found = m_Indexes.find({Lib, IgnoreFlags});
+    if (Found == m_Indexes.end())
+      return nullptr;
+    std::shared_ptr<const SymbolIndex> I = Found->second.lock();
+    if (!I || !I->IsCurrent(Lib)) {
+      m_Indexes.erase(Found);
+      return nullptr;
+    }
+    return I;
+  }
+
+  void Add(const std::string& Lib, unsigned IgnoreFlags,
+           const std::shared_ptr<const SymbolIndex>& I) {
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+    m_Indexes[{Lib, IgnoreFlags}] = I;
+  }
+};
+
+
 /// An efficient representation of a full path to a library which does not
 /// duplicate common path patterns reducing the overall memory footprint.
 ///
@@ -127,7 +467,12 @@ struct LibraryPath {
   std::string m_LibName;
   std::string m_FullName;
   BloomFilter m_Filter;
-  llvm::StringSet<> m_Symbols;
+  /// The symbols, and replaces m_Filter once the library is indexed.
+  std::shared_ptr<const SymbolIndex> m_Index;
+  /// The file names of the libraries this one needs: its DT_NEEDED,
+  /// LC_LOAD_DYLIB or import table entries, once m_NeededRead.
+  std::vector<std::string> m_Needed;
+  bool m_NeededRead = false;
 
   LibraryPath(const BasePath& Path, const std::string& LibName)
     : m_Path(Path), m_LibName(LibName) {
@@ -149,13 +494,8 @@ struct LibraryPath {
     m_Filter.AddHash(GNUHash(symbol));
   }
 
-  llvm::StringRef AddSymbol(const std::string& symbol) {
-    auto it = m_Symbols.insert(symbol);
-    return it.first->getKey();
-  }
-
   bool hasBloomFilter() const {
-    return m_Filter.m_IsInitialized;
+    return m_Filter.m_IsInitialized || m_Index;
   }
 
   bool isBloomFilterEmpty() const {
@@ -170,7 +510,20 @@ struct LibraryPath {
     m_Filter.ResizeTable(newSymbolsCount);
   }
 
+  /// The table that MayExistSymbol() tests, empty if there are no symbols.
+  void GetBloomTable(const uint64_t*& Table, uint32_t& Size,
+                     uint32_t& Shift) const {
+    if (m_Index)
+      return m_Index->GetBloomTable(Table, Size, Shift);
+    Table = m_Filter.m_BloomTable.data();
+    Size = m_Filter.m_SymbolsCount ? m_Filter.m_BloomSize : 0;
+    Shift = m_Filter.m_BloomShift;
+  }
+
   bool MayExistSymbol(uint32_t hash) const {
+    if (m_Index)
+      return m_Index->MayExistSymbol(hash);
+
     // The library had no symbols and the bloom filter is empty.
     if (isBloomFilterEmpty())
       return false;
@@ -179,7 +532,7 @@ struct LibraryPath {
   }
 
   bool ExistSymbol(llvm::StringRef symbol) const {
-    return m_Symbols.find(symbol) != m_Symbols.end();
+    return m_Index && m_Index->ExistSymbol(symbol, GNUHash(symbol));
   }
 };
 
@@ -199,6 +552,8 @@ class LibraryPaths {
 
   std::vector<const LibraryPath*> m_Libs;
   std::unordered_set<LibraryPath, LibraryPathHashFn> m_LibsH;
+  /// Changes with the set of libraries.
+  uint64_t m_Generation = 0;
 public:
   bool HasRegisteredLib(const LibraryPath& Lib) const {
     return m_LibsH.count(Lib);
@@ -208,6 +563,7 @@ public:
     auto it = m_LibsH.insert(Lib);
     assert(it.second && "Already registered!");
     m_Libs.push_back(&*it.first);
+    ++m_Generation;
   }
 
   void UnregisterLib(const LibraryPath& Lib) {
@@ -217,6 +573,26 @@ public:
 
     m_Libs.erase(std::find(m_Libs.begin(), m_Libs.end(), &*found));
     m_LibsH.erase(found);
+    ++m_Generation;
+  }
+
+  /// Moves Libs, registered, before the others, keeping their order.
+  void MoveToFront(const std::vector<const LibraryPath*>& Libs) {
+    if (Libs.empty())
+      return;
+    std::unordered_set<const LibraryPath*> Front(Libs.begin(), Libs.end());
+    std::stable_partition(m_Libs.begin(), m_Libs.end(),
+                          [&Front](const LibraryPath* L) {
+                            return Front.count(L);
+                          });
+    ++m_Generation;
+  }
+
+  uint64_t GetGeneration() const { return m_Generation; }
+
+  const LibraryPath* GetRegisteredLib(const LibraryPath& Lib) const {
+    auto found = m_LibsH.find(Lib);
+    return found == m_LibsH.end() ? nullptr : &*found;
   }
 
   size_t size() const {
@@ -229,6 +605,118 @@ public:
   }
 };
 
+/// The bloom filters of a list of libraries as a structure of arrays: one
+/// hash gets tested against all of them in a branchless pass over contiguous
+/// arrays, which the compiler can vectorize with gathers where the target
+/// has them. Only the few libraries that may have the symbol are looked at.
+class BloomFilterBank {
+  std::vector<const LibraryPath*> m_Libs;
+  std::vector<const uint64_t*> m_Tables;
+  std::vector<uint32_t> m_Sizes;
+  std::vector<uint8_t> m_Shifts;
+  /// 1 - the library has no filter yet and must be read.
+  std::vector<uint8_t> m_Unfiltered;
+  /// What the bank was built from, see IsStale().
+  uint64_t m_Generation = ~0ULL;
+  unsigned m_FiltersBuilt = 0;
+
+public:
+  ///\returns whether the libraries or their filters changed since Build().
+  bool IsStale(uint64_t Generation, unsigned FiltersBuilt) const {
+    return Generation != m_Generation || FiltersBuilt != m_FiltersBuilt;
+  }
+
+  ///\param UseFilters - whether the filters of the libraries can be used.
+  void Build(const std::vector<const LibraryPath*>& Libs, bool UseFilters,
+             uint64_t Generation, unsigned FiltersBuilt) {
+    // A table of one empty word rejects every hash.
+    static const uint64_t Empty = 0;
+    const size_t N = Libs.size();
+    m_Libs = Libs;
+    m_Tables.assign(N, &Empty);
+    m_Sizes.assign(N, 1);
+    m_Shifts.assign(N, 0);
+    m_Unfiltered.assign(N, 0);
+    for (size_t I = 0; I < N; ++I) {
+      if (!UseFilters || !Libs[I]->hasBloomFilter()) {
+        m_Unfiltered[I] = 1;
+        continue;
+      }
+      const uint64_t* Table;
+      uint32_t Size, Shift;
+      Libs[I]->GetBloomTable(Table, Size, Shift);
+      if (!Size)
+        continue;
+      m_Tables[I] = Table;
+      m_Sizes[I] = Size;
+      // The hash has 32 bits; an index could claim any shift.
+      m_Shifts[I] = std::min(Shift, 31u);
+    }
+    m_Generation = Generation;
+    m_FiltersBuilt = FiltersBuilt;
+  }
+
+  /// The libraries that may contain the symbol of hash, in their order.
+  void Test(uint32_t hash, std::vector<const LibraryPath*>& Positives) const {
+    const int Bits = 8 * sizeof(uint64_t);
+    // BloomFilter::TestHash()'s two bits, for each shift of the second.
+    uint64_t Masks[32];
+    for (int Shift = 0; Shift < 32; ++Shift)
+      Masks[Shift] = (1ULL << (hash % Bits))
+        | (1ULL << ((hash >> Shift) % Bits));
+    const uint32_t Word = hash >> log2u(Bits);
+
+    const size_t N = m_Libs.size();
+    std::vector<uint8_t> Hit(N);
+    const uint64_t* const* Tables = m_Tables.data();
+    const uint32_t* Sizes = m_Sizes.data();
+    const uint8_t* Shifts = m_Shifts.data();
+    const uint8_t* Unfiltered = m_Unfiltered.data();
+    for (size_t I = 0; I < N; ++I) {
+      const uint64_t Mask = Masks[Shifts[I]];
+      Hit[I] = ((Tables[I][Word % Sizes[I]] & Mask) == Mask) | Unfiltered[I];
+    }
+    for (size_t I = 0; I < N; ++I)
+      if (Hit[I])
+        Positives.push_back(m_Libs[I]);
+  }
+
+  /// The libraries that may contain any of the symbols of Hashes, in their
+  /// order, each with the indexes of these hashes: one pass over the
+  /// libraries tests them all.
+  void Test(llvm::ArrayRef<uint32_t> Hashes,
+            std::vector<std::pair<const LibraryPath*, std::vector<unsigned>>>&
+              Positives) const {
+    const int Bits = 8 * sizeof(uint64_t);
+    std::vector<unsigned> Hit;
+    for (size_t I = 0, N = m_Libs.size(); I < N; ++I) {
+      const uint64_t* Table = m_Tables[I];
+      const uint32_t Size = m_Sizes[I];
+      const uint8_t Shift = m_Shifts[I];
+      for (unsigned H = 0, E = Hashes.size(); H < E; ++H) {
+        const uint32_t hash = Hashes[H];
+        const uint64_t Mask = (1ULL << (hash % Bits))
+          | (1ULL << ((hash >> Shift) % Bits));
+        if (m_Unfiltered[I]
+            || (Table[(hash >> log2u(Bits)) % Size] & Mask) == Mask)
+          Hit.push_back(H);
+      }
+      if (!Hit.empty()) {
+        Positives.emplace_back(m_Libs[I], std::move(Hit));
+        Hit.clear();
+      }
+    }
+  }
+};
+
+/// The number of threads building bloom filters: CLING_DYLD_THREADS if set,
+/// else the number of cores. Filters are built one by one if this is <= 1.
+static unsigned getScanThreads() {
+  if (const char* Env = ::getenv("CLING_DYLD_THREADS"))
+    return ::atoi(Env) > 0 ? ::atoi(Env) : 0;
+  return std::thread::hardware_concurrency();
+}
+
 static std::string getRealPath(llvm::StringRef path) {
   llvm::SmallString<512> realPath;
   llvm::sys::fs::real_path(path, realPath, /*expandTilde*/true);
@@ -246,6 +734,84 @@ static llvm::StringRef GetGnuHashSection(llvm::object::ObjectFile *file) {
   return "";
 }
 
+template <class ELFT>
+static void GetELFNeeded(const llvm::object::ELFFile<ELFT>* Elf,
+                         std::vector<std::string>& Needed) {
+  auto DynOrErr = Elf->dynamicEntries();
+  if (!DynOrErr) {
+    llvm::consumeError(DynOrErr.takeError());
+    return;
+  }
+  uint64_t StrTab = 0, StrSz = 0;
+  std::vector<uint64_t> Offsets;
+  for (const typename ELFT::Dyn& Dyn : *DynOrErr) {
+    if (Dyn.d_tag == llvm::ELF::DT_NEEDED)
+      Offsets.push_back(Dyn.getVal());
+    else if (Dyn.d_tag == llvm::ELF::DT_STRTAB)
+      StrTab = Dyn.getPtr();
+    else if (Dyn.d_tag == llvm::ELF::DT_STRSZ)
+      StrSz = Dyn.getVal();
+  }
+  if (Offsets.empty() || !StrTab)
+    return;
+  auto StrOrErr = Elf->toMappedAddr(StrTab);
+  if (!StrOrErr) {
+    llvm::consumeError(StrOrErr.takeError());
+    return;
+  }
+  const uint8_t* Str = *StrOrErr;
+  const uint8_t* End = Elf->base() + Elf->getBufSize();
+  if (Str >= End)
+    return;
+  StrSz = std::min<uint64_t>(StrSz, End - Str);
+  for (uint64_t Off : Offsets) {
+    if (Off >= StrSz)
+      continue;
+    const char* Name = reinterpret_cast<const char*>(Str + Off);
+    Needed.push_back(llvm::sys::path::filename(
+      llvm::StringRef(Name, strnlen(Name, StrSz - Off))).str());
+  }
+}
+
+/// The file names of the libraries that loading file brings in.
+static std::vector<std::string>
+GetNeededLibraries(llvm::object::ObjectFile *file) {
+  using namespace llvm::object;
+  std::vector<std::string> Needed;
+  if (const auto *O = llvm::dyn_cast<ELF64LEObjectFile>(file))
+    GetELFNeeded(O->getELFFile(), Needed);
+  else if (const auto *O = llvm::dyn_cast<ELF32LEObjectFile>(file))
+    GetELFNeeded(O->getELFFile(), Needed);
+  else if (const auto *O = llvm::dyn_cast<ELF64BEObjectFile>(file))
+    GetELFNeeded(O->getELFFile(), Needed);
+  else if (const auto *O = llvm::dyn_cast<ELF32BEObjectFile>(file))
+    GetELFNeeded(O->getELFFile(), Needed);
+  else if (const auto *MachOObj = llvm::dyn_cast<MachOObjectFile>(file)) {
+    for (const MachOObjectFile::LoadCommandInfo &Load
+           : MachOObj->load_commands()) {
+      if (Load.C.cmd != llvm::MachO::LC_LOAD_DYLIB &&
+          Load.C.cmd != llvm::MachO::LC_LOAD_WEAK_DYLIB &&
+          Load.C.cmd != llvm::MachO::LC_REEXPORT_DYLIB)
+        continue;
+      llvm::MachO::dylib_command D = MachOObj->getDylibIDLoadCommand(Load);
+      if (D.dylib.name >= Load.C.cmdsize)
+        continue;
+      const char* Name = Load.Ptr + D.dylib.name;
+      const size_t Size = strnlen(Name, Load.C.cmdsize - D.dylib.name);
+      // E.g. @rpath/libB.dylib.
+      Needed.push_back(
+        llvm::sys::path::filename(llvm::StringRef(Name, Size)).str());
+    }
+  } else if (const auto *CoffObj = llvm::dyn_cast<COFFObjectFile>(file)) {
+    for (const ImportDirectoryEntryRef &I : CoffObj->import_directories()) {
+      llvm::StringRef Name;
+      if (!I.getName(Name) && !Name.empty())
+        Needed.push_back(Name.str());
+    }
+  }
+  return Needed;
+}
+
 /// Bloom filter is a stochastic data structure which can tell us if a symbol
 /// name does not exist in a library with 100% certainty. If it tells us it
 /// exists this may not be true:
@@ -343,15 +909,34 @@ namespace cling {
 
     LibraryPaths m_Libraries;
     LibraryPaths m_SysLibraries;
+    /// The real paths of the directories scanned, mapped to whether their
+    /// libraries went to m_SysLibraries.
+    llvm::StringMap<bool> m_ScannedDirs;
     /// Contains a set of libraries which we gave to the user via ResolveSymbol
     /// call and next time we should check if the user loaded them to avoid
     /// useless iterations.
     std::vector<LibraryPath> m_QueriedLibraries;
+    /// The names by which libraries need the libraries that the search found,
+    /// and that got loaded with their dependencies.
+    llvm::StringSet<> m_LoadedProviders;
 
     using PermanentlyIgnoreCallbackProto = std::function<bool(llvm::StringRef)>;
     const PermanentlyIgnoreCallbackProto m_ShouldPermanentlyIgnoreCallback;
     const llvm::StringRef m_ExecutableFormat;
 
+    /// Builds the bloom filters of many libraries at once, created upon the
+    /// first cold search.
+    mutable std::unique_ptr<llvm::ThreadPool> m_ScanPool;
+
+    /// The number of bloom filters built, to tell when the banks are stale.
+    mutable std::atomic<unsigned> m_FiltersBuilt{0};
+
+    /// The verdicts of the libraries ignored, kept available to the other
+    /// interpreters of the process while this one lives.
+    mutable std::vector<std::shared_ptr<const SymbolIndex>> m_IgnoredIndexes;
+    BloomFilterBank m_LibrariesBank;
+    BloomFilterBank m_SysLibrariesBank;
+
     /// Scan for shared objects which are not yet loaded. They are a our symbol
     /// resolution candidate sources.
     /// NOTE: We only scan not loaded shared objects.
@@ -359,20 +944,98 @@ namespace cling {
     ///            locations for shared objects.
     void ScanForLibraries(bool searchSystemLibraries = false);
 
-    /// Builds a bloom filter lookup optimization.
-    void BuildBloomFilter(LibraryPath* Lib, llvm::object::ObjectFile *BinObjFile,
-                          unsigned IgnoreSymbolFlags = 0) const;
+    /// Registers the not yet loaded libraries of the directory RealPath,
+    /// unless it was scanned already.
+    ///\param[in] Front - whether they go before the libraries registered.
+    void ScanDirectory(const std::string& RealPath, bool System,
+                       bool Front = false);
 
+    /// Registers the library at the real path FileName, unless ignored.
+    ///\returns the library registered, or null.
+    const LibraryPath* RegisterLibrary(std::string FileName, bool System);
+
+    /// Builds a bloom filter lookup optimization, collecting the symbols of
+    /// Lib in Symbols. They point into BinObjFile or Storage.
+    void BuildBloomFilter(LibraryPath* Lib, llvm::object::ObjectFile *BinObjFile,
+                          unsigned IgnoreSymbolFlags,
+                          std::vector<llvm::StringRef>& Symbols,
+                          std::list<std::string>& Storage) const;
+
+    /// Builds the bloom filter of Lib and stores it in the symbol index.
+    void BuildSymbolIndex(LibraryPath* Lib, llvm::object::ObjectFile *BinObjFile,
+                          unsigned IgnoreSymbolFlags) const;
+
+    /// Builds the missing bloom filters of Libs concurrently, such that the
+    /// in-order search after it only tests filters.
+    void BuildBloomFilters(const std::vector<const LibraryPath*>& Libs,
+                           unsigned IgnoreSymbolFlags) const;
+
+
+    /// The file names of the libraries Lib needs, read from BinObjFile, or
+    /// from Lib's file if null.
+    const std::vector<std::string>&
+    GetNeededLibraries(LibraryPath* Lib,
+                       llvm::object::ObjectFile *BinObjFile = nullptr) const;
+
+    /// The scanned library that the dynamic linker finds for the name Needed,
+    /// needed by Lib: in Lib's directory, else in the search paths.
+    LibraryPath* FindNeededLibrary(const LibraryPath& Lib,
+                                   llvm::StringRef Needed) const;
+
+    /// The scanned libraries that loading Lib brings in, Lib first.
+    ///\param[out] Names - the names by which they are needed, if not null.
+    std::vector<LibraryPath*>
+    CollectDependencies(LibraryPath* Lib,
+                        llvm::StringSet<>* Names = nullptr) const;
+
+    /// Reads the files of Lib's dependencies on the scan threads, such that
+    /// loading Lib finds them in the page cache.
+    void PreloadDependencies(LibraryPath* Lib) const;
+
+    /// Whether Lib needs a library in m_LoadedProviders: the symbols missing
+    /// after loading a library often come from the libraries linked against
+    /// it.
+    bool IsLikelyProvider(const LibraryPath* Lib) const;
+
+    /// Moves the likely providers of Libs first.
+    void PrioritizeLibraries(std::vector<const LibraryPath*>& Libs) const;
+
+    /// The libraries of Libs whose filters may contain the symbol of hash,
+    /// the likely providers first; Bank gets rebuilt from Libs if stale.
+    std::vector<const LibraryPath*>
+    GetCandidates(const LibraryPaths& Libs, BloomFilterBank& Bank,
+                  uint32_t hash) const;
 
     /// Looks up symbols from a an object file, representing the library.
     ///\param[in] Lib - full path to the library.
     ///\param[in] mangledName - the mangled name to look for.
+    ///\param[in] hashedMangle - the GNUHash of mangledName.
     ///\param[in] IgnoreSymbolFlags - The symbols to ignore upon a match.
     ///\returns true on success.
     bool ContainsSymbol(const LibraryPath* Lib, const std::string &mangledName,
+                        uint32_t hashedMangle,
                         unsigned IgnoreSymbolFlags = 0) const;
 
-    bool ShouldPermanentlyIgnore(const std::string& FileName) const;
+    /// Takes the libraries that got loaded since they were last found out of
+    /// the search, with their dependencies.
+    void ForgetLoadedLibraries();
+
+    /// Records that the search found Lib, which is likely to get loaded.
+    void AddQueriedLibrary(const LibraryPath* Lib);
+
+    /// Sets Found[I], if empty, to the first library of Libs defining the
+    /// symbol Names[I], of hash Hashes[I].
+    void SearchLibraries(const LibraryPaths& Libs, BloomFilterBank& Bank,
+                         llvm::ArrayRef<std::string> Names,
+                         llvm::ArrayRef<uint32_t> Hashes,
+                         unsigned IgnoreSymbolFlags,
+                         std::vector<std::string>& Found);
+
+    ///\param[out] Index - the index of FileName, if it is valid.
+    bool ShouldPermanentlyIgnore(const std::string& FileName,
+                                 unsigned IgnoreSymbolFlags,
+                                 std::shared_ptr<const SymbolIndex>& Index)
+      const;
   public:
     Dyld(const cling::DynamicLibraryManager &DLM,
          PermanentlyIgnoreCallbackProto shouldIgnore,
@@ -385,6 +1048,30 @@ namespace cling {
 
     std::string searchLibrariesForSymbol(const std::string& mangledName,
                                          bool searchSystem);
+
+    /// Sets Found[I] to the library found for mangledNames[I], or to an
+    /// empty string.
+    void searchLibrariesForSymbols(llvm::ArrayRef<std::string> mangledNames,
+                                   bool searchSystem,
+                                   std::vector<std::string>& Found);
+
+    /// Registers the libraries of the search path Info, added after the scan
+    /// of its kind; nothing happens before it. A prepended path already
+    /// scanned has its libraries searched first.
+    void addSearchPath(const DynamicLibraryManager::SearchPathInfo& Info,
+                       bool Prepend);
+
+    /// Takes the library at Path, and the scanned libraries it loaded, out of
+    /// the search.
+    void libraryLoaded(llvm::StringRef Path);
+
+    /// Puts the library at Path back in the search, if it is in a directory
+    /// scanned.
+    void libraryUnloaded(llvm::StringRef Path);
+
+    /// Leaks the pool of the parent, whose threads a fork() did not copy; the
+    /// next scan makes a new one.
+    void onForked() { m_ScanPool.release(); }
   };
 
   void Dyld::ScanForLibraries(bool searchSystemLibraries/* = false*/) {
@@ -420,50 +1107,117 @@ namespace cling {
 
         // m_BasePaths = ["/lib/1", "/lib/3", "/system/lib"]
         // m_*Libraries  = [<0,"1.so">, <1,"1.so">, <2,"s.so">, <1,"3.so">]
-        std::string RealPath = getRealPath(Info.Path);
-        llvm::StringRef DirPath(RealPath);
+        ScanDirectory(getRealPath(Info.Path), searchSystemLibraries);
+      }
+    }
+  }
 
-        if (!llvm::sys::fs::is_directory(DirPath) || DirPath.empty())
-          continue;
+  void Dyld::ScanDirectory(const std::string& RealPath, bool System,
+                           bool Front/* = false*/) {
+    llvm::StringRef DirPath(RealPath);
+    if (DirPath.empty() || !llvm::sys::fs::is_directory(DirPath))
+      return;
 
-        // Already searched?
-        bool WasInserted;
-        m_BasePaths.RegisterBasePath(RealPath, &WasInserted);
+    // Already searched? Not the same as having a base path: the links of
+    // another directory might point into this one.
+    if (!m_ScannedDirs.insert({DirPath, System}).second)
+      return;
 
-        if (!WasInserted)
-          continue;
+    std::vector<const LibraryPath*> Added;
+    std::error_code EC;
+    for (llvm::sys::fs::directory_iterator DirIt(DirPath, EC), DirEnd;
+         DirIt != DirEnd && !EC; DirIt.increment(EC)) {
+      // FIXME: Use a StringRef here!
+      if (const LibraryPath* Lib = RegisterLibrary(getRealPath(DirIt->path()),
+                                                   System))
+        Added.push_back(Lib);
+    }
+    if (Front)
+      (System ? m_SysLibraries : m_Libraries).MoveToFront(Added);
+  }
 
-        std::error_code EC;
-        for (llvm::sys::fs::directory_iterator DirIt(DirPath, EC), DirEnd;
-             DirIt != DirEnd && !EC; DirIt.increment(EC)) {
-
-          // FIXME: Use a StringRef here!
-          std::string FileName = getRealPath(DirIt->path());
-          assert(!llvm::sys::fs::is_symlink_file(FileName));
-
-          if (ShouldPermanentlyIgnore(FileName))
-            continue;
-
-          std::string FileRealPath = llvm::sys::path::parent_path(FileName);
-          FileName = llvm::sys::path::filename(FileName);
-          const BasePath& BaseP = m_BasePaths.RegisterBasePath(FileRealPath);
-          LibraryPath LibPath(BaseP, FileName);
-          if (m_SysLibraries.HasRegisteredLib(LibPath) ||
-              m_Libraries.HasRegisteredLib(LibPath))
-            continue;
-
-          if (searchSystemLibraries)
-            m_SysLibraries.RegisterLib(LibPath);
-          else
-            m_Libraries.RegisterLib(LibPath);
-        }
-      }
+  const LibraryPath* Dyld::RegisterLibrary(std::string FileName,
+                                           bool System) {
+    assert(!llvm::sys::fs::is_symlink_file(FileName));
+    // Must match the flags searchLibrariesForSymbol uses for each kind.
+    const unsigned IgnoreSymbolFlags = System
+      ? llvm::object::SymbolRef::SF_Undefined | llvm::object::SymbolRef::SF_Weak
+      : llvm::object::SymbolRef::SF_Undefined;
+
+    std::shared_ptr<const SymbolIndex> Index;
+    if (ShouldPermanentlyIgnore(FileName, IgnoreSymbolFlags, Index))
+      return nullptr;
+
+    std::string FileRealPath = llvm::sys::path::parent_path(FileName);
+    FileName = llvm::sys::path::filename(FileName);
+    const BasePath& BaseP = m_BasePaths.RegisterBasePath(FileRealPath);
+    LibraryPath LibPath(BaseP, FileName);
+    LibPath.m_Index = std::move(Index);
+    if (m_SysLibraries.HasRegisteredLib(LibPath) ||
+        m_Libraries.HasRegisteredLib(LibPath))
+      return nullptr;
+
+    LibraryPaths& Libs = System ? m_SysLibraries : m_Libraries;
+    Libs.RegisterLib(LibPath);
+    return Libs.GetRegisteredLib(LibPath);
+  }
+
+  void Dyld::addSearchPath(const DynamicLibraryManager::SearchPathInfo& Info,
+                           bool Prepend) {
+    // The first scan of the kind will see it.
+    if (Info.IsUser ? m_FirstRun : m_FirstRunSysLib)
+      return;
+    const std::string RealPath = getRealPath(Info.Path);
+    auto Scanned = m_ScannedDirs.find(RealPath);
+    if (Scanned == m_ScannedDirs.end()) {
+      ScanDirectory(RealPath, !Info.IsUser, Prepend);
+      return;
     }
+    if (!Prepend)
+      return;
+    // Moved to the front of the search paths.
+    LibraryPaths& Libs = Scanned->second ? m_SysLibraries : m_Libraries;
+    std::vector<const LibraryPath*> InDir;
+    for (const LibraryPath* Lib : Libs.GetLibraries())
+      if (Lib->m_Path == RealPath)
+        InDir.push_back(Lib);
+    Libs.MoveToFront(InDir);
+  }
+
+  void Dyld::libraryLoaded(llvm::StringRef Path) {
+    const std::string RealPath = getRealPath(Path);
+    const BasePath Dir = llvm::sys::path::parent_path(RealPath).str();
+    LibraryPath P(Dir, llvm::sys::path::filename(RealPath).str());
+    const LibraryPath* Lib = m_Libraries.GetRegisteredLib(P);
+    if (!Lib)
+      Lib = m_SysLibraries.GetRegisteredLib(P);
+    if (!Lib)
+      return;
+    // Its dependencies got loaded with it; no need to search them again.
+    std::vector<LibraryPath> Loaded;
+    for (LibraryPath* Dep
+           : CollectDependencies(const_cast<LibraryPath*>(Lib),
+                                 &m_LoadedProviders))
+      Loaded.push_back(*Dep);
+    for (const LibraryPath& L : Loaded) {
+      m_Libraries.UnregisterLib(L);
+      m_SysLibraries.UnregisterLib(L);
+    }
+  }
+
+  void Dyld::libraryUnloaded(llvm::StringRef Path) {
+    const std::string RealPath = getRealPath(Path);
+    auto Scanned
+      = m_ScannedDirs.find(llvm::sys::path::parent_path(RealPath));
+    if (Scanned != m_ScannedDirs.end())
+      RegisterLibrary(RealPath, Scanned->second);
   }
 
   void Dyld::BuildBloomFilter(LibraryPath* Lib,
                               llvm::object::ObjectFile *BinObjFile,
-                              unsigned IgnoreSymbolFlags /*= 0*/) const {
+                              unsigned IgnoreSymbolFlags,
+                              std::vector<llvm::StringRef>& symbols,
+                              std::list<std::string>& namesStorage) const {
     assert(m_UseBloomFilter && "Bloom filter is disabled");
     assert(!Lib->hasBloomFilter() && "Already built!");
 
@@ -473,7 +1227,6 @@ namespace cling {
     // If BloomFilter is empty then build it.
     // Count Symbols and generate BloomFilter
     uint32_t SymbolsCount = 0;
-    std::list<llvm::StringRef> symbols;
     for (const llvm::object::SymbolRef &S : BinObjFile->symbols()) {
       uint32_t Flags = S.getFlags();
       // Do not insert in the table symbols flagged to ignore.
@@ -555,8 +1308,33 @@ namespace cling {
         symbols.push_back(Name);
       }
     }
+    else if (BinObjFile->isMachO()) {
+      const auto *MachOObj = cast<llvm::object::MachOObjectFile>(BinObjFile);
+
+      // Stripped dylibs keep only their exports, in the export trie. Like
+      // .dynsym on ELF, it is what dlsym can find.
+      llvm::Error Err = llvm::Error::success();
+      for (const object::ExportEntry &E : MachOObj->exports(Err)) {
+        if ((IgnoreSymbolFlags & llvm::object::SymbolRef::SF_Weak) &&
+            (E.flags() & MachO::EXPORT_SYMBOL_FLAGS_WEAK_DEFINITION))
+          continue;
+        if (E.name().empty())
+          continue;
+
+        // The entry's name is overwritten as the trie is walked.
+        namesStorage.push_back(E.name().str());
+        ++SymbolsCount;
+        symbols.push_back(namesStorage.back());
+      }
+      if (Err) {
+        cling::errs() << "Dyld::BuildBloomFilter: Failed to read the exports "
+                      << "of " << Lib->GetFullName() << ": "
+                      << llvm::toString(std::move(Err)) << "\n";
+      }
+    }
 
     Lib->InitializeBloomFilter(SymbolsCount);
+    ++m_FiltersBuilt;
 
     if (!SymbolsCount) {
       if (DEBUG > 7)
@@ -571,16 +1349,195 @@ namespace cling {
     }
 
     // Generate BloomFilter
-    for (const auto &S : symbols) {
-      if (m_UseHashTable)
-        Lib->AddBloom(Lib->AddSymbol(S));
-      else
-        Lib->AddBloom(S);
+    for (const auto &S : symbols)
+      Lib->AddBloom(S);
+  }
+
+  void Dyld::BuildSymbolIndex(LibraryPath* Lib,
+                              llvm::object::ObjectFile *BinObjFile,
+                              unsigned IgnoreSymbolFlags) const {
+    // The names stay in the object file's buffer until they are indexed.
+    std::vector<llvm::StringRef> Symbols;
+    std::list<std::string> Storage;
+    BuildBloomFilter(Lib, BinObjFile, IgnoreSymbolFlags, Symbols, Storage);
+    GetNeededLibraries(Lib, BinObjFile);
+    if (!m_UseHashTable)
+      return;
+    const std::string LibName = Lib->GetFullName();
+    std::shared_ptr<const SymbolIndex> Index
+      = SymbolIndex::Create(LibName, IgnoreSymbolFlags, &Lib->m_Filter,
+                            &Symbols);
+    if (!Index)
+      return;
+    const std::string IndexFile = SymbolIndex::GetFile(LibName,
+                                                       IgnoreSymbolFlags);
+    if (!IndexFile.empty() && Index->Write(IndexFile)) {
+      // Map what was written rather than keeping the copy: the pages are
+      // then clean, and shared with the sessions mapping the same index.
+      auto Mapped = std::make_shared<SymbolIndex>();
+      if (Mapped->Load(IndexFile, LibName, IgnoreSymbolFlags))
+        Index = std::move(Mapped);
+    }
+    SharedSymbolIndexes::Get().Add(LibName, IgnoreSymbolFlags, Index);
+    // The index replaces the filter and the symbols, and is shared.
+    Lib->m_Index = std::move(Index);
+    std::vector<uint64_t>().swap(Lib->m_Filter.m_BloomTable);
+  }
+
+  void Dyld::BuildBloomFilters(const std::vector<const LibraryPath*>& Libs,
+                               unsigned IgnoreSymbolFlags) const {
+    // Without the hash table, ContainsSymbol reads the library anyway.
+    if (!m_UseBloomFilter || !m_UseHashTable)
+      return;
+
+    static const unsigned Threads = getScanThreads();
+    if (Threads <= 1)
+      return;
+
+    std::vector<LibraryPath*> Pending;
+    for (const LibraryPath* P : Libs)
+      if (!P->hasBloomFilter())
+        Pending.push_back(const_cast<LibraryPath*>(P));
+    if (Pending.size() < 2)
+      return;
+
+    if (!m_ScanPool)
+      m_ScanPool.reset(new llvm::ThreadPool(Threads));
+
+    // Each job only touches its own library.
+    for (LibraryPath* Lib : Pending) {
+      m_ScanPool->async([this, Lib, IgnoreSymbolFlags]() {
+        auto ObjF = llvm::object::ObjectFile::createObjectFile(
+          Lib->GetFullName());
+        if (!ObjF) {
+          // ContainsSymbol reports it during the search.
+          llvm::consumeError(ObjF.takeError());
+          return;
+        }
+        BuildSymbolIndex(Lib, ObjF.get().getBinary(), IgnoreSymbolFlags);
+      });
+    }
+    m_ScanPool->wait();
+  }
+
+  const std::vector<std::string>&
+  Dyld::GetNeededLibraries(LibraryPath* Lib,
+                           llvm::object::ObjectFile *BinObjFile) const {
+    if (Lib->m_NeededRead)
+      return Lib->m_Needed;
+    Lib->m_NeededRead = true;
+    if (BinObjFile) {
+      Lib->m_Needed = ::GetNeededLibraries(BinObjFile);
+      return Lib->m_Needed;
+    }
+    // An indexed library was not read yet.
+    auto ObjF = llvm::object::ObjectFile::createObjectFile(Lib->GetFullName());
+    if (!ObjF) {
+      llvm::consumeError(ObjF.takeError());
+      return Lib->m_Needed;
     }
+    Lib->m_Needed = ::GetNeededLibraries(ObjF.get().getBinary());
+    return Lib->m_Needed;
+  }
+
+  LibraryPath* Dyld::FindNeededLibrary(const LibraryPath& Lib,
+                                       llvm::StringRef Needed) const {
+    auto Find = [&](llvm::StringRef Dir) -> LibraryPath* {
+      llvm::SmallString<512> Path(Dir);
+      llvm::sys::path::append(Path, Needed);
+      if (!llvm::sys::fs::exists(Path))
+        return nullptr;
+      const std::string RealPath = getRealPath(Path);
+      const BasePath RealDir = llvm::sys::path::parent_path(RealPath).str();
+      LibraryPath Key(RealDir, llvm::sys::path::filename(RealPath).str());
+      const LibraryPath* Found = m_Libraries.GetRegisteredLib(Key);
+      if (!Found)
+        Found = m_SysLibraries.GetRegisteredLib(Key);
+      // The sets hash the path and the name only, which stay as they are.
+      return const_cast<LibraryPath*>(Found);
+    };
+    if (LibraryPath* Found = Find(Lib.m_Path))
+      return Found;
+    for (const auto& Info : m_DynamicLibraryManager.getSearchPaths())
+      if (LibraryPath* Found = Find(Info.Path))
+        return Found;
+    return nullptr;
+  }
+
+  std::vector<LibraryPath*>
+  Dyld::CollectDependencies(LibraryPath* Lib, llvm::StringSet<>* Names) const {
+    std::vector<LibraryPath*> Deps{Lib};
+    if (Names)
+      Names->insert(Lib->m_LibName);
+    for (size_t I = 0; I < Deps.size(); ++I) {
+      for (const std::string& Needed : GetNeededLibraries(Deps[I])) {
+        if (Names)
+          Names->insert(Needed);
+        LibraryPath* Dep = FindNeededLibrary(*Deps[I], Needed);
+        if (Dep && std::find(Deps.begin(), Deps.end(), Dep) == Deps.end())
+          Deps.push_back(Dep);
+      }
+    }
+    return Deps;
+  }
+
+  void Dyld::PreloadDependencies(LibraryPath* Lib) const {
+    static const unsigned Threads = getScanThreads();
+    if (Threads <= 1)
+      return;
+    std::vector<LibraryPath*> Deps = CollectDependencies(Lib);
+    if (Deps.size() < 2)
+      return;
+    if (!m_ScanPool)
+      m_ScanPool.reset(new llvm::ThreadPool(Threads));
+    for (const LibraryPath* Dep : Deps) {
+      m_ScanPool->async([](std::string FileName) {
+        auto MB = llvm::MemoryBuffer::getFile(FileName, /*FileSize*/ -1,
+                                              /*RequiresNullTerminator*/false);
+        if (!MB)
+          return;
+        // Touch each page of the mapping.
+        volatile char Sink = 0;
+        const llvm::StringRef Buf = (*MB)->getBuffer();
+        for (size_t I = 0; I < Buf.size(); I += 4096)
+          Sink += Buf[I];
+        (void)Sink;
+      }, Dep->GetFullName());
+    }
+  }
+
+  bool Dyld::IsLikelyProvider(const LibraryPath* Lib) const {
+    // Only the libraries read so far; reading all would undo the index.
+    for (const std::string& Needed : Lib->m_Needed)
+      if (m_LoadedProviders.count(Needed))
+        return true;
+    return false;
+  }
+
+  void Dyld::PrioritizeLibraries(std::vector<const LibraryPath*>& Libs) const {
+    if (m_LoadedProviders.empty())
+      return;
+    std::stable_partition(Libs.begin(), Libs.end(),
+                          [this](const LibraryPath* P) {
+      return IsLikelyProvider(P);
+    });
+  }
+
+  std::vector<const LibraryPath*>
+  Dyld::GetCandidates(const LibraryPaths& Libs, BloomFilterBank& Bank,
+                      uint32_t hash) const {
+    if (Bank.IsStale(Libs.GetGeneration(), m_FiltersBuilt))
+      Bank.Build(Libs.GetLibraries(), m_UseBloomFilter && m_UseHashTable,
+                 Libs.GetGeneration(), m_FiltersBuilt);
+    std::vector<const LibraryPath*> Candidates;
+    Bank.Test(hash, Candidates);
+    PrioritizeLibraries(Candidates);
+    return Candidates;
   }
 
   bool Dyld::ContainsSymbol(const LibraryPath* Lib,
                             const std::string &mangledName,
+                            uint32_t hashedMangle,
                             unsigned IgnoreSymbolFlags /*= 0*/) const {
     const std::string library_filename = Lib->GetFullName();
 
@@ -590,6 +1547,20 @@ namespace cling {
                     << mangledName << "\n";
     }
 
+    // A filter built by BuildBloomFilters or an earlier query, maybe the
+    // index of another process, answers without reading the library.
+    // Without the index, as SymbolIndex::Create() failed, the filter can
+    // only rule the symbol out; the library's symbols are then scanned.
+    if (m_UseBloomFilter && m_UseHashTable && Lib->hasBloomFilter()
+        && (Lib->m_Index || !Lib->MayExistSymbol(hashedMangle))) {
+      bool result = Lib->MayExistSymbol(hashedMangle)
+        && Lib->ExistSymbol(mangledName);
+      if (DEBUG > 7)
+        cling::errs() << "Dyld::ContainsSymbol: Filter: Symbol "
+                      << (result ? "Exist" : "Not exist") << "\n";
+      return result;
+    }
+
     auto ObjF = llvm::object::ObjectFile::createObjectFile(library_filename);
     if (llvm::Error Err = ObjF.takeError()) {
       if (DEBUG > 1) {
@@ -605,7 +1576,6 @@ namespace cling {
 
     llvm::object::ObjectFile *BinObjFile = ObjF.get().getBinary();
 
-    uint32_t hashedMangle = GNUHash(mangledName);
     // Check for the gnu.hash section if ELF.
     // If the symbol doesn't exist, exit early.
     if (BinObjFile->isELF() &&
@@ -615,7 +1585,7 @@ namespace cling {
     if (m_UseBloomFilter) {
       // Use our bloom filters and create them if necessary.
       if (!Lib->hasBloomFilter())
-        BuildBloomFilter(const_cast<LibraryPath*>(Lib), BinObjFile,
+        BuildSymbolIndex(const_cast<LibraryPath*>(Lib), BinObjFile,
                          IgnoreSymbolFlags);
 
       // If the symbol does not exist, exit early. In case it may exist, iterate.
@@ -629,7 +1599,7 @@ namespace cling {
                       << " Search for it.";
     }
 
-    if (m_UseHashTable) {
+    if (m_UseHashTable && Lib->m_Index) {
       bool result = Lib->ExistSymbol(mangledName);
       if (DEBUG > 7)
         cling::errs() << "Dyld::ContainsSymbol: HashTable: Symbol "
@@ -670,8 +1640,8 @@ namespace cling {
             cling::errs() << "Dyld::ContainsSymbol: Symbol "
                           << mangledName << " found in "
                           << library_filename << "\n";
-            return true;
           }
+          return true;
         }
       }
       return false;
@@ -696,7 +1666,9 @@ namespace cling {
                          IgnoreSymbolFlags, mangledName);
   }
 
-  bool Dyld::ShouldPermanentlyIgnore(const std::string& FileName) const {
+  bool Dyld::ShouldPermanentlyIgnore(const std::string& FileName,
+                                     unsigned IgnoreSymbolFlags,
+                              std::shared_ptr<const SymbolIndex>& Index) const {
     assert(!m_ExecutableFormat.empty() && "Failed to find the object format!");
 
     if (llvm::sys::fs::is_directory(FileName))
@@ -710,13 +1682,48 @@ namespace cling {
     if (m_DynamicLibraryManager.isLibraryLoaded(FileName.c_str()))
       return true;
 
+    // A valid index keeps the verdict of an earlier scan, maybe by another
+    // interpreter of this process.
+    Index = SharedSymbolIndexes::Get().Find(FileName, IgnoreSymbolFlags);
+    if (Index) {
+      if (!Index->IsIgnored())
+        return false;
+      m_IgnoredIndexes.push_back(std::move(Index));
+      return true;
+    }
+    const std::string IndexFile
+      = SymbolIndex::GetFile(FileName, IgnoreSymbolFlags);
+    if (!IndexFile.empty()) {
+      auto I = std::make_shared<SymbolIndex>();
+      if (I->Load(IndexFile, FileName, IgnoreSymbolFlags)) {
+        SharedSymbolIndexes::Get().Add(FileName, IgnoreSymbolFlags, I);
+        if (I->IsIgnored()) {
+          m_IgnoredIndexes.push_back(std::move(I));
+          return true;
+        }
+        Index = std::move(I);
+        return false;
+      }
+    }
+    auto Ignore = [&]() {
+      auto I = SymbolIndex::Create(FileName, IgnoreSymbolFlags,
+                                   /*Filter*/ nullptr, /*Symbols*/ nullptr);
+      if (I) {
+        if (!IndexFile.empty())
+          I->Write(IndexFile);
+        SharedSymbolIndexes::Get().Add(FileName, IgnoreSymbolFlags, I);
+        m_IgnoredIndexes.push_back(std::move(I));
+      }
+      return true;
+    };
 
     auto ObjF = llvm::object::ObjectFile::createObjectFile(FileName);
     if (!ObjF) {
       if (DEBUG > 1)
         cling::errs() << "[DyLD] Failed to read object file "
                       << FileName << "\n";
-      return true;
+      llvm::consumeError(ObjF.takeError());
+      return Ignore();
     }
 
     llvm::object::ObjectFile *file = ObjF.get().getBinary();
@@ -728,7 +1735,7 @@ namespace cling {
 
     // Ignore libraries with different format than the executing one.
     if (m_ExecutableFormat != file->getFileFormatName())
-      return true;
+      return Ignore();
 
     if (llvm::isa<llvm::object::ELFObjectFileBase>(*file)) {
       for (auto S : file->sections()) {
@@ -741,12 +1748,14 @@ namespace cling {
           // objcopy libraries.
           auto SecRef = static_cast<llvm::object::ELFSectionRef&>(S);
           if (SecRef.getType() == llvm::ELF::SHT_NOBITS)
-            return true;
+            return Ignore();
 
-          return (SecRef.getFlags() & llvm::ELF::SHF_ALLOC) == 0;
+          if ((SecRef.getFlags() & llvm::ELF::SHF_ALLOC) == 0)
+            return Ignore();
+          return false;
         }
       }
-      return true;
+      return Ignore();
     }
 
     //FIXME: Handle osx using isStripped after upgrading to llvm9.
@@ -754,8 +1763,104 @@ namespace cling {
     return m_ShouldPermanentlyIgnoreCallback(FileName);
   }
 
+  void Dyld::ForgetLoadedLibraries() {
+    if (m_QueriedLibraries.empty())
+      return;
+    // Last call we were asked if a library contains a symbol. Usually, the
+    // caller wants to load this library. Check if was loaded and remove it
+    // from our lists of not-yet-loaded libs.
+
+    if (DEBUG > 7) {
+      cling::errs() << "Dyld::ResolveSymbol: m_QueriedLibraries:\n";
+      size_t x = 0;
+      for (auto item : m_QueriedLibraries) {
+        cling::errs() << "Dyld::ResolveSymbol - [" << x++ << "]:"
+                      << &item << ": " << item.m_Path << ", "
+                      << item.m_LibName << "\n";
+      }
+    }
+
+    for (const LibraryPath& P : m_QueriedLibraries) {
+      const std::string LibName = P.GetFullName();
+      if (!m_DynamicLibraryManager.isLibraryLoaded(LibName))
+        continue;
+
+      // Its dependencies got loaded with it; no need to search them again.
+      std::vector<LibraryPath> Loaded;
+      const LibraryPath* Lib = m_Libraries.GetRegisteredLib(P);
+      if (!Lib)
+        Lib = m_SysLibraries.GetRegisteredLib(P);
+      if (Lib) {
+        for (LibraryPath* Dep
+               : CollectDependencies(const_cast<LibraryPath*>(Lib),
+                                     &m_LoadedProviders))
+          Loaded.push_back(*Dep);
+      } else
+        Loaded.push_back(P);
+
+      for (const LibraryPath& L : Loaded) {
+        m_Libraries.UnregisterLib(L);
+        m_SysLibraries.UnregisterLib(L);
+      }
+    }
+  }
+
+  void Dyld::AddQueriedLibrary(const LibraryPath* Lib) {
+    m_QueriedLibraries.push_back(*Lib);
+    PreloadDependencies(const_cast<LibraryPath*>(Lib));
+  }
+
+  void Dyld::SearchLibraries(const LibraryPaths& Libs, BloomFilterBank& Bank,
+                             llvm::ArrayRef<std::string> Names,
+                             llvm::ArrayRef<uint32_t> Hashes,
+                             unsigned IgnoreSymbolFlags,
+                             std::vector<std::string>& Found) {
+    std::vector<uint32_t> Pending;
+    std::vector<unsigned> PendingIdx;
+    for (unsigned I = 0, E = Names.size(); I < E; ++I)
+      if (Found[I].empty()) {
+        Pending.push_back(Hashes[I]);
+        PendingIdx.push_back(I);
+      }
+    if (Pending.empty())
+      return;
+
+    if (Bank.IsStale(Libs.GetGeneration(), m_FiltersBuilt))
+      Bank.Build(Libs.GetLibraries(), m_UseBloomFilter && m_UseHashTable,
+                 Libs.GetGeneration(), m_FiltersBuilt);
+    std::vector<std::pair<const LibraryPath*, std::vector<unsigned>>> Cands;
+    Bank.Test(Pending, Cands);
+    // The order GetCandidates() gives each symbol.
+    if (!m_LoadedProviders.empty())
+      std::stable_partition(Cands.begin(), Cands.end(),
+          [this](const std::pair<const LibraryPath*,
+                                 std::vector<unsigned>>& C) {
+        return IsLikelyProvider(C.first);
+      });
+
+    size_t Left = Pending.size();
+    for (const auto& C : Cands) {
+      const LibraryPath* P = C.first;
+      bool Provides = false;
+      for (unsigned H : C.second) {
+        const unsigned I = PendingIdx[H];
+        if (!Found[I].empty()
+            || !ContainsSymbol(P, Names[I], Hashes[I], IgnoreSymbolFlags))
+          continue;
+        Found[I] = P->GetFullName();
+        Provides = true;
+        --Left;
+      }
+      if (Provides)
+        AddQueriedLibrary(P);
+      if (!Left)
+        return;
+    }
+  }
+
   std::string Dyld::searchLibrariesForSymbol(const std::string& mangledName,
                                              bool searchSystem/* = true*/) {
+    CLING_TRACE_SCOPE(Trace, kLibrarySearch, mangledName);
     assert(!llvm::sys::DynamicLibrary::SearchForAddressOfSymbol(mangledName) &&
            "Library already loaded, please use dlsym!");
     assert(!mangledName.empty());
@@ -767,38 +1872,20 @@ namespace cling {
       m_FirstRun = false;
     }
 
-    if (!m_QueriedLibraries.empty()) {
-      // Last call we were asked if a library contains a symbol. Usually, the
-      // caller wants to load this library. Check if was loaded and remove it
-      // from our lists of not-yet-loaded libs.
+    ForgetLoadedLibraries();
 
-      if (DEBUG > 7) {
-        cling::errs() << "Dyld::ResolveSymbol: m_QueriedLibraries:\n";
-        size_t x = 0;
-        for (auto item : m_QueriedLibraries) {
-          cling::errs() << "Dyld::ResolveSymbol - [" << x++ << "]:"
-                        << &item << ": " << item.m_Path << ", "
-                        << item.m_LibName << "\n";
-        }
-      }
-
-      for (const LibraryPath& P : m_QueriedLibraries) {
-        const std::string LibName = P.GetFullName();
-        if (!m_DynamicLibraryManager.isLibraryLoaded(LibName))
-          continue;
-
-        m_Libraries.UnregisterLib(P);
-        m_SysLibraries.UnregisterLib(P);
-      }
-    }
+    BuildBloomFilters(m_Libraries.GetLibraries(),
+                      llvm::object::SymbolRef::SF_Undefined);
 
+    const uint32_t hashedMangle = GNUHash(mangledName);
     // Iterate over files under this path. We want to get each ".so" files
-    for (const LibraryPath* P : m_Libraries.GetLibraries()) {
+    for (const LibraryPath* P
+           : GetCandidates(m_Libraries, m_LibrariesBank, hashedMangle)) {
       const std::string LibName = P->GetFullName();
 
-      if (ContainsSymbol(P, mangledName, /*ignore*/
+      if (ContainsSymbol(P, mangledName, hashedMangle, /*ignore*/
                          llvm::object::SymbolRef::SF_Undefined)) {
-        m_QueriedLibraries.push_back(*P);
+        AddQueriedLibrary(P);
         return LibName;
       }
     }
@@ -815,12 +1902,17 @@ namespace cling {
       m_FirstRunSysLib = false;
     }
 
-    for (const LibraryPath* P : m_SysLibraries.GetLibraries()) {
+    BuildBloomFilters(m_SysLibraries.GetLibraries(),
+                      llvm::object::SymbolRef::SF_Undefined |
+                      llvm::object::SymbolRef::SF_Weak);
+
+    for (const LibraryPath* P
+           : GetCandidates(m_SysLibraries, m_SysLibrariesBank, hashedMangle)) {
       const std::string LibName = P->GetFullName();
-      if (ContainsSymbol(P, mangledName, /*ignore*/
+      if (ContainsSymbol(P, mangledName, hashedMangle, /*ignore*/
                          llvm::object::SymbolRef::SF_Undefined |
                          llvm::object::SymbolRef::SF_Weak)) {
-        m_QueriedLibraries.push_back(*P);
+        AddQueriedLibrary(P);
         return LibName;
       }
     }
@@ -863,6 +1955,46 @@ namespace cling {
     return ""; // Search found no match.
   }
 
+  void Dyld::searchLibrariesForSymbols(llvm::ArrayRef<std::string> mangledNames,
+                                       bool searchSystem,
+                                       std::vector<std::string>& Found) {
+    CLING_TRACE_SCOPE(Trace, kLibrarySearch,
+                      std::to_string(mangledNames.size()) + " symbols");
+    Found.assign(mangledNames.size(), std::string());
+    if (mangledNames.empty())
+      return;
+
+    if (m_FirstRun) {
+      ScanForLibraries(/* SearchSystemLibraries= */ false);
+      m_FirstRun = false;
+    }
+    ForgetLoadedLibraries();
+
+    std::vector<uint32_t> Hashes;
+    Hashes.reserve(mangledNames.size());
+    for (const std::string& Name : mangledNames)
+      Hashes.push_back(GNUHash(Name));
+
+    BuildBloomFilters(m_Libraries.GetLibraries(),
+                      llvm::object::SymbolRef::SF_Undefined);
+    SearchLibraries(m_Libraries, m_LibrariesBank, mangledNames, Hashes,
+                    llvm::object::SymbolRef::SF_Undefined, Found);
+    if (!searchSystem
+        || std::none_of(Found.begin(), Found.end(),
+                        [](const std::string& L) { return L.empty(); }))
+      return;
+
+    if (m_FirstRunSysLib) {
+      ScanForLibraries(/* SearchSystemLibraries= */ true);
+      m_FirstRunSysLib = false;
+    }
+    const unsigned SysFlags = llvm::object::SymbolRef::SF_Undefined
+      | llvm::object::SymbolRef::SF_Weak;
+    BuildBloomFilters(m_SysLibraries.GetLibraries(), SysFlags);
+    SearchLibraries(m_SysLibraries, m_SysLibrariesBank, mangledNames, Hashes,
+                    SysFlags, Found);
+  }
+
   DynamicLibraryManager::~DynamicLibraryManager() {
     static_assert(sizeof(Dyld) > 0, "Incomplete type");
     delete m_Dyld;
@@ -882,17 +2014,109 @@ namespace cling {
                       ObjF.getBinary()->getFileFormatName());
   }
 
+  void DynamicLibraryManager::updateDyld(const SearchPathInfo& Info,
+                                         bool Prepend) {
+    if (m_Dyld)
+      m_Dyld->addSearchPath(Info, Prepend);
+  }
+
+  void DynamicLibraryManager::updateDyld(llvm::StringRef Path, bool Loaded) {
+    if (!m_Dyld)
+      return;
+    if (Loaded)
+      m_Dyld->libraryLoaded(Path);
+    else
+      m_Dyld->libraryUnloaded(Path);
+  }
+
+  void DynamicLibraryManager::onForked() {
+    assert(m_PendingLoads.empty() && "The loading threads are gone");
+    if (m_Dyld)
+      m_Dyld->onForked();
+  }
+
   std::string
   DynamicLibraryManager::searchLibrariesForSymbol(const std::string& mangledName,
                                            bool searchSystem/* = true*/) const {
     assert(m_Dyld && "Must call initialize dyld before!");
-    return m_Dyld->searchLibrariesForSymbol(mangledName, searchSystem);
+    // A miss stays one until the libraries or the search paths change.
+    auto Missing = m_MissingSymbols.find(mangledName);
+    if (Missing != m_MissingSymbols.end() && (Missing->second || !searchSystem))
+      return std::string();
+
+    std::string LibName = m_Dyld->searchLibrariesForSymbol(mangledName,
+                                                           searchSystem);
+    if (LibName.empty())
+      m_MissingSymbols[mangledName] |= searchSystem;
+    return LibName;
+  }
+
+  std::vector<std::string>
+  DynamicLibraryManager::searchLibrariesForSymbols(
+      llvm::ArrayRef<std::string> mangledNames,
+      bool searchSystem/* = true*/) const {
+    assert(m_Dyld && "Must call initialize dyld before!");
+    std::vector<std::string> Libs(mangledNames.size());
+    // Only search for the names that are not known misses.
+    std::vector<std::string> Names;
+    std::vector<size_t> Idx;
+    for (size_t I = 0, E = mangledNames.size(); I < E; ++I) {
+      auto Missing = m_MissingSymbols.find(mangledNames[I]);
+      if (Missing != m_MissingSymbols.end()
+          && (Missing->second || !searchSystem))
+        continue;
+      Names.push_back(mangledNames[I]);
+      Idx.push_back(I);
+    }
+    if (Names.empty())
+      return Libs;
+
+    std::vector<std::string> Found;
+    m_Dyld->searchLibrariesForSymbols(Names, searchSystem, Found);
+    for (size_t I = 0, E = Names.size(); I < E; ++I) {
+      if (Found[I].empty())
+        m_MissingSymbols[Names[I]] |= searchSystem;
+      else
+        Libs[Idx[I]] = std::move(Found[I]);
+    }
+    return Libs;
+  }
+
+  ///\brief The real path of the library named Name, as the loader knows it.
+  static std::string getLibraryLocation(const char* Name) {
+#if defined(_WIN32)
+    return getRealPath(Name);
+#else
+    if (strchr(Name, '/'))
+      return getRealPath(Name);
+    // Else absolute path. For all we know that's a binary.
+    // Some people have dictionaries in binaries, this is how we find their
+    // path: (see also https://stackoverflow.com/a/1024937/6182509)
+# if defined(__APPLE__)
+    char buf[PATH_MAX] = { 0 };
+    uint32_t bufsize = sizeof(buf);
+    if (_NSGetExecutablePath(buf, &bufsize) >= 0)
+      return getRealPath(buf);
+    return getRealPath(Name);
+# elif defined(LLVM_ON_UNIX)
+    char buf[PATH_MAX] = { 0 };
+    // Cross our fingers that /proc/self/exe exists.
+    if (readlink("/proc/self/exe", buf, sizeof(buf)) > 0)
+      return getRealPath(buf);
+    // Search $PATH as the shell does.
+    llvm::ErrorOr<std::string> Program = llvm::sys::findProgramByName(Name);
+    return getRealPath(Program ? *Program : std::string(Name));
+# else
+#  error "Unsupported platform."
+# endif
+#endif
   }
 
   std::string DynamicLibraryManager::getSymbolLocation(void *func) {
 #if defined(__CYGWIN__) && defined(__GNUC__)
     return {};
-#elif defined(_WIN32)
+#else
+# if defined(_WIN32)
     MEMORY_BASIC_INFORMATION mbi;
     if (!VirtualQuery (func, &mbi, sizeof (mbi)))
       return {};
@@ -902,46 +2126,34 @@ namespace cling {
 
     if (!GetModuleFileNameA (hMod, moduleName, sizeof (moduleName)))
       return {};
-
-    return getRealPath(moduleName);
-#else
+    const void* Base = hMod;
+    const char* Name = moduleName;
+# else
     // assume we have  defined HAVE_DLFCN_H and HAVE_DLADDR
     Dl_info info;
     if (dladdr((void*)func, &info) == 0) {
       // Not in a known shared library, let's give up
       return {};
-    } else {
-      if (strchr(info.dli_fname, '/'))
-        return getRealPath(info.dli_fname);
-      // Else absolute path. For all we know that's a binary.
-      // Some people have dictionaries in binaries, this is how we find their
-      // path: (see also https://stackoverflow.com/a/1024937/6182509)
-# if defined(__APPLE__)
-      char buf[PATH_MAX] = { 0 };
-      uint32_t bufsize = sizeof(buf);
-      if (_NSGetExecutablePath(buf, &bufsize) >= 0)
-        return getRealPath(buf);
-      return getRealPath(info.dli_fname);
-# elif defined(LLVM_ON_UNIX)
-      char buf[PATH_MAX] = { 0 };
-      // Cross our fingers that /proc/self/exe exists.
-      if (readlink("/proc/self/exe", buf, sizeof(buf)) > 0)
-        return getRealPath(buf);
-      std::string pipeCmd = std::string("which \"") + info.dli_fname + "\"";
-      FILE* pipe = popen(pipeCmd.c_str(), "r");
-      if (!pipe)
-        return getRealPath(info.dli_fname);
-      std::string result;
-      while (fgets(buf, sizeof(buf), pipe))
-         result += buf;
-
-      pclose(pipe);
-      return getRealPath(result);
-# else
-#  error "Unsupported platform."
+    }
+    const void* Base = info.dli_fbase;
+    const char* Name = info.dli_fname;
 # endif
-      return {};
-   }
+
+    // Printing and exporting ask for many symbols of the same few libraries;
+    // resolve the path of each once. The name tells a library loaded after
+    // another one at the same address apart.
+    static std::mutex CacheMutex;
+    static std::map<std::pair<const void*, std::string>, std::string> Cache;
+    std::pair<const void*, std::string> Key(Base, Name);
+    {
+      std::lock_guard<std::mutex> Lock(CacheMutex);
+      auto Found = Cache.find(Key);
+      if (Found != Cache.end())
+        return Found->second;
+    }
+    std::string Location = getLibraryLocation(Name);
+    std::lock_guard<std::mutex> Lock(CacheMutex);
+    return Cache.emplace(std::move(Key), std::move(Location)).first->second;
 #endif
   }
 
@@ -0,0 +1,34 @@
+#------------------------------------------------------------------------------
+# CLING - the C++ LLVM-based InterpreterG :)
+#
+# This file is dual-licensed: you can choose to license it under the University
+# of Illinois Open Source License or the GNU Lesser General Public License. See
+# LICENSE.TXT for details.
+#------------------------------------------------------------------------------
+
+# Writes OUTPUT, the kEmbeddedHeaders of EmbeddedHeaders.cpp: the contents of
+# the HEADERS, which are relative to ROOT, as null terminated byte arrays.
+#
+#   cmake -DROOT=<dir> -DHEADERS=<h1;h2...> -DOUTPUT=<file> -P EmbedHeaders.cmake
+
+set(_arrays "")
+set(_entries "")
+set(_index 0)
+foreach(_header ${HEADERS})
+  file(READ "${ROOT}/${_header}" _hex HEX)
+  string(LENGTH "${_hex}" _size)
+  math(EXPR _size "${_size} / 2")
+  # Sixteen bytes per line.
+  string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," _bytes "${_hex}")
+  string(REGEX REPLACE "((0x[0-9a-f][0-9a-f],){16})" "\\1\n  " _bytes
+         "${_bytes}")
+  set(_arrays "${_arrays}static const unsigned char kEmbeddedHeader${_index}[] = {\n  ${_bytes}0 };\n")
+  set(_entries "${_entries}  { \"${_header}\", kEmbeddedHeader${_index}, ${_size} },\n")
+  math(EXPR _index "${_index} + 1")
+endforeach()
+
+file(WRITE "${OUTPUT}.tmp"
+  "// Generated by EmbedHeaders.cmake, do not edit.\n${_arrays}\nstatic const EmbeddedHeader kEmbeddedHeaders[] = {\n${_entries}};\n")
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different
+                "${OUTPUT}.tmp" "${OUTPUT}")
+file(REMOVE "${OUTPUT}.tmp")
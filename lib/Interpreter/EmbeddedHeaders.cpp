@@ -0,0 +1,101 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "EmbeddedHeaders.h"
+
+#include "clang/Lex/HeaderSearchOptions.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+#include <cstdlib>
+
+using namespace llvm;
+
+namespace {
+  struct EmbeddedHeader {
+    ///\brief The name to #include, e.g. "cling/Interpreter/Value.h".
+    const char* Name;
+    ///\brief The contents, null terminated.
+    const unsigned char* Data;
+    size_t Size;
+  };
+
+// Generated by EmbedHeaders.cmake: the kEmbeddedHeaders.
+#include <cling-embedded-headers.inc>
+} // unnamed namespace
+
+namespace cling {
+
+  EmbeddedHeadersFileSystem::EmbeddedHeadersFileSystem(
+      IntrusiveRefCntPtr<vfs::FileSystem> FS, StringRef Root):
+    ProxyFileSystem(std::move(FS)), m_Files(new vfs::InMemoryFileSystem),
+    m_Root(Root) {
+    for (const EmbeddedHeader& H : kEmbeddedHeaders) {
+      SmallString<256> Path(m_Root);
+      sys::path::append(Path, H.Name);
+      StringRef Data(reinterpret_cast<const char*>(H.Data), H.Size);
+      m_Files->addFile(Path, /*ModificationTime*/ 0,
+                       MemoryBuffer::getMemBuffer(Data, Path,
+                                                  /*RequiresNullTerminator*/
+                                                  true));
+    }
+  }
+
+  IntrusiveRefCntPtr<vfs::FileSystem>
+  EmbeddedHeadersFileSystem::create(IntrusiveRefCntPtr<vfs::FileSystem> FS,
+                                    clang::HeaderSearchOptions& HSOpts,
+                                    bool Modules) {
+    const char* Env = ::getenv("CLING_EMBEDDED_HEADERS");
+    if (Modules || !HSOpts.UseBuiltinIncludes
+        || (Env && StringRef(Env) == "0"))
+      return FS;
+
+    // Nothing is on disk there: any absolute directory does.
+    SmallString<256> Root(HSOpts.ResourceDir);
+    if (!sys::path::is_absolute(Root))
+      Root = sys::path::get_separator();
+    sys::path::append(Root, "cling-embedded");
+    HSOpts.UserEntries.insert(HSOpts.UserEntries.begin(),
+                              clang::HeaderSearchOptions::Entry(
+                                  Root, clang::frontend::Angled,
+                                  /*IsFramework*/ false,
+                                  /*IgnoreSysRoot*/ true));
+    return new EmbeddedHeadersFileSystem(std::move(FS), Root);
+  }
+
+  bool EmbeddedHeadersFileSystem::isEmbedded(const Twine& Path) const {
+    SmallString<256> Buf;
+    StringRef P = Path.toStringRef(Buf);
+    if (!P.startswith(m_Root))
+      return false;
+    return P.size() == m_Root.size()
+      || sys::path::is_separator(P[m_Root.size()]);
+  }
+
+  ErrorOr<vfs::Status> EmbeddedHeadersFileSystem::status(const Twine& Path) {
+    if (isEmbedded(Path))
+      return m_Files->status(Path);
+    return ProxyFileSystem::status(Path);
+  }
+
+  ErrorOr<std::unique_ptr<vfs::File>>
+  EmbeddedHeadersFileSystem::openFileForRead(const Twine& Path) {
+    if (isEmbedded(Path))
+      return m_Files->openFileForRead(Path);
+    return ProxyFileSystem::openFileForRead(Path);
+  }
+
+  vfs::directory_iterator
+  EmbeddedHeadersFileSystem::dir_begin(const Twine& Dir, std::error_code& EC) {
+    if (isEmbedded(Dir))
+      return m_Files->dir_begin(Dir, EC);
+    return ProxyFileSystem::dir_begin(Dir, EC);
+  }
+} // end namespace cling
@@ -0,0 +1,64 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_EMBEDDED_HEADERS_H
+#define CLING_EMBEDDED_HEADERS_H
+
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+#include <memory>
+#include <string>
+
+namespace clang {
+  class HeaderSearchOptions;
+}
+
+namespace cling {
+  ///\brief Serves the runtime headers that Interpreter::Initialize() and the
+  /// value printer include, e.g. cling/Interpreter/RuntimeUniverse.h, from
+  /// copies embedded into libcling at build time.
+  ///
+  /// They are mounted below a directory of their own, which becomes the
+  /// first include path: startup does not depend on finding the installed
+  /// headers, and the headers always match the library. The lookups below
+  /// the directory are answered from memory, including the misses.
+  ///
+  /// CLING_EMBEDDED_HEADERS=0 uses the headers on the include paths
+  /// instead; so do the sessions with modules, whose module maps name the
+  /// installed headers.
+  ///
+  class EmbeddedHeadersFileSystem : public llvm::vfs::ProxyFileSystem {
+    llvm::IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> m_Files;
+    ///\brief The directory the headers are mounted below.
+    std::string m_Root;
+
+    EmbeddedHeadersFileSystem(
+        llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS,
+        llvm::StringRef Root);
+
+    ///\brief Whether Path is below m_Root, or m_Root itself.
+    bool isEmbedded(const llvm::Twine& Path) const;
+
+  public:
+    ///\brief Wraps FS, putting the directory of the embedded headers first
+    /// on the include paths of HSOpts; returns FS if they are not used.
+    static llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem>
+    create(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS,
+           clang::HeaderSearchOptions& HSOpts, bool Modules);
+
+    llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine& Path) override;
+    llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+    openFileForRead(const llvm::Twine& Path) override;
+    llvm::vfs::directory_iterator dir_begin(const llvm::Twine& Dir,
+                                            std::error_code& EC) override;
+  };
+} // end namespace cling
+
+#endif // CLING_EMBEDDED_HEADERS_H
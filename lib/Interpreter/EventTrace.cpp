@@ -0,0 +1,227 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "EventTrace.h"
+
+#include "cling/Utils/Output.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+  using namespace cling::trace;
+
+  static const char* const kEventNames[kNumEventKinds] = {
+    "begin transaction",
+    "commit transaction",
+    "codegen",
+    "emit module",
+    "run wrapper",
+    "resolve symbol",
+    "search libraries",
+    "load library",
+    "unload library",
+    "autoload",
+    "unload transaction"
+  };
+
+  struct Event {
+    uint64_t Start;
+    uint64_t Duration;
+    EventKind Kind;
+    bool Instant;
+    char Detail[46];
+  };
+  static_assert(sizeof(Event) == 64, "events should fill a cache line");
+
+  ///\brief The events of one thread; the writer is that thread.
+  struct ThreadBuffer {
+    static const size_t kCapacity = 4096;
+    uint64_t Thread;
+    ///\brief The number of events recorded; the last kCapacity are kept.
+    std::atomic<uint64_t> Next{0};
+    Event Events[kCapacity];
+  };
+
+  ///\brief The buffers of all threads that recorded events. They are never
+  /// freed: threads record until the process exits, and the events of
+  /// those that ended are still written.
+  struct Registry {
+    std::mutex Mutex;
+    std::vector<ThreadBuffer*> Buffers;
+    std::string Path;
+    std::chrono::steady_clock::time_point Origin;
+  };
+
+  static Registry& getRegistry() {
+    static Registry* R = new Registry();
+    return *R;
+  }
+
+  static thread_local ThreadBuffer* tBuffer = nullptr;
+
+  static ThreadBuffer& getThreadBuffer() {
+    if (!tBuffer) {
+      tBuffer = new ThreadBuffer();
+      tBuffer->Thread = get_threadid();
+      Registry& R = getRegistry();
+      std::lock_guard<std::mutex> Lock(R.Mutex);
+      R.Buffers.push_back(tBuffer);
+    }
+    return *tBuffer;
+  }
+
+  ///\brief Copies Detail into Buf of Size, null terminated; truncation does
+  /// not split UTF-8 sequences.
+  static void copyDetail(StringRef Detail, char* Buf, size_t Size) {
+    size_t N = Detail.size();
+    if (N >= Size) {
+      N = Size - 1;
+      while (N && (Detail[N] & 0xC0) == 0x80)
+        --N;
+    }
+    memcpy(Buf, Detail.data(), N);
+    Buf[N] = '\0';
+  }
+
+  static void writeJSONString(raw_ostream& OS, StringRef S) {
+    OS << '"';
+    for (char C : S) {
+      if (C == '"' || C == '\\')
+        OS << '\\' << C;
+      else if ((unsigned char)C < 0x20)
+        OS << format("\\u%04x", (unsigned char)C);
+      else
+        OS << C;
+    }
+    OS << '"';
+  }
+
+  ///\brief Writes Ns as microseconds, the unit of the trace format.
+  static void writeMicroseconds(raw_ostream& OS, uint64_t Ns) {
+    OS << Ns / 1000 << '.' << format("%03u", unsigned(Ns % 1000));
+  }
+
+  static void writeAtExit() {
+    const std::string& Path = getRegistry().Path;
+    if (!write(Path))
+      cling::errs() << "cling::trace: cannot write the trace to " << Path
+                    << "\n";
+  }
+} // unnamed namespace
+
+namespace cling {
+  namespace trace {
+    std::atomic<int> gState{0};
+
+    int initialize() {
+      Registry& R = getRegistry();
+      std::lock_guard<std::mutex> Lock(R.Mutex);
+      int State = gState.load(std::memory_order_relaxed);
+      if (State)
+        return State;
+      const char* Path = ::getenv("CLING_TRACE");
+      if (Path && *Path) {
+        R.Path = Path;
+        R.Origin = std::chrono::steady_clock::now();
+        std::atexit(writeAtExit);
+        State = 1;
+      } else
+        State = -1;
+      gState.store(State, std::memory_order_relaxed);
+      return State;
+    }
+
+    uint64_t now() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::steady_clock::now() - getRegistry().Origin)
+          .count();
+    }
+
+    void record(EventKind Kind, uint64_t Start, uint64_t Duration,
+                bool Instant, StringRef Detail) {
+      ThreadBuffer& B = getThreadBuffer();
+      const uint64_t I = B.Next.load(std::memory_order_relaxed);
+      Event& E = B.Events[I % ThreadBuffer::kCapacity];
+      E.Start = Start;
+      E.Duration = Duration;
+      E.Kind = Kind;
+      E.Instant = Instant;
+      copyDetail(Detail, E.Detail, sizeof(E.Detail));
+      B.Next.store(I + 1, std::memory_order_release);
+    }
+
+    bool write(StringRef Path) {
+      std::error_code EC;
+      raw_fd_ostream OS(Path, EC, sys::fs::F_Text);
+      if (EC)
+        return false;
+
+      Registry& R = getRegistry();
+      std::lock_guard<std::mutex> Lock(R.Mutex);
+      const unsigned Pid = sys::Process::getProcessId();
+      OS << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+      bool First = true;
+      for (const ThreadBuffer* B : R.Buffers) {
+        // Events that the thread records meanwhile may be torn; the trace
+        // is meant to be written by a quiet process, e.g. at exit.
+        const uint64_t End = B->Next.load(std::memory_order_acquire);
+        const uint64_t Begin = End > ThreadBuffer::kCapacity
+                               ? End - ThreadBuffer::kCapacity : 0;
+        for (uint64_t I = Begin; I != End; ++I) {
+          const Event& E = B->Events[I % ThreadBuffer::kCapacity];
+          if (E.Kind >= kNumEventKinds)
+            continue;
+          OS << (First ? "\n" : ",\n") << "{\"name\": \""
+             << kEventNames[E.Kind] << "\", \"cat\": \"cling\", \"ph\": \""
+             << (E.Instant ? "i\", \"s\": \"t" : "X") << "\", \"ts\": ";
+          writeMicroseconds(OS, E.Start);
+          if (!E.Instant) {
+            OS << ", \"dur\": ";
+            writeMicroseconds(OS, E.Duration);
+          }
+          OS << ", \"pid\": " << Pid << ", \"tid\": " << B->Thread;
+          if (E.Detail[0]) {
+            OS << ", \"args\": {\"detail\": ";
+            writeJSONString(OS, E.Detail);
+            OS << '}';
+          }
+          OS << '}';
+          First = false;
+        }
+      }
+      OS << "\n]}\n";
+      OS.flush();
+      if (OS.has_error()) {
+        OS.clear_error();
+        return false;
+      }
+      return true;
+    }
+
+    Scope::Scope(EventKind Kind, StringRef Detail):
+      m_Start(0), m_Kind(Kind), m_Enabled(isEnabled()) {
+      if (!m_Enabled)
+        return;
+      copyDetail(Detail, m_Detail, kDetailSize);
+      m_Start = now();
+    }
+  } // end namespace trace
+} // end namespace cling
@@ -0,0 +1,104 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_EVENT_TRACE_H
+#define CLING_EVENT_TRACE_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <atomic>
+#include <cstdint>
+
+namespace cling {
+  ///\brief Records what the interpreter does, as timestamped events, for
+  /// the Chrome trace viewer and Perfetto.
+  ///
+  /// The tracing is compiled in by the CMake option CLING_ENABLE_TRACING,
+  /// and otherwise the CLING_TRACE macros expand to nothing. When compiled
+  /// in, setting CLING_TRACE to a file name records the events and writes
+  /// them to that file as the process exits; without it, each macro costs
+  /// one relaxed load.
+  ///
+  /// Each thread records into its own ring buffer of fixed size binary
+  /// events, without locks; once it is full, the oldest events are dropped.
+  ///
+  namespace trace {
+    enum EventKind : uint8_t {
+      kTransactionBegin,
+      kTransactionCommit,
+      kCodeGen,
+      kModuleEmit,
+      kRunWrapper,
+      kSymbolResolve,
+      kLibrarySearch,
+      kLibraryLoad,
+      kLibraryUnload,
+      kAutoload,
+      kUnload,
+      kNumEventKinds
+    };
+
+    ///\brief 0 until CLING_TRACE was read, then 1 if it is set, -1 if not.
+    extern std::atomic<int> gState;
+
+    int initialize();
+
+    inline bool isEnabled() {
+      int State = gState.load(std::memory_order_relaxed);
+      if (!State)
+        State = initialize();
+      return State > 0;
+    }
+
+    ///\brief Nanoseconds since the tracing started.
+    uint64_t now();
+
+    ///\brief Records an event of Duration nanoseconds from Start, or an
+    /// instant one; Detail is copied, truncated to fit the event.
+    void record(EventKind Kind, uint64_t Start, uint64_t Duration,
+                bool Instant, llvm::StringRef Detail);
+
+    ///\brief Writes the events of all threads as Chrome trace JSON to Path.
+    ///\returns false if it cannot be written.
+    bool write(llvm::StringRef Path);
+
+    ///\brief Records the time between its construction and destruction.
+    class Scope {
+      static constexpr unsigned kDetailSize = 46;
+      uint64_t m_Start;
+      EventKind m_Kind;
+      bool m_Enabled;
+      char m_Detail[kDetailSize];
+
+    public:
+      Scope(EventKind Kind, llvm::StringRef Detail = llvm::StringRef());
+      ~Scope() {
+        if (m_Enabled)
+          record(m_Kind, m_Start, now() - m_Start, false, m_Detail);
+      }
+      Scope(const Scope&) = delete;
+      Scope& operator=(const Scope&) = delete;
+    };
+  } // end namespace trace
+} // end namespace cling
+
+#ifdef CLING_ENABLE_TRACING
+#define CLING_TRACE_SCOPE(Var, Kind, Detail) \
+  ::cling::trace::Scope Var(::cling::trace::Kind, Detail)
+#define CLING_TRACE_EVENT(Kind, Detail) \
+  do { \
+    if (::cling::trace::isEnabled()) \
+      ::cling::trace::record(::cling::trace::Kind, ::cling::trace::now(), 0, \
+                             true, Detail); \
+  } while (0)
+#else
+#define CLING_TRACE_SCOPE(Var, Kind, Detail)
+#define CLING_TRACE_EVENT(Kind, Detail) do { } while (0)
+#endif
+
+#endif // CLING_EVENT_TRACE_H
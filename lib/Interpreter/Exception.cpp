@@ -20,6 +20,8 @@
 #include "clang/Sema/Sema.h"
 #include "clang/Sema/SemaDiagnostic.h"
 
+#include <string>
+
 extern "C" {
 /// Throw an InvalidDerefException if the Arg pointer is invalid.
 ///\param Interp: The interpreter that has compiled the code.
@@ -87,6 +89,10 @@ namespace cling {
   InvalidDerefException::~InvalidDerefException() noexcept {}
 
   bool InvalidDerefException::diagnose() const {
+    // Detected by a fault handler, see RuntimeOptions::SignalPointerChecks.
+    if (!m_Arg)
+      return false;
+
     // Construct custom diagnostic: warning for invalid memory address;
     // no equivalent in clang.
     if (m_Type == cling::InvalidDerefException::DerefType::INVALID_MEM) {
@@ -102,6 +108,28 @@ namespace cling {
     return true;
   }
 
+  static std::string describeLimit(ExecutionLimitException::LimitKind Kind,
+                                   uint64_t Limit) {
+    switch (Kind) {
+    case ExecutionLimitException::WALL_TIME:
+      return "The code ran beyond its time limit of " + std::to_string(Limit)
+        + " ms";
+    case ExecutionLimitException::CPU_TIME:
+      return "The code used more than its CPU time limit of "
+        + std::to_string(Limit) + " ms";
+    case ExecutionLimitException::HEAP:
+      break;
+    }
+    return "The code allocated more than its heap limit of "
+      + std::to_string(Limit) + " bytes";
+  }
+
+  ExecutionLimitException::ExecutionLimitException(LimitKind Kind,
+                                                   uint64_t Limit)
+    : InterpreterException(describeLimit(Kind, Limit)), m_Kind(Kind) {}
+
+  ExecutionLimitException::~ExecutionLimitException() noexcept {}
+
   CompilationException::CompilationException(const std::string& Reason) :
     InterpreterException(Reason) {}
 
@@ -0,0 +1,433 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "ExecutionGuard.h"
+
+#include "BackendPasses.h"
+
+#include "cling/Interpreter/Exception.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+
+#if defined(__linux__) || defined(__FreeBSD__)
+#include <pthread.h>
+#include <time.h>
+// The watchdog reads the CPU time of the threads it watches.
+#define CLING_THREAD_CPU_CLOCK 1
+#endif
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+// The hooks tell the size of what gets freed through malloc_usable_size().
+#define CLING_HEAP_QUOTA_HOOKS 1
+#endif
+
+using namespace llvm;
+
+namespace {
+  ///\brief The runs out of a limit that did not throw yet: the safe points
+  /// call the hook while it is not 0. The JITted code loads it as an int32.
+  static std::atomic<int32_t> gPending{0};
+  static_assert(sizeof(gPending) == sizeof(int32_t),
+                "The safe points load the flag as an i32");
+} // unnamed namespace
+
+namespace cling {
+  struct ExecutionGuard::Run {
+    enum Status : int { kRunning, kWallTime, kCpuTime, kHeap, kRaised };
+
+    ExecutionGuard& Guard;
+    ///\brief The run that the thread was in before.
+    Run* const Outer;
+    std::atomic<int> State{kRunning};
+
+    unsigned WallMs;
+    unsigned CpuMs;
+    uint64_t HeapBytes;
+    std::chrono::steady_clock::time_point Deadline;
+#ifdef CLING_THREAD_CPU_CLOCK
+    clockid_t CpuClock;
+    int64_t CpuDeadline = 0;
+
+    int64_t getCpuTime() const {
+      struct timespec TS;
+      if (clock_gettime(CpuClock, &TS))
+        return 0;
+      return int64_t(TS.tv_sec) * 1000000000 + TS.tv_nsec;
+    }
+#endif
+
+    Run(ExecutionGuard& G, const ExecutionLimits& L, Run* Outer):
+      Guard(G), Outer(Outer), WallMs(L.WallMs), CpuMs(L.CpuMs),
+      HeapBytes(L.HeapBytes) {
+      Deadline = std::chrono::steady_clock::now()
+        + std::chrono::milliseconds(WallMs);
+#ifdef CLING_THREAD_CPU_CLOCK
+      if (CpuMs && !pthread_getcpuclockid(pthread_self(), &CpuClock))
+        CpuDeadline = getCpuTime() + int64_t(CpuMs) * 1000000;
+      else
+        CpuMs = 0;
+#else
+      CpuMs = 0;
+#endif
+    }
+
+    bool isWatched() const { return WallMs || CpuMs; }
+
+    ///\brief Has the next safe point of the run throw, unless it is out of
+    /// a limit already.
+    void flag(Status Kind) {
+      int Expected = kRunning;
+      if (State.compare_exchange_strong(Expected, Kind))
+        gPending.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ///\returns the limit the run is out of, and marks it as thrown for; or
+    /// kRunning if it is within its limits.
+    int take() {
+      int S = State.load();
+      while (S != kRunning && S != kRaised)
+        if (State.compare_exchange_weak(S, kRaised)) {
+          gPending.fetch_sub(1, std::memory_order_relaxed);
+          return S;
+        }
+      return kRunning;
+    }
+
+    [[noreturn]] void raise(int Kind) const {
+      switch (Kind) {
+      case kWallTime:
+        throw ExecutionLimitException(ExecutionLimitException::WALL_TIME,
+                                      WallMs);
+      case kCpuTime:
+        throw ExecutionLimitException(ExecutionLimitException::CPU_TIME,
+                                      CpuMs);
+      default:
+        throw ExecutionLimitException(ExecutionLimitException::HEAP,
+                                      HeapBytes);
+      }
+    }
+
+    void charge(size_t Size) {
+      const int64_t Live
+        = Guard.m_HeapLive.fetch_add(Size, std::memory_order_relaxed) + Size;
+      if (Live > int64_t(HeapBytes))
+        flag(kHeap);
+    }
+
+    void credit(size_t Size) {
+      Guard.m_HeapLive.fetch_sub(Size, std::memory_order_relaxed);
+    }
+
+    bool wouldExceed(size_t Size) const {
+      return Guard.m_HeapLive.load(std::memory_order_relaxed) + int64_t(Size)
+        > int64_t(HeapBytes);
+    }
+  };
+} // end namespace cling
+
+namespace {
+  using cling::ExecutionGuard;
+  using Run = ExecutionGuard::Run;
+
+  ///\brief The innermost run of the calling thread.
+  static thread_local Run* tCurrent = nullptr;
+
+  ///\brief Flags the runs that are out of time, on a thread of its own.
+  /// Leaked: runs might still end while the process exits.
+  class Watchdog {
+    std::mutex m_Mutex;
+    std::condition_variable m_Wakeup;
+    std::vector<Run*> m_Runs;
+    bool m_Started = false;
+
+    ///\brief How often the CPU time of the runs with a CpuMs is read.
+    static constexpr std::chrono::milliseconds kCpuPollInterval{10};
+
+    void watch() {
+      using Clock = std::chrono::steady_clock;
+      std::unique_lock<std::mutex> Lock(m_Mutex);
+      for (;;) {
+        const Clock::time_point Now = Clock::now();
+        Clock::time_point Next = Clock::time_point::max();
+        for (Run* R : m_Runs) {
+          if (R->State.load() != Run::kRunning)
+            continue;
+          if (R->WallMs) {
+            if (Now >= R->Deadline) {
+              R->flag(Run::kWallTime);
+              continue;
+            }
+            Next = std::min(Next, R->Deadline);
+          }
+#ifdef CLING_THREAD_CPU_CLOCK
+          if (R->CpuMs) {
+            if (R->getCpuTime() >= R->CpuDeadline) {
+              R->flag(Run::kCpuTime);
+              continue;
+            }
+            Next = std::min(Next, Now + kCpuPollInterval);
+          }
+#endif
+        }
+        if (Next == Clock::time_point::max())
+          m_Wakeup.wait(Lock);
+        else
+          m_Wakeup.wait_until(Lock, Next);
+      }
+    }
+
+    static Watchdog*& getInstance() {
+      static Watchdog* W = new Watchdog();
+      return W;
+    }
+
+  public:
+    static Watchdog& get() { return *getInstance(); }
+
+    ///\brief Leaves the watchdog of the parent, whose thread is gone and
+    /// whose mutex might be locked, to a child that fork() made.
+    static void reset() { getInstance() = new Watchdog(); }
+
+    void add(Run* R) {
+      std::lock_guard<std::mutex> Lock(m_Mutex);
+      m_Runs.push_back(R);
+      if (!m_Started) {
+        std::thread([this] { watch(); }).detach();
+        m_Started = true;
+      }
+      m_Wakeup.notify_one();
+    }
+
+    void remove(Run* R) {
+      std::lock_guard<std::mutex> Lock(m_Mutex);
+      m_Runs.erase(std::find(m_Runs.begin(), m_Runs.end(), R));
+    }
+  };
+
+  constexpr std::chrono::milliseconds Watchdog::kCpuPollInterval;
+
+  static void SafePoint() {
+    if (Run* R = tCurrent) {
+      const int Kind = R->take();
+      if (Kind != Run::kRunning)
+        R->raise(Kind);
+    }
+  }
+
+#ifdef CLING_HEAP_QUOTA_HOOKS
+  ///\brief The run that the allocations of the calling thread count towards,
+  /// if it has a heap limit.
+  static Run* getHeapRun() {
+    Run* R = tCurrent;
+    return R && R->HeapBytes ? R : nullptr;
+  }
+
+  static void charge(void* P) {
+    if (P)
+      if (Run* R = getHeapRun())
+        R->charge(malloc_usable_size(P));
+  }
+
+  static void credit(void* P) {
+    if (P)
+      if (Run* R = getHeapRun())
+        R->credit(malloc_usable_size(P));
+  }
+
+  ///\brief Throws rather than allocating beyond the limit, as operator new
+  /// may.
+  static void checkNew(size_t Size) {
+    if (Run* R = getHeapRun())
+      if (R->wouldExceed(Size)) {
+        R->take();
+        R->raise(Run::kHeap);
+      }
+  }
+
+  static bool allowsNothrowNew(size_t Size) {
+    Run* R = getHeapRun();
+    if (!R || !R->wouldExceed(Size))
+      return true;
+    R->flag(Run::kHeap);
+    return false;
+  }
+
+  static void* HookMalloc(size_t Size) {
+    void* P = ::malloc(Size);
+    charge(P);
+    return P;
+  }
+
+  static void* HookCalloc(size_t N, size_t Size) {
+    void* P = ::calloc(N, Size);
+    charge(P);
+    return P;
+  }
+
+  static void* HookRealloc(void* Old, size_t Size) {
+    const size_t OldSize = Old ? malloc_usable_size(Old) : 0;
+    void* P = ::realloc(Old, Size);
+    // Null with a Size: Old is still there.
+    if (P || !Size)
+      if (Run* R = getHeapRun()) {
+        R->credit(OldSize);
+        if (P)
+          R->charge(malloc_usable_size(P));
+      }
+    return P;
+  }
+
+  static void HookFree(void* P) {
+    credit(P);
+    ::free(P);
+  }
+
+  static void* HookNew(size_t Size) {
+    checkNew(Size);
+    void* P = ::operator new(Size);
+    charge(P);
+    return P;
+  }
+
+  static void* HookNewArray(size_t Size) {
+    checkNew(Size);
+    void* P = ::operator new[](Size);
+    charge(P);
+    return P;
+  }
+
+  static void* HookNewNothrow(size_t Size, const std::nothrow_t&) noexcept {
+    if (!allowsNothrowNew(Size))
+      return nullptr;
+    void* P = ::operator new(Size, std::nothrow);
+    charge(P);
+    return P;
+  }
+
+  static void* HookNewArrayNothrow(size_t Size,
+                                   const std::nothrow_t&) noexcept {
+    if (!allowsNothrowNew(Size))
+      return nullptr;
+    void* P = ::operator new[](Size, std::nothrow);
+    charge(P);
+    return P;
+  }
+
+  static void HookDelete(void* P) {
+    credit(P);
+    ::operator delete(P);
+  }
+
+  static void HookDeleteArray(void* P) {
+    credit(P);
+    ::operator delete[](P);
+  }
+
+  static void HookDeleteSized(void* P, size_t) { HookDelete(P); }
+
+  static void HookDeleteArraySized(void* P, size_t) { HookDeleteArray(P); }
+#endif // CLING_HEAP_QUOTA_HOOKS
+} // unnamed namespace
+
+namespace cling {
+
+  void ExecutionGuard::setLimits(const ExecutionLimits& Limits) {
+    m_WallMs.store(Limits.WallMs);
+    m_CpuMs.store(Limits.CpuMs);
+    m_HeapBytes.store(Limits.HeapBytes);
+  }
+
+  ExecutionLimits ExecutionGuard::getLimits() const {
+    ExecutionLimits Limits;
+    Limits.WallMs = m_WallMs.load();
+    Limits.CpuMs = m_CpuMs.load();
+    Limits.HeapBytes = m_HeapBytes.load();
+    return Limits;
+  }
+
+  ExecutionGuard::Scope::Scope(ExecutionGuard* Guard) {
+    if (!Guard)
+      return;
+    const ExecutionLimits Limits = Guard->getLimits();
+    if (!Limits.any())
+      return;
+    m_Run.reset(new Run(*Guard, Limits, tCurrent));
+    tCurrent = m_Run.get();
+    if (m_Run->isWatched())
+      Watchdog::get().add(m_Run.get());
+  }
+
+  ExecutionGuard::Scope::~Scope() {
+    if (!m_Run)
+      return;
+    if (m_Run->isWatched())
+      Watchdog::get().remove(m_Run.get());
+    // It ended before a safe point noticed.
+    m_Run->take();
+    tCurrent = m_Run->Outer;
+  }
+
+  void ExecutionGuard::onForked() { Watchdog::reset(); }
+
+  bool ExecutionGuard::hasCpuClock() {
+#ifdef CLING_THREAD_CPU_CLOCK
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  const std::vector<std::pair<const char*, JITTargetAddress>>&
+  ExecutionGuard::getSafePointSymbols() {
+    using Symbols = std::vector<std::pair<const char*, JITTargetAddress>>;
+    static const Symbols AllSymbols = {
+      {BackendPasses::getSafePointHookName(), JITTargetAddress(&SafePoint)},
+      {BackendPasses::getSafePointFlagName(), JITTargetAddress(&gPending)}
+    };
+    return AllSymbols;
+  }
+
+  const std::vector<std::pair<const char*, JITTargetAddress>>&
+  ExecutionGuard::getHeapHooks() {
+    using Hooks = std::vector<std::pair<const char*, JITTargetAddress>>;
+    static const Hooks AllHooks = [] {
+      Hooks H;
+#ifdef CLING_HEAP_QUOTA_HOOKS
+      // How size_t mangles.
+      const bool Long = std::is_same<size_t, unsigned long>::value;
+      H.emplace_back("malloc", JITTargetAddress(&HookMalloc));
+      H.emplace_back("calloc", JITTargetAddress(&HookCalloc));
+      H.emplace_back("realloc", JITTargetAddress(&HookRealloc));
+      H.emplace_back("free", JITTargetAddress(&HookFree));
+      H.emplace_back(Long ? "_Znwm" : "_Znwj", JITTargetAddress(&HookNew));
+      H.emplace_back(Long ? "_Znam" : "_Znaj",
+                     JITTargetAddress(&HookNewArray));
+      H.emplace_back(Long ? "_ZnwmRKSt9nothrow_t" : "_ZnwjRKSt9nothrow_t",
+                     JITTargetAddress(&HookNewNothrow));
+      H.emplace_back(Long ? "_ZnamRKSt9nothrow_t" : "_ZnajRKSt9nothrow_t",
+                     JITTargetAddress(&HookNewArrayNothrow));
+      H.emplace_back("_ZdlPv", JITTargetAddress(&HookDelete));
+      H.emplace_back("_ZdaPv", JITTargetAddress(&HookDeleteArray));
+      H.emplace_back(Long ? "_ZdlPvm" : "_ZdlPvj",
+                     JITTargetAddress(&HookDeleteSized));
+      H.emplace_back(Long ? "_ZdaPvm" : "_ZdaPvj",
+                     JITTargetAddress(&HookDeleteArraySized));
+#endif
+      return H;
+    }();
+    return AllHooks;
+  }
+} // end namespace cling
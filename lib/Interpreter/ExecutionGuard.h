@@ -0,0 +1,89 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_EXECUTION_GUARD_H
+#define CLING_EXECUTION_GUARD_H
+
+#include "cling/Interpreter/ExecutionLimits.h"
+
+#include "llvm/ExecutionEngine/JITSymbol.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace cling {
+  ///\brief Enforces the ExecutionLimits of the code of an executor.
+  ///
+  /// The runs of the code, see Scope, are watched by a thread of the
+  /// process: once one is out of time, it sets the flag that the safe points
+  /// of BackendPasses::addSafePoints() poll, and the next safe point of that
+  /// run throws an ExecutionLimitException. The JIT links the allocation
+  /// functions of the code to the hooks of getHeapHooks(), which count the
+  /// heap of the guard of the run calling them.
+  ///
+  class ExecutionGuard {
+  public:
+    struct Run;
+
+  private:
+    std::atomic<unsigned> m_WallMs{0};
+    std::atomic<unsigned> m_CpuMs{0};
+    std::atomic<uint64_t> m_HeapBytes{0};
+
+    ///\brief The bytes that the code allocated through the hooks and did
+    /// not free yet.
+    std::atomic<int64_t> m_HeapLive{0};
+
+  public:
+    ExecutionGuard() = default;
+    ExecutionGuard(const ExecutionGuard&) = delete;
+    ExecutionGuard& operator=(const ExecutionGuard&) = delete;
+
+    ///\brief Takes effect for the runs starting from now on; the heap
+    /// allocated so far counts towards the new heap limit.
+    void setLimits(const ExecutionLimits& Limits);
+    ExecutionLimits getLimits() const;
+
+    ///\brief Marks the calling thread as running the code of Guard, if not
+    /// null, for its lifetime: its time limits count from now on, and the
+    /// allocations of the thread count towards Guard's heap. The innermost
+    /// Scope of the thread is the one its safe points check.
+    class Scope {
+      std::unique_ptr<Run> m_Run;
+    public:
+      explicit Scope(ExecutionGuard* Guard);
+      ~Scope();
+      Scope(const Scope&) = delete;
+      Scope& operator=(const Scope&) = delete;
+    };
+
+    ///\brief Watches the runs of a child that fork() made of the process
+    /// with a thread of its own; none may be in progress.
+    static void onForked();
+
+    ///\brief Whether CpuMs can be enforced on this platform.
+    static bool hasCpuClock();
+
+    ///\brief The addresses of the hook and of the flag of the safe points,
+    /// by the names of BackendPasses::getSafePointHookName() and
+    /// getSafePointFlagName().
+    static const std::vector<std::pair<const char*, llvm::JITTargetAddress>>&
+    getSafePointSymbols();
+
+    ///\brief The addresses of the hooks counting the heap, by the unmangled
+    /// names of the allocation functions they replace; empty if this
+    /// platform cannot tell the size of what gets freed.
+    static const std::vector<std::pair<const char*, llvm::JITTargetAddress>>&
+    getHeapHooks();
+  };
+} // end namespace cling
+
+#endif // CLING_EXECUTION_GUARD_H
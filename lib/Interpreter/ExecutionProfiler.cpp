@@ -0,0 +1,125 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "ExecutionProfiler.h"
+
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/Process.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+namespace {
+  ///\brief User and system CPU time of the process.
+  static uint64_t getCPUNanoseconds() {
+    llvm::sys::TimePoint<> Elapsed;
+    std::chrono::nanoseconds User, Sys;
+    llvm::sys::Process::GetTimeUsage(Elapsed, User, Sys);
+    return (User + Sys).count();
+  }
+
+#ifdef __linux__
+  ///\brief Opens a counter of the calling thread's user space hardware
+  /// events; -1 if the kernel does not have or permit it.
+  static int openCounter(cling::ExecutionCounters::Event E) {
+    static const uint64_t Configs[cling::ExecutionCounters::kNumEvents] = {
+      PERF_COUNT_HW_CPU_CYCLES,
+      PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_MISSES
+    };
+    perf_event_attr Attr;
+    ::memset(&Attr, 0, sizeof(Attr));
+    Attr.size = sizeof(Attr);
+    Attr.type = PERF_TYPE_HARDWARE;
+    Attr.config = Configs[E];
+    // Unprivileged processes are typically allowed user space events only.
+    Attr.exclude_kernel = 1;
+    Attr.exclude_hv = 1;
+    unsigned long Flags = 0;
+#ifdef PERF_FLAG_FD_CLOEXEC
+    Flags |= PERF_FLAG_FD_CLOEXEC;
+#endif
+    return ::syscall(__NR_perf_event_open, &Attr, /*this thread*/ 0,
+                     /*any cpu*/ -1, /*no group*/ -1, Flags);
+  }
+#endif
+} // unnamed namespace
+
+namespace cling {
+
+  const char* ExecutionCounters::getEventName(Event E) {
+    switch (E) {
+      case kCycles: return "cycles";
+      case kInstructions: return "instructions";
+      case kCacheMisses: return "cache-misses";
+      case kNumEvents: break;
+    }
+    return "unknown";
+  }
+
+  ExecutionProfiler::ExecutionProfiler():
+    m_Thread(std::this_thread::get_id()) {
+    for (unsigned I = 0; I < ExecutionCounters::kNumEvents; ++I) {
+#ifdef __linux__
+      m_FDs[I] = openCounter(ExecutionCounters::Event(I));
+#else
+      m_FDs[I] = -1;
+#endif
+    }
+  }
+
+  ExecutionProfiler::~ExecutionProfiler() {
+#ifdef __linux__
+    for (int FD : m_FDs)
+      if (FD != -1)
+        ::close(FD);
+#endif
+  }
+
+  bool ExecutionProfiler::read(ExecutionCounters::Event E,
+                               uint64_t& Count) const {
+#ifdef __linux__
+    return m_FDs[E] != -1
+      && ::read(m_FDs[E], &Count, sizeof(Count)) == sizeof(Count);
+#else
+    return false;
+#endif
+  }
+
+  ExecutionProfiler::Scope::Scope(ExecutionProfiler* Profiler):
+    m_Profiler(Profiler) {
+    if (!m_Profiler || m_Profiler->m_Depth++)
+      return;
+    m_CountEvents = std::this_thread::get_id() == m_Profiler->m_Thread;
+    for (unsigned I = 0; m_CountEvents && I < ExecutionCounters::kNumEvents;
+         ++I) {
+      if (!m_Profiler->read(ExecutionCounters::Event(I), m_EventStart[I]))
+        m_EventStart[I] = ~uint64_t(0);
+    }
+    // Last, to leave the reads out.
+    m_CPUStart = getCPUNanoseconds();
+  }
+
+  ExecutionProfiler::Scope::~Scope() {
+    if (!m_Profiler || --m_Profiler->m_Depth)
+      return;
+    ExecutionCounters& Total = m_Profiler->m_Total;
+    Total.addCPUNanoseconds(getCPUNanoseconds() - m_CPUStart);
+    for (unsigned I = 0; m_CountEvents && I < ExecutionCounters::kNumEvents;
+         ++I) {
+      uint64_t Count;
+      const ExecutionCounters::Event E = ExecutionCounters::Event(I);
+      if (m_EventStart[I] != ~uint64_t(0) && m_Profiler->read(E, Count))
+        Total.addEvent(E, Count - m_EventStart[I]);
+    }
+  }
+} // end namespace cling
@@ -0,0 +1,65 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_EXECUTION_PROFILER_H
+#define CLING_EXECUTION_PROFILER_H
+
+#include "cling/Interpreter/ExecutionCounters.h"
+
+#include <thread>
+
+namespace cling {
+
+  ///\brief Measures the ExecutionCounters of an interpreter.
+  ///
+  /// The hardware counters are opened for the thread creating the profiler;
+  /// wrappers run by any other thread only get their CPU time measured.
+  ///
+  class ExecutionProfiler {
+  public:
+    ///\brief Measures one execution. Nested scopes, e.g. of user code
+    /// calling back into the interpreter, are part of the outermost one.
+    class Scope {
+      ExecutionProfiler* m_Profiler;
+      uint64_t m_CPUStart = 0;
+      uint64_t m_EventStart[ExecutionCounters::kNumEvents];
+      bool m_CountEvents = false;
+
+    public:
+      ///\param[in] Profiler - the interpreter's profiler, none measures
+      ///                      nothing.
+      Scope(ExecutionProfiler* Profiler);
+      ~Scope();
+      Scope(const Scope&) = delete;
+      Scope& operator=(const Scope&) = delete;
+    };
+
+  private:
+    ExecutionCounters m_Total;
+
+    ///\brief The perf_event_open() descriptors per event, -1 if unavailable.
+    int m_FDs[ExecutionCounters::kNumEvents];
+    std::thread::id m_Thread;
+
+    ///\brief Number of scopes entered, but not left.
+    unsigned m_Depth = 0;
+
+    ///\brief Reads the count of an event; false if it is unavailable.
+    bool read(ExecutionCounters::Event E, uint64_t& Count) const;
+
+  public:
+    ExecutionProfiler();
+    ~ExecutionProfiler();
+    ExecutionProfiler(const ExecutionProfiler&) = delete;
+    ExecutionProfiler& operator=(const ExecutionProfiler&) = delete;
+
+    const ExecutionCounters& getTotal() const { return m_Total; }
+  };
+} // end namespace cling
+
+#endif // CLING_EXECUTION_PROFILER_H
@@ -66,6 +66,35 @@ namespace {
 
 namespace cling {
 
+  const ImportSummaryCache::Summary&
+  ImportSummaryCache::lookup(DeclContext* DC, llvm::StringRef Name) {
+    llvm::StringMap<Summary>& Lookups = m_Lookups[DC];
+    auto Found = Lookups.find(Name);
+    if (Found != Lookups.end())
+      return Found->second;
+
+    Summary& S = Lookups[Name];
+    S.ParentName = DeclarationName(&m_Context.Idents.get(Name));
+    DeclContext::lookup_result R = DC->lookup(S.ParentName);
+    S.Decls.assign(R.begin(), R.end());
+    return S;
+  }
+
+  const std::vector<NamedDecl*>&
+  ImportSummaryCache::members(DeclContext* DC) {
+    auto Found = m_Members.find(DC);
+    if (Found != m_Members.end())
+      return Found->second;
+
+    std::vector<NamedDecl*>& Members = m_Members[DC];
+    for (Decl* D : DC->decls())
+      if (NamedDecl* ND = llvm::dyn_cast<NamedDecl>(D))
+        if (IdentifierInfo* II = ND->getDeclName().getAsIdentifierInfo())
+          if (!II->getName().empty())
+            Members.push_back(ND);
+    return Members;
+  }
+
   ExternalInterpreterSource::ExternalInterpreterSource(
         const cling::Interpreter *parent, cling::Interpreter *child) :
         m_ParentInterpreter(parent), m_ChildInterpreter(child) {
@@ -161,15 +190,14 @@ namespace cling {
     }
   }
 
-  bool ExternalInterpreterSource::Import(DeclContext::lookup_result lookup_result,
+  bool ExternalInterpreterSource::Import(
+                                llvm::ArrayRef<NamedDecl*> lookup_result,
                                 const DeclContext *childCurrentDeclContext,
                                 DeclarationName &childDeclName,
                                 DeclarationName &parentDeclName) {
 
-
-
-    for (DeclContext::lookup_iterator I = lookup_result.begin(),
-          E = lookup_result.end(); I != E; ++I) {
+    for (auto I = lookup_result.begin(), E = lookup_result.end(); I != E;
+         ++I) {
       // Check if this Name we are looking for is
       // a DeclContext (for example a Namespace, function etc.).
       if (DeclContext *declContextToImport = llvm::dyn_cast<DeclContext>(*I)) {
@@ -195,24 +223,6 @@ namespace cling {
     assert(childCurrentDeclContext->hasExternalVisibleStorage() &&
            "DeclContext has no visible decls in storage");
 
-    //Check if we have already found this declaration Name before
-    DeclarationName parentDeclName;
-    std::map<clang::DeclarationName,
-             clang::DeclarationName>::iterator IDecl =
-                                            m_ImportedDecls.find(childDeclName);
-    if (IDecl != m_ImportedDecls.end()) {
-      parentDeclName = IDecl->second;
-    } else {
-      // Get the identifier info from the parent interpreter
-      // for this Name.
-      std::string name = childDeclName.getAsString();
-      IdentifierTable &parentIdentifierTable =
-                            m_ParentInterpreter->getCI()->getASTContext().Idents;
-      IdentifierInfo &parentIdentifierInfo =
-                            parentIdentifierTable.get(name);
-      parentDeclName = DeclarationName(&parentIdentifierInfo);
-    }
-
     // Search in the map of the stored Decl Contexts for this
     // Decl Context.
     std::map<const clang::DeclContext *, clang::DeclContext *>::iterator
@@ -223,8 +233,28 @@ namespace cling {
 
     DeclContext *parentDeclContext = IDeclContext->second;
 
-    DeclContext::lookup_result lookup_result =
-                                    parentDeclContext->lookup(parentDeclName);
+    //Check if we have already found this declaration Name before
+    DeclarationName parentDeclName;
+    std::vector<NamedDecl*> lookup_result;
+    std::map<clang::DeclarationName,
+             clang::DeclarationName>::iterator IDecl =
+                                            m_ImportedDecls.find(childDeclName);
+    if (IDecl != m_ImportedDecls.end() &&
+        !IDecl->second.getAsIdentifierInfo()) {
+      // E.g. an operator or a constructor name, which ASTImporter mapped.
+      parentDeclName = IDecl->second;
+      DeclContext::lookup_result R = parentDeclContext->lookup(parentDeclName);
+      lookup_result.assign(R.begin(), R.end());
+    } else {
+      // The parent's identifier for this Name, and what it declares; the
+      // siblings of this interpreter likely looked it up already.
+      const ImportSummaryCache::Summary& S
+        = m_ParentInterpreter->getImportSummaryCache().lookup(
+            parentDeclContext, childDeclName.getAsString());
+      parentDeclName = S.ParentName;
+      // Importing may look up more names, and grow the cache.
+      lookup_result = S.Decls;
+    }
 
     // Check if we found this Name in the parent interpreter
     if (!lookup_result.empty()) {
@@ -259,20 +289,14 @@ namespace cling {
     // stored in Sema.
     StringRef filter =
       m_ChildInterpreter->getCI()->getPreprocessor().getCodeCompletionFilter();
-    for (DeclContext::decl_iterator IDeclContext =
-                                      parentDeclContext->decls_begin(),
-                                    EDeclContext =
-                                      parentDeclContext->decls_end();
-                              IDeclContext != EDeclContext; ++IDeclContext) {
-      if (NamedDecl* parentDecl = llvm::dyn_cast<NamedDecl>(*IDeclContext)) {
-        DeclarationName childDeclName = parentDecl->getDeclName();
-        if (auto II = childDeclName.getAsIdentifierInfo()) {
-          StringRef name = II->getName();
-          if (!name.empty() && name.startswith(filter))
-            ImportDecl(parentDecl, childDeclName, childDeclName,
-                       childDeclContext);
-        }
-      }
+    // A copy: importing may look up more names, and grow the cache.
+    const std::vector<NamedDecl*> parentDecls
+      = m_ParentInterpreter->getImportSummaryCache().members(parentDeclContext);
+    for (NamedDecl* parentDecl : parentDecls) {
+      DeclarationName childDeclName = parentDecl->getDeclName();
+      if (childDeclName.getAsIdentifierInfo()->getName().startswith(filter))
+        ImportDecl(parentDecl, childDeclName, childDeclName,
+                   childDeclContext);
     }
 
     const_cast<DeclContext *>(childDeclContext)->
@@ -12,8 +12,13 @@
 
 #include "clang/AST/ExternalASTSource.h"
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+
 #include <string>
 #include <map>
+#include <vector>
 
 namespace clang {
   class ASTContext;
@@ -32,6 +37,48 @@ namespace cling {
 
 namespace cling {
 
+    ///\brief What the child interpreters look up in their parent: the
+    /// declarations of an identifier in a parent DeclContext, and the named
+    /// members of a parent DeclContext.
+    ///
+    /// The parent keeps one for all its children: children created afresh
+    /// find the common names without walking the parent's AST again, and
+    /// still import each declaration on its first use only. The parent
+    /// clears it whenever a transaction is committed or unloaded.
+    ///
+    class ImportSummaryCache {
+    public:
+      struct Summary {
+        ///\brief The name in the parent's ASTContext.
+        clang::DeclarationName ParentName;
+        ///\brief What the parent's lookup of ParentName found.
+        std::vector<clang::NamedDecl*> Decls;
+      };
+
+    private:
+      clang::ASTContext& m_Context;
+      llvm::DenseMap<const clang::DeclContext*, llvm::StringMap<Summary>>
+        m_Lookups;
+      llvm::DenseMap<const clang::DeclContext*,
+                     std::vector<clang::NamedDecl*>> m_Members;
+
+    public:
+      ///\param[in] Context - the parent's ASTContext.
+      ImportSummaryCache(clang::ASTContext& Context): m_Context(Context) {}
+
+      ///\brief The declarations of the identifier Name in DC, a DeclContext
+      /// of the parent.
+      const Summary& lookup(clang::DeclContext* DC, llvm::StringRef Name);
+
+      ///\brief The members of DC with identifier names.
+      const std::vector<clang::NamedDecl*>& members(clang::DeclContext* DC);
+
+      void clear() {
+        m_Lookups.clear();
+        m_Members.clear();
+      }
+    };
+
     class ExternalInterpreterSource : public clang::ExternalASTSource {
 
       private:
@@ -68,7 +115,7 @@ namespace cling {
                               const clang::DeclContext *childCurrentDeclContext,
                               clang::DeclarationName childDeclName) override;
 
-        bool Import(clang::DeclContext::lookup_result lookupResult,
+        bool Import(llvm::ArrayRef<clang::NamedDecl*> lookupResult,
                     const clang::DeclContext *childCurrentDeclContext,
                     clang::DeclarationName &childDeclName,
                     clang::DeclarationName &parentDeclName);
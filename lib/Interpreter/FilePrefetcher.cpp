@@ -0,0 +1,202 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "FilePrefetcher.h"
+
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Lex/HeaderSearch.h"
+#include "clang/Lex/Preprocessor.h"
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+#include <algorithm>
+#include <tuple>
+
+using namespace llvm;
+
+namespace {
+  ///\brief The most files read for a loadFiles().
+  static const size_t kMaxFiles = 4000;
+
+  ///\brief The most threads reading: more do not make the disk faster.
+  static const unsigned kMaxJobs = 8;
+
+  ///\brief The name that Line #includes, with its delimiters, e.g.
+  /// "<vector>"; empty if none.
+  static StringRef getInclude(StringRef Line) {
+    Line = Line.ltrim();
+    if (!Line.consume_front("#"))
+      return StringRef();
+    Line = Line.ltrim();
+    if (!Line.consume_front("include"))
+      return StringRef();
+    Line = Line.ltrim();
+    if (Line.empty() || (Line[0] != '<' && Line[0] != '"'))
+      return StringRef();
+    const size_t End = Line.find(Line[0] == '<' ? '>' : '"', 1);
+    if (End == StringRef::npos || End == 1)
+      return StringRef();
+    return Line.substr(0, End + 1);
+  }
+} // unnamed namespace
+
+namespace cling {
+
+  FilePrefetcher::FilePrefetcher(clang::CompilerInstance& CI,
+                                 ArrayRef<std::string> Paths, unsigned Jobs,
+                                 bool Install):
+    m_CI(CI), m_Install(Install) {
+    const clang::HeaderSearch& HS
+      = CI.getPreprocessor().getHeaderSearchInfo();
+    for (auto Dir = HS.search_dir_begin(), E = HS.search_dir_end();
+         Dir != E; ++Dir) {
+      if (Dir->isNormalDir())
+        m_SearchDirs.push_back(Dir->getName().str());
+    }
+
+    for (const std::string& Path : Paths)
+      enqueue(Path);
+    if (!Jobs)
+      Jobs = std::max(std::thread::hardware_concurrency(), 1u);
+    Jobs = std::min(Jobs, kMaxJobs);
+    for (unsigned I = 0; I < Jobs; ++I)
+      m_Workers.emplace_back(&FilePrefetcher::run, this);
+  }
+
+  FilePrefetcher::~FilePrefetcher() {
+    {
+      std::lock_guard<std::mutex> Lock(m_Mutex);
+      m_Stop = true;
+    }
+    m_Wake.notify_all();
+    for (std::thread& Worker : m_Workers)
+      Worker.join();
+
+    if (m_Overridden.empty())
+      return;
+    // The contents of the files parsed back their source locations; the
+    // others must not outlive this loadFiles().
+    clang::SourceManager& SM = m_CI.getSourceManager();
+    SmallPtrSet<const clang::FileEntry*, 64> Parsed;
+    for (unsigned I = 0, N = SM.local_sloc_entry_size(); I != N; ++I) {
+      const clang::SrcMgr::SLocEntry& Entry = SM.getLocalSLocEntry(I);
+      if (Entry.isFile())
+        if (const auto* Content = Entry.getFile().getContentCache())
+          Parsed.insert(Content->OrigEntry);
+    }
+    for (const clang::FileEntry* FE : m_Overridden)
+      if (!Parsed.count(FE))
+        SM.disableFileContentsOverride(FE);
+  }
+
+  void FilePrefetcher::enqueue(const std::string& Path) {
+    if (m_Queued.size() >= kMaxFiles || !m_Queued.insert(Path).second)
+      return;
+    m_Queue.push_back(Path);
+  }
+
+  void FilePrefetcher::read(const std::string& Path) {
+    auto Buf = MemoryBuffer::getFile(Path, /*FileSize*/ -1,
+                                     /*RequiresNullTerminator*/ true);
+
+    std::vector<std::string> Includes;
+    if (Buf) {
+      StringRef Dir = sys::path::parent_path(Path);
+      StringRef Rest = (*Buf)->getBuffer();
+      while (!Rest.empty()) {
+        StringRef Line;
+        std::tie(Line, Rest) = Rest.split('\n');
+        StringRef Include = getInclude(Line);
+        if (Include.empty())
+          continue;
+        StringRef Name = Include.drop_front().drop_back();
+        SmallString<256> Found;
+        if (Include[0] == '"') {
+          Found = Dir;
+          sys::path::append(Found, Name);
+          if (!sys::fs::exists(Found))
+            Found.clear();
+        }
+        for (size_t I = 0, N = m_SearchDirs.size(); Found.empty() && I < N;
+             ++I) {
+          Found = m_SearchDirs[I];
+          sys::path::append(Found, Name);
+          if (!sys::fs::exists(Found))
+            Found.clear();
+        }
+        if (!Found.empty())
+          Includes.push_back(Found.str().str());
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> Lock(m_Mutex);
+      for (const std::string& Include : Includes)
+        enqueue(Include);
+      m_Read[Path] = std::move(Includes);
+      if (Buf && m_Install)
+        m_Buffers.emplace_back(Path, std::move(*Buf));
+    }
+    m_Wake.notify_all();
+    m_Done.notify_all();
+  }
+
+  void FilePrefetcher::run() {
+    while (true) {
+      std::string Path;
+      {
+        std::unique_lock<std::mutex> Lock(m_Mutex);
+        m_Wake.wait(Lock, [this] { return m_Stop || !m_Queue.empty(); });
+        if (m_Stop)
+          return;
+        Path = std::move(m_Queue.front());
+        m_Queue.pop_front();
+      }
+      read(Path);
+    }
+  }
+
+  void FilePrefetcher::install(const std::string& Path) {
+    std::vector<std::pair<std::string, std::unique_ptr<MemoryBuffer>>> Read;
+    {
+      std::unique_lock<std::mutex> Lock(m_Mutex);
+      // The preprocessor needs the headers that Path includes first.
+      m_Done.wait(Lock, [&] {
+        if (!m_Queued.count(Path))
+          return true;
+        auto I = m_Read.find(Path);
+        if (I == m_Read.end())
+          return false;
+        for (const std::string& Include : I->second)
+          if (m_Queued.count(Include) && !m_Read.count(Include))
+            return false;
+        return true;
+      });
+      Read.swap(m_Buffers);
+    }
+
+    clang::SourceManager& SM = m_CI.getSourceManager();
+    clang::FileManager& FM = SM.getFileManager();
+    for (auto& File : Read) {
+      const clang::FileEntry* FE = FM.getFile(File.first, /*Open*/ false,
+                                              /*CacheFailure*/ false);
+      // An #include may have read it already: its source locations point
+      // into that buffer.
+      if (FE && !SM.hasFileInfo(FE)) {
+        SM.overrideFileContents(FE, std::move(File.second));
+        m_Overridden.push_back(FE);
+      }
+    }
+  }
+} // end namespace cling
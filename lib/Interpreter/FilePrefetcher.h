@@ -0,0 +1,98 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_FILE_PREFETCHER_H
+#define CLING_FILE_PREFETCHER_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace clang {
+  class CompilerInstance;
+  class FileEntry;
+}
+
+namespace llvm {
+  class MemoryBuffer;
+}
+
+namespace cling {
+  ///\brief Reads a set of files, and the headers they include, on worker
+  /// threads while the main thread parses them in order, see
+  /// Interpreter::loadFiles().
+  ///
+  /// The #includes are found on a copy of the include paths, ignoring the
+  /// conditions around them: reading a header too many is cheap. The
+  /// threads never touch the CompilerInstance; the main thread hands what
+  /// they read to the SourceManager, through install(), such that the
+  /// preprocessor needs no I/O for them. Files that the SourceManager
+  /// already knows keep their contents. With a PCH or modules, which would
+  /// see the files as overridden, they are only read into the caches of the
+  /// operating system instead. The overrides that no file got parsed from
+  /// are dropped with the FilePrefetcher: the file is read from the disk
+  /// if it is included later, as it might have changed by then.
+  ///
+  class FilePrefetcher {
+    clang::CompilerInstance& m_CI;
+    std::vector<std::string> m_SearchDirs;
+    ///\brief Whether install() gives the contents to the SourceManager.
+    bool m_Install;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_Wake;
+    std::condition_variable m_Done;
+    std::deque<std::string> m_Queue;
+    ///\brief The files queued so far.
+    llvm::StringSet<> m_Queued;
+    ///\brief The files read so far, with the headers they include.
+    llvm::StringMap<std::vector<std::string>> m_Read;
+    ///\brief The contents read for install().
+    std::vector<std::pair<std::string, std::unique_ptr<llvm::MemoryBuffer>>>
+      m_Buffers;
+    ///\brief The files whose contents install() gave to the SourceManager.
+    std::vector<const clang::FileEntry*> m_Overridden;
+    bool m_Stop = false;
+
+    std::vector<std::thread> m_Workers;
+
+    ///\brief Queues Path unless it was already; m_Mutex must be held.
+    void enqueue(const std::string& Path);
+
+    ///\brief Reads the file Path; queues the headers it includes.
+    void read(const std::string& Path);
+
+    void run();
+
+  public:
+    ///\brief Starts reading Paths on Jobs threads, 0 for one per core.
+    ///\param[in] Install - Whether install() gives the contents to the
+    ///   SourceManager, else it only waits.
+    FilePrefetcher(clang::CompilerInstance& CI,
+                   llvm::ArrayRef<std::string> Paths, unsigned Jobs,
+                   bool Install);
+    ///\brief Stops the threads; drops the contents given to the
+    /// SourceManager that it did not use.
+    ~FilePrefetcher();
+
+    ///\brief Waits until the file Path and the headers it includes are
+    /// read, then hands all files read so far to the SourceManager.
+    void install(const std::string& Path);
+  };
+} // end namespace cling
+
+#endif // CLING_FILE_PREFETCHER_H
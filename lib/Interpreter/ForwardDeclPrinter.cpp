@@ -1,5 +1,7 @@
 #include "ForwardDeclPrinter.h"
 
+#include "AutoloadIndex.h"
+
 #include "cling/Interpreter/DynamicLibraryManager.h"
 #include "cling/Interpreter/Transaction.h"
 #include "cling/Utils/AST.h"
@@ -28,10 +30,12 @@ namespace cling {
                                          const Transaction& T,
                                          unsigned Indentation,
                                          bool printMacros,
-                                         IgnoreFilesFunc_t ignoreFiles)
+                                         IgnoreFilesFunc_t ignoreFiles,
+                                         AutoloadIndex* Index)
     : m_Policy(clang::PrintingPolicy(clang::LangOptions())), m_Log(LogS),
       m_Indentation(Indentation), m_PP(P), m_SMgr(P.getSourceManager()),
-      m_Ctx(Ctx), m_SkipFlag(false), m_IgnoreFile(ignoreFiles) {
+      m_Ctx(Ctx), m_SkipFlag(false), m_IgnoreFile(ignoreFiles),
+      m_Index(Index) {
     m_PrintInstantiation = false;
     m_Policy.SuppressTagKeyword = true;
 
@@ -48,13 +52,20 @@ namespace cling {
         m_BuiltinNames.insert(BuiltinInfo.Name);
 
 
-    // Suppress some unfixable warnings.
-    // TODO: Find proper fix for these issues
-    Out() << "#pragma clang diagnostic ignored \"-Wkeyword-compat\"" << "\n";
-    Out() << "#pragma clang diagnostic ignored \"-Wignored-attributes\"" <<"\n";
-    Out() << "#pragma clang diagnostic ignored \"-Wreturn-type-c-linkage\"" <<"\n";
-    // Inject a special marker:
-    Out() << "extern int __Cling_AutoLoading_Map;\n";
+    {
+      std::string Prelude;
+      llvm::raw_string_ostream PreludeOut(Prelude);
+      // Suppress some unfixable warnings.
+      // TODO: Find proper fix for these issues
+      PreludeOut << "#pragma clang diagnostic ignored \"-Wkeyword-compat\"" << "\n";
+      PreludeOut << "#pragma clang diagnostic ignored \"-Wignored-attributes\"" <<"\n";
+      PreludeOut << "#pragma clang diagnostic ignored \"-Wreturn-type-c-linkage\"" <<"\n";
+      // Inject a special marker:
+      PreludeOut << "extern int __Cling_AutoLoading_Map;\n";
+      Out() << PreludeOut.str();
+      if (m_Index)
+        m_Index->setPrelude(PreludeOut.str());
+    }
 
     std::vector<std::string> macrodefs;
     if (printMacros) {
@@ -123,9 +134,23 @@ namespace cling {
       if (!Insert.first->second) {
         // Already skipped before; notify callers.
         skipDecl(D, 0);
+      } else if (!m_ChunkDeps.empty()) {
+        auto Chunk = m_ChunkOf.find(getCanonicalOrNamespace(D));
+        if (Chunk != m_ChunkOf.end())
+          m_ChunkDeps.back().push_back(Chunk->second);
       }
       return;
     }
+
+    // Namespaces are printed around each of their declarations.
+    const bool IsChunk = m_Index && !isa<NamespaceDecl>(D)
+                         && !isa<LinkageSpecDecl>(D);
+    stdstrstream ChunkOut;
+    if (IsChunk) {
+      m_StreamStack.push(&static_cast<llvm::raw_ostream&>(ChunkOut));
+      m_ChunkDeps.emplace_back();
+    }
+
     if (shouldSkip(D)) {
       // shouldSkip() called skipDecl()
       m_Visited[getCanonicalOrNamespace(D)] = false;
@@ -137,6 +162,37 @@ namespace cling {
         m_Visited[getCanonicalOrNamespace(D)] = false;
       }
     }
+
+    if (IsChunk) {
+      m_StreamStack.pop();
+      if (m_Visited[getCanonicalOrNamespace(D)])
+        addChunk(D, ChunkOut.str());
+      else
+        m_ChunkDeps.pop_back();
+    }
+  }
+
+  void ForwardDeclPrinter::addChunk(clang::Decl* D, std::string Text) {
+    std::vector<unsigned> Deps = std::move(m_ChunkDeps.back());
+    m_ChunkDeps.pop_back();
+    if (Text.empty()) {
+      if (!m_ChunkDeps.empty())
+        m_ChunkDeps.back().insert(m_ChunkDeps.back().end(), Deps.begin(),
+                                  Deps.end());
+      return;
+    }
+    unsigned Chunk = m_Index->addChunk(std::move(Text), std::move(Deps));
+    m_ChunkOf[getCanonicalOrNamespace(D)] = Chunk;
+    // Whoever is printed around D needs it.
+    if (!m_ChunkDeps.empty())
+      m_ChunkDeps.back().push_back(Chunk);
+    if (NamedDecl* ND = dyn_cast<NamedDecl>(D))
+      if (ND->getIdentifier()) {
+        std::string Key = AutoloadIndex::getKey(ND->getDeclContext(),
+                                                ND->getName());
+        if (!Key.empty())
+          m_Index->addName(Key, Chunk);
+      }
   }
 
   void ForwardDeclPrinter::printDeclType(llvm::raw_ostream& Stream, QualType T,
@@ -824,8 +880,20 @@ namespace cling {
     if (!haveAnyDecl) {
       // make sure at least one redecl of this namespace is fwd declared.
       if (D == D->getCanonicalDecl()) {
-        PrintNamespaceOpen(Out(), D);
-        Out() << "}\n";
+        if (m_Index && m_ChunkDeps.empty()) {
+          // Nothing is printed around it; using directives need a chunk to
+          // depend on.
+          stdstrstream NSOut;
+          std::string closeBraces
+            = PrintEnclosingDeclContexts(NSOut, D->getDeclContext());
+          PrintNamespaceOpen(NSOut, D);
+          NSOut << '}' << closeBraces << '\n';
+          m_ChunkDeps.emplace_back();
+          addChunk(D, NSOut.str());
+        } else {
+          PrintNamespaceOpen(Out(), D);
+          Out() << "}\n";
+        }
       }
     }
   }
@@ -19,6 +19,7 @@
 #include "llvm/ADT/DenseMap.h"
 #include <stack>
 #include <set>
+#include <vector>
 
 ///\brief Generates forward declarations for a Decl or Transaction
 ///       by implementing a DeclVisitor
@@ -89,6 +90,7 @@ namespace llvm {
 }
 
 namespace cling {
+  class AutoloadIndex;
   class Transaction;
 
   class ForwardDeclPrinter : public clang::DeclVisitor<ForwardDeclPrinter> {
@@ -110,6 +112,16 @@ namespace cling {
     std::set<const char*> m_BuiltinNames;
     IgnoreFilesFunc_t m_IgnoreFile; // Call back to ignore some top level files.
 
+    ///\brief If set, receives each declaration as a chunk of its own instead
+    /// of the output stream.
+    AutoloadIndex* m_Index;
+    ///\brief The chunks used by the declarations being printed, innermost
+    /// last.
+    std::vector<std::vector<unsigned>> m_ChunkDeps;
+    llvm::DenseMap<const clang::Decl*, unsigned> m_ChunkOf;
+
+    void addChunk(clang::Decl* D, std::string Text);
+
     void printTypedefOrAliasDecl(clang::TypedefNameDecl* D);
 
   public:
@@ -121,7 +133,8 @@ namespace cling {
                        unsigned Indentation = 0,
                        bool printMacros = false,
                        IgnoreFilesFunc_t ignoreFiles =
-                          [](const clang::PresumedLoc&) { return false; } );
+                          [](const clang::PresumedLoc&) { return false; },
+                       AutoloadIndex* Index = nullptr);
 
 //    void VisitDeclContext(clang::DeclContext *DC, bool shouldIndent = true);
 
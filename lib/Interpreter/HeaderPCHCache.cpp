@@ -0,0 +1,194 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "HeaderPCHCache.h"
+
+#include "cling/Interpreter/Interpreter.h"
+#include "cling/Interpreter/InvocationOptions.h"
+#include "cling/Utils/Output.h"
+
+#include "clang/Basic/Version.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+using namespace llvm;
+
+namespace {
+  ///\brief Hashes the contents of the file at Path; empty if unreadable.
+  static std::string hashContents(StringRef Path) {
+    auto Buf = MemoryBuffer::getFile(Path, /*FileSize*/ -1,
+                                     /*RequiresNullTerminator*/ false);
+    if (!Buf)
+      return std::string();
+    MD5 Hash;
+    Hash.update((*Buf)->getBuffer());
+    MD5::MD5Result Result;
+    Hash.final(Result);
+    return Result.digest().str();
+  }
+
+  ///\brief Writes Contents to a unique temporary next to Path, then renames
+  /// it: concurrent sessions must never see a partially written manifest.
+  static bool writeFileAtomically(StringRef Path, StringRef Contents) {
+    int FD;
+    SmallString<256> TmpPath;
+    if (sys::fs::createUniqueFile(Path + ".%%%%%%.tmp", FD, TmpPath))
+      return false;
+    {
+      raw_fd_ostream OS(FD, /*shouldClose*/ true);
+      OS << Contents;
+      if (OS.has_error()) {
+        OS.clear_error();
+        sys::fs::remove(TmpPath);
+        return false;
+      }
+    }
+    if (sys::fs::rename(TmpPath, Path)) {
+      sys::fs::remove(TmpPath);
+      return false;
+    }
+    return true;
+  }
+} // unnamed namespace
+
+namespace cling {
+
+HeaderPCHCache::HeaderPCHCache(StringRef Dir, const InvocationOptions& Opts) {
+  // The flags, but not the inputs: scripts loading the same headers share
+  // the PCH.
+  MD5 Hash;
+  Hash.update(clang::getClangFullVersion());
+  Hash.update(StringRef("", 1));
+  const std::vector<const char*>& Args = Opts.CompilerOpts.Remaining;
+  for (size_t I = 1, E = Args.size(); I < E; ++I) {
+    if (std::find(Opts.Inputs.begin(), Opts.Inputs.end(), Args[I])
+        != Opts.Inputs.end())
+      continue;
+    Hash.update(StringRef(Args[I], ::strlen(Args[I]) + 1));
+  }
+  MD5::MD5Result Result;
+  Hash.final(Result);
+
+  SmallString<256> Path(Dir);
+  sys::path::append(Path, Result.digest().str());
+  m_PCH = (Path + ".pch").str();
+  m_Manifest = (Path + ".headers").str();
+}
+
+std::unique_ptr<HeaderPCHCache>
+HeaderPCHCache::createFromEnv(InvocationOptions& Opts) {
+  const char* Dir = ::getenv("CLING_HEADER_PCH_CACHE");
+  if (!Dir || !*Dir || Opts.CompilerOpts.HasOutput)
+    return nullptr;
+
+  // Clang takes one PCH only.
+  std::vector<const char*>& Remaining = Opts.CompilerOpts.Remaining;
+  for (const char* A : Remaining)
+    if (!::strcmp(A, "-include-pch"))
+      return nullptr;
+
+  if (std::error_code EC = sys::fs::create_directories(Dir)) {
+    cling::errs() << "cling::HeaderPCHCache: cannot use '" << Dir
+                  << "' as header cache: " << EC.message() << '\n';
+    return nullptr;
+  }
+  std::unique_ptr<HeaderPCHCache> Cache(new HeaderPCHCache(Dir, Opts));
+  if (Cache->readManifest()) {
+    // The string outlives the options, as the cache is owned by the
+    // interpreter.
+    Remaining.push_back("-include-pch");
+    Remaining.push_back(Cache->m_PCH.c_str());
+  }
+  return Cache;
+}
+
+bool HeaderPCHCache::readManifest() {
+  if (!sys::fs::exists(m_PCH))
+    return false;
+  auto Buf = MemoryBuffer::getFile(m_Manifest);
+  if (!Buf)
+    return false;
+
+  // One "<hash> <path>" line per header, in the order they were loaded.
+  SmallVector<StringRef, 16> Lines;
+  (*Buf)->getBuffer().split(Lines, '\n', /*MaxSplit*/ -1,
+                            /*KeepEmpty*/ false);
+  std::vector<std::string> Headers;
+  for (StringRef Line : Lines) {
+    std::pair<StringRef, StringRef> HashAndPath = Line.split(' ');
+    if (HashAndPath.second.empty()
+        || hashContents(HashAndPath.second) != HashAndPath.first)
+      return false;
+    Headers.push_back(HashAndPath.second.str());
+  }
+  m_Cached = std::move(Headers);
+  return !m_Cached.empty();
+}
+
+bool HeaderPCHCache::isCached(StringRef Path, const Transaction* Last) {
+  if (Last != m_Last)
+    m_Recording = false;
+  if (!m_Recording || m_Loaded.size() >= m_Cached.size()
+      || m_Cached[m_Loaded.size()] != Path)
+    return false;
+  m_Loaded.push_back(Path.str());
+  return true;
+}
+
+void HeaderPCHCache::recordParsed(StringRef Path, bool Success,
+                                  const Transaction* Last) {
+  if (!m_Recording)
+    return;
+  if (!Success || Path.empty()) {
+    m_Recording = false;
+    return;
+  }
+  m_Loaded.push_back(Path.str());
+  m_Last = Last;
+}
+
+void HeaderPCHCache::update(const Interpreter& Interp) {
+  // All headers loaded this time are in the PCH already?
+  if (m_Loaded.size() <= m_Cached.size()
+      && std::equal(m_Loaded.begin(), m_Loaded.end(), m_Cached.begin()))
+    return;
+
+  std::string Manifest;
+  for (const std::string& Header : m_Loaded) {
+    std::string Hash = hashContents(Header);
+    if (Hash.empty())
+      return;
+    Manifest += Hash + ' ' + Header + '\n';
+  }
+
+  // Another session might be using the PCH: write a new file and replace it.
+  SmallString<256> TmpPCH;
+  if (sys::fs::createUniqueFile(m_PCH + ".%%%%%%.tmp", TmpPCH))
+    return;
+  // Invalidate the manifest first: a session starting in between must not
+  // take the new PCH for the old one.
+  sys::fs::remove(m_Manifest);
+  if (!Interp.writeSnapshot(TmpPCH.str(), m_Loaded))
+    return;
+  if (sys::fs::rename(TmpPCH, m_PCH)) {
+    sys::fs::remove(TmpPCH);
+    return;
+  }
+  writeFileAtomically(m_Manifest, Manifest);
+}
+
+} // end namespace cling
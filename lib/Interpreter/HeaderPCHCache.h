@@ -0,0 +1,83 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_HEADER_PCH_CACHE_H
+#define CLING_HEADER_PCH_CACHE_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cling {
+  class InvocationOptions;
+  class Interpreter;
+  class Transaction;
+
+  ///\brief Precompiles the headers that sessions load at startup, to
+  /// deserialize them instead of parsing them at the next start.
+  ///
+  /// The cache directory holds a PCH and a manifest per set of flags: the
+  /// manifest lists the headers of the PCH with the hash of their contents.
+  /// The PCH is used only if all of them are unchanged. Interpreter::
+  /// loadHeader() records the headers loaded before any other input; if they
+  /// are not those of the PCH, the PCH is rewritten when the interpreter is
+  /// destroyed.
+  ///
+  class HeaderPCHCache {
+    ///\brief <dir>/<flags hash>.pch and .headers.
+    std::string m_PCH;
+    std::string m_Manifest;
+
+    ///\brief The headers in m_PCH, if the invocation uses it.
+    std::vector<std::string> m_Cached;
+
+    ///\brief The headers loaded at startup, so far.
+    std::vector<std::string> m_Loaded;
+
+    ///\brief The last transaction when a header got recorded; any other
+    /// transaction after it ends the startup sequence.
+    const Transaction* m_Last = nullptr;
+    bool m_Recording = true;
+
+    HeaderPCHCache(llvm::StringRef Dir, const InvocationOptions& Opts);
+
+    ///\brief Reads the manifest into m_Cached if it is valid.
+    bool readManifest();
+
+  public:
+    ///\brief Creates the cache if the environment variable
+    /// CLING_HEADER_PCH_CACHE names a usable directory and the invocation
+    /// does not use a PCH already; returns null otherwise. A valid PCH is
+    /// added to the compiler arguments of Opts.
+    static std::unique_ptr<HeaderPCHCache>
+    createFromEnv(InvocationOptions& Opts);
+
+    ///\brief Starts the sequence of startup headers after Last, the last
+    /// transaction of the initialized interpreter.
+    void setLastTransaction(const Transaction* Last) { m_Last = Last; }
+
+    ///\brief Whether the header at Path is the next one of the PCH, in which
+    /// case it is recorded and must not be parsed again.
+    ///\param[in] Last - the last transaction of the interpreter.
+    bool isCached(llvm::StringRef Path, const Transaction* Last);
+
+    ///\brief Records that the header at Path was parsed.
+    ///\param[in] Success - whether it could be; ends the sequence if not.
+    ///\param[in] Last - the last transaction of the interpreter, after it.
+    void recordParsed(llvm::StringRef Path, bool Success,
+                      const Transaction* Last);
+
+    ///\brief Writes the PCH of the recorded headers if it differs from the
+    /// one that was used.
+    void update(const Interpreter& Interp);
+  };
+} // end namespace cling
+
+#endif // CLING_HEADER_PCH_CACHE_H
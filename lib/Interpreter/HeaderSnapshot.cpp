@@ -0,0 +1,338 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "HeaderSnapshot.h"
+
+#include "cling/Utils/Output.h"
+
+#include "clang/Basic/Version.h"
+#include "clang/Lex/HeaderSearchOptions.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <tuple>
+
+using namespace llvm;
+
+namespace {
+  static const char kHeader[] = "cling header snapshot 2";
+
+  ///\brief The largest file that gets archived; larger ones are left to
+  /// the file system.
+  static const uint64_t kMaxFileSize = 4 << 20;
+  ///\brief The largest archive: trees this large are not the toolchain's.
+  static const uint64_t kMaxSize = 1ULL << 30;
+
+  ///\brief How deep the trees are archived, against cycles of symlinks;
+  /// deeper ones are left to the file system.
+  static const int kMaxDepth = 16;
+
+  ///\brief Whether Path is Prefix or in its tree.
+  static bool isInTree(StringRef Path, StringRef Prefix) {
+    return Path.startswith(Prefix)
+           && (Path.size() == Prefix.size()
+               || sys::path::is_separator(Path[Prefix.size()]));
+  }
+
+  static int64_t getModTime(const sys::fs::file_status& S) {
+    return S.getLastModificationTime().time_since_epoch().count();
+  }
+
+  static int64_t getModTime(const vfs::Status& S) {
+    return S.getLastModificationTime().time_since_epoch().count();
+  }
+
+  struct ArchivedFile {
+    std::string Path;
+    uint64_t Size;
+    int64_t ModTime;
+  };
+} // unnamed namespace
+
+namespace cling {
+
+  HeaderSnapshotFileSystem::HeaderSnapshotFileSystem(
+      IntrusiveRefCntPtr<vfs::FileSystem> FS, std::vector<std::string> Roots):
+    ProxyFileSystem(std::move(FS)), m_Files(new vfs::InMemoryFileSystem()),
+    m_Roots(std::move(Roots)) {}
+
+  bool HeaderSnapshotFileSystem::build(StringRef Path,
+                                       const std::vector<std::string>& Roots) {
+    std::vector<std::pair<std::string, int64_t>> Dirs;
+    std::vector<ArchivedFile> Files;
+    std::vector<std::string> Skipped;
+    StringSet<> Seen;
+    uint64_t Size = 0;
+    for (const std::string& Root : Roots) {
+      sys::fs::file_status S;
+      if (sys::fs::status(Root, S) || !Seen.insert(Root).second)
+        continue;
+      Dirs.emplace_back(Root, getModTime(S));
+      std::error_code EC;
+      for (sys::fs::recursive_directory_iterator I(Root, EC), E;
+           I != E && !EC; I.increment(EC)) {
+        const std::string& Entry = I->path();
+        if (Entry.find('\n') != std::string::npos
+            || sys::fs::status(Entry, S) || !Seen.insert(Entry).second) {
+          I.no_push();
+          continue;
+        }
+        if (S.type() == sys::fs::file_type::directory_file) {
+          if (I.level() >= kMaxDepth) {
+            I.no_push();
+            Skipped.push_back(Entry);
+          } else
+            Dirs.emplace_back(Entry, getModTime(S));
+        } else if (S.type() != sys::fs::file_type::regular_file)
+          continue;
+        else if (S.getSize() > kMaxFileSize)
+          Skipped.push_back(Entry);
+        else {
+          Files.push_back({Entry, S.getSize(), getModTime(S)});
+          // Each file is followed by a null, for clang's buffers.
+          Size += S.getSize() + 1;
+          if (Size > kMaxSize)
+            return false;
+        }
+      }
+    }
+
+    SmallString<256> TmpPath;
+    int FD;
+    if (sys::fs::createUniqueFile(Path + ".%%%%%%.tmp", FD, TmpPath))
+      return false;
+    bool Success = true;
+    {
+      raw_fd_ostream OS(FD, /*shouldClose*/ true);
+      OS << kHeader << '\n';
+      for (const std::string& Root : Roots)
+        OS << "root " << Root << '\n';
+      for (const auto& D : Dirs)
+        OS << "dir " << D.second << ' ' << D.first << '\n';
+      for (const std::string& Entry : Skipped)
+        OS << "skip " << Entry << '\n';
+      uint64_t Offset = 0;
+      for (const ArchivedFile& F : Files) {
+        OS << "file " << Offset << ' ' << F.Size << ' ' << F.ModTime << ' '
+           << F.Path << '\n';
+        Offset += F.Size + 1;
+      }
+      OS << "data\n";
+      for (const ArchivedFile& F : Files) {
+        auto Buf = MemoryBuffer::getFile(F.Path, /*FileSize*/ -1,
+                                         /*RequiresNullTerminator*/ false);
+        // The file changed meanwhile; the next session archives it anew.
+        if (!Buf || (*Buf)->getBufferSize() != F.Size) {
+          Success = false;
+          break;
+        }
+        OS << (*Buf)->getBuffer() << '\0';
+      }
+      if (OS.has_error()) {
+        OS.clear_error();
+        Success = false;
+      }
+    }
+    if (!Success || sys::fs::rename(TmpPath, Path)) {
+      sys::fs::remove(TmpPath);
+      return false;
+    }
+    return true;
+  }
+
+  bool HeaderSnapshotFileSystem::load(StringRef Path) {
+    auto Buf = MemoryBuffer::getFile(Path, /*FileSize*/ -1,
+                                     /*RequiresNullTerminator*/ false);
+    if (!Buf)
+      return false;
+    StringRef Rest = (*Buf)->getBuffer();
+    StringRef Line;
+    std::tie(Line, Rest) = Rest.split('\n');
+    if (Line != kHeader)
+      return false;
+    m_Files = new vfs::InMemoryFileSystem();
+    m_Skipped.clear();
+    m_Stamps.clear();
+    m_Changed.clear();
+
+    // The index, up to the data that the files are offsets into.
+    std::vector<StringRef> FileLines;
+    size_t NumRoots = 0;
+    while (true) {
+      if (Rest.empty())
+        return false;
+      std::tie(Line, Rest) = Rest.split('\n');
+      if (Line == "data")
+        break;
+      StringRef Kind, Value;
+      std::tie(Kind, Value) = Line.split(' ');
+      if (Kind == "root") {
+        if (NumRoots >= m_Roots.size() || Value != m_Roots[NumRoots])
+          return false;
+        ++NumRoots;
+      } else if (Kind == "dir") {
+        // An entry of the directory changed; the archive is stale.
+        StringRef Time, Dir;
+        std::tie(Time, Dir) = Value.split(' ');
+        int64_t ModTime;
+        sys::fs::file_status S;
+        if (Time.getAsInteger(10, ModTime) || sys::fs::status(Dir, S)
+            || getModTime(S) != ModTime)
+          return false;
+      } else if (Kind == "skip")
+        m_Skipped.push_back(Value.str());
+      else if (Kind == "file")
+        FileLines.push_back(Value);
+      else
+        return false;
+    }
+    if (NumRoots != m_Roots.size())
+      return false;
+
+    const StringRef Data = Rest;
+    for (StringRef Value : FileLines) {
+      StringRef Offset, Size, Time;
+      std::tie(Offset, Value) = Value.split(' ');
+      std::tie(Size, Value) = Value.split(' ');
+      std::tie(Time, Value) = Value.split(' ');
+      uint64_t O, S;
+      int64_t T;
+      if (Offset.getAsInteger(10, O) || Size.getAsInteger(10, S)
+          || Time.getAsInteger(10, T) || O + S >= Data.size()
+          || Data[O + S] != '\0')
+        return false;
+      // The buffers refer to the mapped archive; the null after each one
+      // terminates them as clang expects.
+      m_Files->addFile(Value,
+                       sys::toTimeT(sys::TimePoint<>(
+                           sys::TimePoint<>::duration(T))),
+                       MemoryBuffer::getMemBuffer(Data.substr(O, S), Value));
+      m_Stamps[Value] = std::make_pair(S, T);
+    }
+    m_Archive = std::move(*Buf);
+    m_Path = Path.str();
+    return true;
+  }
+
+  IntrusiveRefCntPtr<vfs::FileSystem>
+  HeaderSnapshotFileSystem::createFromEnv(
+      IntrusiveRefCntPtr<vfs::FileSystem> FS,
+      const clang::HeaderSearchOptions& HSOpts) {
+    const char* Dir = ::getenv("CLING_HEADER_SNAPSHOT");
+    if (!Dir || !*Dir)
+      return FS;
+
+    // The directories of the system headers, which the user does not edit.
+    std::vector<std::string> Roots;
+    for (const clang::HeaderSearchOptions::Entry& E : HSOpts.UserEntries) {
+      switch (E.Group) {
+      case clang::frontend::System:
+      case clang::frontend::ExternCSystem:
+      case clang::frontend::CSystem:
+      case clang::frontend::CXXSystem:
+        break;
+      default:
+        continue;
+      }
+      if (E.IsFramework || !sys::path::is_absolute(E.Path)
+          || !sys::fs::is_directory(E.Path)
+          || std::find(Roots.begin(), Roots.end(), E.Path) != Roots.end())
+        continue;
+      Roots.push_back(E.Path);
+    }
+    if (Roots.empty())
+      return FS;
+
+    MD5 Hash;
+    Hash.update(clang::getClangFullVersion());
+    for (const std::string& Root : Roots) {
+      Hash.update(StringRef("", 1));
+      Hash.update(Root);
+    }
+    MD5::MD5Result Result;
+    Hash.final(Result);
+    SmallString<256> Path(Dir);
+    sys::path::append(Path, Twine(Result.digest().str()) + ".snapshot");
+    if (sys::fs::create_directories(Dir))
+      return FS;
+
+    IntrusiveRefCntPtr<HeaderSnapshotFileSystem> Snapshot(
+        new HeaderSnapshotFileSystem(FS, Roots));
+    if (Snapshot->load(Path))
+      return Snapshot;
+    if (HSOpts.Verbose)
+      cling::log() << "Archiving the system headers into " << Path << "\n";
+    if (build(Path, Roots) && Snapshot->load(Path))
+      return Snapshot;
+    cling::errs() << "cling::HeaderSnapshot: cannot archive the system "
+                     "headers into " << Path << "\n";
+    return FS;
+  }
+
+  bool HeaderSnapshotFileSystem::isInSnapshot(const Twine& Path) const {
+    SmallString<256> Buf;
+    StringRef P = Path.toStringRef(Buf);
+    auto Root = std::find_if(m_Roots.begin(), m_Roots.end(),
+                             [P](const std::string& R) {
+                               return P.size() > R.size() && isInTree(P, R);
+                             });
+    if (Root == m_Roots.end())
+      return false;
+    return std::none_of(m_Skipped.begin(), m_Skipped.end(),
+                        [P](const std::string& S) { return isInTree(P, S); });
+  }
+
+  bool HeaderSnapshotFileSystem::isChanged(const Twine& Path) {
+    SmallString<256> Buf;
+    StringRef P = Path.toStringRef(Buf);
+    if (m_Changed.count(P))
+      return true;
+    auto Stamp = m_Stamps.find(P);
+    if (Stamp == m_Stamps.end())
+      return false;
+    // Rewriting a file in place leaves the time of its directory alone.
+    ErrorOr<vfs::Status> S = ProxyFileSystem::status(P);
+    bool Same = S && S->getSize() == Stamp->second.first
+                && getModTime(*S) == Stamp->second.second;
+    m_Stamps.erase(Stamp);
+    if (Same)
+      return false;
+    m_Changed.insert(P);
+    // For the next session to archive the trees anew; the mapping stays.
+    sys::fs::remove(m_Path);
+    return true;
+  }
+
+  ErrorOr<vfs::Status> HeaderSnapshotFileSystem::status(const Twine& Path) {
+    if (isInSnapshot(Path) && !isChanged(Path))
+      return m_Files->status(Path);
+    return ProxyFileSystem::status(Path);
+  }
+
+  ErrorOr<std::unique_ptr<vfs::File>>
+  HeaderSnapshotFileSystem::openFileForRead(const Twine& Path) {
+    if (isInSnapshot(Path) && !isChanged(Path))
+      return m_Files->openFileForRead(Path);
+    return ProxyFileSystem::openFileForRead(Path);
+  }
+
+  vfs::directory_iterator
+  HeaderSnapshotFileSystem::dir_begin(const Twine& Dir, std::error_code& EC) {
+    if (isInSnapshot(Dir))
+      return m_Files->dir_begin(Dir, EC);
+    return ProxyFileSystem::dir_begin(Dir, EC);
+  }
+} // end namespace cling
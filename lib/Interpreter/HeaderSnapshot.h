@@ -0,0 +1,97 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_HEADER_SNAPSHOT_H
+#define CLING_HEADER_SNAPSHOT_H
+
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace clang {
+  class HeaderSearchOptions;
+}
+
+namespace cling {
+  ///\brief Serves the system include directories, i.e. those of the C and
+  /// C++ libraries and of the toolchain, from one archive of their trees.
+  ///
+  /// The archive holds the files of the trees, after an index of them and of
+  /// their directories. It is mapped into memory and mounted in front of the
+  /// file system: the lookups and reads of the header search below these
+  /// directories are answered from it, including the misses, instead of
+  /// asking the file system for each one.
+  ///
+  /// CLING_HEADER_SNAPSHOT names the directory of the archives, one per set
+  /// of system directories. An archive is built when there is none for the
+  /// set, or when the time of one of the directories of the trees changed,
+  /// i.e. an entry got added, removed or replaced. A file rewritten in place
+  /// leaves its directory alone: the files are compared to the file system
+  /// when first looked up, and read from it if they changed.
+  ///
+  class HeaderSnapshotFileSystem : public llvm::vfs::ProxyFileSystem {
+    ///\brief The mapped archive, which m_Files refers to.
+    std::unique_ptr<llvm::MemoryBuffer> m_Archive;
+    llvm::IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> m_Files;
+
+    ///\brief The directories whose trees are in the archive, and the files
+    /// and trees in them that are not, e.g. because they are too large.
+    std::vector<std::string> m_Roots;
+    std::vector<std::string> m_Skipped;
+
+    ///\brief The path of the archive.
+    std::string m_Path;
+    ///\brief The size and time of the archived files not compared yet to
+    /// the file system, and those that differ from it.
+    llvm::StringMap<std::pair<uint64_t, int64_t>> m_Stamps;
+    llvm::StringSet<> m_Changed;
+
+    HeaderSnapshotFileSystem(
+        llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS,
+        std::vector<std::string> Roots);
+
+    ///\brief Mounts the archive Path if it is the one of m_Roots and up to
+    /// date.
+    bool load(llvm::StringRef Path);
+
+    ///\brief Whether Path is in one of the trees, not being its root.
+    bool isInSnapshot(const llvm::Twine& Path) const;
+
+    ///\brief Whether the archived file Path differs from the one of the file
+    /// system, which then makes the archive stale.
+    bool isChanged(const llvm::Twine& Path);
+
+  public:
+    ///\brief Archives the trees of Roots into Path.
+    ///\returns false if they cannot be, e.g. because they are too large.
+    static bool build(llvm::StringRef Path,
+                      const std::vector<std::string>& Roots);
+
+    ///\brief Wraps FS if CLING_HEADER_SNAPSHOT is set and the system
+    /// directories of HSOpts can be archived; returns FS otherwise.
+    static llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem>
+    createFromEnv(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS,
+                  const clang::HeaderSearchOptions& HSOpts);
+
+    llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine& Path) override;
+    llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+    openFileForRead(const llvm::Twine& Path) override;
+    llvm::vfs::directory_iterator dir_begin(const llvm::Twine& Dir,
+                                            std::error_code& EC) override;
+  };
+} // end namespace cling
+
+#endif // CLING_HEADER_SNAPSHOT_H
@@ -0,0 +1,334 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "HeapProfiler.h"
+
+#include "cling/Utils/Output.h"
+#include "cling/Utils/Platform.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Object/SymbolSize.h"
+#include "llvm/Support/Compiler.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <type_traits>
+
+#if defined(__GNUC__) && !defined(_WIN32)
+// The hooks find their caller through __builtin_return_address(), and
+// replace the allocation functions of the Itanium C++ ABI.
+#define CLING_HEAP_HOOKS 1
+#endif
+
+using namespace llvm;
+
+namespace cling {
+  struct HeapProfiler::FunctionUsage {
+    HeapProfiler* Owner;
+    std::string Name;
+    ///\brief The address of its code.
+    uint64_t Begin;
+    HeapUsage Live;
+  };
+} // end namespace cling
+
+namespace {
+  using cling::HeapProfiler;
+  using FunctionUsage = HeapProfiler::FunctionUsage;
+
+  struct Allocation {
+    size_t Size;
+    FunctionUsage* Caller;
+  };
+
+  struct CodeRange {
+    uint64_t End;
+    FunctionUsage* Function;
+  };
+
+  ///\brief What the hooks of all interpreters share. Leaked: the JITted
+  /// code might still allocate while the process exits.
+  struct HeapTable {
+    std::mutex Mutex;
+    ///\brief The code of the functions of the objects loaded, by address.
+    std::map<uint64_t, CodeRange> Code;
+    llvm::DenseMap<void*, Allocation> Live;
+
+    static HeapTable& get() {
+      static HeapTable* Table = new HeapTable();
+      return *Table;
+    }
+
+    FunctionUsage* findFunction(uint64_t Addr) const {
+      auto I = Code.upper_bound(Addr);
+      if (I == Code.begin())
+        return nullptr;
+      --I;
+      return Addr < I->second.End ? I->second.Function : nullptr;
+    }
+
+    void add(void* P, size_t Size, const void* ReturnAddr) {
+      if (!P)
+        return;
+      std::lock_guard<std::mutex> Lock(Mutex);
+      // Right after the call, which might end the caller's code.
+      FunctionUsage* F = findFunction(uint64_t(uintptr_t(ReturnAddr)) - 1);
+      if (!F)
+        return;
+      put(P, Allocation{Size, F});
+    }
+
+    void put(void* P, Allocation A) {
+      A.Caller->Live.Bytes += A.Size;
+      ++A.Caller->Live.Allocations;
+      Live[P] = A;
+    }
+
+    bool take(void* P, Allocation& A) {
+      auto I = Live.find(P);
+      if (I == Live.end())
+        return false;
+      A = I->second;
+      A.Caller->Live.Bytes -= A.Size;
+      --A.Caller->Live.Allocations;
+      Live.erase(I);
+      return true;
+    }
+
+    void remove(void* P) {
+      if (!P)
+        return;
+      std::lock_guard<std::mutex> Lock(Mutex);
+      Allocation A;
+      take(P, A);
+    }
+  };
+
+#ifdef CLING_HEAP_HOOKS
+#define CLING_CALLER __builtin_return_address(0)
+
+  LLVM_ATTRIBUTE_NOINLINE static void* HookMalloc(size_t Size) {
+    void* P = ::malloc(Size);
+    HeapTable::get().add(P, Size, CLING_CALLER);
+    return P;
+  }
+
+  LLVM_ATTRIBUTE_NOINLINE static void* HookCalloc(size_t N, size_t Size) {
+    void* P = ::calloc(N, Size);
+    HeapTable::get().add(P, N * Size, CLING_CALLER);
+    return P;
+  }
+
+  LLVM_ATTRIBUTE_NOINLINE static void* HookRealloc(void* Old, size_t Size) {
+    HeapTable& Table = HeapTable::get();
+    // Forget Old before it is freed, another thread might get its address.
+    Allocation A;
+    bool Tracked = false;
+    if (Old) {
+      std::lock_guard<std::mutex> Lock(Table.Mutex);
+      Tracked = Table.take(Old, A);
+    }
+    void* P = ::realloc(Old, Size);
+    if (P)
+      Table.add(P, Size, CLING_CALLER);
+    else if (Tracked && Size) {
+      std::lock_guard<std::mutex> Lock(Table.Mutex);
+      Table.put(Old, A);
+    }
+    return P;
+  }
+
+  LLVM_ATTRIBUTE_NOINLINE static void HookFree(void* P) {
+    HeapTable::get().remove(P);
+    ::free(P);
+  }
+
+  LLVM_ATTRIBUTE_NOINLINE static void* HookNew(size_t Size) {
+    void* P = ::operator new(Size);
+    HeapTable::get().add(P, Size, CLING_CALLER);
+    return P;
+  }
+
+  LLVM_ATTRIBUTE_NOINLINE static void* HookNewArray(size_t Size) {
+    void* P = ::operator new[](Size);
+    HeapTable::get().add(P, Size, CLING_CALLER);
+    return P;
+  }
+
+  static void HookDelete(void* P) {
+    HeapTable::get().remove(P);
+    ::operator delete(P);
+  }
+
+  static void HookDeleteArray(void* P) {
+    HeapTable::get().remove(P);
+    ::operator delete[](P);
+  }
+
+  static void HookDeleteSized(void* P, size_t) { HookDelete(P); }
+
+  static void HookDeleteArraySized(void* P, size_t) { HookDeleteArray(P); }
+
+#undef CLING_CALLER
+#endif // CLING_HEAP_HOOKS
+} // unnamed namespace
+
+namespace cling {
+
+  HeapProfiler::HeapProfiler() {}
+
+  HeapProfiler::~HeapProfiler() {
+    HeapTable& Table = HeapTable::get();
+    std::lock_guard<std::mutex> Lock(Table.Mutex);
+    for (auto I = Table.Live.begin(), E = Table.Live.end(); I != E; ++I)
+      if (I->second.Caller->Owner == this)
+        Table.Live.erase(I);
+    for (const auto& Object : m_Objects)
+      for (const auto& F : Object.second) {
+        auto I = Table.Code.find(F->Begin);
+        if (I != Table.Code.end() && I->second.Function == F.get())
+          Table.Code.erase(I);
+      }
+  }
+
+  std::unique_ptr<HeapProfiler> HeapProfiler::createFromEnv() {
+    if (!::getenv("CLING_HEAP_PROFILE"))
+      return nullptr;
+    if (getHooks().empty()) {
+      cling::errs() << "cling::HeapProfiler: the heap allocations cannot be "
+                       "tracked on this platform\n";
+      return nullptr;
+    }
+    return std::unique_ptr<HeapProfiler>(new HeapProfiler());
+  }
+
+  const std::vector<std::pair<const char*, JITTargetAddress>>&
+  HeapProfiler::getHooks() {
+    using Hooks = std::vector<std::pair<const char*, JITTargetAddress>>;
+    static const Hooks AllHooks = [] {
+      Hooks H;
+#ifdef CLING_HEAP_HOOKS
+      // How size_t mangles.
+      const bool Long = std::is_same<size_t, unsigned long>::value;
+      H.emplace_back("malloc", JITTargetAddress(&HookMalloc));
+      H.emplace_back("calloc", JITTargetAddress(&HookCalloc));
+      H.emplace_back("realloc", JITTargetAddress(&HookRealloc));
+      H.emplace_back("free", JITTargetAddress(&HookFree));
+      H.emplace_back(Long ? "_Znwm" : "_Znwj", JITTargetAddress(&HookNew));
+      H.emplace_back(Long ? "_Znam" : "_Znaj",
+                     JITTargetAddress(&HookNewArray));
+      H.emplace_back("_ZdlPv", JITTargetAddress(&HookDelete));
+      H.emplace_back("_ZdaPv", JITTargetAddress(&HookDeleteArray));
+      H.emplace_back(Long ? "_ZdlPvm" : "_ZdlPvj",
+                     JITTargetAddress(&HookDeleteSized));
+      H.emplace_back(Long ? "_ZdaPvm" : "_ZdaPvj",
+                     JITTargetAddress(&HookDeleteArraySized));
+#endif
+      return H;
+    }();
+    return AllHooks;
+  }
+
+  std::map<HeapProfiler::ObjectKey, std::vector<HeapReport::Function>>
+  HeapProfiler::getUsage(HeapUsage& Unloaded) {
+    std::map<ObjectKey, std::vector<HeapReport::Function>> Usage;
+    HeapTable& Table = HeapTable::get();
+    std::lock_guard<std::mutex> Lock(Table.Mutex);
+    for (const auto& Object : m_Objects) {
+      std::vector<HeapReport::Function> Functions;
+      for (const auto& F : Object.second)
+        if (F->Live.Allocations)
+          Functions.push_back({F->Name, F->Live});
+      if (Functions.empty())
+        continue;
+      std::sort(Functions.begin(), Functions.end(),
+                [](const HeapReport::Function& L,
+                   const HeapReport::Function& R) {
+                  return L.Usage.Bytes > R.Usage.Bytes;
+                });
+      Usage[Object.first] = std::move(Functions);
+    }
+    // Drop the functions of the objects freed once nothing of theirs is
+    // left.
+    auto IsFreed = [](const std::unique_ptr<FunctionUsage>& F) {
+      return !F->Live.Allocations;
+    };
+    m_Unloaded.erase(std::remove_if(m_Unloaded.begin(), m_Unloaded.end(),
+                                    IsFreed),
+                     m_Unloaded.end());
+    for (const auto& F : m_Unloaded)
+      Unloaded += F->Live;
+    return Usage;
+  }
+
+  void
+  HeapProfiler::notifyObjectLoaded(ObjectKey K, const object::ObjectFile& Obj,
+                                   const RuntimeDyld::LoadedObjectInfo& L) {
+    std::vector<std::unique_ptr<FunctionUsage>> Functions;
+    std::vector<uint64_t> Ends;
+    for (const auto& SymAndSize : object::computeSymbolSizes(Obj)) {
+      const object::SymbolRef& Sym = SymAndSize.first;
+      Expected<object::SymbolRef::Type> Type = Sym.getType();
+      if (!Type || *Type != object::SymbolRef::ST_Function
+          || !SymAndSize.second) {
+        consumeError(Type.takeError());
+        continue;
+      }
+      Expected<StringRef> Name = Sym.getName();
+      Expected<uint64_t> Addr = Sym.getAddress();
+      Expected<object::section_iterator> Sec = Sym.getSection();
+      if (!Name || !Addr || !Sec || *Sec == Obj.section_end()) {
+        consumeError(Name.takeError());
+        consumeError(Addr.takeError());
+        consumeError(Sec.takeError());
+        continue;
+      }
+      uint64_t Load = L.getSectionLoadAddress(**Sec);
+      if (!Load)
+        continue;
+      Load += *Addr - (*Sec)->getAddress();
+
+      std::string Demangled = utils::platform::Demangle(Name->str());
+      Functions.emplace_back(new FunctionUsage{
+          this, Demangled.empty() ? Name->str() : Demangled, Load,
+          HeapUsage()});
+      Ends.push_back(Load + SymAndSize.second);
+    }
+    if (Functions.empty())
+      return;
+
+    HeapTable& Table = HeapTable::get();
+    std::lock_guard<std::mutex> Lock(Table.Mutex);
+    for (size_t I = 0, N = Functions.size(); I < N; ++I)
+      // Of aliases, the first one names the code.
+      Table.Code.emplace(Functions[I]->Begin,
+                         CodeRange{Ends[I], Functions[I].get()});
+    std::vector<std::unique_ptr<FunctionUsage>>& Known = m_Objects[K];
+    for (auto& F : Functions)
+      Known.push_back(std::move(F));
+  }
+
+  void HeapProfiler::notifyFreeingObject(ObjectKey K) {
+    HeapTable& Table = HeapTable::get();
+    std::lock_guard<std::mutex> Lock(Table.Mutex);
+    auto IObject = m_Objects.find(K);
+    if (IObject == m_Objects.end())
+      return;
+    for (auto& F : IObject->second) {
+      auto I = Table.Code.find(F->Begin);
+      if (I != Table.Code.end() && I->second.Function == F.get())
+        Table.Code.erase(I);
+      if (F->Live.Allocations)
+        m_Unloaded.push_back(std::move(F));
+    }
+    m_Objects.erase(IObject);
+  }
+} // end namespace cling
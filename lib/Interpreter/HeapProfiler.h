@@ -0,0 +1,74 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_HEAP_PROFILER_H
+#define CLING_HEAP_PROFILER_H
+
+#include "cling/Interpreter/HeapReport.h"
+
+#include "llvm/ExecutionEngine/JITEventListener.h"
+#include "llvm/ExecutionEngine/JITSymbol.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cling {
+  ///\brief Tracks the heap allocations of the JITted code, by the function
+  /// calling the allocator; see HeapReport.
+  ///
+  /// The JIT resolves the allocation functions of its objects to the hooks
+  /// of getHooks(), which the profiler of the object's code gets told about,
+  /// by the return address of the call. The hooks are shared by all
+  /// interpreters of the process: the functions of the objects loaded and
+  /// the live allocations are kept in a table of the process, under a lock
+  /// that every allocation takes.
+  ///
+  class HeapProfiler : public llvm::JITEventListener {
+  public:
+    struct FunctionUsage;
+
+  private:
+    ///\brief The functions of the objects loaded, by key.
+    std::map<ObjectKey,
+             std::vector<std::unique_ptr<FunctionUsage>>> m_Objects;
+
+    ///\brief The functions of the objects freed that still have live
+    /// allocations; those count as unattributed.
+    std::vector<std::unique_ptr<FunctionUsage>> m_Unloaded;
+
+    HeapProfiler();
+
+  public:
+    ~HeapProfiler();
+
+    ///\brief Creates the profiler if the environment variable
+    /// CLING_HEAP_PROFILE is set, returns null otherwise or if the hooks are
+    /// not available on this platform.
+    static std::unique_ptr<HeapProfiler> createFromEnv();
+
+    ///\brief The addresses of the hooks, by the unmangled names of the
+    /// allocation functions they replace.
+    static const std::vector<std::pair<const char*, llvm::JITTargetAddress>>&
+    getHooks();
+
+    ///\brief The live allocations of the functions of each object loaded,
+    /// by key; those of the objects freed are added to Unloaded.
+    std::map<ObjectKey, std::vector<HeapReport::Function>>
+    getUsage(HeapUsage& Unloaded);
+
+    void
+    notifyObjectLoaded(ObjectKey K, const llvm::object::ObjectFile& Obj,
+                       const llvm::RuntimeDyld::LoadedObjectInfo& L) override;
+    void notifyFreeingObject(ObjectKey K) override;
+  };
+} // end namespace cling
+
+#endif // CLING_HEAP_PROFILER_H
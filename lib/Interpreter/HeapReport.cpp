@@ -0,0 +1,48 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "cling/Interpreter/HeapReport.h"
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace {
+  static void printUsage(llvm::raw_ostream& Out, const std::string& Name,
+                         const cling::HeapUsage& U) {
+    Out << llvm::format("%-40s %12zu %10zu\n", Name.c_str(), U.Bytes,
+                        U.Allocations);
+  }
+} // unnamed namespace
+
+namespace cling {
+
+  HeapUsage HeapReport::getTotal() const {
+    HeapUsage Total = Unattributed;
+    for (const Entry& E : Transactions)
+      Total += E.Usage;
+    return Total;
+  }
+
+  void HeapReport::print(llvm::raw_ostream& Out) const {
+    if (!Enabled) {
+      Out << "Heap allocations are not tracked; start the session with "
+             "CLING_HEAP_PROFILE set\n";
+      return;
+    }
+    Out << llvm::format("%-40s %12s %10s\n", "transaction", "bytes",
+                        "allocs");
+    for (const Entry& E : Transactions) {
+      printUsage(Out, "#" + std::to_string(E.Index), E.Usage);
+      for (const Function& F : E.Functions)
+        printUsage(Out, "  " + F.Name, F.Usage);
+    }
+    printUsage(Out, "unattributed", Unattributed);
+    printUsage(Out, "total", getTotal());
+    Out << "live allocations of the JITted code\n";
+  }
+} // end namespace cling
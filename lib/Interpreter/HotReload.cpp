@@ -0,0 +1,253 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "HotReload.h"
+
+#include "IncrementalExecutor.h"
+#include "IncrementalParser.h"
+
+#include "cling/Interpreter/CompilationOptions.h"
+#include "cling/Interpreter/Transaction.h"
+#include "cling/Utils/AST.h"
+#include "cling/Utils/Output.h"
+
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/AST/GlobalDecl.h"
+#include "clang/AST/Stmt.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <algorithm>
+
+using namespace clang;
+
+namespace {
+  ///\brief Collects the function bodies of a file that reloads can replace.
+  struct BodyCollector {
+    const SourceManager& SM;
+    const FileEntry* FE;
+    FileID FID;
+    std::vector<std::pair<FunctionDecl*, std::pair<size_t, size_t>>> Bodies;
+
+    BodyCollector(const SourceManager& SM, const FileEntry* FE):
+      SM(SM), FE(FE) {}
+
+    bool isInFile(SourceLocation Loc) {
+      if (Loc.isInvalid() || !Loc.isFileID())
+        return false;
+      if (FID.isInvalid()) {
+        FileID F = SM.getFileID(Loc);
+        if (SM.getFileEntryForID(F) != FE)
+          return false;
+        FID = F;
+      }
+      return SM.getFileID(Loc) == FID;
+    }
+
+    void addFunction(FunctionDecl* FD) {
+      if (!FD->doesThisDeclarationHaveABody() || FD->isDependentContext()
+          || FD->isConstexpr() || FD->isDefaulted() || FD->isDeleted()
+          || isa<CXXConstructorDecl>(FD) || isa<CXXDestructorDecl>(FD))
+        return;
+      const CompoundStmt* CS = dyn_cast_or_null<CompoundStmt>(FD->getBody());
+      if (!CS || !isInFile(CS->getLBracLoc()) || !isInFile(CS->getRBracLoc()))
+        return;
+      Bodies.push_back({FD, {SM.getFileOffset(CS->getLBracLoc()),
+                             SM.getFileOffset(CS->getRBracLoc()) + 1}});
+    }
+
+    void addDecl(Decl* D) {
+      if (!isInFile(SM.getExpansionLoc(D->getBeginLoc())))
+        return;
+      if (auto* FD = dyn_cast<FunctionDecl>(D))
+        addFunction(FD);
+      else if (auto* NSD = dyn_cast<NamespaceDecl>(D)) {
+        for (Decl* Child : NSD->decls())
+          addDecl(Child);
+      } else if (auto* LSD = dyn_cast<LinkageSpecDecl>(D)) {
+        for (Decl* Child : LSD->decls())
+          addDecl(Child);
+      } else if (auto* RD = dyn_cast<CXXRecordDecl>(D)) {
+        if (RD->isThisDeclarationADefinition() && !RD->isDependentContext())
+          for (Decl* Child : RD->decls())
+            addDecl(Child);
+      }
+    }
+
+    void collect(const cling::Transaction& T) {
+      for (auto I = T.decls_begin(), E = T.decls_end(); I != E; ++I) {
+        if (I->m_Call != cling::Transaction::kCCIHandleTopLevelDecl)
+          continue;
+        for (Decl* D : I->m_DGR)
+          addDecl(D);
+      }
+      for (auto I = T.nested_begin(), E = T.nested_end(); I != E; ++I)
+        collect(**I);
+    }
+  };
+
+  static bool isIdentifierChar(char C) {
+    return isalnum((unsigned char)C) || C == '_';
+  }
+} // unnamed namespace
+
+namespace cling {
+
+  void HotReload::add(llvm::StringRef Path, const Transaction& T) {
+    const SourceManager& SM = m_IncrParser.getCI()->getSourceManager();
+    const FileEntry* FE = SM.getFileManager().getFile(Path, /*Open*/false,
+                                                      /*CacheFailure*/false);
+    if (!FE)
+      return;
+    BodyCollector C(SM, FE);
+    C.collect(T);
+    if (C.FID.isInvalid())
+      return;
+
+    File& F = m_Files[Path];
+    F.Transactions.assign(1, &T);
+    F.Text = SM.getBufferData(C.FID).str();
+    F.Bodies.clear();
+    for (const auto& B : C.Bodies)
+      F.Bodies.push_back({B.first, B.second.first, B.second.second});
+    std::sort(F.Bodies.begin(), F.Bodies.end(),
+              [](const Body& L, const Body& R) { return L.Begin < R.Begin; });
+  }
+
+  void HotReload::forget(const Transaction& T) {
+    for (auto I = m_Files.begin(), E = m_Files.end(); I != E;) {
+      auto Cur = I++;
+      const std::vector<const Transaction*>& Ts = Cur->second.Transactions;
+      if (std::find(Ts.begin(), Ts.end(), &T) != Ts.end())
+        m_Files.erase(Cur);
+    }
+  }
+
+  HotReload::Result HotReload::reload(llvm::StringRef Path) {
+    auto FI = m_Files.find(Path);
+    if (FI == m_Files.end() || !m_Executor)
+      return kLoadAnew;
+    File& F = FI->second;
+
+    auto MB = llvm::MemoryBuffer::getFile(Path);
+    if (!MB) {
+      cling::errs() << "cling::HotReload: cannot read " << Path << "\n";
+      return kFailed;
+    }
+    const llvm::StringRef New = (*MB)->getBuffer();
+    const llvm::StringRef Old = F.Text;
+    if (New == Old)
+      return kUnchanged;
+
+    // Match the text between the bodies; each body of the new text ends
+    // where its braces balance.
+    std::vector<Body> NewBodies;
+    std::vector<IncrementalParser::ReparsedBody> Changed;
+    size_t OldPos = 0, NewPos = 0;
+    for (const Body& B : F.Bodies) {
+      const llvm::StringRef Skeleton = Old.slice(OldPos, B.Begin);
+      if (!New.substr(NewPos).startswith(Skeleton))
+        return kLoadAnew;
+      const size_t Begin = NewPos + Skeleton.size();
+      const size_t End = findBodyEnd(New, Begin);
+      if (End == llvm::StringRef::npos)
+        return kLoadAnew;
+      const llvm::StringRef Text = New.slice(Begin, End);
+      if (Text != Old.slice(B.Begin, B.End)) {
+        std::string MangledName;
+        utils::Analyze::maybeMangleDeclName(GlobalDecl(B.FD), MangledName);
+        if (!m_Executor->isReloadable(MangledName))
+          return kLoadAnew;
+        // Pad the body to where it is in the file, for the diagnostics and
+        // the debug info to point into it.
+        std::string Buf;
+        Buf.reserve(End + 1);
+        for (char C : New.substr(0, Begin))
+          Buf += (C == '\n' || C == '\r' || C == '\t') ? C : ' ';
+        Buf += Text;
+        Buf += '\n';
+        Changed.emplace_back(B.FD,
+                             llvm::MemoryBuffer::getMemBufferCopy(Buf, Path));
+      }
+      NewBodies.push_back({B.FD, Begin, End});
+      OldPos = B.End;
+      NewPos = End;
+    }
+    if (New.substr(NewPos) != Old.substr(OldPos))
+      return kLoadAnew;
+
+    // With the options that the file was loaded with, not today's.
+    const CompilationOptions CO = F.Transactions.front()->getCompilationOpts();
+    IncrementalParser::ParseResultTransaction PRT
+      = m_IncrParser.reparseFunctionBodies(std::move(Changed), CO);
+    if (PRT.getInt() == IncrementalParser::kFailed || !PRT.getPointer())
+      return kFailed;
+    F.Text = New.str();
+    F.Bodies.swap(NewBodies);
+    F.Transactions.push_back(PRT.getPointer());
+    return kReloaded;
+  }
+
+  size_t HotReload::findBodyEnd(llvm::StringRef Text, size_t Begin) {
+    const size_t NPos = llvm::StringRef::npos;
+    const size_t Size = Text.size();
+    if (Begin >= Size || Text[Begin] != '{')
+      return NPos;
+    unsigned Depth = 0;
+    for (size_t I = Begin; I < Size; ++I) {
+      const char C = Text[I];
+      if (C == '{')
+        ++Depth;
+      else if (C == '}') {
+        if (!--Depth)
+          return I + 1;
+      } else if (C == '/' && I + 1 < Size && Text[I + 1] == '/') {
+        I = Text.find('\n', I);
+        if (I == NPos)
+          return NPos;
+      } else if (C == '/' && I + 1 < Size && Text[I + 1] == '*') {
+        I = Text.find("*/", I + 2);
+        if (I == NPos)
+          return NPos;
+        ++I;
+      } else if (C == '\'' || C == '"') {
+        // The prefix of a literal, or the digits that a ' separates.
+        size_t P = I;
+        while (P > Begin
+               && (isIdentifierChar(Text[P - 1]) || Text[P - 1] == '.'))
+          --P;
+        const llvm::StringRef Prefix = Text.slice(P, I);
+        if (C == '\'' && !Prefix.empty() && isdigit((unsigned char)Prefix[0]))
+          continue;
+        if (C == '"' && Prefix.endswith("R")
+            && (Prefix == "R" || Prefix == "LR" || Prefix == "uR"
+                || Prefix == "UR" || Prefix == "u8R")) {
+          const size_t Open = Text.find('(', I);
+          if (Open == NPos)
+            return NPos;
+          const std::string Close
+            = ")" + Text.slice(I + 1, Open).str() + "\"";
+          I = Text.find(Close, Open);
+          if (I == NPos)
+            return NPos;
+          I += Close.size() - 1;
+          continue;
+        }
+        for (++I; I < Size && Text[I] != C && Text[I] != '\n'; ++I)
+          if (Text[I] == '\\')
+            ++I;
+        if (I >= Size)
+          return NPos;
+      }
+    }
+    return NPos;
+  }
+} // end namespace cling
@@ -0,0 +1,92 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_HOT_RELOAD_H
+#define CLING_HOT_RELOAD_H
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+#include <vector>
+
+namespace clang {
+  class FunctionDecl;
+}
+
+namespace cling {
+  class IncrementalExecutor;
+  class IncrementalParser;
+  class Transaction;
+
+  ///\brief The files loaded by Interpreter::loadReloadableFile(), to compile
+  /// again only the function bodies that changed since, see
+  /// Interpreter::reloadFile().
+  ///
+  /// Each file keeps its text and the offsets of the bodies of its
+  /// functions. A reload compares the file on disk with that text, skipping
+  /// the bodies: if anything else changed, the file must be loaded anew.
+  /// Otherwise the changed bodies are parsed again on their declarations,
+  /// and the calls to the functions are re-pointed to the new code by the
+  /// stubs of BackendPasses::addReloadStubs(); the globals of the file keep
+  /// their values. Constructors, destructors and the inline, static,
+  /// constexpr and template functions have no stubs: changing their bodies
+  /// loads the file anew.
+  ///
+  class HotReload {
+  public:
+    enum Result {
+      kUnchanged, ///< The file is as it was loaded or last reloaded.
+      kReloaded,  ///< The bodies that changed were compiled again.
+      kFailed,    ///< A body that changed did not compile.
+      kLoadAnew   ///< What changed needs the file to be loaded anew.
+    };
+
+  private:
+    struct Body {
+      clang::FunctionDecl* FD;
+      ///\brief The offsets of '{' and past '}' in the text of the file.
+      size_t Begin;
+      size_t End;
+    };
+
+    struct File {
+      ///\brief The transactions that declare the file's functions.
+      std::vector<const Transaction*> Transactions;
+      std::string Text;
+      ///\brief Sorted by Begin.
+      std::vector<Body> Bodies;
+    };
+
+    IncrementalParser& m_IncrParser;
+    IncrementalExecutor* m_Executor;
+    llvm::StringMap<File> m_Files;
+
+  public:
+    HotReload(IncrementalParser& IncrParser, IncrementalExecutor* Executor):
+      m_IncrParser(IncrParser), m_Executor(Executor) {}
+
+    ///\brief Records the file Path, which T and its nested transactions
+    /// loaded.
+    void add(llvm::StringRef Path, const Transaction& T);
+
+    ///\brief Forgets the files that T loaded or reloaded, e.g. as it gets
+    /// unloaded.
+    void forget(const Transaction& T);
+
+    ///\brief Compiles the bodies of Path that changed, with the options of
+    /// the transaction that loaded it.
+    Result reload(llvm::StringRef Path);
+
+    ///\brief The offset past the '}' closing the body at Begin of Text,
+    /// skipping comments and literals; npos if it is not closed.
+    static size_t findBodyEnd(llvm::StringRef Text, size_t Begin);
+  };
+} // end namespace cling
+
+#endif // CLING_HOT_RELOAD_H
@@ -8,6 +8,9 @@
 //------------------------------------------------------------------------------
 
 #include "cling/Interpreter/IncrementalCUDADeviceCompiler.h"
+
+#include "BackendPasses.h"
+
 #include "cling/Interpreter/Interpreter.h"
 #include "cling/Interpreter/InvocationOptions.h"
 #include "cling/Interpreter/Transaction.h"
@@ -16,6 +19,15 @@
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Lex/HeaderSearchOptions.h"
 
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Process.h"
 #include "llvm/Support/Program.h"
 #include "llvm/Support/raw_ostream.h"
@@ -27,9 +39,37 @@
 
 #include <algorithm>
 #include <bitset>
+#include <chrono>
 #include <string>
 #include <system_error>
 
+namespace {
+  typedef std::chrono::steady_clock Clock;
+
+  static uint64_t nanosecondsSince(Clock::time_point Start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now()
+                                                                - Start)
+        .count();
+  }
+
+  ///\brief Lets the optimizer and the NVPTX backend treat the floating point
+  /// math of the module as -ffast-math would: approximated, fused, and with
+  /// denormals flushed to zero.
+  static void setFastMath(llvm::Module& M) {
+    for (llvm::Function& F : M) {
+      if (F.isDeclaration())
+        continue;
+      for (const char* Attr : {"unsafe-fp-math", "no-infs-fp-math",
+                               "no-nans-fp-math", "no-signed-zeros-fp-math",
+                               "nvptx-f32ftz"})
+        F.addFnAttr(Attr, "true");
+      for (llvm::Instruction& I : llvm::instructions(F))
+        if (llvm::isa<llvm::FPMathOperator>(I))
+          I.setFast(true);
+    }
+  }
+} // unnamed namespace
+
 namespace cling {
 
   IncrementalCUDADeviceCompiler::IncrementalCUDADeviceCompiler(
@@ -101,6 +141,11 @@ namespace cling {
     m_Init = true;
   }
 
+  IncrementalCUDADeviceCompiler::~IncrementalCUDADeviceCompiler() {
+    // The worker uses m_PTX_interp.
+    wait();
+  }
+
   void IncrementalCUDADeviceCompiler::setCuArgs(
       const clang::LangOptions& langOpts,
       const cling::InvocationOptions& invocationOptions,
@@ -121,12 +166,20 @@ namespace cling {
       llvm::errs()
           << "IncrementalCUDADeviceCompiler: No valid c++ standard is set.\n";
 
-    uint32_t smVersion = 20;
-    if (!invocationOptions.CompilerOpts.CUDAGpuArch.empty()) {
-      llvm::StringRef(invocationOptions.CompilerOpts.CUDAGpuArch)
-          .drop_front(3 /* sm_ */)
-          .getAsInteger(10, smVersion);
+    // The fatbinary holds PTX code for each --cuda-gpu-arch. The device code
+    // is parsed for the lowest, such that __CUDA_ARCH__ is valid on all GPUs.
+    std::vector<uint32_t> smVersions;
+    for (const std::string& arch :
+         invocationOptions.CompilerOpts.CUDAGpuArchs) {
+      uint32_t sm;
+      if (!llvm::StringRef(arch).drop_front(3 /* sm_ */).getAsInteger(10, sm))
+        smVersions.push_back(sm);
     }
+    if (smVersions.empty())
+      smVersions.push_back(20);
+    std::sort(smVersions.begin(), smVersions.end());
+    smVersions.erase(std::unique(smVersions.begin(), smVersions.end()),
+                     smVersions.end());
 
     // FIXME : Should not reduce the fine granulated debug options to a simple.
     // -g
@@ -184,7 +237,7 @@ namespace cling {
       fatbinFlags |= FatBinFlags::HostLinux;
 
     m_CuArgs.reset(new IncrementalCUDADeviceCompiler::CUDACompilerArgs(
-        cppStdVersion, hostTriple, smVersion, fatbinFlags,
+        cppStdVersion, hostTriple, smVersions, fatbinFlags,
         invocationOptions.Verbose(), debug, additionalPtxOpt));
   }
 
@@ -207,16 +260,36 @@ namespace cling {
   // modifications in the cling::Transaction class to store information from the
   // device compiler
   bool IncrementalCUDADeviceCompiler::process(const std::string& input) {
+    // The inputs must reach the PTX interpreter in order.
+    wait();
+    beginStats(input);
+    return compile(input, /*declaration*/ false);
+  }
+
+  // FIXME: see process()
+  bool IncrementalCUDADeviceCompiler::declare(const std::string& input) {
+    wait();
+    beginStats(input);
+    return compile(input, /*declaration*/ true);
+  }
+
+  bool IncrementalCUDADeviceCompiler::compile(const std::string& input,
+                                              bool declaration) {
     if (!m_Init) {
       llvm::errs()
           << "Error: Initializiation of CUDA Device Code Compiler failed\n";
       return false;
     }
 
-    Interpreter::CompilationResult CR = m_PTX_interp->process(input);
+    Clock::time_point start = Clock::now();
+    Interpreter::CompilationResult CR = declaration
+                                            ? m_PTX_interp->declare(input)
+                                            : m_PTX_interp->process(input);
+    addStat(&InputStats::PTXInterpNs, nanosecondsSince(start));
 
     if (CR == Interpreter::CompilationResult::kFailure) {
-      llvm::errs() << "IncrementalCUDADeviceCompiler::process()\n"
+      llvm::errs() << "IncrementalCUDADeviceCompiler::"
+                   << (declaration ? "declare()\n" : "process()\n")
                    << "failed at compile ptx code\n";
       return false;
     }
@@ -225,70 +298,275 @@ namespace cling {
     if (CR == Interpreter::CompilationResult::kMoreInputExpected)
       return true;
 
-    if (!generatePTX() || !generateFatbinary())
-      return false;
-
-    return true;
+    return compileDeviceCode();
   }
 
   // FIXME: see process()
-  bool IncrementalCUDADeviceCompiler::declare(const std::string& input) {
+  bool IncrementalCUDADeviceCompiler::parse(const std::string& input) {
+    wait();
     if (!m_Init) {
       llvm::errs()
           << "Error: Initializiation of CUDA Device Code Compiler failed\n";
       return false;
     }
 
-    Interpreter::CompilationResult CR = m_PTX_interp->declare(input);
+    Interpreter::CompilationResult CR = m_PTX_interp->parse(input);
 
     if (CR == Interpreter::CompilationResult::kFailure) {
-      llvm::errs() << "IncrementalCUDADeviceCompiler::declare()\n"
+      llvm::errs() << "IncrementalCUDADeviceCompiler::parse()"
                    << "failed at compile ptx code\n";
       return false;
     }
 
-    // for example blocks which are not closed
-    if (CR == Interpreter::CompilationResult::kMoreInputExpected)
+    return true;
+  }
+
+  void IncrementalCUDADeviceCompiler::processAsync(const std::string& input) {
+    wait();
+    beginStats(input);
+    // The PTX interpreter shares no state with the host one but the fatbin
+    // file, which the host reads after wait().
+    m_Pending = std::async(std::launch::async,
+                           [this, input] {
+                             return compile(input, /*declaration*/ false);
+                           });
+  }
+
+  void IncrementalCUDADeviceCompiler::declareAsync(const std::string& input) {
+    wait();
+    beginStats(input);
+    m_Pending = std::async(std::launch::async,
+                           [this, input] {
+                             return compile(input, /*declaration*/ true);
+                           });
+  }
+
+  bool IncrementalCUDADeviceCompiler::wait() {
+    if (!m_Pending.valid())
       return true;
+    Clock::time_point start = Clock::now();
+    bool result = m_Pending.get();
+    addStat(&InputStats::HostWaitNs, nanosecondsSince(start));
+    return result;
+  }
 
-    if (!generatePTX() || !generateFatbinary())
-      return false;
+  void IncrementalCUDADeviceCompiler::beginStats(const std::string& input) {
+    llvm::StringRef label = llvm::StringRef(input).ltrim();
+    label = label.substr(0, std::min(label.find('\n'), size_t(40))).rtrim();
+    // Enough for a notebook's cells, without growing with the session.
+    if (m_Stats.size() >= 128)
+      m_Stats.pop_front();
+    m_Stats.emplace_back();
+    m_Stats.back().Label = label.str();
+    ++m_NumInputs;
+  }
 
-    return true;
+  void IncrementalCUDADeviceCompiler::addStat(uint64_t InputStats::*Field,
+                                              uint64_t Nanoseconds) {
+    if (!m_Stats.empty())
+      m_Stats.back().*Field += Nanoseconds;
+    m_TotalStats.*Field += Nanoseconds;
   }
 
-  // FIXME: see process()
-  bool IncrementalCUDADeviceCompiler::parse(const std::string& input) const {
-    if (!m_Init) {
-      llvm::errs()
-          << "Error: Initializiation of CUDA Device Code Compiler failed\n";
+  void
+  IncrementalCUDADeviceCompiler::addRegistrationTime(uint64_t Nanoseconds) {
+    addStat(&InputStats::RegistrationNs, Nanoseconds);
+  }
+
+  void IncrementalCUDADeviceCompiler::addKernelTime(uint64_t Nanoseconds) {
+    addStat(&InputStats::KernelNs, Nanoseconds);
+  }
+
+  void IncrementalCUDADeviceCompiler::enableKernelTiming(KernelTimer Timer) {
+    m_KernelTimer = Timer;
+  }
+
+  const std::deque<IncrementalCUDADeviceCompiler::InputStats>&
+  IncrementalCUDADeviceCompiler::getInputStats() {
+    wait();
+    return m_Stats;
+  }
+
+  const IncrementalCUDADeviceCompiler::InputStats&
+  IncrementalCUDADeviceCompiler::getTotalStats() {
+    wait();
+    return m_TotalStats;
+  }
+
+  void IncrementalCUDADeviceCompiler::resetStats() {
+    wait();
+    m_Stats.clear();
+    m_TotalStats = InputStats();
+    m_NumInputs = 0;
+  }
+
+  void IncrementalCUDADeviceCompiler::printStats(llvm::raw_ostream& Out) {
+    wait();
+    auto printLine = [&Out](const std::string& input, const InputStats& S) {
+      Out << llvm::format("%-6s %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f "
+                          "%10llu %5u  ",
+                          input.c_str(), S.PTXInterpNs / 1e6, S.NVPTXNs / 1e6,
+                          S.FatbinNs / 1e6, S.HostWaitNs / 1e6,
+                          S.RegistrationNs / 1e6, S.KernelNs / 1e6,
+                          (unsigned long long)S.FatbinSize, S.CompiledArchs)
+          << S.Label << '\n';
+    };
+    Out << llvm::format("%-6s %10s %10s %10s %10s %10s %10s %10s %5s  %s\n",
+                        "input", "ptx-interp", "nvptx", "fatbin",
+                        "host-wait", "register", "kernels", "bytes", "archs",
+                        "code");
+    unsigned first = m_NumInputs - m_Stats.size();
+    for (size_t I = 0, E = m_Stats.size(); I < E; ++I)
+      printLine(std::to_string(first + I + 1), m_Stats[I]);
+    printLine("total", m_TotalStats);
+    Out << "times in ms";
+    if (!m_KernelTimer)
+      Out << "; kernels are not timed, see '.stats cuda kernels'";
+    Out << '\n';
+  }
+
+  bool IncrementalCUDADeviceCompiler::compileDeviceCode() {
+    llvm::Module* module = m_PTX_interp->getLastTransaction()->getModule();
+    if (!module) {
+      llvm::errs() << "IncrementalCUDADeviceCompiler: no device module\n";
       return false;
     }
 
-    Interpreter::CompilationResult CR = m_PTX_interp->parse(input);
+    // Set by #pragma cling cuda; the IR is optimized only for an
+    // optimization level other than the session's.
+    const CompilationOptions& CO
+      = m_PTX_interp->getLastTransaction()->getCompilationOpts();
+    const int optLevel
+      = int(CO.OptLevel) != m_PTX_interp->getDefaultOptLevel()
+        ? int(CO.OptLevel) : -1;
+    if (CO.FastMath)
+      setFastMath(*module);
+
+    // The key is taken from the IR rather than the PTX, such that a hit
+    // skips the NVPTX backend too. The module name differs for every
+    // transaction and is left out.
+    std::string IR;
+    {
+      const std::string moduleID = module->getModuleIdentifier();
+      const std::string sourceFile = module->getSourceFileName();
+      module->setModuleIdentifier("");
+      module->setSourceFileName("");
+      llvm::raw_string_ostream OS(IR);
+      module->print(OS, /*AAW*/ nullptr);
+      OS.flush();
+      module->setModuleIdentifier(moduleID);
+      module->setSourceFileName(sourceFile);
+    }
+    llvm::MD5 Hash;
+    Hash.update(IR);
+    Hash.update(std::to_string(m_CuArgs->fatbinFlags));
+    Hash.update(std::to_string(optLevel));
+    llvm::MD5::MD5Result Result;
+    Hash.final(Result);
+    const std::string key = Result.digest().str();
+
+    // The file already holds this fatbinary, e.g. for the same cell again.
+    if (key == m_WrittenFatbinKey)
+      return true;
 
-    if (CR == Interpreter::CompilationResult::kFailure) {
-      llvm::errs() << "IncrementalCUDADeviceCompiler::parse()"
-                   << "failed at compile ptx code\n";
-      return false;
+    const std::vector<uint32_t>& smVersions = m_CuArgs->smVersions;
+    std::vector<std::string> PTX(smVersions.size());
+    std::vector<size_t> missing;
+    for (size_t I = 0, E = smVersions.size(); I < E; ++I) {
+      auto cached = m_PTXCache.find(key + std::to_string(smVersions[I]));
+      if (cached != m_PTXCache.end())
+        PTX[I] = cached->getValue();
+      else
+        missing.push_back(I);
+    }
+
+    Clock::time_point start = Clock::now();
+    if (missing.size() == 1) {
+      if (!generatePTX(*module, smVersions[missing[0]], optLevel,
+                       PTX[missing[0]]))
+        return false;
+    } else if (!missing.empty()) {
+      // The LLVMContext is not thread-safe: each architecture gets the module
+      // as bitcode, in a context of its own.
+      llvm::SmallString<0> BC;
+      {
+        llvm::raw_svector_ostream BCOS(BC);
+        llvm::WriteBitcodeToFile(*module, BCOS);
+      }
+      std::vector<std::future<bool>> jobs;
+      for (size_t I : missing)
+        jobs.push_back(std::async(std::launch::async, [&, I] {
+          llvm::LLVMContext Ctx;
+          llvm::Expected<std::unique_ptr<llvm::Module>> M =
+              llvm::parseBitcodeFile(
+                  llvm::MemoryBufferRef(BC.str(), "<device-module>"), Ctx);
+          if (!M) {
+            llvm::consumeError(M.takeError());
+            return false;
+          }
+          return generatePTX(**M, smVersions[I], optLevel, PTX[I]);
+        }));
+      bool failed = false;
+      for (std::future<bool>& job : jobs)
+        failed |= !job.get();
+      if (failed) {
+        llvm::errs() << "IncrementalCUDADeviceCompiler: cannot compile the "
+                        "device code for all architectures\n";
+        return false;
+      }
     }
 
+    addStat(&InputStats::NVPTXNs, nanosecondsSince(start));
+    if (!m_Stats.empty())
+      m_Stats.back().CompiledArchs = missing.size();
+    m_TotalStats.CompiledArchs += missing.size();
+
+    // Cells are rarely re-run after many others; do not grow without bound.
+    if (m_PTXCache.size() + missing.size() > 64 * smVersions.size())
+      m_PTXCache.clear();
+    for (size_t I : missing)
+      m_PTXCache[key + std::to_string(smVersions[I])] = PTX[I];
+
+    start = Clock::now();
+    generateFatbinary(PTX);
+
+    // FIXME: At the moment the fatbin code must be writen to a file so that
+    // CodeGen can use it. This should be replaced by a in-memory solution
+    // (e.g. virtual file).
+    std::error_code EC;
+    llvm::raw_fd_ostream os(m_FatbinFilePath, EC, llvm::sys::fs::F_None);
+    if (EC) {
+      llvm::errs() << "ERROR: cannot generate file " << m_FatbinFilePath
+                   << "\n";
+      m_WrittenFatbinKey.clear();
+      return false;
+    }
+    os << m_Fatbin;
+    os.close();
+    if (os.has_error()) {
+      os.clear_error();
+      m_WrittenFatbinKey.clear();
+      return false;
+    }
+    m_WrittenFatbinKey = key;
+    addStat(&InputStats::FatbinNs, nanosecondsSince(start));
+    addStat(&InputStats::FatbinSize, m_Fatbin.size());
     return true;
   }
 
-  bool cling::IncrementalCUDADeviceCompiler::generatePTX() {
-    // delete compiled PTX code of last input
-    m_PTX_code = "";
-
-    llvm::Module* module = m_PTX_interp->getLastTransaction()->getModule();
+  bool IncrementalCUDADeviceCompiler::generatePTX(llvm::Module& module,
+                                                  uint32_t smVersion,
+                                                  int optLevel,
+                                                  std::string& PTX) {
+    PTX.clear();
 
     std::string error;
     auto Target =
-        llvm::TargetRegistry::lookupTarget(module->getTargetTriple(), error);
+        llvm::TargetRegistry::lookupTarget(module.getTargetTriple(), error);
 
     if (!Target) {
       llvm::errs() << error;
-      return 1;
+      return false;
     }
 
     // is not important, because PTX does not use any object format
@@ -297,13 +575,23 @@ namespace cling {
 
     llvm::TargetOptions TO = llvm::TargetOptions();
 
-    llvm::TargetMachine* targetMachine = Target->createTargetMachine(
-        module->getTargetTriple(),
-        std::string("sm_").append(std::to_string(m_CuArgs->smVersion)), "", TO,
-        RM);
-    module->setDataLayout(targetMachine->createDataLayout());
-
-    llvm::raw_svector_ostream dest(m_PTX_code);
+    llvm::CodeGenOpt::Level CGOptLevel = llvm::CodeGenOpt::Default;
+    switch (optLevel) {
+      case 0: CGOptLevel = llvm::CodeGenOpt::None; break;
+      case 1: CGOptLevel = llvm::CodeGenOpt::Less; break;
+      case 3: CGOptLevel = llvm::CodeGenOpt::Aggressive; break;
+    }
+    std::unique_ptr<llvm::TargetMachine> targetMachine(
+        Target->createTargetMachine(
+            module.getTargetTriple(),
+            std::string("sm_").append(std::to_string(smVersion)), "", TO,
+            RM, llvm::None, CGOptLevel));
+    module.setDataLayout(targetMachine->createDataLayout());
+    if (optLevel >= 0)
+      BackendPasses::runStandalone(module, *targetMachine, optLevel);
+
+    llvm::SmallString<1024> code;
+    llvm::raw_svector_ostream dest(code);
 
     llvm::legacy::PassManager pass;
     // it's important to use the type assembler
@@ -313,38 +601,22 @@ namespace cling {
     if (targetMachine->addPassesToEmitFile(pass, dest, /*DwoOut*/ nullptr,
                                            FileType)) {
       llvm::errs() << "TargetMachine can't emit assembler code";
-      return 1;
+      return false;
     }
 
-    return pass.run(*module);
-  }
-
-  bool IncrementalCUDADeviceCompiler::generateFatbinary() {
-    // FIXME: At the moment the fatbin code must be writen to a file so that
-    // CodeGen can use it. This should be replaced by a in-memory solution
-    // (e.g. virtual file).
-    std::error_code EC;
-    llvm::raw_fd_ostream os(m_FatbinFilePath, EC, llvm::sys::fs::F_None);
-    if (EC) {
-      llvm::errs() << "ERROR: cannot generate file " << m_FatbinFilePath
-                   << "\n";
+    if (!pass.run(module))
       return false;
-    }
+    PTX = code.str();
+    return true;
+  }
 
+  void IncrementalCUDADeviceCompiler::generateFatbinary(
+      const std::vector<std::string>& PTX) {
     // implementation is adapted from clangJIT
     // (https://github.com/hfinkel/llvm-project-cxxjit/blob/cxxjit/clang/lib/CodeGen/JIT.cpp)
     // void *resolveFunction(const void *NTTPValues, const char **TypeStrings,
     //                       unsigned Idx)
 
-    // The outer header of the fat binary is documented in the CUDA
-    // fatbinary.h header. As mentioned there, the overall size must be a
-    // multiple of eight, and so we must make sure that the PTX is.
-    // We also need to make sure that the buffer is explicitly null
-    // terminated (cuobjdump, at least, seems to assume that it is).
-    m_PTX_code += '\0';
-    while (m_PTX_code.size() % 8)
-      m_PTX_code += '\0';
-
     // NVIDIA, unfortunatly, does not provide full documentation on their
     // fatbin format. There is some information on the outer header block in
     // the CUDA fatbinary.h header. Also, it is possible to figure out more
@@ -396,15 +668,33 @@ namespace cling {
             unknown3c(0), unknown40(0), unknown44(0) {}
     };
 
-    FatBinFileHeader fatBinFileHeader(m_PTX_code.size(), m_CuArgs->smVersion,
-                                      m_CuArgs->fatbinFlags);
-    FatBinHeader fatBinHeader(m_PTX_code.size() + fatBinFileHeader.HeaderSize);
+    // The outer header of the fat binary is documented in the CUDA
+    // fatbinary.h header. As mentioned there, the overall size must be a
+    // multiple of eight, and so we must make sure that the PTX is.
+    // We also need to make sure that the buffer is explicitly null
+    // terminated (cuobjdump, at least, seems to assume that it is).
+    auto paddedSize = [](const std::string& code) {
+      return (code.size() + 1 + 7) / 8 * 8;
+    };
+
+    // One entry per architecture; the driver loads the best match for the
+    // GPU when the fatbinary gets registered.
+    uint32_t dataSize = 0;
+    for (const std::string& code : PTX)
+      dataSize += sizeof(FatBinFileHeader) + paddedSize(code);
 
+    m_Fatbin.clear();
+    llvm::raw_svector_ostream os(m_Fatbin);
+    FatBinHeader fatBinHeader(dataSize);
     os.write((char*)&fatBinHeader, fatBinHeader.HeaderSize);
-    os.write((char*)&fatBinFileHeader, fatBinFileHeader.HeaderSize);
-    os << m_PTX_code;
-
-    return true;
+    for (size_t I = 0, E = PTX.size(); I < E; ++I) {
+      FatBinFileHeader fatBinFileHeader(paddedSize(PTX[I]),
+                                        m_CuArgs->smVersions[I],
+                                        m_CuArgs->fatbinFlags);
+      os.write((char*)&fatBinFileHeader, fatBinFileHeader.HeaderSize);
+      os << PTX[I];
+      os.write_zeros(paddedSize(PTX[I]) - PTX[I].size());
+    }
   }
 
   void IncrementalCUDADeviceCompiler::dump() {
@@ -416,11 +706,16 @@ namespace cling {
                  << "\n"
                  << "m_CuArgs Nvidia SM Version: " << m_CuArgs->smVersion
                  << "\n"
+                 << "m_CuArgs Nvidia SM Versions of the fatbinary:";
+    for (uint32_t sm : m_CuArgs->smVersions)
+      llvm::outs() << " " << sm;
+    llvm::outs() << "\n"
                  << "m_CuArgs Fatbin Flags (see "
                     "IncrementalCUDADeviceCompiler::setCuArgs()): "
                  << std::bitset<7>(m_CuArgs->fatbinFlags).to_string() << "\n"
                  << "m_CuArgs verbose: " << m_CuArgs->verbose << "\n"
-                 << "m_CuArgs debug: " << m_CuArgs->debug << "\n";
+                 << "m_CuArgs debug: " << m_CuArgs->debug << "\n"
+                 << "cached PTX codes: " << m_PTXCache.size() << "\n";
     llvm::outs() << "m_CuArgs additional clang nvptx options: ";
     for (const std::string& s : m_CuArgs->additionalPtxOpt) {
       llvm::outs() << s << " ";
@@ -9,10 +9,16 @@
 
 #include "IncrementalExecutor.h"
 #include "BackendPasses.h"
+#include "EventTrace.h"
+#include "HeapProfiler.h"
 #include "IncrementalJIT.h"
-#include "Threading.h"
+#include "SampleProfiler.h"
+#include "SharedCache.h"
 
 #include "cling/Interpreter/DynamicLibraryManager.h"
+#include "cling/Interpreter/Exception.h"
+#include "cling/Interpreter/HeapReport.h"
+#include "cling/Interpreter/ProfileReport.h"
 #include "cling/Interpreter/Transaction.h"
 #include "cling/Interpreter/Value.h"
 #include "cling/Utils/AST.h"
@@ -27,12 +33,19 @@
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/Support/Host.h"
 #include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TimeProfiler.h"
 #include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 
+#include <cstdlib>
+#include <functional>
 #include <iostream>
 
 using namespace llvm;
@@ -42,7 +55,7 @@ namespace cling {
 namespace {
 
 static std::unique_ptr<TargetMachine>
-CreateHostTargetMachine(const clang::CompilerInstance& CI) {
+CreateHostTargetMachine(const clang::CompilerInstance& CI, bool TargetHost) {
   const clang::TargetOptions& TargetOpts = CI.getTargetOpts();
   const clang::CodeGenOptions& CGOpt = CI.getCodeGenOpts();
   const std::string& Triple = TargetOpts.Triple;
@@ -70,6 +83,13 @@ CreateHostTargetMachine(const clang::CompilerInstance& CI) {
                           "Error detecting host");
 
   JTMB->setCodeGenOptLevel(OptLevel);
+  // detectHost() targets the host's CPU with all its features, which the
+  // user can restrict through the frontend, e.g. with -march.
+  if (!TargetHost && !TargetOpts.CPU.empty()) {
+    JTMB->setCPU(TargetOpts.CPU);
+    JTMB->getFeatures() = SubtargetFeatures();
+    JTMB->addFeatures(TargetOpts.Features);
+  }
 #ifdef _WIN32
   JTMB->getOptions().EmulatedTLS = false;
 #endif // _WIN32
@@ -106,62 +126,91 @@ CreateHostTargetMachine(const clang::CompilerInstance& CI) {
 
 } // anonymous namespace
 
-IncrementalExecutor::IncrementalExecutor(clang::DiagnosticsEngine& /*diags*/,
-                                         const clang::CompilerInstance& CI):
-  m_Callbacks(nullptr), m_externalIncrementalExecutor(nullptr)
+IncrementalExecutor::IncrementalExecutor(Interpreter& Interp,
+                                         clang::DiagnosticsEngine& /*diags*/,
+                                         const clang::CompilerInstance& CI,
+                                         bool TargetHost):
+  m_Callbacks(nullptr), m_Interpreter(&Interp),
+  m_externalIncrementalExecutor(nullptr)
 #if 0
   : m_Diags(diags)
 #endif
 {
   m_DyLibManager.initializeDyld([](llvm::StringRef){/*ignore*/ return false;});
 
-  // MSVC doesn't support m_AtExitFuncsSpinLock=ATOMIC_FLAG_INIT; in the class definition
-  std::atomic_flag_clear( &m_AtExitFuncsSpinLock );
-
-  std::unique_ptr<TargetMachine> TM(CreateHostTargetMachine(CI));
+  if (const char* Threshold = ::getenv("CLING_TIERED_COMPILATION"))
+    m_TierUpThreshold = std::max(::atoi(Threshold), 0);
+  if (const char* Limit = ::getenv("CLING_COALESCE_MODULES"))
+    m_CoalesceLimit = std::max(::atoi(Limit), 0);
+  if (const char* Share = ::getenv("CLING_SHARE_DEFINITIONS"))
+    m_ShareDefinitions = ::atoi(Share) != 0;
+
+  std::unique_ptr<TargetMachine> TM(CreateHostTargetMachine(CI, TargetHost));
+  if (const char* Size = ::getenv("CLING_PIPELINE_CODEGEN"))
+    if (::atoi(Size) > 0)
+      m_CodeGenPipeline.reset(new CodeGenPipeline(*TM, ::atoi(Size)));
   m_BackendPasses.reset(new BackendPasses(CI.getCodeGenOpts(),
                                           CI.getTargetOpts(),
                                           CI.getLangOpts(),
                                           *TM));
   auto RetainOwnership =
     [this](llvm::orc::VModuleKey K, std::unique_ptr<Module> M) -> void {
-    assert (m_PendingModules.count(K) && "Unable to find the module");
-    m_PendingModules[K]->setModule(std::move(M));
-    m_PendingModules.erase(K);
+    auto IPending = m_PendingModules.find(K);
+    // Modules the JIT created itself, e.g. the partitions compiled on
+    // demand, do not belong to any transaction.
+    if (IPending == m_PendingModules.end()) {
+      auto ICoalesced = m_PendingCoalesced.find(K);
+      if (ICoalesced != m_PendingCoalesced.end()) {
+        ICoalesced->second->IR = std::move(M);
+        m_PendingCoalesced.erase(ICoalesced);
+      }
+      return;
+    }
+    IPending->second->setModule(std::move(M));
+    m_PendingModules.erase(IPending);
   };
   m_JIT.reset(new IncrementalJIT(*this, std::move(TM), RetainOwnership));
-}
+  // The tier-up stubs call back into this process; the objects of the
+  // pipeline are loaded into it.
+  if (m_JIT->isRemote()) {
+    m_TierUpThreshold = 0;
+    m_CodeGenPipeline.reset();
+  }
 
-// Keep in source: ~unique_ptr<ClingJIT> needs ClingJIT
-IncrementalExecutor::~IncrementalExecutor() {}
+  ExecutionLimits Limits;
+  if (const char* Ms = ::getenv("CLING_TIME_LIMIT"))
+    Limits.WallMs = std::max(::atoi(Ms), 0);
+  if (const char* Ms = ::getenv("CLING_CPU_LIMIT"))
+    Limits.CpuMs = std::max(::atoi(Ms), 0);
+  Limits.HeapBytes = cache::getSizeLimit("CLING_HEAP_LIMIT");
+  if (Limits.any())
+    setExecutionLimits(Limits);
+}
 
-void IncrementalExecutor::runAtExitFuncs() {
-  // It is legal to register an atexit handler from within another atexit
-  // handler and furthor-more the standard says they need to run in reverse
-  // order, so this function must be recursion safe.
-  AtExitFunctions Local;
-  {
-    cling::internal::SpinLockGuard slg(m_AtExitFuncsSpinLock);
-    // Check this case first, to avoid the swap all-together.
-    if (m_AtExitFuncs.empty())
-      return;
-    Local.swap(m_AtExitFuncs);
+void IncrementalExecutor::setExecutionLimits(const ExecutionLimits& Limits) {
+  if (m_JIT->isRemote()) {
+    if (Limits.any())
+      cling::errs() << "cling::IncrementalExecutor: the execution limits are "
+                       "not enforced in the executor process\n";
+    return;
   }
-  for (auto&& Ordered : llvm::reverse(Local.ordered())) {
-    for (auto&& AtExit : llvm::reverse(Ordered->second))
-      AtExit();
-    // The standard says that they need to run in reverse order, which means
-    // anything added from 'AtExit()' must now be run!
-    runAtExitFuncs();
+  if (Limits.CpuMs && !ExecutionGuard::hasCpuClock())
+    cling::errs() << "cling::IncrementalExecutor: the CPU time limit cannot "
+                     "be enforced on this platform\n";
+  if (Limits.HeapBytes && !m_HeapLimitHooks
+      && !(m_HeapLimitHooks = m_JIT->useHeapLimitHooks()))
+    cling::errs() << "cling::IncrementalExecutor: the heap limit cannot be "
+                     "enforced on this platform, or with CLING_HEAP_PROFILE\n";
+  if (!m_Guard) {
+    if (!Limits.any())
+      return;
+    m_Guard.reset(new ExecutionGuard());
   }
+  m_Guard->setLimits(Limits);
 }
 
-void IncrementalExecutor::AddAtExitFunc(void (*func)(void*), void* arg,
-                                        const Transaction* T) {
-  // Register a CXAAtExit function
-  cling::internal::SpinLockGuard slg(m_AtExitFuncsSpinLock);
-  m_AtExitFuncs[T].emplace_back(func, arg);
-}
+// Keep in source: ~unique_ptr<ClingJIT> needs ClingJIT
+IncrementalExecutor::~IncrementalExecutor() {}
 
 void unresolvedSymbol()
 {
@@ -187,6 +236,19 @@ IncrementalExecutor::HandleMissingFunction(const std::string& mangled_name) cons
 
 void*
 IncrementalExecutor::NotifyLazyFunctionCreators(const std::string& mangled_name) const {
+  CLING_TRACE_SCOPE(Trace, kSymbolResolve, mangled_name);
+  // The creators hand out addresses of this process, not of the executor's.
+  if (m_JIT->isRemote()) {
+    HandleMissingFunction(mangled_name);
+    return nullptr;
+  }
+
+  // Do not ask again until a library or a search path changed.
+  auto Missing = m_MissingSymbols.find(mangled_name);
+  if (Missing != m_MissingSymbols.end()
+      && Missing->second == m_DyLibManager.getGeneration())
+    return HandleMissingFunction(mangled_name);
+
   for (auto it = m_lazyFuncCreator.begin(), et = m_lazyFuncCreator.end();
        it != et; ++it) {
     void* ret = (void*)((LazyFunctionCreatorFunc_t)*it)(mangled_name);
@@ -197,7 +259,10 @@ IncrementalExecutor::NotifyLazyFunctionCreators(const std::string& mangled_name)
   if (m_externalIncrementalExecutor)
    address = m_externalIncrementalExecutor->getAddressOfGlobal(mangled_name);
 
-  return (address ? address : HandleMissingFunction(mangled_name));
+  if (address)
+    return address;
+  m_MissingSymbols[mangled_name] = m_DyLibManager.getGeneration();
+  return HandleMissingFunction(mangled_name);
 }
 
 #if 0
@@ -236,121 +301,196 @@ static bool isPracticallyEmptyModule(const llvm::Module* M) {
   return M->empty() && M->global_empty() && M->alias_empty();
 }
 
+///\brief Fails a transaction for Interpreter::cancelCompilation().
+static IncrementalExecutor::ExecutionResult reportCancelled() {
+  cling::errs() << "cling::IncrementalExecutor: compilation interrupted\n";
+  return IncrementalExecutor::kExeCancelled;
+}
+
+
+void IncrementalExecutor::reportDemoted(unsigned BudgetMs,
+                                        llvm::ArrayRef<std::string> Demoted) {
+  cling::errs() << "cling::IncrementalExecutor: the compile budget of "
+                << BudgetMs << " ms ran out; emitted at O0:";
+  for (const std::string& Name : Demoted)
+    cling::errs() << ' ' << Name;
+  cling::errs() << '\n';
+}
 
 IncrementalExecutor::ExecutionResult
-IncrementalExecutor::runStaticInitializersOnce(Transaction& T) {
+IncrementalExecutor::runStaticInitializersOnce(Transaction& T, bool Defer) {
   llvm::Module* m = T.getModule();
   assert(m && "Module must not be null");
 
+  // Cancelled, T gets unloaded: it must not reach the JIT, or run.
+  if (isCancelled())
+    return reportCancelled();
+
   if (isPracticallyEmptyModule(m))
     return kExeSuccess;
 
-  llvm::orc::VModuleKey K =
-    emitModule(T.takeModule(), T.getCompilationOpts().OptLevel);
-  m_PendingModules[K] = &T;
+  if (!m_HasLazyModules && m->getModuleFlag("cling.lazy-functions")) {
+    m_HasLazyModules = true;
+    runDeferredInitializers();
+  }
 
+  // Nothing runs: the module can wait to be linked with the next ones.
+  if (m_CoalesceLimit && canCoalesce(T)) {
+    addCoalescing(T);
+    return kExeSuccess;
+  }
+
+  // Accounts the nested stages to T.
+  PhaseTimers::Scope Timer(m_Timers, TimingStats::kStaticInit, &T);
+  llvm::orc::VModuleKey K;
+  {
+    CLING_TRACE_SCOPE(Trace, kModuleEmit, m->getModuleIdentifier());
+    llvm::TimeTraceScope TimeScope("JIT",
+                                   llvm::StringRef(m->getModuleIdentifier()));
+    K = emitModule(T);
+  }
+  // E.g. while the backend passes ran; unloading T takes it from the JIT.
+  if (isCancelled())
+    return reportCancelled();
+
+  // The symbols get resolved once the code is looked up to run.
+  if (m_CompileOnly)
+    return kExeSuccess;
 
   // We don't care whether something was unresolved before.
   m_unresolvedSymbols.clear();
 
+  // The entry points run them from now on; the object does not need them.
+  if (llvm::GlobalVariable* GV = m->getGlobalVariable("llvm.global_ctors",
+                                                      true))
+    GV->eraseFromParent();
+
   // check if there is any unresolved symbol in the list
   if (diagnoseUnresolvedSymbols("static initializers"))
     return kExeUnresolvedSymbols;
 
-  llvm::GlobalVariable* GV
-     = m->getGlobalVariable("llvm.global_ctors", true);
-  // Nothing to do is good, too.
-  if (!GV) return kExeSuccess;
-
-  // Close similarity to
-  // m_engine->runStaticConstructorsDestructors(false) aka
-  // llvm::ExecutionEngine::runStaticConstructorsDestructors()
-  // is intentional; we do an extra pass to check whether the JIT
-  // managed to collect all the symbols needed by the niitializers.
-  // Should be an array of '{ i32, void ()* }' structs.  The first value is
-  // the init priority, which we ignore.
-  llvm::ConstantArray *InitList
-    = llvm::dyn_cast<llvm::ConstantArray>(GV->getInitializer());
-
-  // We need to delete it here just in case we have recursive inits, otherwise
-  // it will call inits multiple times.
-  GV->eraseFromParent();
-
-  if (InitList == 0)
+  // Loading the object fills the addresses of the entry points, whatever
+  // looked one of its symbols up; the code of the module and of what its
+  // initializers use gets compiled only then. Code running in another
+  // process, the stubs of reloadable functions, and the functions compiled
+  // on demand have no such entry points.
+  if (Defer && !T.getEntryPoints().Initializers.empty() && !m_JIT->isRemote()
+      && !T.getCompilationOpts().Reloadable && !m_HasLazyModules) {
+    std::lock_guard<std::recursive_mutex> Lock(m_JIT->getMutex());
+    m_DeferredInits.push_back(&T);
     return kExeSuccess;
+  }
 
-  //SmallVector<Function*, 2> initFuncs;
-
-  for (unsigned i = 0, e = InitList->getNumOperands(); i != e; ++i) {
-    llvm::ConstantStruct *CS
-      = llvm::dyn_cast<llvm::ConstantStruct>(InitList->getOperand(i));
-    if (CS == 0) continue;
-
-    llvm::Constant *FP = CS->getOperand(1);
-    if (FP->isNullValue())
-      continue;  // Found a sentinal value, ignore.
-
-    // Strip off constant expression casts.
-    if (llvm::ConstantExpr *CE = llvm::dyn_cast<llvm::ConstantExpr>(FP))
-      if (CE->isCast())
-        FP = CE->getOperand(0);
-
-    // Execute the ctor/dtor function!
-    if (llvm::Function *F = llvm::dyn_cast<llvm::Function>(FP)) {
-      const llvm::StringRef fName = F->getName();
-      executeInit(fName);
-/*
-      initFuncs.push_back(F);
-      if (fName.startswith("_GLOBAL__sub_I_")) {
-        BasicBlock& BB = F->getEntryBlock();
-        for (BasicBlock::iterator I = BB.begin(), E = BB.end(); I != E; ++I)
-          if (CallInst* call = dyn_cast<CallInst>(I))
-            initFuncs.push_back(call->getCalledFunction());
-      }
-*/
+  // What runs next is in there; loading it locates the entry points. What
+  // it left unresolved gets reported by the first of them to run.
+  m_JIT->loadEntryPoints(K, m);
+  // The modules that this one uses got loaded with it.
+  runLoadedInitializers();
+
+  // Taken before running them, in case they recursively run the inits.
+  std::vector<Transaction::EntryPoint> Inits;
+  Inits.swap(T.getEntryPoints().Initializers);
+  for (const Transaction::EntryPoint& Init : Inits)
+    executeInit(Init.Name, Init.Address);
+
+  return kExeSuccess;
+}
+
+void IncrementalExecutor::runLoadedInitializers() const {
+  // An initializer can load another deferred module, whose own then run
+  // first if they come first: look again from the start after each.
+  while (true) {
+    std::vector<Transaction::EntryPoint> Taken;
+    {
+      // Not while they run, which might wait for other threads.
+      std::lock_guard<std::recursive_mutex> Lock(m_JIT->getMutex());
+      auto Loaded = std::find_if(m_DeferredInits.begin(),
+                                 m_DeferredInits.end(), [](Transaction* T) {
+        auto& Inits = T->getEntryPoints().Initializers;
+        return std::any_of(Inits.begin(), Inits.end(),
+                           [](const Transaction::EntryPoint& Init) {
+                             return Init.Address != 0;
+                           });
+      });
+      if (Loaded == m_DeferredInits.end())
+        return;
+      Taken.swap((*Loaded)->getEntryPoints().Initializers);
+      m_DeferredInits.erase(Loaded);
     }
+    for (const Transaction::EntryPoint& Init : Taken)
+      executeInit(Init.Name, Init.Address);
   }
+}
 
-/*
-  for (SmallVector<Function*,2>::iterator I = initFuncs.begin(),
-         E = initFuncs.end(); I != E; ++I) {
-    // Cleanup also the dangling init functions. They are in the form:
-    // define internal void @_GLOBAL__I_aN() section "..."{
-    // entry:
-    //   call void @__cxx_global_var_init(N-1)()
-    //   call void @__cxx_global_var_initM()
-    //   ret void
-    // }
-    //
-    // define internal void @__cxx_global_var_init(N-1)() section "..." {
-    // entry:
-    //   call void @_ZN7MyClassC1Ev(%struct.MyClass* @n)
-    //   ret void
-    // }
-
-    // Erase __cxx_global_var_init(N-1)() first.
-    (*I)->removeDeadConstantUsers();
-    (*I)->eraseFromParent();
-  }
-*/
+void IncrementalExecutor::runDeferredInitializers() const {
+  std::vector<std::string> Names;
+  {
+    std::lock_guard<std::recursive_mutex> Lock(m_JIT->getMutex());
+    for (Transaction* T : m_DeferredInits)
+      Names.push_back(T->getEntryPoints().Initializers.front().Name);
+  }
+  // Looking one of its symbols up loads a module, which locates its entry
+  // points.
+  for (const std::string& Name : Names)
+    m_JIT->getSymbolAddress(Name, false /*no dlsym*/);
+  runLoadedInitializers();
+}
 
-  return kExeSuccess;
+void IncrementalExecutor::addEntryPoints(const llvm::Module& M, Transaction& T,
+                                         llvm::orc::VModuleKey K) const {
+  Transaction::EntryPoints& Entries = T.getEntryPoints();
+  Entries = Transaction::EntryPoints();
+  if (const clang::FunctionDecl* FD = T.getWrapperFD())
+    utils::Analyze::maybeMangleDeclName(FD, Entries.Wrapper.Name);
+
+  // Close similarity to llvm::ExecutionEngine::
+  // runStaticConstructorsDestructors() is intentional. Should be an array of
+  // '{ i32, void ()* }' structs.  The first value is the init priority,
+  // which we ignore.
+  if (const llvm::GlobalVariable* GV
+        = M.getGlobalVariable("llvm.global_ctors", true)) {
+    const llvm::ConstantArray* InitList
+      = llvm::dyn_cast_or_null<llvm::ConstantArray>(GV->getInitializer());
+    for (unsigned i = 0, e = InitList ? InitList->getNumOperands() : 0;
+         i != e; ++i) {
+      const llvm::ConstantStruct* CS
+        = llvm::dyn_cast<llvm::ConstantStruct>(InitList->getOperand(i));
+      if (CS == 0) continue;
+
+      const llvm::Constant* FP = CS->getOperand(1);
+      if (FP->isNullValue())
+        continue;  // Found a sentinal value, ignore.
+
+      // Strip off constant expression casts.
+      if (const llvm::ConstantExpr* CE = llvm::dyn_cast<llvm::ConstantExpr>(FP))
+        if (CE->isCast())
+          FP = CE->getOperand(0);
+
+      if (const llvm::Function* F = llvm::dyn_cast<llvm::Function>(FP)) {
+        Entries.Initializers.emplace_back();
+        Entries.Initializers.back().Name = F->getName().str();
+      }
+    }
+  }
+
+  // The stubs of reloadable functions, and the code of another process, are
+  // found by name.
+  if (T.getCompilationOpts().Reloadable || m_JIT->isRemote())
+    return;
+  if (!Entries.Wrapper.Name.empty())
+    m_JIT->addEntryPoint(K, Entries.Wrapper.Name, &Entries.Wrapper.Address);
+  for (Transaction::EntryPoint& Init : Entries.Initializers)
+    m_JIT->addEntryPoint(K, Init.Name, &Init.Address);
 }
 
 void IncrementalExecutor::runAndRemoveStaticDestructors(Transaction* T) {
   assert(T && "Must be set");
-  // Collect all the dtors bound to this transaction.
-  AtExitFunctions::mapped_type Local;
-  {
-    cling::internal::SpinLockGuard slg(m_AtExitFuncsSpinLock);
-    auto Itr = m_AtExitFuncs.find(T);
-    if (Itr == m_AtExitFuncs.end()) return;
-    m_AtExitFuncs.erase(Itr, &Local);
-  } // end of spin lock lifetime block.
-
-  // 'Unload' the cxa_atexit, atexit entities.
-  for (auto&& AtExit : llvm::reverse(Local)) {
-    AtExit();
+  // 'Unload' the cxa_atexit, atexit entities; the list is the last first.
+  for (Transaction::AtExitFunc* F = T->takeAtExitFuncs(); F;) {
+    F->Func(F->Arg);
+    Transaction::AtExitFunc* Next = F->Next;
+    delete F;
+    F = Next;
     // Run anything that was just registered in 'AtExit()'
     runAndRemoveStaticDestructors(T);
   }
@@ -364,20 +504,54 @@ static void flushOutBuffers() {
 
 IncrementalExecutor::ExecutionResult
 IncrementalExecutor::executeWrapper(llvm::StringRef function,
-                                    Value* returnValue/* =0*/) const {
+                                    Value* returnValue/* =0*/,
+                                    uint64_t Address/* =0*/) const {
+  CLING_TRACE_SCOPE(Trace, kRunWrapper, function);
   // Set the value to cling::invalid.
   if (returnValue)
     *returnValue = Value();
+  if (m_CompileOnly)
+    return kExeSuccess;
 
   typedef void (*InitFun_t)(void*);
   InitFun_t fun;
-  ExecutionResult res = jitInitOrWrapper(function, fun);
+  // Before the lookup: an unload from now on leaves the wrapper in place.
+  RunningCodeRAII Running(*this);
+  ExecutionResult res = jitInitOrWrapper(function, fun, Address);
   if (res != kExeSuccess)
     return res;
+  // The wrapper might use what the loaded modules initialize.
+  runLoadedInitializers();
   EnterUserCodeRAII euc(m_Callbacks);
-  (*fun)(returnValue);
+  if (m_JIT->isRemote()) {
+    // The executor cannot hand out a value; returnValue stays invalid.
+    PhaseTimers::Scope Timer(m_Timers, TimingStats::kUserCode);
+    return m_JIT->runRemote(uintptr_t(fun)) ? kExeSuccess
+                                            : kExeFunctionNotCompiled;
+  }
+  ExecutionGuard::Scope Guarded(m_Guard.get());
+  const void* FaultAddr = nullptr;
+  bool Faulted = false;
+  {
+    PhaseTimers::Scope Timer(m_Timers, TimingStats::kUserCode);
+    ExecutionProfiler::Scope Profile(m_Profiler.get());
+    if (m_GuardPointerFaults)
+      Faulted = !utils::platform::RunGuarded(fun, returnValue, &FaultAddr);
+    else
+      (*fun)(returnValue);
+  }
 
   flushOutBuffers();
+  if (Faulted) {
+    // Like cling_runtime_internal_throwIfInvalidPointer, but after the fact:
+    // there is no expression to point at.
+    if (m_Callbacks)
+      m_Callbacks->PrintStackTrace();
+    throw InvalidDerefException(nullptr, nullptr,
+                                uintptr_t(FaultAddr) < 4096
+                                ? InvalidDerefException::NULL_DEREF
+                                : InvalidDerefException::INVALID_MEM);
+  }
   return kExeSuccess;
 }
 
@@ -390,33 +564,446 @@ void
 IncrementalExecutor::installLazyFunctionCreator(LazyFunctionCreatorFunc_t fp)
 {
   m_lazyFuncCreator.push_back(fp);
+  m_MissingSymbols.clear();
 }
 
 bool
 IncrementalExecutor::addSymbol(const char* Name,  void* Addr,
                                bool Jit) const {
+  m_MissingSymbols.clear();
+  ++m_Invalidations;
   return m_JIT->lookupSymbol(Name, Addr, Jit).second;
 }
 
+bool IncrementalExecutor::canCoalesce(const Transaction& T) const {
+  const llvm::Module* M = T.getModule();
+  return !T.getWrapperFD() && !M->getNamedGlobal("llvm.global_ctors")
+    && !M->getModuleFlag("cling.lazy-functions")
+    && !T.getCompilationOpts().Reloadable
+    && !(m_CodeGenPipeline && m_CodeGenPipeline->hasPartitions(*M));
+}
+
+bool IncrementalExecutor::canUsePipelined(const llvm::Module& M,
+                                          const Transaction* T) const {
+  // The partitions are neither instrumented nor given safe points or
+  // stubs; and the journal restores the objects of whole modules.
+  return T && !T->getCompilationOpts().Reloadable
+    && !(m_Guard && m_Guard->getLimits().any()) && !m_ProfileInstrumentation
+    && !m_TierUpThreshold && !M.getModuleFlag("cling.lazy-functions")
+    && !(m_Journal && m_Journal->wantsModules());
+}
+
+std::string
+IncrementalExecutor::prepareReloadable(llvm::Module& M,
+                                       std::vector<std::string>& Replaced) {
+  const std::string Suffix = ".reload" + std::to_string(m_NumReloads + 1);
+  std::vector<llvm::Function*> Stubbed;
+  for (llvm::Function& F : M) {
+    if (!BackendPasses::isReloadable(F))
+      continue;
+    if (isReloadable(F.getName())) {
+      // A new body: the module that defined it first keeps the stub.
+      Replaced.push_back(F.getName().str());
+      F.setName(F.getName() + Suffix);
+    } else
+      Stubbed.push_back(&F);
+  }
+  BackendPasses::addReloadStubs(M, Stubbed);
+  if (Replaced.empty())
+    return std::string();
+  ++m_NumReloads;
+  return Suffix;
+}
+
+void IncrementalExecutor::repointReloaded(const llvm::Module& M,
+                                          llvm::ArrayRef<std::string> Replaced,
+                                          llvm::StringRef Suffix) {
+  ReloadedTargets& Targets = m_ReloadedTargets[&M];
+  for (const std::string& Name : Replaced) {
+    const uint64_t Ptr = m_JIT->getSymbolAddress(
+        Name + BackendPasses::getReloadPtrSuffix(), false /*dlsym*/);
+    const uint64_t Body = m_JIT->getSymbolAddress(Name + Suffix.str(),
+                                                  false /*dlsym*/);
+    if (!Ptr || !Body)
+      continue;
+    void** Slot = reinterpret_cast<void**>(uintptr_t(Ptr));
+    Targets.emplace_back(Slot, *Slot);
+    *Slot = reinterpret_cast<void*>(uintptr_t(Body));
+  }
+}
+
+static bool isCoalescedName(const llvm::GlobalValue& GV) {
+  return !GV.isDeclaration() && !GV.hasLocalLinkage()
+    && !GV.hasLinkOnceLinkage() && !GV.hasWeakLinkage();
+}
+
+void IncrementalExecutor::addCoalescing(Transaction& T) {
+  std::lock_guard<std::recursive_mutex> Lock(m_JIT->getMutex());
+  llvm::SmallVector<llvm::StringRef, 32> Names;
+  bool Clashes = false;
+  for (const llvm::GlobalValue& GV : T.getModule()->global_values())
+    if (isCoalescedName(GV)) {
+      Clashes |= m_CoalescingNames.count(GV.getName());
+      Names.push_back(GV.getName());
+    }
+  // The linker would reject a second definition; and there is one
+  // optimization level per module.
+  if (Clashes || (!m_Coalescing.empty()
+                  && m_Coalescing.front()->getCompilationOpts().OptLevel
+                       != T.getCompilationOpts().OptLevel))
+    emitCoalescedModules();
+  m_Coalescing.push_back(&T);
+  for (llvm::StringRef Name : Names)
+    m_CoalescingNames.insert(Name);
+  if (m_Coalescing.size() >= m_CoalesceLimit)
+    emitCoalescedModules();
+}
+
+void IncrementalExecutor::linkCoalescedModules() {
+  std::vector<Transaction*> Members;
+  Members.swap(m_Coalescing);
+  m_CoalescingNames.clear();
+
+  const llvm::Module& First = *Members.front()->getModule();
+  std::unique_ptr<llvm::Module> Linked(
+      new llvm::Module("cling-coalesced", First.getContext()));
+  Linked->setDataLayout(First.getDataLayout());
+  Linked->setTargetTriple(First.getTargetTriple());
+  bool Failed = false;
+  {
+    PhaseTimers::Scope Timer(m_Timers, TimingStats::kJITLinking);
+    llvm::Linker L(*Linked);
+    // The transactions keep their modules, to be unloaded one by one.
+    for (Transaction* T : Members)
+      if ((Failed = L.linkInModule(llvm::CloneModule(*T->getModule()))))
+        break;
+  }
+
+  const int OptLevel = Members.front()->getCompilationOpts().OptLevel;
+  if (!Failed) {
+    addCoalescedModule(std::move(Linked), OptLevel, std::move(Members));
+    return;
+  }
+  // Not expected with clashing names kept apart; emit them one by one.
+  for (Transaction* T : Members)
+    addCoalescedModule(llvm::CloneModule(*T->getModule()), OptLevel, {T});
+}
+
+void IncrementalExecutor::addCoalescedModule(std::unique_ptr<llvm::Module> M,
+                                             int OptLevel,
+                                             std::vector<Transaction*> Ts) {
+  std::unique_ptr<CoalescedModule> CM(new CoalescedModule());
+  CM->Members = std::move(Ts);
+  CM->Key = M.get();
+  for (Transaction* T : CM->Members)
+    m_CoalescedOf[T->getModule()] = CM.get();
+  CoalescedModule* Added = CM.get();
+  m_Coalesced.push_back(std::move(CM));
+  addModuleToJIT(std::move(M), OptLevel, nullptr, Added);
+}
+
+void IncrementalExecutor::addJITMemory(const Transaction& T,
+                                       MemoryStats& Stats) const {
+  const llvm::Module* M = T.getModule();
+  if (!M)
+    return;
+  auto ICoalesced = m_CoalescedOf.find(M);
+  if (ICoalesced != m_CoalescedOf.end()) {
+    if (ICoalesced->second->Members.front() != &T)
+      return;
+    M = ICoalesced->second->Key;
+  }
+  m_JIT->addObjectMemory(M, Stats);
+}
+
+void IncrementalExecutor::collectObjectKeys(
+    const Transaction& T, std::vector<llvm::orc::VModuleKey>& Keys) const {
+  if (const llvm::Module* M = T.getModule()) {
+    auto ICoalesced = m_CoalescedOf.find(M);
+    if (ICoalesced == m_CoalescedOf.end())
+      m_JIT->getObjectKeys(M, Keys);
+    else if (ICoalesced->second->Members.front() == &T)
+      m_JIT->getObjectKeys(ICoalesced->second->Key, Keys);
+  }
+  if (T.hasNestedTransactions())
+    for (auto I = T.nested_begin(), E = T.nested_end(); I != E; ++I)
+      collectObjectKeys(**I, Keys);
+}
+
+void IncrementalExecutor::getHeapReport(const Transaction* First,
+                                        HeapReport& Report) const {
+  HeapProfiler* Profiler = m_JIT->getHeapProfiler();
+  if (!Profiler)
+    return;
+  Report.Enabled = true;
+  std::map<llvm::orc::VModuleKey, std::vector<HeapReport::Function>> Usage
+    = Profiler->getUsage(Report.Unattributed);
+
+  std::vector<llvm::orc::VModuleKey> Keys;
+  size_t Index = 0;
+  for (const Transaction* T = First; T; T = T->getNext()) {
+    HeapReport::Entry Entry{T, ++Index, HeapUsage(), {}};
+    Keys.clear();
+    collectObjectKeys(*T, Keys);
+    for (llvm::orc::VModuleKey K : Keys) {
+      auto I = Usage.find(K);
+      if (I == Usage.end())
+        continue;
+      for (HeapReport::Function& F : I->second) {
+        Entry.Usage += F.Usage;
+        Entry.Functions.push_back(std::move(F));
+      }
+      Usage.erase(I);
+    }
+    if (!Entry.Usage.Allocations)
+      continue;
+    std::stable_sort(Entry.Functions.begin(), Entry.Functions.end(),
+                     [](const HeapReport::Function& L,
+                        const HeapReport::Function& R) {
+                       return L.Usage.Bytes > R.Usage.Bytes;
+                     });
+    Report.Transactions.push_back(std::move(Entry));
+  }
+  for (const auto& Object : Usage)
+    for (const HeapReport::Function& F : Object.second)
+      Report.Unattributed += F.Usage;
+}
+
+bool IncrementalExecutor::startProfiling(unsigned Interval) {
+  SampleProfiler* Profiler = m_JIT->getSampleProfiler();
+  return Profiler && Profiler->start(Interval);
+}
+
+bool IncrementalExecutor::stopProfiling() {
+  SampleProfiler* Profiler = m_JIT->getSampleProfiler();
+  return Profiler && Profiler->stop();
+}
+
+void IncrementalExecutor::getProfileReport(const Transaction* First,
+                                           ProfileReport& Report) const {
+  SampleProfiler* Profiler = m_JIT->getSampleProfiler();
+  if (!Profiler)
+    return;
+  // Like in the HeapReport, the JITted functions are named with the position
+  // of their top-level transaction.
+  std::map<llvm::orc::VModuleKey, size_t> IndexOf;
+  std::vector<llvm::orc::VModuleKey> Keys;
+  size_t Index = 0;
+  for (const Transaction* T = First; T; T = T->getNext()) {
+    Keys.clear();
+    collectObjectKeys(*T, Keys);
+    ++Index;
+    for (llvm::orc::VModuleKey K : Keys)
+      IndexOf[K] = Index;
+  }
+  Report = Profiler->report([&](llvm::JITEventListener::ObjectKey K) {
+    auto I = IndexOf.find(K);
+    return I == IndexOf.end() ? std::string()
+                              : "#" + std::to_string(I->second);
+  });
+}
+
+namespace {
+  ///\brief The executors whose code the calling thread runs, innermost
+  /// last.
+  static thread_local llvm::SmallVector<const IncrementalExecutor*, 4>
+    tRunning;
+}
+
+IncrementalExecutor::RunningCodeRAII::RunningCodeRAII(
+    const IncrementalExecutor& Exe): m_Executor(Exe) {
+  tRunning.push_back(&Exe);
+  ++Exe.m_NumRunning;
+}
+
+IncrementalExecutor::RunningCodeRAII::~RunningCodeRAII() {
+  assert(!tRunning.empty() && tRunning.back() == &m_Executor
+         && "Unbalanced RunningCodeRAII");
+  tRunning.pop_back();
+  if (--m_Executor.m_NumRunning)
+    return;
+  // Free what was unloaded while the code ran, unless a thread started
+  // running code meanwhile.
+  IncrementalJIT& JIT = *m_Executor.m_JIT;
+  std::lock_guard<std::recursive_mutex> Lock(JIT.getMutex());
+  if (!m_Executor.m_NumRunning && JIT.hasRetiredModules())
+    llvm::consumeError(JIT.removeRetiredModules());
+}
+
+Interpreter* IncrementalExecutor::getRunningInterpreter() {
+  return tRunning.empty() ? nullptr : tRunning.back()->m_Interpreter;
+}
+
+bool IncrementalExecutor::unloadModules(
+    llvm::ArrayRef<const llvm::Module*> Ms) const {
+  std::lock_guard<std::recursive_mutex> Lock(m_JIT->getMutex());
+  // Other threads might run the code, or code calling it: leave it in place
+  // until they are done. The calling thread gets to unload the code it
+  // runs, as it always did.
+  const unsigned RunningHere = std::count(tRunning.begin(), tRunning.end(),
+                                          this);
+  const bool Retire = m_NumRunning > RunningHere;
+  ++m_Invalidations;
+  // The stubs that the modules re-pointed go back to the bodies before;
+  // the modules are unloaded in reverse order of their addition.
+  for (const llvm::Module* M : Ms) {
+    auto IReloaded = m_ReloadedTargets.find(M);
+    if (IReloaded == m_ReloadedTargets.end())
+      continue;
+    for (auto I = IReloaded->second.rbegin(), E = IReloaded->second.rend();
+         I != E; ++I)
+      *I->first = I->second;
+    m_ReloadedTargets.erase(IReloaded);
+  }
+  if (m_BackendPasses)
+    for (const llvm::Module* M : Ms)
+      m_BackendPasses->forgetDefinitions(*M);
+  llvm::SmallPtrSet<const llvm::Module*, 8> Unloaded(Ms.begin(), Ms.end());
+  llvm::SmallVector<const llvm::Module*, 8> JITModules;
+  llvm::SmallPtrSet<CoalescedModule*, 4> Split;
+  for (const llvm::Module* M : Ms) {
+    auto IWaiting = std::find_if(m_Coalescing.begin(), m_Coalescing.end(),
+                                 [M](Transaction* T) {
+                                   return T->getModule() == M;
+                                 });
+    if (IWaiting != m_Coalescing.end()) {
+      m_Coalescing.erase(IWaiting);
+      continue;
+    }
+    auto ICoalesced = m_CoalescedOf.find(M);
+    if (ICoalesced != m_CoalescedOf.end())
+      Split.insert(ICoalesced->second);
+    else
+      JITModules.push_back(M);
+  }
+
+  // The code of a coalesced module can only go away as a whole: the members
+  // that stay get coalesced again, before those waiting.
+  std::vector<Transaction*> Remaining;
+  for (const auto& CM : m_Coalesced) {
+    if (!Split.count(CM.get()))
+      continue;
+    JITModules.push_back(CM->Key);
+    for (Transaction* T : CM->Members) {
+      m_CoalescedOf.erase(T->getModule());
+      if (!Unloaded.count(T->getModule()))
+        Remaining.push_back(T);
+    }
+  }
+  m_Coalescing.insert(m_Coalescing.begin(), Remaining.begin(),
+                      Remaining.end());
+  m_CoalescingNames.clear();
+  for (Transaction* T : m_Coalescing)
+    for (const llvm::GlobalValue& GV : T->getModule()->global_values())
+      if (isCoalescedName(GV))
+        m_CoalescingNames.insert(GV.getName());
+
+  // FIXME: Propagate the error in a more verbose way.
+  llvm::Error Err = m_JIT->removeModules(JITModules, Retire);
+  if (!m_NumRunning && m_JIT->hasRetiredModules())
+    Err = llvm::joinErrors(std::move(Err), m_JIT->removeRetiredModules());
+
+  // The JIT knows them by their address; free them only now.
+  if (!Split.empty()) {
+    for (auto IP = m_PendingCoalesced.begin();
+         IP != m_PendingCoalesced.end();)
+      IP = Split.count(IP->second) ? m_PendingCoalesced.erase(IP) : ++IP;
+    m_Coalesced.erase(std::remove_if(m_Coalesced.begin(), m_Coalesced.end(),
+                                     [&Split](const std::unique_ptr<
+                                                CoalescedModule>& CM) {
+                                       return Split.count(CM.get());
+                                     }),
+                      m_Coalesced.end());
+  }
+
+  if (Err) {
+    llvm::consumeError(std::move(Err));
+    return false;
+  }
+  return true;
+}
+
 void* IncrementalExecutor::getAddressOfGlobal(llvm::StringRef symbolName,
                                               bool* fromJIT /*=0*/) const {
+  const unsigned Generation = getSymbolGeneration();
+  if (Generation != m_GlobalAddressesGeneration) {
+    m_GlobalAddresses.clear();
+    m_GlobalAddressesGeneration = Generation;
+  }
+  auto Cached = m_GlobalAddresses.find(symbolName);
+  if (Cached != m_GlobalAddresses.end()) {
+    if (fromJIT)
+      *fromJIT = Cached->second.FromJIT;
+    return Cached->second.Address;
+  }
+
+  emitCoalescedModules();
   // Return a symbol's address, and whether it was jitted.
   void* address = m_JIT->lookupSymbol(symbolName).first;
 
   // It's not from the JIT if it's in a dylib.
+  const bool JITted = !address;
   if (fromJIT)
-    *fromJIT = !address;
+    *fromJIT = JITted;
 
-  if (!address)
-    return (void*)m_JIT->getSymbolAddress(symbolName, false /*no dlsym*/);
+  if (!address) {
+    address = (void*)m_JIT->getSymbolAddress(symbolName, false /*no dlsym*/);
+    // The caller might use what the initializers of its module set up.
+    runLoadedInitializers();
+  }
 
+  // Only remember what was found: a missing symbol might get defined by the
+  // next transaction.
+  if (address)
+    m_GlobalAddresses[symbolName] = GlobalAddress{address, JITted};
   return address;
 }
 
+void IncrementalExecutor::shareDefinitions(llvm::Module& M,
+                                           IncrementalJIT& JIT) const {
+  // The members of a comdat, e.g. a template static data member and its guard
+  // variable, can only be shared all together: the copy of the guard must not
+  // initialize the parent's variable again.
+  llvm::DenseMap<const llvm::Comdat*, bool> ComdatShared;
+  llvm::SmallVector<llvm::GlobalObject*, 32> Shared;
+  auto consider = [&](llvm::GlobalObject& GO) {
+    const bool IsShared = !GO.isDeclaration() && GO.hasName()
+      && (GO.hasLinkOnceLinkage() || GO.hasWeakLinkage())
+      && JIT.hasDefinition(GO.getName());
+    if (const llvm::Comdat* C = GO.getComdat()) {
+      auto Ins = ComdatShared.insert(std::make_pair(C, IsShared));
+      Ins.first->second &= IsShared;
+    }
+    if (IsShared)
+      Shared.push_back(&GO);
+  };
+  for (llvm::Function& F : M)
+    consider(F);
+  for (llvm::GlobalVariable& GV : M.globals())
+    consider(GV);
+
+  for (llvm::GlobalObject* GO : Shared) {
+    if (const llvm::Comdat* C = GO->getComdat()) {
+      if (!ComdatShared[C])
+        continue;
+      GO->setComdat(nullptr);
+    }
+    if (llvm::Function* F = llvm::dyn_cast<llvm::Function>(GO))
+      F->deleteBody();
+    else {
+      llvm::GlobalVariable* GV = llvm::cast<llvm::GlobalVariable>(GO);
+      GV->setInitializer(nullptr);
+      GV->setLinkage(llvm::GlobalValue::ExternalLinkage);
+    }
+  }
+}
+
 void*
 IncrementalExecutor::getPointerToGlobalFromJIT(llvm::StringRef name) const {
   // Get the function / variable pointer referenced by name.
 
+  emitCoalescedModules();
+
   // We don't care whether something was unresolved before.
   m_unresolvedSymbols.clear();
 
@@ -424,6 +1011,7 @@ IncrementalExecutor::getPointerToGlobalFromJIT(llvm::StringRef name) const {
 
   if (diagnoseUnresolvedSymbols(name, "symbol"))
     return 0;
+  runLoadedInitializers();
   return addr;
 }
 
@@ -440,8 +1028,25 @@ bool IncrementalExecutor::diagnoseUnresolvedSymbols(llvm::StringRef trigger,
         return false;
   }
 
+  // Search the libraries for all of them at once.
+  std::vector<std::string> Names(m_unresolvedSymbols.begin(),
+                                 m_unresolvedSymbols.end());
+#ifdef __APPLE__
+  // The JIT gives us a mangled name which has only one leading underscore on
+  // all platforms, for instance _ZN8TRandom34RndmEv. However, on OSX the
+  // linker stores this symbol as __ZN8TRandom34RndmEv (adding an extra _).
+  for (std::string& Name : Names) {
+    assert(!llvm::StringRef(Name).startswith("__") && "Already added!");
+    Name.insert(0, 1, '_');
+  }
+#endif //__APPLE__
+  const std::vector<std::string> Libs
+    = m_DyLibManager.searchLibrariesForSymbols(Names, /*searchSystem=*/ true);
+
   llvm::SmallVector<llvm::Function*, 128> funcsToFree;
+  size_t symIdx = 0;
   for (const std::string& sym : m_unresolvedSymbols) {
+    const std::string& libName = Libs[symIdx++];
 #if 0
     // FIXME: This causes a lot of test failures, for some reason it causes
     // the call to HandleMissingFunction to be elided.
@@ -473,17 +1078,6 @@ bool IncrementalExecutor::diagnoseUnresolvedSymbols(llvm::StringRef trigger,
           << "Maybe you need to load the corresponding shared library?\n";
     }
 
-#ifdef __APPLE__
-    // The JIT gives us a mangled name which has only one leading underscore on
-    // all platforms, for instance _ZN8TRandom34RndmEv. However, on OSX the
-    // linker stores this symbol as __ZN8TRandom34RndmEv (adding an extra _).
-    assert(!llvm::StringRef(sym).startswith("__") && "Already added!");
-    std::string libName = m_DyLibManager.searchLibrariesForSymbol('_' + sym,
-                                                        /*searchSystem=*/ true);
-#else
-    std::string libName = m_DyLibManager.searchLibrariesForSymbol(sym,
-                                                        /*searchSystem=*/ true);
-#endif //__APPLE__
     if (!libName.empty())
       cling::errs() << "Symbol found in '" << libName << "';"
                     << " did you mean to load it with '.L "
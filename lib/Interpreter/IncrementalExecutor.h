@@ -13,20 +13,30 @@
 #include "IncrementalJIT.h"
 
 #include "BackendPasses.h"
+#include "CodeGenPipeline.h"
 #include "EnterUserCodeRAII.h"
+#include "ExecutionGuard.h"
+#include "ExecutionProfiler.h"
+#include "IncrementalObjectCache.h"
+#include "PhaseTimers.h"
+#include "SessionJournal.h"
 
 #include "cling/Interpreter/DynamicLibraryManager.h"
 #include "cling/Interpreter/InterpreterCallbacks.h"
 #include "cling/Interpreter/Transaction.h"
 #include "cling/Interpreter/Value.h"
 #include "cling/Utils/Casting.h"
-#include "cling/Utils/OrderedMap.h"
 
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
 
+#include <algorithm>
 #include <atomic>
+#include <functional>
+#include <limits>
 #include <map>
 #include <memory>
 #include <unordered_set>
@@ -46,7 +56,10 @@ namespace llvm {
 
 namespace cling {
   class DynamicLibraryManager;
+  class HeapReport;
   class IncrementalJIT;
+  class Interpreter;
+  class ProfileReport;
   class Value;
 
   class IncrementalExecutor {
@@ -64,64 +77,13 @@ namespace cling {
     ///\brief Whom to call upon invocation of user code.
     InterpreterCallbacks* m_Callbacks;
 
+    ///\brief The interpreter whose code this runs, see getRunningInterpreter().
+    Interpreter* m_Interpreter;
+
     ///\brief A pointer to the IncrementalExecutor of the parent Interpreter.
     ///
     IncrementalExecutor* m_externalIncrementalExecutor;
 
-    ///\brief Helper that manages when the destructor of an object to be called.
-    ///
-    /// The object is registered first as an CXAAtExitElement and then cling
-    /// takes the control of it's destruction.
-    ///
-    class CXAAtExitElement {
-      ///\brief The function to be called.
-      ///
-      void (*m_Func)(void*);
-
-      ///\brief The single argument passed to the function.
-      ///
-      void* m_Arg;
-
-    public:
-      ///\brief Constructs an element, whose destruction time will be managed by
-      /// the interpreter. (By registering a function to be called by exit
-      /// or when a shared library is unloaded.)
-      ///
-      /// Registers destructors for objects with static storage duration with
-      /// the _cxa atexit function rather than the atexit function. This option
-      /// is required for fully standards-compliant handling of static
-      /// destructors(many of them created by cling), but will only work if
-      /// your C library supports __cxa_atexit (means we have our own work
-      /// around for Windows). More information about __cxa_atexit could be
-      /// found in the Itanium C++ ABI spec.
-      ///
-      ///\param [in] func - The function to be called on exit or unloading of
-      ///                   shared lib.(The destructor of the object.)
-      ///\param [in] arg - The argument the func to be called with.
-      ///\param [in] fromT - The unloading of this transaction will trigger the
-      ///                    atexit function.
-      ///
-      CXAAtExitElement(void (*func)(void*), void* arg)
-          : m_Func(func), m_Arg(arg) {}
-
-      void operator()() const { (*m_Func)(m_Arg); }
-    };
-
-    ///\brief Atomic used as a spin lock to protect the access to m_AtExitFuncs
-    ///
-    /// AddAtExitFunc is used at the end of the 'interpreted' user code
-    /// and before the calling framework has any change of taking back/again
-    /// its lock protecting the access to cling, so we need to explicit protect
-    /// again multiple conccurent access.
-    std::atomic_flag m_AtExitFuncsSpinLock; // MSVC doesn't support = ATOMIC_FLAG_INIT;
-
-    ///\brief Function registered via __cxa_atexit, atexit, or one of
-    /// it's C++ overloads that should be run when a transaction is unloaded.
-    ///
-    using AtExitFunctions =
-      utils::OrderedMap<const Transaction*, std::vector<CXAAtExitElement>>;
-    AtExitFunctions m_AtExitFuncs;
-
     ///\brief Modules to emit upon the next call to the JIT.
     ///
     std::vector<llvm::Module*> m_ModulesToJIT;
@@ -135,6 +97,30 @@ namespace cling {
     ///
     mutable std::unordered_set<std::string> m_unresolvedSymbols;
 
+    ///\brief Symbols that neither the lazy function creators nor the
+    /// external executor provided, mapped to the generation of
+    /// m_DyLibManager at the time. Emptied by addSymbol() and
+    /// installLazyFunctionCreator().
+    ///
+    mutable llvm::StringMap<unsigned> m_MissingSymbols;
+
+    ///\brief An address found by getAddressOfGlobal().
+    struct GlobalAddress {
+      void* Address;
+      bool FromJIT;
+    };
+
+    ///\brief The addresses found by getAddressOfGlobal(), by name; valid
+    /// for m_GlobalAddressesGeneration.
+    ///
+    mutable llvm::StringMap<GlobalAddress> m_GlobalAddresses;
+    mutable unsigned m_GlobalAddressesGeneration = 0;
+
+    ///\brief The number of unloadModules() and addSymbol() calls, see
+    /// getSymbolGeneration().
+    ///
+    mutable unsigned m_Invalidations = 0;
+
 #if 0 // See FIXME in IncrementalExecutor.cpp
     ///\brief The diagnostics engine, printing out issues coming from the
     /// incremental executor.
@@ -145,20 +131,138 @@ namespace cling {
     /// after the JIT has emitted them.
     std::map<llvm::orc::VModuleKey, Transaction*> m_PendingModules;
 
+    ///\brief A module linked from those of several transactions, which keep
+    /// their own for unloading, see CLING_COALESCE_MODULES.
+    struct CoalescedModule {
+      std::vector<Transaction*> Members;
+      ///\brief What the JIT knows the module by.
+      const llvm::Module* Key = nullptr;
+      ///\brief The module, once the JIT gave it back: possibly still needed
+      /// for tiering up.
+      std::unique_ptr<llvm::Module> IR;
+    };
+    mutable std::vector<std::unique_ptr<CoalescedModule>> m_Coalesced;
+
+    ///\brief The coalesced module of the module of each member.
+    mutable std::map<const llvm::Module*, CoalescedModule*> m_CoalescedOf;
+
+    ///\brief The coalesced modules not yet given back, by key.
+    mutable std::map<llvm::orc::VModuleKey, CoalescedModule*>
+      m_PendingCoalesced;
+
+    ///\brief Committed transactions whose modules are yet to be coalesced,
+    /// in order, and the names they define other than as linkonce or weak.
+    mutable std::vector<Transaction*> m_Coalescing;
+    mutable llvm::StringSet<> m_CoalescingNames;
+
+    ///\brief The maximal number of transactions in a coalesced module, see
+    /// CLING_COALESCE_MODULES; 0 disables coalescing.
+    unsigned m_CoalesceLimit = 0;
+
+    ///\brief The transactions whose initializers wait for their module to
+    /// get loaded, in order; see runStaticInitializersOnce(). Guarded by
+    /// the mutex of the JIT, as lookups load modules.
+    mutable std::vector<Transaction*> m_DeferredInits;
+
+    ///\brief Whether a module compiling its functions on demand got to the
+    /// JIT: nothing is deferred from then on, as the code compiled while it
+    /// runs could load a deferred module, whose initializers would then run
+    /// too late.
+    bool m_HasLazyModules = false;
+
     /// Dynamic library manager object.
     ///
     DynamicLibraryManager m_DyLibManager;
 
+    ///\brief Number of calls after which a function gets re-optimized,
+    /// see CLING_TIERED_COMPILATION; 0 disables tiered compilation.
+    unsigned m_TierUpThreshold = 0;
+
+    ///\brief Whether the modules leave out the inline and template
+    /// definitions that the JIT has already, see shareDefinitions(); disabled
+    /// by CLING_SHARE_DEFINITIONS=0.
+    bool m_ShareDefinitions = true;
+
+    ///\brief Compiles the functions of the inputs as they get parsed, see
+    /// CLING_PIPELINE_CODEGEN; null if disabled.
+    std::unique_ptr<CodeGenPipeline> m_CodeGenPipeline;
+
+    ///\brief Whether the modules get instrumented for profile-guided
+    /// re-optimization, see optimizeWithProfile().
+    bool m_ProfileInstrumentation = false;
+
+    ///\brief The stub pointers that the modules replacing functions of
+    /// reloadable ones re-pointed, with what they pointed to before.
+    using ReloadedTargets = std::vector<std::pair<void**, void*>>;
+    mutable std::map<const llvm::Module*, ReloadedTargets> m_ReloadedTargets;
+
+    ///\brief Number of modules that replaced functions, naming their bodies.
+    unsigned m_NumReloads = 0;
+
+    ///\brief The number of RunningCodeRAII alive, on all threads.
+    mutable std::atomic<unsigned> m_NumRunning{0};
+
+    ///\brief The interpreter's timers; may be null.
+    PhaseTimers* m_Timers = nullptr;
+
+    ///\brief The interpreter's journal, told about the modules; may be null.
+    SessionJournal* m_Journal = nullptr;
+
+    ///\brief Measures the execution of wrappers, if enabled.
+    std::unique_ptr<ExecutionProfiler> m_Profiler;
+
+    ///\brief Enforces the ExecutionLimits once some got set; kept from then
+    /// on, the code running refers to it.
+    std::unique_ptr<ExecutionGuard> m_Guard;
+
+    ///\brief Whether the JIT links the allocation functions to the hooks of
+    /// the heap limit.
+    bool m_HeapLimitHooks = false;
+
+    ///\brief Whether wrappers run under a fault handler, see
+    /// RuntimeOptions::SignalPointerChecks.
+    bool m_GuardPointerFaults = false;
+
+    ///\brief Whether the modules are compiled without running their static
+    /// initializers and wrappers, see setCompileOnly().
+    bool m_CompileOnly = false;
+
+    ///\brief Whether the compilation got cancelled, see
+    /// setCancellationCheck().
+    std::function<bool()> m_IsCancelled;
+
   public:
+    ///\brief Marks the calling thread as running JITted code for its
+    /// lifetime, taking a reference to the code: unloading modules while
+    /// other threads run code leaves their code in place, until no thread
+    /// runs code anymore. The wrappers run under one; threads that user code
+    /// starts take their own, see Interpreter::RunningCodeRAII.
+    class RunningCodeRAII {
+      const IncrementalExecutor& m_Executor;
+    public:
+      RunningCodeRAII(const IncrementalExecutor& Exe);
+      ~RunningCodeRAII();
+      RunningCodeRAII(const RunningCodeRAII&) = delete;
+      RunningCodeRAII& operator=(const RunningCodeRAII&) = delete;
+    };
+
+    ///\brief The interpreter of the innermost RunningCodeRAII of the calling
+    /// thread, or null if the thread runs no JITted code.
+    static Interpreter* getRunningInterpreter();
+
     enum ExecutionResult {
       kExeSuccess,
       kExeFunctionNotCompiled,
       kExeUnresolvedSymbols,
+      kExeCancelled,
       kNumExeResults
     };
 
-    IncrementalExecutor(clang::DiagnosticsEngine& diags,
-                        const clang::CompilerInstance& CI);
+    ///\brief The JIT compiles for the host's CPU and features unless
+    /// TargetHost is false, e.g. with -march: then for the frontend's.
+    IncrementalExecutor(Interpreter& Interp, clang::DiagnosticsEngine& diags,
+                        const clang::CompilerInstance& CI,
+                        bool TargetHost = true);
 
     ~IncrementalExecutor();
 
@@ -166,6 +270,98 @@ namespace cling {
       m_externalIncrementalExecutor = extIncrExec;
     }
     void setCallbacks(InterpreterCallbacks* callbacks);
+    void setPhaseTimers(PhaseTimers* Timers) { m_Timers = Timers; }
+    void setJournal(SessionJournal* Journal) { m_Journal = Journal; }
+    void setGuardPointerFaults(bool Guard) { m_GuardPointerFaults = Guard; }
+
+    ///\brief Compiles the modules from now on without running any of their
+    /// code: runStaticInitializersOnce() only emits them, executeWrapper()
+    /// succeeds without a value. See Interpreter::warmCaches().
+    void setCompileOnly(bool CompileOnly) { m_CompileOnly = CompileOnly; }
+
+    ///\brief Sets what tells whether the compilation got cancelled, see
+    /// Interpreter::cancelCompilation(): the backend passes stop optimizing,
+    /// and runStaticInitializersOnce() fails instead of running anything.
+    void setCancellationCheck(std::function<bool()> Check) {
+      if (m_BackendPasses)
+        m_BackendPasses->setCancellationCheck(Check);
+      m_IsCancelled = std::move(Check);
+    }
+    bool isCancelled() const { return m_IsCancelled && m_IsCancelled(); }
+
+    ///\brief Limits the resources of the wrappers and static initializers
+    /// run from now on; the modules added from now on get their safe points.
+    /// Warns about the limits that cannot be enforced.
+    void setExecutionLimits(const ExecutionLimits& Limits);
+    ExecutionLimits getExecutionLimits() const {
+      return m_Guard ? m_Guard->getLimits() : ExecutionLimits();
+    }
+
+    ///\brief Waits for the threads of the JIT to go idle, see
+    /// Interpreter::prepareFork().
+    void waitIdle() {
+      m_JIT->waitIdle();
+      if (m_CodeGenPipeline)
+        m_CodeGenPipeline->waitIdle();
+    }
+
+    ///\brief Goes on in a child that fork() made of the process, see
+    /// Interpreter::onForked().
+    void onForked() {
+      m_JIT->onForked();
+      if (m_CodeGenPipeline)
+        m_CodeGenPipeline->onForked();
+      ExecutionGuard::onForked();
+    }
+
+    ///\brief Starts or stops measuring the ExecutionCounters of wrappers.
+    void enableExecutionCounters(bool Enable) {
+      if (!Enable)
+        m_Profiler.reset();
+      else if (!m_Profiler)
+        m_Profiler.reset(new ExecutionProfiler());
+    }
+
+    ///\brief The counters since they got enabled; null if they are not.
+    const ExecutionCounters* getExecutionCounters() const {
+      return m_Profiler ? &m_Profiler->getTotal() : nullptr;
+    }
+
+    ///\brief Instruments the modules added from now on (or not) to collect
+    /// the profile of their functions while they run.
+    ///\returns false if the JIT cannot, i.e. if it runs code remotely.
+    bool enableProfileInstrumentation(bool Enable) {
+      if (Enable && m_JIT->isRemote())
+        return false;
+      m_ProfileInstrumentation = Enable;
+      return true;
+    }
+    bool isInstrumentingForProfile() const {
+      return m_ProfileInstrumentation;
+    }
+
+    ///\brief Re-optimizes the instrumented functions that ran with their
+    /// profile, and makes their callers use the result.
+    ///\returns the number of functions re-optimized.
+    unsigned optimizeWithProfile() { return m_JIT->optimizeWithProfile(); }
+
+    ///\brief Whether the code runs in an executor process.
+    bool isRemote() const { return m_JIT->isRemote(); }
+
+    ///\brief Whether the calls to the function MangledName go through the
+    /// stub of a reloadable module, which a module defining it again can
+    /// re-point; see CompilationOptions::Reloadable.
+    bool isReloadable(llvm::StringRef MangledName) const {
+      return m_JIT->hasDefinition(MangledName.str()
+                                  + BackendPasses::getReloadPtrSuffix());
+    }
+
+    ///\brief The passes optimizing the modules; null if there are none.
+    BackendPasses* getBackendPasses() { return m_BackendPasses.get(); }
+
+    ///\brief What the parser hands the functions it completed to, see
+    /// IncrementalParser::setCodeGenPipeline(); null if disabled.
+    CodeGenPipeline* getCodeGenPipeline() { return m_CodeGenPipeline.get(); }
 
     const DynamicLibraryManager& getDynamicLibraryManager() const {
       return const_cast<IncrementalExecutor*>(this)->m_DyLibManager;
@@ -178,24 +374,84 @@ namespace cling {
 
     ///\brief Unload a set of JIT symbols.
     bool unloadModule(const llvm::Module* M) const {
-      // FIXME: Propagate the error in a more verbose way.
-      if (auto Err = m_JIT->removeModule(M))
-        return false;
-      return true;
+      return unloadModules(M);
+    }
+
+    ///\brief Unload the JIT symbols of several modules at once. The code
+    /// stays in place while other threads run code, see RunningCodeRAII.
+    bool unloadModules(llvm::ArrayRef<const llvm::Module*> Ms) const;
+
+    ///\brief Whether the JIT still needs the IR of M, see
+    /// IncrementalJIT::needsModuleIR().
+    bool needsModuleIR(const llvm::Module* M) const {
+      return m_JIT->needsModuleIR(M);
+    }
+
+    ///\brief Adds the JIT memory of the objects of T's module to Stats. The
+    /// objects of a coalesced module count for the first of its transactions.
+    void addJITMemory(const Transaction& T, MemoryStats& Stats) const;
+
+    ///\brief The JIT memory of all objects.
+    MemoryStats getJITMemory() const { return m_JIT->getObjectMemory(); }
+
+    ///\brief Fills Report with the live heap allocations of the code of the
+    /// committed top-level transactions from First on, if CLING_HEAP_PROFILE
+    /// tracks them. Like for addJITMemory(), the code of a coalesced module
+    /// counts for the first of its transactions.
+    void getHeapReport(const Transaction* First, HeapReport& Report) const;
+
+    ///\brief Starts sampling the calling thread every Interval microseconds
+    /// of CPU time, see SampleProfiler.
+    ///\returns false if the code runs in another process or cannot be
+    /// sampled.
+    bool startProfiling(unsigned Interval);
+
+    ///\returns false if it was not sampling.
+    bool stopProfiling();
+
+    ///\brief Fills Report with the samples so far. The JITted functions
+    /// come from the committed top-level transactions from First on, which
+    /// are named by their position like in the HeapReport.
+    void getProfileReport(const Transaction* First,
+                          ProfileReport& Report) const;
+
+    ///\brief Compiles the modules that wait to be coalesced or looked up, so
+    /// that all transactions have theirs back.
+    void emitAllModules() {
+      emitCoalescedModules();
+      m_JIT->emitAllModules();
     }
 
     ///\brief Run the static initializers of all modules collected to far.
-    ExecutionResult runStaticInitializersOnce(Transaction& T);
+    ///\param[in] Defer - Instead, leave the module to be compiled when
+    /// something first looks up one of its symbols, e.g. when the code of a
+    /// later transaction that uses it gets loaded, and run the initializers
+    /// then, before anything else runs. See
+    /// RuntimeOptions::DeferHeaderInitializers.
+    ExecutionResult runStaticInitializersOnce(Transaction& T,
+                                              bool Defer = false);
+
+    ///\brief Drops the deferred initializers of T, which is being unloaded:
+    /// they never ran, nor will.
+    void forgetDeferredInits(const Transaction& T) {
+      std::lock_guard<std::recursive_mutex> Lock(m_JIT->getMutex());
+      m_DeferredInits.erase(std::remove(m_DeferredInits.begin(),
+                                        m_DeferredInits.end(), &T),
+                            m_DeferredInits.end());
+    }
 
     ///\brief Runs all destructors bound to the given transaction and removes
-    /// them from the list.
+    /// them from the list, in reverse order of registration.
     ///\param[in] T - Transaction to which the dtors were bound.
     ///
     void runAndRemoveStaticDestructors(Transaction* T);
 
     ///\brief Runs a wrapper function.
+    ///\param Address - Where the JIT loaded it, see Transaction::EntryPoint;
+    /// it is looked up by name if 0.
     ExecutionResult executeWrapper(llvm::StringRef function,
-                                   Value* returnValue = 0) const;
+                                   Value* returnValue = 0,
+                                   uint64_t Address = 0) const;
     ///\brief Adds a symbol (function) to the execution engine.
     ///
     /// Allows runtime declaration of a function passing its pointer for being
@@ -209,20 +465,6 @@ namespace cling {
     ///
     bool addSymbol(const char* Name, void* Address, bool JIT = false) const;
 
-    ///\brief Tells the execution to run all registered atexit functions once.
-    ///
-    /// This rountine should be used with caution only when an external process
-    /// wants to carefully control the teardown. For example, if the process
-    /// has registered its own atexit functions which need the interpreter
-    /// service to be available when they are being executed.
-    ///
-    void runAtExitFuncs();
-
-    ///\brief A more meaningful synonym of runAtExitFuncs when used in a more
-    /// standard teardown.
-    ///
-    void shuttingDown() { runAtExitFuncs(); }
-
     ///\brief Gets the address of an existing global and whether it was JITted.
     ///
     /// JIT symbols might not be immediately convertible to e.g. a function
@@ -234,6 +476,18 @@ namespace cling {
     void*
     getAddressOfGlobal(llvm::StringRef mangledName, bool* fromJIT = 0) const;
 
+    ///\brief Changes whenever an address returned by getAddressOfGlobal()
+    /// might have become invalid or different: when code gets unloaded or
+    /// symbols get added, here or in the parent's executor, or libraries get
+    /// loaded or unloaded.
+    ///
+    unsigned getSymbolGeneration() const {
+      unsigned Generation = m_DyLibManager.getGeneration() + m_Invalidations;
+      if (m_externalIncrementalExecutor)
+        Generation += m_externalIncrementalExecutor->getSymbolGeneration();
+      return Generation;
+    }
+
     ///\brief Return the address of a global from the JIT (as
     /// opposed to dynamic libraries). Forces the emission of the symbol if
     /// it has not happened yet.
@@ -241,26 +495,200 @@ namespace cling {
     ///param[in] name - the mangled name of the global.
     void* getPointerToGlobalFromJIT(llvm::StringRef name) const;
 
-    ///\brief Keep track of the entities whose dtor we need to call.
+    ///\brief Keep track of the entities whose dtor we need to call: they are
+    /// run when T is unloaded, see Transaction::addAtExitFunc().
     ///
-    void AddAtExitFunc(void (*func)(void*), void* arg, const Transaction* T);
+    void AddAtExitFunc(void (*func)(void*), void* arg, const Transaction* T) {
+      assert(T && "Code runs on behalf of a transaction");
+      T->addAtExitFunc(func, arg);
+    }
 
     ///\brief Try to resolve a symbol through our LazyFunctionCreators;
     /// print an error message if that fails.
     void* NotifyLazyFunctionCreators(const std::string&) const;
 
   private:
-    ///\brief Emit a llvm::Module to the JIT.
+    ///\brief Emit the llvm::Module of a transaction to the JIT.
+    ///
+    /// The transaction gets its module back once the JIT has compiled it.
+    ///
+    /// @param[in] T - The transaction whose module to pass to the execution
+    ///                engine, optimized at the transaction's opt level.
+    ///\returns the key the JIT knows the module by.
+    llvm::orc::VModuleKey emitModule(Transaction& T) {
+      // It might refer to the definitions of the coalesced transactions.
+      emitCoalescedModules();
+      return addModuleToJIT(T.takeModule(), T.getCompilationOpts().OptLevel,
+                            &T);
+    }
+
+    ///\brief Optimizes the module and adds it to the JIT.
     ///
-    /// @param[in] module - The module to pass to the execution engine.
-    /// @param[in] optLevel - The optimization level to be used.
+    /// @param[in] T - The transaction getting the module back once compiled.
+    /// @param[in] CM - Or the coalesced module it was linked for.
+    ///\returns the key the JIT knows the module by.
     llvm::orc::VModuleKey
-    emitModule(std::unique_ptr<llvm::Module> module, int optLevel) const {
-      if (m_BackendPasses)
-        m_BackendPasses->runOnModule(*module, optLevel);
+    addModuleToJIT(std::unique_ptr<llvm::Module> module, int OptLevel,
+                   Transaction* T, CoalescedModule* CM = nullptr) {
+      // The module might need the symbols of the libraries still loading.
+      m_DyLibManager.joinPendingLoads();
+      // The threads running code look up symbols meanwhile.
+      std::lock_guard<std::recursive_mutex> Lock(m_JIT->getMutex());
+      // With `.O auto`, the IR tells how much optimizing it pays off.
+      const Transaction* Owner = T ? T : CM ? CM->Members.front() : nullptr;
+      if (Owner && Owner->getCompilationOpts().AutoOptLevel)
+        OptLevel = BackendPasses::selectOptLevel(*module, OptLevel);
+      // The functions compiled while the input got parsed.
+      std::vector<std::unique_ptr<llvm::MemoryBuffer>> Pipelined;
+      if (m_CodeGenPipeline)
+        m_CodeGenPipeline->take(*module, OptLevel, canUsePipelined(*module, T),
+                                Pipelined);
+      if (m_externalIncrementalExecutor) {
+        m_externalIncrementalExecutor->emitCoalescedModules();
+        shareDefinitions(*module, *m_externalIncrementalExecutor->m_JIT);
+      }
+      if (m_ShareDefinitions)
+        shareDefinitions(*module, *m_JIT);
+      // The functions of a reloadable module get stubs, or replace the
+      // bodies behind the stubs they have already.
+      std::vector<std::string> Replaced;
+      std::string ReloadSuffix;
+      if (T && T->getCompilationOpts().Reloadable && !m_JIT->isRemote())
+        ReloadSuffix = prepareReloadable(*module, Replaced);
+      // Before optimizing: the loops then do not look as if they could not
+      // throw.
+      // The limits might be gone since SafePointTransformer saw the input.
+      BackendPasses::addSafePoints(*module,
+                                   m_Guard && m_Guard->getLimits().any());
+      // Tiered compilation and the lazy modules need their IR in the JIT.
+      const bool Plain = !m_ProfileInstrumentation
+        && !(m_TierUpThreshold && OptLevel > 0)
+        && !module->getModuleFlag("cling.lazy-functions");
+      const bool NoUnwind = T && T->getCompilationOpts().InferNoUnwind;
+      IncrementalObjectCache* Cache = m_Journal && m_Journal->wantsModules()
+                                        ? m_JIT->getObjectCache() : nullptr;
+      std::string SourceKey, ObjectKey;
+      std::unique_ptr<llvm::MemoryBuffer> Object;
+      if (Cache) {
+        // The restored session might have compiled the same IR already.
+        SourceKey = Cache->getSourceKey(*module, "O" + std::to_string(OptLevel)
+                                        + (NoUnwind ? "-nounwind" : ""));
+        ObjectKey = m_Journal->replayedObject(SourceKey);
+        if (Plain)
+          Object = Cache->getCachedObject(ObjectKey);
+        if (Object)
+          m_Journal->reusedObject();
+      }
+      if (m_BackendPasses && !Object) {
+        PhaseTimers::Scope Timer(m_Timers, TimingStats::kBackendPasses, T);
+        if (m_ProfileInstrumentation) {
+          // Emit it quickly, re-optimize it once it ran, with its profile.
+          m_BackendPasses->runOnModule(*module, 0);
+          m_BackendPasses->addTierUpCounters(
+            *module, std::numeric_limits<unsigned>::max(),
+            std::max(OptLevel, 2));
+          m_BackendPasses->addProfileCounters(*module);
+        } else if (m_TierUpThreshold && OptLevel > 0) {
+          // Tiered compilation: emit it quickly, re-optimize what is hot.
+          m_BackendPasses->runOnModule(*module, 0);
+          m_BackendPasses->addTierUpCounters(*module, m_TierUpThreshold,
+                                             std::max(OptLevel, 2));
+        } else {
+          const unsigned BudgetMs
+            = Owner ? Owner->getCompilationOpts().CompileBudgetMs : 0;
+          std::vector<std::string> Demoted;
+          m_BackendPasses->runOnModule(*module, OptLevel, BudgetMs, &Demoted);
+          if (!Demoted.empty())
+            reportDemoted(BudgetMs, Demoted);
+        }
+        // Once optimized: inlining might have removed the calls that throw.
+        if (NoUnwind)
+          BackendPasses::inferNoUnwind(*module);
+      }
+      if (Cache)
+        m_Journal->addModule(std::move(SourceKey),
+                             Object ? std::move(ObjectKey)
+                                    : Plain ? Cache->getKey(*module)
+                                            : std::string());
+
+      // Register the transaction before adding the module: the JIT might
+      // compile it right away.
+      PhaseTimers::Scope Timer(m_Timers, TimingStats::kJITLinking, T);
+      llvm::orc::VModuleKey K = m_JIT->allocateModuleKey();
+      if (T) {
+        m_PendingModules[K] = T;
+        addEntryPoints(*module, *T, K);
+      } else if (CM)
+        m_PendingCoalesced[K] = CM;
+      const llvm::Module* M = module.get();
+      m_JIT->addModule(std::move(module), K, std::move(Object));
+      if (!Pipelined.empty())
+        m_JIT->addObjects(*M, std::move(Pipelined));
+      if (!Replaced.empty())
+        repointReloaded(*M, Replaced, ReloadSuffix);
+      return K;
+    }
 
-      return m_JIT->addModule(std::move(module));
+    ///\brief Whether the objects of the CodeGenPipeline can replace the
+    /// functions of M, the module of T: its code is what the partitions
+    /// compiled, and goes to this process.
+    bool canUsePipelined(const llvm::Module& M, const Transaction* T) const;
+
+    ///\brief Notes the entry points of T, whose module M is about to be
+    /// added under K, and has the JIT locate them as it loads the object.
+    void addEntryPoints(const llvm::Module& M, Transaction& T,
+                        llvm::orc::VModuleKey K) const;
+
+    ///\brief Tells which functions ran out of the CompileBudgetMs of their
+    /// module, and got emitted at O0.
+    static void reportDemoted(unsigned BudgetMs,
+                              llvm::ArrayRef<std::string> Demoted);
+
+    ///\brief Gives the functions of M stubs, see BackendPasses::
+    /// addReloadStubs(); or names of their own to those with a stub in the
+    /// JIT already, appending them to Replaced.
+    ///\returns the suffix of the names given.
+    std::string prepareReloadable(llvm::Module& M,
+                                  std::vector<std::string>& Replaced);
+
+    ///\brief Points the stubs of the functions Replaced to their bodies in
+    /// M, named with Suffix.
+    void repointReloaded(const llvm::Module& M,
+                         llvm::ArrayRef<std::string> Replaced,
+                         llvm::StringRef Suffix);
+
+    ///\brief Appends the keys of the objects of T and its nested
+    /// transactions to Keys; those of a coalesced module go with the first of
+    /// its transactions.
+    void collectObjectKeys(const Transaction& T,
+                           std::vector<llvm::orc::VModuleKey>& Keys) const;
+
+    ///\brief Whether the module of T can wait to be linked with those of the
+    /// transactions after it: it runs nothing when committed.
+    bool canCoalesce(const Transaction& T) const;
+
+    ///\brief Links the modules of m_Coalescing into one and adds it to the
+    /// JIT, before anything is looked up or added after them.
+    void emitCoalescedModules() const {
+      std::lock_guard<std::recursive_mutex> Lock(m_JIT->getMutex());
+      if (!m_Coalescing.empty())
+        const_cast<IncrementalExecutor*>(this)->linkCoalescedModules();
     }
+    void linkCoalescedModules();
+
+    ///\brief Queues the module of T to be coalesced.
+    void addCoalescing(Transaction& T);
+
+    ///\brief Adds M, linked from the modules of Ts, to the JIT.
+    void addCoalescedModule(std::unique_ptr<llvm::Module> M, int OptLevel,
+                            std::vector<Transaction*> Ts);
+
+    ///\brief Turn the inline and template definitions that JIT already has
+    /// into declarations: they then resolve to its code instead of getting
+    /// optimized and compiled again, only for the JIT to keep the first copy.
+    /// In a child interpreter, JIT is the parent's, whose function-local
+    /// statics and template static data members get shared.
+    void shareDefinitions(llvm::Module& M, IncrementalJIT& JIT) const;
 
     ///\brief Report and empty m_unresolvedSymbols.
     ///\return true if m_unresolvedSymbols was non-empty.
@@ -270,22 +698,42 @@ namespace cling {
     ///\brief Remember that the symbol could not be resolved by the JIT.
     void* HandleMissingFunction(const std::string& symbol) const;
 
-    ///\brief Runs an initializer function.
-    ExecutionResult executeInit(llvm::StringRef function) const {
+    ///\brief Runs the initializers of m_DeferredInits whose module got
+    /// loaded meanwhile, in the order of their transactions.
+    void runLoadedInitializers() const;
+
+    ///\brief Loads the modules of m_DeferredInits, and runs their
+    /// initializers.
+    void runDeferredInitializers() const;
+
+    ///\brief Runs an initializer function, at Address unless 0.
+    ExecutionResult executeInit(llvm::StringRef function,
+                                uint64_t Address = 0) const {
       typedef void (*InitFun_t)();
       InitFun_t fun;
-      ExecutionResult res = jitInitOrWrapper(function, fun);
+      RunningCodeRAII Running(*this);
+      ExecutionResult res = jitInitOrWrapper(function, fun, Address);
       if (res != kExeSuccess)
         return res;
       EnterUserCodeRAII euc(m_Callbacks);
+      PhaseTimers::Scope Timer(m_Timers, TimingStats::kStaticInit);
+      if (m_JIT->isRemote())
+        return m_JIT->runRemote(uintptr_t(fun)) ? kExeSuccess
+                                                : kExeFunctionNotCompiled;
+      ExecutionGuard::Scope Guarded(m_Guard.get());
       (*fun)();
       return kExeSuccess;
     }
 
     template <class T>
-    ExecutionResult jitInitOrWrapper(llvm::StringRef funcname, T& fun) const {
-      fun = utils::UIntToFunctionPtr<T>(m_JIT->getSymbolAddress(funcname,
-                                                              false /*dlsym*/));
+    ExecutionResult jitInitOrWrapper(llvm::StringRef funcname, T& fun,
+                                     uint64_t Address = 0) const {
+      std::lock_guard<std::recursive_mutex> Lock(m_JIT->getMutex());
+      emitCoalescedModules();
+      PhaseTimers::Scope Timer(m_Timers, TimingStats::kJITLinking);
+      if (!Address)
+        Address = m_JIT->getSymbolAddress(funcname, false /*dlsym*/);
+      fun = utils::UIntToFunctionPtr<T>(Address);
 
       // check if there is any unresolved symbol in the list
       if (diagnoseUnresolvedSymbols(funcname, "function") || !fun)
@@ -9,12 +9,37 @@
 
 #include "IncrementalJIT.h"
 
+#include "BackendPasses.h"
+#include "ExecutionGuard.h"
+#include "HeapProfiler.h"
 #include "IncrementalExecutor.h"
+#include "IncrementalObjectCache.h"
+#include "JITDebugRegistry.h"
+#include "PerfMapListener.h"
+#include "RemoteTarget.h"
+#include "SampleProfiler.h"
+#include "SlabMemoryManager.h"
 #include "cling/Utils/Platform.h"
 
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/ExecutionEngine/Orc/Legacy.h"
-#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/Object/ObjectFile.h"
 #include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <thread>
 
 #if defined(__APPLE__) || defined (_MSC_VER)
 // Apple and Windows add an extra '_'
@@ -27,15 +52,17 @@ namespace {
 
 ///\brief Memory manager providing the lop-level link to the
 /// IncrementalExecutor, handles missing or special / replaced symbols.
-class ClingMemoryManager: public SectionMemoryManager {
+class ClingMemoryManager: public cling::SlabMemoryManager {
 public:
-  ClingMemoryManager() {}
+  ///\brief Backs the code with huge pages if CLING_JIT_HUGE_PAGES is set.
+  ClingMemoryManager():
+    SlabMemoryManager(::getenv("CLING_JIT_HUGE_PAGES") != nullptr) {}
 
   ///\brief Simply wraps the base class's function setting AbortOnFailure
   /// to false and instead using the error handling mechanism to report it.
   void* getPointerToNamedFunction(const std::string &Name,
                                   bool /*AbortOnFailure*/ =true) override {
-    return SectionMemoryManager::getPointerToNamedFunction(Name, false);
+    return RTDyldMemoryManager::getPointerToNamedFunction(Name, false);
   }
 };
 
@@ -51,6 +78,68 @@ public:
     cling::IncrementalJIT &m_JIT;
   };
 
+  ///\brief Modules with fewer function definitions than this are emitted
+  /// lazily, on the calling thread: splitting them does not pay off.
+  static constexpr unsigned kMinFunctionsToSplit = 64;
+
+  static void TierUpHook(void* JIT, const char* Name, void** Target,
+                         int64_t* Counter) {
+    static_cast<cling::IncrementalJIT*>(JIT)->tierUp(Name, Target, Counter);
+  }
+
+#ifndef CLING_WIN_SEH_EXCEPTIONS
+  ///\brief The registration of a whole .eh_frame section by LLVM's
+  /// libunwind, where the process uses it: RTDyldMemoryManager would call
+  /// its __register_frame once per FDE (on macOS), or give it the section
+  /// where it expects an FDE (elsewhere). libgcc gets the section from
+  /// RTDyldMemoryManager already.
+  struct EHFrameSections {
+    void (*Add)(uintptr_t) = nullptr;
+    void (*Remove)(uintptr_t) = nullptr;
+
+    EHFrameSections() {
+      Add = reinterpret_cast<void (*)(uintptr_t)>(
+        sys::DynamicLibrary::SearchForAddressOfSymbol(
+          "__unw_add_dynamic_eh_frame_section"));
+      Remove = reinterpret_cast<void (*)(uintptr_t)>(
+        sys::DynamicLibrary::SearchForAddressOfSymbol(
+          "__unw_remove_dynamic_eh_frame_section"));
+      if (!Add || !Remove)
+        Add = Remove = nullptr;
+    }
+
+    static const EHFrameSections& get() {
+      static const EHFrameSections Sections;
+      return Sections;
+    }
+  };
+
+  static void registerEHFrameSection(uint8_t* Addr, size_t Size) {
+    const EHFrameSections& Sections = EHFrameSections::get();
+    if (Sections.Add)
+      Sections.Add(uintptr_t(Addr));
+    else
+      RTDyldMemoryManager::registerEHFramesInProcess(Addr, Size);
+  }
+
+  static void deregisterEHFrameSection(uint8_t* Addr, size_t Size) {
+    const EHFrameSections& Sections = EHFrameSections::get();
+    if (Sections.Remove)
+      Sections.Remove(uintptr_t(Addr));
+    else
+      RTDyldMemoryManager::deregisterEHFramesInProcess(Addr, Size);
+  }
+#endif
+
+  static unsigned getCodeGenThreads() {
+    if (const char* Env = ::getenv("CLING_JIT_THREADS")) {
+      if (!::strcmp(Env, "all"))
+        return std::max(1u, std::thread::hardware_concurrency());
+      return ::atoi(Env) > 0 ? ::atoi(Env) : 0;
+    }
+    return 0;
+  }
+
 } // unnamed namespace
 
 namespace cling {
@@ -61,6 +150,16 @@ namespace cling {
 class Azog: public RTDyldMemoryManager {
   cling::IncrementalJIT& m_jit;
 
+  ///\brief The memory manager of the JIT when the object got loaded: objects
+  /// loaded while resolving the symbols of another one use their own.
+  std::shared_ptr<SlabMemoryManager> m_ExeMM;
+
+  ///\brief The key of the object, to account its memory to.
+  llvm::orc::VModuleKey m_Key;
+
+  ///\brief What the object got from m_ExeMM, released along with it.
+  llvm::SmallVector<uint8_t*, 4> m_Allocations;
+
   struct AllocInfo {
     uint8_t *m_Start   = nullptr;
     uint8_t *m_End     = nullptr;
@@ -146,12 +245,33 @@ class Azog: public RTDyldMemoryManager {
   // FIXME: This is directly mirroring a structure in RTDyldMemoryManager that
   // is private. Get Win64 exceptions into LLVM or add an accessor for it.
   platform::windows::EHFrameInfos m_EHFrames;
+#else
+  ///\brief The frames registered for this object only; m_ExeMM would
+  /// deregister those of all objects at once.
+  llvm::SmallVector<std::pair<uint8_t*, size_t>, 1> m_EHFrames;
 #endif
 
+  void addAllocation(uint8_t* Addr, uintptr_t Size,
+                     size_t MemoryStats::*Kind) {
+    if (Addr) {
+      m_Allocations.push_back(Addr);
+      m_jit.m_ObjectMemory[m_Key].*Kind += Size;
+    }
+    m_jit.m_SectionsAllocatedSinceLastLoad.insert(Addr);
+  }
+
 public:
-  Azog(cling::IncrementalJIT& Jit): m_jit(Jit) {}
+  Azog(cling::IncrementalJIT& Jit, llvm::orc::VModuleKey K):
+    m_jit(Jit), m_ExeMM(Jit.m_ExeMM), m_Key(K) {}
+
+  ///\brief The object got removed: its pages can be reused.
+  ~Azog() override {
+    for (uint8_t* Addr : m_Allocations)
+      m_ExeMM->release(Addr);
+    m_jit.m_ObjectMemory.erase(m_Key);
+  }
 
-  RTDyldMemoryManager* getExeMM() const { return m_jit.m_ExeMM.get(); }
+  SlabMemoryManager* getExeMM() const { return m_ExeMM.get(); }
 
   uint8_t *allocateCodeSection(uintptr_t Size, unsigned Alignment,
                                unsigned SectionID,
@@ -162,7 +282,7 @@ public:
     }
     if (!Addr) {
       Addr = getExeMM()->allocateCodeSection(Size, Alignment, SectionID, SectionName);
-      m_jit.m_SectionsAllocatedSinceLastLoad.insert(Addr);
+      addAllocation(Addr, Size, &MemoryStats::JITCodeBytes);
     }
 
     return Addr;
@@ -181,7 +301,8 @@ public:
     if (!Addr) {
       Addr = getExeMM()->allocateDataSection(Size, Alignment, SectionID,
                                                    SectionName, IsReadOnly);
-      m_jit.m_SectionsAllocatedSinceLastLoad.insert(Addr);
+      addAllocation(Addr, Size, IsReadOnly ? &MemoryStats::JITRODataBytes
+                                           : &MemoryStats::JITRWDataBytes);
     }
     return Addr;
   }
@@ -193,9 +314,9 @@ public:
     m_ROData.allocate(getExeMM(),RODataSize, RODataAlign, false, true);
     m_RWData.allocate(getExeMM(),RWDataSize, RWDataAlign, false, false);
 
-    m_jit.m_SectionsAllocatedSinceLastLoad.insert(m_Code.m_Start);
-    m_jit.m_SectionsAllocatedSinceLastLoad.insert(m_ROData.m_Start);
-    m_jit.m_SectionsAllocatedSinceLastLoad.insert(m_RWData.m_Start);
+    addAllocation(m_Code.m_Start, CodeSize, &MemoryStats::JITCodeBytes);
+    addAllocation(m_ROData.m_Start, RODataSize, &MemoryStats::JITRODataBytes);
+    addAllocation(m_RWData.m_Start, RWDataSize, &MemoryStats::JITRWDataBytes);
   }
 
   bool needsToReserveAllocationSpace() override {
@@ -208,7 +329,8 @@ public:
     const platform::windows::RuntimePRFunction PRFunc = { Addr, Size };
     m_EHFrames.emplace_back(PRFunc);
 #else
-    return getExeMM()->registerEHFrames(Addr, LoadAddr, Size);
+    registerEHFrameSection(Addr, Size);
+    m_EHFrames.emplace_back(Addr, Size);
 #endif
   }
 
@@ -217,7 +339,10 @@ public:
     platform::DeRegisterEHFrames(getBaseAddr(), m_EHFrames);
     platform::windows::EHFrameInfos().swap(m_EHFrames);
 #else
-    return getExeMM()->deregisterEHFrames();
+    // Newest first: libgcc searches its objects from the last registered.
+    for (auto I = m_EHFrames.rbegin(), E = m_EHFrames.rend(); I != E; ++I)
+      deregisterEHFrameSection(I->first, I->second);
+    m_EHFrames.clear();
 #endif
   }
 
@@ -281,11 +406,13 @@ IncrementalJIT::IncrementalJIT(IncrementalExecutor& exe,
       llvm::orc::SymbolNameSet ret(Symbols);
       for (auto I = ret.begin(), E = ret.end(); I != E; ++I) {
         std::string symName = (**I).str();
-        if (auto Sym = getInjectedSymbols(symName)) {
+        if (m_Remote) {
+          // Nothing of this process exists in the executor.
+        } else if (auto Sym = getInjectedSymbols(symName)) {
           if (!Sym.getAddress())
             llvm_unreachable("Handle the error case");
           ret.erase(I);
-        } else if (m_ExeMM->findSymbol(symName)) {
+        } else if (findProcessSymbol(symName)) {
           ret.erase(I);
         }
       }
@@ -295,14 +422,16 @@ IncrementalJIT::IncrementalJIT(IncrementalExecutor& exe,
         llvm::orc::SymbolNameSet Symbols) {
       return llvm::orc::lookupWithLegacyFn(m_ES, *Q, Symbols,
         [&](const std::string& Name) {
-          if (auto Sym = getInjectedSymbols(Name)) {
-            if (auto AddrOrErr = Sym.getAddress())
-              return JITSymbol((uint64_t)*AddrOrErr, Sym.getFlags());
-            else
-              llvm_unreachable("Handle the error case");
+          if (!m_Remote) {
+            if (auto Sym = getInjectedSymbols(Name)) {
+              if (auto AddrOrErr = Sym.getAddress())
+                return JITSymbol((uint64_t)*AddrOrErr, Sym.getFlags());
+              else
+                llvm_unreachable("Handle the error case");
+            }
+            if (auto Sym = findProcessSymbol(Name))
+              return Sym;
           }
-          if (auto Sym = m_ExeMM->findSymbol(Name))
-            return Sym;
 
           if (auto Sym = getSymbolAddressWithoutMangling(Name, true)) {
             if (auto AddrOrErr = Sym.getAddress())
@@ -346,17 +475,49 @@ IncrementalJIT::IncrementalJIT(IncrementalExecutor& exe,
       })),
   m_ExeMM(std::make_shared<ClingMemoryManager>()),
   m_NotifyObjectLoaded(*this),
+  m_ObjCache(IncrementalObjectCache::createFromEnv(*m_TM)),
   m_ObjectLayer(m_SymbolMap, m_ES,
-                [this] (llvm::orc::VModuleKey) {
-                  return ObjectLayerT::Resources{llvm::make_unique<Azog>(*this),
-                      this->m_Resolver};
+                [this] (llvm::orc::VModuleKey K) {
+                  if (m_Remote)
+                    return ObjectLayerT::Resources{
+                      m_Remote->createMemoryManager(), takeSymbolResolver(K)};
+                  return ObjectLayerT::Resources{
+                      llvm::make_unique<Azog>(*this, K), takeSymbolResolver(K)};
                 },
                 m_NotifyObjectLoaded, NotifyFinalizedT(*this)),
-  m_CompileLayer(m_ObjectLayer, llvm::orc::SimpleCompiler(*m_TM)),
-  m_LazyEmitLayer(m_CompileLayer) {
+  m_CompileLayer(m_ObjectLayer,
+                 llvm::orc::SimpleCompiler(*m_TM, m_ObjCache.get())),
+  m_LazyEmitLayer(m_CompileLayer),
+  m_NotifyCompiled(NCC),
+  m_CodeGenThreads(getCodeGenThreads()),
+  m_Self(this),
+  m_DyLibManager(exe.getDynamicLibraryManager()) {
 
   m_CompileLayer.setNotifyCompiled(NCC);
 
+  // Run the code in another process, e.g. to survive its crashes.
+  if (const char* Executor = ::getenv("CLING_REMOTE_EXECUTOR")) {
+    std::string Err;
+    m_Remote = RemoteTarget::create(Executor, m_ES, Err);
+    if (!m_Remote)
+      cling::errs() << "cling: cannot use the executor '" << Executor << "': "
+                    << Err << "; running the code in-process.\n";
+  }
+
+  if (m_Remote) {
+    // The partitions would need to be linked against each other remotely.
+    m_CodeGenThreads = 0;
+  } else {
+    // The runtime interface of the tier-up stubs.
+    m_SymbolMap.set(Mangle(BackendPasses::getTierUpJITName()),
+                    llvm::JITTargetAddress(&m_Self));
+    m_SymbolMap.set(Mangle(BackendPasses::getTierUpHookName()),
+                    llvm::JITTargetAddress(&TierUpHook));
+    // And that of the safe points, for the ExecutionLimits.
+    for (const auto& Symbol : ExecutionGuard::getSafePointSymbols())
+      m_SymbolMap.set(Mangle(Symbol.first), Symbol.second);
+  }
+
   // Libraries might get exposed through ExposeHiddenSharedLibrarySymbols(),
   // make them available to the JIT, even though their symbols cannot be
   // resolved through the process.
@@ -366,8 +527,30 @@ IncrementalJIT::IncrementalJIT(IncrementalExecutor& exe,
   // Enable JIT symbol resolution from the binary.
   llvm::sys::DynamicLibrary::LoadLibraryPermanently(0, 0);
 
-  // Make debug symbols available.
-  m_GDBListener = 0; // JITEventListener::createGDBRegistrationListener();
+  // Name the JITted code in profiles and make it debuggable; the addresses
+  // of remote code are not ours to describe.
+  if (!m_Remote) {
+    m_DebugRegistry = JITDebugRegistry::createFromEnv();
+    if (m_DebugRegistry)
+      m_EventListeners.push_back(m_DebugRegistry.get());
+    m_PerfMap = PerfMapListener::createFromEnv();
+    if (m_PerfMap) {
+      m_EventListeners.push_back(m_PerfMap.get());
+      if (auto JITDump = JITEventListener::createPerfJITEventListener())
+        m_EventListeners.push_back(JITDump);
+    }
+    // The allocation functions of the objects resolve to the hooks, which
+    // take precedence over what the process defines.
+    m_HeapProfiler = HeapProfiler::createFromEnv();
+    if (m_HeapProfiler) {
+      m_EventListeners.push_back(m_HeapProfiler.get());
+      for (const auto& Hook : HeapProfiler::getHooks())
+        m_SymbolMap.set(Mangle(Hook.first), Hook.second);
+    }
+    // Knows the code of all objects, for a profile started at any time.
+    m_SampleProfiler.reset(new SampleProfiler());
+    m_EventListeners.push_back(m_SampleProfiler.get());
+  }
 
 // #if MCJIT
 //   llvm::EngineBuilder builder(std::move(m));
@@ -392,19 +575,91 @@ IncrementalJIT::IncrementalJIT(IncrementalExecutor& exe,
 // #endif
 }
 
+// Keep in source: ~unique_ptr<IncrementalObjectCache> needs the definition.
+IncrementalJIT::~IncrementalJIT() {}
+
+bool IncrementalJIT::runRemote(uint64_t Addr) {
+  std::string Err;
+  if (m_Remote->run(Addr, Err))
+    return true;
+  cling::errs() << "cling: the executor failed to run the code: " << Err
+                << '\n';
+  return false;
+}
+
+bool IncrementalJIT::useHeapLimitHooks() {
+  if (m_Remote || m_HeapProfiler || ExecutionGuard::getHeapHooks().empty())
+    return false;
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
+  for (const auto& Hook : ExecutionGuard::getHeapHooks())
+    m_SymbolMap.set(Mangle(Hook.first), Hook.second);
+  return true;
+}
+
+void IncrementalJIT::waitIdle() {
+  // Not under m_Mutex: the jobs take it.
+  if (m_TierUpPool)
+    m_TierUpPool->wait();
+  if (m_CodeGenPool)
+    m_CodeGenPool->wait();
+}
+
+void IncrementalJIT::onForked() {
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
+  // Destroying them would join threads that this process does not have.
+  m_CodeGenPool.release();
+  m_TierUpPool.release();
+  m_TierUpJobs.clear();
+}
 
 llvm::JITSymbol
 IncrementalJIT::getInjectedSymbols(const std::string& Name) const {
   using JITSymbol = llvm::JITSymbol;
-  auto SymMapI = m_SymbolMap.find(Name);
-  if (SymMapI != m_SymbolMap.end())
-    return JITSymbol(SymMapI->second, llvm::JITSymbolFlags::Exported);
+  if (const llvm::JITTargetAddress* Addr = m_SymbolMap.find(Name))
+    return JITSymbol(*Addr, llvm::JITSymbolFlags::Exported);
 
   return JITSymbol(nullptr);
 }
 
+llvm::JITSymbol IncrementalJIT::findProcessSymbol(const std::string& Name) {
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
+  const unsigned Unloads = m_DyLibManager.getNumUnloads();
+  if (Unloads != m_ProcessSymbolsUnloads) {
+    m_ProcessSymbols.clear();
+    m_ProcessSymbolsUnloads = Unloads;
+  }
+  auto I = m_ProcessSymbols.find(Name);
+  if (I != m_ProcessSymbols.end())
+    return llvm::JITSymbol(I->second, llvm::JITSymbolFlags::Exported);
+
+  llvm::JITSymbol Sym = m_ExeMM->findSymbol(Name);
+  if (!Sym)
+    return Sym;
+  auto AddrOrErr = Sym.getAddress();
+  if (!AddrOrErr)
+    llvm_unreachable("Handle the error case");
+  if (*AddrOrErr)
+    m_ProcessSymbols[Name] = *AddrOrErr;
+  return llvm::JITSymbol(*AddrOrErr, Sym.getFlags());
+}
+
 std::pair<void*, bool>
 IncrementalJIT::lookupSymbol(llvm::StringRef Name, void *InAddr, bool Jit) {
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
+  if (m_Remote) {
+    // An address of this process means nothing to the executor.
+    if (InAddr)
+      return std::make_pair(nullptr, false);
+    std::string Key(Name);
+#ifdef MANGLE_PREFIX
+    Key.insert(0, MANGLE_PREFIX);
+#endif
+    if (auto Sym = m_Remote->findSymbol(Key))
+      if (auto AddrOrErr = Sym.getAddress())
+        return std::make_pair((void*)*AddrOrErr, false);
+    return std::make_pair(nullptr, false);
+  }
+
   // FIXME: See comments on DLSym below.
 #if !defined(_WIN32)
   void* Addr = llvm::sys::DynamicLibrary::SearchForAddressOfSymbol(Name);
@@ -413,13 +668,14 @@ IncrementalJIT::lookupSymbol(llvm::StringRef Name, void *InAddr, bool Jit) {
 #endif
 
   if (InAddr && (!Addr || Jit)) {
-    if (Jit) {
-      std::string Key(Name);
+    std::string Key(Name);
 #ifdef MANGLE_PREFIX
-      Key.insert(0, MANGLE_PREFIX);
+    Key.insert(0, MANGLE_PREFIX);
 #endif
-      m_SymbolMap[Key] = llvm::JITTargetAddress(InAddr);
-    }
+    if (Jit)
+      m_SymbolMap.set(Key, llvm::JITTargetAddress(InAddr));
+    // It takes precedence over what the libraries define.
+    m_ProcessSymbols.erase(Key);
     llvm::sys::DynamicLibrary::AddSymbol(Name, InAddr);
     return std::make_pair(InAddr, true);
   }
@@ -429,11 +685,15 @@ IncrementalJIT::lookupSymbol(llvm::StringRef Name, void *InAddr, bool Jit) {
 llvm::JITSymbol
 IncrementalJIT::getSymbolAddressWithoutMangling(const std::string& Name,
                                                 bool AlsoInProcess) {
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
   if (auto Sym = getInjectedSymbols(Name))
     return Sym;
 
-  if (AlsoInProcess) {
-    if (llvm::JITSymbol SymInfo = m_ExeMM->findSymbol(Name)) {
+  if (AlsoInProcess && m_Remote) {
+    if (auto Sym = m_Remote->findSymbol(Name))
+      return Sym;
+  } else if (AlsoInProcess) {
+    if (llvm::JITSymbol SymInfo = findProcessSymbol(Name)) {
       if (auto AddrOrErr = SymInfo.getAddress())
         return llvm::JITSymbol(*AddrOrErr, llvm::JITSymbolFlags::Exported);
       else
@@ -456,11 +716,363 @@ IncrementalJIT::getSymbolAddressWithoutMangling(const std::string& Name,
   if (auto Sym = m_LazyEmitLayer.findSymbol(Name, false))
     return Sym;
 
+  if (m_CODLayer)
+    if (auto Sym = m_CODLayer->findSymbol(Name, false))
+      return Sym;
+
   return llvm::JITSymbol(nullptr);
 }
 
-llvm::orc::VModuleKey
-IncrementalJIT::addModule(std::unique_ptr<llvm::Module> module) {
+bool IncrementalJIT::addModuleConcurrently(llvm::Module& module,
+                                           llvm::orc::VModuleKey K) {
+  if (m_CodeGenThreads <= 1)
+    return false;
+
+  unsigned NumDefinitions = 0;
+  for (const auto& Fn : module.functions())
+    if (!Fn.isDeclaration())
+      ++NumDefinitions;
+  if (NumDefinitions < kMinFunctionsToSplit)
+    return false;
+
+  // The LLVMContext is not thread-safe, so each partition travels as bitcode
+  // into a context of its own, just like LTO's parallel code generation does.
+  // Internal symbols are kept together with their users (PreserveLocals),
+  // such that no two transactions' internal symbols can clash once
+  // externalized.
+  std::vector<SmallString<0>> BCParts;
+  SplitModule(llvm::CloneModule(module), m_CodeGenThreads,
+              [&](std::unique_ptr<llvm::Module> MPart) {
+                BCParts.emplace_back();
+                raw_svector_ostream BCOS(BCParts.back());
+                WriteBitcodeToFile(*MPart, BCOS);
+              },
+              /*PreserveLocals*/ true);
+
+  if (!m_CodeGenPool)
+    m_CodeGenPool.reset(new ThreadPool(m_CodeGenThreads));
+
+  std::vector<std::unique_ptr<MemoryBuffer>> Objects(BCParts.size());
+  std::mutex ErrorsLock;
+  std::string Errors;
+  for (size_t I = 0, E = BCParts.size(); I < E; ++I) {
+    m_CodeGenPool->async([&, I]() {
+      LLVMContext Ctx;
+      Expected<std::unique_ptr<llvm::Module>> MPart
+        = parseBitcodeFile(MemoryBufferRef(StringRef(BCParts[I].data(),
+                                                     BCParts[I].size()),
+                                           "<split-module>"), Ctx);
+      if (!MPart) {
+        std::lock_guard<std::mutex> Guard(ErrorsLock);
+        Errors += toString(MPart.takeError()) + '\n';
+        return;
+      }
+      // A TargetMachine is not thread-safe either; mirror the shared one.
+      std::unique_ptr<TargetMachine> TM(m_TM->getTarget().createTargetMachine(
+          m_TM->getTargetTriple().str(), m_TM->getTargetCPU(),
+          m_TM->getTargetFeatureString(), m_TM->Options,
+          m_TM->getRelocationModel(), m_TM->getCodeModel(),
+          m_TM->getOptLevel(), /*JIT*/ true));
+      TM->setGlobalISel(false);
+      (*MPart)->setDataLayout(TM->createDataLayout());
+      Objects[I] = llvm::orc::SimpleCompiler(*TM, m_ObjCache.get())(**MPart);
+    });
+  }
+  m_CodeGenPool->wait();
+
+  if (!Errors.empty()) {
+    // Nothing has been added yet; let the lazy emission deal with it.
+    cling::errs() << "IncrementalJIT: concurrent code generation failed, "
+                     "falling back to the calling thread:\n" << Errors;
+    return false;
+  }
+
+  std::vector<llvm::orc::VModuleKey>& Keys = m_ObjectUnloadPoints[&module];
+  for (auto& Obj : Objects) {
+    if (!Obj)
+      continue;
+    llvm::orc::VModuleKey PartK = Keys.empty() ? K : m_ES.allocateVModule();
+    llvm::cantFail(m_ObjectLayer.addObject(PartK, std::move(Obj)));
+    Keys.push_back(PartK);
+  }
+  return true;
+}
+
+std::shared_ptr<llvm::orc::SymbolResolver>
+IncrementalJIT::takeSymbolResolver(llvm::orc::VModuleKey K) {
+  auto I = m_Resolvers.find(K);
+  if (I == m_Resolvers.end())
+    return m_Resolver;
+  // Each module is added to the object layer exactly once.
+  std::shared_ptr<llvm::orc::SymbolResolver> R = std::move(I->second);
+  m_Resolvers.erase(I);
+  return R;
+}
+
+bool IncrementalJIT::addModuleLazily(const llvm::Module& module) {
+  // Set by IncrementalParser::codeGenTransaction().
+  if (!module.getModuleFlag("cling.lazy-functions"))
+    return false;
+  // The call-through stubs would call back into this process.
+  if (m_Remote)
+    return false;
+
+  if (!m_CODLayer) {
+    const Triple& TT = m_TM->getTargetTriple();
+    auto CallbackMgr
+      = llvm::orc::createLocalCompileCallbackManager(TT, m_ES, 0);
+    if (!CallbackMgr) {
+      logAllUnhandledErrors(CallbackMgr.takeError(), cling::errs(),
+                            "IncrementalJIT: no compile-on-demand: ");
+      return false;
+    }
+    m_CallbackMgr = std::move(*CallbackMgr);
+    m_CODLayer.reset(new CODLayerT(m_ES, m_CompileLayer,
+      [this](llvm::orc::VModuleKey K) {
+        auto I = m_Resolvers.find(K);
+        return I == m_Resolvers.end() ? m_Resolver : I->second;
+      },
+      [this](llvm::orc::VModuleKey K,
+             std::shared_ptr<llvm::orc::SymbolResolver> R) {
+        m_Resolvers[K] = std::move(R);
+      },
+      [](Function& F) { return std::set<Function*>({&F}); },
+      *m_CallbackMgr, llvm::orc::createLocalIndirectStubsManagerBuilder(TT)));
+  }
+
+  // The layer keeps what it gets, but the transaction needs its module (for
+  // unloading, for instance): give it a copy, under a key of its own as the
+  // layer compiles its global variables under that key.
+  llvm::orc::VModuleKey CODK = m_ES.allocateVModule();
+  if (auto Err = m_CODLayer->addModule(CODK, llvm::CloneModule(module))) {
+    logAllUnhandledErrors(std::move(Err), cling::errs(),
+                          "IncrementalJIT: no compile-on-demand: ");
+    return false;
+  }
+  m_CODUnloadPoints[&module] = CODK;
+  return true;
+}
+
+bool IncrementalJIT::cloneForTierUp(const TierUpCandidate& C, StringRef Name,
+                                    SmallString<0>& Bitcode) const {
+  const std::string ImplName = Name.str() + ".tier0";
+  const Function* Impl = C.M->getFunction(ImplName);
+  if (!Impl || Impl->isDeclaration())
+    return false;
+
+  // Everything else is referenced from the existing objects. ODR functions
+  // come along to be inlined, constants to be found in the same object.
+  ValueToValueMapTy VMap;
+  std::unique_ptr<llvm::Module> Clone = CloneModule(*C.M, VMap,
+    [Impl](const GlobalValue* GV) {
+      if (GV == Impl)
+        return true;
+      if (auto F = dyn_cast<Function>(GV))
+        return F->hasLinkOnceODRLinkage() || F->hasWeakODRLinkage();
+      if (auto V = dyn_cast<GlobalVariable>(GV))
+        return V->isConstant() && V->hasGlobalUnnamedAddr();
+      return false;
+    });
+
+  for (const char* Special : {"llvm.global_ctors", "llvm.global_dtors",
+                              "llvm.used", "llvm.compiler.used"})
+    if (GlobalVariable* GV = Clone->getNamedGlobal(Special))
+      GV->eraseFromParent();
+
+  for (Function& F : *Clone) {
+    if (F.isDeclaration())
+      continue;
+    F.setComdat(nullptr);
+    if (F.getName() == ImplName) {
+      F.setName(Name + ".tier2");
+      F.setLinkage(GlobalValue::ExternalLinkage);
+    } else
+      F.setLinkage(GlobalValue::AvailableExternallyLinkage);
+  }
+  for (GlobalVariable& V : Clone->globals()) {
+    if (V.isDeclaration())
+      continue;
+    V.setComdat(nullptr);
+    V.setLinkage(GlobalValue::PrivateLinkage);
+  }
+
+  raw_svector_ostream BCOS(Bitcode);
+  WriteBitcodeToFile(*Clone, BCOS);
+  return true;
+}
+
+std::shared_ptr<IncrementalJIT::TierUpJob>
+IncrementalJIT::startTierUp(StringRef Name, const TierUpCandidate& C,
+                            std::vector<uint64_t> Profile) {
+  auto Job = std::make_shared<TierUpJob>();
+  Job->K = C.K;
+  Job->OptLevel = C.OptLevel;
+  Job->Profile = std::move(Profile);
+  if (!cloneForTierUp(C, Name, Job->Bitcode))
+    return nullptr;
+
+  // Take the target's configuration now: the interpreter keeps changing
+  // the opt level of m_TM.
+  const llvm::Target& TheTarget = m_TM->getTarget();
+  const std::string Triple = m_TM->getTargetTriple().str();
+  const std::string CPU = m_TM->getTargetCPU().str();
+  const std::string Features = m_TM->getTargetFeatureString().str();
+  const TargetOptions Options = m_TM->Options;
+  const Reloc::Model RM = m_TM->getRelocationModel();
+  const CodeModel::Model CM = m_TM->getCodeModel();
+  const std::string ImplName = Name.str() + ".tier2";
+
+  if (!m_TierUpPool)
+    m_TierUpPool.reset(new ThreadPool(1));
+  m_TierUpPool->async([=, &TheTarget]() {
+    LLVMContext Ctx;
+    Expected<std::unique_ptr<llvm::Module>> M
+      = parseBitcodeFile(MemoryBufferRef(StringRef(Job->Bitcode.data(),
+                                                   Job->Bitcode.size()),
+                                         "<tier-up>"), Ctx);
+    if (M) {
+      static constexpr CodeGenOpt::Level CGOptLevel[] = {
+        CodeGenOpt::None, CodeGenOpt::Less, CodeGenOpt::Default,
+        CodeGenOpt::Aggressive
+      };
+      std::unique_ptr<TargetMachine> TM(TheTarget.createTargetMachine(
+          Triple, CPU, Features, Options, RM, CM, CGOptLevel[Job->OptLevel],
+          /*JIT*/ true));
+      TM->setGlobalISel(false);
+      (*M)->setDataLayout(TM->createDataLayout());
+      Function* Impl = (*M)->getFunction(ImplName);
+      if (Impl && !Job->Profile.empty())
+        BackendPasses::applyProfile(**M, *Impl, Job->Profile);
+      BackendPasses::runStandalone(**M, *TM, Job->OptLevel,
+                                   /*HotColdSplit*/ !Job->Profile.empty());
+      Job->Object = llvm::orc::SimpleCompiler(*TM)(**M);
+    } else
+      consumeError(M.takeError());
+    Job->Done.store(true, std::memory_order_release);
+  });
+  return Job;
+}
+
+bool IncrementalJIT::swapInTierUp(StringRef Name, TierUpJob& Job,
+                                  void** Target) {
+  auto ICand = m_TierUpCandidates.find(Name);
+  // Bail out if the module got unloaded (and maybe reloaded) meanwhile.
+  if (!Job.Object || ICand == m_TierUpCandidates.end()
+      || ICand->second.K != Job.K)
+    return false;
+
+  // Only swap in code whose every symbol resolves: we must not end up
+  // calling the unresolved symbol handler instead of what tier 0 called.
+  auto Obj
+    = object::ObjectFile::createObjectFile(Job.Object->getMemBufferRef());
+  if (!Obj) {
+    consumeError(Obj.takeError());
+    return false;
+  }
+  for (const object::SymbolRef& Sym : (*Obj)->symbols()) {
+    if (!(Sym.getFlags() & object::BasicSymbolRef::SF_Undefined))
+      continue;
+    auto SymName = Sym.getName();
+    if (!SymName) {
+      consumeError(SymName.takeError());
+      return false;
+    }
+    if (!getSymbolAddressWithoutMangling(SymName->str(), true))
+      return false;
+  }
+
+  llvm::orc::VModuleKey ObjK = m_ES.allocateVModule();
+  if (auto Err = m_ObjectLayer.addObject(ObjK, std::move(Job.Object))) {
+    consumeError(std::move(Err));
+    return false;
+  }
+  m_ObjectUnloadPoints[ICand->second.M].push_back(ObjK);
+  uint64_t Addr = getSymbolAddress(Name.str() + ".tier2", false);
+  if (!Addr)
+    return false;
+  *Target = reinterpret_cast<void*>(Addr);
+  return true;
+}
+
+void IncrementalJIT::tierUp(const char* Name, void** Target,
+                            int64_t* Counter) {
+  // The hot code does not wait for a thread that is adding code: the stub
+  // calls again after its next 1024 calls.
+  std::unique_lock<std::recursive_mutex> Lock(m_Mutex, std::try_to_lock);
+  if (!Lock.owns_lock())
+    return;
+  // Let the stub stop calling us.
+  auto Disable = [Counter]() {
+    *Counter = std::numeric_limits<int64_t>::min();
+  };
+
+  auto IJob = m_TierUpJobs.find(Name);
+  if (IJob == m_TierUpJobs.end()) {
+    auto ICand = m_TierUpCandidates.find(Name);
+    // Profiled functions are re-optimized on request only, see
+    // optimizeWithProfile().
+    if (ICand == m_TierUpCandidates.end() || ICand->second.M->getNamedGlobal(
+          std::string(Name) + BackendPasses::getProfileSuffix()))
+      return Disable();
+
+    std::shared_ptr<TierUpJob> Job = startTierUp(Name, ICand->second, {});
+    if (!Job)
+      return Disable();
+    m_TierUpJobs[Name] = std::move(Job);
+    return;
+  }
+
+  std::shared_ptr<TierUpJob> Job = IJob->second;
+  if (!Job->Done.load(std::memory_order_acquire))
+    return; // Keep running tier 0 for now.
+  m_TierUpJobs.erase(IJob);
+  Disable();
+  swapInTierUp(Name, *Job, Target);
+}
+
+unsigned IncrementalJIT::optimizeWithProfile() {
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
+  std::vector<std::pair<std::string, std::shared_ptr<TierUpJob>>> Jobs;
+  for (const auto& Cand : m_TierUpCandidates) {
+    const std::string Name = Cand.first().str();
+    const std::string CountersName = Name + BackendPasses::getProfileSuffix();
+    const GlobalVariable* Counters
+      = Cand.second.M->getNamedGlobal(CountersName);
+    if (!Counters)
+      continue;
+    const uint64_t* Counts = reinterpret_cast<const uint64_t*>(
+      getSymbolAddress(CountersName, false));
+    // Code that never ran gives no profile to optimize for.
+    if (!Counts || !Counts[0])
+      continue;
+    const uint64_t NumCounts
+      = cast<ArrayType>(Counters->getValueType())->getNumElements();
+    if (auto Job = startTierUp(Name, Cand.second,
+                               std::vector<uint64_t>(Counts,
+                                                     Counts + NumCounts)))
+      Jobs.emplace_back(Name, std::move(Job));
+  }
+  if (Jobs.empty())
+    return 0;
+  m_TierUpPool->wait();
+
+  unsigned NumOptimized = 0;
+  for (auto& Job : Jobs) {
+    void** Target = reinterpret_cast<void**>(
+      getSymbolAddress(Job.first + ".tierptr", false));
+    if (!Target || !swapInTierUp(Job.first, *Job.second, Target))
+      continue;
+    // The optimized code does not count: it is done with its profile.
+    m_TierUpCandidates.erase(Job.first);
+    ++NumOptimized;
+  }
+  return NumOptimized;
+}
+
+void IncrementalJIT::addModule(std::unique_ptr<llvm::Module> module,
+                               llvm::orc::VModuleKey K,
+                               std::unique_ptr<MemoryBuffer> Object) {
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
   // If this module doesn't have a DataLayout attached then attach the
   // default.
   module->setDataLayout(m_TMDataLayout);
@@ -480,14 +1092,201 @@ IncrementalJIT::addModule(std::unique_ptr<llvm::Module> module) {
     }
   }
 
-  llvm::orc::VModuleKey K = m_ES.allocateVModule();
+  if (auto Flag = mdconst::extract_or_null<ConstantInt>(
+        module->getModuleFlag(BackendPasses::getTierUpFlagName()))) {
+    for (const auto& Fn : module->functions())
+      if (!Fn.isDeclaration() && Fn.getName().endswith(".tier0"))
+        m_TierUpCandidates[Fn.getName().drop_back(6)]
+          = TierUpCandidate{K, module.get(), int(Flag->getZExtValue())};
+  }
+
+  if (Object) {
+    llvm::cantFail(m_ObjectLayer.addObject(K, std::move(Object)));
+    m_ObjectUnloadPoints[module.get()].push_back(K);
+    if (m_NotifyCompiled)
+      m_NotifyCompiled(K, std::move(module));
+    return;
+  }
+
+  if (addModuleLazily(*module) || addModuleConcurrently(*module, K)) {
+    // The JIT has its own copy or the objects: give the module back.
+    if (m_NotifyCompiled)
+      m_NotifyCompiled(K, std::move(module));
+    return;
+  }
+
   m_UnloadPoints[module.get()] = K;
   llvm::cantFail(m_LazyEmitLayer.addModule(K, std::move(module)));
-  return K;
+}
+
+void IncrementalJIT::addObjects(const llvm::Module& module,
+                       std::vector<std::unique_ptr<MemoryBuffer>> Objects) {
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
+  // After the keys of module's own objects, which loadEntryPoints() expects
+  // first.
+  std::vector<llvm::orc::VModuleKey>& Keys = m_ObjectUnloadPoints[&module];
+  for (auto& Obj : Objects) {
+    llvm::orc::VModuleKey K = m_ES.allocateVModule();
+    llvm::cantFail(m_ObjectLayer.addObject(K, std::move(Obj)));
+    Keys.push_back(K);
+  }
+}
+
+bool IncrementalJIT::needsModuleIR(const llvm::Module* module) const {
+  for (const auto& Cand : m_TierUpCandidates)
+    if (Cand.second.M == module)
+      return true;
+  return false;
+}
+
+void IncrementalJIT::getObjectKeys(const llvm::Module* module,
+                             std::vector<llvm::orc::VModuleKey>& Keys) const {
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
+  auto IUnload = m_UnloadPoints.find(module);
+  if (IUnload != m_UnloadPoints.end())
+    Keys.push_back(IUnload->second);
+  auto IObjects = m_ObjectUnloadPoints.find(module);
+  if (IObjects != m_ObjectUnloadPoints.end())
+    Keys.insert(Keys.end(), IObjects->second.begin(), IObjects->second.end());
+}
+
+void IncrementalJIT::addObjectMemory(const llvm::Module* module,
+                                     MemoryStats& Stats) const {
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
+  std::vector<llvm::orc::VModuleKey> Keys;
+  getObjectKeys(module, Keys);
+  for (llvm::orc::VModuleKey K : Keys) {
+    auto I = m_ObjectMemory.find(K);
+    if (I != m_ObjectMemory.end())
+      Stats += I->second;
+  }
+}
+
+MemoryStats IncrementalJIT::getObjectMemory() const {
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
+  MemoryStats Total;
+  for (const auto& Object : m_ObjectMemory)
+    Total += Object.second;
+  return Total;
+}
+
+void IncrementalJIT::loadEntryPoints(llvm::orc::VModuleKey K,
+                                     const llvm::Module* module) {
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
+  auto IEntries = m_EntryPoints.find(K);
+  if (IEntries == m_EntryPoints.end())
+    return; // Nothing to run, or loaded already.
+  // Not loaded, hence not finalized either: finalizing is what loads it.
+  auto IUnload = m_UnloadPoints.find(module);
+  auto IObjects = m_ObjectUnloadPoints.find(module);
+  if (IUnload != m_UnloadPoints.end() && IUnload->second == K) {
+    if (auto Err = m_LazyEmitLayer.emitAndFinalize(K))
+      logAllUnhandledErrors(std::move(Err), cling::errs(), "IncrementalJIT: ");
+  } else if (IObjects != m_ObjectUnloadPoints.end()
+             && !IObjects->second.empty() && IObjects->second.front() == K) {
+    if (auto Err = m_ObjectLayer.emitAndFinalize(K))
+      logAllUnhandledErrors(std::move(Err), cling::errs(), "IncrementalJIT: ");
+  }
+  // What the object did not define gets looked up by name.
+  m_EntryPoints.erase(K);
+}
+
+void IncrementalJIT::emitAllModules() {
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
+  // Modules that were emitted already are left as they are.
+  // One that refers to an unresolved symbol is reported, as the lookup of
+  // its symbols would, and the others still get emitted.
+  for (const auto& Unload : m_UnloadPoints)
+    if (auto Err = m_LazyEmitLayer.emitAndFinalize(Unload.second))
+      logAllUnhandledErrors(std::move(Err), cling::errs(), "IncrementalJIT: ");
 }
 
 llvm::Error
 IncrementalJIT::removeModule(const llvm::Module* module) {
+  return removeModules(module);
+}
+
+llvm::Error
+IncrementalJIT::removeModules(llvm::ArrayRef<const llvm::Module*> modules,
+                              bool Retire /*= false*/) {
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
+  // One pass over the candidates, however many modules go away.
+  if (!m_TierUpCandidates.empty()) {
+    llvm::SmallPtrSet<const llvm::Module*, 8> Removed(modules.begin(),
+                                                      modules.end());
+    for (auto I = m_TierUpCandidates.begin(), E = m_TierUpCandidates.end();
+         I != E;) {
+      auto Cur = I++;
+      if (Removed.count(Cur->second.M)) {
+        m_TierUpJobs.erase(Cur->first());
+        m_TierUpCandidates.erase(Cur);
+      }
+    }
+  }
+
+  llvm::Error Err = llvm::Error::success();
+  for (const llvm::Module* module : modules)
+    Err = llvm::joinErrors(std::move(Err), removeModuleCode(module, Retire));
+  return Err;
+}
+
+llvm::Error IncrementalJIT::removeRetiredModules() {
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
+  RetiredCode Retired = std::move(m_Retired);
+  m_Retired = RetiredCode();
+  llvm::Error Err = llvm::Error::success();
+  for (llvm::orc::VModuleKey K : Retired.Objects) {
+    for (llvm::JITEventListener* Listener : m_EventListeners)
+      Listener->notifyFreeingObject(K);
+    Err = llvm::joinErrors(std::move(Err), m_ObjectLayer.removeObject(K));
+  }
+  for (llvm::orc::VModuleKey K : Retired.CompiledOnDemand)
+    Err = llvm::joinErrors(std::move(Err), m_CODLayer->removeModule(K));
+  for (llvm::orc::VModuleKey K : Retired.Lazy) {
+    for (llvm::JITEventListener* Listener : m_EventListeners)
+      Listener->notifyFreeingObject(K);
+    Err = llvm::joinErrors(std::move(Err), m_LazyEmitLayer.removeModule(K));
+  }
+  return Err;
+}
+
+llvm::Error
+IncrementalJIT::removeModuleCode(const llvm::Module* module, bool Retire) {
+  if (!m_EntryPoints.empty()) {
+    std::vector<llvm::orc::VModuleKey> Keys;
+    getObjectKeys(module, Keys);
+    for (llvm::orc::VModuleKey K : Keys)
+      m_EntryPoints.erase(K);
+  }
+
+  auto IObjects = m_ObjectUnloadPoints.find(module);
+  if (IObjects != m_ObjectUnloadPoints.end()) {
+    std::vector<llvm::orc::VModuleKey> Keys = std::move(IObjects->second);
+    m_ObjectUnloadPoints.erase(IObjects);
+    if (Retire) {
+      m_Retired.Objects.insert(m_Retired.Objects.end(), Keys.begin(),
+                               Keys.end());
+      Keys.clear();
+    }
+    for (llvm::orc::VModuleKey K : Keys) {
+      for (llvm::JITEventListener* Listener : m_EventListeners)
+        Listener->notifyFreeingObject(K);
+      if (auto Err = m_ObjectLayer.removeObject(K))
+        return Err;
+    }
+  }
+
+  auto ICOD = m_CODUnloadPoints.find(module);
+  if (ICOD != m_CODUnloadPoints.end()) {
+    llvm::orc::VModuleKey K = ICOD->second;
+    m_CODUnloadPoints.erase(ICOD);
+    if (Retire) {
+      m_Retired.CompiledOnDemand.push_back(K);
+      return llvm::Error::success();
+    }
+    return m_CODLayer->removeModule(K);
+  }
+
   // FIXME: Track down what calls this routine on a not-yet-added module. Once
   // this is resolved we can remove this check enabling the assert.
   auto IUnload = m_UnloadPoints.find(module);
@@ -496,6 +1295,13 @@ IncrementalJIT::removeModule(const llvm::Module* module) {
   llvm::orc::VModuleKey K = IUnload->second;
   //assert(*Handle && "Trying to remove a non existent module!");
   m_UnloadPoints.erase(IUnload);
+  if (Retire) {
+    m_Retired.Lazy.push_back(K);
+    return llvm::Error::success();
+  }
+  // Its object, if it got emitted, goes under the same key.
+  for (llvm::JITEventListener* Listener : m_EventListeners)
+    Listener->notifyFreeingObject(K);
   return m_LazyEmitLayer.removeModule(K);
 }
 
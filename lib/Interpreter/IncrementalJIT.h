@@ -10,21 +10,33 @@
 #ifndef CLING_INCREMENTAL_JIT_H
 #define CLING_INCREMENTAL_JIT_H
 
+#include "cling/Interpreter/MemoryReport.h"
 #include "cling/Utils/Output.h"
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/CachedHashString.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/IR/Mangler.h"
 #include "llvm/IR/GlobalValue.h"
 #include "llvm/ExecutionEngine/JITEventListener.h"
 #include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h"
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
 #include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
 #include "llvm/ExecutionEngine/Orc/LazyEmittingLayer.h"
 #include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
 #include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Target/TargetMachine.h"
 
+#include <atomic>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <vector>
@@ -36,16 +48,84 @@ class RTDyldMemoryManager;
 
 namespace cling {
 class Azog;
+class DynamicLibraryManager;
+class HeapProfiler;
 class IncrementalExecutor;
+class IncrementalObjectCache;
+class JITDebugRegistry;
+class PerfMapListener;
+class RemoteTarget;
+class SampleProfiler;
+class SlabMemoryManager;
+
+///\brief The addresses of the symbols that the JIT defines, by name.
+///
+/// The names of the loaded objects' symbols are not copied: the keys refer
+/// to the symbol tables that RuntimeDyld keeps for the objects, and the
+/// entries of an object go before its table does. The few other names are
+/// interned. Lookups compare the cached hashes first.
+class JITSymbolMap {
+  llvm::DenseMap<llvm::CachedHashStringRef, llvm::JITTargetAddress> m_Map;
+  llvm::BumpPtrAllocator m_Alloc;
+  llvm::UniqueStringSaver m_Names{m_Alloc};
+
+public:
+  ///\brief Adds the symbol of a loaded object, whose symbol table holds
+  /// Name, unless Name has an address already.
+  void addObjectSymbol(llvm::StringRef Name, llvm::JITTargetAddress Addr) {
+    m_Map.try_emplace(llvm::CachedHashStringRef(Name), Addr);
+  }
+
+  ///\brief Drops the symbol of an object that is removed, unless Name got
+  /// another address.
+  void removeObjectSymbol(llvm::StringRef Name, llvm::JITTargetAddress Addr) {
+    auto I = m_Map.find(llvm::CachedHashStringRef(Name));
+    if (I != m_Map.end() && I->second == Addr)
+      m_Map.erase(I);
+  }
+
+  ///\brief Gives Name the address Addr, for good.
+  void set(llvm::StringRef Name, llvm::JITTargetAddress Addr) {
+    const llvm::CachedHashStringRef Key(Name);
+    // A key might refer to the symbol table of an object.
+    m_Map.erase(Key);
+    m_Map[llvm::CachedHashStringRef(m_Names.save(Name), Key.hash())] = Addr;
+  }
+
+  ///\returns the address of Name, or null if it has none.
+  const llvm::JITTargetAddress* find(llvm::StringRef Name) const {
+    auto I = m_Map.find(llvm::CachedHashStringRef(Name));
+    return I != m_Map.end() ? &I->second : nullptr;
+  }
+};
 
 class IncrementalJIT {
 public:
-  using SymbolMapT = llvm::StringMap<llvm::JITTargetAddress>;
+  using SymbolMapT = JITSymbolMap;
 
 private:
   friend class Azog;
 
-  llvm::JITEventListener* m_GDBListener; // owned by llvm::ManagedStaticBase
+  ///\brief Registers the objects with the debugger when needed, see
+  /// CLING_JIT_DEBUG; null if it is not enabled.
+  std::unique_ptr<JITDebugRegistry> m_DebugRegistry;
+
+  ///\brief The perf map of the JITted functions, see CLING_PERF; null if it
+  /// is not enabled.
+  std::unique_ptr<PerfMapListener> m_PerfMap;
+
+  ///\brief Tracks the heap allocations of the JITted code, see
+  /// CLING_HEAP_PROFILE; null if it is not enabled.
+  std::unique_ptr<HeapProfiler> m_HeapProfiler;
+
+  ///\brief Samples the JITted code upon .profile start; null if the code
+  /// runs in another process.
+  std::unique_ptr<SampleProfiler> m_SampleProfiler;
+
+  ///\brief What gets told about the objects loaded and removed: m_PerfMap
+  /// and LLVM's jitdump writer, if it was built with LLVM_USE_PERF,
+  /// m_DebugRegistry, m_HeapProfiler and m_SampleProfiler.
+  std::vector<llvm::JITEventListener*> m_EventListeners;
 
   SymbolMapT m_SymbolMap;
 
@@ -54,39 +134,33 @@ private:
     NotifyObjectLoadedT(IncrementalJIT &jit) : m_JIT(jit) {}
     void operator()(llvm::orc::VModuleKey K,
                     const llvm::object::ObjectFile &Object,
-                    const llvm::LoadedObjectInfo &/*Info*/) const {
+                    const llvm::RuntimeDyld::LoadedObjectInfo &Info) const {
       m_JIT.m_UnfinalizedSections[K]
         = std::move(m_JIT.m_SectionsAllocatedSinceLastLoad);
       m_JIT.m_SectionsAllocatedSinceLastLoad = SectionAddrSet();
 
-      // FIXME: NotifyObjectEmitted requires a RuntimeDyld::LoadedObjectInfo
-      // object. In order to get it one should call
-      // RTDyld.loadObject(*ObjToLoad->getBinary()) according to r306058.
-      // Moreover this should be done in the finalizer. Currently we are
-      // disabling this since we have globally disabled this functionality in
-      // IncrementalJIT.cpp (m_GDBListener = 0).
-      //
-      // if (auto GDBListener = m_JIT.m_GDBListener)
-      //   GDBListener->NotifyObjectEmitted(*Object->getBinary(), Info);
-
-      for (const auto &Symbol: Object.symbols()) {
-        auto Flags = Symbol.getFlags();
-        if (Flags & llvm::object::BasicSymbolRef::SF_Undefined)
-          continue;
-        // FIXME: this should be uncommented once we serve incremental
-        // modules from a TU module.
-        //if (!(Flags & llvm::object::BasicSymbolRef::SF_Exported))
-        //  continue;
-        auto NameOrError = Symbol.getName();
-        if (!NameOrError)
-          continue;
-        auto Name = NameOrError.get();
-        if (m_JIT.m_SymbolMap.find(Name) == m_JIT.m_SymbolMap.end()) {
-          llvm::JITSymbol Sym
-            = m_JIT.m_CompileLayer.findSymbolIn(K, Name, true);
-          if (auto Addr = Sym.getAddress())
-            m_JIT.m_SymbolMap[Name] = *Addr;
+      for (llvm::JITEventListener* Listener: m_JIT.m_EventListeners)
+        Listener->notifyObjectLoaded(K, Object, Info);
+
+      // Where the code that is about to run got loaded; see addEntryPoint().
+      auto IEntries = m_JIT.m_EntryPoints.find(K);
+      if (IEntries != m_JIT.m_EntryPoints.end()) {
+        const auto& Table = m_JIT.m_ObjectLayer.getSymbolTable(K);
+        for (const auto& Entry: IEntries->second) {
+          auto ISym = Table.find(Entry.first);
+          if (ISym != Table.end())
+            *Entry.second = ISym->second.getAddress();
         }
+        m_JIT.m_EntryPoints.erase(IEntries);
+      }
+
+      // RuntimeDyld resolved the defined symbols already; take their
+      // addresses in one pass instead of looking each of them up.
+      for (auto&& NameSym: m_JIT.m_ObjectLayer.getSymbolTable(K)) {
+        if (!NameSym.second.getFlags().isExported())
+          continue;
+        if (llvm::JITTargetAddress Addr = NameSym.second.getAddress())
+          m_JIT.m_SymbolMap.addObjectSymbol(NameSym.first(), Addr);
       }
     }
 
@@ -106,8 +180,9 @@ private:
       : Base_t(ES, RG, NotifyLoaded, NotifyFinalized), m_SymbolMap(SymMap)
     {}
 
-    llvm::Error
-    removeObject(llvm::orc::VModuleKey K) {
+    ///\brief The symbols RuntimeDyld defined for the loaded object K.
+    const llvm::StringMap<llvm::JITEvaluatedSymbol>&
+    getSymbolTable(llvm::orc::VModuleKey K) const {
       struct AccessSymbolTable: public LinkedObject {
         const llvm::StringMap<llvm::JITEvaluatedSymbol>&
         getSymbolTable() const {
@@ -115,16 +190,15 @@ private:
         }
       };
       const AccessSymbolTable* HSymTable
-        = static_cast<const AccessSymbolTable*>(LinkedObjects[K].get());
+        = static_cast<const AccessSymbolTable*>(LinkedObjects.at(K).get());
+      return HSymTable->getSymbolTable();
+    }
 
-      for (auto&& NameSym: HSymTable->getSymbolTable()) {
-        auto iterSymMap = m_SymbolMap.find(NameSym.first());
-        if (iterSymMap == m_SymbolMap.end())
-          continue;
-        // Is this this symbol (address)?
-        if (iterSymMap->second == NameSym.second.getAddress())
-          m_SymbolMap.erase(iterSymMap);
-      }
+    llvm::Error
+    removeObject(llvm::orc::VModuleKey K) {
+      for (auto&& NameSym: getSymbolTable(K))
+        m_SymbolMap.removeObjectSymbol(NameSym.first(),
+                                       NameSym.second.getAddress());
       return llvm::orc::LegacyRTDyldObjectLinkingLayer::removeObject(K);
     }
   private:
@@ -135,6 +209,7 @@ private:
   typedef llvm::orc::LegacyIRCompileLayer<ObjectLayerT,
                                        llvm::orc::SimpleCompiler> CompileLayerT;
   typedef llvm::orc::LazyEmittingLayer<CompileLayerT> LazyEmitLayerT;
+  typedef llvm::orc::LegacyCompileOnDemandLayer<CompileLayerT> CODLayerT;
 
   std::unique_ptr<llvm::TargetMachine> m_TM;
   llvm::DataLayout m_TMDataLayout;
@@ -143,16 +218,51 @@ private:
 
   std::shared_ptr<llvm::orc::SymbolResolver> m_Resolver;
 
+  ///\brief Resolvers of the modules that the compile-on-demand layer adds,
+  /// until the object layer picks them up.
+  std::map<llvm::orc::VModuleKey,
+           std::shared_ptr<llvm::orc::SymbolResolver>> m_Resolvers;
+
   ///\brief The RTDyldMemoryManager used to communicate with the
-  /// IncrementalExecutor to handle missing or special symbols.
-  std::shared_ptr<llvm::RTDyldMemoryManager> m_ExeMM;
+  /// IncrementalExecutor to handle missing or special symbols. It hands out
+  /// the memory of the objects, which gets reused once they are removed.
+  std::shared_ptr<SlabMemoryManager> m_ExeMM;
+
+  ///\brief The executor process running the code, see CLING_REMOTE_EXECUTOR.
+  /// Null if the code runs in this process.
+  std::unique_ptr<RemoteTarget> m_Remote;
+
+  ///\brief The JIT sizes of the objects loaded, by key; see Azog. Outlives
+  /// the object layer, whose objects remove themselves from it.
+  std::map<llvm::orc::VModuleKey, MemoryStats> m_ObjectMemory;
+
+  ///\brief The entry points that addEntryPoint() was asked for, by the key
+  /// of the object to find them in: their symbol names and where to store
+  /// their addresses.
+  std::map<llvm::orc::VModuleKey,
+           std::vector<std::pair<std::string, uint64_t*>>> m_EntryPoints;
 
   NotifyObjectLoadedT m_NotifyObjectLoaded;
 
+  ///\brief The on-disk cache of compiled objects, see CLING_OBJECT_CACHE.
+  /// Null if it is not enabled.
+  std::unique_ptr<IncrementalObjectCache> m_ObjCache;
+
   ObjectLayerT m_ObjectLayer;
   CompileLayerT m_CompileLayer;
   LazyEmitLayerT m_LazyEmitLayer;
 
+  ///\brief Creates the lazy call-through stubs of m_CODLayer.
+  std::unique_ptr<llvm::orc::JITCompileCallbackManager> m_CallbackMgr;
+
+  ///\brief Compiles the functions of modules flagged "cling.lazy-functions"
+  /// one by one, upon their first call; created on first use.
+  std::unique_ptr<CODLayerT> m_CODLayer;
+
+  ///\brief Mapping between \c llvm::Module* and the \c VModuleKey of its
+  /// copy in the m_CODLayer.
+  std::map<const llvm::Module*, llvm::orc::VModuleKey> m_CODUnloadPoints;
+
   // We need to store ObjLayerT::ObjHandles for each of the object sets
   // that have been emitted but not yet finalized so that we can forward the
   // mapSectionAddress calls appropriately.
@@ -163,6 +273,103 @@ private:
   ///\brief Mapping between \c llvm::Module* and \c VModuleKey.
   std::map<const llvm::Module*, llvm::orc::VModuleKey> m_UnloadPoints;
 
+  ///\brief Mapping between \c llvm::Module* and the \c VModuleKey-s of the
+  /// objects added on its behalf: the partitions it was split into by the
+  /// concurrent code generation and its re-optimized (tier-up) functions.
+  std::map<const llvm::Module*,
+           std::vector<llvm::orc::VModuleKey>> m_ObjectUnloadPoints;
+
+  ///\brief Hands the module back to its transaction once it got compiled.
+  CompileLayerT::NotifyCompiledCallback m_NotifyCompiled;
+
+  ///\brief Number of threads used to codegen large modules, see
+  /// CLING_JIT_THREADS. Concurrent code generation is off if this is <= 1.
+  unsigned m_CodeGenThreads = 0;
+
+  ///\brief Threads compiling the partitions of large modules; created on
+  /// first use.
+  std::unique_ptr<llvm::ThreadPool> m_CodeGenPool;
+
+  ///\brief A function with a tier-up stub, see BackendPasses.
+  struct TierUpCandidate {
+    llvm::orc::VModuleKey K;
+    llvm::Module* M;
+    int OptLevel;
+  };
+  ///\brief The functions with tier-up stubs, by IR name.
+  llvm::StringMap<TierUpCandidate> m_TierUpCandidates;
+
+  ///\brief A re-optimization running in the background.
+  struct TierUpJob {
+    llvm::orc::VModuleKey K;
+    int OptLevel;
+    llvm::SmallString<0> Bitcode;
+    ///\brief The counts of the tier-0 body, see
+    /// BackendPasses::addProfileCounters(), if optimizing with a profile.
+    std::vector<uint64_t> Profile;
+    std::unique_ptr<llvm::MemoryBuffer> Object;
+    std::atomic<bool> Done{false};
+  };
+  ///\brief The re-optimizations not yet swapped in, by IR name.
+  llvm::StringMap<std::shared_ptr<TierUpJob>> m_TierUpJobs;
+
+  ///\brief Runs the re-optimizations; created on first use.
+  std::unique_ptr<llvm::ThreadPool> m_TierUpPool;
+
+  ///\brief The address of this member is what the tier-up stubs find as
+  /// BackendPasses::getTierUpJITName().
+  IncrementalJIT* m_Self;
+
+  ///\brief Serializes the additions, removals and lookups of code: the
+  /// threads running JITted code call into the JIT, e.g. for their
+  /// tier-ups, while another one compiles the next input.
+  mutable std::recursive_mutex m_Mutex;
+
+  ///\brief The keys of the code that removeModules() was asked to leave in
+  /// place, by layer, until removeRetiredModules().
+  struct RetiredCode {
+    std::vector<llvm::orc::VModuleKey> Objects;
+    std::vector<llvm::orc::VModuleKey> Lazy;
+    std::vector<llvm::orc::VModuleKey> CompiledOnDemand;
+  } m_Retired;
+
+  ///\brief Removes the objects and the layers' state of module, except for
+  /// its tier-up candidates; or only forgets module, keeping its code in
+  /// m_Retired, if Retire.
+  llvm::Error removeModuleCode(const llvm::Module* module, bool Retire);
+
+  ///\brief Create a module with only the named function's tier-0 body (and
+  /// what it could inline), renamed to Name.tier2, as bitcode.
+  bool cloneForTierUp(const TierUpCandidate& C, llvm::StringRef Name,
+                      llvm::SmallString<0>& Bitcode) const;
+
+  ///\brief Starts re-optimizing the function Name in the background, with
+  /// the counts of its profile unless empty.
+  ///\returns nullptr if it cannot be re-optimized.
+  std::shared_ptr<TierUpJob> startTierUp(llvm::StringRef Name,
+                                         const TierUpCandidate& C,
+                                         std::vector<uint64_t> Profile);
+
+  ///\brief Adds the object of the finished Job and stores the address of
+  /// its code into *Target.
+  ///\returns false if the object cannot be used; the old code then stays.
+  bool swapInTierUp(llvm::StringRef Name, TierUpJob& Job, void** Target);
+
+  ///\brief The resolver for the module K in the object layer.
+  std::shared_ptr<llvm::orc::SymbolResolver>
+  takeSymbolResolver(llvm::orc::VModuleKey K);
+
+  ///\brief Add (a copy of) the module to the compile-on-demand layer, if
+  /// requested by its "cling.lazy-functions" flag.
+  ///\returns false if the module should be added as a whole.
+  bool addModuleLazily(const llvm::Module& module);
+
+  ///\brief Split the module into partitions, compile them concurrently and
+  /// add the resulting objects to the object layer.
+  ///\returns false if the module is not worth splitting, in which case it is
+  /// left untouched.
+  bool addModuleConcurrently(llvm::Module& module, llvm::orc::VModuleKey K);
+
   std::string Mangle(llvm::StringRef Name) {
     stdstrstream MangledName;
     llvm::Mangler::getNameWithPrefix(MangledName, Name, m_TMDataLayout);
@@ -171,10 +378,25 @@ private:
 
   llvm::JITSymbol getInjectedSymbols(const std::string& Name) const;
 
+  ///\brief The libraries whose unloads invalidate m_ProcessSymbols.
+  const DynamicLibraryManager& m_DyLibManager;
+
+  ///\brief The addresses that m_ExeMM found in the process, by name: the
+  /// search takes a global lock and walks all open libraries, for the same
+  /// symbols of each new object. Only what was found is kept, for as long
+  /// as no library got unloaded; a library loaded later does not replace
+  /// a definition found earlier.
+  llvm::StringMap<llvm::JITTargetAddress> m_ProcessSymbols;
+  unsigned m_ProcessSymbolsUnloads = 0;
+
+  ///\brief m_ExeMM->findSymbol(), through m_ProcessSymbols.
+  llvm::JITSymbol findProcessSymbol(const std::string& Name);
+
 public:
   IncrementalJIT(IncrementalExecutor& exe,
                  std::unique_ptr<llvm::TargetMachine> TM,
                  CompileLayerT::NotifyCompiledCallback NCF);
+  ~IncrementalJIT();
 
   ///\brief Get the address of a symbol from the JIT or the memory manager,
   /// mangling the name as needed. Use this to resolve symbols as coming
@@ -202,13 +424,144 @@ public:
   llvm::JITSymbol getSymbolAddressWithoutMangling(const std::string& Name,
                                                   bool AlsoInProcess);
 
-  llvm::orc::VModuleKey addModule(std::unique_ptr<llvm::Module> module);
+  ///\brief Whether the JIT has a definition of the symbol Name, as coming
+  /// from clang's mangler. Unlike getSymbolAddress(), this neither searches
+  /// the process nor emits the module defining Name.
+  bool hasDefinition(llvm::StringRef Name) {
+    return (bool)getSymbolAddressWithoutMangling(Mangle(Name), false);
+  }
+
+  ///\brief Reserve the key under which a module will be added.
+  /// The key is passed to the NotifyCompiledCallback once the module got
+  /// compiled, which might already happen from within addModule().
+  llvm::orc::VModuleKey allocateModuleKey() { return m_ES.allocateVModule(); }
+
+  ///\brief Add a module to the JIT, under a key from allocateModuleKey().
+  /// Large modules are split and compiled on several threads if
+  /// CLING_JIT_THREADS is set; all others are emitted lazily, upon the first
+  /// lookup of one of their symbols.
+  ///\param Object - The object compiled from module earlier, e.g. out of
+  /// the object cache; the module is then not compiled again.
+  void addModule(std::unique_ptr<llvm::Module> module,
+                 llvm::orc::VModuleKey K,
+                 std::unique_ptr<llvm::MemoryBuffer> Object = nullptr);
+  ///\brief Add objects that define symbols of module, added before: they
+  /// get unloaded with it.
+  void addObjects(const llvm::Module& module,
+                  std::vector<std::unique_ptr<llvm::MemoryBuffer>> Objects);
   llvm::Error removeModule(const llvm::Module* module);
 
+  ///\brief Has the address of the function Name (as coming from clang's
+  /// mangler) stored into *Address when the object of the module K gets
+  /// loaded; it is left alone if that object does not define Name. The
+  /// caller then runs the code without looking it up.
+  void addEntryPoint(llvm::orc::VModuleKey K, llvm::StringRef Name,
+                     uint64_t* Address) {
+    std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
+    m_EntryPoints[K].emplace_back(Mangle(Name), Address);
+  }
+
+  ///\brief Loads the object of module, added under K, if it has entry
+  /// points still to locate: right away, instead of upon the first lookup.
+  /// Entry points that are not in that object, e.g. as module got split or
+  /// gets compiled on demand, stay to be looked up by name.
+  void loadEntryPoints(llvm::orc::VModuleKey K, const llvm::Module* module);
+
+  ///\brief Removes the code of several modules, e.g. of a range of
+  /// transactions being unloaded, sharing the bookkeeping between them.
+  ///\param Retire - Whether to keep their code, e.g. as other threads
+  /// might still run it, until removeRetiredModules(). The JIT forgets the
+  /// modules right away, but lookups might still find their symbols.
+  llvm::Error removeModules(llvm::ArrayRef<const llvm::Module*> modules,
+                            bool Retire = false);
+
+  ///\brief Removes the code that removeModules() retired.
+  llvm::Error removeRetiredModules();
+
+  ///\brief Whether removeModules() retired code that is still in place.
+  bool hasRetiredModules() const {
+    std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
+    return !m_Retired.Objects.empty() || !m_Retired.Lazy.empty()
+      || !m_Retired.CompiledOnDemand.empty();
+  }
+
+  ///\brief The lock that the JIT takes for each of its operations; hold it
+  /// to make several of them atomic.
+  std::recursive_mutex& getMutex() const { return m_Mutex; }
+
+  ///\brief Whether the JIT might still read the IR of module, which it gave
+  /// back to its transaction; true if it has functions to tier up.
+  bool needsModuleIR(const llvm::Module* module) const;
+
+  ///\brief Adds the JIT memory of the objects loaded for module to Stats.
+  /// The functions compiled on demand are not attributed to any module.
+  void addObjectMemory(const llvm::Module* module, MemoryStats& Stats) const;
+
+  ///\brief The JIT memory of all objects loaded.
+  MemoryStats getObjectMemory() const;
+
+  ///\brief Appends the keys of the objects loaded for module to Keys.
+  void getObjectKeys(const llvm::Module* module,
+                     std::vector<llvm::orc::VModuleKey>& Keys) const;
+
+  ///\brief The profiler of CLING_HEAP_PROFILE, or null if it is not
+  /// enabled.
+  HeapProfiler* getHeapProfiler() const { return m_HeapProfiler.get(); }
+
+  ///\brief Links the allocation functions of the objects loaded from now on
+  /// to the hooks of ExecutionGuard::getHeapHooks(), for a heap limit.
+  ///\returns false if they cannot be: on this platform, with a remote
+  /// executor or with the hooks of CLING_HEAP_PROFILE.
+  bool useHeapLimitHooks();
+
+  ///\brief Waits for the jobs of the pools, which might hold locks of LLVM,
+  /// e.g. of the PassRegistry, that a child made by fork() could never take.
+  void waitIdle();
+
+  ///\brief Goes on in a child that fork() made of the process, where the
+  /// threads of the pools are gone: they are leaked, and made anew upon
+  /// their next use. The re-optimizations they ran are dropped.
+  void onForked();
+
+  ///\brief The sampling profiler, or null if the code runs in another
+  /// process.
+  SampleProfiler* getSampleProfiler() const { return m_SampleProfiler.get(); }
+
+  ///\brief Emits the modules still waiting for a lookup of their symbols,
+  /// which gives them back to their transactions. The modules that fail to
+  /// link are reported and left as they are.
+  void emitAllModules();
+
+  ///\brief Whether the code runs in a cling-executor process, whose symbols
+  /// and addresses are then the ones the JIT resolves to.
+  bool isRemote() const { return (bool)m_Remote; }
+
+  ///\brief The cache of CLING_OBJECT_CACHE, or null if it is not enabled.
+  IncrementalObjectCache* getObjectCache() const { return m_ObjCache.get(); }
+
+  ///\brief Runs the function of type void() at Addr in the executor process.
+  ///\returns false, after reporting why, if it could not be run.
+  bool runRemote(uint64_t Addr);
+
   void RemoveUnfinalizedSection(llvm::orc::VModuleKey K) {
     m_UnfinalizedSections.erase(K);
   }
 
+  ///\brief Called by the tier-up stub of the function Name once it is hot.
+  /// Starts the re-optimization in the background on the first call; later
+  /// calls swap in the result once available by storing its address into
+  /// *Target. Sets *Counter such that the stub stops calling once done.
+  /// Called by the threads running the code, it touches the maps of the
+  /// tier-up under m_Mutex, and returns right away while another thread
+  /// holds it.
+  void tierUp(const char* Name, void** Target, int64_t* Counter);
+
+  ///\brief Re-optimizes the functions instrumented by
+  /// BackendPasses::addProfileCounters() that ran, with the profile they
+  /// collected, and swaps in the result. Blocks until done.
+  ///\returns the number of functions that were swapped.
+  unsigned optimizeWithProfile();
+
   ///\brief Get the address of a symbol from the process' loaded libraries.
   /// \param Name - symbol to look for
   /// \param Addr - known address of the symbol that can be cached later use
@@ -0,0 +1,169 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "IncrementalObjectCache.h"
+#include "SharedCache.h"
+
+#include "cling/Utils/Output.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include <cstdlib>
+
+using namespace llvm;
+
+namespace {
+  ///\brief Feeds the textual IR into the hash, skipping the lines that only
+  /// identify the module.
+  class HashingStream : public raw_ostream {
+    MD5& m_Hash;
+    std::string m_Line;
+    uint64_t m_Pos = 0;
+
+    void write_impl(const char* Ptr, size_t Size) override {
+      m_Pos += Size;
+      for (const char* E = Ptr + Size; Ptr != E; ++Ptr) {
+        m_Line += *Ptr;
+        if (*Ptr == '\n')
+          flushLine();
+      }
+    }
+
+    uint64_t current_pos() const override { return m_Pos; }
+
+    void flushLine() {
+      StringRef Line(m_Line);
+      if (!Line.startswith("; ModuleID =") &&
+          !Line.startswith("source_filename ="))
+        m_Hash.update(Line);
+      m_Line.clear();
+    }
+
+  public:
+    HashingStream(MD5& Hash) : m_Hash(Hash) { SetUnbuffered(); }
+    ~HashingStream() override { flushLine(); }
+  };
+
+  ///\brief The hex MD5 of the target of TM, Salt, then M's IR.
+  static std::string hashModule(const TargetMachine& TM,
+                                ArrayRef<uint8_t> Salt, const Module& M) {
+    MD5 Hash;
+    Hash.update(TM.getTargetTriple().str());
+    Hash.update(TM.getTargetCPU());
+    Hash.update(TM.getTargetFeatureString());
+    Hash.update(Salt);
+    {
+      HashingStream HS(Hash);
+      M.print(HS, /*AAW*/ nullptr);
+    }
+    MD5::MD5Result Result;
+    Hash.final(Result);
+    return Result.digest().str();
+  }
+} // unnamed namespace
+
+namespace cling {
+
+IncrementalObjectCache::IncrementalObjectCache(StringRef CacheDir,
+                                               const TargetMachine& TM):
+  m_CacheDir(CacheDir.str()), m_TM(TM),
+  m_MaxBytes(cache::getSizeLimit("CLING_OBJECT_CACHE_SIZE")) {}
+
+// Keep in source: ~unique_ptr<EntryLock> needs the definition.
+IncrementalObjectCache::~IncrementalObjectCache() = default;
+
+std::unique_ptr<IncrementalObjectCache>
+IncrementalObjectCache::createFromEnv(const TargetMachine& TM) {
+  const char* Dir = ::getenv("CLING_OBJECT_CACHE");
+  if (!Dir || !*Dir)
+    return nullptr;
+
+  if (std::error_code EC = sys::fs::create_directories(Dir)) {
+    cling::errs() << "cling::IncrementalObjectCache: cannot use '" << Dir
+                  << "' as object cache: " << EC.message() << '\n';
+    return nullptr;
+  }
+  return std::unique_ptr<IncrementalObjectCache>(
+      new IncrementalObjectCache(Dir, TM));
+}
+
+std::string IncrementalObjectCache::getKey(const Module& M) const {
+  const uint8_t OptLevel = m_TM.getOptLevel();
+  return hashModule(m_TM, OptLevel, M);
+}
+
+std::string IncrementalObjectCache::getSourceKey(const Module& M,
+                                                 StringRef Pipeline) const {
+  const std::string Salt = "source " + Pipeline.str();
+  return hashModule(m_TM, arrayRefFromStringRef(Salt), M);
+}
+
+std::string IncrementalObjectCache::getCachePath(StringRef Key) const {
+  SmallString<256> Path(m_CacheDir);
+  sys::path::append(Path, Key + ".o");
+  return Path.str().str();
+}
+
+std::unique_ptr<MemoryBuffer>
+IncrementalObjectCache::getCachedObject(StringRef Key) const {
+  if (Key.empty())
+    return nullptr;
+  return cache::readCheckedEntry(getCachePath(Key), Key);
+}
+
+void IncrementalObjectCache::notifyObjectCompiled(const Module* M,
+                                                  MemoryBufferRef Obj) {
+  Missed Entry;
+  {
+    std::lock_guard<std::mutex> Guard(m_Mutex);
+    auto I = m_Missed.find(M);
+    if (I != m_Missed.end()) {
+      Entry = std::move(I->second);
+      m_Missed.erase(I);
+    }
+  }
+  if (Entry.Path.empty())
+    Entry.Path = getCachePath(getKey(*M));
+
+  if (!cache::writeCheckedEntry(Entry.Path, Obj.getBuffer()))
+    return;
+  // Let the processes waiting for the entry read it.
+  Entry.Lock.reset();
+  cache::prune(m_CacheDir, m_MaxBytes, {".o"});
+}
+
+std::unique_ptr<MemoryBuffer>
+IncrementalObjectCache::getObject(const Module* M) {
+  std::string Path = getCachePath(getKey(*M));
+  // The JIT keeps the object alive; it is a copy.
+  const std::string& Name = M->getModuleIdentifier();
+  if (auto Obj = cache::readCheckedEntry(Path, Name))
+    return Obj;
+  // Another process might be compiling the same module: wait for it rather
+  // than compile it too.
+  auto Lock = llvm::make_unique<cache::EntryLock>(Path);
+  if (auto Obj = cache::readCheckedEntry(Path, Name))
+    return Obj;
+  std::lock_guard<std::mutex> Guard(m_Mutex);
+  Missed& Entry = m_Missed[M];
+  Entry.Path = std::move(Path);
+  if (Lock->isOwner())
+    Entry.Lock = std::move(Lock);
+  return nullptr;
+}
+
+} // end namespace cling
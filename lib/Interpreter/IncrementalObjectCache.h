@@ -0,0 +1,102 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_INCREMENTAL_OBJECT_CACHE_H
+#define CLING_INCREMENTAL_OBJECT_CACHE_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace llvm {
+  class MemoryBuffer;
+  class MemoryBufferRef;
+  class Module;
+  class TargetMachine;
+}
+
+namespace cling {
+  namespace cache {
+    class EntryLock;
+  }
+
+  ///\brief Persistent, on-disk cache of the objects compiled by the
+  /// IncrementalJIT.
+  ///
+  /// Entries are keyed on a hash of the final (optimized) module - without
+  /// its identifier, which differs between otherwise identical transactions -
+  /// the target triple, the CPU and its features and the codegen opt level.
+  /// Identical transactions of different processes thus skip code generation.
+  ///
+  /// Processes can share the cache as they start together: one of those
+  /// missing an entry compiles it while the others wait for it, and
+  /// $CLING_OBJECT_CACHE_SIZE, e.g. "2G", bounds the size of the directory by
+  /// evicting the least recently used entries. See cache::EntryLock.
+  ///
+  class IncrementalObjectCache : public llvm::ObjectCache {
+    ///\brief The directory holding the cached objects.
+    std::string m_CacheDir;
+
+    ///\brief The target the objects are generated for.
+    const llvm::TargetMachine& m_TM;
+
+    ///\brief The size the directory is pruned to, or 0.
+    uint64_t m_MaxBytes;
+
+    ///\brief Protects m_Missed; modules can be compiled concurrently.
+    std::mutex m_Mutex;
+
+    struct Missed {
+      std::string Path;
+      ///\brief Makes the other processes wait for the entry, if we own it.
+      std::unique_ptr<cache::EntryLock> Lock;
+    };
+
+    ///\brief Cache entries looked up but not found, to be written once the
+    /// module got compiled without hashing it again.
+    std::map<const llvm::Module*, Missed> m_Missed;
+
+    ///\brief The path of the cache entry Key.
+    std::string getCachePath(llvm::StringRef Key) const;
+
+  public:
+    IncrementalObjectCache(llvm::StringRef CacheDir,
+                           const llvm::TargetMachine& TM);
+    ~IncrementalObjectCache();
+
+    ///\brief Creates the cache if the environment variable CLING_OBJECT_CACHE
+    /// names a usable directory, returns null otherwise.
+    static std::unique_ptr<IncrementalObjectCache>
+    createFromEnv(const llvm::TargetMachine& TM);
+
+    ///\brief The key of the cache entry of the final module M.
+    std::string getKey(const llvm::Module& M) const;
+
+    ///\brief The key of M's IR before the optimizer runs the pipeline
+    /// Pipeline on it, e.g. "O2", for SessionJournal: the same key, in the
+    /// same session state, gives the same final module.
+    std::string getSourceKey(const llvm::Module& M,
+                             llvm::StringRef Pipeline) const;
+
+    ///\brief The object of the cache entry Key, or null if there is none.
+    std::unique_ptr<llvm::MemoryBuffer>
+    getCachedObject(llvm::StringRef Key) const;
+
+    void notifyObjectCompiled(const llvm::Module* M,
+                              llvm::MemoryBufferRef Obj) override;
+    std::unique_ptr<llvm::MemoryBuffer>
+    getObject(const llvm::Module* M) override;
+  };
+} // end namespace cling
+
+#endif // CLING_INCREMENTAL_OBJECT_CACHE_H
@@ -14,19 +14,28 @@
 #include "BackendPasses.h"
 #include "CheckEmptyTransactionTransformer.h"
 #include "ClingPragmas.h"
+#include "CodeGenPipeline.h"
 #include "DeclCollector.h"
 #include "DeclExtractor.h"
+#include "DeclUnloader.h"
+#include "DeferredBodies.h"
 #include "DefinitionShadower.h"
 #include "DeviceKernelInliner.h"
 #include "DynamicLookup.h"
+#include "EventTrace.h"
 #include "NullDerefProtectionTransformer.h"
+#include "SafePointTransformer.h"
+#include "StateLock.h"
 #include "TransactionPool.h"
 #include "ValueExtractionSynthesizer.h"
 #include "ValuePrinterSynthesizer.h"
 #include "cling/Interpreter/CIFactory.h"
+#include "cling/Interpreter/IncrementalCUDADeviceCompiler.h"
 #include "cling/Interpreter/Interpreter.h"
 #include "cling/Interpreter/InterpreterCallbacks.h"
+#include "cling/Interpreter/LookupHelper.h"
 #include "cling/Interpreter/Transaction.h"
+#include "cling/Utils/AST.h"
 #include "cling/Utils/Diagnostics.h"
 #include "cling/Utils/Output.h"
 
@@ -42,20 +51,27 @@
 #include "clang/Frontend/FrontendDiagnostic.h"
 #include "clang/Frontend/FrontendPluginRegistry.h"
 #include "clang/Frontend/MultiplexConsumer.h"
+#include "clang/Lex/Lexer.h"
 #include "clang/Lex/Preprocessor.h"
 #include "clang/Lex/PreprocessorOptions.h"
 #include "clang/Parse/Parser.h"
 #include "clang/Sema/Sema.h"
 #include "clang/Sema/SemaDiagnostic.h"
+#include "clang/Sema/TemplateInstCallback.h"
 #include "clang/Serialization/ASTWriter.h"
 #include "clang/Serialization/ASTReader.h"
 #include "llvm/Support/Path.h"
 
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Support/CrashRecoveryContext.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/TimeProfiler.h"
 
+#include <algorithm>
+#include <mutex>
 #include <stdio.h>
 
 using namespace clang;
@@ -180,6 +196,37 @@ namespace {
       ~RAAI() { m_Client.m_IgnorePromptDiags.pop(); }
     };
   };
+
+  ///\brief Fails the input for Interpreter::cancelCompilation(), with a
+  /// fatal error: clang then stops instantiating templates and suppresses
+  /// the diagnostics that follow, and the transaction gets rolled back.
+  static void reportCancelled(DiagnosticsEngine& Diags) {
+    if (Diags.hasFatalErrorOccurred())
+      return;
+    Diags.Report(Diags.getCustomDiagID(DiagnosticsEngine::Fatal,
+                                       "compilation interrupted"));
+  }
+
+  ///\brief Checks for Interpreter::cancelCompilation() as each template
+  /// instantiation starts: a runaway one rarely returns to the parser.
+  class CancellationCallback : public TemplateInstantiationCallback {
+    const cling::Interpreter& m_Interp;
+
+  public:
+    CancellationCallback(const cling::Interpreter& Interp): m_Interp(Interp) {}
+
+    void initialize(const Sema&) override {}
+    void finalize(const Sema&) override {}
+
+    void atTemplateBegin(const Sema& S,
+                         const Sema::CodeSynthesisContext&) override {
+      if (m_Interp.isCompilationCancelled())
+        reportCancelled(S.getDiagnostics());
+    }
+
+    void atTemplateEnd(const Sema&, const Sema::CodeSynthesisContext&)
+      override {}
+  };
 } // unnamed namespace
 
 static void HandlePlugins(CompilerInstance& CI,
@@ -283,6 +330,13 @@ namespace cling {
     // Initialize the DeclCollector and add callbacks keeping track of macros.
     m_Consumer->Setup(this, std::move(WrappedConsumer), m_CI->getPreprocessor());
 
+    // Replaces the TextDiagnosticPrinter, unless -verify checks them.
+    if (m_Interpreter->getOptions().StructuredDiagnostics
+        && !m_CI->getDiagnosticOpts().VerifyDiagnostics) {
+      m_StructuredDiags = new utils::StructuredDiagnostics();
+      Diag.setClient(m_StructuredDiags, /*Owns*/ true);
+    }
+
     m_DiagConsumer.reset(new FilteringDiagConsumer(Diag, false));
 
     initializeVirtualFile();
@@ -291,9 +345,12 @@ namespace cling {
   bool
   IncrementalParser::Initialize(llvm::SmallVectorImpl<ParseResultTransaction>&
                                 result, bool isChildInterpreter) {
+    llvm::TimeTraceScope TimeScope("InitializeParser", llvm::StringRef());
     m_TransactionPool.reset(new TransactionPool);
     if (hasCodeGenerator())
       getCodeGenerator()->Initialize(getCI()->getASTContext());
+    m_CI->getSema().TemplateInstCallbacks.push_back(
+      llvm::make_unique<CancellationCallback>(*m_Interpreter));
 
     CompilationOptions CO = m_Interpreter->makeDefaultCompilationOpts();
     Transaction* CurT = beginTransaction(CO);
@@ -304,6 +361,7 @@ namespace cling {
     const std::string& PCHFileName
       = m_CI->getInvocation().getPreprocessorOpts().ImplicitPCHInclude;
     if (!PCHFileName.empty()) {
+      llvm::TimeTraceScope PCHScope("LoadPCH", llvm::StringRef(PCHFileName));
       Transaction* PchT = beginTransaction(CO);
       DiagnosticErrorTrap Trap(Diags);
       m_CI->createPCHExternalASTSource(PCHFileName,
@@ -327,6 +385,12 @@ namespace cling {
     Sema* TheSema = &m_CI->getSema();
     m_Parser.reset(new Parser(PP, *TheSema, false /*skipFuncBodies*/));
 
+    if (auto Deferred = DeferredBodies::create(m_Interpreter->getOptions(),
+                                               *m_CI)) {
+      PP.addPPCallbacks(std::move(Deferred));
+      m_DeferBodies = true;
+    }
+
     // Initialize the parser after PP has entered the main source file.
     m_Parser->Initialize();
 
@@ -364,25 +428,16 @@ namespace cling {
            && (!initialized || (m_TransactionPool && m_Parser));
   }
 
-  namespace {
-    template <class T>
-    struct Reversed {
-      const T &m_orig;
-      auto begin() -> decltype(m_orig.rbegin()) { return m_orig.rbegin(); }
-      auto end() -> decltype (m_orig.rend()) { return m_orig.rend(); }
-    };
-    template <class T>
-    Reversed<T> reverse(const T& orig) { return {orig}; }
-  }
-
   const Transaction* IncrementalParser::getLastWrapperTransaction() const {
     if (auto *T = getCurrentTransaction())
       if (T->getWrapperFD())
         return T;
 
-    for (auto T: reverse(m_Transactions))
-      if (T->getWrapperFD())
-        return T;
+    // Unloading the declarations of a transaction can drop its wrapper.
+    for (auto I = m_WrapperTransactions.rbegin(),
+           E = m_WrapperTransactions.rend(); I != E; ++I)
+      if ((*I)->getWrapperFD())
+        return *I;
     return nullptr;
   }
 
@@ -411,25 +466,41 @@ namespace cling {
   }
 
   void IncrementalParser::addTransaction(Transaction* T) {
-    if (!T->isNestedTransaction() && T != getLastTransaction()) {
+    if (T->isNestedTransaction())
+      return;
+    if (T != getLastTransaction()) {
       if (getLastTransaction())
         m_Transactions.back()->setNext(T);
       m_Transactions.push_back(T);
     }
+    // T might get added again once parsed, by endTransaction().
+    if (T->getWrapperFD() && (m_WrapperTransactions.empty()
+                              || m_WrapperTransactions.back() != T))
+      m_WrapperTransactions.push_back(T);
   }
 
 
   Transaction* IncrementalParser::beginTransaction(const CompilationOptions&
                                                    Opts) {
+    CLING_TRACE_EVENT(kTransactionBegin, "");
     Transaction* OldCurT = m_Consumer->getTransaction();
     Transaction* NewCurT = m_TransactionPool->takeTransaction(m_CI->getSema());
     NewCurT->setCompilationOpts(Opts);
+    m_MemoryMarks[NewCurT]
+      = MemoryMark{getCI()->getASTContext().getASTAllocatedMemory(),
+                   getCI()->getSourceManager().local_sloc_entry_size()};
+    // Lets a rollback skip the declarations that were there before.
+    NewCurT->setDeclCheckpoint(DeclUnloader::getLastDecl(
+        getCI()->getASTContext().getTranslationUnitDecl()));
     // If we are in the middle of transaction and we see another begin
     // transaction - it must be nested transaction.
     if (OldCurT && OldCurT != NewCurT
         && (OldCurT->getState() == Transaction::kCollecting
             || OldCurT->getState() == Transaction::kCompleted)) {
       OldCurT->addNestedTransaction(NewCurT); // takes the ownership
+    } else {
+      // A new input: a cancelCompilation() was meant for an earlier one.
+      m_Interpreter->clearCompilationCancelled();
     }
 
     m_Consumer->setTransaction(NewCurT);
@@ -450,6 +521,7 @@ namespace cling {
 #endif
 
     T->setState(Transaction::kCompleted);
+    recordMemoryStats(T);
 
     DiagnosticsEngine& Diag = getCI()->getSema().getDiagnostics();
 
@@ -491,6 +563,42 @@ namespace cling {
     return std::string("cling-module-") + std::to_string(m_ModuleNo++);
   }
 
+  void IncrementalParser::recordMemoryStats(Transaction* T) {
+    auto IMark = m_MemoryMarks.find(T);
+    if (IMark == m_MemoryMarks.end())
+      return;
+    const MemoryMark Mark = IMark->second;
+    m_MemoryMarks.erase(IMark);
+
+    MemoryStats& Stats = T->getMemoryStats();
+    Stats.ASTBytes
+      = getCI()->getASTContext().getASTAllocatedMemory() - Mark.ASTBytes;
+    // The buffers of the inputs and files entered, each once: a header
+    // included again shares the buffer.
+    const SourceManager& SM = getCI()->getSourceManager();
+    llvm::SmallPtrSet<const SrcMgr::ContentCache*, 4> Buffers;
+    Stats.SourceBytes = 0;
+    for (unsigned I = Mark.SLocEntries, E = SM.local_sloc_entry_size();
+         I < E; ++I) {
+      const SrcMgr::SLocEntry& Entry = SM.getLocalSLocEntry(I);
+      if (!Entry.isFile())
+        continue;
+      const SrcMgr::ContentCache* CC = Entry.getFile().getContentCache();
+      if (CC && Buffers.insert(CC).second)
+        Stats.SourceBytes += CC->getSize();
+    }
+
+    // The nested transactions, which all ended already, have their own.
+    if (!T->hasNestedTransactions())
+      return;
+    for (Transaction::const_nested_iterator I = T->nested_begin(),
+           E = T->nested_end(); I != E; ++I) {
+      const MemoryStats& Nested = (*I)->getMemoryStats();
+      Stats.ASTBytes -= std::min(Stats.ASTBytes, Nested.ASTBytes);
+      Stats.SourceBytes -= std::min(Stats.SourceBytes, Nested.SourceBytes);
+    }
+  }
+
   llvm::Module* IncrementalParser::StartModule() {
     return getCodeGenerator()->StartModule(makeModuleName(),
                                            *m_Interpreter->getLLVMContext(),
@@ -499,6 +607,7 @@ namespace cling {
 
   void IncrementalParser::commitTransaction(ParseResultTransaction& PRT,
                                             bool ClearDiagClient) {
+    CLING_TRACE_SCOPE(Trace, kTransactionCommit, "");
     Transaction* T = PRT.getPointer();
     if (!T) {
       if (PRT.getInt() != kSuccess) {
@@ -529,6 +638,8 @@ namespace cling {
       if (!T->isNestedTransaction() && hasCodeGenerator()) {
         MustStartNewModule = true;
         std::unique_ptr<llvm::Module> M(getCodeGenerator()->ReleaseModule());
+        if (m_CodeGenPipeline)
+          m_CodeGenPipeline->release(nullptr);
 
         if (M) {
           T->setModule(std::move(M));
@@ -624,12 +735,21 @@ namespace cling {
     }
     T->setState(Transaction::kCommitted);
 
+    // The new declarations might change what lookups find.
+    m_Interpreter->getLookupHelper().clearCache();
+    m_Interpreter->clearCompletionCache();
+    m_Interpreter->clearImportSummaryCache();
+    m_Interpreter->clearPrintValueWrappers(*T);
+
     {
       Transaction* prevConsumerT = m_Consumer->getTransaction();
       if (InterpreterCallbacks* callbacks = m_Interpreter->getCallbacks())
         callbacks->TransactionCommitted(*T);
       m_Consumer->setTransaction(prevConsumerT);
     }
+
+    // The session keeps it until it gets unloaded.
+    T->compact();
   }
 
   void IncrementalParser::emitTransaction(Transaction* T) {
@@ -643,6 +763,9 @@ namespace cling {
     assert(T->getState() == Transaction::kCompleted && "Must be completed");
     assert(hasCodeGenerator() && "No CodeGen");
 
+    PhaseTimers::Scope Timer(&m_Timers, TimingStats::kCodeGen, T);
+    CLING_TRACE_SCOPE(Trace, kCodeGen, "");
+
     // Could trigger derserialization of decls.
     Transaction* deserT = beginTransaction(CompilationOptions());
 
@@ -659,6 +782,12 @@ namespace cling {
       if (InterpreterCallbacks* callbacks = m_Interpreter->getCallbacks())
         callbacks->TransactionCodeGenStarted(*T);
 
+      // The CUDA module ctor embeds the fatbin file, which the device
+      // compiler might still be writing.
+      if (IncrementalCUDADeviceCompiler* CUDA
+            = m_Interpreter->getCUDACompiler())
+        CUDA->wait();
+
       // The initializers are emitted to the symbol "_GLOBAL__sub_I_" + filename.
       // Make that unique!
       deserT = beginTransaction(CompilationOptions());
@@ -669,9 +798,18 @@ namespace cling {
       deserT = PRT.getPointer();
 
       std::unique_ptr<llvm::Module> M(getCodeGenerator()->ReleaseModule());
+      if (m_CodeGenPipeline)
+        m_CodeGenPipeline->release(M.get());
+
+      // Ask the JIT to compile the functions upon their first call, see
+      // IncrementalJIT::addModule().
+      if (M && m_Interpreter->getOptions().LazyFunctions)
+        M->addModuleFlag(llvm::Module::Warning, "cling.lazy-functions", 1);
 
-      if (M)
+      if (M) {
+        T->getMemoryStats().IRInstructions = M->getInstructionCount();
         T->setModule(std::move(M));
+      }
 
       if (T->getIssuedDiags() != Transaction::kNone) {
         // Module has been released from Codegen, reset the Diags now.
@@ -688,7 +826,16 @@ namespace cling {
     }
   }
 
+  void IncrementalParser::forgetRuntime() {
+    m_Consumer->ForgetRuntime();
+  }
+
+  void IncrementalParser::transactionUnloading(const Transaction& T) {
+    m_Consumer->TransactionUnloading(T);
+  }
+
   void IncrementalParser::deregisterTransaction(Transaction& T) {
+    m_MemoryMarks.erase(&T);
     if (&T == m_Consumer->getTransaction())
       m_Consumer->setTransaction(T.getParent());
 
@@ -699,6 +846,9 @@ namespace cling {
       if (&T == m_Transactions.back()) {
         // Remove from the queue
         m_Transactions.pop_back();
+        if (!m_WrapperTransactions.empty()
+            && m_WrapperTransactions.back() == &T)
+          m_WrapperTransactions.pop_back();
         if (!m_Transactions.empty())
           m_Transactions.back()->setNext(0);
       } else {
@@ -714,13 +864,8 @@ namespace cling {
   }
 
   std::vector<const Transaction*> IncrementalParser::getAllTransactions() {
-    std::vector<const Transaction*> result(m_Transactions.size());
-    const cling::Transaction* T = getFirstTransaction();
-    while (T) {
-      result.push_back(T);
-      T = T->getNext();
-    }
-    return result;
+    return std::vector<const Transaction*>(m_Transactions.begin(),
+                                           m_Transactions.end());
   }
 
   // Each input line is contained in separate memory buffer. The SourceManager
@@ -760,11 +905,55 @@ namespace cling {
       cling::errs() << "VirtualFileID could not be created.\n";
   }
 
+  IncrementalParser::InputBuffer
+  IncrementalParser::takeInputBuffer(size_t Size) {
+    // The smallest one that fits.
+    auto Best = m_FreeInputBuffers.end();
+    for (auto I = m_FreeInputBuffers.begin(), E = m_FreeInputBuffers.end();
+         I != E; ++I)
+      if (I->Capacity >= Size
+          && (Best == E || I->Capacity < Best->Capacity))
+        Best = I;
+    InputBuffer Result;
+    if (Best != m_FreeInputBuffers.end()) {
+      Result = std::move(*Best);
+      m_FreeInputBuffers.erase(Best);
+      return Result;
+    }
+    // Round up, for the next inputs of about the same size to fit.
+    Result.Capacity = std::max<size_t>(llvm::PowerOf2Ceil(Size), 256);
+    Result.Data.reset(new char[Result.Capacity]);
+    return Result;
+  }
+
+  void IncrementalParser::releaseInputBuffer(FileID FID) {
+    if (FID.isInvalid())
+      return;
+    getCI()->getSourceManager().invalidateCache(FID);
+    auto I = m_InputBuffers.find(FID);
+    if (I == m_InputBuffers.end())
+      return;
+    // The wrappers of the prompt come and go in similar sizes: a few buffers
+    // serve them all.
+    static constexpr size_t kMaxFreeInputBuffers = 16;
+    if (m_FreeInputBuffers.size() < kMaxFreeInputBuffers)
+      m_FreeInputBuffers.push_back(std::move(I->second));
+    m_InputBuffers.erase(I);
+  }
+
   IncrementalParser::ParseResultTransaction
   IncrementalParser::Compile(llvm::StringRef input,
                              const CompilationOptions& Opts) {
+    std::lock_guard<StateLock> Lock(m_Interpreter->getStateLock());
     Transaction* CurT = beginTransaction(Opts);
-    EParseResult ParseRes = ParseInternal(input);
+    // Nested into CurT, the runtime comes and goes with the input needing it.
+    m_Interpreter->declareRuntimeFor(Opts);
+    EParseResult ParseRes;
+    {
+      // CurT might be gone once committed; only time the parsing with it.
+      PhaseTimers::Scope Timer(&m_Timers, TimingStats::kParsing, CurT);
+      ParseRes = ParseInternal(input);
+    }
 
     if (ParseRes == kSuccessWithWarnings)
       CurT->setIssuedDiags(Transaction::kWarnings);
@@ -777,7 +966,155 @@ namespace cling {
     return PRT;
   }
 
+  Transaction* IncrementalParser::CompileBatch(
+      llvm::ArrayRef<std::string> inputs,
+      llvm::ArrayRef<CompilationOptions> Opts,
+      const CompilationOptions& OuterOpts,
+      llvm::SmallVectorImpl<ParseResultTransaction>& Results) {
+    assert(inputs.size() == Opts.size() && "One CompilationOptions per input");
+    std::lock_guard<StateLock> Lock(m_Interpreter->getStateLock());
+    Transaction* OuterT = beginTransaction(OuterOpts);
+    for (size_t I = 0, E = inputs.size(); I != E; ++I) {
+      Transaction* CurT = beginTransaction(Opts[I]);
+      m_Interpreter->declareRuntimeFor(Opts[I]);
+      EParseResult ParseRes;
+      {
+        PhaseTimers::Scope Timer(&m_Timers, TimingStats::kParsing, CurT);
+        ParseRes = ParseInternal(inputs[I]);
+      }
+
+      if (ParseRes == kSuccessWithWarnings)
+        CurT->setIssuedDiags(Transaction::kWarnings);
+      else if (ParseRes == kFailed)
+        CurT->setIssuedDiags(Transaction::kErrors);
+
+      ParseResultTransaction PRT = endTransaction(CurT);
+      if (PRT.getInt() == kFailed) {
+        // Unloads CurT and resets the diagnostics for the next input.
+        commitTransaction(PRT);
+      } else if (PRT.getPointer()) {
+        // Committed along with OuterT.
+        m_Consumer->setTransaction(OuterT);
+      }
+      Results.push_back(PRT);
+    }
+
+    ParseResultTransaction PRT = endTransaction(OuterT);
+    commitTransaction(PRT);
+    // Initializers that failed unloaded OuterT.
+    OuterT = PRT.getPointer();
+    if (OuterT && OuterT->getState() != Transaction::kCommitted)
+      return nullptr;
+    return OuterT;
+  }
+
+  IncrementalParser::ParseResultTransaction
+  IncrementalParser::reparseFunctionBodies(std::vector<ReparsedBody> Bodies,
+                                           const CompilationOptions& Opts) {
+    std::lock_guard<StateLock> Lock(m_Interpreter->getStateLock());
+    Transaction* CurT = beginTransaction(Opts);
+    {
+      PhaseTimers::Scope Timer(&m_Timers, TimingStats::kParsing, CurT);
+      Sema& S = getCI()->getSema();
+      Preprocessor& PP = getCI()->getPreprocessor();
+      SourceManager& SM = getCI()->getSourceManager();
+      DiagnosticErrorTrap Trap(getCI()->getDiagnostics());
+      if (!PP.getCurrentLexer())
+        PP.EnterSourceFile(SM.getMainFileID(), 0, SourceLocation());
+
+      // The parser's callback for the late parsed templates parses a body
+      // for an existing declaration; the parser registers it when reaching
+      // the end of an input while delaying them.
+      if (!S.LateTemplateParser) {
+        LangOptions& LangOpts = getCI()->getLangOpts();
+        const bool Delaying = LangOpts.DelayedTemplateParsing;
+        LangOpts.DelayedTemplateParsing = 1;
+        Parser::DeclGroupPtrTy ADecl;
+        m_Parser->ParseTopLevelDecl(ADecl);
+        LangOpts.DelayedTemplateParsing = Delaying;
+      }
+
+      for (ReparsedBody& Body : Bodies) {
+        FunctionDecl* FD = Body.first;
+        FileID FID = SM.createFileID(std::move(Body.second), SrcMgr::C_User,
+                                     /*LoadedID*/ 0, /*LoadedOffset*/ 0,
+                                     getNextAvailableUniqueSourceLoc());
+        PP.EnterSourceFile(FID, /*DirLookup*/ nullptr, SourceLocation());
+        LateParsedTemplate LPT;
+        LPT.D = FD;
+        Token Tok;
+        for (PP.Lex(Tok); Tok.isNot(tok::eof); PP.Lex(Tok))
+          LPT.Toks.push_back(Tok);
+        if (LPT.Toks.empty() || LPT.Toks.front().isNot(tok::l_brace)) {
+          CurT->setIssuedDiags(Transaction::kErrors);
+          break;
+        }
+        // Not a redefinition: the new body replaces the old one.
+        FD->setWillHaveBody(true);
+        S.LateTemplateParser(S.OpaqueParser, LPT);
+        FD->setWillHaveBody(false);
+        if (Trap.hasErrorOccurred() || !FD->hasBody()) {
+          CurT->setIssuedDiags(Transaction::kErrors);
+          break;
+        }
+        m_Consumer->HandleReloadedDefinition(FD);
+      }
+    }
+
+    ParseResultTransaction PRT = endTransaction(CurT);
+    commitTransaction(PRT);
+    return PRT;
+  }
+
   // Add the input to the memory buffer, parse it, and add it to the AST.
+  void IncrementalParser::enterWrapperHeader(llvm::StringRef Code,
+                                             FileID FID) {
+    // The header that Interpreter::WrapInput() puts in front of the input.
+    static const llvm::StringRef Void = "void ";
+    if (!Code.startswith(Void))
+      return;
+    const size_t NameEnd = Code.find('(');
+    const llvm::StringRef Name = Code.slice(Void.size(), NameEnd);
+    if (!Name.startswith(utils::Synthesize::UniquePrefix)
+        || !Code.substr(NameEnd).startswith(utils::Synthesize::WrapperTail))
+      return;
+
+    Preprocessor& PP = m_CI->getPreprocessor();
+    SourceManager& SM = m_CI->getSourceManager();
+    if (m_WrapperHeader.empty()) {
+      // Up to the '{' of the body; Name is the second token.
+      Lexer RawLex(FID, SM.getBuffer(FID), SM, m_CI->getLangOpts());
+      Token Tok;
+      do {
+        RawLex.LexFromRawLexer(Tok);
+        if (Tok.is(tok::raw_identifier))
+          PP.LookUpIdentifierInfo(Tok);
+        m_WrapperHeader.push_back({Tok, SM.getFileOffset(Tok.getLocation())});
+      } while (Tok.isNot(tok::l_brace));
+      m_WrapperNameSize = Name.size();
+    }
+
+    const SourceLocation Start = SM.getLocForStartOfFile(FID);
+    const int Shift = int(Name.size()) - int(m_WrapperNameSize);
+    const size_t NumToks = m_WrapperHeader.size();
+    auto Toks = llvm::make_unique<Token[]>(NumToks);
+    for (size_t I = 0; I < NumToks; ++I) {
+      const WrapperToken& WT = m_WrapperHeader[I];
+      Toks[I] = WT.Tok;
+      Toks[I].setLocation(Start.getLocWithOffset(WT.Offset
+                                                 + (I > 1 ? Shift : 0)));
+    }
+    Toks[1].setIdentifierInfo(PP.getIdentifierInfo(Name));
+    Toks[1].setLength(Name.size());
+
+    // The buffer is lexed from the end of the '{' on, as it would be.
+    const unsigned BodyStart = int(m_WrapperHeader.back().Offset) + Shift + 1;
+    static_cast<Lexer*>(PP.getCurrentLexer())->seek(BodyStart,
+                                                    /*IsAtStartOfLine*/false);
+    PP.EnterTokenStream(std::move(Toks), NumToks,
+                        /*DisableMacroExpansion*/true, /*IsReinject*/false);
+  }
+
   IncrementalParser::EParseResult
   IncrementalParser::ParseInternal(llvm::StringRef input) {
     if (input.empty()) return IncrementalParser::kSuccess;
@@ -799,17 +1136,28 @@ namespace cling {
     PP.enableIncrementalProcessing();
 
     smallstream source_name;
-    source_name << "input_line_" << (m_MemoryBuffers.size() + 1);
+    source_name << "input_line_" << ++m_NumInputs;
 
-    // Create an uninitialized memory buffer, copy code in and append "\n"
+    // Refer to the caller's input if it is a buffer already; otherwise copy
+    // the code in and append "\n". The lexer reads up to the terminating
+    // zero, which the MemoryBuffer below only asserts.
     size_t InputSize = input.size(); // don't include trailing 0
-    // MemBuffer size should *not* include terminating zero
-    std::unique_ptr<llvm::WritableMemoryBuffer>
-      MB(llvm::WritableMemoryBuffer::getNewUninitMemBuffer(InputSize + 1,
-                                                           source_name.str()));
-    char* MBStart = MB->getBufferStart();
-    memcpy(MBStart, input.data(), InputSize);
-    MBStart[InputSize] = '\n';
+    InputBuffer Storage;
+    llvm::StringRef Code = input;
+    if (!CO.CallerOwnedInput || input.back() != '\n'
+        || input.data()[InputSize] != '\0') {
+      Storage = takeInputBuffer(InputSize + 2);
+      char* Start = Storage.Data.get();
+      memcpy(Start, input.data(), InputSize);
+      Start[InputSize] = '\n';
+      Start[InputSize + 1] = '\0';
+      // MemBuffer size should *not* include terminating zero
+      Code = llvm::StringRef(Start, InputSize + 1);
+    } else
+      --InputSize;
+    std::unique_ptr<llvm::MemoryBuffer>
+      MB(llvm::MemoryBuffer::getMemBuffer(Code, source_name.str(),
+                                          /*RequiresNullTerminator*/ true));
 
     SourceManager& SM = getCI()->getSourceManager();
 
@@ -817,8 +1165,6 @@ namespace cling {
     // candidates for example
     SourceLocation NewLoc = getNextAvailableUniqueSourceLoc();
 
-    llvm::MemoryBuffer* MBNonOwn = MB.get();
-
     // Create FileID for the current buffer.
     FileID FID;
     // Create FileEntry and FileID for the current buffer.
@@ -835,11 +1181,15 @@ namespace cling {
                                 CO.CodeCompletionOffset+1/* 1-based column*/);
     }
 
-    m_MemoryBuffers.push_back(std::make_pair(MBNonOwn, FID));
+    if (Storage.Data)
+      m_InputBuffers[FID] = std::move(Storage);
 
     // NewLoc only used for diags.
     PP.EnterSourceFile(FID, /*DirLookup*/0, NewLoc);
     m_Consumer->getTransaction()->setBufferFID(FID);
+    // The completion point must be reached by lexing the buffer.
+    if (CO.CodeCompletionOffset == -1)
+      enterWrapperHeader(Code, FID);
 
     DiagnosticsEngine& Diags = getCI()->getDiagnostics();
 
@@ -848,20 +1198,46 @@ namespace cling {
     DiagnosticErrorTrap Trap(Diags);
     Sema::SavePendingInstantiationsRAII SavedPendingInstantiations(S);
 
+    // The functions that clang completed get compiled meanwhile, unless
+    // the module is meant for the lazy or the reloadable functions.
+    const bool Pipelined = m_CodeGenPipeline && hasCodeGenerator()
+      && CO.CodeGeneration && !CO.CodeGenerationForModule && !CO.Reloadable
+      && !m_Interpreter->getOptions().LazyFunctions;
+
     Parser::DeclGroupPtrTy ADecl;
     while (!m_Parser->ParseTopLevelDecl(ADecl)) {
+      // Cancelled, the rest of the input is parsed without diagnostics or
+      // instantiations, to leave the lexer at its end.
+      if (m_Interpreter->isCompilationCancelled())
+        reportCancelled(Diags);
       // If we got a null return and something *was* parsed, ignore it.  This
       // is due to a top-level semicolon, an action override, or a parse error
       // skipping something.
       if (Trap.hasErrorOccurred())
         m_Consumer->getTransaction()->setIssuedDiags(Transaction::kErrors);
-      if (ADecl)
+      if (ADecl) {
         m_Consumer->HandleTopLevelDecl(ADecl.get());
+        if (Pipelined && !Trap.hasErrorOccurred())
+          if (const llvm::Module* M = getCodeGenerator()->GetModule())
+            m_CodeGenPipeline->collect(*M, CO.OptLevel);
+      }
     };
     // If never entered the while block, there's a chance an error occured
     if (Trap.hasErrorOccurred())
       m_Consumer->getTransaction()->setIssuedDiags(Transaction::kErrors);
 
+    // The parser makes Sema call it for the deferred bodies when it reaches
+    // the end of an input while delaying them, i.e. not unless the input
+    // ends in a deferred header: parse the end once more while delaying.
+    if (m_DeferBodies && !S.LateTemplateParser
+        && !S.LateParsedTemplateMap.empty()) {
+      LangOptions& LangOpts = getCI()->getLangOpts();
+      const bool Delaying = LangOpts.DelayedTemplateParsing;
+      LangOpts.DelayedTemplateParsing = 1;
+      m_Parser->ParseTopLevelDecl(ADecl);
+      LangOpts.DelayedTemplateParsing = Delaying;
+    }
+
     if (CO.CodeCompletionOffset != -1) {
       assert((int)SM.getFileOffset(PP.getCodeCompletionLoc())
              == CO.CodeCompletionOffset
@@ -922,29 +1298,34 @@ namespace cling {
     // Register the AST Transformers
     typedef std::unique_ptr<ASTTransformer> ASTTPtr_t;
     std::vector<ASTTPtr_t> ASTTransformers;
-    ASTTransformers.emplace_back(new AutoSynthesizer(TheSema));
     ASTTransformers.emplace_back(new EvaluateTSynthesizer(TheSema));
     if (hasCodeGenerator() && !m_Interpreter->getOptions().NoRuntime) {
       // Don't protect against crashes if we cannot run anything.
       // cling might also be in a PCH-generation mode; don't inject our Sema
       // pointer into the PCH.
-      if (!isCUDADevice)
+      if (!isCUDADevice) {
         ASTTransformers.emplace_back(
             new NullDerefProtectionTransformer(m_Interpreter));
-      else
+        ASTTransformers.emplace_back(
+            new SafePointTransformer(*TheSema, *m_Interpreter));
+      } else {
         ASTTransformers.emplace_back(
             new DeviceKernelInliner(TheSema));
+      }
     }
     ASTTransformers.emplace_back(new DefinitionShadower(*TheSema, *m_Interpreter));
 
     typedef std::unique_ptr<WrapperTransformer> WTPtr_t;
     std::vector<WTPtr_t> WrapperTransformers;
+    // Only the prompt introduces implicit `auto` variables; declared bodies
+    // need not be walked for them.
+    WrapperTransformers.emplace_back(new AutoSynthesizer(TheSema));
     if (!m_Interpreter->getOptions().NoRuntime && !isCUDADevice)
       WrapperTransformers.emplace_back(new ValuePrinterSynthesizer(TheSema));
     WrapperTransformers.emplace_back(new DeclExtractor(TheSema));
     if (!m_Interpreter->getOptions().NoRuntime && !isCUDADevice)
       WrapperTransformers.emplace_back(new ValueExtractionSynthesizer(TheSema,
-                                                           isChildInterpreter));
+                                         *m_Interpreter, isChildInterpreter));
     WrapperTransformers.emplace_back(new CheckEmptyTransactionTransformer(TheSema));
 
     m_Consumer->SetTransformers(std::move(ASTTransformers),
@@ -10,14 +10,21 @@
 #ifndef CLING_INCREMENTAL_PARSER_H
 #define CLING_INCREMENTAL_PARSER_H
 
+#include "PhaseTimers.h"
+
 #include "clang/Basic/SourceLocation.h"
+#include "clang/Lex/Token.h"
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/PointerIntPair.h"
+#include "llvm/ADT/iterator_range.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 
 #include <vector>
 #include <deque>
+#include <map>
 #include <memory>
 
 namespace llvm {
@@ -33,11 +40,13 @@ namespace clang {
   class DiagnosticConsumer;
   class Decl;
   class FileID;
+  class FunctionDecl;
   class ModuleFileExtension;
   class Parser;
 }
 
 namespace cling {
+  class CodeGenPipeline;
   class CompilationOptions;
   class DeclCollector;
   class ExecutionContext;
@@ -45,6 +54,9 @@ namespace cling {
   class Transaction;
   class TransactionPool;
   class ASTTransformer;
+  namespace utils {
+    class StructuredDiagnostics;
+  }
 
   ///\brief Responsible for the incremental parsing and compilation of input.
   ///
@@ -58,15 +70,49 @@ namespace cling {
     // FIXME: Get rid of that back reference to the interpreter.
     Interpreter* m_Interpreter;
 
+    ///\brief The storage of an input's buffer, which the SourceManager only
+    /// refers to.
+    struct InputBuffer {
+      std::unique_ptr<char[]> Data;
+      size_t Capacity = 0;
+    };
+
+    ///\brief The buffers of the inputs, until their transaction releases
+    /// them; declared before m_CI to outlive its SourceManager.
+    std::map<clang::FileID, InputBuffer> m_InputBuffers;
+
+    ///\brief Released buffers, to be reused by the next inputs.
+    std::vector<InputBuffer> m_FreeInputBuffers;
+
+    ///\brief Number of inputs parsed, naming their buffers.
+    unsigned m_NumInputs = 0;
+
+    ///\brief A token of the header of the wrapper functions, as lexed in
+    /// the first input with a wrapper, see enterWrapperHeader().
+    struct WrapperToken {
+      clang::Token Tok;
+      ///\brief Its offset in the input.
+      unsigned Offset;
+    };
+    std::vector<WrapperToken> m_WrapperHeader;
+    ///\brief The size of the name of the first wrapper, which the offsets of
+    /// the tokens that follow it include.
+    unsigned m_WrapperNameSize = 0;
+
+    ///\brief Whether the function template bodies of some headers are
+    /// parsed on instantiation only, see DeferredBodies.
+    bool m_DeferBodies = false;
+
+    ///\brief Compiles the functions of the inputs as they get parsed; null
+    /// if disabled or without an executor.
+    CodeGenPipeline* m_CodeGenPipeline = nullptr;
+
     // compiler instance.
     std::unique_ptr<clang::CompilerInstance> m_CI;
 
     // parser (incremental)
     std::unique_ptr<clang::Parser> m_Parser;
 
-    // One buffer for each command line, owner by the source file manager
-    std::deque<std::pair<llvm::MemoryBuffer*, clang::FileID>> m_MemoryBuffers;
-
     // file ID of the memory buffer
     clang::FileID m_VirtualFileID;
 
@@ -84,6 +130,11 @@ namespace cling {
     ///
     std::deque<Transaction*> m_Transactions;
 
+    ///\brief The transactions of m_Transactions that have an input line
+    /// wrapper, in the same order, for getLastWrapperTransaction().
+    ///
+    std::vector<const Transaction*> m_WrapperTransactions;
+
     ///\brief Number of created modules.
     unsigned m_ModuleNo = 0;
 
@@ -91,7 +142,7 @@ namespace cling {
     ///
     clang::CodeGenerator* m_CodeGen = nullptr;
 
-    ///\brief Pool of reusable block-allocated transactions.
+    ///\brief Pool of reusable transactions.
     ///
     std::unique_ptr<TransactionPool> m_TransactionPool;
 
@@ -99,6 +150,23 @@ namespace cling {
     ///
     std::unique_ptr<clang::DiagnosticConsumer> m_DiagConsumer;
 
+    ///\brief The client of the DiagnosticsEngine, which owns it, with
+    /// InvocationOptions::StructuredDiagnostics.
+    ///
+    utils::StructuredDiagnostics* m_StructuredDiags = nullptr;
+
+    ///\brief Time spent in the stages of incremental compilation.
+    ///
+    PhaseTimers m_Timers;
+
+    ///\brief What the ASTContext had allocated and how many entries the
+    /// SourceManager had when a transaction began, until it ends.
+    struct MemoryMark {
+      size_t ASTBytes;
+      unsigned SLocEntries;
+    };
+    llvm::DenseMap<const Transaction*, MemoryMark> m_MemoryMarks;
+
     using ModuleFileExtensions =
         std::vector<std::shared_ptr<clang::ModuleFileExtension>>;
 
@@ -127,6 +195,18 @@ namespace cling {
     clang::CodeGenerator* getCodeGenerator() const { return m_CodeGen; }
     bool hasCodeGenerator() const { return m_CodeGen; }
 
+    utils::StructuredDiagnostics* getStructuredDiagnostics() const {
+      return m_StructuredDiags;
+    }
+    PhaseTimers& getPhaseTimers() { return m_Timers; }
+    void setCodeGenPipeline(CodeGenPipeline* Pipeline) {
+      m_CodeGenPipeline = Pipeline;
+    }
+    const TransactionPool* getTransactionPool() const {
+      return m_TransactionPool.get();
+    }
+    TransactionPool* getTransactionPool() { return m_TransactionPool.get(); }
+
     /// Returns the next available unique source location. It is an offset into
     /// the limitless virtual file. Each time this interface is used it bumps
     /// an internal counter. This is very useful for using the various API in
@@ -166,6 +246,21 @@ namespace cling {
     ///
     void deregisterTransaction(Transaction& T);
 
+    ///\brief The lazily declared parts of the runtime universe got unloaded;
+    /// see Interpreter::declareRuntimeFor().
+    ///
+    void forgetRuntime();
+
+    ///\brief T is about to be unloaded; tells the AST transformers.
+    ///
+    void transactionUnloading(const Transaction& T);
+
+    ///\brief Drops the source buffer FID of a transaction that is unloaded
+    /// or does not need its source anymore, and keeps its memory for the
+    /// next inputs. Diagnostics cannot quote it afterwards.
+    ///
+    void releaseInputBuffer(clang::FileID FID);
+
     ///\brief Returns the first transaction the incremental parser saw.
     ///
     const Transaction* getFirstTransaction() const {
@@ -203,9 +298,24 @@ namespace cling {
     ///\brief Add a user-generated transaction.
     void addTransaction(Transaction* T);
 
+    using const_transaction_iterator = std::deque<Transaction*>::const_iterator;
+    using const_transaction_range
+      = llvm::iterator_range<const_transaction_iterator>;
+
+    ///\brief The top-level transactions seen by the interpreter, from the
+    /// first to the last, without copying them.
+    ///
+    const_transaction_range transactions() const {
+      return llvm::make_range(m_Transactions.begin(), m_Transactions.end());
+    }
+
+    ///\brief The number of top-level transactions seen by the interpreter.
+    ///
+    size_t getNumTransactions() const { return m_Transactions.size(); }
+
     ///\brief Returns the list of transactions seen by the interpreter.
     /// Intentionally makes a copy - that function is meant to be use for debug
-    /// purposes.
+    /// purposes; see transactions() otherwise.
     ///
     std::vector<const Transaction*> getAllTransactions();
 
@@ -219,6 +329,46 @@ namespace cling {
     ///
     ParseResultTransaction Compile(llvm::StringRef input, const CompilationOptions& Opts);
 
+    ///\brief Compiles several inputs together: each is parsed into a
+    /// transaction of its own, nested into one outer transaction that is
+    /// committed as a whole, such that all inputs end up in one llvm::Module
+    /// and their static initializers run in one go.
+    ///
+    /// An input that fails to parse is unloaded right away and does not
+    /// affect the others.
+    ///
+    ///\param[in] inputs - The code to compile.
+    ///\param[in] Opts - The compilation options of each input.
+    ///\param[in] OuterOpts - The compilation options of the outer
+    ///            transaction.
+    ///\param[out] Results - The transaction and parse result of each input;
+    ///            valid only if the outer transaction got committed.
+    ///\returns the outer transaction; null if it is empty or got unloaded.
+    ///
+    Transaction*
+    CompileBatch(llvm::ArrayRef<std::string> inputs,
+                 llvm::ArrayRef<CompilationOptions> Opts,
+                 const CompilationOptions& OuterOpts,
+                 llvm::SmallVectorImpl<ParseResultTransaction>& Results);
+
+    ///\brief A function definition and the buffer holding its new body,
+    /// from its '{' to its '}'.
+    typedef std::pair<clang::FunctionDecl*, std::unique_ptr<llvm::MemoryBuffer>>
+      ReparsedBody;
+
+    ///\brief Parses the bodies of function definitions anew, replacing
+    /// those of the declarations, and codegens these into one transaction,
+    /// which gets committed. The declarations stay with the transactions
+    /// that declared them.
+    ///
+    ///\param[in] Bodies - The definitions and their bodies.
+    ///\param[in] Opts - The compilation options of the transaction.
+    ///\returns the transaction and parse result.
+    ///
+    ParseResultTransaction
+    reparseFunctionBodies(std::vector<ReparsedBody> Bodies,
+                          const CompilationOptions& Opts);
+
     void printTransactionStructure() const;
 
     ///\brief Runs the static initializers created by codegening a transaction.
@@ -249,10 +399,27 @@ namespace cling {
     ///
     EParseResult ParseInternal(llvm::StringRef input);
 
+    ///\brief Has the wrapper header that the input Code of FID starts with,
+    /// if any, come from the tokens of m_WrapperHeader rather than from the
+    /// buffer, whose lexer then starts with the body. FID must be the file
+    /// just entered.
+    ///
+    void enterWrapperHeader(llvm::StringRef Code, clang::FileID FID);
+
+    ///\brief Storage for an input of Size bytes: a released one if one is
+    /// large enough.
+    ///
+    InputBuffer takeInputBuffer(size_t Size);
+
     ///\brief Create a unique name for the next llvm::Module
     ///
     std::string makeModuleName();
 
+    ///\brief Sets the AST and source figures of Transaction::
+    /// getMemoryStats(), from what got allocated since T began.
+    ///
+    void recordMemoryStats(Transaction* T);
+
     ///\brief Create a new llvm::Module
     ///
     llvm::Module* StartModule();
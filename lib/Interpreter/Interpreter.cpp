@@ -12,16 +12,32 @@
 #ifdef _WIN32
 #include "cling/Utils/Platform.h"
 #endif
+#include "AsyncEvaluator.h"
+#include "AutoloadIndex.h"
+#include "CellCache.h"
 #include "ClingUtils.h"
+#include "CompletionCache.h"
+#include "DeclUnloader.h"
 
 #include "DynamicLookup.h"
 #include "EnterUserCodeRAII.h"
 #include "ExternalInterpreterSource.h"
+#include "FilePrefetcher.h"
 #include "ForwardDeclPrinter.h"
+#include "HeaderPCHCache.h"
+#include "HotReload.h"
 #include "IncrementalExecutor.h"
 #include "IncrementalParser.h"
+#include "ModuleImportCallback.h"
 #include "MultiplexInterpreterCallbacks.h"
+#include "PhaseTimers.h"
+#include "ScriptLibraryCache.h"
+#include "SessionExporter.h"
+#include "SessionJournal.h"
+#include "StateLock.h"
+#include "TransactionPool.h"
 #include "TransactionUnloader.h"
+#include "ValuePool.h"
 
 #include "cling/Interpreter/AutoloadCallback.h"
 #include "cling/Interpreter/CIFactory.h"
@@ -31,23 +47,32 @@
 #include "cling/Interpreter/DynamicExprInfo.h"
 #include "cling/Interpreter/DynamicLibraryManager.h"
 #include "cling/Interpreter/Exception.h"
+#include "cling/Interpreter/ExecutionLimits.h"
+#include "cling/Interpreter/HeapReport.h"
 #include "cling/Interpreter/IncrementalCUDADeviceCompiler.h"
 #include "cling/Interpreter/LookupHelper.h"
+#include "cling/Interpreter/MemoryReport.h"
+#include "cling/Interpreter/ProfileReport.h"
+#include "cling/Interpreter/TimingStats.h"
 #include "cling/Interpreter/Transaction.h"
 #include "cling/Interpreter/Value.h"
 #include "cling/Interpreter/Visibility.h"
 #include "cling/Utils/AST.h"
 #include "cling/Utils/Casting.h"
+#include "cling/Utils/Diagnostics.h"
 #include "cling/Utils/Output.h"
 #include "cling/Utils/SourceNormalization.h"
 
 #include "clang/AST/ASTContext.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/AST/DeclTemplate.h"
 #include "clang/AST/GlobalDecl.h"
 #include "clang/Basic/SourceManager.h"
 #include "clang/Basic/TargetInfo.h"
 #include "clang/CodeGen/ModuleBuilder.h"
 #include "clang/Frontend/ASTConsumers.h"
 #include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendActions.h"
 #include "clang/Frontend/Utils.h"
 #include "clang/Lex/ExternalPreprocessorSource.h"
 #include "clang/Lex/HeaderSearch.h"
@@ -57,14 +82,33 @@
 #include "clang/Sema/Sema.h"
 #include "clang/Sema/SemaDiagnostic.h"
 
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
-
+#include "llvm/Support/TimeProfiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
 using namespace clang;
 
 namespace {
@@ -76,6 +120,31 @@ namespace {
     return 0;
   }
 
+  ///\brief Text without the $clingAutoload$ annotations: a declaration
+  /// reached from several headers is annotated with each of their include
+  /// chains, yet must be declared once.
+  static std::string withoutAutoloadAnnotations(llvm::StringRef Text) {
+    static const llvm::StringRef Begin
+      = " __attribute__((annotate(\"$clingAutoload$";
+    static const llvm::StringRef End = "\")))";
+    std::string Result;
+    for (size_t Pos = Text.find(Begin); Pos != llvm::StringRef::npos;
+         Pos = Text.find(Begin)) {
+      size_t EndPos = Text.find(End, Pos + Begin.size());
+      if (EndPos == llvm::StringRef::npos)
+        break;
+      Result += Text.substr(0, Pos);
+      Text = Text.substr(EndPos + End.size());
+    }
+    return Result + Text.str();
+  }
+
+  ///\brief The explicit instantiation definition of the class template
+  /// specialization Class, e.g. "std::vector<int>".
+  static std::string makeExplicitInstantiation(llvm::StringRef Class) {
+    return "template class " + Class.str() + ";\n";
+  }
+
   static cling::Interpreter::ExecutionResult
   ConvertExecutionResult(cling::IncrementalExecutor::ExecutionResult ExeRes) {
     switch (ExeRes) {
@@ -85,6 +154,8 @@ namespace {
       return cling::Interpreter::kExeFunctionNotCompiled;
     case cling::IncrementalExecutor::kExeUnresolvedSymbols:
       return cling::Interpreter::kExeUnresolvedSymbols;
+    case cling::IncrementalExecutor::kExeCancelled:
+      return cling::Interpreter::kExeCompilationError;
     default: break;
     }
     return cling::Interpreter::kExeSuccess;
@@ -99,11 +170,29 @@ namespace cling {
     CO.ResultEvaluation = 0;
     CO.DynamicScoping = 0;
 
+    m_Interpreter->getStateLock().lock();
     m_Transaction = m_Interpreter->m_IncrParser->beginTransaction(CO);
   }
 
   Interpreter::PushTransactionRAII::~PushTransactionRAII() {
     pop();
+    m_Interpreter->getStateLock().unlock();
+  }
+
+  struct Interpreter::RunningCodeRAII::Impl {
+    IncrementalExecutor::RunningCodeRAII Running;
+    Impl(const IncrementalExecutor& Exe): Running(Exe) {}
+  };
+
+  Interpreter::RunningCodeRAII::RunningCodeRAII(const Interpreter& I) {
+    if (I.m_Executor)
+      m_Impl.reset(new Impl(*I.m_Executor));
+  }
+
+  Interpreter::RunningCodeRAII::~RunningCodeRAII() {}
+
+  Interpreter* Interpreter::getCurrent() {
+    return IncrementalExecutor::getRunningInterpreter();
   }
 
   void Interpreter::PushTransactionRAII::pop() const {
@@ -160,6 +249,10 @@ namespace cling {
       == clang::frontend::ParseSyntaxOnly;
   }
 
+  bool Interpreter::isExecutorRemote() const {
+    return m_Executor && m_Executor->isRemote();
+  }
+
   bool Interpreter::isValid() const {
     // Should we also check m_IncrParser->getFirstTransaction() ?
     // not much can be done without it (its the initializing transaction)
@@ -183,18 +276,19 @@ namespace cling {
     return Opts.ShowVersion || Opts.Help;
   }
 
-  static void setupCallbacks(Interpreter& Interp,
-                             const Interpreter* parentInterp) {
+  static AutoloadCallback* setupCallbacks(Interpreter& Interp,
+                                          const Interpreter* parentInterp) {
     // We need InterpreterCallbacks only if it is a parent Interpreter.
-    if (parentInterp) return;
+    if (parentInterp) return nullptr;
 
     // Disable suggestions for ROOT
     bool showSuggestions =
         !llvm::StringRef(ClingStringify(CLING_VERSION)).startswith("ROOT");
 
-    std::unique_ptr<InterpreterCallbacks> AutoLoadCB(
-        new AutoloadCallback(&Interp, showSuggestions));
-    Interp.setCallbacks(std::move(AutoLoadCB));
+    AutoloadCallback* AutoLoadCB
+      = new AutoloadCallback(&Interp, showSuggestions);
+    Interp.setCallbacks(std::unique_ptr<InterpreterCallbacks>(AutoLoadCB));
+    return AutoLoadCB;
   }
 
   Interpreter::Interpreter(int argc, const char* const *argv,
@@ -205,12 +299,34 @@ namespace cling {
     m_UniqueCounter(parentInterp ? parentInterp->m_UniqueCounter + 1 : 0),
     m_PrintDebug(false), m_DynamicLookupDeclared(false),
     m_DynamicLookupEnabled(false), m_RawInputEnabled(false),
+    m_OwnsTimeTrace(false),
     m_RuntimeOptions{},
-    m_OptLevel(parentInterp ? parentInterp->m_OptLevel : -1) {
+    m_OptLevel(parentInterp ? parentInterp->m_OptLevel : -1),
+    m_AutoOptLevel(parentInterp && parentInterp->m_AutoOptLevel),
+    m_CompileBudgetMs(parentInterp ? parentInterp->m_CompileBudgetMs
+                                   : m_Opts.CompileBudgetMs),
+    m_AutoloadCallback(nullptr) {
+
+    m_StateLock.reset(new StateLock());
+    m_AsyncEvaluator.reset(new AsyncEvaluator(*this));
+    m_ValuePool = new ValuePool();
 
     if (handleSimpleOptions(m_Opts))
       return;
 
+    // Before anything is timed; clang's frontend then records its sections,
+    // e.g. of parsing and instantiating, too.
+    if (!parentInterp && !m_Opts.TimeTraceFile.empty()
+        && !llvm::timeTraceProfilerEnabled()) {
+      llvm::timeTraceProfilerInitialize();
+      m_OwnsTimeTrace = true;
+    }
+    llvm::TimeTraceScope TimeScope("Startup", llvm::StringRef());
+
+    // Before creating the CompilerInstance, which might use the cached PCH.
+    if (!parentInterp && m_Opts.SnapshotFile.empty())
+      m_HeaderPCHCache = HeaderPCHCache::createFromEnv(m_Opts);
+
     m_LLVMContext.reset(new llvm::LLVMContext);
     m_IncrParser.reset(new IncrementalParser(this, llvmdir, moduleExtensions));
     if (!m_IncrParser->isValid(false))
@@ -257,11 +373,18 @@ namespace cling {
       return;
 
     if (!isInSyntaxOnlyMode()) {
-      m_Executor.reset(new IncrementalExecutor(SemaRef.Diags, *getCI()));
+      m_Executor.reset(new IncrementalExecutor(*this, SemaRef.Diags, *getCI(),
+                                               !m_Opts.CompilerOpts.TargetCPU));
 
       if (!m_Executor)
         return;
 
+      m_Executor->setPhaseTimers(&m_IncrParser->getPhaseTimers());
+      m_IncrParser->setCodeGenPipeline(m_Executor->getCodeGenPipeline());
+      m_Executor->setCancellationCheck([this] {
+        return isCompilationCancelled();
+      });
+
       for (const std::string &P : m_Opts.LibSearchPath)
         getDynamicLibraryManager()->addSearchPath(P);
     }
@@ -277,7 +400,12 @@ namespace cling {
       // we can't setup the calls now because the clang PCH currently just
       // overwrites it in the Initialize method and we have no simple way to
       // initialize them earlier. We handle the non-modules case below.
-      setupCallbacks(*this, parentInterp);
+      m_AutoloadCallback = setupCallbacks(*this, parentInterp);
+
+      // Import the modules upon the lookup of what they declare.
+      if (!parentInterp && ::getenv("CLING_LAZY_MODULE_IMPORT"))
+        if (auto ImportCB = ModuleImportCallback::create(*this))
+          setCallbacks(std::move(ImportCB));
     }
 
     if(m_Opts.CompilerOpts.CUDAHost){
@@ -288,6 +416,9 @@ namespace cling {
        }
     }
 
+    if (getCI()->getLangOpts().OpenMP && !isInSyntaxOnlyMode())
+      loadOpenMPRuntime();
+
     llvm::SmallVector<IncrementalParser::ParseResultTransaction, 2>
       IncrParserTransactions;
     if (!m_IncrParser->Initialize(IncrParserTransactions, parentInterp)) {
@@ -303,7 +434,7 @@ namespace cling {
     // our callbacks without fearing that they get overwritten by clang code.
     // The modules setup is handled above.
     if (!usingCxxModules) {
-      setupCallbacks(*this, parentInterp);
+      m_AutoloadCallback = setupCallbacks(*this, parentInterp);
     }
 
     llvm::SmallVector<llvm::StringRef, 6> Syms;
@@ -332,8 +463,27 @@ namespace cling {
       }
     }
 
+    m_LastStartupTransaction = getLastTransaction();
+
     m_IncrParser->SetTransformers(parentInterp);
 
+    if (m_HeaderPCHCache)
+      m_HeaderPCHCache->setLastTransaction(getLastTransaction());
+
+    if (!m_Opts.SnapshotFile.empty() && !parentInterp) {
+      // If the snapshot was loaded as PCH, the prelude is already in the AST.
+      if (getCI()->getPreprocessorOpts().ImplicitPCHInclude
+          != m_Opts.SnapshotFile) {
+        for (const std::string& Header : m_Opts.SnapshotPrelude)
+          declare("#include \"" + Header + "\"");
+        for (const std::string& Class : m_Opts.SnapshotInstantiations)
+          declare(makeExplicitInstantiation(Class));
+        if (!isInSyntaxOnlyMode())
+          writeSnapshot(m_Opts.SnapshotFile, m_Opts.SnapshotPrelude,
+                        m_Opts.SnapshotInstantiations);
+      }
+    }
+
     if (!m_LLVMContext) {
       // Never true, but don't tell the compiler.
       // Force symbols needed by runtime to be included in binaries.
@@ -342,6 +492,208 @@ namespace cling {
     }
   }
 
+  bool Interpreter::writeSnapshot(const std::string& File,
+                       const std::vector<std::string>& Headers,
+                       const std::vector<std::string>& Instantiations) const {
+    // Precompile what Initialize() parses, in a separate compiler instance:
+    // the PCH writer needs a fresh AST, not one with incremental state.
+    auto Invocation
+      = std::make_shared<CompilerInvocation>(getCI()->getInvocation());
+    Invocation->getPreprocessorOpts().ImplicitPCHInclude.clear();
+
+    std::string Source = "#include <new>\n";
+    if (!m_Opts.NoRuntime)
+      Source += "#include \"cling/Interpreter/RuntimeUniverse.h\"\n"
+                "#include \"cling/Interpreter/ValueRuntimeUniverse.h\"\n"
+                "#include \"cling/Interpreter/NullDerefRuntimeUniverse.h\"\n"
+                "#include \"cling/Interpreter/RuntimePrintValue.h\"\n";
+    for (const std::string& Header : Headers)
+      Source += "#include \"" + Header + "\"\n";
+    // The PCH keeps the instantiated members, and the explicit instantiation
+    // definitions are handed to the CodeGen of the sessions loading it: their
+    // code is the same in each, which CLING_OBJECT_CACHE can then skip
+    // compiling.
+    for (const std::string& Class : Instantiations)
+      Source += makeExplicitInstantiation(Class);
+    std::unique_ptr<llvm::MemoryBuffer> Buffer
+      = llvm::MemoryBuffer::getMemBufferCopy(Source, "<cling snapshot>");
+
+    FrontendOptions& FrontendOpts = Invocation->getFrontendOpts();
+    FrontendOpts.Inputs.clear();
+    FrontendOpts.Inputs.push_back(
+        FrontendInputFile(Buffer.get(), InputKind(InputKind::CXX)));
+    FrontendOpts.OutputFile = File;
+    FrontendOpts.ProgramAction = frontend::GeneratePCH;
+
+    llvm::StringRef Dir = llvm::sys::path::parent_path(File);
+    if (!Dir.empty())
+      llvm::sys::fs::create_directories(Dir);
+
+    CompilerInstance Clang;
+    Clang.setInvocation(std::move(Invocation));
+    Clang.createDiagnostics();
+    GeneratePCHAction Action;
+    if (!Clang.ExecuteAction(Action)) {
+      cling::errs() << "Error: cannot write the snapshot " << File << '\n';
+      llvm::sys::fs::remove(File);
+      return false;
+    }
+    return true;
+  }
+
+  bool Interpreter::exportSession(llvm::StringRef Path, int OptLevel) {
+    if (!m_Executor) {
+      cling::errs() << "cling::Interpreter::exportSession: there is no code "
+                       "to export without a JIT\n";
+      return false;
+    }
+    // The modules of the transactions are needed, not the JIT's objects.
+    m_Executor->emitAllModules();
+
+    SessionExporter Exporter(*this, OptLevel < 0 ? getDefaultOptLevel()
+                                                 : OptLevel);
+    const Transaction* T = m_LastStartupTransaction
+                             ? m_LastStartupTransaction->getNext()
+                             : getFirstTransaction();
+    for (; T; T = T->getNext())
+      Exporter.add(*T);
+    return Exporter.write(Path);
+  }
+
+  bool Interpreter::exportPackage(const Transaction& T, llvm::raw_ostream& OS,
+                                  int OptLevel) {
+    if (!m_Executor) {
+      cling::errs() << "cling::Interpreter::exportPackage: there is no code "
+                       "to export without a JIT\n";
+      return false;
+    }
+    m_Executor->emitAllModules();
+
+    SessionExporter Exporter(*this, OptLevel < 0 ? getDefaultOptLevel()
+                                                 : OptLevel);
+    Exporter.add(T);
+    return Exporter.writePackage(OS);
+  }
+
+  bool Interpreter::warmCaches(const std::vector<std::string>& Files) {
+    if (!m_Executor) {
+      cling::errs() << "cling::Interpreter::warmCaches: there is no code to "
+                       "compile without a JIT\n";
+      return false;
+    }
+    DynamicLibraryManager* DLM = getDynamicLibraryManager();
+    m_Executor->setCompileOnly(true);
+    bool Success = true;
+    for (const std::string& File : Files) {
+      const std::string Path = lookupFileOrLibrary(File);
+      if (DLM && !Path.empty()
+          && DynamicLibraryManager::isSharedLibrary(Path)) {
+        DLM->addSearchPath(llvm::sys::path::parent_path(Path));
+        continue;
+      }
+      if (loadFile(File, /*allowSharedLib=*/false) != kSuccess) {
+        cling::errs() << "cling::Interpreter::warmCaches: cannot compile '"
+                      << File << "'\n";
+        Success = false;
+      }
+    }
+    // Compiles what waits to be looked up: the objects go to the cache.
+    m_Executor->emitAllModules();
+    m_Executor->setCompileOnly(false);
+
+    // No library has this one: all of those on the path get indexed.
+    if (DLM)
+      DLM->searchLibrariesForSymbol("__cling_warm_caches_no_such_symbol");
+    return Success;
+  }
+
+  static SessionJournal& getJournal(std::unique_ptr<SessionJournal>& Journal,
+                                    IncrementalExecutor* Executor) {
+    if (!Journal) {
+      Journal.reset(new SessionJournal());
+      if (Executor)
+        Executor->setJournal(Journal.get());
+    }
+    return *Journal;
+  }
+
+  bool Interpreter::startJournal(llvm::StringRef File) {
+    return getJournal(m_Journal, m_Executor.get()).startRecording(File);
+  }
+
+  void Interpreter::stopJournal() {
+    if (m_Journal)
+      m_Journal->stopRecording();
+  }
+
+  Interpreter::CompilationResult
+  Interpreter::restoreJournal(llvm::StringRef File, bool DeclarationsOnly) {
+    return getJournal(m_Journal, m_Executor.get()).restore(*this, File,
+                                                         DeclarationsOnly);
+  }
+
+  Interpreter::CompilationResult Interpreter::runDeferredJournalInputs() {
+    return m_Journal ? m_Journal->runDeferred(*this) : kSuccess;
+  }
+
+  size_t Interpreter::getNumDeferredJournalInputs() const {
+    return m_Journal ? m_Journal->getNumDeferred() : 0;
+  }
+
+  size_t Interpreter::getNumReplayedJournalModules(size_t* Reused) const {
+    if (Reused)
+      *Reused = m_Journal ? m_Journal->getNumReusedObjects() : 0;
+    return m_Journal ? m_Journal->getNumReplayedModules() : 0;
+  }
+
+  void Interpreter::enableOptimizationRemarks(bool Enable) {
+    BackendPasses* Passes
+      = m_Executor ? m_Executor->getBackendPasses() : nullptr;
+    if (!Passes)
+      return;
+    Passes->collectRemarks(Enable);
+    // Without locations, the remarks could only name the functions.
+    clang::CodeGenOptions& CGO = getCI()->getCodeGenOpts();
+    if (Enable && CGO.getDebugInfo() == clang::codegenoptions::NoDebugInfo)
+      CGO.setDebugInfo(clang::codegenoptions::LocTrackingOnly);
+    else if (!Enable
+             && CGO.getDebugInfo() == clang::codegenoptions::LocTrackingOnly)
+      CGO.setDebugInfo(clang::codegenoptions::NoDebugInfo);
+  }
+
+  bool Interpreter::isCollectingOptimizationRemarks() const {
+    return m_Executor && m_Executor->getBackendPasses()
+      && m_Executor->getBackendPasses()->isCollectingRemarks();
+  }
+
+  size_t Interpreter::printOptimizationRemarks(llvm::raw_ostream& Out,
+                                               bool Passed, bool Missed) {
+    if (!isCollectingOptimizationRemarks())
+      return 0;
+    // The code waiting to be coalesced is not optimized yet.
+    m_Executor->emitAllModules();
+    unsigned Kinds = 0;
+    if (Passed)
+      Kinds |= BackendPasses::kPassedRemarks;
+    if (Missed)
+      Kinds |= BackendPasses::kMissedRemarks | BackendPasses::kAnalysisRemarks;
+    return m_Executor->getBackendPasses()->printRemarks(Out, Kinds);
+  }
+
+  bool Interpreter::enableProfileInstrumentation(bool Enable) {
+    if (!m_Executor || !m_Executor->getBackendPasses())
+      return !Enable;
+    return m_Executor->enableProfileInstrumentation(Enable);
+  }
+
+  bool Interpreter::isInstrumentingForProfile() const {
+    return m_Executor && m_Executor->isInstrumentingForProfile();
+  }
+
+  unsigned Interpreter::optimizeWithProfile() {
+    return m_Executor ? m_Executor->optimizeWithProfile() : 0;
+  }
+
   ///\brief Constructor for the child Interpreter.
   /// Passing the parent Interpreter as an argument.
   ///
@@ -371,10 +723,50 @@ namespace cling {
       // Give my IncrementalExecutor a pointer to the Incremental executor of the
       // parent Interpreter.
       m_Executor->setExternalIncrementalExecutor(parentInterpreter.m_Executor.get());
+
+      // The runtime of my inputs is the parent's, found through the bridge:
+      // it must have all of it.
+      CompilationOptions CO = makeDefaultCompilationOpts();
+      CO.ResultEvaluation = 1;
+      CO.CheckPointerValidity = 1;
+      const_cast<Interpreter&>(parentInterpreter).declareRuntimeFor(CO);
     }
   }
 
+  ///\brief Appends the TimingStats of an interpreter and the peak RSS of the
+  /// process to the file $CLING_TIMING_STATS, as one line of name=value
+  /// pairs; the times are in nanoseconds. See PERF-BUDGET in test/lit.cfg.
+  static void appendTimingStats(const TimingStats& Stats) {
+    const char* Path = ::getenv("CLING_TIMING_STATS");
+    if (!Path || !*Path)
+      return;
+    std::string Line;
+    llvm::raw_string_ostream LineOS(Line);
+    for (unsigned I = 0; I < TimingStats::kNumPhases; ++I) {
+      const TimingStats::Phase P = TimingStats::Phase(I);
+      LineOS << TimingStats::getPhaseName(P) << '='
+             << Stats.getNanoseconds(P) << ' ';
+    }
+    LineOS << "peak-rss-kb=" << utils::GetPeakRSS() << '\n';
+
+    std::error_code EC;
+    // One write per line: the interpreters of several processes append.
+    llvm::raw_fd_ostream OS(Path, EC,
+                            llvm::sys::fs::F_Append | llvm::sys::fs::F_Text);
+    if (EC)
+      cling::errs() << "cling::Interpreter: cannot write the timing stats to "
+                    << Path << ": " << EC.message() << "\n";
+    else
+      OS << LineOS.str();
+  }
+
   Interpreter::~Interpreter() {
+    // Evaluate what is pending while everything is still there.
+    m_AsyncEvaluator.reset();
+
+    if (m_HeaderPCHCache && getCIOrNull() && !isInSyntaxOnlyMode())
+      m_HeaderPCHCache->update(*this);
+
     // Do this first so m_StoredStates will be ignored if Interpreter::unload
     // is called later on.
     for (size_t i = 0, e = m_StoredStates.size(); i != e; ++i)
@@ -382,7 +774,10 @@ namespace cling {
     m_StoredStates.clear();
 
     if (m_Executor)
-      m_Executor->shuttingDown();
+      runAtExitFuncs();
+
+    if (m_IncrParser)
+      appendTimingStats(getTimingStats());
 
     // LookupHelper's ~Parser needs the PP from IncrParser's CI, so do this
     // first:
@@ -395,6 +790,13 @@ namespace cling {
     // explicitly, before the implicit destruction (through the unique_ptr) of
     // the callbacks.
     m_IncrParser.reset(0);
+
+    if (m_OwnsTimeTrace) {
+      if (!writeTimeTrace())
+        cling::errs() << "cling::Interpreter: cannot write the time trace to "
+                      << m_Opts.TimeTraceFile << "\n";
+      llvm::timeTraceProfilerCleanup();
+    }
   }
 
   Transaction* Interpreter::Initialize(bool NoRuntime, bool SyntaxOnly,
@@ -424,6 +826,8 @@ namespace cling {
     // loading the PCH/PCM will make the runtime barf about dupe definitions.
     bool EmitDefinitions = !SyntaxOnly;
 
+    llvm::TimeTraceScope TimeScope("RuntimeUniverse", llvm::StringRef());
+
     // FIXME: gCling should be const so assignemnt is a compile time error.
     // Currently the name mangling is coming up wrong for the const version
     // (on OS X at least, so probably Linux too) and the JIT thinks the symbol
@@ -562,7 +966,10 @@ namespace cling {
       cling::errs() << Strm.str();
 
     Transaction *T;
-    declare(Strm.str(), &T);
+    const CompilationResult Res = declare(Strm.str(), &T);
+    // The rest of the runtime comes with the first input needing it, unless
+    // this part failed, e.g. without the standard library.
+    m_LazyRuntime = !NoRuntime && LangOpts.CPlusPlus && Res == kSuccess;
     return T;
   }
 
@@ -620,9 +1027,15 @@ namespace cling {
     CompilerInstance* CI = getCI();
     HeaderSearchOptions& HOpts = CI->getHeaderSearchOpts();
 
+    if (!m_IncludePaths) {
+      m_IncludePaths.reset(new utils::PathSet());
+      for (const HeaderSearchOptions::Entry& E : HOpts.UserEntries)
+        m_IncludePaths->insert(E.Path);
+    }
+
     // Save the current number of entries
     size_t Idx = HOpts.UserEntries.size();
-    utils::AddIncludePaths(PathStr, HOpts, Delm);
+    utils::AddIncludePaths(PathStr, HOpts, Delm, m_IncludePaths.get());
 
     Preprocessor& PP = CI->getPreprocessor();
     SourceManager& SM = PP.getSourceManager();
@@ -677,6 +1090,305 @@ namespace cling {
       ClangInternalState::printLookupTables(where, getSema().getASTContext());
     else if (what.equals("undo"))
       m_IncrParser->printTransactionStructure();
+    else if (what.equals("transactions"))
+      m_IncrParser->getTransactionPool()->printStats(where);
+  }
+
+  const TimingStats& Interpreter::getTimingStats() const {
+    return m_IncrParser->getPhaseTimers().getTotal();
+  }
+
+  void Interpreter::resetTimingStats() {
+    m_IncrParser->getPhaseTimers().clear();
+  }
+
+  void Interpreter::trimMemory(TrimLevel Level /*= kTrimHeap*/) {
+    m_CompletionCache.reset();
+    // clear() would keep the buckets.
+    std::unordered_map<void*, std::string>().swap(m_MangledNames);
+    if (TransactionPool* Pool = m_IncrParser->getTransactionPool())
+      Pool->trim();
+    if (BackendPasses* BP
+          = m_Executor ? m_Executor->getBackendPasses() : nullptr)
+      BP->releasePassManagers();
+    if (Level < kTrimHeap)
+      return;
+#ifdef __GLIBC__
+    ::malloc_trim(0);
+#endif
+  }
+
+  bool Interpreter::writeTimeTrace() const {
+    if (!m_OwnsTimeTrace || !llvm::timeTraceProfilerEnabled())
+      return false;
+    std::error_code EC;
+    auto* File = new llvm::raw_fd_ostream(m_Opts.TimeTraceFile, EC,
+                                          llvm::sys::fs::F_Text);
+    std::unique_ptr<llvm::raw_pwrite_stream> OS(File);
+    if (EC)
+      return false;
+    // Only ended sections are written; meta commands and user code run
+    // outside of cling's.
+    llvm::timeTraceProfilerWrite(OS);
+    File->flush();
+    if (File->has_error()) {
+      File->clear_error();
+      return false;
+    }
+    return true;
+  }
+
+  ///\brief Adds the memory of T and its nested transactions to Stats.
+  static void addMemoryStats(const Transaction& T,
+                             const IncrementalExecutor* Exe,
+                             MemoryStats& Stats) {
+    Stats += T.getMemoryStats();
+    if (Exe)
+      Exe->addJITMemory(T, Stats);
+    if (!T.hasNestedTransactions())
+      return;
+    for (Transaction::const_nested_iterator I = T.nested_begin(),
+           E = T.nested_end(); I != E; ++I)
+      addMemoryStats(**I, Exe, Stats);
+  }
+
+  MemoryReport Interpreter::getMemoryReport() const {
+    MemoryReport Report;
+    MemoryStats Attributed;
+    for (const Transaction* T = getFirstTransaction(); T; T = T->getNext()) {
+      MemoryReport::Entry Entry{T, MemoryStats()};
+      addMemoryStats(*T, m_Executor.get(), Entry.Stats);
+      Attributed += Entry.Stats;
+      Report.Transactions.push_back(Entry);
+    }
+    if (m_Executor) {
+      const MemoryStats JIT = m_Executor->getJITMemory();
+      MemoryStats& Rest = Report.Unattributed;
+      Rest.JITCodeBytes = JIT.JITCodeBytes - Attributed.JITCodeBytes;
+      Rest.JITRODataBytes = JIT.JITRODataBytes - Attributed.JITRODataBytes;
+      Rest.JITRWDataBytes = JIT.JITRWDataBytes - Attributed.JITRWDataBytes;
+    }
+    return Report;
+  }
+
+  HeapReport Interpreter::getHeapReport() const {
+    HeapReport Report;
+    if (m_Executor)
+      m_Executor->getHeapReport(getFirstTransaction(), Report);
+    return Report;
+  }
+
+  bool Interpreter::startProfiling(unsigned IntervalUs) {
+    return m_Executor && m_Executor->startProfiling(IntervalUs);
+  }
+
+  bool Interpreter::stopProfiling() {
+    return m_Executor && m_Executor->stopProfiling();
+  }
+
+  ProfileReport Interpreter::getProfileReport() const {
+    ProfileReport Report;
+    if (m_Executor)
+      m_Executor->getProfileReport(getFirstTransaction(), Report);
+    return Report;
+  }
+
+  bool Interpreter::loadOpenMPRuntime(llvm::StringRef Runtime) {
+    if (!getCI()->getLangOpts().OpenMP) {
+      cling::errs() << "cling::Interpreter: OpenMP is not enabled; start the "
+                       "session with -fopenmp\n";
+      return false;
+    }
+    if (isInSyntaxOnlyMode())
+      return true;
+    // The process might already provide it, e.g. through a library of ROOT.
+    if (Runtime.empty()
+        && llvm::sys::DynamicLibrary::SearchForAddressOfSymbol(
+             "__kmpc_fork_call"))
+      return true;
+
+    static const char* const Defaults[] = {"libomp", "libiomp5"};
+    std::vector<std::string> Candidates;
+    if (Runtime.empty())
+      Candidates.assign(std::begin(Defaults), std::end(Defaults));
+    else
+      Candidates.push_back(Runtime.str());
+    DynamicLibraryManager* DLM = getDynamicLibraryManager();
+    for (const std::string& Lib : Candidates) {
+      switch (DLM->loadLibrary(Lib, /*permanent*/ true)) {
+        case DynamicLibraryManager::kLoadLibSuccess:
+        case DynamicLibraryManager::kLoadLibAlreadyLoaded:
+          return true;
+        case DynamicLibraryManager::kLoadLibNotFound:
+          continue;
+        default:
+          // Already reported.
+          return false;
+      }
+    }
+    cling::errs() << "cling::Interpreter: cannot find the OpenMP runtime "
+                  << (Runtime.empty() ? "libomp" : Runtime)
+                  << "; add its directory to LD_LIBRARY_PATH or with -L\n";
+    return false;
+  }
+
+  bool Interpreter::enableCUDAKernelTiming(bool Enable) {
+    if (!m_CUDACompiler)
+      return false;
+    if (!Enable) {
+      m_CUDACompiler->enableKernelTiming(nullptr);
+      return true;
+    }
+    const char* Name = "__cling_cuda_kernel_timer";
+    void* Addr = getAddressOfGlobal(Name);
+    if (!Addr) {
+      // The events are recorded on the default stream, which synchronizes
+      // with the others (unless they are created non-blocking).
+      if (declare("extern \"C\" float __cling_cuda_kernel_timer(int Stop) {\n"
+                  "  static cudaEvent_t Start, End;\n"
+                  "  static bool Valid = cudaEventCreate(&Start) == 0\n"
+                  "                      && cudaEventCreate(&End) == 0;\n"
+                  "  if (!Valid) return -1.f;\n"
+                  "  if (!Stop) return cudaEventRecord(Start) ? -1.f : 0.f;\n"
+                  "  float Ms = -1.f;\n"
+                  "  if (cudaEventRecord(End) || cudaEventSynchronize(End)\n"
+                  "      || cudaEventElapsedTime(&Ms, Start, End))\n"
+                  "    return -1.f;\n"
+                  "  return Ms;\n"
+                  "}\n") != kSuccess)
+        return false;
+      Addr = getAddressOfGlobal(Name);
+    }
+    if (!Addr)
+      return false;
+    m_CUDACompiler->enableKernelTiming(
+        utils::VoidToFunctionPtr<IncrementalCUDADeviceCompiler::KernelTimer>(
+            Addr));
+    return true;
+  }
+
+  bool Interpreter::enableCUDAGraphs() {
+    if (!m_CUDACompiler || !m_Executor)
+      return false;
+    const char* Hook = "__cling_cuda_launch_kernel";
+    if (getAddressOfGlobal(Hook))
+      return true;
+    // Before the hook replaces it.
+    void* Launch = getAddressOfGlobal("cudaLaunchKernel");
+    if (!Launch)
+      return false;
+
+    // A region captures its statement into a graph on its first run, and
+    // launches the graph instead of running the statement from then on.
+    // The launches on the default stream cannot be captured: while a region
+    // captures, the hook sends them to the stream of the region, which like
+    // the default stream synchronizes with the blocking streams.
+    std::string Code;
+    llvm::raw_string_ostream Out(Code);
+    Out << "#include <cstdio>\n"
+           "namespace cling { namespace runtime { namespace internal {\n"
+           "static cudaStream_t gCUDAGraphCapture;\n"
+           "extern \"C\" cudaError_t __cling_cuda_launch_kernel(\n"
+           "    const void* F, dim3 G, dim3 B, void** Args, size_t Shared,\n"
+           "    cudaStream_t S) {\n"
+           "  typedef cudaError_t (*Launch_t)(const void*, dim3, dim3,\n"
+           "                                  void**, size_t, cudaStream_t);\n"
+           "  if (gCUDAGraphCapture && (!S || S == cudaStreamLegacy))\n"
+           "    S = gCUDAGraphCapture;\n"
+           "  const Launch_t Launch = (Launch_t)";
+    Out << uintptr_t(Launch) << "ULL;\n";
+    Out << "  return Launch(F, G, B, Args, Shared, S);\n"
+           "}\n"
+           "struct CUDAGraph {\n"
+           "  cudaStream_t Stream = nullptr;\n"
+           "  cudaGraphExec_t Exec = nullptr;\n"
+           "  bool Failed = false;\n"
+           "};\n"
+           "class CUDAGraphRegion {\n"
+           "  CUDAGraph& m_Graph;\n"
+           "  bool m_Run = true;\n"
+           "  bool m_Capturing = false;\n"
+           "public:\n"
+           "  CUDAGraphRegion(CUDAGraph& G): m_Graph(G) {\n"
+           "    if (G.Exec) {\n"
+           "      if (cudaGraphLaunch(G.Exec, G.Stream) == cudaSuccess) {\n"
+           "        m_Run = false;\n"
+           "        return;\n"
+           "      }\n"
+           "      cudaGraphExecDestroy(G.Exec);\n"
+           "      G.Exec = nullptr;\n"
+           "      G.Failed = true;\n"
+           "    }\n"
+           "    // Nested in a capturing region, the statement is part of its\n"
+           "    // graph.\n"
+           "    if (G.Failed || gCUDAGraphCapture\n"
+           "        || (!G.Stream && cudaStreamCreate(&G.Stream))\n"
+           "        || cudaStreamBeginCapture(\n"
+           "             G.Stream, cudaStreamCaptureModeThreadLocal))\n"
+           "      return;\n"
+           "    m_Capturing = true;\n"
+           "    gCUDAGraphCapture = G.Stream;\n"
+           "  }\n"
+           "  ~CUDAGraphRegion() {\n"
+           "    if (!m_Capturing)\n"
+           "      return;\n"
+           "    gCUDAGraphCapture = nullptr;\n"
+           "    cudaGraph_t Graph = nullptr;\n"
+           "    cudaError_t Err\n"
+           "      = cudaStreamEndCapture(m_Graph.Stream, &Graph);\n"
+           "#if CUDART_VERSION >= 12000\n"
+           "    if (!Err)\n"
+           "      Err = cudaGraphInstantiate(&m_Graph.Exec, Graph, 0);\n"
+           "#else\n"
+           "    if (!Err)\n"
+           "      Err = cudaGraphInstantiate(&m_Graph.Exec, Graph, nullptr,\n"
+           "                                 nullptr, 0);\n"
+           "#endif\n"
+           "    if (!Err)\n"
+           "      Err = cudaGraphLaunch(m_Graph.Exec, m_Graph.Stream);\n"
+           "    if (Graph)\n"
+           "      cudaGraphDestroy(Graph);\n"
+           "    if (!Err)\n"
+           "      return;\n"
+           "    if (m_Graph.Exec)\n"
+           "      cudaGraphExecDestroy(m_Graph.Exec);\n"
+           "    m_Graph.Exec = nullptr;\n"
+           "    m_Graph.Failed = true;\n"
+           "    fprintf(stderr, \"cling: cannot capture the CUDA graph\"\n"
+           "            \" of the region: %s; its kernels did not run, and\"\n"
+           "            \" it runs uncaptured from now on\\n\",\n"
+           "            cudaGetErrorString(Err));\n"
+           "  }\n"
+           "  bool next() {\n"
+           "    const bool Run = m_Run;\n"
+           "    m_Run = false;\n"
+           "    return Run;\n"
+           "  }\n"
+           "};\n"
+           "}}}\n";
+    if (declare(Out.str()) != kSuccess)
+      return false;
+    void* Addr = getAddressOfGlobal(Hook);
+    return Addr && m_Executor->addSymbol("cudaLaunchKernel", Addr,
+                                         true /*JIT*/);
+  }
+
+  void Interpreter::enableExecutionCounters(bool Enable) {
+    if (m_Executor)
+      m_Executor->enableExecutionCounters(Enable);
+  }
+
+  void Interpreter::setExecutionLimits(const ExecutionLimits& Limits) {
+    if (m_Executor)
+      m_Executor->setExecutionLimits(Limits);
+  }
+
+  ExecutionLimits Interpreter::getExecutionLimits() const {
+    return m_Executor ? m_Executor->getExecutionLimits() : ExecutionLimits();
+  }
+
+  const ExecutionCounters* Interpreter::getExecutionCounters() const {
+    return m_Executor ? m_Executor->getExecutionCounters() : nullptr;
   }
 
   void Interpreter::storeInterpreterState(const std::string& name) const {
@@ -749,6 +1461,17 @@ namespace cling {
     return getCI()->getDiagnostics();
   }
 
+  bool Interpreter::setDiagnosticsCallback(
+      std::function<void(const utils::DiagnosticRecord&)> Callback,
+      bool Notes /*= false*/) {
+    utils::StructuredDiagnostics* Diags
+      = m_IncrParser ? m_IncrParser->getStructuredDiagnostics() : nullptr;
+    if (!Diags)
+      return false;
+    Diags->setCallback(std::move(Callback), Notes);
+    return true;
+  }
+
   CompilationOptions Interpreter::makeDefaultCompilationOpts() const {
     CompilationOptions CO;
     CO.DeclarationExtraction = 0;
@@ -760,6 +1483,9 @@ namespace cling {
     CO.IgnorePromptDiags = !isRawInputEnabled();
     CO.CheckPointerValidity = !isRawInputEnabled();
     CO.OptLevel = getDefaultOptLevel();
+    CO.AutoOptLevel = isAutoOptLevel();
+    CO.CompileBudgetMs = getCompileBudget();
+    CO.InferNoUnwind = m_RuntimeOptions.NoUnwindWrappers;
     return CO;
   }
 
@@ -794,6 +1520,9 @@ namespace cling {
     return Value;
   }
 
+  static std::string makeExpressionCacheKey(llvm::StringRef Input,
+                                            const CompilationOptions& CO);
+
   ///\brief Maybe transform the input line to implement cint command line
   /// semantics (declarations are global) and compile to produce a module.
   ///
@@ -801,8 +1530,9 @@ namespace cling {
   Interpreter::process(const std::string& input, Value* V /* = 0 */,
                        Transaction** T /* = 0 */,
                        bool disableValuePrinting /* = false*/) {
+    // Compiled concurrently; CodeGen waits for the fatbin.
     if (!isInSyntaxOnlyMode() && m_Opts.CompilerOpts.CUDAHost)
-      m_CUDACompiler->process(input);
+      m_CUDACompiler->processAsync(input);
 
     std::string wrapReadySource = input;
     size_t wrapPoint = std::string::npos;
@@ -812,25 +1542,159 @@ namespace cling {
     CompilationOptions CO = makeDefaultCompilationOpts();
     CO.EnableShadowing = m_RuntimeOptions.AllowRedefinition && !isRawInputEnabled();
 
-    if (isRawInputEnabled() || wrapPoint == std::string::npos) {
+    SessionJournal::Scope Journal(m_Journal.get());
+    const bool Declaration
+      = isRawInputEnabled() || wrapPoint == std::string::npos;
+    if (Declaration) {
       CO.DeclarationExtraction = 0;
       CO.ValuePrinting = 0;
       CO.ResultEvaluation = 0;
-      return DeclareInternal(input, CO, T);
+    } else {
+      CO.DeclarationExtraction = 1;
+      CO.ValuePrinting = disableValuePrinting ? CompilationOptions::VPDisabled
+        : CompilationOptions::VPAuto;
+      CO.ResultEvaluation = (bool)V;
+      // CO.IgnorePromptDiags = 1; done by EvaluateInternal().
+      CO.CheckPointerValidity = 1;
+    }
+    const SessionJournal::Kind Kind = Declaration
+      ? SessionJournal::kDeclaration : SessionJournal::kStatement;
+
+    // Not for the inputs that user code processes: what runs them might
+    // expect them to be compiled.
+    std::string CellKey;
+    const Transaction* BeforeCell = nullptr;
+    if (m_RuntimeOptions.CacheCells && !getCurrentTransaction()
+        && !isInSyntaxOnlyMode() && !m_Opts.CompilerOpts.CUDAHost
+        && !m_Opts.CompilerOpts.CUDADevice) {
+      if (!m_CellCache)
+        m_CellCache.reset(new CellCache(*this));
+      CellKey = makeExpressionCacheKey(input, CO);
+      CellKey += char('0' + isRawInputEnabled());
+      m_CellCache->update();
+      if (const CellCache::Cell* C = m_CellCache->find(CellKey)) {
+        if (V)
+          *V = Value();
+        CompilationResult Res = kSuccess;
+        if (!C->WrapperName.empty())
+          Res = RunCachedWrapper(C->WrapperName, C->ValuePrinting, V);
+        return Journal.commit(Kind, CO.OptLevel, isRawInputEnabled(), input,
+                              Res);
+      }
+      BeforeCell = getLastTransaction();
     }
 
-    CO.DeclarationExtraction = 1;
-    CO.ValuePrinting = disableValuePrinting ? CompilationOptions::VPDisabled
-      : CompilationOptions::VPAuto;
-    CO.ResultEvaluation = (bool)V;
-    // CO.IgnorePromptDiags = 1; done by EvaluateInternal().
-    CO.CheckPointerValidity = 1;
-    if (EvaluateInternal(wrapReadySource, CO, V, T, wrapPoint)
-                                                     == Interpreter::kFailure) {
-      return Interpreter::kFailure;
+    CompilationResult Res = Declaration
+      ? DeclareInternal(input, CO, T)
+      : EvaluateInternal(wrapReadySource, CO, V, T, wrapPoint);
+    if (Res == kSuccess && !CellKey.empty())
+      m_CellCache->add(CellKey, BeforeCell);
+    return Journal.commit(Kind, CO.OptLevel, isRawInputEnabled(), input, Res);
+  }
+
+  Interpreter::CompilationResult
+  Interpreter::processBatch(llvm::ArrayRef<std::string> inputs,
+                            std::vector<CompilationResult>* Results /*= 0*/,
+                            std::vector<Value>* Values /*= 0*/,
+                            bool disableValuePrinting /*= false*/) {
+    if (Results)
+      Results->assign(inputs.size(), kFailure);
+    if (Values)
+      Values->assign(inputs.size(), Value());
+
+    // The CUDA device compiler gets the inputs one by one.
+    if (!isInSyntaxOnlyMode() && m_Opts.CompilerOpts.CUDAHost) {
+      CompilationResult BatchRes = kSuccess;
+      for (size_t I = 0, E = inputs.size(); I != E; ++I) {
+        CompilationResult Res = process(inputs[I], Values ? &(*Values)[I] : 0,
+                                        0, disableValuePrinting);
+        if (Results)
+          (*Results)[I] = Res;
+        if (Res != kSuccess)
+          BatchRes = kFailure;
+      }
+      return BatchRes;
     }
 
-    return Interpreter::kSuccess;
+    // Wrap the inputs as process() does.
+    std::vector<std::string> Sources;
+    std::vector<CompilationOptions> Opts;
+    Sources.reserve(inputs.size());
+    Opts.reserve(inputs.size());
+    for (const std::string& Input : inputs) {
+      std::string wrapReadySource = Input;
+      size_t wrapPoint = std::string::npos;
+      if (!isRawInputEnabled())
+        wrapPoint = utils::getWrapPoint(wrapReadySource,
+                                        getCI()->getLangOpts());
+
+      CompilationOptions CO = makeDefaultCompilationOpts();
+      CO.EnableShadowing = m_RuntimeOptions.AllowRedefinition
+        && !isRawInputEnabled();
+      if (isRawInputEnabled() || wrapPoint == std::string::npos) {
+        CO.DeclarationExtraction = 0;
+        CO.ValuePrinting = 0;
+        CO.ResultEvaluation = 0;
+        Sources.push_back(Input);
+      } else {
+        CO.DeclarationExtraction = 1;
+        CO.ValuePrinting = disableValuePrinting ? CompilationOptions::VPDisabled
+          : CompilationOptions::VPAuto;
+        CO.ResultEvaluation = (bool)Values;
+        CO.IgnorePromptDiags = 1;
+        CO.CheckPointerValidity = 1;
+        std::string WrapperBuffer;
+        Sources.push_back(WrapInput(wrapReadySource, WrapperBuffer, wrapPoint));
+      }
+      Opts.push_back(CO);
+    }
+
+    StateDebuggerRAII stateDebugger(this);
+
+    // New declarations might change what cached expressions refer to.
+    m_ExpressionCache.clear();
+
+    llvm::SmallVector<IncrementalParser::ParseResultTransaction, 16> PRTs;
+    Transaction* BatchT
+      = m_IncrParser->CompileBatch(Sources, Opts, makeDefaultCompilationOpts(),
+                                   PRTs);
+
+    CompilationResult BatchRes = kSuccess;
+    for (size_t I = 0, E = PRTs.size(); I != E; ++I) {
+      CompilationResult Res = kFailure;
+      Transaction* T = PRTs[I].getPointer();
+      if (PRTs[I].getInt() == IncrementalParser::kFailed)
+        Res = kFailure;
+      else if (!T)
+        Res = kSuccess; // Empty transactions are good, too!
+      else if (!BatchT)
+        Res = kFailure; // The static initializers failed; T is gone.
+      else if (m_Opts.CompilerOpts.CUDADevice || !T->getWrapperFD())
+        Res = kSuccess; // No wrapper to run.
+      else {
+        Value resultV;
+        Value* V = Values ? &(*Values)[I] : &resultV;
+        ExecutionResult ExeRes;
+        {
+          // Accounts the JIT and user code time to T.
+          PhaseTimers::Scope Timer(&m_IncrParser->getPhaseTimers(),
+                                   TimingStats::kUserCode, T);
+          ExeRes = RunFunction(T->getWrapperFD(), V, T);
+        }
+        if (ExeRes < kExeFirstError) {
+          Res = kSuccess;
+          if (T->getCompilationOpts().ValuePrinting
+              != CompilationOptions::VPDisabled
+              && V->isValid() && V->needsManagedAllocation())
+            V->dump();
+        }
+      }
+      if (Results)
+        (*Results)[I] = Res;
+      if (Res != kSuccess)
+        BatchRes = kFailure;
+    }
+    return BatchRes;
   }
 
   Interpreter::CompilationResult
@@ -866,6 +1730,17 @@ namespace cling {
    return false;
   }
 
+  bool Interpreter::writeModuleIndex(llvm::StringRef File) {
+    assert(getCI()->getLangOpts().Modules
+           && "Function only relevant when C++ modules are turned on!");
+    std::string Error;
+    if (ModuleImportCallback::writeIndex(*this, File, Error))
+      return true;
+    cling::errs() << "cling::Interpreter::writeModuleIndex: cannot write '"
+                  << File << "': " << Error << '\n';
+    return false;
+  }
+
   bool Interpreter::loadModule(clang::Module* M, bool complain /* = true*/) {
     assert(getCI()->getLangOpts().Modules
            && "Function only relevant when C++ modules are turned on!");
@@ -962,13 +1837,29 @@ namespace cling {
   Interpreter::CompilationResult
   Interpreter::declare(const std::string& input, Transaction** T/*=0 */) {
     if (!isInSyntaxOnlyMode() && m_Opts.CompilerOpts.CUDAHost)
-      m_CUDACompiler->declare(input);
+      m_CUDACompiler->declareAsync(input);
+
+    CompilationOptions CO = makeDefaultCompilationOpts();
+    CO.DeclarationExtraction = 0;
+    CO.ValuePrinting = 0;
+    CO.ResultEvaluation = 0;
+    CO.CheckPointerValidity = 0;
+
+    return DeclareInternal(input, CO, T);
+  }
+
+  Interpreter::CompilationResult
+  Interpreter::declareInPlace(llvm::StringRef input,
+                              Transaction** T/*=0 */) {
+    if (!isInSyntaxOnlyMode() && m_Opts.CompilerOpts.CUDAHost)
+      m_CUDACompiler->declareAsync(input.str());
 
     CompilationOptions CO = makeDefaultCompilationOpts();
     CO.DeclarationExtraction = 0;
     CO.ValuePrinting = 0;
     CO.ResultEvaluation = 0;
     CO.CheckPointerValidity = 0;
+    CO.CallerOwnedInput = 1;
 
     return DeclareInternal(input, CO, T);
   }
@@ -991,6 +1882,81 @@ namespace cling {
   Interpreter::CompilationResult
   Interpreter::codeComplete(const std::string& line, size_t& cursor,
                             std::vector<std::string>& completions) const {
+    llvm::StringRef Context, Prefix;
+    CompletionCache::split(line, cursor, Context, Prefix);
+
+    if (!m_CompletionCache)
+      m_CompletionCache.reset(new CompletionCache());
+    const CompletionCache::Entry* Cached = m_CompletionCache->find(Context);
+    if (!Cached) {
+      // Complete before the typed part of the identifier, to get all names
+      // that the next keystrokes can filter.
+      CompletionCache::Entry E;
+      if (codeCompleteUncached(Context.str(), Context.size(), E.Completions,
+                               &E.Names) != kSuccess)
+        return kFailure;
+      // Only now: completing commits the declarations it deserialized,
+      // which clears the cache.
+      Cached = &m_CompletionCache->insert(Context, std::move(E));
+    }
+    CompletionCache::filter(*Cached, Prefix, completions);
+    return kSuccess;
+  }
+
+  void Interpreter::clearCompletionCache() {
+    if (m_CompletionCache)
+      m_CompletionCache->clear();
+  }
+
+  ImportSummaryCache& Interpreter::getImportSummaryCache() const {
+    if (!m_ImportSummaryCache)
+      m_ImportSummaryCache.reset(
+        new ImportSummaryCache(getCI()->getASTContext()));
+    return *m_ImportSummaryCache;
+  }
+
+  void Interpreter::clearImportSummaryCache() {
+    if (m_ImportSummaryCache)
+      m_ImportSummaryCache->clear();
+  }
+
+  ///\brief Whether D declares cling::printValue(), looking into namespace
+  /// cling and the linkage specifications only.
+  static bool declaresPrintValue(const Decl* D) {
+    if (const auto* LSD = dyn_cast<LinkageSpecDecl>(D))
+      return std::any_of(LSD->decls_begin(), LSD->decls_end(),
+                         declaresPrintValue);
+    if (const auto* NSD = dyn_cast<NamespaceDecl>(D)) {
+      if (NSD->getName() != "cling" && !NSD->isInline())
+        return false;
+      return std::any_of(NSD->decls_begin(), NSD->decls_end(),
+                         declaresPrintValue);
+    }
+    if (!isa<FunctionDecl>(D) && !isa<FunctionTemplateDecl>(D))
+      return false;
+    const IdentifierInfo* II = cast<NamedDecl>(D)->getIdentifier();
+    if (!II || !II->isStr("printValue"))
+      return false;
+    const auto* NSD
+      = dyn_cast<NamespaceDecl>(D->getDeclContext()->getRedeclContext());
+    return NSD && NSD->getName() == "cling";
+  }
+
+  void Interpreter::clearPrintValueWrappers(const Transaction& T) {
+    if (m_PrintValueWrappers.empty())
+      return;
+    for (auto I = T.decls_begin(), E = T.decls_end(); I != E; ++I)
+      for (const Decl* D : I->m_DGR)
+        if (declaresPrintValue(D)) {
+          m_PrintValueWrappers.clear();
+          return;
+        }
+  }
+
+  Interpreter::CompilationResult
+  Interpreter::codeCompleteUncached(const std::string& line, size_t cursor,
+                                    std::vector<std::string>& completions,
+                                    std::vector<std::string>* names) const {
 
     const char * const argV = "cling";
     std::string resourceDir = this->getCI()->getHeaderSearchOpts().ResourceDir;
@@ -1011,7 +1977,7 @@ namespace cling {
     // from the parent interpreter and set the consumer for the child
     // interpreter.
     ClingCodeCompleteConsumer* consumer = new ClingCodeCompleteConsumer(
-                getCI()->getFrontendOpts().CodeCompleteOpts, completions);
+                getCI()->getFrontendOpts().CodeCompleteOpts, completions, names);
     // Child interpreter CI will own consumer!
     childCI->setCodeCompletionConsumer(consumer);
     childSemaRef.CodeCompleter = consumer;
@@ -1085,7 +2051,7 @@ namespace cling {
     cling::ostrstream Strm;
     Strm << "void ";
     makeUniqueName(Strm, ID);
-    Strm << "(void* vpClingValue) {\n ";
+    Strm << utils::Synthesize::WrapperTail;
     return Strm.str();
   }
 
@@ -1133,7 +2099,8 @@ namespace cling {
   }
 
   Interpreter::ExecutionResult
-  Interpreter::RunFunction(const FunctionDecl* FD, Value* res /*=0*/) {
+  Interpreter::RunFunction(const FunctionDecl* FD, Value* res /*=0*/,
+                           const Transaction* T /*=nullptr*/) {
     if (getDiagnostics().hasErrorOccurred())
       return kExeCompilationError;
 
@@ -1145,9 +2112,24 @@ namespace cling {
       return kExeUnkownFunction;
 
     std::string mangledNameIfNeeded;
-    utils::Analyze::maybeMangleDeclName(FD, mangledNameIfNeeded);
+    const Transaction::EntryPoint* Entry
+      = T && !T->getEntryPoints().Wrapper.Name.empty()
+      ? &T->getEntryPoints().Wrapper : nullptr;
+    if (!Entry)
+      utils::Analyze::maybeMangleDeclName(FD, mangledNameIfNeeded);
+    m_Executor->setGuardPointerFaults(m_RuntimeOptions.SignalPointerChecks);
+    IncrementalCUDADeviceCompiler::KernelTimer KernelTimer
+      = m_CUDACompiler ? m_CUDACompiler->getKernelTimer() : nullptr;
+    if (KernelTimer)
+      KernelTimer(/*Stop*/ 0);
     IncrementalExecutor::ExecutionResult ExeRes =
-       m_Executor->executeWrapper(mangledNameIfNeeded, res);
+       Entry ? m_Executor->executeWrapper(Entry->Name, res, Entry->Address)
+             : m_Executor->executeWrapper(mangledNameIfNeeded, res);
+    if (KernelTimer) {
+      float Milliseconds = KernelTimer(/*Stop*/ 1);
+      if (Milliseconds >= 0)
+        m_CUDACompiler->addKernelTime(uint64_t(Milliseconds * 1e6));
+    }
     return ConvertExecutionResult(ExeRes);
   }
 
@@ -1297,6 +2279,89 @@ namespace cling {
     return m_Executor->getPointerToGlobalFromJIT(name);
   }
 
+  ///\brief The code of F with its name replaced, if it is named there only
+  /// once, such that functions differing only by their name compare equal.
+  static std::string getCodeWithoutName(const Interpreter::FunctionSource& F) {
+    auto isIdentifierChar = [](char C) {
+      return std::isalnum((unsigned char)C) || C == '_' || C == '$';
+    };
+    llvm::StringRef Code = F.Code;
+    size_t Found = llvm::StringRef::npos;
+    for (size_t Pos = Code.find(F.Name); !F.Name.empty()
+           && Pos != llvm::StringRef::npos;
+         Pos = Code.find(F.Name, Pos + 1)) {
+      const size_t End = Pos + F.Name.size();
+      if ((Pos && isIdentifierChar(Code[Pos - 1]))
+          || (End < Code.size() && isIdentifierChar(Code[End])))
+        continue;
+      // Also in a string or a call, say; keep it.
+      if (Found != llvm::StringRef::npos)
+        return F.Code.str();
+      Found = Pos;
+    }
+    if (Found == llvm::StringRef::npos)
+      return F.Code.str();
+    std::string Result = Code.take_front(Found).str();
+    Result += '\0';
+    Result += Code.drop_front(Found + F.Name.size()).str();
+    return Result;
+  }
+
+  bool
+  Interpreter::compileFunctions(llvm::ArrayRef<FunctionSource> Functions,
+                                llvm::SmallVectorImpl<void*>& Addresses,
+                                bool ifUnique, bool withAccessControl) {
+    Addresses.assign(Functions.size(), nullptr);
+    if (isInSyntaxOnlyMode())
+      return Functions.empty();
+
+    // The functions to compile, and those whose code one of them has: they
+    // become its aliases, such that their own names are defined too.
+    llvm::StringMap<size_t> ByCode;
+    std::vector<size_t> ToCompile;
+    std::vector<std::pair<size_t, size_t>> Aliases;
+    largestream code;
+    for (size_t I = 0, E = Functions.size(); I != E; ++I) {
+      const FunctionSource& F = Functions[I];
+      if (ifUnique && (Addresses[I] = getAddressOfGlobal(F.Name)))
+        continue;
+      auto Inserted = ByCode.try_emplace(getCodeWithoutName(F), I);
+      if (Inserted.second) {
+        ToCompile.push_back(I);
+        code << F.Code << '\n';
+      } else
+        Aliases.emplace_back(I, Inserted.first->second);
+    }
+    for (const auto& Alias : Aliases) {
+      llvm::StringRef Target = Functions[Alias.second].Name;
+      code << "extern \"C\" decltype(" << Target << ") "
+           << Functions[Alias.first].Name << " __attribute__((alias(\""
+           << Target << "\")));\n";
+      ToCompile.push_back(Alias.first);
+    }
+
+    if (!ToCompile.empty()) {
+      Transaction* T = nullptr;
+      const FunctionSource& First = Functions[ToCompile.front()];
+      DeclareCFunction(First.Name, code.str(), withAccessControl, T);
+      if (T) {
+        for (size_t I : ToCompile)
+          Addresses[I]
+            = m_Executor->getPointerToGlobalFromJIT(Functions[I].Name);
+      } else if (ToCompile.size() > 1) {
+        // The batch is gone; find the functions that compile.
+        for (size_t I : ToCompile)
+          Addresses[I] = compileFunction(Functions[I].Name, Functions[I].Code,
+                                         false /*ifUniq*/, withAccessControl);
+      }
+    }
+
+    bool AllCompiled = true;
+    for (void* Address : Addresses)
+      AllCompiled &= Address != nullptr;
+    return AllCompiled;
+  }
+
   void*
   Interpreter::compileDtorCallFor(const clang::RecordDecl* RD) {
     void* &addr = m_DtorWrappers[RD];
@@ -1326,8 +2391,173 @@ namespace cling {
     return addr;
   }
 
+  ///\brief Prints the qualified name of a function as the wrappers refer to
+  /// it, including the arguments of a template specialization.
+  static void printCalleeName(llvm::raw_ostream& Out, const FunctionDecl* FD) {
+    PrintingPolicy Policy(FD->getASTContext().getPrintingPolicy());
+    Policy.SuppressUnwrittenScope = true;
+    FD->printQualifiedName(Out, Policy);
+    if (const TemplateArgumentList* Args = FD->getTemplateSpecializationArgs())
+      printTemplateArgumentList(Out, Args->asArray(), Policy);
+  }
+
+  CallWrapper_t
+  Interpreter::getCallWrapper(const clang::FunctionDecl* FD) {
+    if (!FD)
+      return nullptr;
+    CallWrapper_t &addr = m_CallWrappers[FD];
+    if (addr)
+      return addr;
+
+    if (isa<CXXConstructorDecl>(FD) || isa<CXXDestructorDecl>(FD)
+        || FD->isDeleted() || FD->isDependentContext())
+      return nullptr;
+
+    ASTContext& Ctx = FD->getASTContext();
+    auto typeName = [&Ctx](QualType QT) {
+      return utils::TypeName::GetFullyQualifiedName(QT, Ctx);
+    };
+
+    // Call through a pointer of the exact type, such that overload resolution
+    // cannot pick another function.
+    const CXXMethodDecl* MD = dyn_cast<CXXMethodDecl>(FD);
+    const bool IsMember = MD && MD->isInstance();
+    QualType ClassTy = IsMember ? Ctx.getRecordType(MD->getParent())
+                                : QualType();
+    QualType CalleeTy = IsMember
+      ? Ctx.getMemberPointerType(FD->getType(), ClassTy.getTypePtr())
+      : Ctx.getPointerType(FD->getType());
+    largestream call;
+    call << "(";
+    if (IsMember)
+      call << "((" << typeName(ClassTy) << "*)obj)->*";
+    call << "static_cast<" << typeName(CalleeTy) << ">(&";
+    printCalleeName(call, FD);
+    call << "))(";
+    for (unsigned I = 0, N = FD->getNumParams(); I < N; ++I) {
+      QualType ParamTy = FD->getParamDecl(I)->getType();
+      QualType ArgTy = ParamTy.getNonReferenceType();
+      if (I)
+        call << ", ";
+      if (ParamTy->isRValueReferenceType())
+        call << "static_cast<" << typeName(Ctx.getRValueReferenceType(ArgTy))
+             << ">(";
+      call << "*static_cast<" << typeName(Ctx.getPointerType(ArgTy))
+           << ">(args[" << I << "])";
+      if (ParamTy->isRValueReferenceType())
+        call << ")";
+    }
+    call << ")";
+
+    smallstream funcname;
+    funcname << "__cling_Call_" << FD;
+
+    largestream code;
+    code << "extern \"C\" void " << funcname.str()
+         << "(void* obj, void** args, void* ret){";
+    QualType RetTy = FD->getReturnType();
+    if (RetTy->isVoidType())
+      code << call.str() << ";";
+    else if (RetTy->isReferenceType())
+      code << "if (ret) *(void**)ret = (void*)&" << call.str() << "; else "
+           << call.str() << ";";
+    else
+      code << "using R = " << typeName(RetTy.getUnqualifiedType()) << ";"
+           << "if (ret) ::new (ret) R(" << call.str() << "); else (void)"
+           << call.str() << ";";
+    code << "}";
+
+    // ifUniq = false: we know it's unique, no need to check.
+    addr = (CallWrapper_t)compileFunction(funcname.str(), code.str(),
+                                          false /*ifUniq*/,
+                                          false /*withAccessControl*/);
+    return addr;
+  }
+
+  ///\brief Extracts the spelling of a type from the name of
+  /// internal::spellType().
+  static llvm::StringRef extractTypeSpelling(llvm::StringRef FuncName) {
+    // "const char *cling::internal::spellType() [T = int (int)]" or, with a
+    // note on the typedefs used, "... [with T = int(int); ...]".
+    size_t Begin = FuncName.find("T = ");
+    if (Begin != llvm::StringRef::npos) {
+      Begin += 4;
+      size_t End = FuncName.find("; ", Begin);
+      if (End == llvm::StringRef::npos)
+        End = FuncName.rfind(']');
+      return FuncName.slice(Begin, End).trim();
+    }
+    // "const char *__cdecl cling::internal::spellType<int(int)>(void)"
+    Begin = FuncName.find("spellType<");
+    if (Begin == llvm::StringRef::npos)
+      return llvm::StringRef();
+    return FuncName.slice(Begin + 10, FuncName.rfind(">(")).trim();
+  }
+
+  ///\brief Splits a qualified name into scope and name at the last "::"
+  /// outside of template arguments.
+  static std::pair<llvm::StringRef, llvm::StringRef>
+  splitQualifiedName(llvm::StringRef Name) {
+    int Depth = 0;
+    for (size_t I = Name.size(); I > 1; --I) {
+      const char C = Name[I - 1];
+      if (C == '>')
+        ++Depth;
+      else if (C == '<')
+        --Depth;
+      else if (!Depth && C == ':' && Name[I - 2] == ':')
+        return std::make_pair(Name.substr(0, I - 2), Name.substr(I));
+    }
+    return std::make_pair(llvm::StringRef(), Name);
+  }
+
+  CallWrapper_t Interpreter::getFunctionWrapper(llvm::StringRef name,
+                                                llvm::StringRef spelling,
+                                                void*& address) {
+    address = nullptr;
+    if (isInSyntaxOnlyMode())
+      return nullptr;
+
+    const LookupHelper& LH = getLookupHelper();
+    QualType SigTy = LH.findType(extractTypeSpelling(spelling),
+                                 LookupHelper::NoDiagnostics);
+    const FunctionProtoType* Sig
+      = SigTy.isNull() ? nullptr : SigTy->getAs<FunctionProtoType>();
+    if (!Sig)
+      return nullptr;
+
+    std::pair<llvm::StringRef, llvm::StringRef> Split
+      = splitQualifiedName(name);
+    ASTContext& Ctx = getCI()->getASTContext();
+    const Decl* Scope = Ctx.getTranslationUnitDecl();
+    if (!Split.first.empty())
+      Scope = LH.findScope(Split.first, LookupHelper::NoDiagnostics);
+    if (!Scope)
+      return nullptr;
+
+    llvm::SmallVector<QualType, 4> Params(Sig->param_type_begin(),
+                                          Sig->param_type_end());
+    const FunctionDecl* FD
+      = LH.matchFunctionProto(Scope, Split.second, Params,
+                              LookupHelper::NoDiagnostics,
+                              false /*objectIsConst*/);
+    if (!FD)
+      return nullptr;
+    if (const CXXMethodDecl* MD = dyn_cast<CXXMethodDecl>(FD))
+      if (MD->isInstance())
+        return nullptr;
+    if (!Ctx.hasSameFunctionTypeIgnoringExceptionSpec(FD->getType(), SigTy))
+      return nullptr;
+
+    CallWrapper_t Wrapper = getCallWrapper(FD);
+    // The wrapper emitted the function; call it directly if it can be found.
+    if (Wrapper)
+      address = getAddressOfGlobal(GlobalDecl(FD));
+    return Wrapper;
+  }
+
   Interpreter::CompilationResult
-  Interpreter::DeclareInternal(const std::string& input,
+  Interpreter::DeclareInternal(llvm::StringRef input,
                                const CompilationOptions& CO,
                                Transaction** T /* = 0 */) const {
     assert(CO.DeclarationExtraction == 0
@@ -1337,6 +2567,9 @@ namespace cling {
 
     StateDebuggerRAII stateDebugger(this);
 
+    // New declarations might change what cached expressions refer to.
+    m_ExpressionCache.clear();
+
     IncrementalParser::ParseResultTransaction PRT
       = m_IncrParser->Compile(input, CO);
     if (PRT.getInt() == IncrementalParser::kFailed)
@@ -1347,12 +2580,91 @@ namespace cling {
     return Interpreter::kSuccess;
   }
 
+  ///\brief The key of an expression in the m_ExpressionCache: what was
+  /// typed, without surrounding whitespace, and how it is to be compiled.
+  static std::string makeExpressionCacheKey(llvm::StringRef Input,
+                                            const CompilationOptions& CO) {
+    std::string Key = Input.trim().str();
+    Key += '\0';
+    Key += char('0' + CO.DeclarationExtraction);
+    Key += char('0' + CO.EnableShadowing);
+    Key += char('0' + CO.ValuePrinting);
+    Key += char('0' + CO.ResultEvaluation);
+    Key += char('0' + CO.DynamicScoping);
+    Key += char('0' + CO.Debug);
+    Key += char('0' + CO.CheckPointerValidity);
+    Key += char('0' + CO.OptLevel);
+    return Key;
+  }
+
+  ///\brief Whether the transaction of an expression declared nothing but
+  /// the wrapper, i.e. whether it left the lookup results of any other (or
+  /// the same) expression unchanged.
+  static bool declaresOnlyWrapper(const Transaction& T) {
+    if (T.hasNestedTransactions() || T.macros_begin() != T.macros_end())
+      return false;
+    for (auto I = T.decls_begin(), E = T.decls_end(); I != E; ++I) {
+      if (I->m_Call != Transaction::kCCIHandleTopLevelDecl)
+        continue;
+      for (const Decl* D : I->m_DGR)
+        if (D != T.getWrapperFD())
+          return false;
+    }
+    return true;
+  }
+
+  ///\brief Frees what the wrapper-only transaction T no longer needs once its
+  /// wrapper has run, see RuntimeOptions::FossilizeWrappers.
+  ///
+  /// The module keeps its (now body-less) globals: the JIT and the code
+  /// generator refer to them, and unloading T needs their names.
+  static void fossilizeTransaction(Transaction& T, IncrementalExecutor& Exe,
+                                   IncrementalParser& Parser,
+                                   bool KeepBuffer) {
+    if (llvm::Module* M = T.getModule()) {
+      if (!Exe.needsModuleIR(M)) {
+        for (llvm::Function& F : *M)
+          if (!F.isDeclaration())
+            F.deleteBody();
+        for (llvm::GlobalVariable& GV : M->globals()) {
+          if (GV.hasInitializer()) {
+            GV.setInitializer(nullptr);
+            GV.setLinkage(llvm::GlobalValue::ExternalLinkage);
+          }
+        }
+      }
+    }
+    if (!KeepBuffer)
+      Parser.releaseInputBuffer(T.getBufferFID());
+  }
+
   Interpreter::CompilationResult
   Interpreter::EvaluateInternal(const std::string& input,
                                 CompilationOptions CO,
                                 Value* V, /* = 0 */
                                 Transaction** /* T = 0 */,
                                 size_t wrapPoint /* = 0*/) {
+    // Only expressions as a whole can be cached; a wrap point > 0 means
+    // declarations precede the expression.
+    std::string CacheKey;
+    if (m_RuntimeOptions.CacheExpressions && !wrapPoint
+        && !isInSyntaxOnlyMode() && !m_Opts.CompilerOpts.CUDAHost
+        && !m_Opts.CompilerOpts.CUDADevice) {
+      CacheKey = makeExpressionCacheKey(input, CO);
+      auto ICached = m_ExpressionCache.find(CacheKey);
+      if (ICached != m_ExpressionCache.end()) {
+        if (getDiagnostics().hasErrorOccurred())
+          return kFailure;
+        if (ICached->second.Folded) {
+          if (V)
+            *V = *ICached->second.Folded;
+          return kSuccess;
+        }
+        return RunCachedWrapper(ICached->second.WrapperName,
+                                ICached->second.ValuePrinting, V);
+      }
+    }
+
     StateDebuggerRAII stateDebugger(this);
 
     // Wrap the expression
@@ -1363,9 +2675,29 @@ namespace cling {
     // non-default C++ at the prompt:
     CO.IgnorePromptDiags = 1;
 
+    // Let a constant expression be folded instead of emitted and run; only
+    // its value is wanted.
+    Value Folded;
+    Value* const PrevFoldTarget = m_FoldTarget;
+    m_FoldTarget = V && CO.ResultEvaluation && !wrapPoint
+      && CO.ValuePrinting == CompilationOptions::VPDisabled
+      && !isInSyntaxOnlyMode() && !m_Opts.CompilerOpts.CUDAHost
+      && !m_Opts.CompilerOpts.CUDADevice ? &Folded : nullptr;
     IncrementalParser::ParseResultTransaction PRT
       = m_IncrParser->Compile(Wrapper, CO);
+    m_FoldTarget = PrevFoldTarget;
     Transaction* lastT = PRT.getPointer();
+    if (Folded.isValid() && PRT.getInt() != IncrementalParser::kFailed
+        && (!lastT || lastT->getState() == Transaction::kCommitted)) {
+      *V = Folded;
+      // As for a wrapper: what else got declared might change the value.
+      if (lastT)
+        m_ExpressionCache.clear();
+      else if (!CacheKey.empty())
+        m_ExpressionCache[CacheKey] = CachedExpression{std::string(),
+          CO.ValuePrinting, std::make_shared<Value>(Folded)};
+      return kSuccess;
+    }
     if (lastT && lastT->getState() != Transaction::kCommitted) {
       assert((lastT->getState() == Transaction::kCommitted
               || lastT->getState() == Transaction::kRolledBack
@@ -1397,7 +2729,24 @@ namespace cling {
         !lastT->getWrapperFD()) // no wrapper to run
       return Interpreter::kSuccess;
     else {
-      ExecutionResult res = RunFunction(lastT->getWrapperFD(), V);
+      if (!m_ExpressionCache.empty() || !CacheKey.empty()) {
+        if (!declaresOnlyWrapper(*lastT))
+          m_ExpressionCache.clear();
+        else if (!CacheKey.empty()) {
+          std::string WrapperName;
+          utils::Analyze::maybeMangleDeclName(lastT->getWrapperFD(),
+                                              WrapperName);
+          m_ExpressionCache[CacheKey] = CachedExpression{WrapperName,
+            lastT->getCompilationOpts().ValuePrinting};
+        }
+      }
+      ExecutionResult res;
+      {
+        // Accounts the JIT and user code time to lastT.
+        PhaseTimers::Scope Timer(&m_IncrParser->getPhaseTimers(),
+                                 TimingStats::kUserCode, lastT);
+        res = RunFunction(lastT->getWrapperFD(), V, lastT);
+      }
       if (res < kExeFirstError) {
          if (lastT->getCompilationOpts().ValuePrinting
             != CompilationOptions::VPDisabled
@@ -1406,6 +2755,10 @@ namespace cling {
             // dumpIfNoStorage.
             && V->needsManagedAllocation())
          V->dump();
+         if (m_RuntimeOptions.FossilizeWrappers
+             && !lastT->isNestedTransaction() && declaresOnlyWrapper(*lastT))
+           fossilizeTransaction(*lastT, *m_Executor, *m_IncrParser,
+                                getCI()->getDiagnosticOpts().VerifyDiagnostics);
          return Interpreter::kSuccess;
       } else {
         return Interpreter::kFailure;
@@ -1414,6 +2767,81 @@ namespace cling {
     return Interpreter::kSuccess;
   }
 
+  Interpreter::CompilationResult
+  Interpreter::RunCachedWrapper(const std::string& WrapperName,
+                                unsigned ValuePrinting, Value* V) {
+    Value resultV;
+    if (!V)
+      V = &resultV;
+    m_Executor->setGuardPointerFaults(m_RuntimeOptions.SignalPointerChecks);
+    ExecutionResult res
+      = ConvertExecutionResult(m_Executor->executeWrapper(WrapperName, V));
+    if (res >= kExeFirstError)
+      return kFailure;
+    if (ValuePrinting != CompilationOptions::VPDisabled && V->isValid()
+        && V->needsManagedAllocation())
+      V->dump();
+    return kSuccess;
+  }
+
+  std::future<Interpreter::CompilationResult>
+  Interpreter::evaluateAsync(const std::string& input, Value& V) {
+    return m_AsyncEvaluator->submit(input, V);
+  }
+
+  void Interpreter::setAsyncExecutor(AsyncExecutor Exec) {
+    m_AsyncEvaluator->setExecutor(std::move(Exec));
+  }
+
+  Interpreter::CompilationResult
+  Interpreter::compileForAsync(const std::string& input, Transaction*& T) {
+    T = nullptr;
+    // Also protects the wrapper counter and the expression cache.
+    std::lock_guard<StateLock> Lock(getStateLock());
+
+    CompilationOptions CO = makeDefaultCompilationOpts();
+    CO.DeclarationExtraction = 0;
+    CO.ValuePrinting = 0;
+    CO.ResultEvaluation = 1;
+    CO.CheckPointerValidity = 0;
+    CO.IgnorePromptDiags = 1;
+
+    StateDebuggerRAII stateDebugger(this);
+
+    std::string WrapperBuffer;
+    size_t wrapPoint = 0;
+    const std::string& Wrapper = WrapInput(input, WrapperBuffer, wrapPoint);
+
+    IncrementalParser::ParseResultTransaction PRT
+      = m_IncrParser->Compile(Wrapper, CO);
+    Transaction* lastT = PRT.getPointer();
+    if (lastT && lastT->getState() != Transaction::kCommitted)
+      return kFailure;
+    if (PRT.getInt() == IncrementalParser::kFailed)
+      return kFailure;
+
+    if (lastT && !declaresOnlyWrapper(*lastT))
+      m_ExpressionCache.clear();
+    T = lastT;
+    return kSuccess;
+  }
+
+  Interpreter::CompilationResult
+  Interpreter::runForAsync(Transaction* T, Value& V) {
+    V = Value();
+    if (!T || m_Opts.CompilerOpts.CUDADevice || !T->getWrapperFD())
+      return kSuccess;
+
+    ExecutionResult res;
+    {
+      // Accounts the JIT and user code time to T.
+      PhaseTimers::Scope Timer(&m_IncrParser->getPhaseTimers(),
+                               TimingStats::kUserCode, T);
+      res = RunFunction(T->getWrapperFD(), &V, T);
+    }
+    return res < kExeFirstError ? kSuccess : kFailure;
+  }
+
   std::string Interpreter::lookupFileOrLibrary(llvm::StringRef file) {
     std::string canonicalFile = DynamicLibraryManager::normalizePath(file);
     if (canonicalFile.empty())
@@ -1442,7 +2870,8 @@ namespace cling {
   }
 
   Interpreter::CompilationResult
-  Interpreter::loadLibrary(const std::string& filename, bool lookup) {
+  Interpreter::loadLibrary(const std::string& filename, bool lookup,
+                           bool async /*= false*/) {
     DynamicLibraryManager* DLM = getDynamicLibraryManager();
     std::string canonicalLib;
     if (lookup)
@@ -1450,7 +2879,11 @@ namespace cling {
 
     const std::string &library = lookup ? canonicalLib : filename;
     if (!library.empty()) {
-      switch (DLM->loadLibrary(library, /*permanent*/false, /*resolved*/true)) {
+      switch (async
+              ? DLM->loadLibraryAsync(library, /*permanent*/false,
+                                      /*resolved*/true)
+              : DLM->loadLibrary(library, /*permanent*/false,
+                                 /*resolved*/true)) {
       case DynamicLibraryManager::kLoadLibSuccess: // Intentional fall through
       case DynamicLibraryManager::kLoadLibAlreadyLoaded:
         return kSuccess;
@@ -1468,6 +2901,23 @@ namespace cling {
   Interpreter::CompilationResult
   Interpreter::loadHeader(const std::string& filename,
                           Transaction** T /*= 0*/) {
+    std::string Path;
+    if (m_HeaderPCHCache) {
+      Path = lookupFileOrLibrary(filename);
+      if (!Path.empty()) {
+        llvm::SmallString<256> AbsPath(Path);
+        llvm::sys::fs::make_absolute(AbsPath);
+        Path = AbsPath.str();
+      }
+      if (m_HeaderPCHCache->isCached(Path, getLastTransaction())) {
+        // Deserialized from the PCH; including it again is a redefinition
+        // if it has no include guard.
+        if (T)
+          *T = nullptr;
+        return kSuccess;
+      }
+    }
+
     std::string code;
     code += "#include \"" + filename + "\"";
 
@@ -1477,10 +2927,22 @@ namespace cling {
     CO.ResultEvaluation = 0;
     CO.CheckPointerValidity = 1;
     CompilationResult res = DeclareInternal(code, CO, T);
+    if (m_HeaderPCHCache)
+      m_HeaderPCHCache->recordParsed(Path, res == kSuccess,
+                                     getLastTransaction());
     return res;
   }
 
-  void Interpreter::unload(Transaction& T) {
+  ///\brief Runs the atexit functions of T and its nested transactions.
+  static void runAtExitFuncsOf(IncrementalExecutor& Exe,
+                               const Transaction& T) {
+    if (T.hasNestedTransactions())
+      for (auto I = T.rnested_begin(), E = T.rnested_end(); I != E; ++I)
+        runAtExitFuncsOf(Exe, **I);
+    Exe.runAndRemoveStaticDestructors(const_cast<Transaction*>(&T));
+  }
+
+  bool Interpreter::prepareUnload(Transaction& T) {
     T.setUnloading();
     // Clear any stored states that reference the llvm::Module.
     // Do it first in case
@@ -1503,6 +2965,19 @@ namespace cling {
       }
     }
 
+    // The transaction might hold cached wrappers or what they refer to.
+    m_ExpressionCache.clear();
+    if (m_CellCache)
+      m_CellCache->clear();
+    if (m_HotReload)
+      m_HotReload->forget(T);
+    clearImportSummaryCache();
+    m_PrintValueWrappers.clear();
+    m_CallWrappers.clear();
+    m_MangledNames.clear();
+    forgetRuntimeOf(T);
+    m_IncrParser->transactionUnloading(T);
+
     // Clear any cached transaction states.
     for (unsigned i = 0; i < kNumTransactions; ++i) {
       if (m_CachedTrns[i] == &T) {
@@ -1513,94 +2988,252 @@ namespace cling {
 
     if (InterpreterCallbacks* callbacks = getCallbacks())
       callbacks->TransactionUnloaded(T);
+    // Those of the nested transactions too: they are released with T.
     if (m_Executor) // we also might be in fsyntax-only mode.
-      m_Executor->runAndRemoveStaticDestructors(&T);
+      runAtExitFuncsOf(*m_Executor, T);
 
-    // We can revert the most recent transaction or a nested transaction of a
-    // transaction that is not in the middle of the transaction collection
-    // (i.e. at the end or not yet added to the collection at all).
-    assert(!T.getTopmostParent()->getNext() &&
-           "Can not revert previous transactions");
     assert((T.getState() != Transaction::kRolledBack ||
             T.getState() != Transaction::kRolledBackWithErrors) &&
            "Transaction already rolled back.");
     if (getOptions().ErrorOut) {
       // Tag the transaction as "won't need to be committed" (ROOT-10798).
       T.setState(Transaction::kRolledBack);
-      return;
+      return false;
     }
+    return true;
+  }
+
+  void Interpreter::revertTransaction(Transaction& T, TransactionUnloader& U) {
+    // We can revert the most recent transaction or a nested transaction of a
+    // transaction that is not in the middle of the transaction collection
+    // (i.e. at the end or not yet added to the collection at all).
+    assert(!T.getTopmostParent()->getNext() &&
+           "Can not revert previous transactions");
 
     if (InterpreterCallbacks* callbacks = getCallbacks())
       callbacks->TransactionRollback(T);
 
-    TransactionUnloader U(this, &getCI()->getSema(),
-                          m_IncrParser->getCodeGenerator(),
-                          m_Executor.get());
     if (U.RevertTransaction(&T))
       T.setState(Transaction::kRolledBack);
     else
       T.setState(Transaction::kRolledBackWithErrors);
 
+    // Release the input_line_X file unless verifying diagnostics.
+    if (!getCI()->getDiagnosticOpts().VerifyDiagnostics)
+      m_IncrParser->releaseInputBuffer(T.getBufferFID());
+
     m_IncrParser->deregisterTransaction(T);
   }
 
+  void Interpreter::unload(Transaction& T) {
+    std::lock_guard<StateLock> Lock(getStateLock());
+    if (!prepareUnload(T))
+      return;
+    TransactionUnloader U(this, &getCI()->getSema(),
+                          m_IncrParser->getCodeGenerator(),
+                          m_Executor.get());
+    revertTransaction(T, U);
+  }
+
   void Interpreter::unload(unsigned numberOfTransactions) {
+    std::lock_guard<StateLock> Lock(getStateLock());
     const Transaction *First = m_IncrParser->getFirstTransaction();
     if (!First) {
       cling::errs() << "cling: No transactions to unload!";
       return;
     }
-    for (unsigned i = 0; i < numberOfTransactions; ++i) {
-      cling::Transaction* T = m_IncrParser->getLastTransaction();
-      if (T == First) {
-        cling::errs() << "cling: Can't unload first transaction!  Unloaded "
-                      << i << " of " << numberOfTransactions << "\n";
-        return;
+    if (numberOfTransactions < 2 || getOptions().ErrorOut) {
+      for (unsigned i = 0; i < numberOfTransactions; ++i) {
+        cling::Transaction* T = m_IncrParser->getLastTransaction();
+        if (T == First) {
+          cling::errs() << "cling: Can't unload first transaction!  Unloaded "
+                        << i << " of " << numberOfTransactions << "\n";
+          return;
+        }
+        unload(*T);
       }
-      unload(*T);
+      return;
+    }
+
+    // Unload the range as a batch: run the destructors of all transactions,
+    // remove their code from the JIT at once, then revert their declarations
+    // with one unloader, which keeps its indexes of the DeclContexts.
+    llvm::SmallVector<Transaction*, 16> Range;
+    for (Transaction* T : llvm::reverse(m_IncrParser->transactions())) {
+      if (T == First || Range.size() >= numberOfTransactions)
+        break;
+      Range.push_back(T);
     }
+
+    for (Transaction* T : Range)
+      prepareUnload(*T);
+    TransactionUnloader U(this, &getCI()->getSema(),
+                          m_IncrParser->getCodeGenerator(),
+                          m_Executor.get());
+    U.unloadFromExecutor(Range);
+    for (Transaction* T : Range)
+      revertTransaction(*T, U);
+
+    if (Range.size() < numberOfTransactions)
+      cling::errs() << "cling: Can't unload first transaction!  Unloaded "
+                    << Range.size() << " of " << numberOfTransactions << "\n";
   }
 
   Interpreter::CompilationResult
   Interpreter::loadFile(const std::string& filename,
                         bool allowSharedLib /*=true*/,
                         Transaction** T /*= 0*/) {
+    SessionJournal::Scope Journal(m_Journal.get());
+    const SessionJournal::Kind Kind
+      = allowSharedLib ? SessionJournal::kLoad : SessionJournal::kLoadHeader;
     if (allowSharedLib) {
       CompilationResult result = loadLibrary(filename, true);
       if (result!=kMoreInputExpected)
-        return result;
+        return Journal.commit(Kind, getDefaultOptLevel(), false, filename,
+                              result);
     }
-    return loadHeader(filename, T);
+    return Journal.commit(Kind, getDefaultOptLevel(), false, filename,
+                          loadHeader(filename, T));
   }
 
-  static void runAndRemoveStaticDestructorsImpl(IncrementalExecutor &executor,
-                                std::vector<const Transaction*> &transactions,
-                                         unsigned int begin, unsigned int end) {
+  Interpreter::CompilationResult
+  Interpreter::loadFiles(llvm::ArrayRef<std::string> filenames,
+                         bool allowSharedLib /*=true*/,
+                         unsigned Jobs /*= 0*/) {
+    // The paths of the files to be parsed, empty for the libraries.
+    std::vector<std::string> Paths(filenames.size());
+    std::vector<std::string> Sources;
+    for (size_t I = 0, E = filenames.size(); I < E; ++I) {
+      std::string Path = lookupFileOrLibrary(filenames[I]);
+      if (Path.empty()
+          || (allowSharedLib && DynamicLibraryManager::isSharedLibrary(Path)))
+        continue;
+      Paths[I] = Path;
+      Sources.push_back(std::move(Path));
+    }
+
+    std::unique_ptr<FilePrefetcher> Prefetcher;
+    if (!Sources.empty()) {
+      CompilerInstance& CI = *getCI();
+      const bool Install = !m_HeaderPCHCache && !CI.getLangOpts().Modules
+        && !CI.getModuleManager();
+      Prefetcher.reset(new FilePrefetcher(CI, Sources, Jobs, Install));
+    }
 
-    for(auto i = begin; i != end; --i) {
-      if (transactions[i-1] != nullptr)
-        executor.runAndRemoveStaticDestructors(const_cast<Transaction*>(transactions[i-1]));
+    CompilationResult Result = kSuccess;
+    for (size_t I = 0, E = filenames.size(); I < E; ++I) {
+      if (!Paths[I].empty())
+        Prefetcher->install(Paths[I]);
+      if (loadFile(filenames[I], allowSharedLib) != kSuccess)
+        Result = kFailure;
+    }
+    return Result;
+  }
+
+  Interpreter::CompilationResult
+  Interpreter::loadCompiledScript(const std::string& filename,
+                                  bool rebuild /*= false*/,
+                                  Transaction** T /*= 0*/) {
+    if (isInSyntaxOnlyMode() || !m_Executor)
+      return loadHeader(filename, T);
+
+    std::string Path = lookupFileOrLibrary(filename);
+    if (Path.empty())
+      Path = filename;
+    const std::string Lib = ScriptLibraryCache().getLibrary(*this, Path,
+                                                            rebuild);
+    if (Lib.empty() || loadLibrary(Lib, /*lookup*/ false) != kSuccess)
+      return kFailure;
+
+    std::string code;
+    code += "#include \"" + filename + "\"";
+    return parse(code, T);
+  }
+
+  ///\brief The options of loadReloadableFile(), which reloadFile() keeps.
+  static CompilationOptions makeReloadableOpts(const Interpreter& I) {
+    CompilationOptions CO = I.makeDefaultCompilationOpts();
+    CO.DeclarationExtraction = 0;
+    CO.ValuePrinting = 0;
+    CO.ResultEvaluation = 0;
+    CO.CheckPointerValidity = 1;
+    CO.Reloadable = 1;
+    return CO;
+  }
+
+  ///\brief The absolute path of filename, by which m_HotReload knows it.
+  static std::string getReloadablePath(Interpreter& I,
+                                       const std::string& filename) {
+    llvm::SmallString<256> Path(I.lookupFileOrLibrary(filename));
+    if (Path.empty())
+      Path = filename;
+    llvm::sys::fs::make_absolute(Path);
+    return Path.str();
+  }
+
+  Interpreter::CompilationResult
+  Interpreter::loadReloadableFile(const std::string& filename,
+                                  Transaction** T /*= 0*/) {
+    SessionJournal::Scope Journal(m_Journal.get());
+    const CompilationOptions CO = makeReloadableOpts(*this);
+    const std::string Path = getReloadablePath(*this, filename);
+    Transaction* LoadT = nullptr;
+    CompilationResult Res = DeclareInternal("#include \"" + Path + "\"", CO,
+                                            &LoadT);
+    if (Res == kSuccess && LoadT && m_Executor) {
+      if (!m_HotReload)
+        m_HotReload.reset(new HotReload(*m_IncrParser, m_Executor.get()));
+      m_HotReload->add(Path, *LoadT);
+    }
+    if (T)
+      *T = LoadT;
+    return Journal.commit(SessionJournal::kLoadHeader, CO.OptLevel, false,
+                          filename, Res);
+  }
+
+  Interpreter::CompilationResult
+  Interpreter::reloadFile(const std::string& filename) {
+    if (!m_HotReload)
+      return kMoreInputExpected;
+    switch (m_HotReload->reload(getReloadablePath(*this, filename))) {
+    case HotReload::kUnchanged:
+    case HotReload::kReloaded:
+      return kSuccess;
+    case HotReload::kFailed:
+      return kFailure;
+    case HotReload::kLoadAnew:
+      break;
+    }
+    return kMoreInputExpected;
+  }
+
+  ///\brief Runs the static destructors of the last numberOfTransactions
+  /// transactions, from the last one backwards.
+  static void runAndRemoveStaticDestructorsImpl(
+      IncrementalExecutor& executor,
+      IncrementalParser::const_transaction_range Ts,
+      size_t numberOfTransactions) {
+    for (Transaction* T : llvm::reverse(Ts)) {
+      if (!numberOfTransactions--)
+        break;
+      executor.runAndRemoveStaticDestructors(T);
     }
   }
 
   void Interpreter::runAndRemoveStaticDestructors(unsigned numberOfTransactions) {
     if (!m_Executor)
       return;
-    auto transactions( m_IncrParser->getAllTransactions() );
-    unsigned int min = 0;
-    if (transactions.size() > numberOfTransactions) {
-      min = transactions.size() - numberOfTransactions;
-    }
-    runAndRemoveStaticDestructorsImpl(*m_Executor, transactions,
-                                      transactions.size(), min);
+    runAndRemoveStaticDestructorsImpl(*m_Executor,
+                                      m_IncrParser->transactions(),
+                                      numberOfTransactions);
   }
 
   void Interpreter::runAndRemoveStaticDestructors() {
     if (!m_Executor)
       return;
-    auto transactions( m_IncrParser->getAllTransactions() );
-    runAndRemoveStaticDestructorsImpl(*m_Executor, transactions,
-                                      transactions.size(), 0);
+    runAndRemoveStaticDestructorsImpl(*m_Executor,
+                                      m_IncrParser->transactions(),
+                                      m_IncrParser->getNumTransactions());
   }
 
   void Interpreter::installLazyFunctionCreator(void* (*fp)(const std::string&)) {
@@ -1629,6 +3262,37 @@ namespace cling {
     return Result;
   }
 
+  Value Interpreter::EvaluateDynamic(runtime::internal::DynamicExprInfo* DEI,
+                                     DeclContext* DC) {
+    const unsigned NumAddresses = DEI->getNumAddresses();
+    std::unique_ptr<void*[]>& Slots = m_DynamicExprSlots[DEI->getTemplate()];
+    if (!Slots)
+      Slots.reset(new void*[NumAddresses ? NumAddresses : 1]());
+
+    // The expression may run itself, e.g. in a recursion: restore the
+    // caller's addresses and options afterwards, also if it throws.
+    struct RestoreRAII {
+      RuntimeOptions& Opts;
+      const bool WasCaching;
+      void** Slots;
+      llvm::SmallVector<void*, 8> Saved;
+
+      RestoreRAII(RuntimeOptions& O, void** S, unsigned N)
+        : Opts(O), WasCaching(O.CacheExpressions), Slots(S), Saved(S, S + N) {}
+      ~RestoreRAII() {
+        Opts.CacheExpressions = WasCaching;
+        std::copy(Saved.begin(), Saved.end(), Slots);
+      }
+    } Restore(m_RuntimeOptions, Slots.get(), NumAddresses);
+    DEI->bind(Slots.get());
+
+    // The text is the same for every evaluation of the template, so the
+    // expression cache keeps its wrapper until declarations change.
+    m_RuntimeOptions.CacheExpressions = true;
+    const std::string Expr = DEI->getExprReadingFrom(Slots.get());
+    return Evaluate(Expr.c_str(), DC, DEI->isValuePrinterRequested());
+  }
+
   void Interpreter::setCallbacks(std::unique_ptr<InterpreterCallbacks> C) {
     // We need it to enable LookupObject callback.
     if (!m_Callbacks) {
@@ -1671,6 +3335,54 @@ namespace cling {
     return m_IncrParser->getLastTransaction();
   }
 
+  unsigned Interpreter::getUnloadGeneration() const {
+    return DeclUnloader::getGeneration();
+  }
+
+  void Interpreter::declareRuntimeFor(const CompilationOptions& CO) {
+    if (!m_LazyRuntime)
+      return;
+    // Set before declaring: declare() compiles without either.
+    Transaction* T = nullptr;
+    if ((CO.ResultEvaluation || CO.ValuePrinting) && !m_ValueRuntimeDeclared) {
+      m_ValueRuntimeDeclared = true;
+      declare("#include \"cling/Interpreter/ValueRuntimeUniverse.h\"", &T);
+      m_ValueRuntimeT = T;
+    }
+    if (CO.CheckPointerValidity && !m_RuntimeOptions.SignalPointerChecks
+        && !isExecutorRemote() && !m_NullDerefRuntimeDeclared) {
+      m_NullDerefRuntimeDeclared = true;
+      T = nullptr;
+      declare("#include \"cling/Interpreter/NullDerefRuntimeUniverse.h\"",
+              &T);
+      m_NullDerefRuntimeT = T;
+    }
+  }
+
+  ///\brief Whether Part is T or nested into it.
+  static bool isPartOf(const Transaction* Part, const Transaction& T) {
+    for (; Part; Part = Part->getParent())
+      if (Part == &T)
+        return true;
+    return false;
+  }
+
+  void Interpreter::forgetRuntimeOf(const Transaction& T) {
+    bool Forgot = false;
+    if (isPartOf(m_ValueRuntimeT, T)) {
+      m_ValueRuntimeDeclared = false;
+      m_ValueRuntimeT = nullptr;
+      Forgot = true;
+    }
+    if (isPartOf(m_NullDerefRuntimeT, T)) {
+      m_NullDerefRuntimeDeclared = false;
+      m_NullDerefRuntimeT = nullptr;
+      Forgot = true;
+    }
+    if (Forgot)
+      m_IncrParser->forgetRuntime();
+  }
+
   void Interpreter::enableDynamicLookup(bool value /*=true*/) {
     if (!m_DynamicLookupDeclared && value) {
       // No dynlookup for the dynlookup header!
@@ -1683,6 +3395,25 @@ namespace cling {
     m_DynamicLookupEnabled = value;
   }
 
+  ///\brief Whether T declares nothing of its own input, only what the
+  /// headers it includes do.
+  static bool declaresOnlyHeaders(const Transaction& T,
+                                  const SourceManager& SM, FileID Input) {
+    if (T.getWrapperFD())
+      return false;
+    for (auto I = T.decls_begin(), E = T.decls_end(); I != E; ++I) {
+      if (I->m_Call != Transaction::kCCIHandleTopLevelDecl)
+        continue;
+      for (const Decl* D : I->m_DGR)
+        if (SM.getFileID(SM.getExpansionLoc(D->getBeginLoc())) == Input)
+          return false;
+    }
+    for (auto I = T.nested_begin(), E = T.nested_end(); I != E; ++I)
+      if (!declaresOnlyHeaders(**I, SM, Input))
+        return false;
+    return true;
+  }
+
   Interpreter::ExecutionResult
   Interpreter::executeTransaction(Transaction& T) {
     assert(!isInSyntaxOnlyMode() && "Running on what?");
@@ -1696,10 +3427,21 @@ namespace cling {
 
     // CUDA device code is not direct executable
     // the code is executed by a CUDA library function in the host code
-    if (!m_Opts.CompilerOpts.CUDADevice)
+    if (!m_Opts.CompilerOpts.CUDADevice) {
+      // The static initializers of the host register the fatbinary.
+      auto Start = std::chrono::steady_clock::now();
       // Forward to IncrementalExecutor; should not be called by
       // anyone except for IncrementalParser.
-      ExeRes = m_Executor->runStaticInitializersOnce(T);
+      const bool Defer = m_RuntimeOptions.DeferHeaderInitializers
+        && T.getBufferFID().isValid()
+        && declaresOnlyHeaders(T, getSema().getSourceManager(),
+                               T.getBufferFID());
+      ExeRes = m_Executor->runStaticInitializersOnce(T, Defer);
+      if (m_CUDACompiler)
+        m_CUDACompiler->addRegistrationTime(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - Start).count());
+    }
 
     return ConvertExecutionResult(ExeRes);
   }
@@ -1715,8 +3457,18 @@ namespace cling {
   void* Interpreter::getAddressOfGlobal(const GlobalDecl& GD,
                                         bool* fromJIT /*=0*/) const {
     // Return a symbol's address, and whether it was jitted.
-    std::string mangledName;
-    utils::Analyze::maybeMangleDeclName(GD, mangledName);
+    return lookupMangledName(getMangledName(GD), fromJIT);
+  }
+
+  const std::string& Interpreter::getMangledName(const GlobalDecl& GD) const {
+    std::string& mangledName = m_MangledNames[GD.getAsOpaquePtr()];
+    if (mangledName.empty())
+      utils::Analyze::maybeMangleDeclName(GD, mangledName);
+    return mangledName;
+  }
+
+  void* Interpreter::lookupMangledName(const std::string& mangledName,
+                                       bool* fromJIT) const {
 #if defined(_WIN32)
     // For some unknown reason, Clang 5.0 adds a special symbol ('\01') in front
     // of the mangled names on Windows, making them impossible to find
@@ -1735,6 +3487,27 @@ namespace cling {
     return getAddressOfGlobal(mangledName, fromJIT);
   }
 
+  Interpreter::SymbolHandle
+  Interpreter::getSymbolHandle(const GlobalDecl& GD) const {
+    SymbolHandle H;
+    H.m_Name = getMangledName(GD);
+    return H;
+  }
+
+  void* Interpreter::getAddressOfGlobal(const SymbolHandle& H,
+                                        bool* fromJIT /*=0*/) const {
+    if (isInSyntaxOnlyMode() || !H)
+      return 0;
+    const unsigned Generation = m_Executor->getSymbolGeneration();
+    if (!H.m_Address || H.m_Generation != Generation) {
+      H.m_Address = lookupMangledName(H.m_Name, &H.m_FromJIT);
+      H.m_Generation = Generation;
+    }
+    if (fromJIT)
+      *fromJIT = H.m_FromJIT;
+    return H.m_Address;
+  }
+
   void* Interpreter::getAddressOfGlobal(llvm::StringRef SymName,
                                         bool* fromJIT /*=0*/) const {
     // Return a symbol's address, and whether it was jitted.
@@ -1749,21 +3522,79 @@ namespace cling {
 
   void Interpreter::runAtExitFuncs() {
     assert(!isInSyntaxOnlyMode() && "Must have JIT");
-    m_Executor->runAtExitFuncs();
+    std::vector<const Transaction*> Transactions;
+    for (const Transaction* T = getFirstTransaction(); T; T = T->getNext())
+      Transactions.push_back(T);
+    // The latest transactions first. What the functions register goes to the
+    // latest transaction, and must run before the earlier ones.
+    for (auto I = Transactions.rbegin(), E = Transactions.rend(); I != E;
+         ++I) {
+      runAtExitFuncsOf(*m_Executor, **I);
+      runAtExitFuncsOf(*m_Executor, *Transactions.back());
+    }
   }
 
-  void Interpreter::GenerateAutoLoadingMap(llvm::StringRef inFile,
-                                           llvm::StringRef outFile,
-                                           bool enableMacros,
-                                           bool enableLogs) {
+  void Interpreter::prepareFork() {
+    if (DynamicLibraryManager* DLM = getDynamicLibraryManager())
+      DLM->joinPendingLoads();
+    m_AsyncEvaluator->drain();
+    if (m_Executor)
+      m_Executor->waitIdle();
+  }
 
-    const char *const dummy="cling_fwd_declarator";
+  void Interpreter::onForked() {
+    // The thread of the parent's evaluator is gone, so is its queue.
+    m_AsyncEvaluator.release();
+    m_AsyncEvaluator.reset(new AsyncEvaluator(*this));
+    if (m_Executor)
+      m_Executor->onForked();
+    if (DynamicLibraryManager* DLM = getDynamicLibraryManager())
+      DLM->onForked();
+  }
+
+  void Interpreter::fastExit(int ExitCode) {
+    // What ~Interpreter does that is seen outside of the process.
+    m_AsyncEvaluator.reset();
+    if (m_HeaderPCHCache && getCIOrNull() && !isInSyntaxOnlyMode())
+      m_HeaderPCHCache->update(*this);
+    if (m_Executor)
+      runAtExitFuncs();
+    if (m_IncrParser)
+      appendTimingStats(getTimingStats());
+    if (m_OwnsTimeTrace && !writeTimeTrace())
+      cling::errs() << "cling::Interpreter: cannot write the time trace to "
+                    << m_Opts.TimeTraceFile << "\n";
+
+    cling::outs().flush();
+    cling::errs().flush();
+    llvm::outs().flush();
+    llvm::errs().flush();
+    std::cout.flush();
+    std::cerr.flush();
+    ::fflush(nullptr);
+    std::_Exit(ExitCode);
+  }
+
+  bool Interpreter::parseForForwardDeclarations(llvm::StringRef inFile,
+         const std::function<void(Interpreter&, Transaction&)>& Print,
+         bool SyntaxOnly /*= false*/) {
+    const char *const args[] = {"cling_fwd_declarator", "-fsyntax-only"};
     // Create an interpreter without any runtime, producing the fwd decls.
     // FIXME: CIFactory appends extra 3 folders to the llvmdir.
     std::string llvmdir
       = getCI()->getHeaderSearchOpts().ResourceDir + "/../../../";
-    cling::Interpreter fwdGen(1, &dummy, llvmdir.c_str(),
-                              /*moduleExtensions*/ {}, /*noRuntime=*/true);
+    std::unique_ptr<Interpreter> fwdGenPtr;
+    {
+      // Setting up the compiler touches process wide state, e.g. the llvm
+      // options; parsing does not.
+      static std::mutex CreationMutex;
+      std::lock_guard<std::mutex> Lock(CreationMutex);
+      fwdGenPtr.reset(new Interpreter(SyntaxOnly ? 2 : 1, args,
+                                      llvmdir.c_str(),
+                                      /*moduleExtensions*/ {},
+                                      /*noRuntime=*/true));
+    }
+    Interpreter& fwdGen = *fwdGenPtr;
 
     // Copy the same header search options to the new instance.
     Preprocessor& fwdGenPP = fwdGen.getCI()->getPreprocessor();
@@ -1778,7 +3609,8 @@ namespace cling {
     CO.ValuePrinting = 0;
     CO.ResultEvaluation = 0;
     CO.DynamicScoping = 0;
-
+    if (SyntaxOnly)
+      CO.CodeGeneration = 0;
 
     std::string includeFile = std::string("#include \"") + inFile.str() + "\"";
     IncrementalParser::ParseResultTransaction PRT
@@ -1787,17 +3619,166 @@ namespace cling {
 
     // If this was already #included we will get a T == 0.
     if (PRT.getInt() == IncrementalParser::kFailed || !T)
-      return;
+      return false;
+
+    Print(fwdGen, *T);
+    return true;
+  }
+
+  void Interpreter::GenerateAutoLoadingMap(llvm::StringRef inFile,
+                                           llvm::StringRef outFile,
+                                           bool enableMacros,
+                                           bool enableLogs) {
+    parseForForwardDeclarations(inFile,
+                                [&](Interpreter& fwdGen, Transaction& T) {
+      std::error_code EC;
+      llvm::raw_fd_ostream out(outFile.data(), EC,
+                               llvm::sys::fs::OpenFlags::F_None);
+      llvm::raw_fd_ostream log((outFile + ".skipped").str().c_str(),
+                               EC, llvm::sys::fs::OpenFlags::F_None);
+      log << "Generated for :" << inFile << "\n";
+      forwardDeclare(T, fwdGen.getCI()->getPreprocessor(),
+                     fwdGen.getCI()->getSema().getASTContext(),
+                     out, enableMacros,
+                     &log);
+    });
+  }
+
+  bool Interpreter::collectForwardDeclarations(llvm::StringRef inFile,
+                                               AutoloadIndex& Index,
+                                               bool SyntaxOnly) {
+    return parseForForwardDeclarations(inFile,
+                                       [&](Interpreter& fwdGen,
+                                           Transaction& T) {
+      llvm::raw_null_ostream null;
+      ForwardDeclPrinter visitor(null, null, fwdGen.getCI()->getPreprocessor(),
+                                 fwdGen.getCI()->getSema().getASTContext(), T,
+                                 0, false,
+                                 [](const clang::PresumedLoc&) { return false; },
+                                 &Index);
+      // Avoid assertion in the ~IncrementalParser.
+      T.setState(Transaction::kCommitted);
+    }, SyntaxOnly);
+  }
+
+  bool Interpreter::GenerateAutoLoadingIndex(llvm::StringRef inFile,
+                                             llvm::StringRef outFile) {
+    AutoloadIndex Index;
+    if (!collectForwardDeclarations(inFile, Index, /*SyntaxOnly*/ false))
+      return false;
+
+    std::string Error;
+    if (!Index.write(outFile, Error)) {
+      cling::errs() << "Error: cannot write the autoload index " << outFile
+                    << ": " << Error << '\n';
+      return false;
+    }
+    return true;
+  }
+
+  bool Interpreter::GenerateAutoLoadingMaps(llvm::ArrayRef<std::string> inFiles,
+                                            llvm::StringRef outFile,
+                                            unsigned Jobs /*= 0*/) {
+    if (!Jobs)
+      Jobs = std::max(std::thread::hardware_concurrency(), 1u);
+    Jobs = std::min<size_t>(Jobs, inFiles.size());
+
+    // Each header gets an index of its own, such that the threads share
+    // nothing but the next header to parse.
+    std::vector<AutoloadIndex> Indexes(inFiles.size());
+    std::unique_ptr<bool[]> Parsed(new bool[inFiles.size()]());
+    std::atomic<size_t> Next(0);
+    auto Work = [&]() {
+      for (size_t I = Next++; I < inFiles.size(); I = Next++)
+        Parsed[I] = collectForwardDeclarations(inFiles[I], Indexes[I],
+                                              /*SyntaxOnly*/ true);
+    };
+    std::vector<std::thread> Workers;
+    for (unsigned I = 1; I < Jobs; ++I)
+      Workers.emplace_back(Work);
+    Work();
+    for (std::thread& Worker : Workers)
+      Worker.join();
+
+    // Merge in the order of inFiles, whichever thread parsed them: a chunk
+    // printed for several headers is the same declaration, annotated with
+    // the first header reaching it.
+    AutoloadIndex Merged;
+    llvm::StringMap<unsigned> ChunkOfDecl;
+    bool Success = true;
+    for (size_t I = 0, E = inFiles.size(); I < E; ++I) {
+      if (!Parsed[I]) {
+        cling::errs() << "Error: cannot generate the autoloading map of "
+                      << inFiles[I] << '\n';
+        Success = false;
+        continue;
+      }
+      const AutoloadIndex& Index = Indexes[I];
+      if (Merged.getPrelude().empty())
+        Merged.setPrelude(Index.getPrelude());
+      // Dependencies have smaller ids, and thus get merged first.
+      std::vector<unsigned> NewId(Index.size());
+      for (unsigned C = 0, CE = Index.size(); C < CE; ++C) {
+        const AutoloadIndex::Chunk& Chunk = Index.getChunk(C);
+        auto Known = ChunkOfDecl.insert(
+          std::make_pair(withoutAutoloadAnnotations(Chunk.Text),
+                         unsigned(Merged.size())));
+        if (!Known.second) {
+          NewId[C] = Known.first->second;
+          continue;
+        }
+        std::vector<unsigned> Deps;
+        for (unsigned D : Chunk.Deps)
+          Deps.push_back(NewId[D]);
+        NewId[C] = Merged.addChunk(Chunk.Text, std::move(Deps));
+      }
+      for (const auto& Name : Index.names())
+        for (unsigned C : Name.getValue())
+          Merged.addName(Name.getKey(), NewId[C]);
+    }
+
+    std::string Error;
+    if (outFile.endswith(".clidx")) {
+      if (!Merged.write(outFile, Error)) {
+        cling::errs() << "Error: cannot write the autoload index " << outFile
+                      << ": " << Error << '\n';
+        return false;
+      }
+      return Success;
+    }
 
     std::error_code EC;
-    llvm::raw_fd_ostream out(outFile.data(), EC,
-                             llvm::sys::fs::OpenFlags::F_None);
-    llvm::raw_fd_ostream log((outFile + ".skipped").str().c_str(),
-                             EC, llvm::sys::fs::OpenFlags::F_None);
-    log << "Generated for :" << inFile << "\n";
-    forwardDeclare(*T, fwdGenPP, fwdGen.getCI()->getSema().getASTContext(),
-                   out, enableMacros,
-                   &log);
+    llvm::raw_fd_ostream out(outFile, EC, llvm::sys::fs::OpenFlags::F_None);
+    if (!EC) {
+      out << Merged.getPrelude();
+      for (unsigned C = 0, CE = Merged.size(); C < CE; ++C)
+        out << Merged.getChunk(C).Text;
+      out.close();
+      if (out.has_error()) {
+        out.clear_error();
+        EC = std::make_error_code(std::errc::io_error);
+      }
+    }
+    if (EC) {
+      cling::errs() << "Error: cannot write the autoloading map " << outFile
+                    << ": " << EC.message() << '\n';
+      return false;
+    }
+    return Success;
+  }
+
+  bool Interpreter::loadAutoLoadingIndex(llvm::StringRef File) {
+    if (!m_AutoloadCallback)
+      return false;
+    std::string Error;
+    std::unique_ptr<AutoloadIndex> Index = AutoloadIndex::read(File, Error);
+    if (!Index) {
+      cling::errs() << "Error: cannot read the autoload index " << File
+                    << ": " << Error << '\n';
+      return false;
+    }
+    m_AutoloadCallback->addIndex(std::move(Index));
+    return true;
   }
 
   void Interpreter::forwardDeclare(Transaction& T, Preprocessor& P,
@@ -1822,11 +3803,14 @@ namespace cling {
       CLING_LIB_EXPORT
       Value EvaluateDynamicExpression(Interpreter* interp, DynamicExprInfo* DEI,
                                       clang::DeclContext* DC) {
+        // The expression is in the AST of the interpreter running it; gCling
+        // only helps code run from outside of a wrapper, e.g. by the host.
+        if (Interpreter* Current = Interpreter::getCurrent())
+          interp = Current;
         Value ret = [&]
         {
           LockCompilationDuringUserCodeExecutionRAII LCDUCER(*interp);
-          return interp->Evaluate(DEI->getExpr(), DC,
-                                  DEI->isValuePrinterRequested());
+          return interp->EvaluateDynamic(DEI, DC);
         }();
         if (!ret.isValid()) {
           std::string msg = "Error evaluating expression ";
@@ -16,6 +16,7 @@
 #include "clang/Frontend/MultiplexConsumer.h"
 #include "clang/Lex/Preprocessor.h"
 #include "clang/Sema/CodeCompleteConsumer.h"
+#include "clang/Sema/Lookup.h"
 #include "clang/Sema/MultiplexExternalSemaSource.h"
 #include "clang/Sema/Sema.h"
 #include "clang/Serialization/ASTDeserializationListener.h"
@@ -265,7 +266,8 @@ namespace cling {
     ///\returns true if a suitable declaration is found.
     ///
     virtual bool LookupUnqualified(clang::LookupResult& R, clang::Scope* S) {
-      if (m_Callbacks) {
+      if (m_Callbacks && m_Callbacks->mightLookup(
+                             LookupNameFilter::hash(R.getLookupName()))) {
         return m_Callbacks->LookupObject(R, S);
       }
 
@@ -274,7 +276,8 @@ namespace cling {
 
     virtual bool FindExternalVisibleDeclsByName(const clang::DeclContext* DC,
                                                 clang::DeclarationName Name) {
-      if (m_Callbacks)
+      if (m_Callbacks
+          && m_Callbacks->mightLookup(LookupNameFilter::hash(Name)))
         return m_Callbacks->LookupObject(DC, Name);
 
       return false;
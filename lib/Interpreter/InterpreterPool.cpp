@@ -0,0 +1,218 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "cling/Interpreter/InterpreterPool.h"
+
+#include "cling/Interpreter/Interpreter.h"
+#include "cling/Interpreter/Transaction.h"
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cassert>
+#include <chrono>
+
+namespace {
+  typedef std::chrono::steady_clock Clock;
+
+  static uint64_t nanosecondsSince(Clock::time_point Start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now()
+                                                                - Start)
+      .count();
+  }
+} // unnamed namespace
+
+namespace cling {
+
+  struct InterpreterPool::Slot {
+    std::unique_ptr<Interpreter> Interp;
+
+    ///\brief The last transaction of the prelude, and its position in the
+    /// list of transactions. The pointer is only compared, never followed:
+    /// the user might have unloaded the checkpoint itself.
+    const Transaction* Checkpoint = nullptr;
+    unsigned CheckpointIndex = 0;
+
+    ///\brief Whether the interpreter and its prelude were set up.
+    bool Valid = false;
+
+    Clock::time_point LeasedAt;
+  };
+
+  InterpreterPool::Lease&
+  InterpreterPool::Lease::operator=(Lease&& Other) {
+    if (this != &Other) {
+      release();
+      m_Pool = Other.m_Pool;
+      m_Slot = Other.m_Slot;
+      Other.m_Pool = nullptr;
+    }
+    return *this;
+  }
+
+  Interpreter& InterpreterPool::Lease::operator*() const {
+    return *m_Pool->m_Slots[m_Slot]->Interp;
+  }
+
+  void InterpreterPool::Lease::release() {
+    if (!m_Pool)
+      return;
+    InterpreterPool* Pool = m_Pool;
+    m_Pool = nullptr;
+    Pool->giveBack(m_Slot);
+  }
+
+  InterpreterPool::InterpreterPool(unsigned Size, int argc,
+                                   const char* const* argv,
+                                   const char* llvmdir /*= 0*/,
+                                   const std::string& Prelude /*= ""*/):
+    m_Args(argv, argv + argc), m_LLVMDir(llvmdir ? llvmdir : ""),
+    m_HasLLVMDir(llvmdir), m_Prelude(Prelude), m_Stats() {
+    if (!Size)
+      Size = 1;
+    m_Stats.Size = Size;
+    m_Slots.reserve(Size);
+    m_Free.reserve(Size);
+    for (unsigned I = 0; I < Size; ++I) {
+      m_Slots.emplace_back(new Slot());
+      setUp(*m_Slots.back());
+      // Hand out the first slots first, they are the warmest.
+      m_Free.push_back(Size - 1 - I);
+    }
+  }
+
+  InterpreterPool::~InterpreterPool() {
+    // Interpreters must not outlive their leases.
+    assert(m_Free.size() == m_Slots.size() && "Interpreters still leased!");
+  }
+
+  bool InterpreterPool::setUp(Slot& S) {
+    std::vector<const char*> Argv;
+    Argv.reserve(m_Args.size());
+    for (const std::string& Arg : m_Args)
+      Argv.push_back(Arg.c_str());
+
+    S.Interp.reset();
+    S.Interp.reset(new Interpreter(Argv.size(), Argv.data(),
+                                   m_HasLLVMDir ? m_LLVMDir.c_str() : 0));
+    S.Valid = S.Interp->isValid();
+    if (S.Valid && !m_Prelude.empty())
+      S.Valid = S.Interp->process(m_Prelude, /*V*/0, /*T*/0,
+                                  /*disableValuePrinting*/true)
+        == Interpreter::kSuccess;
+
+    S.Checkpoint = S.Interp->getLastTransaction();
+    S.CheckpointIndex = 0;
+    for (const Transaction* T = S.Interp->getFirstTransaction();
+         T && T != S.Checkpoint; T = T->getNext())
+      ++S.CheckpointIndex;
+    return S.Valid;
+  }
+
+  void InterpreterPool::reset(Slot& S) {
+    // Count the transactions after the checkpoint; the checkpoint must still
+    // be where it was.
+    unsigned Index = 0;
+    const Transaction* T = S.Interp->getFirstTransaction();
+    for (; T && Index < S.CheckpointIndex; T = T->getNext())
+      ++Index;
+    bool Reverted = T && T == S.Checkpoint;
+    if (Reverted) {
+      unsigned Since = 0;
+      for (T = T->getNext(); T; T = T->getNext())
+        ++Since;
+      if (Since)
+        S.Interp->unload(Since);
+      Reverted = S.Interp->getLastTransaction() == S.Checkpoint;
+    }
+    if (Reverted)
+      return;
+
+    setUp(S);
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+    ++m_Stats.Replacements;
+  }
+
+  InterpreterPool::Lease
+  InterpreterPool::take(std::unique_lock<std::mutex>& Lock) {
+    const unsigned Index = m_Free.back();
+    m_Free.pop_back();
+    ++m_Stats.Leases;
+    if (++m_Stats.InUse > m_Stats.PeakInUse)
+      m_Stats.PeakInUse = m_Stats.InUse;
+    m_Slots[Index]->LeasedAt = Clock::now();
+    return Lease(this, Index);
+  }
+
+  void InterpreterPool::giveBack(unsigned Index) {
+    Slot& S = *m_Slots[Index];
+    const uint64_t LeasedNs = nanosecondsSince(S.LeasedAt);
+
+    // The slot is still exclusively ours: reset it without holding the lock.
+    const Clock::time_point ResetStart = Clock::now();
+    reset(S);
+    const uint64_t ResetNs = nanosecondsSince(ResetStart);
+
+    {
+      std::lock_guard<std::mutex> Lock(m_Mutex);
+      m_Stats.LeasedNs += LeasedNs;
+      m_Stats.ResetNs += ResetNs;
+      --m_Stats.InUse;
+      m_Free.push_back(Index);
+    }
+    m_Released.notify_one();
+  }
+
+  bool InterpreterPool::isValid() const {
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+    for (const std::unique_ptr<Slot>& S : m_Slots)
+      if (!S->Valid)
+        return false;
+    return true;
+  }
+
+  InterpreterPool::Lease InterpreterPool::acquire() {
+    std::unique_lock<std::mutex> Lock(m_Mutex);
+    if (m_Free.empty()) {
+      ++m_Stats.Waits;
+      const Clock::time_point WaitStart = Clock::now();
+      m_Released.wait(Lock, [this] { return !m_Free.empty(); });
+      m_Stats.WaitNs += nanosecondsSince(WaitStart);
+    }
+    return take(Lock);
+  }
+
+  InterpreterPool::Lease InterpreterPool::tryAcquire() {
+    std::unique_lock<std::mutex> Lock(m_Mutex);
+    if (m_Free.empty())
+      return Lease();
+    return take(Lock);
+  }
+
+  InterpreterPool::Stats InterpreterPool::getStats() const {
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+    return m_Stats;
+  }
+
+  void InterpreterPool::printStats(llvm::raw_ostream& Out) const {
+    const Stats S = getStats();
+    Out << "Interpreter pool: " << S.Size << " interpreters, " << S.InUse
+        << " in use, at most " << S.PeakInUse << " at once\n";
+    Out << llvm::format("%-14s %10llu\n", "leases",
+                        (unsigned long long)S.Leases);
+    Out << llvm::format("%-14s %10llu %12.3f ms\n", "waits",
+                        (unsigned long long)S.Waits, S.WaitNs / 1e6);
+    Out << llvm::format("%-14s %10llu %12.3f ms\n", "resets",
+                        (unsigned long long)S.Leases - S.InUse,
+                        S.ResetNs / 1e6);
+    Out << llvm::format("%-14s %10llu\n", "replacements",
+                        (unsigned long long)S.Replacements);
+    Out << llvm::format("%-14s %10s %12.3f ms\n", "leased", "",
+                        S.LeasedNs / 1e6);
+  }
+} // end namespace cling
@@ -18,7 +18,10 @@
 #include "llvm/Option/ArgList.h"
 #include "llvm/Option/Option.h"
 #include "llvm/Option/OptTable.h"
+#include "llvm/Support/FileSystem.h"
 
+#include <algorithm>
+#include <cstring>
 #include <memory>
 
 using namespace clang;
@@ -75,6 +78,44 @@ static const char kNoStdInc[] = "-nostdinc";
     Opts.ShowVersion = Args.hasArg(OPT_version);
     Opts.Help = Args.hasArg(OPT_help);
     Opts.NoRuntime = Args.hasArg(OPT_noruntime);
+    Opts.LazyFunctions = Args.hasArg(OPT__lazy_functions);
+    Opts.DeferSystemBodies = Args.hasArg(OPT__defer_bodies);
+    Opts.DeferBodiesDirs = Args.getAllArgValues(OPT__defer_bodies_EQ);
+    Opts.PointerChecksDirs = Args.getAllArgValues(OPT__pointer_checks_dir_EQ);
+    Opts.ScopedPointerChecks = Args.hasArg(OPT__pointer_checks_input)
+                               || !Opts.PointerChecksDirs.empty();
+    Opts.StructuredDiagnostics = Args.hasArg(OPT__structured_diagnostics);
+    Opts.FastExit = Args.hasArg(OPT__fast_exit);
+    Opts.BatchStdin = Args.hasArg(OPT__batch_stdin);
+    if (Arg* TraceArg = Args.getLastArg(OPT__time_trace_EQ))
+      Opts.TimeTraceFile = TraceArg->getValue();
+    if (Arg* ServerArg = Args.getLastArg(OPT__fork_server_EQ))
+      Opts.ForkServerSocket = ServerArg->getValue();
+    if (Arg* MapArg = Args.getLastArg(OPT__generate_autoload_map_EQ))
+      Opts.AutoloadMapFile = MapArg->getValue();
+    if (Arg* JobsArg = Args.getLastArg(OPT__generate_autoload_map_jobs_EQ)) {
+      if (StringRef(JobsArg->getValue())
+            .getAsInteger(10, Opts.AutoloadMapJobs)) {
+        cling::errs() << "ERROR: invalid number of jobs "
+                      << JobsArg->getValue() << "! Using one per core.\n";
+        Opts.AutoloadMapJobs = 0;
+      }
+    }
+    if (Arg* JobsArg = Args.getLastArg(OPT_j)) {
+      if (StringRef(JobsArg->getValue()).getAsInteger(10, Opts.Jobs)) {
+        cling::errs() << "ERROR: invalid number of jobs "
+                      << JobsArg->getValue() << "! Running one per core.\n";
+        Opts.Jobs = 0;
+      }
+    }
+    if (Arg* BudgetArg = Args.getLastArg(OPT__compile_budget_EQ)) {
+      if (StringRef(BudgetArg->getValue())
+            .getAsInteger(10, Opts.CompileBudgetMs)) {
+        cling::errs() << "ERROR: invalid compile budget "
+                      << BudgetArg->getValue() << "! Using none.\n";
+        Opts.CompileBudgetMs = 0;
+      }
+    }
     if (Arg* MetaStringArg = Args.getLastArg(OPT__metastr, OPT__metastr_EQ)) {
       Opts.MetaString = MetaStringArg->getValue();
       if (Opts.MetaString.empty()) {
@@ -90,6 +131,28 @@ static const char kNoStdInc[] = "-nostdinc";
       A.push_back(std::move(Val));
   }
 
+  ///\brief Parses --snapshot; an existing snapshot is passed to clang as
+  /// -include-pch unless another PCH was requested.
+  static void ParseSnapshotOpts(cling::InvocationOptions& Opts,
+                                InputArgList& Args) {
+    Arg* SnapshotArg = Args.getLastArg(OPT__snapshot_EQ);
+    if (!SnapshotArg)
+      return;
+    Opts.SnapshotFile = SnapshotArg->getValue();
+    Opts.SnapshotPrelude = Args.getAllArgValues(OPT__snapshot_prelude_EQ);
+    Opts.SnapshotInstantiations
+      = Args.getAllArgValues(OPT__snapshot_instantiate_EQ);
+    if (!llvm::sys::fs::exists(Opts.SnapshotFile))
+      return;
+    std::vector<const char*>& Remaining = Opts.CompilerOpts.Remaining;
+    for (const char* A : Remaining)
+      if (!::strcmp(A, "-include-pch"))
+        return;
+    // Both strings outlive the options: the value points into argv.
+    Remaining.push_back("-include-pch");
+    Remaining.push_back(SnapshotArg->getValue());
+  }
+
   static void ParseLinkerOpts(cling::InvocationOptions& Opts,
                               InputArgList& Args /* , Diags */) {
     Extend(Opts.LibsToLoad, Args.getAllArgValues(OPT_l));
@@ -100,7 +163,8 @@ static const char kNoStdInc[] = "-nostdinc";
 CompilerOptions::CompilerOptions(int argc, const char* const* argv)
     : Language(false), ResourceDir(false), SysRoot(false), NoBuiltinInc(false),
       NoCXXInc(false), StdVersion(false), StdLib(false), HasOutput(false),
-      Verbose(false), CxxModules(false), CUDAHost(false), CUDADevice(false) {
+      Verbose(false), CxxModules(false), CUDAHost(false), CUDADevice(false),
+      TargetCPU(false) {
   if (argc && argv) {
     // Preserve what's already in Remaining, the user might want to push args
     // to clang while still using main's argc, argv
@@ -145,10 +209,16 @@ void CompilerOptions::Parse(int argc, const char* const argv[],
       case options::OPT_fmodule_name: ModuleName = arg->getValue(); break;
       case options::OPT_fmodules_cache_path: CachePath = arg->getValue(); break;
       case options::OPT_cuda_path_EQ: CUDAPath = arg->getValue(); break;
-      case options::OPT_cuda_gpu_arch_EQ: CUDAGpuArch = arg->getValue(); break;
+      case options::OPT_cuda_gpu_arch_EQ:
+        CUDAGpuArch = arg->getValue();
+        CUDAGpuArchs.push_back(CUDAGpuArch);
+        break;
       case options::OPT_Xcuda_fatbinary:
         CUDAFatbinaryArgs.push_back(arg->getValue());
         break;
+      case options::OPT_march_EQ:
+      case options::OPT_mcpu_EQ:
+      case options::OPT_target: TargetCPU = true; break;
       case options::OPT_cuda_device_only:
         Language = true;
         CUDADevice = true;
@@ -179,8 +249,14 @@ bool CompilerOptions::DefaultLanguage(const LangOptions* LangOpts) const {
 }
 
 InvocationOptions::InvocationOptions(int argc, const char* const* argv) :
-  MetaString("."), ErrorOut(false), NoLogo(false), ShowVersion(false),
-  Help(false), NoRuntime(false) {
+  MetaString("."), AutoloadMapJobs(0), Jobs(1), CompileBudgetMs(0),
+  ErrorOut(false),
+  NoLogo(false),
+  ShowVersion(false),
+  Help(false), NoRuntime(false), LazyFunctions(false),
+  DeferSystemBodies(false), ScopedPointerChecks(false),
+  StructuredDiagnostics(false), FastExit(false),
+  BatchStdin(false) {
 
   ArrayRef<const char *> ArgStrings(argv, argv + argc);
   unsigned MissingArgIndex, MissingArgCount;
@@ -215,8 +291,21 @@ InvocationOptions::InvocationOptions(int argc, const char* const* argv) :
     }
   }
 
-  // Get Input list and any compiler specific flags we're interested in
-  CompilerOpts.Parse(argc, argv, &Inputs);
+  ParseSnapshotOpts(*this, Args);
+
+  // Get Input list and any compiler specific flags we're interested in; the
+  // value of -j is no input.
+  std::vector<const char*> CompilerArgv(argv, argv + argc);
+  for (const Arg* JobsArg : Args.filtered(OPT_j)) {
+    const unsigned Index = JobsArg->getIndex();
+    if (!::strcmp(argv[Index], "-j") && Index + 1 < unsigned(argc))
+      CompilerArgv[Index + 1] = nullptr;
+    CompilerArgv[Index] = nullptr;
+  }
+  CompilerArgv.erase(std::remove(CompilerArgv.begin(), CompilerArgv.end(),
+                                 nullptr),
+                     CompilerArgv.end());
+  CompilerOpts.Parse(CompilerArgv.size(), CompilerArgv.data(), &Inputs);
 
   ParseStartupOpts(*this, Args);
   ParseLinkerOpts(*this, Args);
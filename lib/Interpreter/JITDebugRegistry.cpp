@@ -0,0 +1,226 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "JITDebugRegistry.h"
+
+#include "llvm/Support/Compiler.h"
+#include "llvm/Support/Signals.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+
+#if defined(__GLIBC__) || defined(__APPLE__)
+#include <execinfo.h>
+#define CLING_HAVE_BACKTRACE 1
+#endif
+
+// The JIT interface of GDB, which LLDB implements too; see "JIT Interface"
+// in the GDB manual. LLVM's GDBRegistrationListener defines the descriptor
+// and the function the debuggers break on; cling does not use the listener
+// itself, leaving the descriptor to this registry.
+extern "C" {
+  enum { JIT_NOACTION = 0, JIT_REGISTER_FN, JIT_UNREGISTER_FN };
+
+  struct jit_code_entry {
+    jit_code_entry* next_entry;
+    jit_code_entry* prev_entry;
+    const char* symfile_addr;
+    uint64_t symfile_size;
+  };
+
+  struct jit_descriptor {
+    uint32_t version;
+    uint32_t action_flag;
+    jit_code_entry* relevant_entry;
+    jit_code_entry* first_entry;
+  };
+
+  extern jit_descriptor __jit_debug_descriptor;
+  void __jit_debug_register_code();
+
+  ///\brief To call from the debugger, e.g. `call
+  /// cling_jit_debug_register_at($pc)`.
+  LLVM_ATTRIBUTE_USED void cling_jit_debug_register_at(void* Addr) {
+    const uintptr_t PC = reinterpret_cast<uintptr_t>(Addr);
+    cling::JITDebugRegistry::registerAt(&PC, 1, /*Blocking*/ true);
+  }
+
+  LLVM_ATTRIBUTE_USED void cling_jit_debug_register_all() {
+    cling::JITDebugRegistry::registerAll();
+  }
+}
+
+namespace {
+  using namespace cling;
+
+  ///\brief Guards the registries, their objects and the descriptor. A
+  /// spin lock, which the signal handler can try to take: unlike a mutex,
+  /// the atomic flag is async-signal-safe.
+  class SpinLock {
+    std::atomic_flag m_Flag = ATOMIC_FLAG_INIT;
+
+  public:
+    bool try_lock() { return !m_Flag.test_and_set(std::memory_order_acquire); }
+    void lock() {
+      while (!try_lock())
+        std::this_thread::yield();
+    }
+    void unlock() { m_Flag.clear(std::memory_order_release); }
+  };
+
+  static SpinLock& getMutex() {
+    static SpinLock Lock;
+    return Lock;
+  }
+
+  static std::vector<JITDebugRegistry*>& getRegistries() {
+    static std::vector<JITDebugRegistry*> Registries;
+    return Registries;
+  }
+
+  ///\brief Runs in the signal handler: allocates nothing and only takes the
+  /// lock if it is free.
+  static void RegisterStackOnCrash(void*) {
+#ifdef CLING_HAVE_BACKTRACE
+    void* Frames[256];
+    const int NumFrames = ::backtrace(Frames, 256);
+    uintptr_t PCs[256];
+    for (int I = 0; I < NumFrames; ++I)
+      PCs[I] = reinterpret_cast<uintptr_t>(Frames[I]);
+    JITDebugRegistry::registerAt(PCs, NumFrames, /*Blocking*/ false);
+#else
+    // Without the stack, the debugger needs all of the code.
+    JITDebugRegistry::registerAll();
+#endif
+  }
+} // unnamed namespace
+
+namespace cling {
+
+  bool JITDebugRegistry::Object::contains(uintptr_t Addr) const {
+    for (const auto& Range : Code)
+      if (Addr >= Range.first && Addr - Range.first < Range.second)
+        return true;
+    return false;
+  }
+
+  JITDebugRegistry::JITDebugRegistry() {
+    static std::once_flag HandlerInstalled;
+    std::call_once(HandlerInstalled, [] {
+#ifdef CLING_HAVE_BACKTRACE
+      // Its first call loads libgcc, which allocates.
+      void* Frame;
+      ::backtrace(&Frame, 1);
+#endif
+      llvm::sys::AddSignalHandler(RegisterStackOnCrash, nullptr);
+    });
+    std::lock_guard<SpinLock> Lock(getMutex());
+    getRegistries().push_back(this);
+  }
+
+  JITDebugRegistry::~JITDebugRegistry() {
+    std::lock_guard<SpinLock> Lock(getMutex());
+    for (auto& KO : m_Objects)
+      deregisterObject(KO.second);
+    std::vector<JITDebugRegistry*>& Registries = getRegistries();
+    Registries.erase(std::find(Registries.begin(), Registries.end(), this));
+  }
+
+  std::unique_ptr<JITDebugRegistry> JITDebugRegistry::createFromEnv() {
+    if (!::getenv("CLING_JIT_DEBUG"))
+      return nullptr;
+    return std::unique_ptr<JITDebugRegistry>(new JITDebugRegistry());
+  }
+
+  void JITDebugRegistry::registerObject(Object& O) {
+    if (O.Registered)
+      return;
+    O.Registered = true;
+    O.Entry->prev_entry = nullptr;
+    O.Entry->next_entry = __jit_debug_descriptor.first_entry;
+    if (O.Entry->next_entry)
+      O.Entry->next_entry->prev_entry = O.Entry.get();
+    __jit_debug_descriptor.first_entry = O.Entry.get();
+    __jit_debug_descriptor.relevant_entry = O.Entry.get();
+    __jit_debug_descriptor.action_flag = JIT_REGISTER_FN;
+    __jit_debug_register_code();
+  }
+
+  void JITDebugRegistry::deregisterObject(Object& O) {
+    jit_code_entry* Entry = O.Entry.get();
+    if (!O.Registered)
+      return;
+    if (Entry->prev_entry)
+      Entry->prev_entry->next_entry = Entry->next_entry;
+    else
+      __jit_debug_descriptor.first_entry = Entry->next_entry;
+    if (Entry->next_entry)
+      Entry->next_entry->prev_entry = Entry->prev_entry;
+    __jit_debug_descriptor.relevant_entry = Entry;
+    __jit_debug_descriptor.action_flag = JIT_UNREGISTER_FN;
+    __jit_debug_register_code();
+    O.Registered = false;
+  }
+
+  void JITDebugRegistry::registerAt(const uintptr_t* Addrs, size_t NumAddrs,
+                                    bool Blocking) {
+    std::unique_lock<SpinLock> Lock(getMutex(), std::defer_lock);
+    if (Blocking)
+      Lock.lock();
+    else if (!Lock.try_lock())
+      return;
+    for (JITDebugRegistry* Registry : getRegistries())
+      for (auto& KO : Registry->m_Objects)
+        for (size_t I = 0; I < NumAddrs; ++I)
+          if (KO.second.contains(Addrs[I])) {
+            registerObject(KO.second);
+            break;
+          }
+  }
+
+  void JITDebugRegistry::registerAll() {
+    std::lock_guard<SpinLock> Lock(getMutex());
+    for (JITDebugRegistry* Registry : getRegistries())
+      for (auto& KO : Registry->m_Objects)
+        registerObject(KO.second);
+  }
+
+  void JITDebugRegistry::notifyObjectLoaded(
+      ObjectKey K, const llvm::object::ObjectFile& Obj,
+      const llvm::RuntimeDyld::LoadedObjectInfo& L) {
+    // The copy the debugger reads, with its sections at their addresses.
+    Object O;
+    O.DebugObj = L.getObjectForDebug(Obj);
+    if (!O.DebugObj.getBinary())
+      return;
+    llvm::MemoryBufferRef Buf = O.DebugObj.getBinary()->getMemoryBufferRef();
+    O.Entry.reset(new jit_code_entry());
+    O.Entry->symfile_addr = Buf.getBufferStart();
+    O.Entry->symfile_size = Buf.getBufferSize();
+    for (const llvm::object::SectionRef& Sec : Obj.sections()) {
+      if (!Sec.isText() || !Sec.getSize())
+        continue;
+      if (uint64_t Load = L.getSectionLoadAddress(Sec))
+        O.Code.push_back({uintptr_t(Load), uintptr_t(Sec.getSize())});
+    }
+    std::lock_guard<SpinLock> Lock(getMutex());
+    m_Objects[K] = std::move(O);
+  }
+
+  void JITDebugRegistry::notifyFreeingObject(ObjectKey K) {
+    std::lock_guard<SpinLock> Lock(getMutex());
+    auto I = m_Objects.find(K);
+    if (I == m_Objects.end())
+      return;
+    deregisterObject(I->second);
+    m_Objects.erase(I);
+  }
+} // end namespace cling
@@ -0,0 +1,89 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_JIT_DEBUG_REGISTRY_H
+#define CLING_JIT_DEBUG_REGISTRY_H
+
+#include "llvm/ExecutionEngine/JITEventListener.h"
+#include "llvm/Object/ObjectFile.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+struct jit_code_entry;
+
+namespace cling {
+  ///\brief Registers the JITted objects with GDB and LLDB, through their JIT
+  /// interface; but only when they are needed.
+  ///
+  /// A registration stops the process in the debugger, which then reads the
+  /// object's debug info: registering every transaction slows the session
+  /// down, with or without a debugger. Loading an object thus only keeps a
+  /// copy of it for the debugger. The objects get registered
+  ///  - on crash signals, those that contain a function on the stack, so
+  ///    that the core dump or the debugger catching the crash can see them;
+  ///  - from the debugger, through
+  ///    `call cling_jit_debug_register_at($pc)`, the object containing the
+  ///    address, or `call cling_jit_debug_register_all()`.
+  ///
+  /// Removing an object deregisters it.
+  ///
+  class JITDebugRegistry : public llvm::JITEventListener {
+    struct Object {
+      ///\brief The object with its sections at their load addresses.
+      llvm::object::OwningBinary<llvm::object::ObjectFile> DebugObj;
+
+      ///\brief The load address and size of its code sections.
+      std::vector<std::pair<uintptr_t, uintptr_t>> Code;
+
+      ///\brief Its entry in the debugger's list; allocated with the
+      /// object, as the signal handler cannot.
+      std::unique_ptr<jit_code_entry> Entry;
+      bool Registered = false;
+
+      bool contains(uintptr_t Addr) const;
+    };
+
+    ///\brief The objects loaded, guarded by the lock of all registries:
+    /// objects can be linked concurrently, for each interpreter.
+    std::map<ObjectKey, Object> m_Objects;
+
+    JITDebugRegistry();
+
+    ///\brief Adds O to the debugger's list unless it is on it already.
+    static void registerObject(Object& O);
+    static void deregisterObject(Object& O);
+
+  public:
+    ~JITDebugRegistry();
+
+    ///\brief Creates the registry if the environment variable
+    /// CLING_JIT_DEBUG is set, returns null otherwise.
+    static std::unique_ptr<JITDebugRegistry> createFromEnv();
+
+    ///\brief Registers the objects of all registries containing one of the
+    /// addresses.
+    ///\param Blocking - whether to wait for objects being linked, which
+    /// a signal handler cannot.
+    static void registerAt(const uintptr_t* Addrs, size_t NumAddrs,
+                           bool Blocking);
+
+    ///\brief Registers the objects of all registries.
+    static void registerAll();
+
+    void
+    notifyObjectLoaded(ObjectKey K, const llvm::object::ObjectFile& Obj,
+                       const llvm::RuntimeDyld::LoadedObjectInfo& L) override;
+    void notifyFreeingObject(ObjectKey K) override;
+  };
+} // end namespace cling
+
+#endif // CLING_JIT_DEBUG_REGISTRY_H
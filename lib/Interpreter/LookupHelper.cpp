@@ -11,11 +11,14 @@
 #include "cling/Utils/Output.h"
 
 #include "DeclUnloader.h"
+#include "StateLock.h"
 #include "cling/Interpreter/Interpreter.h"
 #include "cling/Utils/AST.h"
+#include "cling/Utils/Diagnostics.h"
 #include "cling/Utils/ParserStateRAII.h"
 
 #include "clang/AST/ASTContext.h"
+#include "clang/AST/DeclContextInternals.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Parse/Parser.h"
 #include "clang/Parse/RAIIObjectsForParser.h"
@@ -26,6 +29,13 @@
 #include "clang/Sema/Template.h"
 #include "clang/Sema/TemplateDeduction.h"
 
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/STLExtras.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
 using namespace clang;
 
 namespace cling {
@@ -35,9 +45,15 @@ namespace cling {
      char fBuffer[sizeof(clang::OpaqueValueExpr)];
   };
 
+  ///\brief The size of the pooled lookup buffers; longer code gets a buffer
+  /// of its own.
+  static constexpr size_t kPooledBufferSize = 1024;
+
   class StartParsingRAII {
     LookupHelper& m_LH;
     llvm::SaveAndRestore<bool> SaveIsRecursivelyRunning;
+    // Give back the pooled buffers used, once the parser left them.
+    llvm::SaveAndRestore<unsigned> SavePooledBuffersInUse;
     // Save and restore the state of the Parser and lexer.
     // Note: ROOT::Internal::ParsingStateRAII also save and restore the state of
     // Sema, including pending instantiation for example.  It is not clear
@@ -54,6 +70,7 @@ namespace cling {
                      llvm::StringRef bufferName,
                      LookupHelper::DiagSetting diagOnOff)
         : m_LH(LH), SaveIsRecursivelyRunning(LH.IsRecursivelyRunning),
+          SavePooledBuffersInUse(LH.m_PooledBuffersInUse),
           fCleanupRAII(LH.m_Parser->getPreprocessor()),
           fSavedCurToken(*LH.m_Parser),
           ResetParserState(*LH.m_Parser,
@@ -65,8 +82,74 @@ namespace cling {
 
     ~StartParsingRAII() { pop(); }
     void pop() const {}
+
+    ///\brief Switches the parser to a pooled buffer holding the code, unless
+    /// the code does not fit. Returns whether it did.
+    bool enterPooledBuffer(llvm::StringRef code);
+
+    ///\brief Switches the parser to the code, the way #include does, for a
+    /// reparse within the same lookup.
+    ///
+    /// Note: To switch back to the main file we must consume an eof token.
+    ///
+    void enterBuffer(llvm::StringRef code, llvm::StringRef bufferName);
   };
 
+  bool StartParsingRAII::enterPooledBuffer(llvm::StringRef code) {
+    // Code spanning lines would change the line table of the buffer.
+    if (!m_LH.m_UsePooledBuffers || code.size() >= kPooledBufferSize
+        || code.find_first_of("\n\r") != llvm::StringRef::npos)
+      return false;
+
+    Preprocessor& PP = m_LH.m_Parser->getPreprocessor();
+    SourceManager& SM = PP.getSourceManager();
+    if (m_LH.m_PooledBuffersInUse == m_LH.m_PooledBuffers.size()) {
+      std::unique_ptr<llvm::WritableMemoryBuffer> Buf
+        = llvm::WritableMemoryBuffer::getNewUninitMemBuffer(kPooledBufferSize,
+                                                            "lookup.buffer");
+      char* Data = Buf->getBufferStart();
+      FileID FID = SM.createFileID(std::move(Buf), SrcMgr::C_User,
+                                   /*LoadedID*/0, /*LoadedOffset*/0,
+                                   m_LH.m_Interpreter->getNextAvailableLoc());
+      m_LH.m_PooledBuffers.push_back(
+        {SM.getLocForStartOfFile(FID).getRawEncoding(), Data});
+    }
+    const LookupHelper::PooledBuffer& Pooled
+      = m_LH.m_PooledBuffers[m_LH.m_PooledBuffersInUse++];
+
+    // The code, padded with blanks, then the newline: each line always
+    // starts at the same offset.
+    std::memcpy(Pooled.Data, code.data(), code.size());
+    std::memset(Pooled.Data + code.size(), ' ',
+                kPooledBufferSize - 1 - code.size());
+    Pooled.Data[kPooledBufferSize - 1] = '\n';
+
+    FileID FID
+      = SM.getFileID(SourceLocation::getFromRawEncoding(Pooled.FileStartLoc));
+    // See the reuse of cached buffers in prepareForParsing().
+    SM.setNumCreatedFIDsForFileID(FID, 0, /*force*/ true);
+    PP.EnterSourceFile(FID, /*DirLookup*/0, SM.getIncludeLoc(FID));
+    PP.Lex(const_cast<Token&>(m_LH.m_Parser->getCurToken()));
+    return true;
+  }
+
+  void StartParsingRAII::enterBuffer(llvm::StringRef code,
+                                     llvm::StringRef bufferName) {
+    if (enterPooledBuffer(code))
+      return;
+    Preprocessor& PP = m_LH.m_Parser->getPreprocessor();
+    std::unique_ptr<llvm::MemoryBuffer> SB
+      = llvm::MemoryBuffer::getMemBufferCopy(code.str() + "\n",
+                                             bufferName.str());
+    SourceLocation NewLoc = m_LH.m_Interpreter->getNextAvailableLoc();
+    FileID FID = PP.getSourceManager().createFileID(std::move(SB),
+                                                    SrcMgr::C_User,
+                                                    /*LoadedID*/0,
+                                                    /*LoadedOffset*/0, NewLoc);
+    PP.EnterSourceFile(FID, /*DirLookup*/0, NewLoc);
+    PP.Lex(const_cast<Token&>(m_LH.m_Parser->getCurToken()));
+  }
+
   void StartParsingRAII::prepareForParsing(llvm::StringRef code,
                                            llvm::StringRef bufferName,
                                           LookupHelper::DiagSetting diagOnOff) {
@@ -103,6 +186,10 @@ namespace cling {
     assert(!code.empty() &&
            "prepareForParsing should only be called when need");
 
+    // Write the code into a pooled buffer, if it fits.
+    if (enterPooledBuffer(code))
+      return;
+
     // Create a fake file to parse the type name.
     FileID FID;
     llvm::hash_code hashedCode = llvm::hash_value(code);
@@ -164,14 +251,304 @@ namespace cling {
     PP.Lex(const_cast<Token&>(P.getCurToken()));
   }
 
+  ///\brief Pushes the transaction of a lookup, unless the lookup is an item
+  /// of a batch, which pushed one for all its items.
+  class LookupTransactionRAII {
+    llvm::Optional<Interpreter::PushTransactionRAII> m_Pushed;
+  public:
+    LookupTransactionRAII(const LookupHelper& LH) {
+      if (!LH.m_InBatch)
+        m_Pushed.emplace(LH.m_Interpreter);
+    }
+  };
+
   // pin *tor here so that we can have clang::Parser defined and be able to call
   // the dtor on the OwningPtr
   LookupHelper::LookupHelper(clang::Parser* P, Interpreter* interp)
     : m_Parser(P), m_Interpreter(interp) {
+    if (const char* Env = ::getenv("CLING_LOOKUP_CACHE"))
+      m_UseLookupCache = llvm::StringRef(Env) != "0";
+    if (const char* Env = ::getenv("CLING_LOOKUP_BUFFER_POOL"))
+      m_UsePooledBuffers = llvm::StringRef(Env) != "0";
   }
 
   LookupHelper::~LookupHelper() {}
 
+  namespace {
+    enum LookupKind : char {
+      kFindType,
+      kFindScope,
+      kFindDataMember,
+      kFindFunctionProto,
+      kMatchFunctionProto
+    };
+  }
+
+  ///\brief Builds the key of a query in the lookup cache. Names cannot
+  /// contain '\0', which separates them from the arguments.
+  static std::string makeLookupKey(LookupKind Kind, const void* Scope,
+                                   llvm::StringRef Name, llvm::StringRef Args,
+                                   LookupHelper::DiagSetting diagOnOff,
+                                   bool Flag = false) {
+    std::string Key;
+    Key.reserve(3 + sizeof(Scope) + Name.size() + 1 + Args.size());
+    Key += Kind;
+    Key += char(diagOnOff);
+    Key += char(Flag);
+    Key.append(reinterpret_cast<const char*>(&Scope), sizeof(Scope));
+    Key += Name;
+    Key += '\0';
+    Key += Args;
+    return Key;
+  }
+
+  ///\brief Lists the parameter types of a function prototype query as the
+  /// arguments of a lookup cache key. Starts with '\0' to be distinct from
+  /// any textual prototype.
+  static std::string
+  makeLookupArgs(const llvm::SmallVectorImpl<QualType>& Types) {
+    std::string Args(1, '\0');
+    for (QualType QT : Types) {
+      const void* Ptr = QT.getAsOpaquePtr();
+      Args.append(reinterpret_cast<const char*>(&Ptr), sizeof(Ptr));
+    }
+    return Args;
+  }
+
+  bool LookupHelper::canUseCache() const {
+    if (!m_UseLookupCache || m_Interpreter->getCurrentTransaction())
+      return false;
+    const unsigned Generation = DeclUnloader::getGeneration();
+    if (Generation != m_LookupCacheGeneration) {
+      m_LookupCache.clear();
+      m_LookupCacheGeneration = Generation;
+    }
+    return true;
+  }
+
+  const LookupHelper::CachedLookup*
+  LookupHelper::getCached(const std::string& Key) const {
+    auto I = m_LookupCache.find(Key);
+    if (I == m_LookupCache.end())
+      return nullptr;
+    ++m_LookupCacheHits;
+    return &I->second;
+  }
+
+  void LookupHelper::addCached(std::string Key, const void* Result,
+                               const clang::Type* Type,
+                               DiagSetting diagOnOff) const {
+    if (!Result && diagOnOff == WithDiagnostics)
+      return;
+    // The lookup might have unloaded invalid declarations, which might be
+    // what it found.
+    if (DeclUnloader::getGeneration() != m_LookupCacheGeneration)
+      return;
+    m_LookupCache[std::move(Key)] = CachedLookup{Result, Type};
+  }
+
+  namespace {
+    ///\brief Outcome of a read-only lookup.
+    enum ReadOnlyResult {
+      kAnswered,
+      kNeedsFullLookup
+    };
+  }
+
+  ///\brief Finds the unique declaration named Name in DC without changing
+  /// anything: through the lookup table DC already built, not creating the
+  /// identifier. Result is null if there is no such declaration.
+  static ReadOnlyResult lookupReadOnly(const DeclContext* DC,
+                                       llvm::StringRef Name,
+                                       const IdentifierTable& Idents,
+                                       const NamedDecl*& Result) {
+    Result = nullptr;
+    if (Name.empty())
+      return kNeedsFullLookup;
+    auto II = Idents.find(Name);
+    if (II == Idents.end()) {
+      // Declarations from an AST file might introduce it.
+      return Idents.getExternalIdentifierLookup() ? kNeedsFullLookup
+                                                  : kAnswered;
+    }
+    const IdentifierInfo* Info = II->getValue();
+    if (Info->isOutOfDate())
+      return kNeedsFullLookup;
+
+    DC = DC->getPrimaryContext();
+    const StoredDeclsMap* Map = DC->getLookupPtr();
+    if (!Map || DC->hasExternalVisibleStorage())
+      return kNeedsFullLookup;
+    auto I = Map->find(DeclarationName(Info));
+    if (I == Map->end()) {
+      // Names made visible by using directives are not in the table.
+      if (Map->count(UsingDirectiveDecl::getName()))
+        return kNeedsFullLookup;
+      return kAnswered;
+    }
+    const StoredDeclsList& Decls = I->second;
+    if (Decls.hasExternalDecls())
+      return kNeedsFullLookup;
+    if (NamedDecl* ND = Decls.getAsDecl())
+      Result = ND;
+    else if (const StoredDeclsList::DeclsTy* Vec = Decls.getAsVector()) {
+      // Let Sema pick the visible one of several declarations.
+      if (Vec->size() > 1)
+        return kNeedsFullLookup;
+      if (!Vec->empty())
+        Result = Vec->front();
+    }
+    if (const UsingShadowDecl* USD = dyn_cast_or_null<UsingShadowDecl>(Result))
+      Result = USD->getTargetDecl();
+    return kAnswered;
+  }
+
+  ///\brief Turns the result of lookupReadOnly() into what findScope()
+  /// returns for it, without completing the scope. Scope is null if Found is
+  /// not a scope.
+  static ReadOnlyResult getScopeReadOnly(const NamedDecl* Found,
+                                         bool HasExternalSource,
+                                         const Decl*& Scope,
+                                         const Type*& ScopeType) {
+    Scope = nullptr;
+    ScopeType = nullptr;
+    if (const auto* NSD = dyn_cast<NamespaceDecl>(Found)) {
+      Scope = NSD->getCanonicalDecl();
+      return kAnswered;
+    }
+    if (const auto* Alias = dyn_cast<NamespaceAliasDecl>(Found)) {
+      Scope = Alias->getNamespace()->getCanonicalDecl();
+      return kAnswered;
+    }
+    // Finding the definition of a tag might need to complete its
+    // redeclaration chain from the external source.
+    const TagDecl* Tag = dyn_cast<TagDecl>(Found);
+    if (const auto* TND = dyn_cast<TypedefNameDecl>(Found)) {
+      // The type of a typedef is created by its first use.
+      ScopeType = TND->getTypeForDecl();
+      if (!ScopeType || HasExternalSource)
+        return kNeedsFullLookup;
+      if (const TagType* TT = ScopeType->getAs<TagType>())
+        Tag = TT->getDecl();
+    } else if (Tag)
+      ScopeType = Tag->getTypeForDecl();
+    if (!Tag) {
+      ScopeType = nullptr;
+      return kAnswered;
+    }
+    if (!Tag->isCompleteDefinition()) {
+      if (HasExternalSource)
+        return kNeedsFullLookup;
+      // findScope() would complete or instantiate it.
+      Tag = Tag->getDefinition();
+      if (!Tag)
+        return kNeedsFullLookup;
+    }
+    Scope = Tag;
+    return kAnswered;
+  }
+
+  bool LookupHelper::mayQueryReadOnly() const {
+    // Declarations being parsed are visible before they are committed.
+    return !m_Interpreter->getCurrentTransaction();
+  }
+
+  const LookupHelper::CachedLookup*
+  LookupHelper::getCachedReadOnly(const std::string& Key) const {
+    if (!m_UseLookupCache
+        || DeclUnloader::getGeneration() != m_LookupCacheGeneration)
+      return nullptr;
+    auto I = m_LookupCache.find(Key);
+    return I == m_LookupCache.end() ? nullptr : &I->second;
+  }
+
+  const Decl*
+  LookupHelper::findScopeReadOnly(llvm::StringRef className, bool& answered,
+                                  const Type** resultType /*= 0*/) const {
+    StateLock::ReaderRAII Lock(m_Interpreter->getStateLock());
+    answered = false;
+    if (!mayQueryReadOnly())
+      return nullptr;
+
+    if (const CachedLookup* Cached
+        = getCachedReadOnly(makeLookupKey(kFindScope, nullptr, className,
+                                          llvm::StringRef(), NoDiagnostics,
+                                          /*instantiateTemplate*/ true))) {
+      answered = true;
+      if (resultType)
+        *resultType = Cached->Type;
+      return static_cast<const Decl*>(Cached->Result);
+    }
+
+    // Template arguments, pointers and the like need the parser.
+    if (className.startswith("::"))
+      className = className.drop_front(2);
+    if (className.empty()
+        || className.find_first_of("<>()[]&*, \t") != llvm::StringRef::npos)
+      return nullptr;
+
+    const Sema& S = m_Parser->getActions();
+    const bool HasExternalSource = S.getASTContext().getExternalSource();
+    const IdentifierTable& Idents = S.getPreprocessor().getIdentifierTable();
+    const DeclContext* DC = S.getASTContext().getTranslationUnitDecl();
+    while (true) {
+      const size_t Sep = className.find("::");
+      const NamedDecl* Found = nullptr;
+      if (lookupReadOnly(DC, className.substr(0, Sep), Idents, Found)
+          != kAnswered)
+        return nullptr;
+      const Decl* Scope = nullptr;
+      const Type* ScopeType = nullptr;
+      if (Found && getScopeReadOnly(Found, HasExternalSource, Scope, ScopeType)
+                   != kAnswered)
+        return nullptr;
+      if (!Scope || Sep == llvm::StringRef::npos) {
+        answered = true;
+        if (resultType)
+          *resultType = ScopeType;
+        return Scope;
+      }
+      className = className.substr(Sep + 2);
+      if (className.empty()) {
+        // "A::" names nothing.
+        answered = true;
+        return nullptr;
+      }
+      DC = cast<DeclContext>(Scope);
+    }
+  }
+
+  const ValueDecl*
+  LookupHelper::findDataMemberReadOnly(const clang::Decl* scopeDecl,
+                                       llvm::StringRef dataName,
+                                       bool& answered) const {
+    StateLock::ReaderRAII Lock(m_Interpreter->getStateLock());
+    answered = false;
+    if (!mayQueryReadOnly())
+      return nullptr;
+
+    if (const CachedLookup* Cached
+        = getCachedReadOnly(makeLookupKey(kFindDataMember, scopeDecl, dataName,
+                                          llvm::StringRef(), NoDiagnostics))) {
+      answered = true;
+      return static_cast<const ValueDecl*>(Cached->Result);
+    }
+
+    // Looking into an incomplete class needs to complete it.
+    if (const auto* Tag = dyn_cast<TagDecl>(scopeDecl))
+      if (!Tag->isCompleteDefinition())
+        return nullptr;
+
+    const Preprocessor& PP = m_Parser->getPreprocessor();
+    const NamedDecl* Found = nullptr;
+    if (lookupReadOnly(cast<DeclContext>(scopeDecl), dataName,
+                       PP.getIdentifierTable(), Found) != kAnswered)
+      return nullptr;
+    answered = true;
+    const ValueDecl* VD = dyn_cast_or_null<ValueDecl>(Found);
+    return VD && !isa<FunctionDecl>(VD) ? VD : nullptr;
+  }
+
   static
   DeclContext* getCompleteContext(const Decl* scopeDecl,
                                   ASTContext& Context, Sema &S);
@@ -469,6 +846,23 @@ namespace cling {
 
   QualType LookupHelper::findType(llvm::StringRef typeName,
                                   DiagSetting diagOnOff) const {
+    // Lookups change the parser's and Sema's state, and the cache.
+    std::lock_guard<StateLock> Lock(m_Interpreter->getStateLock());
+    std::string Key;
+    if (canUseCache()) {
+      Key = makeLookupKey(kFindType, nullptr, typeName, llvm::StringRef(),
+                          diagOnOff);
+      if (const CachedLookup* Cached = getCached(Key))
+        return QualType::getFromOpaquePtr(Cached->Result);
+    }
+    QualType QT = findTypeUncached(typeName, diagOnOff);
+    if (!Key.empty())
+      addCached(std::move(Key), QT.getAsOpaquePtr(), nullptr, diagOnOff);
+    return QT;
+  }
+
+  QualType LookupHelper::findTypeUncached(llvm::StringRef typeName,
+                                          DiagSetting diagOnOff) const {
     //
     //  Our return value.
     //
@@ -477,7 +871,7 @@ namespace cling {
     if (typeName.empty()) return TheQT;
 
     // Could trigger deserialization of decls.
-    Interpreter::PushTransactionRAII RAII(m_Interpreter);
+    LookupTransactionRAII RAII(*this);
 
     // Deal with the most common case.
     // Going through this custom finder is both much faster
@@ -523,6 +917,33 @@ namespace cling {
                                       DiagSetting diagOnOff,
                                       const Type** resultType /* = 0 */,
                                       bool instantiateTemplate/*=true*/) const {
+    // Lookups change the parser's and Sema's state, and the cache.
+    std::lock_guard<StateLock> Lock(m_Interpreter->getStateLock());
+    std::string Key;
+    if (canUseCache()) {
+      Key = makeLookupKey(kFindScope, nullptr, className, llvm::StringRef(),
+                          diagOnOff, instantiateTemplate);
+      if (const CachedLookup* Cached = getCached(Key)) {
+        if (resultType)
+          *resultType = Cached->Type;
+        return static_cast<const Decl*>(Cached->Result);
+      }
+    }
+    // Always ask for the type, to have it cached.
+    const Type* TheType = nullptr;
+    const Decl* TheDecl = findScopeUncached(className, diagOnOff, &TheType,
+                                            instantiateTemplate);
+    if (resultType)
+      *resultType = TheType;
+    if (!Key.empty())
+      addCached(std::move(Key), TheDecl, TheType, diagOnOff);
+    return TheDecl;
+  }
+
+  const Decl* LookupHelper::findScopeUncached(llvm::StringRef className,
+                                              DiagSetting diagOnOff,
+                                              const Type** resultType,
+                                              bool instantiateTemplate) const {
 
     //
     //  Some utilities.
@@ -538,7 +959,7 @@ namespace cling {
     // Here we might not have an active transaction to handle
     // the caused instantiation decl.
     // Also quickFindDecl could trigger deserialization of decls.
-    Interpreter::PushTransactionRAII pushedT(m_Interpreter);
+    LookupTransactionRAII pushedT(*this);
 
     // See if we can find it without a buffer and any clang parsing,
     // We need to go scope by scope.
@@ -757,17 +1178,7 @@ namespace cling {
     //
     //  Setup to reparse as a type.
     //
-
-    std::unique_ptr<llvm::MemoryBuffer>
-      SB(llvm::MemoryBuffer::getMemBufferCopy(className.str() + "\n",
-                                              "lookup.type.file"));
-    SourceLocation NewLoc = m_Interpreter->getNextAvailableLoc();
-    FileID FID = S.getSourceManager().createFileID(std::move(SB),
-                                                   SrcMgr::C_User,
-                                                   /*LoadedID*/0,
-                                                   /*LoadedOffset*/0, NewLoc);
-    PP.EnterSourceFile(FID, /*DirLookup*/0, NewLoc);
-    PP.Lex(const_cast<clang::Token&>(P.getCurToken()));
+    ParseStarted.enterBuffer(className, "lookup.type.file");
 
     //
     //  Now try to parse the name as a type.
@@ -910,6 +1321,26 @@ namespace cling {
   const ValueDecl* LookupHelper::findDataMember(const clang::Decl* scopeDecl,
                                                 llvm::StringRef dataName,
                                                 DiagSetting diagOnOff) const {
+    // Lookups change the parser's and Sema's state, and the cache.
+    std::lock_guard<StateLock> Lock(m_Interpreter->getStateLock());
+    std::string Key;
+    if (canUseCache()) {
+      Key = makeLookupKey(kFindDataMember, scopeDecl, dataName,
+                          llvm::StringRef(), diagOnOff);
+      if (const CachedLookup* Cached = getCached(Key))
+        return static_cast<const ValueDecl*>(Cached->Result);
+    }
+    const ValueDecl* VD = findDataMemberUncached(scopeDecl, dataName,
+                                                 diagOnOff);
+    if (!Key.empty())
+      addCached(std::move(Key), VD, nullptr, diagOnOff);
+    return VD;
+  }
+
+  const ValueDecl*
+  LookupHelper::findDataMemberUncached(const clang::Decl* scopeDecl,
+                                       llvm::StringRef dataName,
+                                       DiagSetting diagOnOff) const {
     // Lookup a data member based on its Decl(Context), name.
 
     Parser& P = *m_Parser;
@@ -1582,7 +2013,7 @@ namespace cling {
     llvm::SmallVector<Expr*, 4> GivenArgs;
     if (!inputEval(GivenArgs,funcArgs,diagOnOff,P,Interp,LH)) return 0;
 
-    Interpreter::PushTransactionRAII pushedT(Interp);
+    LookupTransactionRAII pushedT(LH);
     return findFunction(foundDC,
                         funcName, GivenArgs, objectIsConst,
                         Context, Interp, functionSelector,
@@ -1849,14 +2280,25 @@ namespace cling {
                                   DiagSetting diagOnOff, bool objectIsConst) const {
     assert(scopeDecl && "Decl cannot be null");
 
-    return execFindFunction<ExprFromTypes>(*m_Parser, m_Interpreter,
-                                           const_cast<LookupHelper&>(*this),
-                                           scopeDecl,
-                                           funcName,
-                                           funcProto,
-                                           objectIsConst,
-                                           overloadFunctionSelector,
-                                           diagOnOff);
+    // Lookups change the parser's and Sema's state, and the cache.
+    std::lock_guard<StateLock> Lock(m_Interpreter->getStateLock());
+    std::string Key;
+    if (canUseCache()) {
+      Key = makeLookupKey(kFindFunctionProto, scopeDecl, funcName,
+                          makeLookupArgs(funcProto), diagOnOff,
+                          objectIsConst);
+      if (const CachedLookup* Cached = getCached(Key))
+        return static_cast<const FunctionDecl*>(Cached->Result);
+    }
+    const FunctionDecl* FD
+      = execFindFunction<ExprFromTypes>(*m_Parser, m_Interpreter,
+                                        const_cast<LookupHelper&>(*this),
+                                        scopeDecl, funcName, funcProto,
+                                        objectIsConst, overloadFunctionSelector,
+                                        diagOnOff);
+    if (!Key.empty())
+      addCached(std::move(Key), FD, nullptr, diagOnOff);
+    return FD;
   }
 
   const FunctionDecl* LookupHelper::findFunctionProto(const Decl* scopeDecl,
@@ -1866,14 +2308,190 @@ namespace cling {
                                                       bool objectIsConst) const{
     assert(scopeDecl && "Decl cannot be null");
 
-    return execFindFunction<ParseProto>(*m_Parser, m_Interpreter,
-                                        const_cast<LookupHelper&>(*this),
-                                        scopeDecl,
-                                        funcName,
-                                        funcProto,
-                                        objectIsConst,
-                                        overloadFunctionSelector,
-                                        diagOnOff);
+    // Lookups change the parser's and Sema's state, and the cache.
+    std::lock_guard<StateLock> Lock(m_Interpreter->getStateLock());
+    std::string Key;
+    if (canUseCache()) {
+      Key = makeLookupKey(kFindFunctionProto, scopeDecl, funcName, funcProto,
+                          diagOnOff, objectIsConst);
+      if (const CachedLookup* Cached = getCached(Key))
+        return static_cast<const FunctionDecl*>(Cached->Result);
+    }
+    const FunctionDecl* FD
+      = execFindFunction<ParseProto>(*m_Parser, m_Interpreter,
+                                     const_cast<LookupHelper&>(*this),
+                                     scopeDecl, funcName, funcProto,
+                                     objectIsConst, overloadFunctionSelector,
+                                     diagOnOff);
+    if (!Key.empty())
+      addCached(std::move(Key), FD, nullptr, diagOnOff);
+    return FD;
+  }
+
+  void LookupHelper::runBatch(llvm::ArrayRef<unsigned> Todo,
+                              DiagSetting diagOnOff,
+                  llvm::function_ref<std::vector<std::string>&(unsigned)>
+                                DiagnosticsOf,
+                              llvm::function_ref<void(unsigned)> Lookup) const {
+    DiagnosticsEngine& Diags = m_Parser->getActions().getDiagnostics();
+    std::vector<std::string>* Current = nullptr;
+    utils::StructuredDiagnostics Collect(
+      [&Current](const utils::DiagnosticRecord& Record) {
+        if (Current)
+          Current->push_back(Record.Message.str());
+      });
+    llvm::Optional<utils::ReplaceDiagnostics> Replaced;
+    if (diagOnOff == WithDiagnostics)
+      Replaced.emplace(Diags, Collect, /*Own*/ false);
+
+    llvm::SaveAndRestore<bool> SaveInBatch(m_InBatch, true);
+    // The items [Begin, End) share a transaction. An error rolls it back,
+    // with what the items before the failed one found: these are redone,
+    // then the failed one first of the rest, such that it fails on its own.
+    size_t Begin = 0, End = Todo.size();
+    while (Begin != End) {
+      size_t I = Begin;
+      {
+        Interpreter::PushTransactionRAII pushedT(m_Interpreter);
+        for (; I != End; ++I) {
+          Current = &DiagnosticsOf(Todo[I]);
+          Current->clear();
+          Lookup(Todo[I]);
+          if (Diags.hasErrorOccurred())
+            break;
+        }
+        Current = nullptr;
+      }
+      if (I != Begin && I != End) {
+        End = I;
+        continue;
+      }
+      Begin = I == End ? End : I + 1;
+      End = Todo.size();
+    }
+  }
+
+  std::vector<LookupHelper::BatchResult<QualType>>
+  LookupHelper::findTypes(llvm::ArrayRef<std::string> typeNames,
+                          DiagSetting diagOnOff) const {
+    // Lookups change the parser's and Sema's state, and the cache.
+    std::lock_guard<StateLock> Lock(m_Interpreter->getStateLock());
+    std::vector<BatchResult<QualType>> Results(typeNames.size());
+    std::vector<std::string> Keys(typeNames.size());
+    std::vector<unsigned> Todo;
+    const bool UseCache = canUseCache();
+    for (unsigned I = 0, N = typeNames.size(); I != N; ++I) {
+      if (UseCache) {
+        Keys[I] = makeLookupKey(kFindType, nullptr, typeNames[I],
+                                llvm::StringRef(), diagOnOff);
+        if (const CachedLookup* Cached = getCached(Keys[I])) {
+          Results[I].Result = QualType::getFromOpaquePtr(Cached->Result);
+          continue;
+        }
+      }
+      Todo.push_back(I);
+    }
+    runBatch(Todo, diagOnOff,
+             [&Results](unsigned I) -> std::vector<std::string>& {
+               return Results[I].Diagnostics;
+             },
+             [&](unsigned I) {
+               Results[I].Result = findTypeUncached(typeNames[I], diagOnOff);
+             });
+    if (UseCache) {
+      for (unsigned I : Todo)
+        addCached(std::move(Keys[I]), Results[I].Result.getAsOpaquePtr(),
+                  nullptr, diagOnOff);
+    }
+    return Results;
+  }
+
+  std::vector<LookupHelper::BatchResult<const Decl*>>
+  LookupHelper::findScopes(llvm::ArrayRef<std::string> classNames,
+                           DiagSetting diagOnOff,
+                           std::vector<const Type*>* resultTypes /*= 0*/,
+                           bool instantiateTemplate /*= true*/) const {
+    // Lookups change the parser's and Sema's state, and the cache.
+    std::lock_guard<StateLock> Lock(m_Interpreter->getStateLock());
+    std::vector<BatchResult<const Decl*>> Results(classNames.size());
+    // Always ask for the types, to have them cached.
+    std::vector<const Type*> Types(classNames.size());
+    std::vector<std::string> Keys(classNames.size());
+    std::vector<unsigned> Todo;
+    const bool UseCache = canUseCache();
+    for (unsigned I = 0, N = classNames.size(); I != N; ++I) {
+      if (UseCache) {
+        Keys[I] = makeLookupKey(kFindScope, nullptr, classNames[I],
+                                llvm::StringRef(), diagOnOff,
+                                instantiateTemplate);
+        if (const CachedLookup* Cached = getCached(Keys[I])) {
+          Results[I].Result = static_cast<const Decl*>(Cached->Result);
+          Types[I] = Cached->Type;
+          continue;
+        }
+      }
+      Todo.push_back(I);
+    }
+    runBatch(Todo, diagOnOff,
+             [&Results](unsigned I) -> std::vector<std::string>& {
+               return Results[I].Diagnostics;
+             },
+             [&](unsigned I) {
+               Results[I].Result
+                 = findScopeUncached(classNames[I], diagOnOff, &Types[I],
+                                     instantiateTemplate);
+             });
+    if (UseCache) {
+      for (unsigned I : Todo)
+        addCached(std::move(Keys[I]), Results[I].Result, Types[I],
+                  diagOnOff);
+    }
+    if (resultTypes)
+      resultTypes->swap(Types);
+    return Results;
+  }
+
+  std::vector<LookupHelper::BatchResult<const FunctionDecl*>>
+  LookupHelper::findFunctionProtos(llvm::ArrayRef<FunctionProtoQuery> Queries,
+                                   DiagSetting diagOnOff) const {
+    // Lookups change the parser's and Sema's state, and the cache.
+    std::lock_guard<StateLock> Lock(m_Interpreter->getStateLock());
+    std::vector<BatchResult<const FunctionDecl*>> Results(Queries.size());
+    std::vector<std::string> Keys(Queries.size());
+    std::vector<unsigned> Todo;
+    const bool UseCache = canUseCache();
+    for (unsigned I = 0, N = Queries.size(); I != N; ++I) {
+      const FunctionProtoQuery& Q = Queries[I];
+      assert(Q.Scope && "Decl cannot be null");
+      if (UseCache) {
+        Keys[I] = makeLookupKey(kFindFunctionProto, Q.Scope, Q.Name, Q.Proto,
+                                diagOnOff, Q.ObjectIsConst);
+        if (const CachedLookup* Cached = getCached(Keys[I])) {
+          Results[I].Result = static_cast<const FunctionDecl*>(Cached->Result);
+          continue;
+        }
+      }
+      Todo.push_back(I);
+    }
+    runBatch(Todo, diagOnOff,
+             [&Results](unsigned I) -> std::vector<std::string>& {
+               return Results[I].Diagnostics;
+             },
+             [&](unsigned I) {
+               const FunctionProtoQuery& Q = Queries[I];
+               Results[I].Result
+                 = execFindFunction<ParseProto>(*m_Parser, m_Interpreter,
+                                          const_cast<LookupHelper&>(*this),
+                                                Q.Scope, Q.Name, Q.Proto,
+                                                Q.ObjectIsConst,
+                                                overloadFunctionSelector,
+                                                diagOnOff);
+             });
+    if (UseCache) {
+      for (unsigned I : Todo)
+        addCached(std::move(Keys[I]), Results[I].Result, nullptr, diagOnOff);
+    }
+    return Results;
   }
 
   const FunctionDecl*
@@ -1884,14 +2502,24 @@ namespace cling {
                                    bool objectIsConst) const {
     assert(scopeDecl && "Decl cannot be null");
 
-    return execFindFunction<ParseProto>(*m_Parser, m_Interpreter,
-                                        const_cast<LookupHelper&>(*this),
-                                        scopeDecl,
-                                        funcName,
-                                        funcProto,
-                                        objectIsConst,
-                                        matchFunctionSelector,
-                                        diagOnOff);
+    // Lookups change the parser's and Sema's state, and the cache.
+    std::lock_guard<StateLock> Lock(m_Interpreter->getStateLock());
+    std::string Key;
+    if (canUseCache()) {
+      Key = makeLookupKey(kMatchFunctionProto, scopeDecl, funcName, funcProto,
+                          diagOnOff, objectIsConst);
+      if (const CachedLookup* Cached = getCached(Key))
+        return static_cast<const FunctionDecl*>(Cached->Result);
+    }
+    const FunctionDecl* FD
+      = execFindFunction<ParseProto>(*m_Parser, m_Interpreter,
+                                     const_cast<LookupHelper&>(*this),
+                                     scopeDecl, funcName, funcProto,
+                                     objectIsConst, matchFunctionSelector,
+                                     diagOnOff);
+    if (!Key.empty())
+      addCached(std::move(Key), FD, nullptr, diagOnOff);
+    return FD;
   }
 
   const FunctionDecl*
@@ -1902,14 +2530,25 @@ namespace cling {
                                    bool objectIsConst) const {
     assert(scopeDecl && "Decl cannot be null");
 
-    return execFindFunction<ExprFromTypes>(*m_Parser, m_Interpreter,
-                                           const_cast<LookupHelper&>(*this),
-                                           scopeDecl,
-                                           funcName,
-                                           funcProto,
-                                           objectIsConst,
-                                           matchFunctionSelector,
-                                           diagOnOff);
+    // Lookups change the parser's and Sema's state, and the cache.
+    std::lock_guard<StateLock> Lock(m_Interpreter->getStateLock());
+    std::string Key;
+    if (canUseCache()) {
+      Key = makeLookupKey(kMatchFunctionProto, scopeDecl, funcName,
+                          makeLookupArgs(funcProto), diagOnOff,
+                          objectIsConst);
+      if (const CachedLookup* Cached = getCached(Key))
+        return static_cast<const FunctionDecl*>(Cached->Result);
+    }
+    const FunctionDecl* FD
+      = execFindFunction<ExprFromTypes>(*m_Parser, m_Interpreter,
+                                        const_cast<LookupHelper&>(*this),
+                                        scopeDecl, funcName, funcProto,
+                                        objectIsConst, matchFunctionSelector,
+                                        diagOnOff);
+    if (!Key.empty())
+      addCached(std::move(Key), FD, nullptr, diagOnOff);
+    return FD;
   }
 
   struct ParseArgs {
@@ -2121,5 +2760,7 @@ namespace cling {
     llvm::errs() << "Cached entries: " << m_ParseBufferCache.size() << "\n";
     llvm::errs() << "Total parse requests: " << m_TotalParseRequests << "\n";
     llvm::errs() << "Cache hits: " << m_CacheHits << "\n";
+    llvm::errs() << "Cached lookups: " << m_LookupCache.size() << "\n";
+    llvm::errs() << "Lookup cache hits: " << m_LookupCacheHits << "\n";
   }
 } // end namespace cling
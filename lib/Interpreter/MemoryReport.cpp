@@ -0,0 +1,46 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "cling/Interpreter/MemoryReport.h"
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+
+namespace {
+  static void printStats(llvm::raw_ostream& Out, const char* Name,
+                         const cling::MemoryStats& S) {
+    Out << llvm::format("%-12s %12zu %10zu %10zu %10zu %10zu %10zu\n", Name,
+                        S.ASTBytes, S.SourceBytes, S.IRInstructions,
+                        S.JITCodeBytes, S.JITRODataBytes, S.JITRWDataBytes);
+  }
+} // unnamed namespace
+
+namespace cling {
+
+  MemoryStats MemoryReport::getTotal() const {
+    MemoryStats Total = Unattributed;
+    for (const Entry& E : Transactions)
+      Total += E.Stats;
+    return Total;
+  }
+
+  void MemoryReport::print(llvm::raw_ostream& Out) const {
+    Out << llvm::format("%-12s %12s %10s %10s %10s %10s %10s\n",
+                        "transaction", "ast", "source", "ir-insts", "code",
+                        "rodata", "rwdata");
+    for (size_t I = 0, N = Transactions.size(); I < N; ++I) {
+      std::string Name = "#" + std::to_string(I + 1);
+      printStats(Out, Name.c_str(), Transactions[I].Stats);
+    }
+    printStats(Out, "unattributed", Unattributed);
+    printStats(Out, "total", getTotal());
+    Out << "sizes in bytes, IR in instructions\n";
+  }
+} // end namespace cling
@@ -0,0 +1,205 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "ModuleImportCallback.h"
+
+#include "AutoloadIndex.h"
+
+#include "cling/Interpreter/CIFactory.h"
+#include "cling/Interpreter/Interpreter.h"
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/Basic/Module.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Lex/HeaderSearch.h"
+#include "clang/Lex/Preprocessor.h"
+#include "clang/Sema/Lookup.h"
+#include "clang/Sema/Sema.h"
+#include "clang/Serialization/ASTReader.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <tuple>
+
+using namespace clang;
+
+// The index is text: a header line, then a line per name with its key and
+// the name of its module, separated by a space.
+
+namespace {
+  static const char* const kIndexHeader = "cling-module-index 1";
+
+  ///\brief Adds the last component of Key, a qualified name.
+  static void addUnqualifiedName(llvm::StringRef Key,
+                                 cling::LookupNameFilter& Filter) {
+    size_t Pos = Key.rfind("::");
+    Filter.insert(Pos == llvm::StringRef::npos ? Key : Key.substr(Pos + 2));
+  }
+
+  ///\brief Records the top-level module owning each named declaration of
+  /// DC, recursing into its namespaces and linkage specifications.
+  static void collectNames(const DeclContext* DC,
+                           llvm::StringMap<std::string>& Modules) {
+    for (const Decl* D : DC->decls()) {
+      if (const auto LSD = dyn_cast<LinkageSpecDecl>(D)) {
+        collectNames(LSD, Modules);
+        continue;
+      }
+      const auto ND = dyn_cast<NamedDecl>(D);
+      const Module* M = D->getOwningModule();
+      if (ND && M && ND->getIdentifier())
+        Modules.try_emplace(
+            cling::AutoloadIndex::getKey(ND->getDeclContext(), ND->getName()),
+            M->getTopLevelModule()->Name);
+      if (const auto ED = dyn_cast<EnumDecl>(D)) {
+        // Unscoped enumerators are found in the enclosing context.
+        if (M && !ED->isScoped())
+          for (const EnumConstantDecl* ECD : ED->enumerators())
+            Modules.try_emplace(
+                cling::AutoloadIndex::getKey(ED->getDeclContext(),
+                                             ECD->getName()),
+                M->getTopLevelModule()->Name);
+      } else if (const auto NSD = dyn_cast<NamespaceDecl>(D))
+        collectNames(NSD, Modules);
+    }
+  }
+} // unnamed namespace
+
+namespace cling {
+  void ModuleImportCallback::readIndex(llvm::StringRef Dir) {
+    llvm::SmallString<256> File(Dir);
+    llvm::sys::path::append(File, CIFactory::PrebuiltModuleIndexName);
+    auto Buffer = llvm::MemoryBuffer::getFile(File);
+    if (!Buffer)
+      return;
+    llvm::StringRef Rest = (*Buffer)->getBuffer();
+    llvm::StringRef Line;
+    std::tie(Line, Rest) = Rest.split('\n');
+    if (Line.rtrim() != kIndexHeader)
+      return;
+    while (!Rest.empty()) {
+      std::tie(Line, Rest) = Rest.split('\n');
+      llvm::StringRef Key, Module;
+      std::tie(Key, Module) = Line.rtrim().split(' ');
+      if (Key.empty() || Module.empty())
+        continue;
+      // The earlier paths win, as for the PCMs.
+      if (m_Modules.try_emplace(Key, Module.str()).second)
+        addUnqualifiedName(Key, m_NameFilter);
+    }
+  }
+
+  std::unique_ptr<ModuleImportCallback>
+  ModuleImportCallback::create(Interpreter& Interp) {
+    CompilerInstance* CI = Interp.getCI();
+    if (!CI->getLangOpts().Modules)
+      return nullptr;
+    std::unique_ptr<ModuleImportCallback> CB(new ModuleImportCallback(&Interp));
+    for (const std::string& Dir : CI->getHeaderSearchOpts().PrebuiltModulePaths)
+      CB->readIndex(Dir);
+    if (CB->m_Modules.empty())
+      return nullptr;
+    return CB;
+  }
+
+  bool ModuleImportCallback::writeIndex(Interpreter& Interp,
+                                        llvm::StringRef File,
+                                        std::string& Error) {
+    llvm::StringMap<std::string> Modules;
+    collectNames(Interp.getCI()->getASTContext().getTranslationUnitDecl(),
+                 Modules);
+
+    // Sorted, such that the same modules give the same file.
+    std::vector<llvm::StringRef> Keys;
+    Keys.reserve(Modules.size());
+    for (const auto& Entry : Modules)
+      if (!Entry.first().empty())
+        Keys.push_back(Entry.first());
+    std::sort(Keys.begin(), Keys.end());
+
+    std::error_code EC;
+    llvm::raw_fd_ostream Out(File, EC, llvm::sys::fs::F_Text);
+    if (EC) {
+      Error = EC.message();
+      return false;
+    }
+    Out << kIndexHeader << '\n';
+    for (llvm::StringRef Key : Keys)
+      Out << Key << ' ' << Modules[Key] << '\n';
+    Out.close();
+    if (Out.has_error()) {
+      Out.clear_error();
+      Error = "write error";
+      return false;
+    }
+    return true;
+  }
+
+  bool ModuleImportCallback::importFor(llvm::StringRef Key) {
+    auto I = m_Modules.find(Key);
+    if (I == m_Modules.end() || !m_Tried.insert(I->second).second)
+      return false;
+    HeaderSearch& HS
+      = m_Interpreter->getCI()->getPreprocessor().getHeaderSearchInfo();
+    Module* M = HS.lookupModule(I->second, /*AllowSearch*/ true,
+                                /*AllowExtraSearch*/ true);
+    if (!M || m_Interpreter->getSema().isModuleVisible(M))
+      return false;
+    m_IsImporting = true;
+    const bool Imported = m_Interpreter->loadModule(M, /*complain*/ false);
+    m_IsImporting = false;
+    return Imported;
+  }
+
+  bool ModuleImportCallback::LookupObject(LookupResult& R, Scope* S) {
+    if (m_IsImporting)
+      return false;
+    IdentifierInfo* II = R.getLookupName().getAsIdentifierInfo();
+    if (!II)
+      return false;
+
+    // The name might be declared in any of the enclosing namespaces.
+    bool Imported = false;
+    for (DeclContext* DC = m_Interpreter->getSema().CurContext; DC;
+         DC = DC->getParent())
+      if (DC->isNamespace() || DC->isTranslationUnit()) {
+        std::string Key = AutoloadIndex::getKey(DC, II->getName());
+        if (!Key.empty())
+          Imported |= importFor(Key);
+      }
+    if (!Imported)
+      return false;
+
+    // Find what the module declares; a failing lookup gets here again, but
+    // has nothing left to import.
+    R.clear();
+    return m_Interpreter->getSema().LookupName(R, S) && !R.empty();
+  }
+
+  bool ModuleImportCallback::LookupObject(const DeclContext* DC,
+                                          DeclarationName Name) {
+    if (m_IsImporting)
+      return false;
+    IdentifierInfo* II = Name.getAsIdentifierInfo();
+    if (!II)
+      return false;
+    std::string Key = AutoloadIndex::getKey(DC, II->getName());
+    if (Key.empty() || !importFor(Key))
+      return false;
+    // The module reader asked before the import; it knows the name now.
+    ASTReader* Reader = m_Interpreter->getCI()->getModuleManager().get();
+    return Reader && Reader->FindExternalVisibleDeclsByName(DC, Name);
+  }
+} // end namespace cling
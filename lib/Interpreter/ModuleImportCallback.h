@@ -0,0 +1,75 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_MODULE_IMPORT_CALLBACK_H
+#define CLING_MODULE_IMPORT_CALLBACK_H
+
+#include "cling/Interpreter/InterpreterCallbacks.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+
+#include <memory>
+#include <string>
+
+namespace cling {
+  class Interpreter;
+
+  ///\brief Imports the C++ module that declares a name when its lookup
+  /// fails, instead of all modules that might be needed at startup.
+  ///
+  /// Which module declares which name comes from the index that
+  /// cling-prebuild-modules writes next to the PCMs, see
+  /// CIFactory::PrebuiltModuleIndexName, of each prebuilt module path. The
+  /// names are keyed as the AutoloadIndex's, by their enclosing namespaces.
+  ///
+  class ModuleImportCallback : public InterpreterCallbacks {
+    ///\brief The module declaring each name, the first one indexed.
+    llvm::StringMap<std::string> m_Modules;
+
+    ///\brief The unqualified names of m_Modules.
+    LookupNameFilter m_NameFilter;
+
+    ///\brief The modules imported or that failed to, not to try again.
+    llvm::StringSet<> m_Tried;
+
+    ///\brief Set while importing; its lookups must not recurse.
+    bool m_IsImporting = false;
+
+    ModuleImportCallback(Interpreter* Interp) : InterpreterCallbacks(Interp) {}
+
+    ///\brief Reads the index in the prebuilt module path Dir, if any.
+    void readIndex(llvm::StringRef Dir);
+
+    ///\brief Imports the module of Key unless tried before.
+    ///\returns true if it got imported now.
+    bool importFor(llvm::StringRef Key);
+
+  public:
+    ///\brief The callback for the prebuilt module paths of Interp, or null
+    /// if it has no C++ modules or none of its paths an index.
+    static std::unique_ptr<ModuleImportCallback> create(Interpreter& Interp);
+
+    ///\brief Writes the index of the names declared by the modules Interp
+    /// imported so far to File; sets Error and returns false on failure.
+    static bool writeIndex(Interpreter& Interp, llvm::StringRef File,
+                           std::string& Error);
+
+    using InterpreterCallbacks::LookupObject;
+    bool LookupObject(clang::LookupResult& R, clang::Scope* S) override;
+    bool LookupObject(const clang::DeclContext* DC,
+                      clang::DeclarationName Name) override;
+
+    const LookupNameFilter* getLookupNameFilter() const override {
+      return &m_NameFilter;
+    }
+  };
+} // end namespace cling
+
+#endif // CLING_MODULE_IMPORT_CALLBACK_H
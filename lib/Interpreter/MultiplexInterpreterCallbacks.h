@@ -13,6 +13,8 @@
 
 #include "cling/Interpreter/InterpreterCallbacks.h"
 
+#include "clang/Sema/Lookup.h"
+
 namespace cling {
 
   class MultiplexInterpreterCallbacks : public InterpreterCallbacks {
@@ -56,18 +58,24 @@ namespace cling {
       return result;
     }
 
+     // The callbacks that cannot resolve the name are skipped; the hash is
+     // computed once for all of them.
      bool LookupObject(clang::LookupResult& LR, clang::Scope* S) override {
+       const uint64_t Hash = LookupNameFilter::hash(LR.getLookupName());
        bool result = false;
        for (auto&& cb : m_Callbacks)
-         result = cb->LookupObject(LR, S) || result;
+         if (cb->mightLookup(Hash))
+           result = cb->LookupObject(LR, S) || result;
        return result;
      }
 
      bool LookupObject(const clang::DeclContext* DC,
                        clang::DeclarationName DN) override {
+       const uint64_t Hash = LookupNameFilter::hash(DN);
        bool result = false;
        for (auto&& cb : m_Callbacks)
-         result = cb->LookupObject(DC, DN) || result;
+         if (cb->mightLookup(Hash))
+           result = cb->LookupObject(DC, DN) || result;
        return result;
      }
 
@@ -10,24 +10,31 @@
 
 #include "NullDerefProtectionTransformer.h"
 
+#include "AddressSymbols.h"
+
 #include "cling/Interpreter/Interpreter.h"
 #include "cling/Utils/AST.h"
 
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/Decl.h"
 #include "clang/AST/Expr.h"
+#include "clang/AST/DeclCXX.h"
 #include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/Basic/FileManager.h"
 #include "clang/Basic/SourceLocation.h"
 #include "clang/Basic/SourceManager.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Sema/Lookup.h"
 
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
 #include <bitset>
 
 using namespace clang;
 
-namespace {
-using namespace cling;
+namespace cling {
 
 class PointerCheckInjector : public RecursiveASTVisitor<PointerCheckInjector> {
   private:
@@ -44,6 +51,11 @@ class PointerCheckInjector : public RecursiveASTVisitor<PointerCheckInjector> {
     ///
     LookupResult* m_clingthrowIfInvalidPointerCache;
 
+    ///\brief The interpreter and the checked expressions, for the runtime
+    /// to report them; the expressions by their location.
+    ///
+    AddressSymbols m_Addresses;
+
     bool IsTransparentThis(Expr* E) {
       if (llvm::isa<CXXThisExpr>(E))
         return true;
@@ -56,12 +68,22 @@ class PointerCheckInjector : public RecursiveASTVisitor<PointerCheckInjector> {
     PointerCheckInjector(Interpreter& I)
       : m_Interp(I), m_Sema(I.getCI()->getSema()),
         m_Context(I.getCI()->getASTContext()),
-        m_clingthrowIfInvalidPointerCache(0) {}
+        m_clingthrowIfInvalidPointerCache(0),
+        m_Addresses(I, "__cling_checked_") {}
 
     ~PointerCheckInjector() {
       delete m_clingthrowIfInvalidPointerCache;
     }
 
+    ///\brief Injects the checks into D; the runtime function is looked up
+    /// once for all declarations.
+    void Inject(Decl* D) {
+      // The function declarations of a previous transaction might have been
+      // unloaded.
+      m_NonNullArgIndexs.clear();
+      TraverseDecl(D);
+    }
+
     bool VisitUnaryOperator(UnaryOperator* UnOp) {
       Expr* SubExpr = UnOp->getSubExpr();
       VisitStmt(SubExpr);
@@ -126,12 +148,11 @@ class PointerCheckInjector : public RecursiveASTVisitor<PointerCheckInjector> {
         FindAndCacheRuntimeLookupResult();
 
       SourceLocation Loc = Arg->getBeginLoc();
-      Expr* VoidSemaArg = utils::Synthesize::CStyleCastPtrExpr(&m_Sema,
-                                                            m_Context.VoidPtrTy,
-                                                            (uintptr_t)&m_Interp);
-      Expr* VoidExprArg = utils::Synthesize::CStyleCastPtrExpr(&m_Sema,
-                                                          m_Context.VoidPtrTy,
-                                                          (uintptr_t)Arg);
+      Expr* VoidSemaArg = m_Addresses.get(m_Sema, "interpreter", &m_Interp);
+      const SourceManager& SM = m_Sema.getSourceManager();
+      Expr* VoidExprArg
+        = m_Addresses.get(m_Sema, Loc.printToString(SM) + ' '
+                          + Arg->getEndLoc().printToString(SM), Arg);
       Scope* S = m_Sema.getScopeForContext(m_Sema.CurContext);
       CXXScopeSpec CSS;
 
@@ -244,7 +265,7 @@ class PointerCheckInjector : public RecursiveASTVisitor<PointerCheckInjector> {
     return hasPtrCheckDisabledInContext(Parent);
   }
 
-} // unnamed namespace
+} // end namespace cling
 
 namespace cling {
   NullDerefProtectionTransformer::NullDerefProtectionTransformer(Interpreter* I)
@@ -254,6 +275,53 @@ namespace cling {
   NullDerefProtectionTransformer::~NullDerefProtectionTransformer()
   { }
 
+  void NullDerefProtectionTransformer::ForgetRuntime() {
+    // Its lookup of cling_runtime_internal_throwIfInvalidPointer is gone.
+    m_Injector.reset();
+  }
+
+  static void getRealPath(llvm::StringRef Path,
+                          llvm::SmallVectorImpl<char>& Real) {
+    if (llvm::sys::fs::real_path(Path, Real)) {
+      Real.assign(Path.begin(), Path.end());
+      llvm::sys::fs::make_absolute(Real);
+    }
+  }
+
+  bool NullDerefProtectionTransformer::isInScope(const FileEntry* FE) {
+    // The inputs have no real path (their buffers are virtual files of the
+    // FileManager, named input_line_N).
+    if (FE->tryGetRealPathName().empty())
+      return true;
+
+    // `#pragma cling add_pointer_checks_path` appends to the directories.
+    const std::vector<std::string>& Dirs
+      = m_Interp->getOptions().PointerChecksDirs;
+    if (Dirs.size() != m_ScopeDirs.size()) {
+      for (size_t I = m_ScopeDirs.size(), E = Dirs.size(); I < E; ++I) {
+        llvm::SmallString<256> Real;
+        getRealPath(Dirs[I], Real);
+        if (Real.empty() || !llvm::sys::path::is_separator(Real.back()))
+          Real += llvm::sys::path::get_separator();
+        m_ScopeDirs.push_back(Real.str());
+      }
+      m_InScopeDirs.clear();
+    }
+    if (m_ScopeDirs.empty())
+      return false;
+
+    auto Known = m_InScopeDirs.find(FE);
+    if (Known != m_InScopeDirs.end())
+      return Known->second;
+    llvm::SmallString<256> Real;
+    getRealPath(FE->tryGetRealPathName(), Real);
+    bool& InDirs = m_InScopeDirs[FE];
+    for (const std::string& Dir : m_ScopeDirs)
+      if ((InDirs = Real.startswith(Dir)))
+        break;
+    return InDirs;
+  }
+
   bool NullDerefProtectionTransformer::shouldTransform(const clang::Decl* D) {
     if (D->isFromASTFile())
       return false;
@@ -263,11 +331,24 @@ namespace cling {
     if (hasPtrCheckDisabledInContext(D))
       return false;
 
-    auto Loc = D->getLocation();
+    // A specialization is code of its template, wherever it is instantiated
+    // from: std::sort<int*> is as trusted as <algorithm>.
+    const Decl* Spelled = D;
+    if (auto FD = dyn_cast<FunctionDecl>(D)) {
+      if (const FunctionDecl* Pattern = FD->getTemplateInstantiationPattern())
+        Spelled = Pattern;
+    } else if (auto RD = dyn_cast<CXXRecordDecl>(D)) {
+      if (const CXXRecordDecl* Pattern = RD->getTemplateInstantiationPattern())
+        Spelled = Pattern;
+    }
+
+    auto Loc = Spelled->getLocation();
     if (Loc.isInvalid())
       return false;
 
     SourceManager& SM = m_Interp->getSema().getSourceManager();
+    if (SM.isInSystemHeader(Loc))
+      return false;
     auto Characteristic = SM.getFileCharacteristic(Loc);
     if (Characteristic != clang::SrcMgr::C_User)
       return false;
@@ -280,6 +361,9 @@ namespace cling {
     if (!FE)
       return false;
 
+    if (m_Interp->getOptions().ScopedPointerChecks)
+      return isInScope(FE);
+
     auto Dir = FE->getDir();
     if (!Dir)
       return false;
@@ -299,9 +383,14 @@ namespace cling {
 
   ASTTransformer::Result
   NullDerefProtectionTransformer::Transform(clang::Decl* D) {
-    if (getCompilationOpts().CheckPointerValidity && shouldTransform(D)) {
-      PointerCheckInjector injector(*m_Interp);
-      injector.TraverseDecl(D);
+    // With signal based checks, faults are caught when they happen. The
+    // executor process has no cling_runtime_internal_throwIfInvalidPointer.
+    if (getCompilationOpts().CheckPointerValidity
+        && !m_Interp->getRuntimeOptions().SignalPointerChecks
+        && !m_Interp->isExecutorRemote() && shouldTransform(D)) {
+      if (!m_Injector)
+        m_Injector.reset(new PointerCheckInjector(*m_Interp));
+      m_Injector->Inject(D);
     }
     return Result(D, true);
   }
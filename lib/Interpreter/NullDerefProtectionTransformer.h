@@ -15,12 +15,18 @@
 
 #include "llvm/ADT/DenseMap.h"
 
+#include <memory>
+#include <string>
+#include <vector>
+
 namespace clang {
   class Decl;
   class DirectoryEntry;
+  class FileEntry;
 }
 namespace cling {
   class Interpreter;
+  class PointerCheckInjector;
 }
 
 namespace cling {
@@ -31,9 +37,23 @@ namespace cling {
     /// Whether to visit a Decl coming from a file in a given directory.
     llvm::DenseMap<const clang::DirectoryEntry*, bool> m_ShouldVisitDir;
 
+    /// The real paths of InvocationOptions::PointerChecksDirs, ending with a
+    /// separator.
+    std::vector<std::string> m_ScopeDirs;
+
+    /// Whether a file is in one of the m_ScopeDirs.
+    llvm::DenseMap<const clang::FileEntry*, bool> m_InScopeDirs;
+
+    /// Kept across declarations, as it caches the lookup of the runtime.
+    std::unique_ptr<PointerCheckInjector> m_Injector;
+
     /// Whether the declaration should be visited and possibly transformed.
     bool shouldTransform(const clang::Decl* D);
 
+    /// Whether the code of FE is checked with
+    /// InvocationOptions::ScopedPointerChecks.
+    bool isInScope(const clang::FileEntry* FE);
+
   public:
     ///\ brief Constructs the NullDeref AST Transformer.
     ///
@@ -43,6 +63,7 @@ namespace cling {
 
     virtual ~NullDerefProtectionTransformer();
     Result Transform(clang::Decl* D) override;
+    void ForgetRuntime() override;
   };
 
 } // namespace cling
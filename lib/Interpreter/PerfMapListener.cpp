@@ -0,0 +1,89 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "PerfMapListener.h"
+
+#include "cling/Utils/Output.h"
+#include "cling/Utils/Platform.h"
+
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Object/SymbolSize.h"
+#include "llvm/Support/Process.h"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using namespace llvm;
+
+namespace cling {
+
+  PerfMapListener::~PerfMapListener() {
+    std::fclose(m_File);
+  }
+
+  std::unique_ptr<PerfMapListener> PerfMapListener::createFromEnv() {
+    if (!::getenv("CLING_PERF"))
+      return nullptr;
+    const std::string Path
+      = "/tmp/perf-" + std::to_string(sys::Process::getProcessId()) + ".map";
+    std::FILE* File = std::fopen(Path.c_str(), "a");
+    if (!File) {
+      cling::errs() << "cling::PerfMapListener: cannot write '" << Path
+                    << "': " << std::strerror(errno) << '\n';
+      return nullptr;
+    }
+    return std::unique_ptr<PerfMapListener>(new PerfMapListener(File));
+  }
+
+  void
+  PerfMapListener::notifyObjectLoaded(ObjectKey, const object::ObjectFile& Obj,
+                                      const RuntimeDyld::LoadedObjectInfo& L) {
+    std::string Entries;
+    for (const auto& SymAndSize : object::computeSymbolSizes(Obj)) {
+      const object::SymbolRef& Sym = SymAndSize.first;
+      Expected<object::SymbolRef::Type> Type = Sym.getType();
+      if (!Type || *Type != object::SymbolRef::ST_Function
+          || !SymAndSize.second) {
+        consumeError(Type.takeError());
+        continue;
+      }
+      Expected<StringRef> Name = Sym.getName();
+      Expected<uint64_t> Addr = Sym.getAddress();
+      Expected<object::section_iterator> Sec = Sym.getSection();
+      if (!Name || !Addr || !Sec || *Sec == Obj.section_end()) {
+        consumeError(Name.takeError());
+        consumeError(Addr.takeError());
+        consumeError(Sec.takeError());
+        continue;
+      }
+      // The object's addresses are relative to its sections, which were
+      // loaded each on its own.
+      uint64_t Load = L.getSectionLoadAddress(**Sec);
+      if (!Load)
+        continue;
+      Load += *Addr - (*Sec)->getAddress();
+
+      std::string Demangled = utils::platform::Demangle(Name->str());
+      char Range[2 * 16 + 3];
+      std::snprintf(Range, sizeof(Range), "%" PRIx64 " %" PRIx64 " ", Load,
+                    SymAndSize.second);
+      Entries += Range;
+      Entries += Demangled.empty() ? Name->str() : Demangled;
+      Entries += '\n';
+    }
+    if (Entries.empty())
+      return;
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+    std::fwrite(Entries.data(), 1, Entries.size(), m_File);
+    // perf can read the map while the process still runs.
+    std::fflush(m_File);
+  }
+} // end namespace cling
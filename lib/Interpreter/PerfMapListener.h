@@ -0,0 +1,46 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_PERF_MAP_LISTENER_H
+#define CLING_PERF_MAP_LISTENER_H
+
+#include "llvm/ExecutionEngine/JITEventListener.h"
+
+#include <cstdio>
+#include <memory>
+#include <mutex>
+
+namespace cling {
+  ///\brief Lists the functions of the JITted objects in /tmp/perf-PID.map,
+  /// where `perf report` finds the names of the code without a file.
+  ///
+  /// The names are demangled, as perf shows them. The map is append only:
+  /// perf reads it once the profile is taken, so the code of an unloaded
+  /// transaction keeps its entries, even if later code reuses its memory.
+  ///
+  class PerfMapListener : public llvm::JITEventListener {
+    ///\brief The map; the objects can be linked concurrently.
+    std::FILE* m_File;
+    std::mutex m_Mutex;
+
+    PerfMapListener(std::FILE* File) : m_File(File) {}
+
+  public:
+    ~PerfMapListener();
+
+    ///\brief Creates the map of this process if the environment variable
+    /// CLING_PERF is set, returns null otherwise or if it cannot be written.
+    static std::unique_ptr<PerfMapListener> createFromEnv();
+
+    void
+    notifyObjectLoaded(ObjectKey K, const llvm::object::ObjectFile& Obj,
+                       const llvm::RuntimeDyld::LoadedObjectInfo& L) override;
+  };
+} // end namespace cling
+
+#endif // CLING_PERF_MAP_LISTENER_H
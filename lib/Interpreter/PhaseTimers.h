@@ -0,0 +1,65 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_PHASE_TIMERS_H
+#define CLING_PHASE_TIMERS_H
+
+#include "cling/Interpreter/TimingStats.h"
+
+#include <chrono>
+
+namespace cling {
+  class Transaction;
+
+  ///\brief Measures the TimingStats of an interpreter.
+  ///
+  /// A Scope object times one stage. Scopes nest: entering one pauses the
+  /// enclosing scope, so every nanosecond is accounted to exactly one phase.
+  /// The time goes to the interpreter's total and to the scope's transaction,
+  /// or that of the enclosing scope if none is given.
+  ///
+  class PhaseTimers {
+  public:
+    class Scope {
+      typedef std::chrono::steady_clock Clock;
+
+      PhaseTimers* m_Timers;
+      Scope* m_Outer;
+      Transaction* m_Transaction;
+      TimingStats::Phase m_Phase;
+      Clock::time_point m_Start;
+
+      ///\brief Accounts the time since m_Start, restarting it at Now.
+      void lap(Clock::time_point Now);
+
+    public:
+      ///\param[in] Timers - the interpreter's timers, none measures nothing.
+      ///\param[in] P - the phase timed.
+      ///\param[in] T - the transaction to account the time to; it must exist
+      ///               until the scope is left.
+      Scope(PhaseTimers* Timers, TimingStats::Phase P,
+            Transaction* T = nullptr);
+      ~Scope();
+      Scope(const Scope&) = delete;
+      Scope& operator=(const Scope&) = delete;
+    };
+
+  private:
+    ///\brief The accumulated stats of all transactions.
+    TimingStats m_Total;
+
+    ///\brief The innermost scope that is being timed.
+    Scope* m_Active = nullptr;
+
+  public:
+    const TimingStats& getTotal() const { return m_Total; }
+    void clear() { m_Total.clear(); }
+  };
+} // end namespace cling
+
+#endif // CLING_PHASE_TIMERS_H
@@ -0,0 +1,82 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "cling/Interpreter/ProfileReport.h"
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace {
+  using cling::ProfileReport;
+
+  static double percent(size_t Part, size_t Whole) {
+    return Whole ? 100.0 * Part / Whole : 0.0;
+  }
+
+  static void printFunction(llvm::raw_ostream& Out,
+                            const ProfileReport::Function& F) {
+    Out << F.Name;
+    if (!F.Origin.empty())
+      Out << "  [" << F.Origin << ']';
+    Out << '\n';
+  }
+
+  static void printNodes(llvm::raw_ostream& Out, const ProfileReport& Report,
+                         const std::vector<ProfileReport::Node>& Nodes,
+                         unsigned Depth, double MinPercent) {
+    for (const ProfileReport::Node& Node : Nodes) {
+      const double Percent = percent(Node.Samples, Report.Samples);
+      if (Percent < MinPercent)
+        continue;
+      Out << llvm::format("%6.1f%%  ", Percent);
+      Out.indent(2 * Depth);
+      printFunction(Out, Report.Functions[Node.Function]);
+      printNodes(Out, Report, Node.Children, Depth + 1, MinPercent);
+    }
+  }
+} // unnamed namespace
+
+namespace cling {
+
+  void ProfileReport::print(llvm::raw_ostream& Out, double MinPercent) const {
+    if (!Enabled) {
+      Out << "The code cannot be sampled on this platform\n";
+      return;
+    }
+    if (!Interval) {
+      Out << "No profile; start one with .profile start\n";
+      return;
+    }
+    Out << Samples << (Samples == 1 ? " sample" : " samples") << ", one every "
+        << Interval << " us of CPU time";
+    if (Running)
+      Out << ", still sampling";
+    if (Dropped)
+      Out << ", " << Dropped << " dropped as the buffer was full";
+    Out << '\n';
+    if (!Samples)
+      return;
+
+    Out << "   self   total  function\n";
+    for (const Function& F : Functions) {
+      if (!F.Self && percent(F.Total, Samples) < MinPercent)
+        continue;
+      Out << llvm::format("%6.1f%% %6.1f%%  ", percent(F.Self, Samples),
+                          percent(F.Total, Samples));
+      printFunction(Out, F);
+    }
+
+    if (!CallTree.empty()) {
+      Out << "call tree of the JITted code:\n";
+      printNodes(Out, *this, CallTree, 0, MinPercent);
+    }
+    if (OutsideJIT)
+      Out << llvm::format("%6.1f%%  ", percent(OutsideJIT, Samples))
+          << "outside the JITted code\n";
+  }
+} // end namespace cling
@@ -0,0 +1,162 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "RemoteTarget.h"
+
+#include "cling/Utils/Platform.h"
+
+#include "llvm/ExecutionEngine/Orc/OrcRemoteTargetClient.h"
+#include "llvm/ExecutionEngine/Orc/RawByteChannel.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Program.h"
+
+#include <cerrno>
+#include <system_error>
+
+#ifdef LLVM_ON_UNIX
+#include <unistd.h>
+#endif
+
+using namespace llvm;
+
+namespace cling {
+
+  ///\brief The RPC channel to the executor, over a pipe or a socket.
+  class RemoteTarget::FDChannel final: public orc::rpc::RawByteChannel {
+    int m_InFD;
+    int m_OutFD;
+
+  public:
+    FDChannel(int InFD, int OutFD): m_InFD(InFD), m_OutFD(OutFD) {}
+
+    ~FDChannel() override {
+#ifdef LLVM_ON_UNIX
+      ::close(m_InFD);
+      if (m_OutFD != m_InFD)
+        ::close(m_OutFD);
+#endif
+    }
+
+    Error readBytes(char* Dst, unsigned Size) override {
+#ifdef LLVM_ON_UNIX
+      for (unsigned Done = 0; Done < Size;) {
+        ssize_t Read = ::read(m_InFD, Dst + Done, Size - Done);
+        if (Read <= 0) {
+          if (Read && (errno == EINTR || errno == EAGAIN))
+            continue;
+          if (!Read)
+            return errorCodeToError(make_error_code(std::errc::broken_pipe));
+          return errorCodeToError(std::error_code(errno,
+                                                  std::generic_category()));
+        }
+        Done += Read;
+      }
+#endif
+      return Error::success();
+    }
+
+    Error appendBytes(const char* Src, unsigned Size) override {
+#ifdef LLVM_ON_UNIX
+      for (unsigned Done = 0; Done < Size;) {
+        ssize_t Written = ::write(m_OutFD, Src + Done, Size - Done);
+        if (Written < 0) {
+          if (errno == EINTR || errno == EAGAIN)
+            continue;
+          return errorCodeToError(std::error_code(errno,
+                                                  std::generic_category()));
+        }
+        Done += Written;
+      }
+#endif
+      return Error::success();
+    }
+
+    Error send() override { return Error::success(); }
+  };
+
+  RemoteTarget::RemoteTarget(std::unique_ptr<FDChannel> Channel,
+                             int ProcessID):
+    m_Channel(std::move(Channel)), m_ProcessID(ProcessID) {}
+
+  std::unique_ptr<RemoteTarget>
+  RemoteTarget::create(StringRef Spec, orc::ExecutionSession& ES,
+                       std::string& Err) {
+    int InFD = -1, OutFD = -1, ProcessID = -1;
+    std::pair<StringRef, StringRef> HostPort = Spec.rsplit(':');
+    if (sys::fs::can_execute(Spec)) {
+      ProcessID = utils::platform::SpawnPiped(Spec.str(), InFD, OutFD);
+      if (ProcessID == -1) {
+        Err = "cannot start '" + Spec.str() + "'";
+        return nullptr;
+      }
+    } else if (!HostPort.second.empty()) {
+      InFD = OutFD = utils::platform::ConnectTCP(HostPort.first.str(),
+                                                 HostPort.second.str());
+      if (InFD == -1) {
+        Err = "cannot connect to '" + Spec.str() + "'";
+        return nullptr;
+      }
+    } else {
+      Err = "'" + Spec.str() + "' is neither an executable nor host:port";
+      return nullptr;
+    }
+
+    std::unique_ptr<RemoteTarget> Target(
+      new RemoteTarget(llvm::make_unique<FDChannel>(InFD, OutFD), ProcessID));
+    auto Client = orc::remote::OrcRemoteTargetClient::Create(
+      *Target->m_Channel, ES);
+    if (!Client) {
+      Err = toString(Client.takeError());
+      return nullptr;
+    }
+    Target->m_Client = std::move(*Client);
+    return Target;
+  }
+
+  RemoteTarget::~RemoteTarget() {
+    if (m_Client)
+      consumeError(m_Client->terminateSession());
+    m_Client.reset();
+    // Closing the channel lets a stuck executor see the end of the session.
+    m_Channel.reset();
+    if (m_ProcessID != -1) {
+      sys::ProcessInfo PI;
+      PI.Pid = m_ProcessID;
+      sys::Wait(PI, 0, true /*WaitUntilChildTerminates*/);
+    }
+  }
+
+  std::unique_ptr<RuntimeDyld::MemoryManager>
+  RemoteTarget::createMemoryManager() {
+    auto MM = m_Client->createRemoteMemoryManager();
+    if (!MM) {
+      consumeError(MM.takeError());
+      return nullptr;
+    }
+    return std::move(*MM);
+  }
+
+  JITSymbol RemoteTarget::findSymbol(const std::string& Name) {
+    Expected<JITTargetAddress> Addr = m_Client->getSymbolAddress(Name);
+    if (!Addr) {
+      consumeError(Addr.takeError());
+      return nullptr;
+    }
+    if (!*Addr)
+      return nullptr;
+    return JITSymbol(*Addr, JITSymbolFlags::Exported);
+  }
+
+  bool RemoteTarget::run(JITTargetAddress Addr, std::string& Err) {
+    if (Error E = m_Client->callVoidVoid(Addr)) {
+      Err = toString(std::move(E));
+      return false;
+    }
+    return true;
+  }
+} // end namespace cling
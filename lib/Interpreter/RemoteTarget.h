@@ -0,0 +1,79 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_REMOTE_TARGET_H
+#define CLING_REMOTE_TARGET_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/ExecutionEngine/RuntimeDyld.h"
+
+#include <memory>
+#include <string>
+
+namespace llvm {
+  namespace orc {
+    class ExecutionSession;
+    namespace remote {
+      class OrcRemoteTargetClient;
+    }
+  }
+}
+
+namespace cling {
+
+  ///\brief The connection to a cling-executor process, which runs the
+  /// JITted code instead of the interpreter's process: a crash of the code
+  /// then only takes down the executor.
+  ///
+  /// The objects get linked here, into memory the executor allocated, and
+  /// their external symbols resolve to the executor's. It runs the static
+  /// initializers and wrappers; the functions registered with atexit run at
+  /// its exit. What needs the interpreter's address space, like printing
+  /// values or gCling, cannot run remotely.
+  ///
+  class RemoteTarget {
+  public:
+    class FDChannel;
+
+  private:
+    std::unique_ptr<FDChannel> m_Channel;
+    std::unique_ptr<llvm::orc::remote::OrcRemoteTargetClient> m_Client;
+    ///\brief The executor started by create(), or -1 if connected to.
+    int m_ProcessID;
+
+    RemoteTarget(std::unique_ptr<FDChannel> Channel, int ProcessID);
+
+  public:
+    ///\brief Starts or connects to an executor process.
+    ///
+    ///\param[in] Spec - "host:port" of a cling-executor --listen, or the path
+    ///   of the cling-executor binary to start, connected through pipes.
+    ///\param[out] Err - Why the connection failed.
+    ///\returns The connection, or null on failure.
+    ///
+    static std::unique_ptr<RemoteTarget>
+    create(llvm::StringRef Spec, llvm::orc::ExecutionSession& ES,
+           std::string& Err);
+
+    ///\brief Ends the session; the executor then exits.
+    ~RemoteTarget();
+
+    ///\brief A memory manager for one object, allocating in the executor.
+    std::unique_ptr<llvm::RuntimeDyld::MemoryManager> createMemoryManager();
+
+    ///\brief Finds a symbol of the executor's process by its linker name.
+    llvm::JITSymbol findSymbol(const std::string& Name);
+
+    ///\brief Runs the function of type void() at Addr in the executor.
+    ///\returns false if the executor could not run it, see Err.
+    bool run(llvm::JITTargetAddress Addr, std::string& Err);
+  };
+} // end namespace cling
+
+#endif // CLING_REMOTE_TARGET_H
@@ -0,0 +1,123 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "SafePointTransformer.h"
+
+#include "BackendPasses.h"
+
+#include "cling/Interpreter/ExecutionLimits.h"
+#include "cling/Interpreter/Interpreter.h"
+#include "cling/Utils/AST.h"
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Attr.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/AST/ExprCXX.h"
+#include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/AST/StmtCXX.h"
+#include "clang/Sema/Sema.h"
+
+using namespace clang;
+
+namespace {
+  class SafePointInjector : public RecursiveASTVisitor<SafePointInjector> {
+    Sema& m_Sema;
+    FunctionDecl* m_Hook;
+
+    ///\brief Whether a safe point in FD could throw out of it.
+    static bool canThrow(const FunctionDecl* FD) {
+      if (FD->isConstexpr() || FD->getDescribedFunctionTemplate()
+          || FD->isDependentContext() || FD->hasAttr<CUDADeviceAttr>())
+        return false;
+      const auto* FPT = FD->getType()->getAs<FunctionProtoType>();
+      if (!FPT)
+        return true;
+      // Destructors and defaulted members might not know yet.
+      if (isUnresolvedExceptionSpec(FPT->getExceptionSpecType()))
+        return false;
+      return !FPT->isNothrow();
+    }
+
+    ///\brief Body, after a call to the hook.
+    Stmt* addSafePoint(Stmt* Body) {
+      if (!Body)
+        return Body;
+      SourceLocation Loc = Body->getBeginLoc();
+      Expr* Callee = m_Sema.BuildDeclRefExpr(m_Hook, m_Hook->getType(),
+                                             VK_LValue, Loc);
+      ExprResult Call = m_Sema.ActOnCallExpr(/*Scope*/nullptr, Callee, Loc,
+                                             MultiExprArg(), Loc);
+      if (Call.isInvalid())
+        return Body;
+      Stmt* Stmts[] = {Call.get(), Body};
+      return CompoundStmt::Create(m_Sema.getASTContext(), Stmts, Loc,
+                                  Body->getEndLoc());
+    }
+
+  public:
+    SafePointInjector(Sema& S, FunctionDecl* Hook)
+      : m_Sema(S), m_Hook(Hook) {}
+
+    bool TraverseFunctionDecl(FunctionDecl* FD) {
+      return !canThrow(FD) || RecursiveASTVisitor::TraverseFunctionDecl(FD);
+    }
+    bool TraverseCXXMethodDecl(CXXMethodDecl* MD) {
+      return !canThrow(MD) || RecursiveASTVisitor::TraverseCXXMethodDecl(MD);
+    }
+    bool TraverseCXXConstructorDecl(CXXConstructorDecl* CD) {
+      return !canThrow(CD)
+        || RecursiveASTVisitor::TraverseCXXConstructorDecl(CD);
+    }
+    bool TraverseCXXConversionDecl(CXXConversionDecl* CD) {
+      return !canThrow(CD)
+        || RecursiveASTVisitor::TraverseCXXConversionDecl(CD);
+    }
+    bool TraverseCXXDestructorDecl(CXXDestructorDecl* DD) {
+      return !canThrow(DD)
+        || RecursiveASTVisitor::TraverseCXXDestructorDecl(DD);
+    }
+    bool TraverseLambdaExpr(LambdaExpr* LE) {
+      // Its body is walked as part of the enclosing function's.
+      return !canThrow(LE->getCallOperator())
+        || RecursiveASTVisitor::TraverseLambdaExpr(LE);
+    }
+
+    bool VisitForStmt(ForStmt* S) {
+      S->setBody(addSafePoint(S->getBody()));
+      return true;
+    }
+    bool VisitCXXForRangeStmt(CXXForRangeStmt* S) {
+      S->setBody(addSafePoint(S->getBody()));
+      return true;
+    }
+    bool VisitWhileStmt(WhileStmt* S) {
+      S->setBody(addSafePoint(S->getBody()));
+      return true;
+    }
+    bool VisitDoStmt(DoStmt* S) {
+      S->setBody(addSafePoint(S->getBody()));
+      return true;
+    }
+  };
+} // unnamed namespace
+
+namespace cling {
+  ASTTransformer::Result SafePointTransformer::Transform(Decl* D) {
+    if (!m_Interp.getExecutionLimits().any())
+      return Result(D, true);
+    if (!m_Hook) {
+      const char* Name = BackendPasses::getSafePointHookName();
+      NamedDecl* ND = utils::Lookup::Named(m_Sema, Name);
+      if (!ND || ND == (NamedDecl*)-1 || !isa<FunctionDecl>(ND))
+        return Result(D, true);
+      m_Hook = cast<FunctionDecl>(ND);
+    }
+    SafePointInjector(*m_Sema, m_Hook).TraverseDecl(D);
+    return Result(D, true);
+  }
+} // end namespace cling
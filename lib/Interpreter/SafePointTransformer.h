@@ -0,0 +1,46 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_SAFE_POINT_TRANSFORMER_H
+#define CLING_SAFE_POINT_TRANSFORMER_H
+
+#include "ASTTransformer.h"
+
+namespace clang {
+  class Decl;
+  class FunctionDecl;
+}
+
+namespace cling {
+  class Interpreter;
+
+  ///\brief Calls the hook of BackendPasses::getSafePointHookName() first
+  /// thing in the body of each loop, while the interpreter has
+  /// ExecutionLimits.
+  ///
+  /// Being a call that may throw, clang emits it as an invoke of the
+  /// cleanups of the scopes around the loop, which then run if a limit is
+  /// hit there; BackendPasses::addSafePoints() makes it a poll of the flag.
+  /// Functions that cannot throw, constexpr functions and templates are
+  /// left alone, as NullDerefProtectionTransformer does.
+  ///
+  class SafePointTransformer : public ASTTransformer {
+    Interpreter& m_Interp;
+
+    ///\brief The hook, declared by RuntimeUniverse.h; looked up once.
+    clang::FunctionDecl* m_Hook = nullptr;
+
+  public:
+    SafePointTransformer(clang::Sema& S, Interpreter& I)
+      : ASTTransformer(&S), m_Interp(I) {}
+
+    Result Transform(clang::Decl* D) override;
+  };
+} // end namespace cling
+
+#endif // CLING_SAFE_POINT_TRANSFORMER_H
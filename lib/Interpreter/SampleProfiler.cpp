@@ -0,0 +1,388 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "SampleProfiler.h"
+
+#include "cling/Utils/Platform.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Object/SymbolSize.h"
+#include "llvm/Support/Path.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <numeric>
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+// The interrupted registers come from the ucontext_t, the bounds of the
+// thread's stack from pthread_getattr_np().
+#define CLING_SAMPLE_STACKS 1
+#include <dlfcn.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#endif
+
+using namespace llvm;
+
+namespace cling {
+  struct SampleProfiler::Samples {
+    static constexpr unsigned kMaxDepth = 32;
+    static constexpr size_t kCapacity = 1 << 16;
+
+    struct Stack {
+      unsigned Depth;
+      ///\brief The interrupted address, then the return addresses.
+      uintptr_t PCs[kMaxDepth];
+    };
+
+    ///\brief Not initialized: only the pages of the stacks taken get used.
+    std::unique_ptr<Stack[]> Stacks{new Stack[kCapacity]};
+    ///\brief The stacks taken; the signal handler publishes each one once
+    /// it is complete.
+    std::atomic<size_t> Taken{0};
+    std::atomic<size_t> Dropped{0};
+    ///\brief The stack of the sampled thread, which tells it apart from
+    /// the others.
+    uintptr_t StackLow = 0;
+    uintptr_t StackHigh = 0;
+    unsigned Interval = 0;
+    bool Running = false;
+  };
+} // end namespace cling
+
+namespace {
+  using cling::SampleProfiler;
+  using Samples = SampleProfiler::Samples;
+
+#ifdef CLING_SAMPLE_STACKS
+  ///\brief The samples being taken, by the profiler of the process that
+  /// samples.
+  static std::atomic<Samples*> gSampling{nullptr};
+
+  static struct sigaction gPrevAction;
+
+  static void getRegisters(const void* Context, uintptr_t& PC, uintptr_t& FP,
+                           uintptr_t& SP) {
+    const mcontext_t& MC = static_cast<const ucontext_t*>(Context)->uc_mcontext;
+#if defined(__x86_64__)
+    PC = MC.gregs[REG_RIP];
+    FP = MC.gregs[REG_RBP];
+    SP = MC.gregs[REG_RSP];
+#else
+    PC = MC.pc;
+    FP = MC.regs[29];
+    SP = MC.sp;
+#endif
+  }
+
+  static void takeSample(int, siginfo_t*, void* Context) {
+    Samples* S = gSampling.load(std::memory_order_acquire);
+    if (!S)
+      return;
+    uintptr_t PC, FP, SP;
+    getRegisters(Context, PC, FP, SP);
+    if (SP < S->StackLow || SP >= S->StackHigh)
+      return; // Another thread.
+    // The handler does not interrupt itself: it is the only writer.
+    const size_t I = S->Taken.load(std::memory_order_relaxed);
+    if (I == Samples::kCapacity) {
+      S->Dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    Samples::Stack& Stack = S->Stacks[I];
+    Stack.PCs[0] = PC;
+    unsigned Depth = 1;
+    // The frame records, [caller's record, return address], go up the
+    // stack; what is not within it is not a frame record.
+    while (Depth < Samples::kMaxDepth && FP >= SP
+           && FP % sizeof(uintptr_t) == 0
+           && FP <= S->StackHigh - 2 * sizeof(uintptr_t)) {
+      const uintptr_t* Record = reinterpret_cast<const uintptr_t*>(FP);
+      if (!Record[1])
+        break;
+      Stack.PCs[Depth++] = Record[1];
+      if (Record[0] <= FP)
+        break;
+      FP = Record[0];
+    }
+    Stack.Depth = Depth;
+    S->Taken.store(I + 1, std::memory_order_release);
+  }
+#endif // CLING_SAMPLE_STACKS
+
+  ///\brief Orders the functions by decreasing Self then Total, and the
+  /// calling contexts by decreasing samples.
+  static void sortReport(cling::ProfileReport& Report) {
+    using cling::ProfileReport;
+    const size_t N = Report.Functions.size();
+    std::vector<size_t> Order(N);
+    std::iota(Order.begin(), Order.end(), 0);
+    std::stable_sort(Order.begin(), Order.end(), [&](size_t L, size_t R) {
+      const ProfileReport::Function& FL = Report.Functions[L];
+      const ProfileReport::Function& FR = Report.Functions[R];
+      return FL.Self != FR.Self ? FL.Self > FR.Self : FL.Total > FR.Total;
+    });
+    std::vector<size_t> NewIndex(N);
+    std::vector<ProfileReport::Function> Functions;
+    Functions.reserve(N);
+    for (size_t I = 0; I < N; ++I) {
+      NewIndex[Order[I]] = I;
+      Functions.push_back(std::move(Report.Functions[Order[I]]));
+    }
+    Report.Functions.swap(Functions);
+
+    std::function<void(std::vector<ProfileReport::Node>&)> Remap
+      = [&](std::vector<ProfileReport::Node>& Nodes) {
+      for (ProfileReport::Node& Node : Nodes) {
+        Node.Function = NewIndex[Node.Function];
+        Remap(Node.Children);
+      }
+      std::stable_sort(Nodes.begin(), Nodes.end(),
+                       [](const ProfileReport::Node& L,
+                          const ProfileReport::Node& R) {
+                         return L.Samples > R.Samples;
+                       });
+    };
+    Remap(Report.CallTree);
+  }
+} // unnamed namespace
+
+namespace cling {
+
+  SampleProfiler::SampleProfiler() {}
+
+  SampleProfiler::~SampleProfiler() { stop(); }
+
+  bool SampleProfiler::isAvailable() {
+#ifdef CLING_SAMPLE_STACKS
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  bool SampleProfiler::start(unsigned Interval) {
+#ifdef CLING_SAMPLE_STACKS
+    stop();
+    std::unique_ptr<Samples> S(new Samples());
+    pthread_attr_t Attr;
+    if (pthread_getattr_np(pthread_self(), &Attr))
+      return false;
+    void* Addr = nullptr;
+    size_t Size = 0;
+    const bool HasStack = !pthread_attr_getstack(&Attr, &Addr, &Size);
+    pthread_attr_destroy(&Attr);
+    if (!HasStack)
+      return false;
+    S->StackLow = uintptr_t(Addr);
+    S->StackHigh = S->StackLow + Size;
+    S->Interval = Interval ? Interval : 1;
+
+    Samples* None = nullptr;
+    if (!gSampling.compare_exchange_strong(None, S.get()))
+      return false;
+    struct sigaction Action;
+    std::memset(&Action, 0, sizeof(Action));
+    Action.sa_sigaction = takeSample;
+    Action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&Action.sa_mask);
+    sigaction(SIGPROF, &Action, &gPrevAction);
+
+    itimerval Timer;
+    Timer.it_interval.tv_sec = S->Interval / 1000000;
+    Timer.it_interval.tv_usec = S->Interval % 1000000;
+    Timer.it_value = Timer.it_interval;
+    if (setitimer(ITIMER_PROF, &Timer, nullptr)) {
+      sigaction(SIGPROF, &gPrevAction, nullptr);
+      gSampling.store(nullptr);
+      return false;
+    }
+    S->Running = true;
+    m_Samples = std::move(S);
+    return true;
+#else
+    (void)Interval;
+    return false;
+#endif
+  }
+
+  bool SampleProfiler::stop() {
+    if (!m_Samples || !m_Samples->Running)
+      return false;
+#ifdef CLING_SAMPLE_STACKS
+    itimerval Off;
+    std::memset(&Off, 0, sizeof(Off));
+    setitimer(ITIMER_PROF, &Off, nullptr);
+    gSampling.store(nullptr);
+    // A SIGPROF still pending would terminate the process by default; our
+    // handler, now doing nothing, stays instead.
+    if (gPrevAction.sa_handler != SIG_DFL)
+      sigaction(SIGPROF, &gPrevAction, nullptr);
+#endif
+    m_Samples->Running = false;
+    return true;
+  }
+
+  bool SampleProfiler::isRunning() const {
+    return m_Samples && m_Samples->Running;
+  }
+
+  ProfileReport
+  SampleProfiler::report(const std::function<std::string(ObjectKey)>&
+                           OriginOf) const {
+    ProfileReport Report;
+    Report.Enabled = isAvailable();
+    if (!m_Samples)
+      return Report;
+    const Samples& S = *m_Samples;
+    Report.Running = S.Running;
+    Report.Interval = S.Interval;
+    const size_t N = S.Taken.load(std::memory_order_acquire);
+    Report.Samples = N;
+    Report.Dropped = S.Dropped.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+    // The function of each address and of each start of code.
+    DenseMap<uintptr_t, unsigned> OfAddress, OfStart;
+    std::vector<bool> IsJITted;
+    auto Symbolize = [&](uintptr_t Addr) -> unsigned {
+      auto IAddr = OfAddress.find(Addr);
+      if (IAddr != OfAddress.end())
+        return IAddr->second;
+      uintptr_t Start = 0;
+      std::string Name, Origin;
+      bool JITted = false;
+      auto ICode = m_Code.upper_bound(Addr);
+      if (ICode != m_Code.begin() && Addr < std::prev(ICode)->second.End) {
+        --ICode;
+        Start = ICode->first;
+        Name = ICode->second.Name;
+        Origin = OriginOf(ICode->second.Key);
+        JITted = true;
+      }
+#ifdef CLING_SAMPLE_STACKS
+      Dl_info Info;
+      if (!JITted && dladdr(reinterpret_cast<void*>(Addr), &Info)) {
+        if (Info.dli_fname)
+          Origin = sys::path::filename(Info.dli_fname).str();
+        if (Info.dli_sname && Info.dli_saddr) {
+          Start = uintptr_t(Info.dli_saddr);
+          Name = Info.dli_sname;
+        } else
+          Start = uintptr_t(Info.dli_fbase);
+      }
+#endif
+      auto IStart = OfStart.find(Start);
+      unsigned Index;
+      if (IStart != OfStart.end())
+        Index = IStart->second;
+      else {
+        Index = Report.Functions.size();
+        OfStart[Start] = Index;
+        ProfileReport::Function F;
+        std::string Demangled = utils::platform::Demangle(Name);
+        F.Name = !Demangled.empty() ? Demangled
+                 : !Name.empty() ? Name : std::string("[unknown]");
+        F.Origin = std::move(Origin);
+        Report.Functions.push_back(std::move(F));
+        IsJITted.push_back(JITted);
+      }
+      OfAddress[Addr] = Index;
+      return Index;
+    };
+
+    std::vector<unsigned> Frames, Seen;
+    for (size_t I = 0; I < N; ++I) {
+      const Samples::Stack& Stack = S.Stacks[I];
+      Frames.clear();
+      // The return addresses follow the calls, which might end the caller.
+      for (unsigned D = 0; D < Stack.Depth; ++D)
+        Frames.push_back(Symbolize(D ? Stack.PCs[D] - 1 : Stack.PCs[D]));
+      ++Report.Functions[Frames.front()].Self;
+      Seen.clear();
+      for (unsigned F : Frames)
+        if (std::find(Seen.begin(), Seen.end(), F) == Seen.end()) {
+          Seen.push_back(F);
+          ++Report.Functions[F].Total;
+        }
+
+      size_t Outermost = Frames.size();
+      while (Outermost && !IsJITted[Frames[Outermost - 1]])
+        --Outermost;
+      if (!Outermost) {
+        ++Report.OutsideJIT;
+        continue;
+      }
+      std::vector<ProfileReport::Node>* Level = &Report.CallTree;
+      for (size_t D = Outermost; D-- > 0;) {
+        const unsigned F = Frames[D];
+        auto Node = std::find_if(Level->begin(), Level->end(),
+                                 [F](const ProfileReport::Node& Candidate) {
+                                   return Candidate.Function == F;
+                                 });
+        if (Node == Level->end()) {
+          Level->push_back(ProfileReport::Node{F, 0, {}});
+          Node = Level->end() - 1;
+        }
+        ++Node->Samples;
+        Level = &Node->Children;
+      }
+    }
+    sortReport(Report);
+    return Report;
+  }
+
+  void
+  SampleProfiler::notifyObjectLoaded(ObjectKey K,
+                                     const object::ObjectFile& Obj,
+                                     const RuntimeDyld::LoadedObjectInfo& L) {
+    std::vector<std::pair<uint64_t, Code>> Functions;
+    for (const auto& SymAndSize : object::computeSymbolSizes(Obj)) {
+      const object::SymbolRef& Sym = SymAndSize.first;
+      Expected<object::SymbolRef::Type> Type = Sym.getType();
+      if (!Type || *Type != object::SymbolRef::ST_Function
+          || !SymAndSize.second) {
+        consumeError(Type.takeError());
+        continue;
+      }
+      Expected<StringRef> Name = Sym.getName();
+      Expected<uint64_t> Addr = Sym.getAddress();
+      Expected<object::section_iterator> Sec = Sym.getSection();
+      if (!Name || !Addr || !Sec || *Sec == Obj.section_end()) {
+        consumeError(Name.takeError());
+        consumeError(Addr.takeError());
+        consumeError(Sec.takeError());
+        continue;
+      }
+      uint64_t Load = L.getSectionLoadAddress(**Sec);
+      if (!Load)
+        continue;
+      Load += *Addr - (*Sec)->getAddress();
+      Functions.emplace_back(Load,
+                             Code{Load + SymAndSize.second, Name->str(), K});
+    }
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+    // Of aliases, the first one names the code.
+    for (auto& F : Functions)
+      m_Code.emplace(F.first, std::move(F.second));
+  }
+
+  void SampleProfiler::notifyFreeingObject(ObjectKey K) {
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+    for (auto I = m_Code.begin(); I != m_Code.end();) {
+      if (I->second.Key == K)
+        I = m_Code.erase(I);
+      else
+        ++I;
+    }
+  }
+} // end namespace cling
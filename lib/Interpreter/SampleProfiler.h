@@ -0,0 +1,82 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_SAMPLE_PROFILER_H
+#define CLING_SAMPLE_PROFILER_H
+
+#include "cling/Interpreter/ProfileReport.h"
+
+#include "llvm/ExecutionEngine/JITEventListener.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace cling {
+  ///\brief Samples the call stacks of the thread that starts it, on SIGPROF,
+  /// and symbolizes them with the functions of the objects the JIT loaded;
+  /// see ProfileReport.
+  ///
+  /// The timer and the signal are the process's: one profiler of the process
+  /// samples at a time.
+  ///
+  class SampleProfiler : public llvm::JITEventListener {
+  public:
+    struct Samples;
+
+  private:
+    struct Code {
+      uint64_t End;
+      std::string Name; ///< Mangled.
+      ObjectKey Key;
+    };
+
+    ///\brief The code of the functions of the objects loaded, by address;
+    /// the JIT might load objects on other threads.
+    std::map<uint64_t, Code> m_Code;
+    mutable std::mutex m_Mutex;
+
+    ///\brief The samples of the last profile, also while it is running.
+    std::unique_ptr<Samples> m_Samples;
+
+  public:
+    SampleProfiler();
+    ~SampleProfiler();
+
+    ///\brief Whether the platform can sample.
+    static bool isAvailable();
+
+    ///\brief Starts sampling the calling thread every Interval microseconds
+    /// of CPU time, dropping the samples of before.
+    ///\returns false if the platform cannot sample, or another profiler of
+    /// the process is sampling.
+    bool start(unsigned Interval);
+
+    ///\brief Stops sampling, keeping the samples for report().
+    ///\returns false if it was not sampling.
+    bool stop();
+
+    bool isRunning() const;
+
+    ///\brief The profile of the samples so far.
+    ///\param OriginOf - names the input that the object of a JITted
+    /// function got compiled for.
+    ProfileReport report(const std::function<std::string(ObjectKey)>&
+                           OriginOf) const;
+
+    void
+    notifyObjectLoaded(ObjectKey K, const llvm::object::ObjectFile& Obj,
+                       const llvm::RuntimeDyld::LoadedObjectInfo& L) override;
+    void notifyFreeingObject(ObjectKey K) override;
+  };
+} // end namespace cling
+
+#endif // CLING_SAMPLE_PROFILER_H
@@ -0,0 +1,309 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "ScriptLibraryCache.h"
+#include "SharedCache.h"
+
+#include <cling-compiledata.h>
+
+#include "cling/Interpreter/Interpreter.h"
+#include "cling/Utils/Output.h"
+
+#include "clang/Basic/LangOptions.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Lex/PreprocessorOptions.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdlib>
+
+using namespace llvm;
+
+namespace {
+#if defined(_WIN32)
+  static const char kLibraryExt[] = ".dll";
+#elif defined(__APPLE__)
+  static const char kLibraryExt[] = ".dylib";
+#else
+  static const char kLibraryExt[] = ".so";
+#endif
+
+  ///\brief The MD5 of the file at Path; empty if it cannot be read.
+  static std::string hashFile(StringRef Path) {
+    auto Buf = MemoryBuffer::getFile(Path, /*FileSize*/ -1,
+                                     /*RequiresNullTerminator*/ false);
+    if (!Buf)
+      return std::string();
+    MD5 Hash;
+    Hash.update((*Buf)->getBuffer());
+    MD5::MD5Result Result;
+    Hash.final(Result);
+    return Result.digest().str();
+  }
+
+  ///\brief Appends the prerequisites of the Makefile rule that -MD wrote to
+  /// DepFile to Deps.
+  static bool readDepFile(StringRef DepFile, std::vector<std::string>& Deps) {
+    auto Buf = MemoryBuffer::getFile(DepFile);
+    if (!Buf)
+      return false;
+    StringRef Rule = (*Buf)->getBuffer();
+    // Not just ':', which is part of Windows paths.
+    size_t Colon = Rule.find(": ");
+    if (Colon == StringRef::npos)
+      return false;
+    std::string Dep;
+    for (size_t I = Colon + 2, E = Rule.size(); I <= E; ++I) {
+      const char C = I < E ? Rule[I] : '\n';
+      if (C == '\\' && I + 1 < E) {
+        // An escaped space belongs to the path, an escaped newline continues
+        // the rule.
+        if (Rule[I + 1] == ' ') {
+          Dep += ' ';
+          ++I;
+          continue;
+        }
+        if (Rule[I + 1] == '\n' || Rule[I + 1] == '\r')
+          continue;
+      }
+      if (C == ' ' || C == '\t' || C == '\n' || C == '\r') {
+        if (!Dep.empty())
+          Deps.push_back(Dep);
+        Dep.clear();
+        continue;
+      }
+      Dep += C;
+    }
+    return true;
+  }
+} // unnamed namespace
+
+namespace cling {
+
+ScriptLibraryCache::ScriptLibraryCache() {
+  SmallString<256> Dir;
+  if (const char* Env = ::getenv("CLING_SCRIPT_CACHE"))
+    Dir = Env;
+  else if (sys::path::cache_directory(Dir))
+    sys::path::append(Dir, "cling", "scripts");
+  m_Dir = Dir.str();
+}
+
+std::vector<std::string> ScriptLibraryCache::getCompiler() {
+  const char* Cmd = ::getenv("CLING_SCRIPT_CXX");
+  if (!Cmd || !*Cmd) {
+#if defined(CLING_CXX_RLTV)
+    Cmd = CLING_CXX_RLTV;
+#elif defined(CLING_CXX_PATH)
+    Cmd = CLING_CXX_PATH;
+#else
+    Cmd = "c++";
+#endif
+  }
+  SmallVector<StringRef, 4> Words;
+  StringRef(Cmd).split(Words, ' ', /*MaxSplit*/ -1, /*KeepEmpty*/ false);
+  return std::vector<std::string>(Words.begin(), Words.end());
+}
+
+std::vector<std::string> ScriptLibraryCache::getCommand(Interpreter& Interp) {
+  std::vector<std::string> Command = getCompiler();
+  const clang::CompilerInstance& CI = *Interp.getCI();
+
+  const clang::LangOptions& LO = CI.getLangOpts();
+  std::string Std = LO.GNUMode ? "-std=gnu++" : "-std=c++";
+  if (LO.CPlusPlus2a)
+    Std += "2a";
+  else if (LO.CPlusPlus17)
+    Std += "17";
+  else if (LO.CPlusPlus14)
+    Std += "14";
+  else
+    Std += "11";
+  Command.push_back(Std);
+  Command.push_back("-O" + std::to_string(Interp.getDefaultOptLevel()));
+
+  // The script is also parsed by the interpreter, which must see the same
+  // declarations.
+  for (const auto& Macro : CI.getPreprocessorOpts().Macros)
+    Command.push_back((Macro.second ? "-U" : "-D") + Macro.first);
+  SmallVector<std::string, 16> IncPaths;
+  Interp.GetIncludePaths(IncPaths, /*withSystem*/ false, /*withFlags*/ true);
+  Command.insert(Command.end(), IncPaths.begin(), IncPaths.end());
+
+  Command.push_back("-fPIC");
+  Command.push_back("-shared");
+#ifdef __APPLE__
+  // The script can use what the process provides.
+  Command.push_back("-undefined");
+  Command.push_back("dynamic_lookup");
+#endif
+  return Command;
+}
+
+bool ScriptLibraryCache::isUpToDate(StringRef Manifest) {
+  auto Buf = MemoryBuffer::getFile(Manifest);
+  if (!Buf)
+    return false;
+  // One "<hash> <path>" line per file.
+  SmallVector<StringRef, 16> Lines;
+  (*Buf)->getBuffer().split(Lines, '\n', /*MaxSplit*/ -1,
+                            /*KeepEmpty*/ false);
+  for (StringRef Line : Lines) {
+    std::pair<StringRef, StringRef> HashAndPath = Line.split(' ');
+    if (HashAndPath.second.empty()
+        || hashFile(HashAndPath.second) != HashAndPath.first)
+      return false;
+  }
+  return !Lines.empty();
+}
+
+bool ScriptLibraryCache::build(const std::vector<std::string>& Command,
+                               StringRef Script, StringRef Lib,
+                               StringRef Manifest) const {
+  ErrorOr<std::string> Compiler = sys::findProgramByName(Command[0]);
+  if (!Compiler) {
+    cling::errs() << "cling::ScriptLibraryCache: cannot find the compiler '"
+                  << Command[0] << "'\n";
+    return false;
+  }
+
+  // Jobs sharing the cache might build the same library: compile into a
+  // file of our own and move it into place.
+  int FD;
+  SmallString<256> TmpLib;
+  if (sys::fs::createUniqueFile(Lib + ".%%%%%%.tmp", FD, TmpLib)) {
+    cling::errs() << "cling::ScriptLibraryCache: cannot write to '" << m_Dir
+                  << "'\n";
+    return false;
+  }
+  sys::Process::SafelyCloseFileDescriptor(FD);
+  const std::string DepFile = (TmpLib + ".d").str();
+
+  std::vector<StringRef> Args(Command.begin(), Command.end());
+  Args.insert(Args.end(), {"-MD", "-MF", DepFile, "-x", "c++", Script,
+                           "-o", TmpLib});
+  std::string ErrMsg;
+  const int Result = sys::ExecuteAndWait(*Compiler, Args, None, {}, 0, 0,
+                                         &ErrMsg);
+  std::vector<std::string> Deps;
+  const bool HaveDeps = readDepFile(DepFile, Deps);
+  sys::fs::remove(DepFile);
+  if (Result || !HaveDeps) {
+    sys::fs::remove(TmpLib);
+    cling::errs() << "cling::ScriptLibraryCache: cannot compile '" << Script
+                  << "'";
+    if (!ErrMsg.empty())
+      cling::errs() << ": " << ErrMsg;
+    cling::errs() << '\n';
+    return false;
+  }
+
+  // The library itself too: a damaged one gets rebuilt.
+  std::string Contents = hashFile(TmpLib) + ' ' + Lib.str() + '\n';
+  for (const std::string& Dep : Deps) {
+    SmallString<256> AbsDep(Dep);
+    sys::fs::make_absolute(AbsDep);
+    std::string Hash = hashFile(AbsDep);
+    if (Hash.empty())
+      continue;
+    Contents += Hash + ' ' + AbsDep.str().str() + '\n';
+  }
+
+  SmallString<256> TmpManifest;
+  if (sys::fs::createUniqueFile(Manifest + ".%%%%%%.tmp", FD, TmpManifest)) {
+    sys::fs::remove(TmpLib);
+    return false;
+  }
+  {
+    raw_fd_ostream OS(FD, /*shouldClose*/ true);
+    OS << Contents;
+  }
+  // The library first: a manifest without it is taken as a cache miss.
+  if (sys::fs::rename(TmpLib, Lib) || sys::fs::rename(TmpManifest, Manifest)) {
+    sys::fs::remove(TmpLib);
+    sys::fs::remove(TmpManifest);
+    return false;
+  }
+  return true;
+}
+
+std::string ScriptLibraryCache::getLibrary(Interpreter& Interp,
+                                           StringRef Script, bool Rebuild) {
+  if (m_Dir.empty()) {
+    cling::errs() << "cling::ScriptLibraryCache: no cache directory, set "
+                     "CLING_SCRIPT_CACHE\n";
+    return std::string();
+  }
+  if (std::error_code EC = sys::fs::create_directories(m_Dir)) {
+    cling::errs() << "cling::ScriptLibraryCache: cannot use '" << m_Dir
+                  << "' as script cache: " << EC.message() << '\n';
+    return std::string();
+  }
+
+  SmallString<256> AbsScript(Script);
+  sys::fs::make_absolute(AbsScript);
+  const std::string ScriptHash = hashFile(AbsScript);
+  if (ScriptHash.empty()) {
+    cling::errs() << "cling::ScriptLibraryCache: cannot read '" << AbsScript
+                  << "'\n";
+    return std::string();
+  }
+
+  const std::vector<std::string> Command = getCommand(Interp);
+  MD5 Hash;
+  Hash.update(ScriptHash);
+  // Its quoted includes are found relative to it.
+  Hash.update(sys::path::parent_path(AbsScript));
+  for (const std::string& Word : Command)
+    Hash.update(StringRef(Word.c_str(), Word.size() + 1));
+  // A different compiler behind the same command makes a different library.
+  ErrorOr<std::string> Compiler = sys::findProgramByName(Command[0]);
+  sys::fs::file_status Status;
+  if (Compiler && !sys::fs::status(*Compiler, Status)) {
+    Hash.update(std::to_string(Status.getSize()));
+    Hash.update(std::to_string(
+                  sys::toTimeT(Status.getLastModificationTime())));
+  }
+  MD5::MD5Result Result;
+  Hash.final(Result);
+
+  SmallString<256> Path(m_Dir);
+  sys::path::append(Path, sys::path::stem(AbsScript) + "-"
+                          + Result.digest().str());
+  const std::string Lib = (Path + kLibraryExt).str();
+  const std::string Manifest = (Path + ".deps").str();
+  auto IsCached = [&]() {
+    if (Rebuild || !sys::fs::exists(Lib) || !isUpToDate(Manifest))
+      return false;
+    cache::touch(Lib);
+    cache::touch(Manifest);
+    return true;
+  };
+  if (IsCached())
+    return Lib;
+  // Of the jobs missing the library, one builds it for the others.
+  cache::EntryLock Lock(Lib);
+  if (IsCached())
+    return Lib;
+  if (!build(Command, AbsScript, Lib, Manifest))
+    return std::string();
+  // Not the library the caller is about to load.
+  cache::prune(m_Dir, cache::getSizeLimit("CLING_SCRIPT_CACHE_SIZE"),
+               {kLibraryExt, ".deps"}, {Lib, Manifest});
+  return Lib;
+}
+
+} // end namespace cling
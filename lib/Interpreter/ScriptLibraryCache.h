@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_SCRIPT_LIBRARY_CACHE_H
+#define CLING_SCRIPT_LIBRARY_CACHE_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+#include <vector>
+
+namespace cling {
+  class Interpreter;
+
+  ///\brief Shared libraries compiled from scripts, for `.L script.C+`.
+  ///
+  /// A script is compiled by the host compiler ($CLING_SCRIPT_CXX, or the
+  /// one cling was configured with) with the interpreter's language standard,
+  /// macros, include paths and optimization level. The library is named
+  /// after the hash of the script's contents, directory and these flags; a
+  /// manifest next to it lists the hashes of the files it was compiled from,
+  /// as reported by the compiler. The library is reused as long as none of
+  /// them changed.
+  ///
+  /// The cache lives in $CLING_SCRIPT_CACHE, or in the user's cache
+  /// directory. Of the jobs sharing it that miss a library, one builds it
+  /// while the others wait; $CLING_SCRIPT_CACHE_SIZE, e.g. "1G", bounds its
+  /// size by evicting the least recently used libraries.
+  ///
+  class ScriptLibraryCache {
+    std::string m_Dir;
+
+    ///\brief The compiler and its flags for the scripts of Interp.
+    static std::vector<std::string> getCommand(Interpreter& Interp);
+
+    ///\brief Whether the manifest at Manifest lists unchanged files only.
+    static bool isUpToDate(llvm::StringRef Manifest);
+
+    ///\brief Compiles Script into Lib, writing Manifest.
+    bool build(const std::vector<std::string>& Command, llvm::StringRef Script,
+               llvm::StringRef Lib, llvm::StringRef Manifest) const;
+
+  public:
+    ScriptLibraryCache();
+
+    ///\brief The words of the command compiling scripts, without flags.
+    static std::vector<std::string> getCompiler();
+
+    ///\brief The library compiled from Script for Interp, built if there is
+    /// none or if Rebuild is set; empty on failure, which is reported.
+    std::string getLibrary(Interpreter& Interp, llvm::StringRef Script,
+                           bool Rebuild);
+  };
+} // end namespace cling
+
+#endif // CLING_SCRIPT_LIBRARY_CACHE_H
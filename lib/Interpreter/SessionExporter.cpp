@@ -0,0 +1,389 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "SessionExporter.h"
+
+#include "BackendPasses.h"
+#include "CodeGenPipeline.h"
+#include "ScriptLibraryCache.h"
+
+#include "cling/Interpreter/DynamicLibraryManager.h"
+#include "cling/Interpreter/Interpreter.h"
+#include "cling/Interpreter/Transaction.h"
+#include "cling/Utils/AST.h"
+#include "cling/Utils/Output.h"
+
+#include "clang/AST/Decl.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Sema/Sema.h"
+
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+namespace cling {
+
+  void SessionExporter::add(const Transaction& T) {
+    if (T.getState() != Transaction::kCommitted
+        || T.getIssuedDiags() == Transaction::kErrors)
+      return;
+    m_Transactions.push_back(&T);
+    if (clang::FunctionDecl* FD = T.getWrapperFD()) {
+      std::string Name;
+      utils::Analyze::maybeMangleDeclName(FD, Name);
+      m_Wrappers.insert(Name);
+    }
+    for (auto I = T.nested_begin(), E = T.nested_end(); I != E; ++I)
+      add(**I);
+  }
+
+  std::unique_ptr<Module> SessionExporter::linkModules() const {
+    std::unique_ptr<Module> Session;
+    for (const Transaction* T : m_Transactions) {
+      const Module* M = T->getModule();
+      if (!M)
+        continue;
+      if (M->getModuleFlag(BackendPasses::getTierUpFlagName())) {
+        cling::errs() << "cling::SessionExporter: the session was compiled "
+                         "for tiered compilation, which cannot be exported; "
+                         "unset CLING_TIERED_COMPILATION\n";
+        return nullptr;
+      }
+      if (M->getModuleFlag(CodeGenPipeline::getFlagName())) {
+        cling::errs() << "cling::SessionExporter: the session was compiled "
+                         "while parsed, and lacks the IR of some functions; "
+                         "unset CLING_PIPELINE_CODEGEN\n";
+        return nullptr;
+      }
+      if (!Session) {
+        Session = llvm::make_unique<Module>("cling-session", M->getContext());
+        Session->setTargetTriple(M->getTargetTriple());
+        Session->setDataLayout(M->getDataLayout());
+      }
+      if (Linker::linkModules(*Session, CloneModule(*M))) {
+        cling::errs() << "cling::SessionExporter: cannot link the code of '"
+                      << M->getName() << "'\n";
+        return nullptr;
+      }
+    }
+    if (!Session)
+      cling::errs() << "cling::SessionExporter: the session has no code\n";
+    return Session;
+  }
+
+  void SessionExporter::stripInterpreterCode(Module& M) const {
+    // The statements ran in the session; only its declarations are exported.
+    for (auto I = M.begin(), E = M.end(); I != E;) {
+      Function& F = *I++;
+      if (!m_Wrappers.count(F.getName()))
+        continue;
+      F.deleteBody();
+      if (F.use_empty())
+        F.eraseFromParent();
+    }
+
+    // The interpreter defines __dso_handle as its own address, see
+    // Interpreter::Initialize(): register the destructors with the library
+    // instead, to run them when it is unloaded.
+    Function* AtExit = M.getFunction("__cxa_atexit");
+    if (!AtExit)
+      return;
+    GlobalVariable* DSOHandle = M.getNamedGlobal("__dso_handle");
+    for (User* U : AtExit->users()) {
+      CallInst* Call = dyn_cast<CallInst>(U);
+      if (!Call || Call->getNumArgOperands() != 3)
+        continue;
+      Value* Handle = Call->getArgOperand(2);
+      if (isa<GlobalValue>(Handle->stripPointerCasts()))
+        continue;
+      if (!DSOHandle) {
+        DSOHandle = new GlobalVariable(M, Type::getInt8Ty(M.getContext()),
+                                       /*isConstant*/ false,
+                                       GlobalValue::ExternalLinkage,
+                                       /*Initializer*/ nullptr,
+                                       "__dso_handle");
+        DSOHandle->setVisibility(GlobalValue::HiddenVisibility);
+      }
+      Call->setArgOperand(2, ConstantExpr::getBitCast(DSOHandle,
+                                                      Handle->getType()));
+    }
+  }
+
+  void SessionExporter::reportRuntimeSymbols(const Module& M) const {
+    std::vector<StringRef> Names;
+    for (const GlobalValue& GV : M.global_values()) {
+      if (!GV.isDeclaration() || GV.use_empty())
+        continue;
+      StringRef Name = GV.getName();
+      if (Name.startswith("cling_runtime") || Name.contains("N5cling"))
+        Names.push_back(Name);
+    }
+    if (Names.empty())
+      return;
+    cling::errs() << "cling::SessionExporter: warning: the code uses the "
+                     "interpreter's runtime, which the library needs at "
+                     "load time:";
+    for (StringRef Name : Names)
+      cling::errs() << ' ' << Name;
+    cling::errs() << '\n';
+  }
+
+  bool SessionExporter::emitObject(Module& M, raw_pwrite_stream& OS) const {
+    auto JTMB = orc::JITTargetMachineBuilder::detectHost();
+    if (!JTMB) {
+      cling::errs() << "cling::SessionExporter: "
+                    << toString(JTMB.takeError()) << '\n';
+      return false;
+    }
+    // The library can be loaded at any address.
+    JTMB->setRelocationModel(Reloc::PIC_);
+    static const CodeGenOpt::Level Levels[] = {
+      CodeGenOpt::None, CodeGenOpt::Less, CodeGenOpt::Default,
+      CodeGenOpt::Aggressive
+    };
+    JTMB->setCodeGenOptLevel(Levels[std::min(std::max(m_OptLevel, 0), 3)]);
+    auto TM = JTMB->createTargetMachine();
+    if (!TM) {
+      cling::errs() << "cling::SessionExporter: "
+                    << toString(TM.takeError()) << '\n';
+      return false;
+    }
+
+    M.setDataLayout((*TM)->createDataLayout());
+    BackendPasses::runStandalone(M, **TM, m_OptLevel);
+
+    legacy::PassManager PM;
+    if ((*TM)->addPassesToEmitFile(PM, OS, nullptr,
+                                   TargetMachine::CGFT_ObjectFile)) {
+      cling::errs() << "cling::SessionExporter: cannot emit objects for "
+                    << M.getTargetTriple() << '\n';
+      return false;
+    }
+    PM.run(M);
+    return true;
+  }
+
+  bool SessionExporter::emitObject(Module& M, StringRef Path) const {
+    std::error_code EC;
+    raw_fd_ostream OS(Path, EC, sys::fs::F_None);
+    if (EC) {
+      cling::errs() << "cling::SessionExporter: cannot write '" << Path
+                    << "': " << EC.message() << '\n';
+      return false;
+    }
+    return emitObject(M, OS);
+  }
+
+  bool SessionExporter::linkLibrary(StringRef Object, StringRef Path) const {
+    const std::vector<std::string> Command = ScriptLibraryCache::getCompiler();
+    ErrorOr<std::string> Compiler = sys::findProgramByName(Command[0]);
+    if (!Compiler) {
+      cling::errs() << "cling::SessionExporter: cannot find the compiler '"
+                    << Command[0] << "'\n";
+      return false;
+    }
+    std::vector<StringRef> Args(Command.begin(), Command.end());
+    Args.insert(Args.end(), {"-shared", Object, "-o", Path});
+#ifdef __APPLE__
+    // The code can use what the process loading it provides.
+    Args.insert(Args.end(), {"-undefined", "dynamic_lookup"});
+#endif
+    std::string ErrMsg;
+    const int Result = sys::ExecuteAndWait(*Compiler, Args, None, {}, 0, 0,
+                                           &ErrMsg);
+    if (Result) {
+      cling::errs() << "cling::SessionExporter: cannot link '" << Path << "'";
+      if (!ErrMsg.empty())
+        cling::errs() << ": " << ErrMsg;
+      cling::errs() << '\n';
+      return false;
+    }
+    return true;
+  }
+
+  bool SessionExporter::writeHeader(StringRef Path) const {
+    clang::CompilerInstance& CI = *m_Interp.getCI();
+    const clang::SourceManager& SM = CI.getSourceManager();
+
+    // What the session included is included again, what it declared itself
+    // (in the buffers of its inputs, which have no file) is forward declared.
+    SetVector<const clang::FileEntry*> Includes;
+    Transaction Decls(CI.getSema());
+    for (const Transaction* T : m_Transactions) {
+      for (auto I = T->decls_begin(), E = T->decls_end(); I != E; ++I) {
+        if (I->m_Call != Transaction::kCCIHandleTopLevelDecl)
+          continue;
+        for (clang::Decl* D : I->m_DGR) {
+          if (D->isImplicit() || D == T->getWrapperFD())
+            continue;
+          clang::FileID FID
+            = SM.getFileID(SM.getExpansionLoc(D->getBeginLoc()));
+          if (FID.isInvalid())
+            continue;
+          if (!SM.getFileEntryForID(FID)) {
+            Decls.append(D);
+            continue;
+          }
+          // Find the header that an input included.
+          while (true) {
+            clang::SourceLocation IncludeLoc = SM.getIncludeLoc(FID);
+            if (IncludeLoc.isInvalid())
+              break;
+            clang::FileID Includer
+              = SM.getFileID(SM.getExpansionLoc(IncludeLoc));
+            if (!SM.getFileEntryForID(Includer)) {
+              Includes.insert(SM.getFileEntryForID(FID));
+              break;
+            }
+            FID = Includer;
+          }
+        }
+      }
+    }
+
+    std::error_code EC;
+    raw_fd_ostream OS(Path, EC, sys::fs::F_Text);
+    if (EC) {
+      cling::errs() << "cling::SessionExporter: cannot write '" << Path
+                    << "': " << EC.message() << '\n';
+      Decls.setState(Transaction::kCommitted);
+      return false;
+    }
+    OS << "// The declarations of a cling session, see .export.\n"
+          "#pragma once\n\n";
+    for (const clang::FileEntry* FE : Includes)
+      OS << "#include \"" << FE->getName() << "\"\n";
+    OS << '\n';
+    // This also marks Decls as committed.
+    m_Interp.forwardDeclare(Decls, CI.getPreprocessor(), CI.getASTContext(),
+                            OS);
+    return true;
+  }
+
+  std::unique_ptr<Module> SessionExporter::prepareModule() const {
+    std::unique_ptr<Module> M = linkModules();
+    if (!M)
+      return nullptr;
+    stripInterpreterCode(*M);
+    reportRuntimeSymbols(*M);
+    return M;
+  }
+
+  bool SessionExporter::write(StringRef Path) const {
+    std::unique_ptr<Module> M = prepareModule();
+    if (!M)
+      return false;
+
+    const bool ObjectOnly = sys::path::extension(Path) == ".o";
+    SmallString<256> Object(Path);
+    if (!ObjectOnly) {
+      int FD;
+      if (sys::fs::createUniqueFile(Path + ".%%%%%%.o", FD, Object)) {
+        cling::errs() << "cling::SessionExporter: cannot write next to '"
+                      << Path << "'\n";
+        return false;
+      }
+      sys::Process::SafelyCloseFileDescriptor(FD);
+    }
+    const bool Written = emitObject(*M, Object)
+                         && (ObjectOnly || linkLibrary(Object, Path));
+    if (!ObjectOnly)
+      sys::fs::remove(Object);
+    if (!Written)
+      return false;
+
+    SmallString<256> Header(Path);
+    sys::path::replace_extension(Header, ".h");
+    return writeHeader(Header);
+  }
+
+  bool SessionExporter::writePackage(raw_ostream& OS) const {
+    std::unique_ptr<Module> M = prepareModule();
+    if (!M)
+      return false;
+    SmallVector<char, 0> Object;
+    raw_svector_ostream ObjectOS(Object);
+    if (!emitObject(*M, ObjectOS))
+      return false;
+
+    auto Obj = object::ObjectFile::createObjectFile(
+      MemoryBufferRef(StringRef(Object.data(), Object.size()), "package"));
+    if (!Obj) {
+      cling::errs() << "cling::SessionExporter: "
+                    << toString(Obj.takeError()) << '\n';
+      return false;
+    }
+
+    // What the object leaves undefined is either in the process, in a
+    // library or defined by the code of earlier transactions, which the
+    // host added before. Only the libraries that the interpreter loaded on
+    // top of the process are the package's to name.
+    DynamicLibraryManager* DLM = m_Interp.getDynamicLibraryManager();
+    std::vector<std::string> Needs;
+    SetVector<std::string> Libraries;
+    // Searched for all at once.
+    std::vector<std::string> Unresolved;
+    for (const object::SymbolRef& Sym : (*Obj)->symbols()) {
+      // Weak references may stay undefined.
+      const uint32_t Flags = Sym.getFlags();
+      if (!(Flags & object::SymbolRef::SF_Undefined)
+          || (Flags & object::SymbolRef::SF_Weak))
+        continue;
+      Expected<StringRef> Name = Sym.getName();
+      if (!Name || Name->empty()) {
+        consumeError(Name.takeError());
+        continue;
+      }
+      Needs.push_back(Name->str());
+      StringRef LinkageName = *Name;
+#ifdef __APPLE__
+      LinkageName.consume_front("_");
+#endif
+      bool FromJIT = false;
+      if (void* Addr = m_Interp.getAddressOfGlobal(LinkageName, &FromJIT)) {
+        if (FromJIT || !DLM)
+          continue;
+        std::string Library = DynamicLibraryManager::getSymbolLocation(Addr);
+        if (!Library.empty() && DLM->isLibraryLoaded(Library))
+          Libraries.insert(Library);
+      } else if (DLM)
+        Unresolved.push_back(LinkageName.str());
+    }
+    if (!Unresolved.empty())
+      for (std::string& Library : DLM->searchLibrariesForSymbols(Unresolved))
+        if (!Library.empty())
+          Libraries.insert(std::move(Library));
+
+    OS << "cling package 1\n";
+    for (const std::string& Library : Libraries)
+      OS << "library " << Library << '\n';
+    for (const std::string& Name : Needs)
+      OS << "needs " << Name << '\n';
+    OS << "object " << Object.size() << '\n';
+    OS.write(Object.data(), Object.size());
+    return true;
+  }
+} // end namespace cling
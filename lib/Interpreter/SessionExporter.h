@@ -0,0 +1,94 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_SESSION_EXPORTER_H
+#define CLING_SESSION_EXPORTER_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+  class Module;
+  class raw_ostream;
+  class raw_pwrite_stream;
+}
+
+namespace cling {
+  class Interpreter;
+  class Transaction;
+
+  ///\brief Writes the code of committed transactions into a shared library or
+  /// an object file, to use it without the interpreter; see
+  /// Interpreter::exportSession().
+  ///
+  /// The modules the transactions got back from the JIT are linked into one,
+  /// without the wrappers of the statements, optimized anew at the requested
+  /// level and compiled as position independent code. The shared library is
+  /// linked by the compiler of the scripts, see ScriptLibraryCache. A header
+  /// next to it includes the headers the session included and forward
+  /// declares what the session declared itself.
+  ///
+  /// A package instead carries the object with what it needs from outside,
+  /// for hosts running it through libclingExec: packages of consecutive
+  /// transactions are added in order, each resolving to the earlier ones.
+  ///
+  class SessionExporter {
+    Interpreter& m_Interp;
+    int m_OptLevel;
+
+    ///\brief The transactions, nested ones included, in order.
+    std::vector<const Transaction*> m_Transactions;
+
+    ///\brief The linkage names of their wrappers.
+    llvm::StringSet<> m_Wrappers;
+
+    ///\brief Links copies of the modules of m_Transactions.
+    std::unique_ptr<llvm::Module> linkModules() const;
+
+    ///\brief Removes the wrappers and points what depends on the interpreter
+    /// at the library.
+    void stripInterpreterCode(llvm::Module& M) const;
+
+    ///\brief Reports the symbols of the interpreter's runtime that M uses,
+    /// which remain undefined outside of the interpreter.
+    void reportRuntimeSymbols(const llvm::Module& M) const;
+
+    ///\brief Links, strips and reports the code of m_Transactions.
+    std::unique_ptr<llvm::Module> prepareModule() const;
+
+    bool emitObject(llvm::Module& M, llvm::raw_pwrite_stream& OS) const;
+    bool emitObject(llvm::Module& M, llvm::StringRef Path) const;
+    bool linkLibrary(llvm::StringRef Object, llvm::StringRef Path) const;
+    bool writeHeader(llvm::StringRef Path) const;
+
+  public:
+    SessionExporter(Interpreter& Interp, int OptLevel):
+      m_Interp(Interp), m_OptLevel(OptLevel) {}
+
+    ///\brief Exports T and its nested transactions, unless they failed.
+    void add(const Transaction& T);
+
+    ///\brief Writes the library, or the object file if Path ends in ".o",
+    /// and the header, Path with the extension ".h".
+    ///\returns false if it failed, which is reported.
+    bool write(llvm::StringRef Path) const;
+
+    ///\brief Writes the package of the code into OS, for
+    /// ObjectRunner::addPackage(): the object, the symbols it leaves
+    /// undefined and the libraries that the interpreter loaded, or that its
+    /// Dyld finds, to define them.
+    ///\returns false if it failed, which is reported.
+    bool writePackage(llvm::raw_ostream& OS) const;
+  };
+} // end namespace cling
+
+#endif // CLING_SESSION_EXPORTER_H
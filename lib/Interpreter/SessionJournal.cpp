@@ -0,0 +1,239 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "SessionJournal.h"
+
+#include "cling/Utils/Output.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+// A journal starts with kHeader, then has an entry per input:
+//   input <kind> <opt level> <raw input> <size>
+//   <the input, of size bytes>
+//   module <source key> <object key, or '-'>    (per module)
+//   end
+// An entry without its "end", e.g. of a crashed session, is ignored.
+
+namespace {
+  static const char kHeader[] = "cling journal 1\n";
+} // unnamed namespace
+
+namespace cling {
+
+  Interpreter::CompilationResult
+  SessionJournal::Scope::commit(Kind K, int OptLevel, bool RawInput,
+                                StringRef Input,
+                                Interpreter::CompilationResult Result) {
+    if (!m_Journal)
+      return Result;
+    SessionJournal* Journal = m_Journal;
+    m_Journal = nullptr;
+    if (Result != Interpreter::kSuccess) {
+      Journal->endInput(nullptr);
+      return Result;
+    }
+    Entry E{K, OptLevel, RawInput, Input.str(), {}};
+    Journal->endInput(&E);
+    return Result;
+  }
+
+  void SessionJournal::endInput(Entry* Recorded) {
+    if (--m_Depth)
+      return;
+    std::vector<Module> Modules;
+    Modules.swap(m_Modules);
+    // What gets replayed is in the journal it comes from already.
+    if (!Recorded || !isRecording() || m_Replaying)
+      return;
+    Recorded->Modules = std::move(Modules);
+    write(*Recorded);
+  }
+
+  bool SessionJournal::write(const Entry& E) const {
+    std::error_code EC;
+    raw_fd_ostream OS(m_Path, EC, sys::fs::F_Append);
+    if (!EC) {
+      OS << "input " << char(E.K) << ' ' << E.OptLevel << ' '
+         << unsigned(E.RawInput) << ' ' << E.Input.size() << '\n'
+         << E.Input << '\n';
+      for (const Module& M : E.Modules)
+        OS << "module " << M.SourceKey << ' '
+           << (M.ObjectKey.empty() ? "-" : M.ObjectKey) << '\n';
+      OS << "end\n";
+      OS.close();
+      EC = OS.error();
+      OS.clear_error();
+    }
+    if (EC) {
+      cling::errs() << "cling::SessionJournal: cannot write '" << m_Path
+                    << "': " << EC.message() << '\n';
+      return false;
+    }
+    return true;
+  }
+
+  bool SessionJournal::startRecording(StringRef Path) {
+    uint64_t Size = 0;
+    if (!sys::fs::file_size(Path, Size) && Size) {
+      // Append to a journal, but never to another file.
+      auto Buf = MemoryBuffer::getFile(Path);
+      if (!Buf || !(*Buf)->getBuffer().startswith(kHeader)) {
+        cling::errs() << "cling::SessionJournal: '" << Path
+                      << "' is not a journal\n";
+        return false;
+      }
+    } else {
+      std::error_code EC;
+      raw_fd_ostream OS(Path, EC, sys::fs::F_None);
+      if (!EC) {
+        OS << kHeader;
+        OS.close();
+        EC = OS.error();
+        OS.clear_error();
+      }
+      if (EC) {
+        cling::errs() << "cling::SessionJournal: cannot write '" << Path
+                      << "': " << EC.message() << '\n';
+        return false;
+      }
+    }
+    m_Path = Path.str();
+    return true;
+  }
+
+  bool SessionJournal::read(StringRef Path, std::vector<Entry>& Entries) {
+    auto Buf = MemoryBuffer::getFile(Path);
+    if (!Buf) {
+      cling::errs() << "cling::SessionJournal: cannot read '" << Path
+                    << "': " << Buf.getError().message() << '\n';
+      return false;
+    }
+    StringRef Text = (*Buf)->getBuffer();
+    if (!Text.consume_front(kHeader)) {
+      cling::errs() << "cling::SessionJournal: '" << Path
+                    << "' is not a journal\n";
+      return false;
+    }
+
+    while (!Text.empty()) {
+      StringRef Line;
+      std::tie(Line, Text) = Text.split('\n');
+      SmallVector<StringRef, 5> Fields;
+      Line.split(Fields, ' ');
+      Entry E;
+      unsigned Raw = 0;
+      size_t Size = 0;
+      if (Fields.size() != 5 || Fields[0] != "input" || Fields[1].size() != 1
+          || StringRef("DSLH").find(Fields[1][0]) == StringRef::npos
+          || Fields[2].getAsInteger(10, E.OptLevel)
+          || Fields[3].getAsInteger(10, Raw)
+          || Fields[4].getAsInteger(10, Size)
+          || Text.size() <= Size || Text[Size] != '\n')
+        break;
+      E.K = Kind(Fields[1][0]);
+      E.RawInput = Raw;
+      E.Input = Text.substr(0, Size).str();
+      Text = Text.drop_front(Size + 1);
+
+      bool Ended = false;
+      while (!Ended && !Text.empty()) {
+        std::tie(Line, Text) = Text.split('\n');
+        Fields.clear();
+        Line.split(Fields, ' ');
+        if (Fields.size() == 1 && Fields[0] == "end")
+          Ended = true;
+        else if (Fields.size() == 3 && Fields[0] == "module")
+          E.Modules.push_back({Fields[1].str(),
+                               Fields[2] == "-" ? "" : Fields[2].str()});
+        else
+          break;
+      }
+      if (!Ended)
+        break;
+      Entries.push_back(std::move(E));
+    }
+    if (!Text.empty())
+      cling::errs() << "cling::SessionJournal: ignoring the corrupt end of '"
+                    << Path << "'\n";
+    return true;
+  }
+
+  Interpreter::CompilationResult
+  SessionJournal::replay(Interpreter& Interp, const Entry& E) {
+    m_Replaying = &E;
+    m_NextModule = 0;
+    const bool WasRaw = Interp.isRawInputEnabled();
+    const int WasOptLevel = Interp.getDefaultOptLevel();
+    Interp.enableRawInput(E.RawInput);
+    Interp.setDefaultOptLevel(E.OptLevel);
+    Interpreter::CompilationResult Result;
+    if (E.K == kLoad || E.K == kLoadHeader)
+      Result = Interp.loadFile(E.Input, /*allowSharedLib*/ E.K == kLoad);
+    else
+      Result = Interp.process(E.Input);
+    Interp.enableRawInput(WasRaw);
+    Interp.setDefaultOptLevel(WasOptLevel);
+    // The next modules would be compared with those of another input.
+    if (m_NextModule != E.Modules.size())
+      m_InSync = false;
+    m_Replaying = nullptr;
+    return Result;
+  }
+
+  Interpreter::CompilationResult
+  SessionJournal::restore(Interpreter& Interp, StringRef Path,
+                          bool DeclarationsOnly) {
+    std::vector<Entry> Entries;
+    if (!read(Path, Entries))
+      return Interpreter::kFailure;
+    for (Entry& E : Entries) {
+      if (DeclarationsOnly && E.K == kStatement) {
+        m_Deferred.push_back(std::move(E));
+        continue;
+      }
+      if (replay(Interp, E) != Interpreter::kSuccess) {
+        cling::errs() << "cling::SessionJournal: stopped restoring '" << Path
+                      << "' at an input that failed\n";
+        return Interpreter::kFailure;
+      }
+    }
+    return Interpreter::kSuccess;
+  }
+
+  Interpreter::CompilationResult
+  SessionJournal::runDeferred(Interpreter& Interp) {
+    while (!m_Deferred.empty()) {
+      Entry E = std::move(m_Deferred.front());
+      m_Deferred.pop_front();
+      if (replay(Interp, E) != Interpreter::kSuccess)
+        return Interpreter::kFailure;
+    }
+    return Interpreter::kSuccess;
+  }
+
+  std::string SessionJournal::replayedObject(StringRef SourceKey) {
+    const Module* Recorded = nullptr;
+    if (m_Replaying)
+      ++m_NumReplayed;
+    if (m_Replaying && m_NextModule < m_Replaying->Modules.size())
+      Recorded = &m_Replaying->Modules[m_NextModule++];
+    if (!Recorded || Recorded->SourceKey != SourceKey)
+      m_InSync = false;
+    return m_InSync ? Recorded->ObjectKey : std::string();
+  }
+
+  void SessionJournal::addModule(std::string SourceKey, std::string ObjectKey) {
+    if (isRecording() && m_Depth)
+      m_Modules.push_back({std::move(SourceKey), std::move(ObjectKey)});
+  }
+} // end namespace cling
@@ -0,0 +1,158 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_SESSION_JOURNAL_H
+#define CLING_SESSION_JOURNAL_H
+
+#include "cling/Interpreter/Interpreter.h"
+
+#include "llvm/ADT/StringRef.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace cling {
+  ///\brief Records the inputs a session committed, to restore the session
+  /// in another process by replaying them; see Interpreter::startJournal()
+  /// and Interpreter::restoreJournal().
+  ///
+  /// Each input records the modules it added to the JIT: the key of their
+  /// IR as CodeGen produced it and, with CLING_OBJECT_CACHE, the cache key
+  /// of their object. When a replayed input produces the same IR, in the
+  /// same order, the JIT gets the cached object without running the
+  /// optimizer. Once a module differs, or one got compiled outside of a
+  /// replay, the session is no longer the one recorded and its modules get
+  /// compiled as usual.
+  ///
+  class SessionJournal {
+  public:
+    enum Kind {
+      kDeclaration = 'D', ///< process()ed, without wrapper.
+      kStatement = 'S',   ///< process()ed in a wrapper.
+      kLoad = 'L',        ///< loadFile()d, possibly as a library.
+      kLoadHeader = 'H'   ///< loadFile()d as a header only.
+    };
+
+    struct Module {
+      std::string SourceKey;
+      ///\brief Empty if the object cannot be reused, e.g. it got tiered up.
+      std::string ObjectKey;
+    };
+
+    struct Entry {
+      Kind K;
+      int OptLevel;
+      bool RawInput;
+      std::string Input;
+      std::vector<Module> Modules;
+    };
+
+    ///\brief Brackets an input, which nests in the input running it; only
+    /// the outermost one gets recorded, with the modules of the nested ones.
+    class Scope {
+      SessionJournal* m_Journal;
+
+    public:
+      Scope(SessionJournal* Journal): m_Journal(Journal) {
+        if (m_Journal)
+          ++m_Journal->m_Depth;
+      }
+      ~Scope() {
+        if (m_Journal)
+          m_Journal->endInput(nullptr);
+      }
+
+      ///\brief Records the input if Result is kSuccess.
+      ///\returns Result.
+      Interpreter::CompilationResult
+      commit(Kind K, int OptLevel, bool RawInput, llvm::StringRef Input,
+             Interpreter::CompilationResult Result);
+    };
+
+  private:
+    ///\brief The file recording the inputs; empty if not recording.
+    std::string m_Path;
+
+    ///\brief The nesting of the current inputs, see Scope.
+    unsigned m_Depth = 0;
+
+    ///\brief The modules of the current outermost input.
+    std::vector<Module> m_Modules;
+
+    ///\brief The entry being replayed and its next module, if replaying.
+    const Entry* m_Replaying = nullptr;
+    size_t m_NextModule = 0;
+
+    ///\brief Whether the session still compiled the same as the recorded
+    /// one, such that their objects are interchangeable.
+    bool m_InSync = true;
+
+    ///\brief The modules that replays compiled, and how many of them got
+    /// their object out of the cache.
+    size_t m_NumReplayed = 0;
+    size_t m_NumReused = 0;
+
+    ///\brief The statements that a declarations-only restore kept.
+    std::deque<Entry> m_Deferred;
+
+    ///\brief Closes an input; records Recorded, with the modules of the
+    /// input, if it is the outermost one.
+    void endInput(Entry* Recorded);
+
+    ///\brief Appends E to m_Path.
+    bool write(const Entry& E) const;
+
+    ///\brief Reads the entries of the journal Path.
+    ///\returns false if it cannot be read, which is reported.
+    static bool read(llvm::StringRef Path, std::vector<Entry>& Entries);
+
+    ///\brief Runs the input of E, with the options it was recorded with.
+    Interpreter::CompilationResult replay(Interpreter& Interp,
+                                          const Entry& E);
+
+  public:
+    ///\brief Appends the inputs committed from now on to Path.
+    ///\returns false if Path cannot be written, which is reported.
+    bool startRecording(llvm::StringRef Path);
+    void stopRecording() { m_Path.clear(); }
+    bool isRecording() const { return !m_Path.empty(); }
+
+    ///\brief Replays the entries of the journal Path, stopping at the first
+    /// one that fails. DeclarationsOnly keeps the statements for
+    /// runDeferred().
+    Interpreter::CompilationResult restore(Interpreter& Interp,
+                                           llvm::StringRef Path,
+                                           bool DeclarationsOnly);
+
+    ///\brief Replays the statements that restore() kept, in order.
+    Interpreter::CompilationResult runDeferred(Interpreter& Interp);
+    size_t getNumDeferred() const { return m_Deferred.size(); }
+
+    ///\brief Whether the JIT should report its modules, through
+    /// replayedObject() and addModule(); once out of sync, only to record
+    /// them.
+    bool wantsModules() const { return m_InSync || isRecording(); }
+
+    ///\brief The object key that the replayed entry recorded for its next
+    /// module, if that one's source key was SourceKey too; empty otherwise.
+    std::string replayedObject(llvm::StringRef SourceKey);
+
+    ///\brief The object of the module that replayedObject() was asked for
+    /// last came out of the cache.
+    void reusedObject() { ++m_NumReused; }
+
+    size_t getNumReplayedModules() const { return m_NumReplayed; }
+    size_t getNumReusedObjects() const { return m_NumReused; }
+
+    ///\brief Records a module of the current input.
+    void addModule(std::string SourceKey, std::string ObjectKey);
+  };
+} // end namespace cling
+
+#endif // CLING_SESSION_JOURNAL_H
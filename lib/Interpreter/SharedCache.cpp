@@ -0,0 +1,204 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "SharedCache.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/LockFileManager.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+  ///\brief Ends the entries of writeCheckedEntry(), after the MD5 of their
+  /// contents; bump it if the layout changes.
+  static const char kTrailerMagic[8] = {'C', 'L', 'N', 'G', 'S', 'U', 'M', '1'};
+  static const size_t kTrailerSize = 16 + sizeof(kTrailerMagic);
+
+  static MD5::MD5Result checksum(StringRef Contents) {
+    MD5 Hash;
+    Hash.update(Contents);
+    MD5::MD5Result Result;
+    Hash.final(Result);
+    return Result;
+  }
+} // unnamed namespace
+
+namespace cling {
+namespace cache {
+
+EntryLock::EntryLock(StringRef Path) {
+  auto Lock = llvm::make_unique<LockFileManager>(Path);
+  switch (*Lock) {
+  case LockFileManager::LFS_Owned:
+    m_Lock = std::move(Lock);
+    break;
+  case LockFileManager::LFS_Shared:
+    // Rather than waiting on an owner that got stuck, build the entry too;
+    // the rename keeps that harmless.
+    if (Lock->waitForUnlock() == LockFileManager::Res_Timeout)
+      Lock->unsafeRemoveLockFile();
+    break;
+  case LockFileManager::LFS_Error:
+    // E.g. a read-only directory: readers do not need the lock.
+    break;
+  }
+}
+
+EntryLock::~EntryLock() = default;
+
+bool writeCheckedEntry(StringRef Path, StringRef Contents) {
+  int FD;
+  SmallString<256> TmpPath;
+  if (sys::fs::createUniqueFile(Path + ".%%%%%%.tmp", FD, TmpPath))
+    return false;
+  {
+    raw_fd_ostream OS(FD, /*shouldClose*/ true);
+    const MD5::MD5Result Sum = checksum(Contents);
+    OS << Contents;
+    OS.write(reinterpret_cast<const char*>(Sum.Bytes.data()), 16);
+    OS.write(kTrailerMagic, sizeof(kTrailerMagic));
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      sys::fs::remove(TmpPath);
+      return false;
+    }
+  }
+  if (sys::fs::rename(TmpPath, Path)) {
+    sys::fs::remove(TmpPath);
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<MemoryBuffer> readCheckedEntry(StringRef Path,
+                                               StringRef BufferName) {
+  auto Buf = MemoryBuffer::getFile(Path, /*FileSize*/ -1,
+                                   /*RequiresNullTerminator*/ false);
+  if (!Buf)
+    return nullptr;
+  StringRef Data = (*Buf)->getBuffer();
+  if (Data.size() >= kTrailerSize
+      && Data.endswith(StringRef(kTrailerMagic, sizeof(kTrailerMagic)))) {
+    StringRef Contents = Data.drop_back(kTrailerSize);
+    const MD5::MD5Result Sum = checksum(Contents);
+    if (!std::memcmp(Sum.Bytes.data(), Contents.end(), 16)) {
+      touch(Path);
+      // Copy it out of the mapped file, which another process might replace.
+      return MemoryBuffer::getMemBufferCopy(Contents, BufferName);
+    }
+  }
+  // Written by something else, or damaged since: make room for a good one.
+  sys::fs::remove(Path);
+  return nullptr;
+}
+
+void touch(StringRef Path) {
+  int FD;
+  if (sys::fs::openFileForWrite(Path, FD, sys::fs::CD_OpenExisting,
+                                sys::fs::OF_Append))
+    return;
+  sys::fs::setLastAccessAndModificationTime(FD,
+                                            std::chrono::system_clock::now());
+  sys::Process::SafelyCloseFileDescriptor(FD);
+}
+
+uint64_t getSizeLimit(const char* Var) {
+  const char* Env = ::getenv(Var);
+  if (!Env)
+    return 0;
+  char* End;
+  uint64_t Size = ::strtoull(Env, &End, 10);
+  switch (*End) {
+  case 'g': case 'G': Size <<= 10; LLVM_FALLTHROUGH;
+  case 'm': case 'M': Size <<= 10; LLVM_FALLTHROUGH;
+  case 'k': case 'K': Size <<= 10; break;
+  default: break;
+  }
+  return Size;
+}
+
+void prune(StringRef Dir, uint64_t MaxBytes, ArrayRef<StringRef> Suffixes,
+           ArrayRef<std::string> Keep) {
+  if (!MaxBytes)
+    return;
+  // Scanning a large directory after each new entry would cost more than
+  // the entries save; one process gets to do it in a while.
+  SmallString<256> Stamp(Dir);
+  sys::path::append(Stamp, "prune.stamp");
+  sys::fs::file_status Status;
+  const sys::TimePoint<> Now = std::chrono::system_clock::now();
+  if (!sys::fs::status(Stamp, Status)
+      && Now - Status.getLastModificationTime() < std::chrono::minutes(1))
+    return;
+  int FD;
+  if (sys::fs::openFileForWrite(Stamp, FD))
+    return;
+  sys::Process::SafelyCloseFileDescriptor(FD);
+
+  struct Entry {
+    sys::TimePoint<> Used;
+    uint64_t Size;
+    std::string Path;
+  };
+  std::vector<Entry> Entries;
+  uint64_t Total = 0;
+  std::error_code EC;
+  for (sys::fs::directory_iterator I(Dir, EC), E; I != E && !EC;
+       I.increment(EC)) {
+    const std::string& Path = I->path();
+    if (std::none_of(Suffixes.begin(), Suffixes.end(),
+                     [&](StringRef Suffix) {
+                       return StringRef(Path).endswith(Suffix);
+                     }))
+      continue;
+    if (sys::fs::status(Path, Status)
+        || Status.type() != sys::fs::file_type::regular_file)
+      continue;
+    Entries.push_back({Status.getLastModificationTime(), Status.getSize(),
+                       Path});
+    Total += Status.getSize();
+  }
+  if (Total <= MaxBytes)
+    return;
+
+  // Down to below the limit, not to prune again with the next entry. The
+  // processes that use an entry removed keep their copy or mapping of it.
+  std::sort(Entries.begin(), Entries.end(),
+            [](const Entry& L, const Entry& R) { return L.Used < R.Used; });
+  const uint64_t Target = MaxBytes - MaxBytes / 10;
+  for (const Entry& En : Entries) {
+    if (Total <= Target)
+      break;
+    if (std::any_of(Keep.begin(), Keep.end(),
+                    [&](const std::string& K) {
+                      return sys::fs::equivalent(K, En.Path);
+                    }))
+      continue;
+    if (!sys::fs::remove(En.Path))
+      Total -= En.Size;
+  }
+}
+
+} // end namespace cache
+} // end namespace cling
@@ -0,0 +1,81 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_SHARED_CACHE_H
+#define CLING_SHARED_CACHE_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace llvm {
+  class LockFileManager;
+  class MemoryBuffer;
+}
+
+namespace cling {
+  ///\brief What lets the on-disk caches be shared by the processes that start
+  /// together, e.g. the jobs of a node: only one of them builds a missing
+  /// entry, corrupt entries are dropped and the least recently used ones are
+  /// evicted to keep the directory below a size.
+  namespace cache {
+
+    ///\brief Lets one of the processes missing the entry Path build it.
+    ///
+    /// The others wait until it is done, or its lock went stale because it
+    /// died; they are then let through without the lock. Either way, look for
+    /// the entry again before building it: it might have appeared meanwhile.
+    ///
+    class EntryLock {
+      std::unique_ptr<llvm::LockFileManager> m_Lock;
+
+    public:
+      explicit EntryLock(llvm::StringRef Path);
+      ~EntryLock();
+
+      ///\brief Whether the entry is ours to build; the lock is released
+      /// when this goes away.
+      bool isOwner() const { return m_Lock != nullptr; }
+    };
+
+    ///\brief Writes Contents and their checksum to a unique temporary next
+    /// to Path, then renames it to Path: readers never see a partial entry.
+    ///\returns whether Path now holds the entry.
+    bool writeCheckedEntry(llvm::StringRef Path, llvm::StringRef Contents);
+
+    ///\brief A copy of the contents of the entry Path written by
+    /// writeCheckedEntry(), or null if there is none. An entry that fails its
+    /// checksum is removed. Marks the entry as used, see prune().
+    std::unique_ptr<llvm::MemoryBuffer>
+    readCheckedEntry(llvm::StringRef Path, llvm::StringRef BufferName);
+
+    ///\brief Marks the entry Path as used now: its modification time orders
+    /// the eviction of prune().
+    void touch(llvm::StringRef Path);
+
+    ///\brief The size in bytes that the environment variable Var asks for,
+    /// e.g. "800M": a number with an optional K, M or G suffix. 0 - no limit
+    /// - if it is not set.
+    uint64_t getSizeLimit(const char* Var);
+
+    ///\brief Removes the least recently used entries of Dir, its files with
+    /// one of Suffixes, until they take 90% of MaxBytes if they take more
+    /// than MaxBytes. Nothing happens without MaxBytes, or if a process
+    /// sharing Dir pruned it in the last minute. The files Keep, e.g. the
+    /// entry just written and about to be used, count but are not removed.
+    void prune(llvm::StringRef Dir, uint64_t MaxBytes,
+               llvm::ArrayRef<llvm::StringRef> Suffixes,
+               llvm::ArrayRef<std::string> Keep = llvm::None);
+
+  } // end namespace cache
+} // end namespace cling
+
+#endif // CLING_SHARED_CACHE_H
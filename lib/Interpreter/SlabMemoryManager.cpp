@@ -0,0 +1,179 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "SlabMemoryManager.h"
+
+#include "cling/Utils/Platform.h"
+
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/Process.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+namespace {
+  ///\brief The size of a slab, unless an allocation needs more.
+  static constexpr size_t kSlabSize = 1 << 20;
+
+  ///\brief The size of the code slabs backed by huge pages: a mapping of
+  /// twice the size of a huge page contains at least one aligned huge page.
+  static constexpr size_t kHugeSlabSize = 4 << 20;
+} // unnamed namespace
+
+namespace cling {
+
+SlabMemoryManager::SlabMemoryManager(bool HugeCodePages):
+  m_PageSize(sys::Process::getPageSizeEstimate()),
+  m_HugeCodePages(HugeCodePages) {}
+
+SlabMemoryManager::~SlabMemoryManager() {
+  for (Pool& P : m_Pools)
+    for (sys::MemoryBlock& Slab : P.Slabs)
+      sys::Memory::releaseMappedMemory(Slab);
+}
+
+bool SlabMemoryManager::addSlab(Pool& P, Purpose Kind, size_t Size) {
+  const bool Huge = Kind == kCode && m_HugeCodePages;
+  Size = std::max(Size, Huge ? kHugeSlabSize : kSlabSize);
+  unsigned Flags = sys::Memory::MF_READ | sys::Memory::MF_WRITE;
+  if (Huge)
+    Flags |= sys::Memory::MF_EXEC;
+
+  // Stay close to the other slabs: code refers to its data PC-relatively.
+  const sys::MemoryBlock* Near = nullptr;
+  for (const Pool& Other : m_Pools)
+    if (!Other.Slabs.empty())
+      Near = &Other.Slabs.back();
+
+  std::error_code EC;
+  sys::MemoryBlock Slab
+    = sys::Memory::allocateMappedMemory(Size, Near, Flags, EC);
+  if (EC)
+    return false;
+  if (Huge)
+    platform::AdviseHugePages(Slab.base(), Slab.size());
+  P.Slabs.push_back(Slab);
+  P.Free[uintptr_t(Slab.base())] = Slab.size();
+  return true;
+}
+
+uint8_t* SlabMemoryManager::allocate(Purpose Kind, uintptr_t Size,
+                                     unsigned Alignment) {
+  if (!Size)
+    return nullptr;
+  Alignment = std::max(Alignment, 1u);
+  size_t Needed = alignTo(Size, m_PageSize);
+  if (Alignment > m_PageSize)
+    Needed += Alignment;
+
+  Pool& P = m_Pools[Kind];
+  auto FirstFit = [&]() {
+    return std::find_if(P.Free.begin(), P.Free.end(),
+                        [Needed](const std::pair<const uintptr_t, size_t>& R) {
+                          return R.second >= Needed;
+                        });
+  };
+  auto I = FirstFit();
+  const bool Recycled = I != P.Free.end();
+  if (I == P.Free.end()) {
+    if (!addSlab(P, Kind, Needed))
+      return nullptr;
+    I = FirstFit();
+  }
+
+  const uintptr_t Begin = I->first;
+  const size_t Rest = I->second - Needed;
+  P.Free.erase(I);
+  if (Rest)
+    P.Free[Begin + Needed] = Rest;
+
+  const bool Protected = Kind != kRWData
+                         && !(Kind == kCode && m_HugeCodePages);
+  sys::MemoryBlock Block((void*)Begin, Needed);
+  // Released pages keep their protection until they are reused.
+  if (Protected && Recycled
+      && sys::Memory::protectMappedMemory(Block, sys::Memory::MF_READ
+                                                 | sys::Memory::MF_WRITE)) {
+    P.Free[Begin] = Needed;
+    return nullptr;
+  }
+  if (Kind != kRWData)
+    P.Unfinalized.push_back(Block);
+
+  const uintptr_t Addr = alignTo(Begin, Alignment);
+  m_Allocations[Addr] = Allocation{Kind, Begin, Needed};
+  return (uint8_t*)Addr;
+}
+
+bool SlabMemoryManager::finalizeMemory(std::string* ErrMsg) {
+  for (Purpose Kind : {kCode, kROData}) {
+    std::vector<sys::MemoryBlock>& Blocks = m_Pools[Kind].Unfinalized;
+    std::sort(Blocks.begin(), Blocks.end(),
+              [](const sys::MemoryBlock& L, const sys::MemoryBlock& R) {
+                return L.base() < R.base();
+              });
+    const unsigned Flags = sys::Memory::MF_READ
+      | (Kind == kCode ? sys::Memory::MF_EXEC : 0);
+    for (size_t I = 0, E = Blocks.size(); I < E;) {
+      // One call for each run of adjacent allocations.
+      uint8_t* Begin = (uint8_t*)Blocks[I].base();
+      uint8_t* End = Begin + Blocks[I].size();
+      for (++I; I < E && Blocks[I].base() == End; ++I)
+        End += Blocks[I].size();
+      sys::MemoryBlock Run(Begin, End - Begin);
+      if (Kind == kCode && m_HugeCodePages) {
+        sys::Memory::InvalidateInstructionCache(Begin, End - Begin);
+        continue;
+      }
+      if (std::error_code EC = sys::Memory::protectMappedMemory(Run, Flags)) {
+        if (ErrMsg)
+          *ErrMsg = EC.message();
+        return true;
+      }
+      if (Kind == kCode)
+        sys::Memory::InvalidateInstructionCache(Begin, End - Begin);
+    }
+    Blocks.clear();
+  }
+  return false;
+}
+
+void SlabMemoryManager::release(uint8_t* Addr) {
+  auto I = m_Allocations.find(uintptr_t(Addr));
+  if (I == m_Allocations.end())
+    return;
+  const Allocation A = I->second;
+  m_Allocations.erase(I);
+
+  Pool& P = m_Pools[A.Kind];
+  P.Unfinalized.erase(std::remove_if(P.Unfinalized.begin(),
+                                     P.Unfinalized.end(),
+                                     [&A](const sys::MemoryBlock& B) {
+                                       return uintptr_t(B.base()) == A.Begin;
+                                     }),
+                      P.Unfinalized.end());
+
+  uintptr_t Begin = A.Begin;
+  size_t Size = A.Size;
+  auto Next = P.Free.lower_bound(Begin);
+  if (Next != P.Free.end() && Begin + Size == Next->first) {
+    Size += Next->second;
+    Next = P.Free.erase(Next);
+  }
+  if (Next != P.Free.begin()) {
+    auto Prev = std::prev(Next);
+    if (Prev->first + Prev->second == Begin) {
+      Prev->second += Size;
+      return;
+    }
+  }
+  P.Free[Begin] = Size;
+}
+
+} // end namespace cling
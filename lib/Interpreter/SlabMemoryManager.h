@@ -0,0 +1,96 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_SLAB_MEMORY_MANAGER_H
+#define CLING_SLAB_MEMORY_MANAGER_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
+#include "llvm/Support/Memory.h"
+
+#include <map>
+#include <vector>
+
+namespace cling {
+
+  ///\brief Memory manager handing out the JIT memory from a few large
+  /// mappings, the slabs, instead of one mapping per allocation.
+  ///
+  /// Each allocation takes whole pages of the slabs of its kind (code,
+  /// read-only or read-write data), such that the allocations of an object,
+  /// which Azog packs into one reservation per kind, are protected
+  /// independently of their neighbours. finalizeMemory() protects all
+  /// allocations made since the last call, merging adjacent ones into one
+  /// call. Unlike the SectionMemoryManager, allocations can be released,
+  /// e.g. when their object is unloaded; the pages are reused by later
+  /// allocations of the same kind.
+  ///
+  class SlabMemoryManager: public llvm::RTDyldMemoryManager {
+  public:
+    enum Purpose { kCode, kROData, kRWData, kNumPurposes };
+
+  private:
+    struct Allocation {
+      Purpose Kind;
+      ///\brief The pages, of which the allocation might start later to be
+      /// aligned.
+      uintptr_t Begin;
+      size_t Size;
+    };
+
+    struct Pool {
+      std::vector<llvm::sys::MemoryBlock> Slabs;
+      ///\brief The unused pages of the slabs, by begin; adjacent ranges are
+      /// merged.
+      std::map<uintptr_t, size_t> Free;
+      ///\brief The allocations to protect at the next finalizeMemory().
+      std::vector<llvm::sys::MemoryBlock> Unfinalized;
+    };
+
+    Pool m_Pools[kNumPurposes];
+    llvm::DenseMap<uintptr_t, Allocation> m_Allocations;
+    size_t m_PageSize;
+
+    ///\brief Whether the code slabs are backed by huge pages. They are then
+    /// mapped executable and writable at once, as protecting some of their
+    /// pages would split the huge pages again.
+    bool m_HugeCodePages;
+
+    uint8_t* allocate(Purpose Kind, uintptr_t Size, unsigned Alignment);
+    bool addSlab(Pool& P, Purpose Kind, size_t Size);
+
+  public:
+    ///\param[in] HugeCodePages - whether to ask the system to back the
+    /// code with huge pages, which relieves the instruction TLB of large
+    /// sessions. Without support for it the code uses normal pages.
+    SlabMemoryManager(bool HugeCodePages = false);
+    ~SlabMemoryManager() override;
+
+    uint8_t* allocateCodeSection(uintptr_t Size, unsigned Alignment,
+                                 unsigned SectionID,
+                                 llvm::StringRef SectionName) override {
+      return allocate(kCode, Size, Alignment);
+    }
+
+    uint8_t* allocateDataSection(uintptr_t Size, unsigned Alignment,
+                                 unsigned SectionID,
+                                 llvm::StringRef SectionName,
+                                 bool IsReadOnly) override {
+      return allocate(IsReadOnly ? kROData : kRWData, Size, Alignment);
+    }
+
+    bool finalizeMemory(std::string* ErrMsg = nullptr) override;
+
+    ///\brief Returns the pages of an allocation to its slabs. Addr must have
+    /// been returned by allocateCodeSection() or allocateDataSection(), and
+    /// nothing may use it anymore.
+    void release(uint8_t* Addr);
+  };
+} // end namespace cling
+
+#endif // CLING_SLAB_MEMORY_MANAGER_H
@@ -0,0 +1,227 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "StatCacheFileSystem.h"
+
+#include "clang/Lex/HeaderSearchOptions.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <tuple>
+
+using namespace llvm;
+
+namespace {
+  static const char kHeader[] = "cling stat cache 1";
+
+  static int64_t getModTime(const vfs::Status& S) {
+    return S.getLastModificationTime().time_since_epoch().count();
+  }
+
+  static bool isNotFound(std::error_code EC) {
+    return EC == std::errc::no_such_file_or_directory
+           || EC == std::errc::not_a_directory;
+  }
+} // unnamed namespace
+
+namespace cling {
+
+  StatCacheFileSystem::StatCacheFileSystem(
+      IntrusiveRefCntPtr<vfs::FileSystem> FS,
+      std::shared_ptr<clang::HeaderSearchOptions> HSOpts, StringRef Path,
+      StringRef SharedPath):
+    ProxyFileSystem(std::move(FS)), m_Path(Path),
+    m_HSOpts(std::move(HSOpts)) {
+    if (!SharedPath.empty()) {
+      read(SharedPath);
+      for (auto& D : m_Dirs)
+        D.second.Shared = true;
+    }
+    if (!m_Path.empty())
+      read(m_Path);
+  }
+
+  StatCacheFileSystem::~StatCacheFileSystem() {
+    if (!m_Path.empty())
+      write();
+  }
+
+  IntrusiveRefCntPtr<vfs::FileSystem>
+  StatCacheFileSystem::createFromEnv(
+      IntrusiveRefCntPtr<vfs::FileSystem> FS,
+      std::shared_ptr<clang::HeaderSearchOptions> HSOpts) {
+    const char* Path = ::getenv("CLING_STAT_CACHE");
+    const char* Shared = ::getenv("CLING_SHARED_STAT_CACHE");
+    if ((!Path || !*Path) && (!Shared || !*Shared))
+      return FS;
+    return new StatCacheFileSystem(std::move(FS), std::move(HSOpts),
+                                   Path ? Path : "", Shared ? Shared : "");
+  }
+
+  void StatCacheFileSystem::read(StringRef Path) {
+    auto Buf = MemoryBuffer::getFile(Path);
+    if (!Buf)
+      return;
+    StringRef Rest = (*Buf)->getBuffer();
+    StringRef Line;
+    std::tie(Line, Rest) = Rest.split('\n');
+    if (Line != kHeader)
+      return;
+    Directory* D = nullptr;
+    while (!Rest.empty()) {
+      std::tie(Line, Rest) = Rest.split('\n');
+      StringRef Kind, Value;
+      std::tie(Kind, Value) = Line.split(' ');
+      if (Kind == "d") {
+        StringRef Time, Dir;
+        std::tie(Time, Dir) = Value.split(' ');
+        int64_t ModTime;
+        if (Time.getAsInteger(10, ModTime) || Dir.empty())
+          return;
+        D = &m_Dirs[Dir];
+        *D = Directory();
+        D->ModTime = ModTime;
+      } else if (Kind == "m" && D && !Value.empty())
+        D->Missing.insert(Value);
+      else
+        return;
+    }
+  }
+
+  void StatCacheFileSystem::write() const {
+    bool Dirty = false;
+    for (const auto& D : m_Dirs)
+      Dirty |= D.second.Dirty;
+    if (!Dirty)
+      return;
+
+    if (sys::fs::create_directories(sys::path::parent_path(m_Path)))
+      return;
+    // Write to a unique temporary, then rename: concurrent sessions must
+    // never see a partially written cache.
+    int FD;
+    SmallString<256> TmpPath;
+    if (sys::fs::createUniqueFile(m_Path + ".%%%%%%.tmp", FD, TmpPath))
+      return;
+
+    // A directory changed within the resolution of its time may change
+    // again without a new time; it is checked anew by the next session.
+    const int64_t Recent
+      = (std::chrono::time_point_cast<std::chrono::nanoseconds>(
+           std::chrono::system_clock::now()) - std::chrono::seconds(2))
+          .time_since_epoch().count();
+    {
+      raw_fd_ostream OS(FD, /*shouldClose*/ true);
+      OS << kHeader << '\n';
+      for (const auto& D : m_Dirs) {
+        const Directory& Dir = D.second;
+        // What the shared cache provides unchanged is read from it again.
+        if (Dir.Missing.empty() || (Dir.Shared && !Dir.Dirty)
+            || (Dir.Checked && !Dir.Exists) || Dir.ModTime > Recent)
+          continue;
+        OS << "d " << Dir.ModTime << ' ' << D.first() << '\n';
+        for (const auto& Name : Dir.Missing)
+          OS << "m " << Name.first() << '\n';
+      }
+      if (OS.has_error()) {
+        OS.clear_error();
+        OS.close();
+        sys::fs::remove(TmpPath);
+        return;
+      }
+    }
+    if (sys::fs::rename(TmpPath, m_Path))
+      sys::fs::remove(TmpPath);
+  }
+
+  StatCacheFileSystem::Directory&
+  StatCacheFileSystem::check(StringRef DirPath) {
+    Directory& D = m_Dirs[DirPath];
+    if (D.Checked)
+      return D;
+    D.Checked = true;
+    ErrorOr<vfs::Status> S = getUnderlyingFS().status(DirPath);
+    if (!S) {
+      D.Absent = isNotFound(S.getError());
+      return D;
+    }
+    if (!S->isDirectory()) {
+      D.Absent = true;
+      return D;
+    }
+    D.Exists = true;
+    const int64_t ModTime = getModTime(*S);
+    if (ModTime != D.ModTime) {
+      // Its entries changed: what was missing may exist now.
+      D.Dirty = !D.Missing.empty();
+      D.Missing.clear();
+      D.ModTime = ModTime;
+    }
+    return D;
+  }
+
+  bool StatCacheFileSystem::split(const Twine& Path,
+                                  SmallVectorImpl<char>& Buf, StringRef& Dir,
+                                  StringRef& Name) const {
+    StringRef P = Path.toStringRef(Buf);
+    if (!sys::path::is_absolute(P))
+      return false;
+    // The session builds modules into their cache while looking them up.
+    if (m_HSOpts && !m_HSOpts->ModuleCachePath.empty()
+        && P.startswith(m_HSOpts->ModuleCachePath))
+      return false;
+    Dir = sys::path::parent_path(P);
+    Name = sys::path::filename(P);
+    return !Dir.empty() && !Name.empty();
+  }
+
+  bool StatCacheFileSystem::isMissing(const Twine& Path) {
+    SmallString<256> Buf;
+    StringRef Dir, Name;
+    if (!split(Path, Buf, Dir, Name))
+      return false;
+    const Directory& D = check(Dir);
+    return D.Absent || (D.Exists && D.Missing.count(Name));
+  }
+
+  void StatCacheFileSystem::recordMissing(const Twine& Path) {
+    SmallString<256> Buf;
+    StringRef Dir, Name;
+    if (!split(Path, Buf, Dir, Name))
+      return;
+    Directory& D = check(Dir);
+    if (D.Exists && D.Missing.insert(Name).second)
+      D.Dirty = true;
+  }
+
+  ErrorOr<vfs::Status> StatCacheFileSystem::status(const Twine& Path) {
+    if (isMissing(Path))
+      return std::make_error_code(std::errc::no_such_file_or_directory);
+    ErrorOr<vfs::Status> S = ProxyFileSystem::status(Path);
+    if (!S && isNotFound(S.getError()))
+      recordMissing(Path);
+    return S;
+  }
+
+  ErrorOr<std::unique_ptr<vfs::File>>
+  StatCacheFileSystem::openFileForRead(const Twine& Path) {
+    if (isMissing(Path))
+      return std::make_error_code(std::errc::no_such_file_or_directory);
+    auto F = ProxyFileSystem::openFileForRead(Path);
+    if (!F && isNotFound(F.getError()))
+      recordMissing(Path);
+    return F;
+  }
+} // end namespace cling
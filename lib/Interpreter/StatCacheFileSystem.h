@@ -0,0 +1,103 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_STAT_CACHE_FILE_SYSTEM_H
+#define CLING_STAT_CACHE_FILE_SYSTEM_H
+
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace clang {
+  class HeaderSearchOptions;
+}
+
+namespace cling {
+  ///\brief Answers the lookups of names that did not exist in a directory
+  /// in earlier sessions without asking the file system, e.g. the misses of
+  /// the header search across the include paths on a remote file system.
+  ///
+  /// The cache file lists, per directory, its modification time and the
+  /// names found missing in it. As long as the directory's time is the same,
+  /// which one stat per directory and session checks, its entries are the
+  /// same and so are the misses. What exists is always asked for, such that
+  /// the file system stays the authority on what clang reads.
+  ///
+  /// CLING_STAT_CACHE names the cache file, which the session updates when
+  /// it ends; CLING_SHARED_STAT_CACHE names one that is only read, e.g. for
+  /// the directories of a site-wide toolchain.
+  ///
+  class StatCacheFileSystem : public llvm::vfs::ProxyFileSystem {
+    struct Directory {
+      ///\brief The modification time when the misses were recorded.
+      int64_t ModTime = 0;
+      llvm::StringSet<> Missing;
+      ///\brief Whether the directory was checked this session, and found to
+      /// exist at ModTime or not to exist.
+      bool Checked = false;
+      bool Exists = false;
+      bool Absent = false;
+      ///\brief Whether the session recorded misses to save.
+      bool Dirty = false;
+      ///\brief Whether the misses are those of the shared cache.
+      bool Shared = false;
+    };
+
+    ///\brief The cache file to update; empty if only reading.
+    std::string m_Path;
+    llvm::StringMap<Directory> m_Dirs;
+
+    ///\brief For the module cache, which the session writes to and whose
+    /// files are looked up without caching failures.
+    std::shared_ptr<clang::HeaderSearchOptions> m_HSOpts;
+
+    ///\brief Reads the cache file Path into m_Dirs; entries of a file read
+    /// later replace those of the same directory.
+    void read(llvm::StringRef Path);
+    void write() const;
+
+    ///\brief The directory Dir, checked against the file system.
+    Directory& check(llvm::StringRef Dir);
+
+    ///\brief Splits Path into its directory and name, if the cache is for
+    /// such a path.
+    bool split(const llvm::Twine& Path, llvm::SmallVectorImpl<char>& Buf,
+               llvm::StringRef& Dir, llvm::StringRef& Name) const;
+
+    ///\brief Whether Path is known not to exist.
+    bool isMissing(const llvm::Twine& Path);
+
+    ///\brief Records that Path was found missing.
+    void recordMissing(const llvm::Twine& Path);
+
+  public:
+    StatCacheFileSystem(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS,
+                        std::shared_ptr<clang::HeaderSearchOptions> HSOpts,
+                        llvm::StringRef Path, llvm::StringRef SharedPath);
+    ~StatCacheFileSystem();
+
+    ///\brief Wraps FS if CLING_STAT_CACHE or CLING_SHARED_STAT_CACHE are
+    /// set; returns FS otherwise.
+    static llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem>
+    createFromEnv(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS,
+                  std::shared_ptr<clang::HeaderSearchOptions> HSOpts);
+
+    llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine& Path) override;
+    llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+    openFileForRead(const llvm::Twine& Path) override;
+  };
+} // end namespace cling
+
+#endif // CLING_STAT_CACHE_FILE_SYSTEM_H
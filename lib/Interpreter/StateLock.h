@@ -0,0 +1,76 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_STATE_LOCK_H
+#define CLING_STATE_LOCK_H
+
+#include "llvm/Support/RWMutex.h"
+
+#include <atomic>
+#include <cassert>
+#include <thread>
+
+namespace cling {
+
+  ///\brief Guards the interpreter's AST against concurrent read-only
+  /// reflection queries, see LookupHelper::findScopeReadOnly().
+  ///
+  /// Parsing, committing and unloading transactions hold it exclusively; the
+  /// exclusive lock is recursive as code run by the interpreter may declare
+  /// more. Read-only queries hold it shared, except on the thread holding it
+  /// exclusively: that thread is not parsing while it queries.
+  ///
+  class StateLock {
+    llvm::sys::SmartRWMutex<true> m_Mutex;
+    std::atomic<std::thread::id> m_Writer{std::thread::id()};
+    unsigned m_Depth = 0; // only accessed by the writer.
+
+  public:
+    bool isHeldExclusively() const {
+      return m_Writer.load() == std::this_thread::get_id();
+    }
+
+    void lock() {
+      if (isHeldExclusively()) {
+        ++m_Depth;
+        return;
+      }
+      m_Mutex.lock();
+      m_Writer = std::this_thread::get_id();
+      m_Depth = 1;
+    }
+
+    void unlock() {
+      assert(isHeldExclusively() && "Not locked by this thread!");
+      if (--m_Depth)
+        return;
+      m_Writer = std::thread::id();
+      m_Mutex.unlock();
+    }
+
+    ///\brief Holds the lock shared unless the calling thread holds it
+    /// exclusively.
+    ///
+    class ReaderRAII {
+      StateLock& m_Lock;
+      bool m_Locked;
+    public:
+      ReaderRAII(StateLock& L): m_Lock(L), m_Locked(!L.isHeldExclusively()) {
+        if (m_Locked)
+          m_Lock.m_Mutex.lock_shared();
+      }
+      ~ReaderRAII() {
+        if (m_Locked)
+          m_Lock.m_Mutex.unlock_shared();
+      }
+    };
+  };
+
+} // namespace cling
+
+#endif // CLING_STATE_LOCK_H
@@ -0,0 +1,92 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "cling/Interpreter/TimingStats.h"
+
+#include "PhaseTimers.h"
+
+#include "cling/Interpreter/Transaction.h"
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace cling {
+
+  uint64_t TimingStats::getTotalNanoseconds() const {
+    uint64_t Total = 0;
+    for (unsigned I = 0; I < kNumPhases; ++I)
+      Total += m_Nanoseconds[I];
+    return Total;
+  }
+
+  const char* TimingStats::getPhaseName(Phase P) {
+    switch (P) {
+      case kParsing: return "parsing";
+      case kASTTransformers: return "ast-transformers";
+      case kCodeGen: return "codegen";
+      case kBackendPasses: return "backend-passes";
+      case kJITLinking: return "jit-linking";
+      case kStaticInit: return "static-init";
+      case kUserCode: return "user-code";
+      case kNumPhases: break;
+    }
+    return "unknown";
+  }
+
+  void TimingStats::print(llvm::raw_ostream& Out) const {
+    const uint64_t Total = getTotalNanoseconds();
+    Out << llvm::format("%-18s %10s %12s %7s\n", "phase", "count", "ms", "%");
+    for (unsigned I = 0; I < kNumPhases; ++I) {
+      Out << llvm::format("%-18s %10llu %12.3f %6.1f%%\n",
+                          getPhaseName(Phase(I)),
+                          (unsigned long long)m_Count[I],
+                          m_Nanoseconds[I] / 1e6,
+                          Total ? 100. * m_Nanoseconds[I] / Total : 0.);
+    }
+    Out << llvm::format("%-18s %10s %12.3f\n", "total", "", Total / 1e6);
+  }
+
+  PhaseTimers::Scope::Scope(PhaseTimers* Timers, TimingStats::Phase P,
+                            Transaction* T /*= nullptr*/):
+    m_Timers(Timers), m_Outer(nullptr), m_Transaction(T), m_Phase(P) {
+    if (!m_Timers)
+      return;
+    m_Start = Clock::now();
+    m_Outer = m_Timers->m_Active;
+    if (m_Outer) {
+      m_Outer->lap(m_Start);
+      if (!m_Transaction)
+        m_Transaction = m_Outer->m_Transaction;
+    }
+    m_Timers->m_Active = this;
+    m_Timers->m_Total.addEntry(m_Phase);
+    if (m_Transaction)
+      m_Transaction->getTimingStats().addEntry(m_Phase);
+  }
+
+  PhaseTimers::Scope::~Scope() {
+    if (!m_Timers)
+      return;
+    const Clock::time_point Now = Clock::now();
+    lap(Now);
+    m_Timers->m_Active = m_Outer;
+    // Resume the enclosing scope.
+    if (m_Outer)
+      m_Outer->m_Start = Now;
+  }
+
+  void PhaseTimers::Scope::lap(Clock::time_point Now) {
+    const uint64_t Elapsed
+      = std::chrono::duration_cast<std::chrono::nanoseconds>(Now - m_Start)
+        .count();
+    m_Timers->m_Total.add(m_Phase, Elapsed);
+    if (m_Transaction)
+      m_Transaction->getTimingStats().add(m_Phase, Elapsed);
+    m_Start = Now;
+  }
+} // end namespace cling
@@ -21,16 +21,18 @@
 
 #include "llvm/IR/Module.h"
 
+#include <algorithm>
+
 using namespace clang;
 
 namespace cling {
 
-  Transaction::Transaction(Sema& S) : m_Sema(S) {
+  Transaction::Transaction(Sema& S) : m_AtExitFuncs(nullptr), m_Sema(S) {
     Initialize();
   }
 
   Transaction::Transaction(const CompilationOptions& Opts, Sema& S)
-    : m_Sema(S) {
+    : m_AtExitFuncs(nullptr), m_Sema(S) {
     Initialize();
     m_Opts = Opts; // intentional copy.
   }
@@ -42,15 +44,75 @@ namespace cling {
     m_Unloading = false;
     m_IssuedDiags = kNone;
     m_Opts = CompilationOptions();
+    m_TimingStats.clear();
+    m_MemoryStats = MemoryStats();
     m_DefinitionShadowNS = 0;
     m_Module = 0;
     m_WrapperFD = 0;
+    m_EntryPoints = EntryPoints();
     m_Next = 0;
     m_BufferFID = FileID(); // sets it to invalid.
+    m_DeclCheckpoint = 0;
     m_Exe = 0;
   }
 
+  void Transaction::reset() {
+    assert(!hasNestedTransactions() && "Release the nested ones first!");
+    // Keep the storage unless a large input (such as an #include of a big
+    // header) grew the queue far beyond the typical input.
+    if (m_DeclQueue.capacity() > 4096)
+      DeclQueue().swap(m_DeclQueue);
+    else
+      m_DeclQueue.clear();
+    if (m_DeserializedDeclQueue.capacity() > 4096)
+      DeserializedDeclQueue().swap(m_DeserializedDeclQueue);
+    else
+      m_DeserializedDeclQueue.clear();
+    m_MacroDirectiveInfoQueue.clear();
+    // Not to run when the next input that takes T is unloaded.
+    dropAtExitFuncs();
+    Initialize();
+  }
+
+  void Transaction::dropAtExitFuncs() {
+    for (AtExitFunc* F = takeAtExitFuncs(); F;) {
+      AtExitFunc* Next = F->Next;
+      delete F;
+      F = Next;
+    }
+  }
+
+  namespace {
+    ///\brief Moves the elements of Q into storage of their exact size.
+    template <class Queue>
+    static void shrinkToFit(Queue& Q) {
+      if (Q.capacity() > std::max(Q.size(), Queue().capacity()))
+        Queue(Q.begin(), Q.end()).swap(Q);
+    }
+  } // unnamed namespace
+
+  void Transaction::compact() {
+    auto AllFromASTFile = [](const DelayCallInfo& DCI) {
+      if (DCI.m_DGR.isNull())
+        return false;
+      for (const Decl* D : DCI.m_DGR)
+        if (!D->isFromASTFile())
+          return false;
+      return true;
+    };
+    DeserializedDeclQueue& Q = m_DeserializedDeclQueue;
+    Q.erase(std::remove_if(Q.begin(), Q.end(), AllFromASTFile), Q.end());
+    shrinkToFit(m_DeclQueue);
+    shrinkToFit(m_DeserializedDeclQueue);
+    shrinkToFit(m_MacroDirectiveInfoQueue);
+    if (m_NestedTransactions)
+      shrinkToFit(*m_NestedTransactions);
+  }
+
   Transaction::~Transaction() {
+    // Functions the unloading did not run, e.g. of a transaction that
+    // failed, never will.
+    dropAtExitFuncs();
     // FIXME: Enable this once we have a good control on the ownership.
     //assert(m_Module.use_count() <= 1 && "There is still a reference!");
     if (hasNestedTransactions())
@@ -62,6 +124,12 @@ namespace cling {
       }
   }
 
+  void Transaction::addAtExitFunc(void (*Func)(void*), void* Arg) const {
+    AtExitFunc* F = new AtExitFunc{Func, Arg, m_AtExitFuncs.load()};
+    while (!m_AtExitFuncs.compare_exchange_weak(F->Next, F))
+      ;
+  }
+
   void Transaction::setDefinitionShadowNS(clang::NamespaceDecl* NS) {
     assert(!m_DefinitionShadowNS && "Transaction has a __cling_N5xxx NS?");
     m_DefinitionShadowNS = NS;
@@ -262,6 +330,7 @@ namespace cling {
       "kCCIHandleCXXImplicitFunctionInstantiation",
       "kCCIHandleCXXStaticMemberVarInstantiation",
       "kCCICompleteTentativeDefinition",
+      "kCCIHandleReloadedDefinition",
     };
     assert((sizeof(stateNames) /sizeof(void*)) == Transaction::kCCINumStates
            && "Missing states?");
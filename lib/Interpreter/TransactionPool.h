@@ -13,74 +13,134 @@
 #include "cling/Interpreter/Transaction.h"
 
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cstdlib>
 
 namespace clang {
   class Sema;
 }
 
 namespace cling {
+  ///\brief Recycles Transactions for the lifetime of an IncrementalParser.
+  ///
+  /// Pooled transactions are kept constructed: only their contents are
+  /// reset, so their declaration and macro queues keep the heap storage of
+  /// earlier inputs. The pool starts with room for kMinPoolSize transactions
+  /// and doubles it whenever it has to discard one, up to its capacity. The
+  /// capacity defaults to kMaxPoolSize and can be set through
+  /// CLING_TRANSACTION_POOL_SIZE, where 0 disables reuse.
+  ///
   class TransactionPool {
+  public:
     enum {
-#ifdef NDEBUG
-      kDebugMode           = 0,
-#else
-      kDebugMode           = 1, // Always use a new Transaction
-#endif
-      kPoolSize            = 16
+      kMinPoolSize         = 16,
+      kMaxPoolSize         = 1024
     };
 
-    // It is twice the size of the block because there might be easily around 8
-    // transactions in flight which can be empty, which might lead to refill of
-    // the smallvector and then the return for reuse will exceed the capacity
-    // of the smallvector causing redundant copy of the elements.
-    //
-    llvm::SmallVector<Transaction*, kPoolSize>  m_Transactions;
+    struct Stats {
+      size_t Hits = 0;      ///< Transactions taken from the pool.
+      size_t Misses = 0;    ///< Transactions that had to be allocated.
+      size_t Discarded = 0; ///< Released transactions the pool had no room for.
+      size_t InFlight = 0;  ///< Taken and not yet released.
+    };
+
+  private:
+    llvm::SmallVector<Transaction*, kMinPoolSize> m_Transactions;
+    size_t m_Capacity;
+    size_t m_Limit;
+    Stats m_Stats;
+
+    static size_t getCapacityFromEnv() {
+      if (const char* Env = ::getenv("CLING_TRANSACTION_POOL_SIZE"))
+        return ::strtoul(Env, nullptr, 10);
+      return kMaxPoolSize;
+    }
+
+    void release(Transaction* T, bool reuse) {
+      // Nested transactions go before their parent, which would otherwise
+      // delete them behind the pool's back.
+      while (T->hasNestedTransactions()) {
+        release(*T->nested_begin(), reuse);
+      }
+
+      // Tell the parent that T is gone.
+      if (T->getParent())
+        T->getParent()->removeNestedTransaction(T);
+      --m_Stats.InFlight;
+
+      // don't overflow the pool
+      if (reuse && m_Transactions.size() >= m_Limit && m_Limit < m_Capacity) {
+        m_Limit = std::min(m_Capacity, 2 * m_Limit);
+      }
+      if (reuse && m_Transactions.size() < m_Limit) {
+        T->reset();
+        // Catches uses of T until it is taken again, see setState().
+        T->m_State = Transaction::kNumStates;
+        m_Transactions.push_back(T);
+        return;
+      }
+      if (reuse)
+        ++m_Stats.Discarded;
+      delete T;
+    }
 
   public:
-    TransactionPool() {}
+    TransactionPool() : TransactionPool(getCapacityFromEnv()) {}
+    explicit TransactionPool(size_t Capacity)
+      : m_Capacity(Capacity),
+        m_Limit(std::min<size_t>(Capacity, kMinPoolSize)) {}
     ~TransactionPool() {
-      // Only free the memory as anything put in m_Transactions will have
-      // already been destructed in releaseTransaction
+      // Anything in m_Transactions has already been reset in
+      // releaseTransaction; this frees the queues' storage.
       for (Transaction* T : m_Transactions)
-        ::operator delete(T);
+        delete T;
     }
 
     Transaction* takeTransaction(clang::Sema& S) {
       Transaction *T;
-      if (kDebugMode || m_Transactions.empty())
+      if (m_Transactions.empty()) {
         T = new Transaction(S);
-      else
-        T = new (m_Transactions.pop_back_val()) Transaction(S);
-
+        ++m_Stats.Misses;
+      } else {
+        T = m_Transactions.pop_back_val();
+        assert(&T->m_Sema == &S && "Pooled transaction of another Sema!");
+        T->m_State = Transaction::kCollecting;
+        ++m_Stats.Hits;
+      }
+      ++m_Stats.InFlight;
       return T;
     }
 
     // Transaction T must be from call to TransactionPool::takeTransaction
     //
     void releaseTransaction(Transaction* T, bool reuse = true) {
-      assert((m_Transactions.empty() || m_Transactions.back() != T) \
-             && "Transaction already in pool");
-      if (reuse) {
-        assert((T->getState() == Transaction::kCompleted ||
-                T->getState() == Transaction::kRolledBack)
-               && "Transaction must be completed!");
-        // Force reuse to off when not in Debug mode
-        if (kDebugMode)
-          reuse = false;
-      }
+      assert(std::find(m_Transactions.begin(), m_Transactions.end(), T)
+             == m_Transactions.end() && "Transaction already in pool");
+      assert((!reuse || T->getState() == Transaction::kCompleted ||
+              T->getState() == Transaction::kRolledBack)
+             && "Transaction must be completed!");
+      release(T, reuse);
+    }
 
-      // Tell the parent that T is gone.
-      if (T->getParent())
-        T->getParent()->removeNestedTransaction(T);
+    ///\brief Frees the pooled transactions and their queues; the pool
+    /// starts over with room for kMinPoolSize.
+    void trim() {
+      for (Transaction* T : m_Transactions)
+        delete T;
+      m_Transactions.clear();
+      m_Limit = std::min<size_t>(m_Capacity, kMinPoolSize);
+    }
 
-      // don't overflow the pool
-      if (reuse && (m_Transactions.size() < kPoolSize)) {
-        T->m_State = Transaction::kNumStates;
-        T->~Transaction();
-        m_Transactions.push_back(T);
-      }
-      else
-       delete T;
+    const Stats& getStats() const { return m_Stats; }
+
+    void printStats(llvm::raw_ostream& Out) const {
+      Out << "Transaction pool: " << m_Transactions.size() << " pooled (limit "
+          << m_Limit << ", capacity " << m_Capacity << "), "
+          << m_Stats.Hits << " hits, " << m_Stats.Misses << " misses, "
+          << m_Stats.Discarded << " discarded, " << m_Stats.InFlight
+          << " in flight\n";
     }
   };
 
@@ -11,10 +11,13 @@
 
 #include "IncrementalExecutor.h"
 #include "DeclUnloader.h"
+#include "EventTrace.h"
 
 #include "cling/Interpreter/Interpreter.h"
+#include "cling/Interpreter/LookupHelper.h"
 #include "cling/Interpreter/Transaction.h"
 
+#include "clang/AST/ASTContext.h"
 #include "clang/AST/Decl.h"
 #include "clang/AST/DependentDiagnostic.h"
 #include "clang/CodeGen/ModuleBuilder.h"
@@ -24,6 +27,27 @@
 using namespace clang;
 
 namespace cling {
+  TransactionUnloader::TransactionUnloader(cling::Interpreter* I,
+                                           clang::Sema* Sema,
+                                           clang::CodeGenerator* CG,
+                                           cling::IncrementalExecutor* Exe):
+    m_Interp(I), m_Sema(Sema), m_CodeGen(CG), m_Exe(Exe) {}
+
+  // Keep in source: ~unique_ptr<DeclUnloader> needs DeclUnloader; its
+  // destructor uncaches the files of all reverted transactions.
+  TransactionUnloader::~TransactionUnloader() {}
+
+  bool TransactionUnloader::unloadFromExecutor(llvm::ArrayRef<Transaction*> Ts) {
+    if (!getExecutor())
+      return true;
+    llvm::SmallVector<const llvm::Module*, 8> Modules;
+    for (Transaction* T : Ts)
+      if (const llvm::Module* M = T->getModule())
+        if (m_UnloadedModules.insert(M).second)
+          Modules.push_back(M);
+    return getExecutor()->unloadModules(Modules);
+  }
+
   bool TransactionUnloader::unloadDeclarations(Transaction* T,
                                                DeclUnloader& DeclU) {
     bool Successful = true;
@@ -33,7 +57,8 @@ namespace cling {
       const Transaction::ConsumerCallInfo& Call = I->m_Call;
       const DeclGroupRef& DGR = (*I).m_DGR;
 
-      if (Call == Transaction::kCCIHandleVTable)
+      if (Call == Transaction::kCCIHandleVTable
+          || Call == Transaction::kCCIHandleReloadedDefinition)
         continue;
       // The non templated classes come through HandleTopLevelDecl and
       // HandleTagDeclDefinition, this is why we need to filter.
@@ -97,10 +122,14 @@ namespace cling {
   }
 
   bool TransactionUnloader::RevertTransaction(Transaction* T) {
+    CLING_TRACE_SCOPE(Trace, kUnload, "");
 
     bool Successful = true;
+    if (getExecutor())
+      getExecutor()->forgetDeferredInits(*T);
     if (getExecutor() && T->getModule()) {
-      Successful = getExecutor()->unloadModule(T->getModule()) && Successful;
+      if (!m_UnloadedModules.erase(T->getModule()))
+        Successful = getExecutor()->unloadModule(T->getModule()) && Successful;
 
       // Cleanup the module from unused global values.
       // if (T->getModule()) {
@@ -115,11 +144,24 @@ namespace cling {
     m_Sema->PendingInstantiations.clear();
     m_Sema->PendingLocalImplicitInstantiations.clear();
 
-    DeclUnloader DeclU(m_Sema, m_CodeGen, T);
+    if (!m_DeclU)
+      m_DeclU.reset(new DeclUnloader(m_Sema, m_CodeGen, T));
+    else
+      m_DeclU->setTransaction(T);
+    DeclUnloader& DeclU = *m_DeclU;
+    // Removing the decls of a failed input from a large translation unit
+    // must not walk all of it.
+    if (Decl* Checkpoint = T->getDeclCheckpoint())
+      DeclU.setCheckpoint(m_Sema->getASTContext().getTranslationUnitDecl(),
+                          Checkpoint);
     Successful = unloadDeclarations(T, DeclU) && Successful;
     Successful = unloadDeserializedDeclarations(T, DeclU) && Successful;
     Successful = unloadFromPreprocessor(T, DeclU) && Successful;
 
+    // Cached lookups might refer to the unloaded declarations.
+    m_Interp->getLookupHelper().clearCache();
+    m_Interp->clearCompletionCache();
+
 #ifndef NDEBUG
     //FIXME: Move the nested transaction marker out of the decl lists and
     // reenable this assertion.
@@ -133,9 +175,7 @@ namespace cling {
     else
       T->setState(Transaction::kRolledBackWithErrors);
 
-    // Release the input_line_X file unless verifying diagnostics.
-    if (!m_Interp->getCI()->getDiagnosticOpts().VerifyDiagnostics)
-      m_Sema->getSourceManager().invalidateCache(T->getBufferFID());
+    // Interpreter::revertTransaction() releases the input_line_X file.
 
     return Successful;
   }
@@ -10,6 +10,9 @@
 #ifndef CLING_TRANSACTION_UNLOADER
 #define CLING_TRANSACTION_UNLOADER
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallPtrSet.h"
+
 #include <memory>
 
 namespace llvm {
@@ -38,6 +41,13 @@ namespace cling {
     clang::CodeGenerator* m_CodeGen;
     cling::IncrementalExecutor* m_Exe;
 
+    ///\brief Shared by the transactions reverted through this unloader, so
+    /// that it can reuse what it learnt about the DeclContexts.
+    std::unique_ptr<DeclUnloader> m_DeclU;
+
+    ///\brief Modules already removed from the JIT by unloadFromExecutor().
+    llvm::SmallPtrSet<const llvm::Module*, 8> m_UnloadedModules;
+
     bool unloadDeclarations(Transaction* T, DeclUnloader& DeclU);
     bool unloadDeserializedDeclarations(Transaction* T,
                                         DeclUnloader& DeclU);
@@ -47,8 +57,16 @@ namespace cling {
   public:
     TransactionUnloader(cling::Interpreter* I, clang::Sema* Sema,
                         clang::CodeGenerator* CG,
-                        cling::IncrementalExecutor* Exe):
-      m_Interp(I), m_Sema(Sema), m_CodeGen(CG), m_Exe(Exe) {}
+                        cling::IncrementalExecutor* Exe);
+    ~TransactionUnloader();
+
+    ///\brief Removes the code of the given transactions from the JIT in one
+    /// batch, ahead of reverting them one by one.
+    ///
+    ///\param[in] Ts - The transactions about to be reverted.
+    ///\returns true on success.
+    ///
+    bool unloadFromExecutor(llvm::ArrayRef<Transaction*> Ts);
 
     ///\brief Rolls back given transaction from the AST.
     ///
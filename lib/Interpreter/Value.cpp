@@ -10,6 +10,7 @@
 #include "cling/Interpreter/Value.h"
 
 #include "EnterUserCodeRAII.h"
+#include "ValuePool.h"
 
 #include "cling/Interpreter/Interpreter.h"
 #include "cling/Interpreter/Transaction.h"
@@ -20,17 +21,21 @@
 
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/CanonicalType.h"
+#include "clang/AST/DeclTemplate.h"
 #include "clang/AST/ExprCXX.h"
+#include "clang/AST/RecordLayout.h"
 #include "clang/AST/Type.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Sema/Lookup.h"
 #include "clang/Sema/Overload.h"
 #include "clang/Sema/Sema.h"
 
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/IR/GlobalValue.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Support/raw_os_ostream.h"
 
+#include <algorithm>
 #include <cstring>
 
 namespace {
@@ -57,8 +62,11 @@ namespace {
     ///\brief The number of elements in the array
     unsigned long m_NElements;
 
+    ///\brief The pool of the allocation, if not from the heap.
+    cling::ValuePool* m_Pool;
+
     ///\brief The start of the allocation.
-    char m_Payload[1];
+    alignas(cling::ValuePool::kGranularity) char m_Payload[1];
 
     static const unsigned char kCanaryUnconstructedObject[8];
 
@@ -74,23 +82,31 @@ namespace {
     ///\brief Initialize the storage management part of the allocated object.
     ///  The allocator is referencing it, thus initialize m_RefCnt with 1.
     ///\param [in] dtorFunc - the function to be called before deallocation.
-    AllocatedValue(void* dtorFunc, size_t allocSize, size_t nElements):
+    AllocatedValue(void* dtorFunc, size_t allocSize, size_t nElements,
+                   cling::ValuePool* pool):
       m_RefCnt(1),
       m_DtorFunc(cling::utils::VoidToFunctionPtr<DtorFunc_t>(dtorFunc)),
-      m_AllocSize(allocSize), m_NElements(nElements)
+      m_AllocSize(allocSize), m_NElements(nElements), m_Pool(pool)
     {}
 
   public:
     ///\brief Allocate the memory needed by the AllocatedValue managing
     /// an object of payloadSize bytes, and return the address of the
     /// payload object.
+    ///\param [in] pool - where to allocate from, if payloadSize is small
+    ///   enough.
     static char* CreatePayload(unsigned payloadSize, void* dtorFunc,
-                               size_t nElements) {
+                               size_t nElements, cling::ValuePool* pool) {
       if (payloadSize < sizeof(kCanaryUnconstructedObject))
         payloadSize = sizeof(kCanaryUnconstructedObject);
-      char* alloc = new char[AllocatedValue::getPayloadOffset() + payloadSize];
+      const size_t allocSize = AllocatedValue::getPayloadOffset() + payloadSize;
+      char* alloc = pool ? (char*)pool->allocate(allocSize) : nullptr;
+      if (!alloc) {
+        alloc = new char[allocSize];
+        pool = nullptr;
+      }
       AllocatedValue* allocVal
-        = new (alloc) AllocatedValue(dtorFunc, payloadSize, nElements);
+        = new (alloc) AllocatedValue(dtorFunc, payloadSize, nElements, pool);
       std::memcpy(allocVal->getPayload(), kCanaryUnconstructedObject,
                   sizeof(kCanaryUnconstructedObject));
       return allocVal->getPayload();
@@ -100,7 +116,7 @@ namespace {
     char* getPayload() { return m_Payload; }
 
     static unsigned getPayloadOffset() {
-      static const AllocatedValue Dummy(0,0,0);
+      static const AllocatedValue Dummy(0,0,0,0);
       return Dummy.m_Payload - (const char*)&Dummy;
     }
 
@@ -111,8 +127,8 @@ namespace {
 
     void Retain() { ++m_RefCnt; }
 
-    ///\brief This object must be allocated as a char array. Deallocate it as
-    ///   such.
+    ///\brief This object must be allocated as a char array or from its
+    ///   pool. Deallocate it as such.
     void Release() {
       assert (m_RefCnt > 0 && "Reference count is already zero.");
       if (--m_RefCnt == 0) {
@@ -123,7 +139,10 @@ namespace {
           while (m_NElements-- != 0)
             (*m_DtorFunc)(Payload + m_NElements * Skip);
         }
-        delete [] (char*)this;
+        if (m_Pool)
+          m_Pool->deallocate(this, getPayloadOffset() + m_AllocSize);
+        else
+          delete [] (char*)this;
       }
     }
   };
@@ -255,7 +274,182 @@ namespace cling {
     const clang::ASTContext& ctx = getASTContext();
     unsigned payloadSize = ctx.getTypeSizeInChars(getType()).getQuantity();
     m_Storage.m_Ptr = AllocatedValue::CreatePayload(payloadSize, dtorFunc,
-                                                    GetNumberOfElements());
+                                                    GetNumberOfElements(),
+                                             m_Interpreter->m_ValuePool.get());
+  }
+
+  clang::QualType Value::ArrayView::getElementType() const {
+    return clang::QualType::getFromOpaquePtr(ElementType);
+  }
+
+  namespace {
+    ///\brief The scalar and array subobjects of a record, with their offsets
+    /// in bytes: the fields of its non-virtual bases and its own fields,
+    /// those of record type broken down.
+    typedef llvm::SmallVector<std::pair<clang::QualType, uint64_t>, 8> Leaves;
+
+    static void collectLeaves(const clang::ASTContext& Ctx,
+                              const clang::CXXRecordDecl* RD, uint64_t Offset,
+                              Leaves& Out) {
+      if (!RD->hasDefinition())
+        return;
+      const clang::ASTRecordLayout& Layout = Ctx.getASTRecordLayout(RD);
+      for (const clang::CXXBaseSpecifier& Base : RD->bases()) {
+        const clang::CXXRecordDecl* BaseRD
+          = Base.getType()->getAsCXXRecordDecl();
+        if (!BaseRD || Base.isVirtual())
+          continue;
+        const uint64_t BaseOffset
+          = Offset + Layout.getBaseClassOffset(BaseRD).getQuantity();
+        collectLeaves(Ctx, BaseRD, BaseOffset, Out);
+      }
+      for (const clang::FieldDecl* FD : RD->fields()) {
+        if (FD->isBitField())
+          continue;
+        const uint64_t FieldOffset = Offset + Ctx.toCharUnitsFromBits(
+          Layout.getFieldOffset(FD->getFieldIndex())).getQuantity();
+        const clang::QualType FT = FD->getType().getCanonicalType();
+        if (const clang::CXXRecordDecl* FieldRD = FT->getAsCXXRecordDecl())
+          collectLeaves(Ctx, FieldRD, FieldOffset, Out);
+        else
+          Out.push_back(std::make_pair(FT, FieldOffset));
+      }
+    }
+
+    static uint64_t readUnsigned(const char* Addr, uint64_t Size) {
+      uint64_t Val = 0;
+      switch (Size) {
+        case 1: { uint8_t V; std::memcpy(&V, Addr, 1); Val = V; break; }
+        case 2: { uint16_t V; std::memcpy(&V, Addr, 2); Val = V; break; }
+        case 4: { uint32_t V; std::memcpy(&V, Addr, 4); Val = V; break; }
+        case 8: { uint64_t V; std::memcpy(&V, Addr, 8); Val = V; break; }
+        default: break;
+      }
+      return Val;
+    }
+
+    static char* readPointer(const char* Addr) {
+      char* Ptr;
+      std::memcpy(&Ptr, Addr, sizeof(Ptr));
+      return Ptr;
+    }
+
+    ///\brief Views the std::array, std::vector or span Object of type Spec,
+    /// whose elements are of type Elt.
+    ///
+    /// The standard libraries (libstdc++, libc++ and Microsoft's) keep the
+    /// begin and end pointers of a vector as its first pointers to elements,
+    /// in this order; spans have a pointer to their elements followed by
+    /// their size or end, unless their extent is static.
+    ///
+    static bool
+    viewSpecialization(const clang::ASTContext& Ctx,
+                       const clang::ClassTemplateSpecializationDecl* Spec,
+                       const char* Object, clang::QualType Elt, size_t EltSize,
+                       Value::ArrayView& View) {
+      const clang::TemplateArgumentList& Args = Spec->getTemplateArgs();
+      const llvm::StringRef Name = Spec->getName();
+      const bool InStd = Spec->isInStdNamespace();
+      const bool IsArray = InStd && Name == "array";
+      const bool IsVector = InStd && Name == "vector";
+      if (!IsArray && !IsVector && Name != "span" && Name != "Span")
+        return false;
+      if (IsVector && Elt->isBooleanType())
+        return false;
+
+      Leaves L;
+      collectLeaves(Ctx, Spec, 0, L);
+      std::stable_sort(L.begin(), L.end(),
+                       [](const Leaves::value_type& A,
+                          const Leaves::value_type& B) {
+                         return A.second < B.second;
+                       });
+      auto IsEltPtr = [&](clang::QualType T) {
+        return T->isPointerType() && Ctx.hasSameType(T->getPointeeType(), Elt);
+      };
+
+      // The extent of std::array and of spans with a static one.
+      bool HasStaticExtent = false;
+      if (!IsVector && Args.size() > 1
+          && Args[1].getKind() == clang::TemplateArgument::Integral
+          && !Args[1].getAsIntegral().isAllOnesValue()) {
+        View.Extent = Args[1].getAsIntegral().getZExtValue();
+        HasStaticExtent = true;
+      }
+
+      if (IsArray) {
+        // The aggregate's only member is the C array.
+        if (!HasStaticExtent)
+          return false;
+        if (View.Extent && !L.empty())
+          View.Data = const_cast<char*>(Object + L.front().second);
+        return true;
+      }
+
+      auto First = std::find_if(L.begin(), L.end(),
+                                [&](const Leaves::value_type& Leaf) {
+                                  return IsEltPtr(Leaf.first);
+                                });
+      if (First == L.end())
+        return false;
+      char* Begin = readPointer(Object + First->second);
+      View.Data = Begin;
+      if (HasStaticExtent)
+        return true;
+
+      auto Next = First + 1;
+      if (Next == L.end())
+        return false;
+      if (IsEltPtr(Next->first)) {
+        const char* End = readPointer(Object + Next->second);
+        View.Extent = Begin && End > Begin ? (End - Begin) / EltSize : 0;
+      } else if (!IsVector && Next->first->isIntegerType()) {
+        View.Extent = readUnsigned(Object + Next->second,
+                     Ctx.getTypeSizeInChars(Next->first).getQuantity());
+      } else
+        return false;
+      return true;
+    }
+  } // unnamed namespace
+
+  Value::ArrayView Value::getArrayView() const {
+    if (!isValid() || !m_Interpreter)
+      return ArrayView();
+    // The object is in the managed allocation, or referenced; pointers have
+    // no extent.
+    const char* Object = static_cast<const char*>(m_Storage.m_Ptr);
+    if (!Object || (!needsManagedAllocation() && !getType()->isReferenceType()))
+      return ArrayView();
+
+    const clang::ASTContext& Ctx = getASTContext();
+    const clang::QualType Ty
+      = getType().getNonReferenceType().getCanonicalType();
+    ArrayView View;
+    clang::QualType Elt;
+    if (const clang::ConstantArrayType* ArrTy
+        = Ctx.getAsConstantArrayType(Ty)) {
+      Elt = Ctx.getBaseElementType(Ty);
+      View.Extent = Ctx.getConstantArrayElementCount(ArrTy);
+      View.Data = View.Extent ? const_cast<char*>(Object) : nullptr;
+    } else if (const auto* Spec
+               = llvm::dyn_cast_or_null<clang::ClassTemplateSpecializationDecl>(
+                   Ty->getAsCXXRecordDecl())) {
+      const clang::TemplateArgumentList& Args = Spec->getTemplateArgs();
+      if (!Args.size() || Args[0].getKind() != clang::TemplateArgument::Type)
+        return ArrayView();
+      Elt = Args[0].getAsType().getCanonicalType();
+      if (Elt->isIncompleteType())
+        return ArrayView();
+      const size_t EltSize = Ctx.getTypeSizeInChars(Elt).getQuantity();
+      if (!EltSize
+          || !viewSpecialization(Ctx, Spec, Object, Elt, EltSize, View))
+        return ArrayView();
+    } else
+      return ArrayView();
+
+    View.ElementSize = Ctx.getTypeSizeInChars(Elt).getQuantity();
+    View.ElementType = Elt.getAsOpaquePtr();
+    return View;
   }
 
   void Value::AssertOnUnsupportedTypeCast() const {
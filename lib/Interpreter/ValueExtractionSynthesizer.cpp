@@ -9,6 +9,8 @@
 
 #include "ValueExtractionSynthesizer.h"
 
+#include "DeclUnloader.h"
+
 #include "cling/Interpreter/Interpreter.h"
 #include "cling/Interpreter/Transaction.h"
 #include "cling/Interpreter/Value.h"
@@ -26,10 +28,12 @@ using namespace clang;
 
 namespace cling {
   ValueExtractionSynthesizer::ValueExtractionSynthesizer(clang::Sema* S,
+                                                         Interpreter& Interp,
                                                          bool isChildInterpreter)
     : WrapperTransformer(S), m_Context(&S->getASTContext()), m_gClingVD(0),
       m_UnresolvedNoAlloc(0), m_UnresolvedWithAlloc(0),
-      m_UnresolvedCopyArray(0), m_isChildInterpreter(isChildInterpreter) { }
+      m_UnresolvedCopyArray(0), m_isChildInterpreter(isChildInterpreter),
+      m_Interp(Interp), m_TypeSymbols(Interp, "__cling_type_") { }
 
   // pin the vtable here.
   ValueExtractionSynthesizer::~ValueExtractionSynthesizer() { }
@@ -82,6 +86,18 @@ namespace cling {
     if (isa<Expr>(*(CS->body_begin() + foundAtPos)))
       returnStmts.push_back(CS->body_begin() + foundAtPos);
 
+    // A wrapper of nothing but an expression that clang can compute needs
+    // neither code nor the JIT, see Interpreter::EvaluateInternal().
+    if (Value* FoldTarget = m_Interp.m_FoldTarget) {
+      m_Interp.m_FoldTarget = nullptr;
+      if (CS->size() == 1 && returnStmts.size() == 1
+          && isa<Expr>(CS->body_front())
+          && FoldToValue(cast<Expr>(CS->body_front()), *FoldTarget)) {
+        UnloadDecl(m_Sema, FD);
+        return Result(0, true);
+      }
+    }
+
     // We want to support cases such as:
     // gCling->evaluate("if() return 'A' else return 12", V), that puts in V,
     // either A or 12.
@@ -184,25 +200,92 @@ namespace cling {
     return Result(D, true);
   }
 
+  bool ValueExtractionSynthesizer::FoldToValue(const Expr* E,
+                                               Value& V) const {
+    if (E->isValueDependent() || E->isTypeDependent())
+      return false;
+    // Addresses are only known once the code runs.
+    QualType Ty = E->getType();
+    const Type* CanonTy = Ty.getCanonicalType().getTypePtr();
+    if (!CanonTy->isIntegralOrEnumerationType()
+        && !CanonTy->isRealFloatingType())
+      return false;
+
+    Expr::EvalResult Folded;
+    if (!E->EvaluateAsRValue(Folded, *m_Context) || Folded.HasSideEffects
+        || Folded.HasUndefinedBehavior)
+      return false;
+
+    Value Result(Ty, m_Interp);
+    const APValue& Val = Folded.Val;
+    switch (Result.getStorageType()) {
+      case Value::kSignedIntegerOrEnumerationType:
+        if (!Val.isInt() || Val.getInt().getMinSignedBits() > 64)
+          return false;
+        Result.getLL() = Val.getInt().getSExtValue();
+        break;
+      case Value::kUnsignedIntegerOrEnumerationType:
+        if (!Val.isInt() || Val.getInt().getActiveBits() > 64)
+          return false;
+        Result.getULL() = Val.getInt().getZExtValue();
+        break;
+      case Value::kDoubleType:
+        if (!Val.isFloat())
+          return false;
+        Result.getDouble() = Val.getFloat().convertToDouble();
+        break;
+      case Value::kFloatType:
+        if (!Val.isFloat())
+          return false;
+        Result.getFloat() = Val.getFloat().convertToFloat();
+        break;
+      default:
+        // E.g. long double, which APFloat cannot convert to.
+        return false;
+    }
+    V = Result;
+    return true;
+  }
+
 // Helper function for the SynthesizeSVRInit
 namespace {
-  static bool availableCopyConstructor(QualType QT, clang::Sema* S) {
-    // Check the the existance of the copy constructor the tha placement new will use.
+  static bool isCallable(const CXXConstructorDecl* CD) {
+    return CD && !CD->isDeleted()
+      && CD->getAccess() == clang::AccessSpecifier::AS_public;
+  }
+
+  static bool availableConstructor(QualType QT, const Expr* E,
+                                   clang::Sema* S) {
+    // Check the the existance of the constructor the tha placement new will
+    // use to initialize the value from E.
     if (CXXRecordDecl* RD = QT->getAsCXXRecordDecl()) {
       // If it has a trivial copy constructor it is accessible and it is callable.
       if(RD->hasTrivialCopyConstructor()) return true;
-      // Lookup the copy canstructor and check its accessiblity.
-      if (CXXConstructorDecl* CD = S->LookupCopyingConstructor(RD, QT.getCVRQualifiers())) {
-        if (!CD->isDeleted() && CD ->getAccess() == clang::AccessSpecifier::AS_public) {
+      if (E->isRValue()) {
+        // A temporary is created in the value's storage: no constructor
+        // runs since C++17, and the move that elides is needed before.
+        if (S->getLangOpts().CPlusPlus17 && !E->isXValue())
+          return true;
+        // Move, rather than copy, what was returned by value or std::move'd.
+        if (isCallable(S->LookupMovingConstructor(RD, QT.getCVRQualifiers())))
           return true;
-        }
       }
-      return false;
+      // Lookup the copy canstructor and check its accessiblity.
+      return isCallable(S->LookupCopyingConstructor(RD, QT.getCVRQualifiers()));
     }
     return true;
   }
 }
 
+  Expr* ValueExtractionSynthesizer::getTypeArg(QualType QT) {
+    // The spelling keeps the sugar that the cling::Value shows; anonymous
+    // types and lambdas are spelled with their location.
+    const PrintingPolicy& Policy = m_Context->getPrintingPolicy();
+    const std::string Key = QT.getAsString(Policy) + '\n'
+      + QT.getCanonicalType().getAsString(Policy);
+    return m_TypeSymbols.get(*m_Sema, Key, QT.getAsOpaquePtr());
+  }
+
   Expr* ValueExtractionSynthesizer::SynthesizeSVRInit(Expr* E) {
     if (!m_gClingVD && !FindAndCacheRuntimeDecls(E))
       return nullptr;
@@ -240,9 +323,7 @@ namespace {
       desugaredTy = m_Context->getLValueReferenceType(desugaredTy);
       ETy = m_Context->getLValueReferenceType(ETy);
     }
-    Expr* ETyVP
-      = utils::Synthesize::CStyleCastPtrExpr(m_Sema, m_Context->VoidPtrTy,
-                                             (uintptr_t)ETy.getAsOpaquePtr());
+    Expr* ETyVP = getTypeArg(ETy);
 
     // Pass whether to Value::dump() or not:
     Expr* EVPOn
@@ -266,12 +347,7 @@ namespace {
       // to run E.
 
       // FIXME: Suboptimal: this discards the already created AST nodes.
-      QualType vpQT = m_Context->VoidPtrTy;
-      QualType vQT = m_Context->VoidTy;
-      Expr* vpQTVP
-        = utils::Synthesize::CStyleCastPtrExpr(m_Sema, vpQT,
-                                               (uintptr_t)vQT.getAsOpaquePtr());
-      CallArgs[2] = vpQTVP;
+      CallArgs[2] = getTypeArg(m_Context->VoidTy);
 
 
       Call = m_Sema->ActOnCallExpr(/*Scope*/0, m_UnresolvedNoAlloc,
@@ -284,9 +360,9 @@ namespace {
     else if (desugaredTy->isRecordType() || desugaredTy->isConstantArrayType()
              || desugaredTy->isMemberPointerType()) {
       // 2) object types :
-      // check existence of copy constructor before call
+      // check existence of the copy or move constructor before call
       if (!desugaredTy->isMemberPointerType()
-          && !availableCopyConstructor(desugaredTy, m_Sema))
+          && !availableConstructor(desugaredTy, E, m_Sema))
         return E;
       // call new (setValueWithAlloc(gCling, &SVR, ETy)) (E)
       Call = m_Sema->ActOnCallExpr(/*Scope*/0, m_UnresolvedWithAlloc,
@@ -503,7 +579,11 @@ namespace {
   ///\param [out] vpStoredValRef - The Value that is allocated.
   static cling::Value&
   allocateStoredRefValueAndGetGV(void* vpI, void* vpSVR, void* vpQT) {
-    cling::Interpreter* i = (cling::Interpreter*)vpI;
+    // The type is of the AST of the interpreter running the wrapper, which
+    // might use its parent's gCling.
+    cling::Interpreter* i = cling::Interpreter::getCurrent();
+    if (!i)
+      i = (cling::Interpreter*)vpI;
     clang::QualType QT = clang::QualType::getFromOpaquePtr(vpQT);
     cling::Value& SVR = *(cling::Value*)vpSVR;
     // Here the copy keeps the refcounted value alive.
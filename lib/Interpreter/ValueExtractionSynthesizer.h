@@ -10,17 +10,21 @@
 #ifndef CLING_VALUE_EXTRACTION_SYNTHESIZER_H
 #define CLING_VALUE_EXTRACTION_SYNTHESIZER_H
 
+#include "AddressSymbols.h"
 #include "ASTTransformer.h"
 
 namespace clang {
   class ASTContext;
   class Decl;
   class Expr;
+  class QualType;
   class Sema;
   class VarDecl;
 }
 
 namespace cling {
+  class Interpreter;
+  class Value;
 
   class ValueExtractionSynthesizer : public WrapperTransformer {
 
@@ -47,21 +51,43 @@ namespace cling {
 
     bool m_isChildInterpreter;
 
+    ///\brief The interpreter whose evaluated expressions get folded.
+    ///
+    Interpreter& m_Interp;
+
+    ///\brief The types passed to the runtime, by name.
+    ///
+    AddressSymbols m_TypeSymbols;
+
 public:
     ///\ brief Constructs the return synthesizer.
     ///
     ///\param[in] S - The semantic analysis object.
+    ///\param[in] Interp - The interpreter, see FoldToValue().
     ///\param[in] isChildInterpreter - flag to control if it is called
     /// from a child or parent Interpreter
     ///
-    ValueExtractionSynthesizer(clang::Sema* S, bool isChildInterpreter);
+    ValueExtractionSynthesizer(clang::Sema* S, Interpreter& Interp,
+                               bool isChildInterpreter);
 
     virtual ~ValueExtractionSynthesizer();
 
     Result Transform(clang::Decl* D) override;
 
+    ///\brief Drops the cached runtime declarations, to be looked up again.
+    ///
+    void ForgetRuntime() override {
+      m_gClingVD = nullptr;
+      m_UnresolvedNoAlloc = m_UnresolvedWithAlloc = nullptr;
+      m_UnresolvedCopyArray = nullptr;
+    }
+
   private:
 
+    ///\brief The void* argument of the runtime for the type QT.
+    ///
+    clang::Expr* getTypeArg(clang::QualType QT);
+
     ///\brief
     /// Here we don't want to depend on the JIT runFunction, because of its
     /// limitations, when it comes to return value handling. There it is
@@ -88,6 +114,14 @@ public:
     ///
     clang::Expr* SynthesizeSVRInit(clang::Expr* E);
 
+    ///\brief Evaluates E, of arithmetic or enumeration type, with clang's
+    /// constant evaluator instead of emitting and running its wrapper.
+    ///
+    ///\returns false if E is no constant without side effects or its type
+    /// does not fit the storage of V.
+    ///
+    bool FoldToValue(const clang::Expr* E, Value& V) const;
+
     // Find and cache cling::runtime::gCling, setValueNoAlloc,
     // setValueWithAlloc on first request.
     bool FindAndCacheRuntimeDecls(clang::Expr*);
@@ -0,0 +1,52 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "ValuePool.h"
+
+namespace cling {
+
+void* ValuePool::allocate(size_t Size) {
+  if (!Size || Size > kMaxPooledSize)
+    return nullptr;
+  const size_t Class = getSizeClass(Size);
+  void* Block;
+  {
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+    if (FreeBlock* Free = m_FreeLists[Class]) {
+      m_FreeLists[Class] = Free->Next;
+      Block = Free;
+    } else {
+      const size_t ClassSize = (Class + 1) * kGranularity;
+      if (size_t(m_SlabEnd - m_SlabCur) < ClassSize) {
+        // operator new[] aligns to at least kGranularity; the rest of the
+        // previous slab is left unused.
+        m_Slabs.emplace_back(new char[kSlabSize]);
+        m_SlabCur = m_Slabs.back().get();
+        m_SlabEnd = m_SlabCur + kSlabSize;
+      }
+      Block = m_SlabCur;
+      m_SlabCur += ClassSize;
+    }
+  }
+  Retain();
+  return Block;
+}
+
+void ValuePool::deallocate(void* Block, size_t Size) {
+  const size_t Class = getSizeClass(Size);
+  {
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+    FreeBlock* Free = static_cast<FreeBlock*>(Block);
+    Free->Next = m_FreeLists[Class];
+    m_FreeLists[Class] = Free;
+  }
+  // Might destroy the pool, once the interpreter is gone.
+  Release();
+}
+
+} // end namespace cling
@@ -0,0 +1,67 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_VALUE_POOL_H
+#define CLING_VALUE_POOL_H
+
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace cling {
+
+  ///\brief Recycles the managed allocations of cling::Value.
+  ///
+  /// Each Value of class or array type allocates the storage of its object;
+  /// loops evaluating many of them would spend much of their time in the
+  /// heap. Small allocations are instead carved from slabs and, once their
+  /// last Value is gone, kept in a free list of their size class for the
+  /// next one. Each allocation retains the pool: Values may outlive their
+  /// interpreter.
+  ///
+  class ValuePool : public llvm::ThreadSafeRefCountedBase<ValuePool> {
+  public:
+    ///\brief The allocations are multiples of, and aligned to, this.
+    static constexpr size_t kGranularity = 16;
+
+    ///\brief Larger allocations are left to the heap.
+    static constexpr size_t kMaxPooledSize = 512;
+
+  private:
+    static constexpr size_t kSlabSize = 32 * 1024;
+
+    struct FreeBlock {
+      FreeBlock* Next;
+    };
+
+    ///\brief Values are created and destroyed by evaluateAsync()'s thread,
+    /// too.
+    std::mutex m_Mutex;
+    FreeBlock* m_FreeLists[kMaxPooledSize / kGranularity] = {};
+    std::vector<std::unique_ptr<char[]>> m_Slabs;
+    char* m_SlabCur = nullptr;
+    char* m_SlabEnd = nullptr;
+
+    static size_t getSizeClass(size_t Size) {
+      return (Size + kGranularity - 1) / kGranularity - 1;
+    }
+
+  public:
+    ///\brief Allocates Size bytes and retains the pool; returns null if Size
+    /// is too large to be pooled.
+    void* allocate(size_t Size);
+
+    ///\brief Returns a Block of Size bytes from allocate() and releases the
+    /// pool.
+    void deallocate(void* Block, size_t Size);
+  };
+} // end namespace cling
+
+#endif // CLING_VALUE_POOL_H
@@ -25,6 +25,7 @@
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/Decl.h"
 #include "clang/AST/DeclCXX.h"
+#include "clang/AST/DeclTemplate.h"
 #include "clang/AST/Expr.h"
 #include "clang/AST/ExprCXX.h"
 #include "clang/AST/GlobalDecl.h"
@@ -34,13 +35,22 @@
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Lex/Preprocessor.h"
 #include "clang/Parse/Parser.h"
+#include "clang/Basic/SourceManager.h"
 #include "clang/Sema/Lookup.h"
 #include "clang/Sema/Sema.h"
+#include "clang/Sema/TemplateDeduction.h"
 
 #include "llvm/Support/Format.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SaveAndRestore.h"
 
 #include <locale>
+#include <map>
+#include <set>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 // GCC 4.x doesn't have the proper UTF-8 conversion routines. So use the
 // LLVM conversion routines (which require a buffer 4x string length).
@@ -68,6 +78,18 @@ namespace cling {
     CLING_LIB_EXPORT
     extern const char* const kEmptyCollection = "{}";
 
+    // The interpreter printing a value on this thread, set by
+    // printValueInternal(); calls of printValue() from user code get the
+    // default limit.
+    static thread_local const Interpreter* tPrinting = nullptr;
+
+    CLING_LIB_EXPORT
+    size_t getMaxPrintedElements() {
+      if (tPrinting)
+        return tPrinting->getRuntimeOptions().MaxPrintedElements;
+      return runtime::RuntimeOptions().MaxPrintedElements;
+    }
+
     struct OpaqueString{};
     /// Assign a string to a string*.
     void AssignToStringFromStringPtr(OpaqueString* to, const OpaqueString& from) {
@@ -579,8 +601,7 @@ static const char* BuildAndEmitVPWrapperBody(cling::Interpreter &Interp,
                                              clang::Sema &S,
                                              clang::ASTContext &Ctx,
                                              clang::FunctionDecl *WrapperFD,
-                                             clang::QualType QT,
-                                             const void* ValPtr)
+                                             clang::QualType QT)
 {
   const clang::SourceLocation noSrcLoc;
   clang::Sema::SynthesizedFunctionScope SemaFScope(S, WrapperFD);
@@ -589,7 +610,8 @@ static const char* BuildAndEmitVPWrapperBody(cling::Interpreter &Interp,
                                         | clang::Scope::BlockScope);
   //Build the following AST (where `S` is `std::string`):
   /*
-`-FunctionDecl 0x7fc7d4812978 <col:22, col:46> col:24 XYZ_callPrintValue 'struct S (void)'
+`-FunctionDecl 0x7fc7d4812978 <col:22, col:46> col:24 XYZ_callPrintValue 'struct S (const void *)'
+  |-ParmVarDecl 0x7fc7d4812900 <col:26> col:38 ValPtr 'const void *'
   `-CompoundStmt 0x7fc7d4812ff8 <col:30, col:46>
     `-ReturnStmt 0x7fc7d4812fe0 <col:32, col:43>
       `-ExprWithCleanups 0x7fc7d4812fc8 <col:39, col:43> 'struct S'
@@ -635,16 +657,20 @@ static const char* BuildAndEmitVPWrapperBody(cling::Interpreter &Interp,
     }
   } else if (auto RTy
              = llvm::dyn_cast<clang::ReferenceType>(QT.getTypePtr())) {
-    // X& will be printed as X* (the pointer will be added below).
+    // X& will be printed as X* (the pointer will be added below); the
+    // caller passes the referenced address.
     QT = RTy->getPointeeType();
-    // Val will be a X**, but we cast this to X*, so dereference here:
-    ValPtr = *(const void* const*)ValPtr;
   }
 
-  // `cling::printValue()` takes the *address* of the value to be printed:
+  // `cling::printValue()` takes the *address* of the value to be printed,
+  // which is the wrapper's parameter:
+  clang::ParmVarDecl *ValPtrParm = WrapperFD->getParamDecl(0);
+  clang::Expr *EValPtr
+    = S.BuildDeclRefExpr(ValPtrParm, ValPtrParm->getType(),
+                         clang::VK_LValue, noSrcLoc);
   clang::QualType QTPtr = Ctx.getPointerType(QT);
   clang::Expr *EVPArg
-    = utils::Synthesize::CStyleCastPtrExpr(&S, QTPtr, (uintptr_t)ValPtr);
+    = utils::Synthesize::CStyleCastPtrExpr(&S, QTPtr, EValPtr);
   llvm::SmallVector<clang::Expr*, 1> CallArgs;
   CallArgs.push_back(EVPArg);
   clang::ExprResult ExprVP
@@ -667,12 +693,350 @@ static const char* BuildAndEmitVPWrapperBody(cling::Interpreter &Interp,
   return nullptr; // no error message.
 }
 
+// The common specializations of the standard containers are printed by
+// compiled code, as RuntimePrintValue.h would print them: their first print
+// instantiates and JITs nothing.
+
+// The element types that the compiled printers know.
+enum ElementKind {
+  kNoElement,
+  kIntElement,
+  kUIntElement,
+  kLongElement,
+  kULongElement,
+  kLongLongElement,
+  kULongLongElement,
+  kFloatElement,
+  kDoubleElement,
+  kStringElement
+};
+
+template <class T>
+static std::string printElement(const T& Elem) {
+  return cling::printValue(&Elem);
+}
+
+template <class K, class V>
+static std::string printElement(const std::pair<const K, V>& Elem) {
+  return cling::printValue(&Elem.first) + " => "
+    + cling::printValue(&Elem.second);
+}
+
+template <class CollectionType>
+static std::string printCollection(const void* Ptr) {
+  const CollectionType& Obj = *static_cast<const CollectionType*>(Ptr);
+  auto Iter = Obj.begin(), IterEnd = Obj.end();
+  if (Iter == IterEnd)
+    return cling::valuePrinterInternal::kEmptyCollection;
+
+  const size_t Max = cling::valuePrinterInternal::getMaxPrintedElements();
+  std::string Str("{ ");
+  Str += printElement(*Iter);
+  for (size_t N = 1; ++Iter != IterEnd; ++N) {
+    if (N == Max)
+      return "[" + std::to_string(Obj.size()) + " elements] " + Str
+        + ", ... }";
+    Str += ", ";
+    Str += printElement(*Iter);
+  }
+  return Str + " }";
+}
+
+template <class PairType>
+static std::string printPair(const void* Ptr) {
+  const PairType& Obj = *static_cast<const PairType*>(Ptr);
+  return "{ " + cling::printValue(&Obj.first) + ", "
+    + cling::printValue(&Obj.second) + " }";
+}
+
+typedef std::string (*PrintFn)(const void*);
+
+struct CompiledPrinter {
+  PrintFn Print;
+  ///\brief The size of the type printed, as libcling was compiled.
+  size_t Size;
+
+  CompiledPrinter(PrintFn P = nullptr, size_t S = 0)
+    : Print(P), Size(S) {}
+};
+
+#define CLING_STRINGIFY_(X) #X
+#define CLING_STRINGIFY(X) CLING_STRINGIFY_(X)
+
+// The inline namespaces of std, as in "__8::__cxx11", that the containers
+// and std::string are in for the standard library libcling was compiled
+// with: the session might use another one, e.g. libc++ or the std::string
+// of _GLIBCXX_USE_CXX11_ABI=0, which the compiled printers cannot print.
+#if defined(_LIBCPP_VERSION)
+static const char kLibContainerNamespaces[]
+  = "__" CLING_STRINGIFY(_LIBCPP_ABI_VERSION);
+static const char kLibStringNamespaces[]
+  = "__" CLING_STRINGIFY(_LIBCPP_ABI_VERSION);
+#elif defined(_GLIBCXX_INLINE_VERSION) && _GLIBCXX_INLINE_VERSION
+static const char kLibContainerNamespaces[] = "__8";
+static const char kLibStringNamespaces[] = "__8";
+#else
+static const char kLibContainerNamespaces[] = "";
+# if defined(_GLIBCXX_USE_CXX11_ABI) && _GLIBCXX_USE_CXX11_ABI
+static const char kLibStringNamespaces[] = "__cxx11";
+# else
+static const char kLibStringNamespaces[] = "";
+# endif
+#endif
+
+#undef CLING_STRINGIFY
+#undef CLING_STRINGIFY_
+
+///\brief Whether the inline namespaces of std that D is in are Expected.
+static bool isInInlineNamespaces(const clang::Decl* D,
+                                 llvm::StringRef Expected) {
+  std::string Path;
+  for (const clang::DeclContext* DC = D->getDeclContext();
+       !DC->isTranslationUnit(); DC = DC->getParent()) {
+    const auto* NS = llvm::dyn_cast<clang::NamespaceDecl>(DC);
+    if (!NS || !NS->isInline())
+      break;
+    Path = Path.empty() ? NS->getName().str()
+                        : NS->getName().str() + "::" + Path;
+  }
+  return Path == Expected;
+}
+
+///\brief Whether Ty is laid out as the type of Size bytes that libcling
+/// was compiled with, that is in its std namespaces; the session might
+/// define macros that change it.
+static bool hasLibraryABI(const clang::ASTContext& Ctx, clang::QualType Ty,
+                          bool String, size_t Size) {
+  const clang::CXXRecordDecl* RD = Ty->getAsCXXRecordDecl();
+  return RD && RD->getDefinition()
+    && isInInlineNamespaces(RD, String ? kLibStringNamespaces
+                                       : kLibContainerNamespaces)
+    && Ctx.getTypeSizeInChars(Ty).getQuantity() == (int64_t)Size;
+}
+
+template <class T> using StdVector = std::vector<T>;
+template <class T> using StdSet = std::set<T>;
+template <class K, class V> using StdMap = std::map<K, V>;
+template <class K, class V> using StdUnorderedMap = std::unordered_map<K, V>;
+
+///\brief Calls F.apply<T>() for the element type T of Kind.
+template <class Fn>
+static CompiledPrinter applyToElement(ElementKind Kind, const Fn& F) {
+  switch (Kind) {
+    case kIntElement: return F.template apply<int>();
+    case kUIntElement: return F.template apply<unsigned int>();
+    case kLongElement: return F.template apply<long>();
+    case kULongElement: return F.template apply<unsigned long>();
+    case kLongLongElement: return F.template apply<long long>();
+    case kULongLongElement: return F.template apply<unsigned long long>();
+    case kFloatElement: return F.template apply<float>();
+    case kDoubleElement: return F.template apply<double>();
+    case kStringElement: return F.template apply<std::string>();
+    case kNoElement: break;
+  }
+  return CompiledPrinter();
+}
+
+///\brief As applyToElement(), for the fewer key types of maps and pairs.
+template <class Fn>
+static CompiledPrinter applyToKey(ElementKind Kind, const Fn& F) {
+  switch (Kind) {
+    case kIntElement: return F.template apply<int>();
+    case kLongElement: return F.template apply<long>();
+    case kStringElement: return F.template apply<std::string>();
+    default: break;
+  }
+  return CompiledPrinter();
+}
+
+template <template <class> class C>
+struct CollectionPrinter {
+  template <class T> CompiledPrinter apply() const {
+    return CompiledPrinter(&printCollection<C<T>>, sizeof(C<T>));
+  }
+};
+
+template <template <class, class> class C, class K>
+struct MapValuePrinter {
+  template <class V> CompiledPrinter apply() const {
+    return CompiledPrinter(&printCollection<C<K, V>>, sizeof(C<K, V>));
+  }
+};
+
+template <template <class, class> class C>
+struct MapPrinter {
+  ElementKind ValueKind;
+  template <class K> CompiledPrinter apply() const {
+    return applyToElement(ValueKind, MapValuePrinter<C, K>());
+  }
+};
+
+template <class K>
+struct PairSecondPrinter {
+  template <class V> CompiledPrinter apply() const {
+    return CompiledPrinter(&printPair<std::pair<K, V>>,
+                           sizeof(std::pair<K, V>));
+  }
+};
+
+struct PairPrinter {
+  ElementKind SecondKind;
+  template <class K> CompiledPrinter apply() const {
+    return applyToElement(SecondKind, PairSecondPrinter<K>());
+  }
+};
+
+static ElementKind getElementKind(Interpreter& Interp,
+                                  const clang::TemplateArgument& Arg) {
+  if (Arg.getKind() != clang::TemplateArgument::Type)
+    return kNoElement;
+  const clang::QualType Ty = Arg.getAsType().getCanonicalType();
+  if (Ty.hasQualifiers())
+    return kNoElement;
+  if (const auto* BT = llvm::dyn_cast<clang::BuiltinType>(Ty)) {
+    switch (BT->getKind()) {
+      case clang::BuiltinType::Int: return kIntElement;
+      case clang::BuiltinType::UInt: return kUIntElement;
+      case clang::BuiltinType::Long: return kLongElement;
+      case clang::BuiltinType::ULong: return kULongElement;
+      case clang::BuiltinType::LongLong: return kLongLongElement;
+      case clang::BuiltinType::ULongLong: return kULongLongElement;
+      case clang::BuiltinType::Float: return kFloatElement;
+      case clang::BuiltinType::Double: return kDoubleElement;
+      default: return kNoElement;
+    }
+  }
+  if (Ty->isRecordType()
+      && Interp.getLookupHelper().getStringType(Ty.getTypePtr())
+           == LookupHelper::kStdString
+      && hasLibraryABI(Interp.getCI()->getASTContext(), Ty, /*String*/ true,
+                       sizeof(std::string)))
+    return kStringElement;
+  return kNoElement;
+}
+
+///\brief Whether Arg is a specialization of std::Name, e.g. the default
+/// allocator.
+static bool isStdTemplate(const clang::TemplateArgument& Arg,
+                          llvm::StringRef Name) {
+  if (Arg.getKind() != clang::TemplateArgument::Type)
+    return false;
+  const auto* Spec
+    = llvm::dyn_cast_or_null<clang::ClassTemplateSpecializationDecl>(
+        Arg.getAsType()->getAsCXXRecordDecl());
+  return Spec && Spec->getName() == Name
+    && Spec->getDeclContext()->isStdNamespace();
+}
+
+///\brief Whether a cling::printValue() overload declared for the user takes
+/// a pointer to Ty: it gets to print Ty instead. Templates count if they
+/// can take it, but for the generic ones of RuntimePrintValue.h.
+static bool hasPrintValueOverload(Interpreter& Interp, clang::QualType Ty) {
+  clang::Sema& S = Interp.getSema();
+  clang::NamespaceDecl* ClingNS = utils::Lookup::Namespace(&S, "cling");
+  if (!ClingNS)
+    return false;
+  clang::LookupResult R(S, S.PP.getIdentifierInfo("printValue"),
+                        clang::SourceLocation(),
+                        clang::Sema::LookupOrdinaryName);
+  Interpreter::PushTransactionRAII ScopedT(&Interp);
+  S.LookupQualifiedName(R, ClingNS);
+  clang::ASTContext& Ctx = S.getASTContext();
+  const clang::SourceManager& SM = S.getSourceManager();
+  clang::OpaqueValueExpr Arg(clang::SourceLocation(), Ctx.getPointerType(Ty),
+                             clang::VK_RValue);
+  clang::Expr* Args[] = {&Arg};
+  for (clang::NamedDecl* ND : R) {
+    if (auto* FTD = llvm::dyn_cast<clang::FunctionTemplateDecl>(ND)) {
+      const clang::SourceLocation Loc
+        = SM.getExpansionLoc(FTD->getLocation());
+      if (llvm::sys::path::filename(SM.getFilename(Loc))
+            == "RuntimePrintValue.h")
+        continue;
+      clang::FunctionDecl* Spec = nullptr;
+      clang::sema::TemplateDeductionInfo Info(Loc);
+      if (S.DeduceTemplateArguments(FTD, /*ExplicitTemplateArgs*/ nullptr,
+                                    Args, Spec, Info,
+                                    /*PartialOverloading*/ false,
+                                    [](llvm::ArrayRef<clang::QualType>) {
+                                      return false;
+                                    }) == clang::Sema::TDK_Success)
+        return true;
+      continue;
+    }
+    const auto* FD = llvm::dyn_cast<clang::FunctionDecl>(ND);
+    if (!FD || FD->getNumParams() != 1)
+      continue;
+    const clang::QualType ParmTy = FD->getParamDecl(0)->getType();
+    if (ParmTy->isPointerType()
+        && Ctx.hasSameUnqualifiedType(ParmTy->getPointeeType(), Ty))
+      return true;
+  }
+  return false;
+}
+
+///\brief The compiled printer of the value's type, if any.
+static PrintFn getCompiledPrinter(const Value& V) {
+  const clang::QualType Ty
+    = V.getType().getNonReferenceType().getCanonicalType();
+  const auto* Spec
+    = llvm::dyn_cast_or_null<clang::ClassTemplateSpecializationDecl>(
+        Ty->getAsCXXRecordDecl());
+  if (!Spec || !Spec->getDeclContext()->isStdNamespace())
+    return nullptr;
+
+  Interpreter& Interp = *V.getInterpreter();
+  const clang::TemplateArgumentList& Args = Spec->getTemplateArgs();
+  const llvm::StringRef Name = Spec->getName();
+  CompiledPrinter Printer = nullptr;
+  if (Name == "vector" && Args.size() == 2
+      && isStdTemplate(Args[1], "allocator"))
+    Printer = applyToElement(getElementKind(Interp, Args[0]),
+                             CollectionPrinter<StdVector>());
+  else if (Name == "set" && Args.size() == 3
+           && isStdTemplate(Args[1], "less")
+           && isStdTemplate(Args[2], "allocator"))
+    Printer = applyToElement(getElementKind(Interp, Args[0]),
+                             CollectionPrinter<StdSet>());
+  else if (Name == "map" && Args.size() == 4
+           && isStdTemplate(Args[2], "less")
+           && isStdTemplate(Args[3], "allocator"))
+    Printer = applyToKey(getElementKind(Interp, Args[0]),
+                         MapPrinter<StdMap>{getElementKind(Interp, Args[1])});
+  else if (Name == "unordered_map" && Args.size() == 5
+           && isStdTemplate(Args[2], "hash")
+           && isStdTemplate(Args[3], "equal_to")
+           && isStdTemplate(Args[4], "allocator"))
+    Printer = applyToKey(getElementKind(Interp, Args[0]),
+                         MapPrinter<StdUnorderedMap>{
+                           getElementKind(Interp, Args[1])});
+  else if (Name == "pair" && Args.size() == 2)
+    Printer = applyToKey(getElementKind(Interp, Args[0]),
+                         PairPrinter{getElementKind(Interp, Args[1])});
+
+  if (!Printer.Print
+      || !hasLibraryABI(V.getASTContext(), Ty, /*String*/ false, Printer.Size)
+      || hasPrintValueOverload(Interp, Ty))
+    return nullptr;
+  return Printer.Print;
+}
+
 static std::string callPrintValue(const Value& V, const void* Val) {
   Interpreter *Interp = V.getInterpreter();
   assert(Interp && "No cling::Interpreter!");
-  Value printValueV;
 
-  {
+  const void* ValPtr = V.needsManagedAllocation() ? Val : &Val;
+  // Val will be a X**, but the wrapper prints X*, so dereference here:
+  if (V.getType()->isReferenceType())
+    ValPtr = *(const void* const*)ValPtr;
+
+  // One wrapper per type, taking the value's address as argument: printing
+  // the same type again is just a call.
+  void* &WrapperAddr
+    = Interp->getPrintValueWrapper(V.getType().getCanonicalType().getTypePtr());
+  if (!WrapperAddr)
+    WrapperAddr = utils::FunctionToVoidPtr(getCompiledPrinter(V));
+  if (!WrapperAddr) {
     clang::ASTContext &Ctx = V.getASTContext();
     const clang::SourceLocation noSrcLoc;
     clang::Sema &S = Interp->getSema();
@@ -687,8 +1051,10 @@ static std::string callPrintValue(const Value& V, const void* Val) {
     Interp->createUniqueName(name);
     name += "_callPrintValue";
     clang::DeclarationName DeclName = &Ctx.Idents.get(name);
+    clang::QualType ParmTy = Ctx.getPointerType(Ctx.VoidTy.withConst());
     clang::QualType FnTy
-      = Ctx.getFunctionType(clang::QualType(StdStringTD->getTypeForDecl(), 0), {},
+      = Ctx.getFunctionType(clang::QualType(StdStringTD->getTypeForDecl(), 0),
+                            {ParmTy},
                             clang::FunctionProtoType::ExtProtoInfo());
     clang::FunctionDecl *WrapperFD
       = clang::FunctionDecl::Create(Ctx,
@@ -703,19 +1069,28 @@ static std::string callPrintValue(const Value& V, const void* Val) {
                                     //bool 	hasWrittenPrototype = true,
                                     //bool 	isConstexprSpecified = false
                                     );
+    clang::ParmVarDecl *ValPtrParm
+      = clang::ParmVarDecl::Create(Ctx, WrapperFD, noSrcLoc, noSrcLoc,
+                                   &Ctx.Idents.get("ValPtr"), ParmTy,
+                                   Ctx.getTrivialTypeSourceInfo(ParmTy),
+                                   clang::SC_None, /*DefArg*/ nullptr);
+    WrapperFD->setParams({ValPtrParm});
     WrapperFD->setIsUsed();
-    const void* ValPtr = V.needsManagedAllocation() ? Val : &Val;
 
     if (auto errmsg = BuildAndEmitVPWrapperBody(*Interp, S, Ctx, WrapperFD,
-                                                V.getType(), ValPtr))
+                                                V.getType()))
       return errmsg;
 
     clang::GlobalDecl WrapperGD(WrapperFD);
-    if (void* addr = Interp->getAddressOfGlobal(WrapperGD)) {
-       auto funptr = cling::utils::VoidToFunctionPtr<std::string(*)()>(addr);
-      LockCompilationDuringUserCodeExecutionRAII LCDUCER(*Interp);
-      return funptr();
-    }
+    WrapperAddr = Interp->getAddressOfGlobal(WrapperGD);
+  }
+
+  if (WrapperAddr) {
+    auto funptr
+      = cling::utils::VoidToFunctionPtr<std::string(*)(const void*)>(
+          WrapperAddr);
+    LockCompilationDuringUserCodeExecutionRAII LCDUCER(*Interp);
+    return funptr(ValPtr);
   }
 
   return "ERROR in cling's callPrintValue(): missing value string.";
@@ -988,6 +1363,8 @@ namespace cling {
       Interpreter* Interp = V.getInterpreter();
       LockCompilationDuringUserCodeExecutionRAII LCDUCER(*Interp);
       declarePrintValue(*Interp);
+      // The value of a child interpreter might be printed meanwhile.
+      llvm::SaveAndRestore<const Interpreter*> Printing(tPrinting, Interp);
       return printUnpackedClingValue(V);
     }
   } // end namespace valuePrinterInternal
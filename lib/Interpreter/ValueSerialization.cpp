@@ -0,0 +1,313 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "cling/Interpreter/Value.h"
+
+#include "EnterUserCodeRAII.h"
+
+#include "cling/Interpreter/Interpreter.h"
+#include "cling/Interpreter/LookupHelper.h"
+#include "cling/Utils/AST.h"
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Type.h"
+#include "clang/Frontend/CompilerInstance.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstring>
+
+using namespace llvm;
+
+// An encoding is, little endian: the version and kind of the encoding, its
+// flags, the spelling of the type as a 32 bit size and the characters, and
+// the payload of the kind.
+
+namespace {
+  static const uint8_t kVersion = 1;
+
+  ///\brief The payload of an encoding.
+  enum Kind : uint8_t {
+    kInvalid, ///< None, and no type either.
+    kVoid,    ///< None.
+    kInteger, ///< 64 bits, sign-extended for signed types.
+    kFloat,   ///< The 32 bits of the float.
+    kDouble,  ///< The 64 bits of the double.
+    kAddress, ///< 64 bits.
+    kBytes    ///< A 64 bit size and as many bytes: objects, long double.
+  };
+
+  enum EncodingFlags : uint8_t {
+    kNonPortable = 1 ///< Only means something to the writer, or its target.
+  };
+
+  ///\brief Reads an encoding, failing on truncation.
+  class Reader {
+    const char* m_Cur;
+    const char* m_End;
+
+  public:
+    Reader(StringRef Buf): m_Cur(Buf.begin()), m_End(Buf.end()) {}
+
+    StringRef getRest() const { return StringRef(m_Cur, m_End - m_Cur); }
+
+    bool read(uint8_t& V) {
+      if (m_Cur == m_End)
+        return false;
+      V = uint8_t(*m_Cur++);
+      return true;
+    }
+
+    bool read(uint32_t& V) {
+      if (m_End - m_Cur < 4)
+        return false;
+      V = support::endian::read32le(m_Cur);
+      m_Cur += 4;
+      return true;
+    }
+
+    bool read(uint64_t& V) {
+      if (m_End - m_Cur < 8)
+        return false;
+      V = support::endian::read64le(m_Cur);
+      m_Cur += 8;
+      return true;
+    }
+
+    bool read(StringRef& Bytes, uint64_t Size) {
+      if (uint64_t(m_End - m_Cur) < Size)
+        return false;
+      Bytes = StringRef(m_Cur, Size);
+      m_Cur += Size;
+      return true;
+    }
+  };
+
+  ///\brief The payload of a value: its bits, or the bytes at Bytes.
+  struct Payload {
+    Kind K = kInvalid;
+    uint8_t Flags = 0;
+    uint64_t Bits = 0;
+    const void* Bytes = nullptr;
+    uint64_t Size = 0;
+  };
+
+  ///\brief Reads the integer of type Ty at Addr, extended to 64 bits.
+  static uint64_t loadInteger(const clang::ASTContext& Ctx, clang::QualType Ty,
+                              const void* Addr) {
+    const unsigned Size = Ctx.getTypeSizeInChars(Ty).getQuantity();
+    uint64_t Bits = 0;
+    if (Size > sizeof(Bits))
+      return 0;
+    // Into the low end of Bits.
+    if (support::endian::system_endianness() == support::little)
+      std::memcpy(&Bits, Addr, Size);
+    else
+      std::memcpy(reinterpret_cast<char*>(&Bits) + sizeof(Bits) - Size, Addr,
+                  Size);
+    if (Ty->isSignedIntegerOrEnumerationType())
+      Bits = uint64_t(SignExtend64(Bits, Size * 8));
+    return Bits;
+  }
+} // unnamed namespace
+
+namespace cling {
+
+  bool Value::serialize(raw_ostream& Out) const {
+    support::endian::Writer W(Out, support::little);
+    if (!isValid()) {
+      W.write<uint8_t>(kVersion);
+      W.write<uint8_t>(kInvalid);
+      W.write<uint8_t>(0);
+      return true;
+    }
+
+    const clang::ASTContext& Ctx = getASTContext();
+    // A reference gets the value it refers to.
+    const bool IsReference = getType()->isReferenceType();
+    const clang::QualType Ty = getType().getNonReferenceType();
+    const EStorageType Storage
+      = IsReference ? determineStorageType(Ty) : getStorageType();
+    const void* Referenced = IsReference ? getPtr() : nullptr;
+
+    Payload P;
+    if (isVoid())
+      P.K = kVoid;
+    else if (IsReference && Ty->isIncompleteType())
+      return false;
+    else switch (Storage) {
+      case kSignedIntegerOrEnumerationType:
+      case kUnsignedIntegerOrEnumerationType:
+        P.K = kInteger;
+        P.Bits = Referenced ? loadInteger(Ctx, Ty, Referenced) : getULL();
+        break;
+      case kFloatType: {
+        P.K = kFloat;
+        uint32_t Bits;
+        std::memcpy(&Bits, Referenced ? Referenced : &m_Storage.m_Float, 4);
+        P.Bits = Bits;
+        break;
+      }
+      case kDoubleType:
+        P.K = kDouble;
+        std::memcpy(&P.Bits, Referenced ? Referenced : &m_Storage.m_Double, 8);
+        break;
+      case kLongDoubleType:
+        P.K = kBytes;
+        P.Flags = kNonPortable;
+        P.Bytes = Referenced ? Referenced : &m_Storage.m_LongDouble;
+        P.Size = Ctx.getTypeSizeInChars(Ty).getQuantity();
+        break;
+      case kPointerType: {
+        P.K = kAddress;
+        P.Flags = kNonPortable;
+        void* Ptr = getPtr();
+        if (Referenced)
+          std::memcpy(&Ptr, Referenced, sizeof(Ptr));
+        P.Bits = uintptr_t(Ptr);
+        break;
+      }
+      case kManagedAllocation:
+        if (!Ty.isTriviallyCopyableType(Ctx))
+          return false;
+        P.K = kBytes;
+        if (Ty->isMemberPointerType())
+          P.Flags = kNonPortable;
+        P.Bytes = getPtr();
+        P.Size = Ctx.getTypeSizeInChars(Ty).getQuantity();
+        break;
+      case kUnsupportedType:
+        return false;
+    }
+
+    const std::string Name
+      = utils::TypeName::GetFullyQualifiedName(Ty.getUnqualifiedType(), Ctx);
+    if (Name.empty())
+      return false;
+
+    W.write<uint8_t>(kVersion);
+    W.write<uint8_t>(P.K);
+    W.write<uint8_t>(P.Flags);
+    W.write<uint32_t>(Name.size());
+    Out << Name;
+    switch (P.K) {
+      case kInvalid:
+      case kVoid:
+        break;
+      case kFloat:
+        W.write<uint32_t>(uint32_t(P.Bits));
+        break;
+      case kInteger:
+      case kDouble:
+      case kAddress:
+        W.write<uint64_t>(P.Bits);
+        break;
+      case kBytes:
+        W.write<uint64_t>(P.Size);
+        Out.write(static_cast<const char*>(P.Bytes), P.Size);
+        break;
+    }
+    return true;
+  }
+
+  bool Value::deserialize(StringRef& Data, Interpreter& Interp, Value& V,
+                          bool* NonPortable /*= nullptr*/) {
+    Reader R(Data);
+    uint8_t Version, K, Flags;
+    if (!R.read(Version) || Version != kVersion || !R.read(K)
+        || !R.read(Flags))
+      return false;
+    if (K == kInvalid) {
+      V = Value();
+      Data = R.getRest();
+      return true;
+    }
+
+    uint32_t NameSize;
+    StringRef Name;
+    if (!R.read(NameSize) || !R.read(Name, NameSize))
+      return false;
+    clang::QualType Ty;
+    {
+      LockCompilationDuringUserCodeExecutionRAII LCDUCER(Interp);
+      const LookupHelper& LH = Interp.getLookupHelper();
+      Ty = LH.findType(Name, LookupHelper::NoDiagnostics);
+      // Class template specializations might need to be instantiated.
+      if (!Ty.isNull() && Ty->isIncompleteType() && Ty->isRecordType()) {
+        const clang::Type* Complete = nullptr;
+        LH.findScope(Name, LookupHelper::NoDiagnostics, &Complete);
+        Ty = Complete ? clang::QualType(Complete, 0) : clang::QualType();
+      }
+    }
+    if (Ty.isNull() || (K != kVoid && Ty->isIncompleteType()))
+      return false;
+
+    const clang::ASTContext& Ctx = Interp.getCI()->getASTContext();
+    Value Result(Ty, Interp);
+    const EStorageType Storage = Result.getStorageType();
+    uint32_t Bits32;
+    uint64_t Bits;
+    StringRef Bytes;
+    switch (K) {
+      case kVoid:
+        if (!Ty->isVoidType())
+          return false;
+        break;
+      case kInteger:
+        if (!R.read(Bits))
+          return false;
+        if (Storage == kSignedIntegerOrEnumerationType)
+          Result.getLL() = (long long)Bits;
+        else if (Storage == kUnsignedIntegerOrEnumerationType)
+          Result.getULL() = Bits;
+        else
+          return false;
+        break;
+      case kFloat:
+        if (Storage != kFloatType || !R.read(Bits32))
+          return false;
+        std::memcpy(&Result.getFloat(), &Bits32, 4);
+        break;
+      case kDouble:
+        if (Storage != kDoubleType || !R.read(Bits))
+          return false;
+        std::memcpy(&Result.getDouble(), &Bits, 8);
+        break;
+      case kAddress:
+        if (Storage != kPointerType || Ty->isReferenceType() || !R.read(Bits))
+          return false;
+        Result.getPtr() = reinterpret_cast<void*>(uintptr_t(Bits));
+        break;
+      case kBytes:
+        if (!R.read(Bits) || Bits != uint64_t(Ctx.getTypeSizeInChars(Ty)
+                                                 .getQuantity())
+            || !R.read(Bytes, Bits))
+          return false;
+        if (Storage == kLongDoubleType && Bytes.size() <= sizeof(long double))
+          std::memcpy(&Result.getLongDouble(), Bytes.data(), Bytes.size());
+        else if (Storage == kManagedAllocation
+                 && Ty.isTriviallyCopyableType(Ctx))
+          std::memcpy(Result.getPtr(), Bytes.data(), Bytes.size());
+        else
+          return false;
+        break;
+      default:
+        return false;
+    }
+
+    if (NonPortable)
+      *NonPortable = Flags & kNonPortable;
+    Data = R.getRest();
+    V = std::move(Result);
+    return true;
+  }
+} // end namespace cling
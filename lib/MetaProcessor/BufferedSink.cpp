@@ -0,0 +1,240 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "BufferedSink.h"
+
+#include "cling/Utils/Output.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Compression.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/Signals.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+#ifndef _WIN32
+namespace {
+  using cling::BufferedSink;
+
+  enum { kMaxSinks = 8 };
+  ///\brief The sinks the crash handler flushes: it cannot take a lock.
+  static std::atomic<BufferedSink*> sSinks[kMaxSinks];
+
+  static void FlushOnCrash(void*) {
+    // Not waiting for a lock that the crashed thread might hold.
+    FILE* const Streams[] = {stdout, stderr};
+    for (FILE* F : Streams) {
+      if (::ftrylockfile(F) == 0) {
+        ::fflush(F);
+        ::funlockfile(F);
+      }
+    }
+    for (std::atomic<BufferedSink*>& Slot : sSinks)
+      if (BufferedSink* S = Slot.load())
+        S->flush();
+  }
+
+  static void registerSink(BufferedSink* S) {
+    static std::once_flag HandlerInstalled;
+    std::call_once(HandlerInstalled, [] {
+      llvm::sys::AddSignalHandler(FlushOnCrash, nullptr);
+    });
+    // Beyond kMaxSinks, a crash loses the buffers.
+    for (std::atomic<BufferedSink*>& Slot : sSinks) {
+      BufferedSink* Free = nullptr;
+      if (Slot.compare_exchange_strong(Free, S))
+        return;
+    }
+  }
+
+  static void unregisterSink(BufferedSink* S) {
+    for (std::atomic<BufferedSink*>& Slot : sSinks) {
+      BufferedSink* Mine = S;
+      if (Slot.compare_exchange_strong(Mine, nullptr))
+        return;
+    }
+  }
+} // unnamed namespace
+#endif
+
+namespace cling {
+
+#ifdef _WIN32
+  std::unique_ptr<BufferedSink> BufferedSink::create(int FileFD, bool) {
+    cling::errs() << "cling::BufferedSink: buffered redirections are not "
+                     "supported on this platform\n";
+    ::_close(FileFD);
+    return nullptr;
+  }
+
+  BufferedSink::~BufferedSink() {}
+
+  void BufferedSink::flush() {}
+#else
+  BufferedSink::BufferedSink(int ReadFD, int WriteFD, int FileFD,
+                             bool Compress)
+    : m_ReadFD(ReadFD), m_WriteFD(WriteFD), m_FileFD(FileFD),
+      m_Compress(Compress), m_Buffer(new char[kBufferSize]), m_Busy(false),
+      m_Pending(0), m_FlushNow(false), m_Stop(false) {
+    m_Thread = std::thread(&BufferedSink::run, this);
+  }
+
+  std::unique_ptr<BufferedSink> BufferedSink::create(int FileFD,
+                                                     bool Compress) {
+    if (Compress && !llvm::zlib::isAvailable()) {
+      cling::errs() << "cling::BufferedSink: this build cannot compress\n";
+      ::close(FileFD);
+      return nullptr;
+    }
+
+    int FDs[2];
+    if (::pipe(FDs) == -1) {
+      ::perror("BufferedSink::create");
+      ::close(FileFD);
+      return nullptr;
+    }
+    // The thread polls its end. Shell commands get stdout, not the pipe.
+    ::fcntl(FDs[0], F_SETFL, ::fcntl(FDs[0], F_GETFL) | O_NONBLOCK);
+    ::fcntl(FDs[0], F_SETFD, FD_CLOEXEC);
+    ::fcntl(FDs[1], F_SETFD, FD_CLOEXEC);
+#ifdef F_SETPIPE_SZ
+    // Fewer waits of the writers while the thread writes to the file.
+    ::fcntl(FDs[1], F_SETPIPE_SZ, 1 << 20);
+#endif
+
+    std::unique_ptr<BufferedSink> S(new BufferedSink(FDs[0], FDs[1], FileFD,
+                                                     Compress));
+    registerSink(S.get());
+    return S;
+  }
+
+  BufferedSink::~BufferedSink() {
+    unregisterSink(this);
+    m_Stop = true;
+    m_Thread.join();
+    ::close(m_ReadFD);
+    ::close(m_WriteFD);
+    ::close(m_FileFD);
+  }
+
+  void BufferedSink::run() {
+    bool Stop = false;
+    while (!Stop) {
+      // What was written before the stop request is in the pipe by now.
+      Stop = m_Stop;
+      struct pollfd P;
+      P.fd = m_ReadFD;
+      P.events = POLLIN;
+      P.revents = 0;
+      const int Ready = Stop ? 1 : ::poll(&P, 1, kIdleMilliseconds);
+
+      m_Busy = true;
+      const bool Idle = Ready == 0 || (Ready > 0 && !readAvailable());
+      const bool FlushNow = m_FlushNow.exchange(false);
+      if (Idle || Stop || FlushNow)
+        writeOut();
+      m_Pending = m_Used;
+      m_Busy = false;
+    }
+  }
+
+  bool BufferedSink::readAvailable() {
+    bool Read = false;
+    for (;;) {
+      const ssize_t N = ::read(m_ReadFD, m_Buffer.get() + m_Used,
+                               kBufferSize - m_Used);
+      if (N > 0) {
+        Read = true;
+        m_Used += N;
+        if (m_Used == kBufferSize)
+          writeOut();
+      } else if (N < 0 && errno == EINTR)
+        continue;
+      else
+        return Read; // EAGAIN: the pipe is empty.
+    }
+  }
+
+  void BufferedSink::writeOut() {
+    if (!m_Used)
+      return;
+    const llvm::StringRef Data(m_Buffer.get(), m_Used);
+    m_Used = 0;
+    if (!m_Compress) {
+      writeAll(Data.data(), Data.size());
+      return;
+    }
+
+    // zlib's format wraps the deflate data in a 2-byte header and Adler-32,
+    // gzip's in a 10-byte header, CRC-32 and the size.
+    llvm::SmallVector<char, 0> Zlib;
+    if (llvm::Error Err = llvm::zlib::compress(
+            Data, Zlib, llvm::zlib::BestSpeedCompression)) {
+      // Out of memory; a partial member would make the file unreadable.
+      llvm::consumeError(std::move(Err));
+      return;
+    }
+    if (Zlib.size() < 6)
+      return;
+
+    static const char Header[10] = {'\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0,
+                                    '\xff'};
+    const uint32_t CRC = llvm::zlib::crc32(Data);
+    const uint32_t Size = uint32_t(Data.size());
+    char Trailer[8];
+    for (unsigned I = 0; I < 4; ++I) {
+      Trailer[I] = char(CRC >> (8 * I));
+      Trailer[4 + I] = char(Size >> (8 * I));
+    }
+    writeAll(Header, sizeof(Header));
+    writeAll(Zlib.data() + 2, Zlib.size() - 6);
+    writeAll(Trailer, sizeof(Trailer));
+  }
+
+  void BufferedSink::writeAll(const char* Data, size_t Size) {
+    while (Size) {
+      const ssize_t N = ::write(m_FileFD, Data, Size);
+      if (N < 0) {
+        if (errno == EINTR)
+          continue;
+        // No one to tell: stdout and stderr might be the pipe.
+        return;
+      }
+      Data += N;
+      Size -= N;
+    }
+  }
+
+  void BufferedSink::flush() {
+    // Bounded, for a crash handler must not hang on a stuck disk.
+    for (unsigned I = 0; I < 5000; ++I) {
+      int InPipe = 0;
+      if (::ioctl(m_ReadFD, FIONREAD, &InPipe) == 0 && !InPipe && !m_Busy
+          && !m_Pending)
+        return;
+      m_FlushNow = true;
+      struct timespec Wait = {0, 1000000};
+      ::nanosleep(&Wait, nullptr);
+    }
+  }
+#endif
+} // end namespace cling
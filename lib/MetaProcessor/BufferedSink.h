@@ -0,0 +1,81 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_BUFFERED_SINK_H
+#define CLING_BUFFERED_SINK_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+namespace cling {
+  ///\brief The file of a buffered redirection, `.> file --buffered`: stdout
+  /// or stderr write into a pipe, which a thread empties into a large
+  /// buffer and writes the buffer to the file once it is full or nothing
+  /// came for a while, gzip compressed with `--gzip`.
+  ///
+  /// The output thus never waits for the disk, nor for the compression.
+  /// A compressed file is a sequence of gzip members, one per buffer
+  /// written, which gzip reads as one stream. The sinks of the process are
+  /// flushed when it crashes, by a signal handler of llvm::sys.
+  ///
+  class BufferedSink {
+    int m_ReadFD;
+    int m_WriteFD;
+    int m_FileFD;
+    bool m_Compress;
+
+    std::unique_ptr<char[]> m_Buffer;
+    size_t m_Used = 0;
+
+    ///\brief Set by the thread while it moves data out of the pipe, until
+    /// m_Pending is updated; see flush().
+    std::atomic<bool> m_Busy;
+    ///\brief The bytes in m_Buffer not written to the file yet.
+    std::atomic<size_t> m_Pending;
+    std::atomic<bool> m_FlushNow;
+    std::atomic<bool> m_Stop;
+
+    std::thread m_Thread;
+
+    BufferedSink(int ReadFD, int WriteFD, int FileFD, bool Compress);
+
+    void run();
+    bool readAvailable();
+    void writeOut();
+    void writeAll(const char* Data, size_t Size);
+
+  public:
+    enum {
+      ///\brief The size of the buffer of the thread.
+      kBufferSize = 4 << 20,
+      ///\brief The buffer is written after that many milliseconds without
+      /// output.
+      kIdleMilliseconds = 100
+    };
+
+    ///\brief Starts the thread writing to FileFD, which the sink closes.
+    ///\returns null and closes FileFD if that fails, e.g. if compressing is
+    /// not available.
+    static std::unique_ptr<BufferedSink> create(int FileFD, bool Compress);
+
+    ///\brief Writes what is left, then closes the file. What is written to
+    /// getFD() later is lost: restore stdout and stderr before.
+    ~BufferedSink();
+
+    ///\brief The descriptor to write to; stdout and stderr get it.
+    int getFD() const { return m_WriteFD; }
+
+    ///\brief Waits until what was written to getFD() so far is in the
+    /// file, though not forever. Async-signal-safe.
+    void flush();
+  };
+} // end namespace cling
+
+#endif // CLING_BUFFERED_SINK_H
@@ -31,6 +31,7 @@
 #include "llvm/Support/Format.h"
 #include "llvm/Support/FormattedStream.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/Regex.h"
 
 #include <algorithm>
 #include <cassert>
@@ -432,6 +433,81 @@ void FILEPrintHelper::Print(const char* msg)const
   fStream.flush();
 }
 
+//
+//Decides which entries of a listing are shown, by name, see DisplayFilter.
+//
+class EntryFilter {
+public:
+  EntryFilter(const DisplayFilter& filter);
+
+  bool Accept(llvm::StringRef name);
+  void PrintSummary(const FILEPrintHelper& out)const;
+
+private:
+  const DisplayFilter& fFilter;
+  llvm::Regex fRegex;
+  //Entries matched so far, shown or not.
+  size_t fNMatched;
+};
+
+//______________________________________________________________________________
+EntryFilter::EntryFilter(const DisplayFilter& filter)
+              : fFilter(filter),
+                fRegex(filter.Match == DisplayFilter::kRegex ? filter.Pattern
+                                                             : ""),
+                fNMatched(0)
+{
+  assert(filter.Page != 0 && "EntryFilter, pages are counted from 1");
+}
+
+//______________________________________________________________________________
+bool EntryFilter::Accept(llvm::StringRef name)
+{
+  switch (fFilter.Match) {
+  case DisplayFilter::kAll:
+    break;
+  case DisplayFilter::kPrefix:
+    if (!name.startswith(fFilter.Pattern))
+      return false;
+    break;
+  case DisplayFilter::kRegex:
+    if (!fRegex.match(name))
+      return false;
+    break;
+  }
+
+  const size_t index = fNMatched++;
+  if (!fFilter.PageSize)
+    return true;
+  const size_t first = (fFilter.Page - 1) * fFilter.PageSize;
+  return index >= first && index - first < fFilter.PageSize;
+}
+
+//______________________________________________________________________________
+void EntryFilter::PrintSummary(const FILEPrintHelper& out)const
+{
+  if (!fFilter.PageSize) {
+    if (fFilter.Match != DisplayFilter::kAll && !fNMatched)
+      out.Print("No entry matches\n");
+    return;
+  }
+
+  const size_t first = (fFilter.Page - 1) * fFilter.PageSize;
+  std::string summary;
+  if (first >= fNMatched) {
+    summary = "Page " + std::to_string(fFilter.Page) + " is empty, " +
+              std::to_string(fNMatched) + " entries match\n";
+  } else {
+    const size_t last = std::min(first + fFilter.PageSize, fNMatched);
+    summary = "Entries " + std::to_string(first + 1) + "-" +
+              std::to_string(last) + " of " + std::to_string(fNMatched);
+    if (last < fNMatched)
+      summary += ", next: -page " + std::to_string(fFilter.Page + 1);
+    summary += "\n";
+  }
+  out.Print(summary.c_str());
+}
+
 //
 //Aux. class to traverse translation-unit-declaration/class-declaration.
 //
@@ -445,25 +521,13 @@ private:
 public:
   ClassPrinter(llvm::raw_ostream& stream, const class cling::Interpreter* interpreter);
 
-  void DisplayAllClasses()const;
+  void DisplayAllClasses(DisplayIndex& index, const DisplayFilter& filter)const;
   void DisplayClass(const std::string& className)const;
 
   void SetVerbose(bool verbose);
 
 private:
 
-  //These are declarations, which can contain nested class declarations,
-  //I have separate function for the case I want to treat them in different ways.
-  //Can be only one processDecl actually.
-
-  void ProcessDecl(decl_iterator decl)const;
-  void ProcessBlockDecl(decl_iterator decl)const;
-  void ProcessFunctionDecl(decl_iterator decl)const;
-  void ProcessNamespaceDecl(decl_iterator decl)const;
-  void ProcessLinkageSpecDecl(decl_iterator decl)const;
-  void ProcessClassDecl(decl_iterator decl)const;
-  void ProcessClassTemplateDecl(decl_iterator decl)const;
-
   template<class Decl>
   void ProcessTypeOfMember(const Decl* decl, unsigned nSpaces)const
   {
@@ -512,22 +576,26 @@ ClassPrinter::ClassPrinter(llvm::raw_ostream& stream, const cling::Interpreter*
 
 
 //______________________________________________________________________________
-void ClassPrinter::DisplayAllClasses()const
+void ClassPrinter::DisplayAllClasses(DisplayIndex& index,
+                                     const DisplayFilter& filter)const
 {
   //Just in case asserts were deleted from ctor:
   assert(fInterpreter != 0 && "DisplayAllClasses, fCompiler is null");
 
-  const CompilerInstance* const compiler = fInterpreter->getCI();
-  assert(compiler != 0 && "DisplayAllClasses, compiler instance is null");
-
-  const TranslationUnitDecl* const tuDecl = compiler->getASTContext().getTranslationUnitDecl();
-  assert(tuDecl != 0 && "DisplayAllClasses, translation unit is empty");
-
   fOut.Print("List of classes");
+  EntryFilter entries(filter);
   // Could trigger deserialization of decls.
   Interpreter::PushTransactionRAII RAII(const_cast<Interpreter*>(fInterpreter));
-  for (decl_iterator decl = tuDecl->decls_begin(); decl != tuDecl->decls_end(); ++decl)
-    ProcessDecl(decl);
+  for (const DisplayIndex::Entry& entry : index.get(DisplayIndex::kClasses)) {
+    if (!entries.Accept(entry.Name))
+      continue;
+    const CXXRecordDecl* const classDecl = cast<CXXRecordDecl>(entry.D);
+    if (classDecl->hasDefinition())
+      DisplayClassDecl(classDecl);
+    else
+      DisplayClassFwdDecl(classDecl);
+  }
+  entries.PrintSummary(fOut);
 }
 
 //______________________________________________________________________________
@@ -558,162 +626,6 @@ void ClassPrinter::SetVerbose(bool verbose)
   fVerbose = verbose;
 }
 
-//______________________________________________________________________________
-void ClassPrinter::ProcessDecl(decl_iterator decl)const
-{
-  //Just in case asserts were deleted from ctor:
-  assert(fInterpreter != 0 && "ProcessDecl, fInterpreter is null");
-  assert(*decl != 0 && "ProcessDecl, 'decl' parameter is not a valid iterator");
-
-  switch (decl->getKind()) {
-  case Decl::Namespace:
-    ProcessNamespaceDecl(decl);
-    break;
-  case Decl::Block:
-    ProcessBlockDecl(decl);
-    break;
-  case Decl::Function:
-  case Decl::CXXMethod:
-  case Decl::CXXConstructor:
-  case Decl::CXXConversion:
-  case Decl::CXXDestructor:
-    ProcessFunctionDecl(decl);
-    break;
-  case Decl::LinkageSpec:
-    ProcessLinkageSpecDecl(decl);
-    break;
-  case Decl::ClassTemplate:
-    ProcessClassTemplateDecl(decl);
-    break;
-  case Decl::CXXRecord:
-  case Decl::ClassTemplateSpecialization:
-  case Decl::ClassTemplatePartialSpecialization:
-    ProcessClassDecl(decl);
-    break;
-  default:
-    if (dyn_cast<FunctionDecl>(*decl))
-      //decl->getKind() != Decl::Function, but decl has type, inherited from FunctionDecl.
-      ProcessFunctionDecl(decl);
-    break;
-  }
-}
-
-//______________________________________________________________________________
-void ClassPrinter::ProcessBlockDecl(decl_iterator decl)const
-{
-  //Just in case asserts were deleted from ctor:
-  assert(fInterpreter != 0 && "ProcessBlockDecl, fInterpreter is null");
-  assert(*decl != 0 && "ProcessBlockDecl, 'decl' parameter is not a valid iterator");
-  assert(decl->getKind() == Decl::Block && "ProcessBlockDecl, decl->getKind() != BlockDecl");
-
-  //Block can contain nested (arbitrary deep) class declarations.
-  //Though, I'm not sure if have block in our code.
-  const BlockDecl* const blockDecl = dyn_cast<BlockDecl>(*decl);
-  assert(blockDecl != 0 && "ProcessBlockDecl, internal error - decl is not a BlockDecl");
-
-  // Could trigger deserialization of decls.
-  Interpreter::PushTransactionRAII RAII(const_cast<Interpreter*>(fInterpreter));
-  for (decl_iterator it = blockDecl->decls_begin(); it != blockDecl->decls_end(); ++it)
-    ProcessDecl(it);
-}
-
-//______________________________________________________________________________
-void ClassPrinter::ProcessFunctionDecl(decl_iterator decl)const
-{
-  //Just in case asserts were deleted from ctor:
-  assert(fInterpreter != 0 && "ProcessFunctionDecl, fInterpreter is null");
-  assert(*decl != 0 && "ProcessFunctionDecl, 'decl' parameter is not a valid iterator");
-
-  //Function can contain class declarations, we have to check this.
-  const FunctionDecl* const functionDecl = dyn_cast<FunctionDecl>(*decl);
-  assert(functionDecl != 0 && "ProcessFunctionDecl, internal error - decl is not a FunctionDecl");
-
-  // Could trigger deserialization of decls.
-  Interpreter::PushTransactionRAII RAII(const_cast<Interpreter*>(fInterpreter));
-  for (decl_iterator it = functionDecl->decls_begin(); it != functionDecl->decls_end(); ++it)
-    ProcessDecl(it);
-}
-
-//______________________________________________________________________________
-void ClassPrinter::ProcessNamespaceDecl(decl_iterator decl)const
-{
-  //Just in case asserts were deleted from ctor:
-  assert(fInterpreter != 0 && "ProcessNamespaceDecl, fInterpreter is null");
-  assert(*decl != 0 && "ProcessNamespaceDecl, 'decl' parameter is not a valid iterator");
-  assert(decl->getKind() == Decl::Namespace && "ProcessNamespaceDecl, decl->getKind() != Namespace");
-
-  //Namespace can contain nested (arbitrary deep) class declarations.
-  const NamespaceDecl* const namespaceDecl = dyn_cast<NamespaceDecl>(*decl);
-  assert(namespaceDecl != 0 && "ProcessNamespaceDecl, 'decl' parameter is not a NamespaceDecl");
-
-  // Could trigger deserialization of decls.
-  Interpreter::PushTransactionRAII RAII(const_cast<Interpreter*>(fInterpreter));
-  for (decl_iterator it = namespaceDecl->decls_begin(); it != namespaceDecl->decls_end(); ++it)
-    ProcessDecl(it);
-}
-
-//______________________________________________________________________________
-void ClassPrinter::ProcessLinkageSpecDecl(decl_iterator decl)const
-{
-  //Just in case asserts were deleted from ctor:
-  assert(fInterpreter != 0 && "ProcessLinkageSpecDecl, fInterpreter is null");
-  assert(*decl != 0 && "ProcessLinkageSpecDecl, 'decl' parameter is not a valid iterator");
-
-  const LinkageSpecDecl* const linkageSpec = dyn_cast<LinkageSpecDecl>(*decl);
-  assert(linkageSpec != 0 && "ProcessLinkageSpecDecl, decl is not a LinkageSpecDecl");
-
-  // Could trigger deserialization of decls.
-  Interpreter::PushTransactionRAII RAII(const_cast<Interpreter*>(fInterpreter));
-  for (decl_iterator it = linkageSpec->decls_begin(); it != linkageSpec->decls_end(); ++it)
-    ProcessDecl(it);
-}
-
-//______________________________________________________________________________
-void ClassPrinter::ProcessClassDecl(decl_iterator decl) const
-{
-  assert(fInterpreter != 0 && "ProcessClassDecl, fInterpreter is null");
-  assert(*decl != 0 && "ProcessClassDecl, 'decl' parameter is not a valid iterator");
-
-  const CXXRecordDecl* const classDecl = dyn_cast<CXXRecordDecl>(*decl);
-  assert(classDecl != 0 && "ProcessClassDecl, internal error, declaration is not a CXXRecordDecl");
-
-  if (!classDecl->hasDefinition()) {
-    DisplayClassFwdDecl(classDecl);
-    return;
-  }
-
-  DisplayClassDecl(classDecl);
-
-  // Could trigger deserialization of decls.
-  Interpreter::PushTransactionRAII RAII(const_cast<Interpreter*>(fInterpreter));
-  // Now we have to check nested scopes for class declarations.
-  for (decl_iterator nestedDecl = classDecl->decls_begin();
-       nestedDecl != classDecl->decls_end(); ++nestedDecl)
-    ProcessDecl(nestedDecl);
-}
-
-//______________________________________________________________________________
-void ClassPrinter::ProcessClassTemplateDecl(decl_iterator decl)const
-{
-  assert(fInterpreter != 0 && "ProcessClassDecl, fInterpreter is null");
-  assert(*decl != 0 && "ProcessClassDecl, 'decl' parameter is not a valid iterator");
-
-  ClassTemplateDecl *templateDecl = dyn_cast<ClassTemplateDecl>(*decl);
-  assert(templateDecl != 0 && "ProcessClassTemplateDecl, internal error, declaration is not a ClassTemplateDecl");
-
-  templateDecl = templateDecl->getCanonicalDecl();
-
-  if (!templateDecl->isThisDeclarationADefinition())
-    return;
-
-  // Could trigger deserialization of decls.
-  Interpreter::PushTransactionRAII RAII(const_cast<Interpreter*>(fInterpreter));
-  //Now we have to display all the specialization (/instantiations)
-  for (ClassTemplateDecl::spec_iterator spec = templateDecl->spec_begin();
-       spec != templateDecl->spec_end(); ++spec)
-     ProcessDecl(decl_iterator( *spec ));
-}
-
 //______________________________________________________________________________
 void ClassPrinter::DisplayClassDecl(const CXXRecordDecl* classDecl)const
 {
@@ -1081,7 +993,7 @@ class GlobalsPrinter {
 public:
   GlobalsPrinter(llvm::raw_ostream& stream, const class cling::Interpreter* interpreter);
 
-  void DisplayGlobals()const;
+  void DisplayGlobals(DisplayIndex& index, const DisplayFilter& filter)const;
   void DisplayGlobal(const std::string& name)const;
 
 private:
@@ -1131,7 +1043,8 @@ unsigned GlobalsPrinter::DisplayDCDecls(const DeclContext *DC, T filter_func, Ar
 }
 
 //______________________________________________________________________________
-void GlobalsPrinter::DisplayGlobals()const
+void GlobalsPrinter::DisplayGlobals(DisplayIndex& index,
+                                    const DisplayFilter& filter)const
 {
   typedef Preprocessor::macro_iterator macro_iterator;
 
@@ -1140,20 +1053,21 @@ void GlobalsPrinter::DisplayGlobals()const
   const CompilerInstance* const compiler = fInterpreter->getCI();
   assert(compiler != 0 && "DisplayGlobals, compiler instance is null");
 
-  const TranslationUnitDecl* const tuDecl = compiler->getASTContext().getTranslationUnitDecl();
-  assert(tuDecl != 0 && "DisplayGlobals, translation unit is empty");
+  EntryFilter entries(filter);
 
   // Could trigger deserialization of decls.
   Interpreter::PushTransactionRAII RAII(const_cast<Interpreter*>(fInterpreter));
 
-  //Try to print global macro definitions (object-like only).
+  //Try to print global macro definitions (object-like only). Like the
+  //index, leave the macros of modules and PCHs that were not read yet alone.
   const Preprocessor& pp = compiler->getPreprocessor();
-  for (macro_iterator macro = pp.macro_begin(); macro != pp.macro_end(); ++macro) {
+  for (macro_iterator macro = pp.macro_begin(/*IncludeExternalMacros=*/false);
+       macro != pp.macro_end(/*IncludeExternalMacros=*/false); ++macro) {
     auto* MD = macro->second.getLatest();
     if (!MD)
       continue;
     auto MI = MD->getMacroInfo();
-    if (MI && MI->isObjectLike())
+    if (MI && MI->isObjectLike() && entries.Accept(macro->first->getName()))
       DisplayObjectLikeMacro(macro->first, MI);
   }
 
@@ -1161,7 +1075,15 @@ void GlobalsPrinter::DisplayGlobals()const
   //It's obviously that for objects we can have one definition and any number
   //of declarations, should I print them?
 
-  DisplayDCDecls(tuDecl, [] (NamedDecl *) { return true; });
+  for (const DisplayIndex::Entry& entry : index.get(DisplayIndex::kGlobals)) {
+    if (!entries.Accept(entry.Name))
+      continue;
+    if (const VarDecl* const varDecl = dyn_cast<VarDecl>(entry.D))
+      DisplayVarDecl(varDecl);
+    else
+      DisplayEnumeratorDecl(cast<EnumConstantDecl>(entry.D));
+  }
+  entries.PrintSummary(fOut);
 }
 
 //______________________________________________________________________________
@@ -1295,12 +1217,9 @@ class NamespacePrinter {
 public:
    NamespacePrinter(llvm::raw_ostream& stream, const Interpreter* interpreter);
 
-   void Print()const;
+   void Print(DisplayIndex& index, const DisplayFilter& filter)const;
 
 private:
-   void ProcessNamespaceDeclaration(decl_iterator decl,
-                                    const std::string& enclosingNamespaceName)const;
-
    FILEPrintHelper fOut;
    const cling::Interpreter* fInterpreter;
 };
@@ -1316,64 +1235,21 @@ NamespacePrinter::NamespacePrinter(llvm::raw_ostream& stream,
 }
 
 //______________________________________________________________________________
-void NamespacePrinter::Print()const
+void NamespacePrinter::Print(DisplayIndex& index,
+                             const DisplayFilter& filter)const
 {
   assert(fInterpreter != nullptr && "Print, fInterpreter is null");
 
-  const auto compiler = fInterpreter->getCI();
-  assert(compiler != nullptr && "Print, compiler instance is null");
-
-  const auto tu = compiler->getASTContext().getTranslationUnitDecl();
-  assert(tu != nullptr && "Print, translation unit is null");
-
-  const std::string globalNSName;
-
   fOut.Print("List of namespaces\n");
-  for (auto it = tu->decls_begin(), eIt = tu->decls_end(); it != eIt; ++it) {
-    if (it->getKind() == Decl::Namespace || it->getKind() == Decl::NamespaceAlias)
-      ProcessNamespaceDeclaration(it, globalNSName);
-  }
-}
-
-//______________________________________________________________________________
-void NamespacePrinter::ProcessNamespaceDeclaration(decl_iterator declIt,
-                                const std::string& enclosingNamespaceName)const
-{
-  assert(fInterpreter != 0 &&
-         "ProcessNamespaceDeclaration, fInterpreter is null");
-  assert(*declIt != 0 &&
-         "ProcessNamespaceDeclaration, parameter 'decl' is not a valid iterator");
-
-  if (const auto nsDecl = dyn_cast<NamespaceDecl>(*declIt)) {
-    if (nsDecl->isAnonymousNamespace())
-      return;//TODO: invent some name?
-
-    std::string name(enclosingNamespaceName);
-    if (enclosingNamespaceName.length())
-      name += "::";
-    name += nsDecl->getNameAsString();
-
-    if (nsDecl->isOriginalNamespace()) {
-      fOut.Print(name.c_str());
+  EntryFilter entries(filter);
+  for (const DisplayIndex::Entry& entry
+         : index.get(DisplayIndex::kNamespaces)) {
+    if (entries.Accept(entry.Name)) {
+      fOut.Print(entry.Name.c_str());
       fOut.Print("\n");
     }
-
-    if (const auto ctx = dyn_cast<DeclContext>(*declIt)) {
-      for (auto it = ctx->decls_begin(), eIt = ctx->decls_end(); it != eIt; ++it) {
-        if (it->getKind() == Decl::Namespace ||
-            it->getKind() == Decl::NamespaceAlias)
-          ProcessNamespaceDeclaration(it, name);
-      }
-    }//TODO: else diagnostic?
-  } else if (const auto alDecl = dyn_cast<NamespaceAliasDecl>(*declIt)) {
-    if (enclosingNamespaceName.length()) {
-      fOut.Print((enclosingNamespaceName + "::" +
-                  alDecl->getNameAsString()).c_str());
-    } else
-      fOut.Print(alDecl->getNameAsString().c_str());
-
-    fOut.Print("\n");
   }
+  entries.PrintSummary(fOut);
 }
 
 //Print typedefs.
@@ -1381,15 +1257,11 @@ class TypedefPrinter {
 public:
   TypedefPrinter(llvm::raw_ostream& stream, const Interpreter* interpreter);
 
-  void DisplayTypedefs()const;
+  void DisplayTypedefs(DisplayIndex& index, const DisplayFilter& filter)const;
   void DisplayTypedef(const std::string& name)const;
 
 private:
-
-  void ProcessNestedDeclarations(const DeclContext* decl)const;
-  void ProcessDecl(decl_iterator decl) const;
-
-  void DisplayTypedefDecl(TypedefNameDecl* typedefDecl)const;
+  void DisplayTypedefDecl(const TypedefNameDecl* typedefDecl)const;
 
   FILEPrintHelper fOut;
   const cling::Interpreter* fInterpreter;
@@ -1406,18 +1278,20 @@ TypedefPrinter::TypedefPrinter(llvm::raw_ostream& stream, const Interpreter* int
 }
 
 //______________________________________________________________________________
-void TypedefPrinter::DisplayTypedefs()const
+void TypedefPrinter::DisplayTypedefs(DisplayIndex& index,
+                                     const DisplayFilter& filter)const
 {
   assert(fInterpreter != 0 && "DisplayTypedefs, fInterpreter is null");
 
-  const CompilerInstance* const compiler = fInterpreter->getCI();
-  assert(compiler != 0 && "DisplayTypedefs, compiler instance is null");
-
-  const TranslationUnitDecl* const tuDecl = compiler->getASTContext().getTranslationUnitDecl();
-  assert(tuDecl != 0 && "DisplayTypedefs, translation unit is empty");
-
   fOut.Print("List of typedefs");
-  ProcessNestedDeclarations(tuDecl);
+  EntryFilter entries(filter);
+  // Could trigger deserialization of decls.
+  Interpreter::PushTransactionRAII RAII(const_cast<Interpreter*>(fInterpreter));
+  for (const DisplayIndex::Entry& entry : index.get(DisplayIndex::kTypedefs)) {
+    if (entries.Accept(entry.Name))
+      DisplayTypedefDecl(cast<TypedefNameDecl>(entry.D));
+  }
+  entries.PrintSummary(fOut);
 }
 
 //______________________________________________________________________________
@@ -1445,47 +1319,7 @@ void TypedefPrinter::DisplayTypedef(const std::string& typedefName)const
 }
 
 //______________________________________________________________________________
-void TypedefPrinter::ProcessNestedDeclarations(const DeclContext* decl)const
-{
-  assert(decl != 0 && "ProcessNestedDeclarations, parameter 'decl' is null");
-  // Could trigger deserialization of decls.
-  Interpreter::PushTransactionRAII RAII(const_cast<Interpreter*>(fInterpreter));
-  for (decl_iterator it = decl->decls_begin(), eIt = decl->decls_end(); it != eIt; ++it)
-    ProcessDecl(it);
-}
-
-//______________________________________________________________________________
-void TypedefPrinter::ProcessDecl(decl_iterator decl)const
-{
-  assert(fInterpreter != 0 && "ProcessDecl, fInterpreter is null");
-  assert(*decl != 0 && "ProcessDecl, parameter 'decl' is not a valid iterator");
-
-  switch (decl->getKind()) {
-  case Decl::Typedef:
-    DisplayTypedefDecl(dyn_cast<TypedefDecl>(*decl));
-    break;
-  case Decl::Namespace:
-  case Decl::Block:
-  case Decl::Function:
-  case Decl::CXXMethod:
-  case Decl::CXXConstructor:
-  case Decl::CXXConversion:
-  case Decl::CXXDestructor:
-  case Decl::LinkageSpec:
-  case Decl::CXXRecord:
-  case Decl::ClassTemplateSpecialization:
-  //case Decl::ClassTemplatePartialSpecialization:
-    ProcessNestedDeclarations(dyn_cast<DeclContext>(*decl));
-    break;
-  default:
-    if (FunctionDecl * const funDecl = dyn_cast<FunctionDecl>(*decl))
-      ProcessNestedDeclarations(funDecl);
-    break;
-  }
-}
-
-//______________________________________________________________________________
-void TypedefPrinter::DisplayTypedefDecl(TypedefNameDecl* typedefDecl)const
+void TypedefPrinter::DisplayTypedefDecl(const TypedefNameDecl* typedefDecl)const
 {
   assert(typedefDecl != 0
          && "DisplayTypedefDecl, parameter 'typedefDecl' is null");
@@ -1516,15 +1350,289 @@ void TypedefPrinter::DisplayTypedefDecl(TypedefNameDecl* typedefDecl)const
 
 }//unnamed namespace
 
+//______________________________________________________________________________
+bool DisplayFilter::parse(llvm::StringRef options, std::string& error)
+{
+  llvm::SmallVector<llvm::StringRef, 8> args;
+  options.split(args, ' ', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+
+  bool paged = false;
+  for (size_t i = 0, e = args.size(); i < e; ++i) {
+    const llvm::StringRef option = args[i].trim();
+    if (option.empty())
+      continue;
+    if (option != "-p" && option != "-r" && option != "-n"
+        && option != "-page") {
+      error = "unknown option '" + option.str() + "'";
+      return false;
+    }
+    if (i + 1 == e) {
+      error = "option '" + option.str() + "' needs a value";
+      return false;
+    }
+    const llvm::StringRef value = args[++i].trim();
+
+    if (option == "-p" || option == "-r") {
+      if (Match != kAll) {
+        error = "only one of -p and -r can be given";
+        return false;
+      }
+      Match = option == "-p" ? kPrefix : kRegex;
+      Pattern = value.str();
+      std::string regexError;
+      if (Match == kRegex && !llvm::Regex(Pattern).isValid(regexError)) {
+        error = "invalid regular expression '" + Pattern + "': " + regexError;
+        return false;
+      }
+    } else {
+      size_t number = 0;
+      if (value.getAsInteger(10, number) || !number) {
+        error = "option '" + option.str() + "' needs a positive number";
+        return false;
+      }
+      if (option == "-n")
+        PageSize = number;
+      else {
+        Page = number;
+        paged = true;
+      }
+    }
+  }
+
+  // A page without a size shows the number of lines of a terminal.
+  if (paged && !PageSize)
+    PageSize = 20;
+  return true;
+}
+
+//______________________________________________________________________________
+const std::vector<DisplayIndex::Entry>& DisplayIndex::get(Kind kind)
+{
+  assert(kind < kNumKinds && "get, invalid kind of entries");
+  update();
+  return m_Entries[kind];
+}
+
+//______________________________________________________________________________
+void DisplayIndex::update()
+{
+  // Could trigger deserialization of decls, e.g. template specializations.
+  Interpreter::PushTransactionRAII RAII(const_cast<Interpreter*>(&m_Interpreter));
+
+  // The unloaded declarations might be anywhere in the index: start over.
+  const unsigned generation = m_Interpreter.getUnloadGeneration();
+  if (m_Contexts.empty() || generation != m_Generation) {
+    for (std::vector<Entry>& entries : m_Entries)
+      entries.clear();
+    m_Contexts.clear();
+    m_Templates.clear();
+    m_Seen.clear();
+    m_Generation = generation;
+
+    const TranslationUnitDecl* const tuDecl
+      = m_Interpreter.getCI()->getASTContext().getTranslationUnitDecl();
+    m_Contexts.push_back(Context{tuDecl, nullptr, nullptr, std::string(),
+                                 /*Namespaces=*/true, /*Globals=*/true});
+  }
+
+  // Contexts and templates found meanwhile are indexed right away.
+  for (size_t i = 0; i < m_Contexts.size(); ++i)
+    indexContext(i);
+  for (size_t i = 0; i < m_Templates.size(); ++i)
+    indexTemplate(i);
+}
+
+//______________________________________________________________________________
+void DisplayIndex::indexContext(size_t i)
+{
+  // A copy: indexing adds contexts.
+  const Context ctx = m_Contexts[i];
+
+  // noload_decls(): a context from a module or a PCH keeps its declarations
+  // there until something needs them; a listing does not.
+  const Decl* const first = *ctx.DC->noload_decls_begin();
+  // The declarations read from there since are put before the others.
+  if (ctx.First && first != ctx.First) {
+    for (const Decl* decl = first; decl && decl != ctx.First;
+         decl = decl->getNextDeclInContext())
+      indexDecl(decl, ctx);
+  }
+
+  const Decl* last = ctx.Last;
+  for (const Decl* decl = last ? last->getNextDeclInContext() : first; decl;
+       decl = decl->getNextDeclInContext()) {
+    indexDecl(decl, ctx);
+    last = decl;
+  }
+
+  m_Contexts[i].First = first;
+  m_Contexts[i].Last = last;
+}
+
+//______________________________________________________________________________
+void DisplayIndex::indexTemplate(size_t i)
+{
+  // Copies: indexing adds templates.
+  const ClassTemplateDecl* const templateDecl = m_Templates[i].first;
+  const size_t nIndexed = m_Templates[i].second;
+
+  const Context ctx{templateDecl->getDeclContext(), nullptr, nullptr,
+                    std::string(), /*Namespaces=*/false, /*Globals=*/false};
+  size_t nSpecs = 0;
+  for (const ClassTemplateSpecializationDecl* spec
+         : templateDecl->specializations()) {
+    if (nSpecs++ >= nIndexed)
+      indexClass(spec, ctx);
+  }
+  m_Templates[i].second = nSpecs;
+}
+
+//______________________________________________________________________________
+void DisplayIndex::addContext(const DeclContext* dc, const Context& ctx)
+{
+  m_Contexts.push_back(ctx);
+  m_Contexts.back().DC = dc;
+  m_Contexts.back().First = nullptr;
+  m_Contexts.back().Last = nullptr;
+  // Right away, to keep the entries in the order of declaration.
+  indexContext(m_Contexts.size() - 1);
+}
+
+//______________________________________________________________________________
+void DisplayIndex::indexDecls(const DeclContext* dc, const Context& ctx)
+{
+  for (const Decl* decl : dc->noload_decls())
+    indexDecl(decl, ctx);
+}
+
+//______________________________________________________________________________
+void DisplayIndex::indexDecl(const Decl* decl, const Context& ctx)
+{
+  assert(decl != 0 && "indexDecl, 'decl' parameter is null");
+
+  switch (decl->getKind()) {
+  case Decl::Namespace: {
+    const NamespaceDecl* const nsDecl = cast<NamespaceDecl>(decl);
+    Context nested(ctx);
+    nested.Globals = ctx.Globals && nsDecl->isInlineNamespace();
+    if (nsDecl->isAnonymousNamespace())
+      nested.Namespaces = false;//TODO: invent some name?
+    else {
+      if (!nested.Scope.empty())
+        nested.Scope += "::";
+      nested.Scope += nsDecl->getNameAsString();
+      if (ctx.Namespaces && nsDecl->isOriginalNamespace())
+        m_Entries[kNamespaces].push_back(Entry{nested.Scope, nsDecl});
+    }
+    addContext(nsDecl, nested);
+    break;
+  }
+  case Decl::NamespaceAlias:
+    if (ctx.Namespaces) {
+      std::string name(ctx.Scope);
+      if (!name.empty())
+        name += "::";
+      name += cast<NamespaceAliasDecl>(decl)->getNameAsString();
+      m_Entries[kNamespaces].push_back(Entry{name, decl});
+    }
+    break;
+  case Decl::LinkageSpec: {
+    Context nested(ctx);
+    nested.Namespaces = false;
+    addContext(cast<LinkageSpecDecl>(decl), nested);
+    break;
+  }
+  case Decl::CXXRecord:
+  case Decl::ClassTemplateSpecialization:
+  case Decl::ClassTemplatePartialSpecialization:
+    indexClass(decl, ctx);
+    break;
+  case Decl::ClassTemplate: {
+    const ClassTemplateDecl* const templateDecl
+      = cast<ClassTemplateDecl>(decl)->getCanonicalDecl();
+    if (templateDecl->isThisDeclarationADefinition()
+        && m_Seen.insert(templateDecl).second) {
+      m_Templates.push_back(std::make_pair(templateDecl, size_t(0)));
+      indexTemplate(m_Templates.size() - 1);
+    }
+    break;
+  }
+  case Decl::Typedef:
+    m_Entries[kTypedefs].push_back(
+      Entry{cast<TypedefDecl>(decl)->getQualifiedNameAsString(), decl});
+    break;
+  case Decl::Var:
+    if (ctx.Globals)
+      m_Entries[kGlobals].push_back(
+        Entry{cast<VarDecl>(decl)->getQualifiedNameAsString(), decl});
+    break;
+  case Decl::Enum:
+    if (ctx.Globals) {
+      // Timur.Pocheptsov: it's not really clear, if I should really check this:
+      const EnumDecl* enumDecl = cast<EnumDecl>(decl);
+      if (enumDecl->isComplete() && (enumDecl = enumDecl->getDefinition())) {
+        for (const EnumConstantDecl* enumerator : enumDecl->enumerators())
+          m_Entries[kGlobals].push_back(
+            Entry{enumerator->getQualifiedNameAsString(), enumerator});
+      }
+    }
+    break;
+  case Decl::Block:
+    indexDecls(cast<BlockDecl>(decl),
+               Context{nullptr, nullptr, nullptr, ctx.Scope, false, false});
+    break;
+  default:
+    //Local classes and typedefs; the body does not change once parsed.
+    if (const FunctionDecl* const funcDecl = dyn_cast<FunctionDecl>(decl))
+      indexDecls(funcDecl,
+                 Context{nullptr, nullptr, nullptr, ctx.Scope, false, false});
+    break;
+  }
+}
+
+//______________________________________________________________________________
+void DisplayIndex::indexClass(const Decl* decl, const Context& ctx)
+{
+  const CXXRecordDecl* classDecl = cast<CXXRecordDecl>(decl);
+  const bool isDefinition = classDecl->isThisDeclarationADefinition();
+
+  // The listing shows the definition of a class once, or else each of
+  // its forward declarations.
+  if (classDecl->hasDefinition())
+    classDecl = classDecl->getDefinition();
+  if ((classDecl->hasDefinition() || !classDecl->isImplicit())
+      && m_Seen.insert(classDecl).second) {
+    std::string name;
+    AppendClassName(classDecl, name);
+    m_Entries[kClasses].push_back(Entry{name, classDecl});
+  }
+
+  // Now we have to check nested scopes for class declarations.
+  if (isDefinition) {
+    Context nested(ctx);
+    nested.Namespaces = false;
+    nested.Globals = false;
+    addContext(cast<CXXRecordDecl>(decl), nested);
+  }
+}
+
 //______________________________________________________________________________
 void DisplayClasses(llvm::raw_ostream& stream, const Interpreter* interpreter,
                     bool verbose)
 {
   assert(interpreter != 0 && "DisplayClasses, 'interpreter' parameter is null");
 
-  ClassPrinter printer(stream, interpreter);
+  DisplayIndex index(*interpreter);
+  DisplayClasses(stream, index, verbose, DisplayFilter());
+}
+
+//______________________________________________________________________________
+void DisplayClasses(llvm::raw_ostream& stream, DisplayIndex& index,
+                    bool verbose, const DisplayFilter& filter)
+{
+  ClassPrinter printer(stream, &index.getInterpreter());
   printer.SetVerbose(verbose);
-  printer.DisplayAllClasses();
+  printer.DisplayAllClasses(index, filter);
 }
 
 //______________________________________________________________________________
@@ -1537,26 +1645,29 @@ void DisplayClass(llvm::raw_ostream& stream, const Interpreter* interpreter,
   while (std::isspace(*className))
     ++className;
 
-  ClassPrinter printer(stream, interpreter);
-
   if (*className) {
+    ClassPrinter printer(stream, interpreter);
     printer.SetVerbose(verbose);
     printer.DisplayClass(className);
-  } else {
-    printer.SetVerbose(true);//?
-    printer.DisplayAllClasses();
-  }
+  } else
+    DisplayClasses(stream, interpreter, true);//?
 }
 
 //______________________________________________________________________________
 void DisplayNamespaces(llvm::raw_ostream &stream, const Interpreter *interpreter)
 {
   assert(interpreter != 0 && "DisplayNamespaces, parameter 'interpreter' is null");
-  Interpreter::PushTransactionRAII RAII(const_cast<Interpreter*>(interpreter));
 
-  NamespacePrinter printer(stream, interpreter);
-  Interpreter::PushTransactionRAII guard(const_cast<Interpreter *>(interpreter));
-  printer.Print();
+  DisplayIndex index(*interpreter);
+  DisplayNamespaces(stream, index, DisplayFilter());
+}
+
+//______________________________________________________________________________
+void DisplayNamespaces(llvm::raw_ostream &stream, DisplayIndex &index,
+                       const DisplayFilter &filter)
+{
+  NamespacePrinter printer(stream, &index.getInterpreter());
+  printer.Print(index, filter);
 }
 
 //______________________________________________________________________________
@@ -1564,10 +1675,16 @@ void DisplayGlobals(llvm::raw_ostream& stream, const Interpreter* interpreter)
 {
   assert(interpreter != 0 && "DisplayGlobals, 'interpreter' parameter is null");
 
-  GlobalsPrinter printer(stream, interpreter);
-  // Could trigger deserialization of decls.
-  Interpreter::PushTransactionRAII RAII(const_cast<Interpreter*>(interpreter));
-  printer.DisplayGlobals();
+  DisplayIndex index(*interpreter);
+  DisplayGlobals(stream, index, DisplayFilter());
+}
+
+//______________________________________________________________________________
+void DisplayGlobals(llvm::raw_ostream& stream, DisplayIndex& index,
+                    const DisplayFilter& filter)
+{
+  GlobalsPrinter printer(stream, &index.getInterpreter());
+  printer.DisplayGlobals(index, filter);
 }
 
 //______________________________________________________________________________
@@ -1587,10 +1704,16 @@ void DisplayTypedefs(llvm::raw_ostream &stream, const Interpreter *interpreter)
 {
    assert(interpreter != 0 && "DisplayTypedefs, parameter 'interpreter' is null");
 
-   TypedefPrinter printer(stream, interpreter);
-   // Could trigger deserialization of decls.
-   Interpreter::PushTransactionRAII RAII(const_cast<Interpreter*>(interpreter));
-   printer.DisplayTypedefs();
+   DisplayIndex index(*interpreter);
+   DisplayTypedefs(stream, index, DisplayFilter());
+}
+
+//______________________________________________________________________________
+void DisplayTypedefs(llvm::raw_ostream &stream, DisplayIndex &index,
+                     const DisplayFilter &filter)
+{
+   TypedefPrinter printer(stream, &index.getInterpreter());
+   printer.DisplayTypedefs(index, filter);
 }
 
 //______________________________________________________________________________
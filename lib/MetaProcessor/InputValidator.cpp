@@ -14,11 +14,6 @@
 #include <algorithm>
 
 namespace cling {
-  bool InputValidator::inBlockComment() const {
-    return std::find(m_ParenStack.begin(), m_ParenStack.end(), tok::slash)
-             != m_ParenStack.end();
-  }
-
   static bool findBlockCommentEnd(const char* startPos, const char* endPos) {
     // Find '*/', searching from endPos to startPos.
     // While probably not standard compliant, it should work fine for the indent
@@ -51,26 +46,63 @@ namespace cling {
     queue.pop_back();
   }
 
+  ///\brief Skips the rest of a literal quoted by Quote, from after the
+  /// opening quote or from the start of the line that continues it.
+  ///\param[out] Spliced - whether the line ends with a backslash, within the
+  /// literal.
+  ///\returns false if the end of the line is reached before the closing quote.
+  ///
+  static bool skipQuoted(const char*& curPos, char Quote, bool& Spliced) {
+    Spliced = false;
+    while (*curPos) {
+      if (*curPos == '\\') {
+        // Skip escaped quotes, but do not skip the end of the line.
+        if (!*++curPos) {
+          Spliced = true;
+          return false;
+        }
+      } else if (*curPos == Quote) {
+        ++curPos;
+        return true;
+      }
+      ++curPos;
+    }
+    return false;
+  }
+
   InputValidator::ValidationResult
-  InputValidator::validate(llvm::StringRef line) {
+  InputValidator::lexLine(const char* curPos) {
     ValidationResult Res = kComplete;
 
     Token Tok;
-    const char* curPos = line.data();
-    bool multilineComment = inBlockComment();
+    bool& multilineComment = m_InBlockComment;
     int commentTok = multilineComment ? tok::asterik : tok::slash;
     int lastKind;
 
+    if (!m_ParenStack.empty() && (m_ParenStack.back() == tok::stringlit
+                                  || m_ParenStack.back() == tok::charlit)) {
+      // The previous line ended with a backslash within a literal: resume it.
+      const char Quote = m_ParenStack.back() == tok::stringlit ? '"' : '\'';
+      bool Spliced;
+      if (!skipQuoted(curPos, Quote, Spliced)) {
+        if (Spliced)
+          return kIncomplete;
+        m_ParenStack.pop_back();
+        return m_ParenStack.empty() ? kComplete : kIncomplete;
+      }
+      m_ParenStack.pop_back();
+    }
+
     if (!multilineComment && m_ParenStack.empty()) {
       // Only check for 'template' if we're not already indented
       MetaLexer Lex(curPos, true);
       Lex.Lex(Tok);
-      curPos = Lex.getLocation();
       if (Tok.is(tok::ident)) {
+        curPos = Lex.getLocation();
         if (Tok.getIdent()=="template")
           m_ParenStack.push_back(tok::greater);
-      } else
-        curPos -= Tok.getLength(); // Rewind buffer for LexPunctuatorAndAdvance
+      }
+      // Otherwise LexPunctuatorAndAdvance starts over, from the first token.
     }
 
     do {
@@ -118,8 +150,10 @@ namespace cling {
         // we gonna have to wait for another asterik first
         if (multilineComment) {
           if (kind == tok::eof) {
-            if (findBlockCommentEnd(prevStart, curPos))
+            if (findBlockCommentEnd(prevStart, curPos)) {
+              multilineComment = false;
               unwindTokens(m_ParenStack, tok::slash);
+            }
 
             // eof, were done anyway
             break;
@@ -181,7 +215,14 @@ namespace cling {
             m_ParenStack.pop_back();
         }
         else if (kind >= (int)tok::stringlit && kind <= (int)tok::charlit) {
-          MetaLexer::LexQuotedStringAndAdvance(curPos, Tok);
+          bool Spliced;
+          if (!skipQuoted(curPos, curPos[-1], Spliced)) {
+            // Remember a literal continued on the next line; an unterminated
+            // one is for the parser to diagnose.
+            if (Spliced && !multilineComment)
+              m_ParenStack.push_back(kind);
+            break;
+          }
         }
       }
     } while (Tok.isNot(tok::eof));
@@ -190,16 +231,37 @@ namespace cling {
     if (Continue || (!m_ParenStack.empty() && Res != kMismatch))
       Res = kIncomplete;
 
-    if (!m_Input.empty()) {
-      if (!m_ParenStack.empty() && (m_ParenStack.back() == tok::stringlit
-                                    || m_ParenStack.back() == tok::charlit))
-        m_Input.append("\\n");
-      else
-        m_Input.append("\n");
-    }
+    return Res;
+  }
+
+  void InputValidator::appendInput(llvm::StringRef input) {
+    if (!m_Input.empty())
+      m_Input.append("\n");
+    m_Input.append(input);
+  }
+
+  InputValidator::ValidationResult
+  InputValidator::validate(llvm::StringRef line) {
+    const ValidationResult Res = lexLine(line.data());
+    appendInput(line);
+    return Res;
+  }
 
-    m_Input.append(line);
+  InputValidator::ValidationResult
+  InputValidator::validateBuffer(llvm::StringRef buffer) {
+    ValidationResult Res = kComplete;
+    // The lexer needs each line null terminated; copy them one at a time.
+    std::string line;
+    llvm::StringRef rest = buffer;
+    do {
+      const size_t eol = rest.find('\n');
+      line.assign(rest.data(), std::min(eol, rest.size()));
+      rest = eol == llvm::StringRef::npos ? llvm::StringRef()
+                                          : rest.drop_front(eol + 1);
+      Res = lexLine(line.c_str());
+    } while (Res != kMismatch && !rest.empty());
 
+    appendInput(buffer);
     return Res;
   }
 
@@ -211,5 +273,6 @@ namespace cling {
       std::string().swap(m_Input);
 
     std::deque<int>().swap(m_ParenStack);
+    m_InBlockComment = false;
   }
 } // end namespace cling
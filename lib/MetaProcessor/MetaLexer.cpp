@@ -173,8 +173,8 @@ namespace cling {
    while (true) {
       if (*curPos == '\\'){
         // We don't care what it is. If it's \" or \' it would signal a fake
-        // end of string - so skip.
-        curPos += 2;
+        // end of string - so skip, but not past the end of the line.
+        curPos += curPos[1] ? 2 : 1;
         continue;
       }
 
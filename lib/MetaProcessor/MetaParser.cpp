@@ -22,6 +22,8 @@
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/Path.h"
 
+#include <cctype>
+
 namespace cling {
 
   MetaParser::MetaParser(MetaSema &Actions, llvm::StringRef Line) :
@@ -126,7 +128,12 @@ namespace cling {
       || isTypedefCommand()
       || isShellCommand(actionResult, resultValue) || isstoreStateCommand()
       || iscompareStateCommand() || isstatsCommand() || isundoCommand()
-      || isRedirectCommand(actionResult) || istraceCommand();
+      || isRedirectCommand(actionResult) || istraceCommand()
+      || istimingCommand() || isexportCommand(actionResult)
+      || isremarksCommand(actionResult) || ispgoCommand(actionResult)
+      || isprofileCommand(actionResult)
+      || isjournalCommand(actionResult) || isrestoreCommand(actionResult)
+      || isreloadCommand(actionResult) || istryCommand(actionResult);
   }
 
   // L := 'L' FilePath Comment
@@ -172,8 +179,9 @@ namespace cling {
     return result;
   }
 
-  // >RedirectCommand := '>' FilePath
+  // >RedirectCommand := '>' FilePath [RedirectOption]*
   // FilePath := AnyString
+  // RedirectOption := '--buffered' | '--gzip'
   // AnyString := .*^(' ' | '\t')
   bool MetaParser::isRedirectCommand(MetaSema::ActionResult& actionResult) {
 
@@ -232,10 +240,27 @@ namespace cling {
         }
       }
       std::string EnvExpand;
+      unsigned flags = 0;
       if (!lookAhead(1).is(tok::eof) && !(stream & MetaProcessor::kSTDSTRM)) {
         consumeAnyStringToken(tok::eof);
         if (getCurTok().is(tok::raw_ident)) {
           EnvExpand = getCurTok().getIdent();
+          // The options follow the path.
+          for (;;) {
+            llvm::StringRef Path = llvm::StringRef(EnvExpand).rtrim();
+            const size_t Space = Path.find_last_of(" \t");
+            if (Space == llvm::StringRef::npos)
+              break;
+            const llvm::StringRef Option = Path.substr(Space + 1);
+            if (Option == "--buffered")
+              flags |= MetaProcessor::kRedirectBuffered;
+            else if (Option == "--gzip")
+              flags |= MetaProcessor::kRedirectBuffered
+                       | MetaProcessor::kRedirectCompressed;
+            else
+              break;
+            EnvExpand.resize(Path.substr(0, Space).rtrim().size());
+          }
           // Quoted path, no expansion and strip quotes
           if (EnvExpand.size() > 3 && EnvExpand.front() == '"' &&
               EnvExpand.back() == '"') {
@@ -255,7 +280,8 @@ namespace cling {
       actionResult =
           m_Actions.actOnRedirectCommand(file/*file*/,
                                          stream/*which stream to redirect*/,
-                                         append/*append mode*/);
+                                         append/*append mode*/,
+                                         flags/*buffered, compressed*/);
       return true;
     }
     return false;
@@ -381,6 +407,10 @@ namespace cling {
           consumeAnyStringToken(tok::eof);
           const Token& lastStringToken = getCurTok();
           if (lastStringToken.is(tok::raw_ident)
+              && lastStringToken.getIdent().equals("auto")) {
+            actionResult = m_Actions.actOnOAutoCommand();
+            return true;
+          } else if (lastStringToken.is(tok::raw_ident)
               && lastStringToken.getLength()) {
             int level = 0;
             if (!lastStringToken.getIdent().getAsInteger(10, level)
@@ -523,6 +553,171 @@ namespace cling {
     return false;
   }
 
+  bool MetaParser::istimingCommand() {
+    if (getCurTok().is(tok::ident) &&
+        getCurTok().getIdent().equals("timing")) {
+      MetaSema::SwitchMode mode = MetaSema::kToggle;
+      consumeToken();
+      skipWhitespace();
+      const Token& next = getCurTok();
+      if (next.is(tok::constant))
+        mode = (MetaSema::SwitchMode)next.getConstantAsBool();
+      else if (next.is(tok::ident) && next.getIdent().equals("on"))
+        mode = MetaSema::kOn;
+      else if (next.is(tok::ident) && next.getIdent().equals("off"))
+        mode = MetaSema::kOff;
+      m_Actions.actOntimingCommand(mode);
+      return true;
+    }
+    return false;
+  }
+
+  // ExportCommand := ('export' | 'package') ['-O'Constant] FilePath
+  bool MetaParser::isexportCommand(MetaSema::ActionResult& actionResult) {
+    if (getCurTok().is(tok::ident) &&
+        (getCurTok().getIdent().equals("export") ||
+         getCurTok().getIdent().equals("package"))) {
+      const bool package = getCurTok().getIdent().equals("package");
+      consumeAnyStringToken(tok::eof);
+      if (!getCurTok().is(tok::raw_ident))
+        return false;
+      llvm::StringRef path = getCurTok().getIdent().trim();
+      int optLevel = -1;
+      if (path.startswith("-O")) {
+        std::pair<llvm::StringRef, llvm::StringRef> optAndPath
+          = path.split(' ');
+        if (optAndPath.first.substr(2).getAsInteger(10, optLevel)
+            || optLevel < 0)
+          return false;
+        path = optAndPath.second.trim();
+      }
+      if (path.empty())
+        return false;
+      actionResult = package ? m_Actions.actOnpackageCommand(path, optLevel)
+                             : m_Actions.actOnexportCommand(path, optLevel);
+      return true;
+    }
+    return false;
+  }
+
+  // RemarksCommand := 'remarks' ['missed' | 'passed' | 'all' | 'off']
+  bool MetaParser::isremarksCommand(MetaSema::ActionResult& actionResult) {
+    if (getCurTok().is(tok::ident) &&
+        getCurTok().getIdent().equals("remarks")) {
+      consumeToken();
+      skipWhitespace();
+      llvm::StringRef what = "all";
+      if (getCurTok().is(tok::ident))
+        what = getCurTok().getIdent();
+      else if (!getCurTok().is(tok::eof))
+        return false;
+      actionResult = m_Actions.actOnremarksCommand(what);
+      return true;
+    }
+    return false;
+  }
+
+  // PgoCommand := 'pgo' ['on' | 'off' | 'optimize']
+  bool MetaParser::ispgoCommand(MetaSema::ActionResult& actionResult) {
+    if (getCurTok().is(tok::ident) &&
+        getCurTok().getIdent().equals("pgo")) {
+      consumeToken();
+      skipWhitespace();
+      llvm::StringRef what = "optimize";
+      if (getCurTok().is(tok::ident))
+        what = getCurTok().getIdent();
+      else if (!getCurTok().is(tok::eof))
+        return false;
+      actionResult = m_Actions.actOnpgoCommand(what);
+      return true;
+    }
+    return false;
+  }
+
+  // ProfileCommand := 'profile' ['start' | 'stop' | 'report']
+  bool MetaParser::isprofileCommand(MetaSema::ActionResult& actionResult) {
+    if (getCurTok().is(tok::ident) &&
+        getCurTok().getIdent().equals("profile")) {
+      consumeToken();
+      skipWhitespace();
+      llvm::StringRef what = "report";
+      if (getCurTok().is(tok::ident))
+        what = getCurTok().getIdent();
+      else if (!getCurTok().is(tok::eof))
+        return false;
+      actionResult = m_Actions.actOnprofileCommand(what);
+      return true;
+    }
+    return false;
+  }
+
+  // JournalCommand := 'journal' [FilePath]
+  bool MetaParser::isjournalCommand(MetaSema::ActionResult& actionResult) {
+    if (getCurTok().is(tok::ident) &&
+        getCurTok().getIdent().equals("journal")) {
+      consumeAnyStringToken(tok::eof);
+      llvm::StringRef path;
+      if (getCurTok().is(tok::raw_ident))
+        path = getCurTok().getIdent().trim();
+      actionResult = m_Actions.actOnjournalCommand(path);
+      return true;
+    }
+    return false;
+  }
+
+  // RestoreCommand := 'restore' ['-declarations'] [FilePath]
+  bool MetaParser::isrestoreCommand(MetaSema::ActionResult& actionResult) {
+    if (getCurTok().is(tok::ident) &&
+        getCurTok().getIdent().equals("restore")) {
+      consumeAnyStringToken(tok::eof);
+      llvm::StringRef path;
+      if (getCurTok().is(tok::raw_ident))
+        path = getCurTok().getIdent().trim();
+      bool declarationsOnly = false;
+      if (path.startswith("-")) {
+        std::pair<llvm::StringRef, llvm::StringRef> optionAndPath
+          = path.split(' ');
+        if (!optionAndPath.first.equals("-declarations"))
+          return false;
+        declarationsOnly = true;
+        path = optionAndPath.second.trim();
+        if (path.empty())
+          return false;
+      }
+      actionResult = m_Actions.actOnrestoreCommand(path, declarationsOnly);
+      return true;
+    }
+    return false;
+  }
+
+  // ReloadCommand := 'reload' FilePath
+  bool MetaParser::isreloadCommand(MetaSema::ActionResult& actionResult) {
+    if (getCurTok().is(tok::ident) &&
+        getCurTok().getIdent().equals("reload")) {
+      consumeAnyStringToken(tok::eof);
+      if (getCurTok().is(tok::raw_ident)) {
+        actionResult
+          = m_Actions.actOnreloadCommand(getCurTok().getIdent().trim());
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // TryCommand := 'try' ['adopt' | 'discard' | AnyString]
+  bool MetaParser::istryCommand(MetaSema::ActionResult& actionResult) {
+    if (getCurTok().is(tok::ident) &&
+        getCurTok().getIdent().equals("try")) {
+      consumeAnyStringToken(tok::eof);
+      llvm::StringRef what;
+      if (getCurTok().is(tok::raw_ident))
+        what = getCurTok().getIdent().trim();
+      actionResult = m_Actions.actOntryCommand(what);
+      return true;
+    }
+    return false;
+  }
+
   bool MetaParser::isundoCommand() {
     if (getCurTok().is(tok::ident) &&
         getCurTok().getIdent().equals("undo")) {
@@ -591,7 +786,12 @@ namespace cling {
         return true;
       }
       else if (Tok.getIdent().equals("Class")) {
-        m_Actions.actOnClassCommand();
+        consumeAnyStringToken(tok::eof);
+        const Token& NextTok = getCurTok();
+        llvm::StringRef options;
+        if (NextTok.is(tok::raw_ident))
+          options = NextTok.getIdent();
+        m_Actions.actOnClassCommand(options);
         return true;
       }
     }
@@ -603,9 +803,14 @@ namespace cling {
     if (Tok.is(tok::ident)) {
       if (Tok.getIdent().equals("namespace")) {
         consumeAnyStringToken(tok::eof);
-        if (getCurTok().is(tok::raw_ident))
-          return false;
-        m_Actions.actOnNamespaceCommand();
+        llvm::StringRef options;
+        if (getCurTok().is(tok::raw_ident)) {
+          options = getCurTok().getIdent();
+          // Only the listing options, not a namespace definition.
+          if (!options.startswith("-"))
+            return false;
+        }
+        m_Actions.actOnNamespaceCommand(options);
         return true;
       }
     }
@@ -614,11 +819,16 @@ namespace cling {
 
   bool MetaParser::isgCommand() {
     if (getCurTok().is(tok::ident) && getCurTok().getIdent().equals("g")) {
-      consumeToken();
-      skipWhitespace();
+      consumeAnyStringToken(tok::eof);
       llvm::StringRef varName;
-      if (getCurTok().is(tok::ident))
+      if (getCurTok().is(tok::raw_ident)) {
         varName = getCurTok().getIdent();
+        // The listing options, or the identifier up front.
+        if (!varName.startswith("-"))
+          varName = varName.take_while([](char C) {
+            return std::isalnum((unsigned char)C) || C == '_';
+          });
+      }
       m_Actions.actOngCommand(varName);
       return true;
     }
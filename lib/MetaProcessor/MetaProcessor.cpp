@@ -8,14 +8,20 @@
 //------------------------------------------------------------------------------
 
 #include "cling/MetaProcessor/MetaProcessor.h"
+#include "BufferedSink.h"
+#include "Speculation.h"
 #include "cling/MetaProcessor/InputValidator.h"
 #include "cling/MetaProcessor/MetaParser.h"
 #include "cling/MetaProcessor/MetaSema.h"
 #include "cling/MetaProcessor/Display.h"
 
+#include "cling/Interpreter/ExecutionCounters.h"
 #include "cling/Interpreter/Interpreter.h"
+#include "cling/Interpreter/TimingStats.h"
 #include "cling/Interpreter/Value.h"
 #include "cling/Utils/Output.h"
+#include "cling/Utils/Platform.h"
+#include "cling/Utils/SourceNormalization.h"
 
 #include "clang/Basic/FileManager.h"
 #include "clang/Basic/TargetInfo.h"
@@ -23,8 +29,15 @@
 #include "clang/Lex/Preprocessor.h"
 
 #include "llvm/BinaryFormat/Magic.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
 
+#include <algorithm>
+#include <chrono>
 #include <fcntl.h>
 #include <fstream>
 #include <cstdlib>
@@ -42,6 +55,68 @@
 
 using namespace clang;
 
+namespace {
+  ///\brief Measures the processing of one input for .timing.
+  class InputTiming {
+    typedef std::chrono::steady_clock Clock;
+
+    const cling::Interpreter& m_Interp;
+    Clock::time_point m_Start;
+    uint64_t m_StartCPU;
+    long m_StartPeakRSS;
+    cling::TimingStats m_StartStats;
+    cling::ExecutionCounters m_StartCounters;
+
+    static uint64_t getCPUNanoseconds() {
+      llvm::sys::TimePoint<> Elapsed;
+      std::chrono::nanoseconds User, Sys;
+      llvm::sys::Process::GetTimeUsage(Elapsed, User, Sys);
+      return (User + Sys).count();
+    }
+
+  public:
+    InputTiming(const cling::Interpreter& Interp):
+      m_Interp(Interp), m_StartPeakRSS(cling::utils::GetPeakRSS()),
+      m_StartStats(Interp.getTimingStats()) {
+      if (const cling::ExecutionCounters* C = Interp.getExecutionCounters())
+        m_StartCounters = *C;
+      m_StartCPU = getCPUNanoseconds();
+      m_Start = Clock::now();
+    }
+
+    void report(llvm::raw_ostream& Out) const {
+      const uint64_t Wall
+        = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - m_Start).count();
+      const uint64_t CPU = getCPUNanoseconds() - m_StartCPU;
+      const long PeakRSS = cling::utils::GetPeakRSS();
+      cling::ExecutionCounters Counters;
+      if (const cling::ExecutionCounters* C = m_Interp.getExecutionCounters())
+        Counters = *C - m_StartCounters;
+
+      const cling::TimingStats::Phase Exec = cling::TimingStats::kUserCode;
+      const uint64_t ExecWall = std::min(Wall,
+        m_Interp.getTimingStats().getNanoseconds(Exec)
+        - m_StartStats.getNanoseconds(Exec));
+      const uint64_t ExecCPU = std::min(CPU, Counters.getCPUNanoseconds());
+      Out << llvm::format("wall %10.3f ms  (compile %10.3f ms, "
+                          "execute %10.3f ms)\n",
+                          Wall / 1e6, (Wall - ExecWall) / 1e6, ExecWall / 1e6)
+          << llvm::format("cpu  %10.3f ms  (compile %10.3f ms, "
+                          "execute %10.3f ms)\n",
+                          CPU / 1e6, (CPU - ExecCPU) / 1e6, ExecCPU / 1e6);
+      if (PeakRSS >= 0 && m_StartPeakRSS >= 0)
+        Out << "peak RSS +" << (PeakRSS - m_StartPeakRSS) << " kB\n";
+      for (unsigned I = 0; I < cling::ExecutionCounters::kNumEvents; ++I) {
+        const auto E = cling::ExecutionCounters::Event(I);
+        if (Counters.hasEvent(E))
+          Out << cling::ExecutionCounters::getEventName(E) << ' '
+              << Counters.getEvent(E) << '\n';
+      }
+    }
+  };
+} // unnamed namespace
+
 namespace cling {
 
   class MetaProcessor::RedirectOutput {
@@ -62,8 +137,11 @@ namespace cling {
       int FD;
       MetaProcessor::RedirectionScope Scope;
       bool Close;
+      ///\brief Owns FD for a buffered redirection.
+      std::unique_ptr<BufferedSink> Sink;
 
-      Redirect(std::string file, bool append, RedirectionScope S, int* Baks) :
+      Redirect(std::string file, bool append, RedirectionScope S, int* Baks,
+               unsigned Flags) :
         FD(-1), Scope(S), Close(false) {
         if (S & kSTDSTRM) {
           // Remove the flag from Scope, we don't need it anymore
@@ -89,9 +167,15 @@ namespace cling {
           ::perror("Redirect::open");
           return;
         }
-        Close = true;
         if (append)
           ::lseek(FD, 0, SEEK_END);
+        if (Flags & (kRedirectBuffered | kRedirectCompressed)) {
+          // Closes FD on failure.
+          Sink = BufferedSink::create(FD, Flags & kRedirectCompressed);
+          FD = Sink ? Sink->getFD() : -1;
+          return;
+        }
+        Close = true;
       }
       ~Redirect() {
         if (Close)
@@ -140,6 +224,7 @@ namespace cling {
       assert((newfd == STDOUT_FILENO || newfd == STDERR_FILENO) && "Not std FD");
       assert(oldfd == m_Bak[newfd == STDERR_FILENO] && "Not backup FD");
       if (oldfd != kInvalidFD) {
+        ::fflush(newfd == STDOUT_FILENO ? stdout : stderr);
         dup2(oldfd, newfd, "RedirectOutput::close");
         ::close(oldfd);
         oldfd = kInvalidFD;
@@ -150,6 +235,8 @@ namespace cling {
                 int &bakFD) {
       // If no backup, we have never redirected the file, so nothing to restore
       if (bakFD != kInvalidFD) {
+        // What F buffers belongs to the current redirection.
+        ::fflush(F);
         // Find the last redirect for the scope, and restore redirection to it
         for (RedirectStack::const_reverse_iterator it = m_Stack.rbegin(),
                                                    e = m_Stack.rend();
@@ -162,12 +249,18 @@ namespace cling {
         }
 
         // No redirection for this scope, restore to backup
-        fflush(F);
         close(bakFD, FD);
       }
       return kInvalidFD;
     }
 
+    bool isBuffered(int FD) const {
+      for (const std::unique_ptr<Redirect>& R : m_Stack)
+        if (R->FD == FD && R->Sink)
+          return true;
+      return false;
+    }
+
   public:
     RedirectOutput() : m_CurStdOut(kInvalidFD),
       m_TTY(::isatty(STDOUT_FILENO) ? 1 : 0) {
@@ -195,7 +288,10 @@ namespace cling {
     }
 
     void redirect(llvm::StringRef file, bool apnd,
-                  MetaProcessor::RedirectionScope scope) {
+                  MetaProcessor::RedirectionScope scope, unsigned flags) {
+      // The redirections removed, alive until stdout and stderr are off
+      // their pipes.
+      RedirectStack Removed;
       if (file.empty()) {
         // Unredirection, remove last redirection state(s) for given scope(s)
         if (m_Stack.empty()) {
@@ -230,11 +326,14 @@ namespace cling {
         }
         // std::vector::erase invalidates iterators at or after the point of
         // the erase, so if we reverse iterate on Remove everything is fine
-        for (auto it = Remove.rbegin(), e = Remove.rend(); it != e; ++it)
+        for (auto it = Remove.rbegin(), e = Remove.rend(); it != e; ++it) {
+          Removed.push_back(std::move(**it));
           m_Stack.erase(*it);
+        }
       } else {
         // Add new redirection state
-        if (push(new Redirect(file.str(), apnd, scope, m_Bak)) != kInvalidFD) {
+        if (push(new Redirect(file.str(), apnd, scope, m_Bak, flags))
+            != kInvalidFD) {
           // Save a backup for the scope(s), if not already done
           if (scope & MetaProcessor::kSTDOUT)
             dupOnce(STDOUT_FILENO, m_Bak[0]);
@@ -249,6 +348,14 @@ namespace cling {
             restore(STDOUT_FILENO, stdout, MetaProcessor::kSTDOUT, m_Bak[0]);
       if (scope & MetaProcessor::kSTDERR)
         restore(STDERR_FILENO, stderr, MetaProcessor::kSTDERR, m_Bak[1]);
+
+#ifndef _WIN32
+      // A terminal's line buffering would cost a write into the pipe per
+      // line.
+      if (m_TTY && scope & MetaProcessor::kSTDOUT)
+        ::setvbuf(stdout, NULL, isBuffered(m_CurStdOut) ? _IOFBF : _IOLBF,
+                  BUFSIZ);
+#endif
     }
 
     void resetStdOut(bool toBackup = false) {
@@ -290,6 +397,8 @@ namespace cling {
   }
 
   MetaProcessor::~MetaProcessor() {
+    // An adopted session ends the process, once the redirections are done.
+    m_Speculation.reset();
   }
 
   int MetaProcessor::process(llvm::StringRef input_line,
@@ -299,6 +408,8 @@ namespace cling {
     if (result)
       *result = Value();
     compRes = Interpreter::kSuccess;
+    if (m_Speculation && m_Speculation->isAdopted())
+      return m_Speculation->forward(input_line, compRes);
     int expectedIndent = m_InputValidator->getExpectedIndent();
 
     if (expectedIndent)
@@ -326,8 +437,9 @@ namespace cling {
     }
 
     // Check if the current statement is now complete. If not, return to
-    // prompt for more.
-    if (m_InputValidator->validate(input_line) == InputValidator::kIncomplete) {
+    // prompt for more. Notebook cells come with many lines at once.
+    if (m_InputValidator->validateBuffer(input_line)
+        == InputValidator::kIncomplete) {
       compRes = Interpreter::kMoreInputExpected;
       return m_InputValidator->getExpectedIndent();
     }
@@ -335,23 +447,97 @@ namespace cling {
     //  We have a complete statement, compile and execute it.
     std::string input;
     m_InputValidator->reset(&input);
+    if (m_TryNext) {
+      m_TryNext = false;
+      compRes = m_Speculation->run(input);
+      return 0;
+    }
     // if (m_Options.RawInput)
     //   compResLocal = m_Interp.declare(input);
     // else
+    std::unique_ptr<InputTiming> Timing;
+    if (m_ReportTiming)
+      Timing.reset(new InputTiming(m_Interp));
     compRes = m_Interp.process(input, result, /*Transaction*/ nullptr,
                                disableValuePrinting);
+    if (Timing)
+      Timing->report(getOuts());
 
     return 0;
   }
 
+  void MetaProcessor::enableTimingReport(bool Enable) {
+    m_ReportTiming = Enable;
+    m_Interp.enableExecutionCounters(Enable);
+  }
+
+  bool MetaProcessor::beginTry(llvm::StringRef Code,
+                               Interpreter::CompilationResult& compRes) {
+    compRes = Interpreter::kSuccess;
+    if (!Speculation::isSupported())
+      return false;
+    if (!m_Speculation)
+      m_Speculation.reset(new Speculation(*this));
+    else if (m_Speculation->isPending())
+      m_Speculation->discard();
+    m_TryNext = true;
+    if (Code.empty()
+        || m_InputValidator->validateBuffer(Code)
+           == InputValidator::kIncomplete)
+      return true;
+    std::string input;
+    m_InputValidator->reset(&input);
+    m_TryNext = false;
+    compRes = m_Speculation->run(input);
+    return true;
+  }
+
+  bool MetaProcessor::adoptTry() {
+    if (!m_Speculation || !m_Speculation->isPending())
+      return false;
+    m_Speculation->adopt();
+    return true;
+  }
+
+  bool MetaProcessor::discardTry() {
+    if (!m_Speculation || !m_Speculation->isPending())
+      return false;
+    m_Speculation->discard();
+    return true;
+  }
+
   void MetaProcessor::cancelContinuation() const {
+    if (m_Speculation && m_Speculation->isAdopted())
+      return m_Speculation->cancelContinuation();
+    m_TryNext = false;
     m_InputValidator->reset();
   }
 
   int MetaProcessor::getExpectedIndent() const {
+    if (m_Speculation && m_Speculation->isAdopted())
+      return m_Speculation->getExpectedIndent();
     return m_InputValidator->getExpectedIndent();
   }
 
+  ///\brief Files at least this large are read in chunks if possible.
+  static const uint64_t kChunkedInputSize = 8 * 1024 * 1024;
+
+  ///\brief The size from which a chunk ends at the next declaration.
+  static const size_t kInputChunkSize = 1024 * 1024;
+
+  ///\brief The path of a file as it is spelled in a #line directive.
+  static std::string getLineDirectivePath(llvm::StringRef filename) {
+    std::string path(filename.str());
+#ifdef _WIN32
+    std::size_t p = 0;
+    while ((p = path.find('\\', p)) != std::string::npos) {
+      path.insert(p, "\\");
+      p += 2;
+    }
+#endif
+    return path;
+  }
+
   static Interpreter::CompilationResult reportIOErr(llvm::StringRef File,
                                                     const char* What) {
     cling::errs() << "Error in cling::MetaProcessor: "
@@ -395,6 +581,21 @@ namespace cling {
       }
     }
 
+    // Large files are processed in chunks if they need no wrapping, e.g.
+    // generated tables and functions: each chunk becomes a transaction and a
+    // module of its own, instead of one for the whole file.
+    uint64_t fileSize = 0;
+    if (posOpenCurly == (size_t)-1 && !lineByLine
+        && !llvm::sys::fs::file_size(filename, fileSize)
+        && fileSize >= kChunkedInputSize) {
+      auto buffer = llvm::MemoryBuffer::getFile(filename);
+      if (!buffer)
+        return reportIOErr(filename, "open");
+      Interpreter::CompilationResult ret;
+      if (readInputInChunks(filename, (*buffer)->getBuffer(), result, ret))
+        return ret;
+    }
+
     // Windows requires std::ifstream::binary to properly handle
     // CRLF and LF line endings
     std::ifstream in(filename.str().c_str(), std::ifstream::binary);
@@ -475,15 +676,7 @@ namespace cling {
     if (topmost)
       m_TopExecutingFile = m_CurrentlyExecutingFile;
 
-    std::string path(filename.str());
-#ifdef _WIN32
-    std::size_t p = 0;
-    while ((p = path.find('\\', p)) != std::string::npos) {
-      path.insert(p, "\\");
-      p += 2;
-    }
-#endif
-    content.insert(0, "#line 2 \"" + path + "\" \n");
+    content.insert(0, "#line 2 \"" + getLineDirectivePath(filename) + "\" \n");
     // We don't want to value print the results of a unnamed macro.
     if (content.back() != ';')
       content.append(";");
@@ -512,17 +705,71 @@ namespace cling {
     return ret;
   }
 
+  bool MetaProcessor::readInputInChunks(llvm::StringRef filename,
+                                        llvm::StringRef content,
+                                        Value* result,
+                                        Interpreter::CompilationResult& ret) {
+    const clang::LangOptions& LangOpts = m_Interp.getCI()->getLangOpts();
+    size_t size = utils::getChunkEnd(content, kInputChunkSize, LangOpts);
+    {
+      // Wrapped input must stay in one piece: it becomes one function.
+      std::string first(content.substr(0, size));
+      if (utils::getWrapPoint(first, LangOpts) != std::string::npos)
+        return false;
+    }
+
+    m_CurrentlyExecutingFile = filename;
+    bool topmost = !m_TopExecutingFile.data();
+    if (topmost)
+      m_TopExecutingFile = m_CurrentlyExecutingFile;
+
+    const std::string path = getLineDirectivePath(filename);
+    ret = Interpreter::kSuccess;
+    unsigned line = 1;
+    for (size_t start = 0; start < content.size(); start += size) {
+      if (start)
+        size = utils::getChunkEnd(content.substr(start), kInputChunkSize,
+                                  LangOpts);
+      llvm::StringRef text = content.substr(start, size);
+      std::string chunk = "#line " + std::to_string(line + 1) + " \""
+        + path + "\" \n";
+      const size_t textStart = chunk.size();
+      chunk += text;
+      if (!start && text.startswith("#!")) {
+        // Convert shebang line to comment.
+        chunk[textStart] = '/';
+        chunk[textStart + 1] = '/';
+      }
+      line += std::count(text.begin(), text.end(), '\n');
+      // As for the whole file: the end of it is not value printed.
+      if (start + size >= content.size() && chunk.back() != ';')
+        chunk += ';';
+      ret = m_Interp.process(chunk, result);
+      if (ret == Interpreter::kFailure)
+        break;
+    }
+
+    m_CurrentlyExecutingFile = llvm::StringRef();
+    if (topmost)
+      m_TopExecutingFile = llvm::StringRef();
+    return true;
+  }
+
   void MetaProcessor::setStdStream(llvm::StringRef file, RedirectionScope scope,
-                                   bool append) {
+                                   bool append, unsigned flags) {
     assert((scope & kSTDOUT || scope & kSTDERR) && "Invalid RedirectionScope");
     if (!m_RedirectOutput)
       m_RedirectOutput.reset(new RedirectOutput);
 
-    m_RedirectOutput->redirect(file, append, scope);
+    m_RedirectOutput->redirect(file, append, scope, flags);
     if (m_RedirectOutput->empty())
       m_RedirectOutput.reset();
   }
 
+  void MetaProcessor::resetStdStreams() {
+    m_RedirectOutput.reset();
+  }
+
   void MetaProcessor::registerUnloadPoint(const Transaction* T,
                                           llvm::StringRef filename) {
     m_MetaSema->registerUnloadPoint(T, filename);
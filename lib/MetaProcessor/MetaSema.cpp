@@ -8,13 +8,19 @@
 //------------------------------------------------------------------------------
 
 #include "cling/Interpreter/DynamicLibraryManager.h"
+#include "cling/Interpreter/HeapReport.h"
+#include "cling/Interpreter/IncrementalCUDADeviceCompiler.h"
 #include "cling/Interpreter/Interpreter.h"
+#include "cling/Interpreter/MemoryReport.h"
+#include "cling/Interpreter/ProfileReport.h"
+#include "cling/Interpreter/TimingStats.h"
 #include "cling/Interpreter/Transaction.h"
 #include "cling/Interpreter/Value.h"
 
 #include "cling/MetaProcessor/Display.h"
 #include "cling/MetaProcessor/MetaProcessor.h"
 #include "cling/MetaProcessor/MetaSema.h"
+#include "cling/Utils/Output.h"
 
 #include "clang/AST/ASTContext.h"
 #include "clang/Basic/SourceManager.h"
@@ -26,6 +32,8 @@
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ExecutionEngine/GenericValue.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
 
 
 #include "clang/Lex/Preprocessor.h"
@@ -57,6 +65,23 @@ namespace cling {
   MetaSema::MetaSema(Interpreter& interp, MetaProcessor& meta)
     : m_Interpreter(interp), m_MetaProcessor(meta), m_IsQuitRequested(false) { }
 
+  MetaSema::~MetaSema() {}
+
+  DisplayIndex& MetaSema::getDisplayIndex() const {
+    if (!m_DisplayIndex)
+      m_DisplayIndex.reset(new DisplayIndex(m_Interpreter));
+    return *m_DisplayIndex;
+  }
+
+  bool MetaSema::parseDisplayFilter(llvm::StringRef Options,
+                                    DisplayFilter& Filter) const {
+    std::string Error;
+    if (Filter.parse(Options, Error))
+      return true;
+    cling::errs() << "cling::MetaSema: " << Error << '\n';
+    return false;
+  }
+
   MetaSema::ActionResult MetaSema::actOnLCommand(llvm::StringRef file,
                                             Transaction** transaction /*= 0*/) {
     if (file.empty()) {
@@ -64,6 +89,14 @@ namespace cling {
       return AR_Success;
     }
 
+    // ACLiC-like: "file+" loads the script compiled into a cached library,
+    // "file++" compiles it anew.
+    unsigned compile = 0;
+    while (compile < 2 && file.endswith("+") && !llvm::sys::fs::exists(file)) {
+      file = file.drop_back();
+      ++compile;
+    }
+
     if (actOnUCommand(file) != AR_Success)
       return AR_Failure;
 
@@ -76,8 +109,10 @@ namespace cling {
     std::string pathname(m_Interpreter.lookupFileOrLibrary(file));
     if (pathname.empty())
       pathname = file;
-    if (m_Interpreter.loadFile(pathname, /*allowSharedLib=*/true, transaction)
-        == Interpreter::kSuccess) {
+    const Interpreter::CompilationResult result = compile
+      ? m_Interpreter.loadCompiledScript(pathname, compile > 1, transaction)
+      : m_Interpreter.loadFile(pathname, /*allowSharedLib=*/true, transaction);
+    if (result == Interpreter::kSuccess) {
       registerUnloadPoint(unloadPoint, pathname);
       return AR_Success;
     }
@@ -87,6 +122,7 @@ namespace cling {
   MetaSema::ActionResult MetaSema::actOnOCommand(int optLevel) {
     if (optLevel >= 0 && optLevel < 4) {
       m_Interpreter.setDefaultOptLevel(optLevel);
+      m_Interpreter.enableAutoOptLevel(false);
       return AR_Success;
     }
     m_MetaProcessor.getOuts()
@@ -95,8 +131,15 @@ namespace cling {
   }
 
   void MetaSema::actOnOCommand() {
-    m_MetaProcessor.getOuts() << "Current cling optimization level: "
-                              << m_Interpreter.getDefaultOptLevel() << '\n';
+    m_MetaProcessor.getOuts() << "Current cling optimization level: ";
+    if (m_Interpreter.isAutoOptLevel())
+      m_MetaProcessor.getOuts() << "auto, by default ";
+    m_MetaProcessor.getOuts() << m_Interpreter.getDefaultOptLevel() << '\n';
+  }
+
+  MetaSema::ActionResult MetaSema::actOnOAutoCommand() {
+    m_Interpreter.enableAutoOptLevel();
+    return AR_Success;
   }
 
   MetaSema::ActionResult MetaSema::actOnTCommand(llvm::StringRef inputFile,
@@ -106,8 +149,9 @@ namespace cling {
   }
 
   MetaSema::ActionResult MetaSema::actOnRedirectCommand(llvm::StringRef file,
-                         MetaProcessor::RedirectionScope stream, bool append) {
-    m_MetaProcessor.setStdStream(file, stream, append);
+                         MetaProcessor::RedirectionScope stream, bool append,
+                         unsigned flags) {
+    m_MetaProcessor.setStdStream(file, stream, append, flags);
     return AR_Success;
   }
 
@@ -297,9 +341,253 @@ namespace cling {
 
   void MetaSema::actOnstatsCommand(llvm::StringRef name,
                                    llvm::StringRef args) const {
+    if (name.equals("time")) {
+      if (args.equals("reset"))
+        m_Interpreter.resetTimingStats();
+      else
+        m_Interpreter.getTimingStats().print(m_MetaProcessor.getOuts());
+      return;
+    }
+    if (name.equals("timetrace")) {
+      if (!m_Interpreter.writeTimeTrace())
+        cling::errs() << "cling::MetaSema: no time trace; start the session "
+                         "with --time-trace=<file>\n";
+      return;
+    }
+    if (name.equals("memory")) {
+      m_Interpreter.getMemoryReport().print(m_MetaProcessor.getOuts());
+      return;
+    }
+    if (name.equals("heap")) {
+      m_Interpreter.getHeapReport().print(m_MetaProcessor.getOuts());
+      return;
+    }
+    if (name.equals("cuda")) {
+      IncrementalCUDADeviceCompiler* CUDA = m_Interpreter.getCUDACompiler();
+      if (!CUDA) {
+        m_MetaProcessor.getOuts() << "Not in CUDA mode\n";
+        return;
+      }
+      if (args.equals("reset"))
+        CUDA->resetStats();
+      else if (args.equals("kernels")) {
+        bool flag = !CUDA->getKernelTimer();
+        if (!m_Interpreter.enableCUDAKernelTiming(flag))
+          m_MetaProcessor.getOuts() << "Cannot time the kernels\n";
+        else
+          m_MetaProcessor.getOuts() << (flag ? "T" : "Not t")
+                                    << "iming the kernels\n";
+      } else
+        CUDA->printStats(m_MetaProcessor.getOuts());
+      return;
+    }
     m_Interpreter.dump(name, args);
   }
 
+  void MetaSema::actOntimingCommand(SwitchMode mode/* = kToggle*/) const {
+    if (mode == kToggle) {
+      bool flag = !m_MetaProcessor.isReportingTiming();
+      m_MetaProcessor.enableTimingReport(flag);
+      m_MetaProcessor.getOuts() << (flag ? "R" : "Not r") << "eporting timing\n";
+    }
+    else
+      m_MetaProcessor.enableTimingReport(mode);
+  }
+
+  MetaSema::ActionResult
+  MetaSema::actOnexportCommand(llvm::StringRef path,
+                               int optLevel /* = -1*/) const {
+    if (!m_Interpreter.exportSession(path, optLevel))
+      return AR_Failure;
+    m_MetaProcessor.getOuts() << "Exported the session to " << path << '\n';
+    return AR_Success;
+  }
+
+  MetaSema::ActionResult
+  MetaSema::actOnpackageCommand(llvm::StringRef path,
+                                int optLevel /* = -1*/) const {
+    const Transaction* T = m_Interpreter.getLastTransaction();
+    if (!T) {
+      cling::errs() << "cling::MetaSema: there is no input to package\n";
+      return AR_Failure;
+    }
+    std::error_code EC;
+    llvm::raw_fd_ostream OS(path, EC, llvm::sys::fs::F_None);
+    if (EC) {
+      cling::errs() << "cling::MetaSema: cannot write '" << path << "': "
+                    << EC.message() << '\n';
+      return AR_Failure;
+    }
+    if (!m_Interpreter.exportPackage(*T, OS, optLevel)) {
+      OS.close();
+      llvm::sys::fs::remove(path);
+      return AR_Failure;
+    }
+    m_MetaProcessor.getOuts() << "Packaged the last input into " << path
+                              << '\n';
+    return AR_Success;
+  }
+
+  MetaSema::ActionResult
+  MetaSema::actOnremarksCommand(llvm::StringRef what) const {
+    const bool passed = what.equals("passed") || what.equals("all");
+    const bool missed = what.equals("missed") || what.equals("all");
+    llvm::raw_ostream& outs = m_MetaProcessor.getOuts();
+    if (what.equals("off")) {
+      m_Interpreter.enableOptimizationRemarks(false);
+      outs << "Not collecting optimization remarks\n";
+      return AR_Success;
+    }
+    if (!passed && !missed) {
+      outs << ".remarks takes 'missed', 'passed', 'all' or 'off', not '"
+           << what << "'\n";
+      return AR_Failure;
+    }
+    if (!m_Interpreter.isCollectingOptimizationRemarks()) {
+      m_Interpreter.enableOptimizationRemarks(true);
+      if (!m_Interpreter.isCollectingOptimizationRemarks()) {
+        outs << "No optimization remarks without a JIT\n";
+        return AR_Failure;
+      }
+      outs << "Collecting optimization remarks from the next input on\n";
+      return AR_Success;
+    }
+    if (!m_Interpreter.printOptimizationRemarks(outs, passed, missed))
+      outs << "No optimization remarks since the last .remarks\n";
+    return AR_Success;
+  }
+
+  MetaSema::ActionResult
+  MetaSema::actOnpgoCommand(llvm::StringRef what) const {
+    llvm::raw_ostream& outs = m_MetaProcessor.getOuts();
+    if (what.equals("on") || what.equals("off")) {
+      const bool enable = what.equals("on");
+      if (!m_Interpreter.enableProfileInstrumentation(enable)) {
+        outs << "No profile without a JIT running the code in process\n";
+        return AR_Failure;
+      }
+      outs << (enable ? "Collecting the profile of the next inputs\n"
+                      : "Not collecting profiles\n");
+      return AR_Success;
+    }
+    if (!what.equals("optimize")) {
+      outs << ".pgo takes 'on', 'off' or 'optimize', not '" << what << "'\n";
+      return AR_Failure;
+    }
+    const unsigned optimized = m_Interpreter.optimizeWithProfile();
+    outs << "Re-optimized " << optimized
+         << (optimized == 1 ? " function" : " functions")
+         << " with the profile collected\n";
+    return AR_Success;
+  }
+
+  MetaSema::ActionResult
+  MetaSema::actOnprofileCommand(llvm::StringRef what) const {
+    llvm::raw_ostream& outs = m_MetaProcessor.getOuts();
+    if (what.equals("start")) {
+      if (!m_Interpreter.startProfiling()) {
+        outs << "No sampling of code running in another process, on this "
+                "platform or while another interpreter samples\n";
+        return AR_Failure;
+      }
+      outs << "Sampling the CPU time of this thread\n";
+      return AR_Success;
+    }
+    if (what.equals("stop")) {
+      if (!m_Interpreter.stopProfiling()) {
+        outs << "Not sampling; start with .profile start\n";
+        return AR_Failure;
+      }
+      outs << "Stopped sampling\n";
+      return AR_Success;
+    }
+    if (!what.equals("report")) {
+      outs << ".profile takes 'start', 'stop' or 'report', not '" << what
+           << "'\n";
+      return AR_Failure;
+    }
+    m_Interpreter.getProfileReport().print(outs);
+    return AR_Success;
+  }
+
+  MetaSema::ActionResult
+  MetaSema::actOnjournalCommand(llvm::StringRef path) const {
+    llvm::raw_ostream& outs = m_MetaProcessor.getOuts();
+    if (path.empty()) {
+      m_Interpreter.stopJournal();
+      outs << "Not recording the inputs\n";
+      return AR_Success;
+    }
+    if (!m_Interpreter.startJournal(path))
+      return AR_Failure;
+    outs << "Recording the inputs into " << path << '\n';
+    return AR_Success;
+  }
+
+  MetaSema::ActionResult
+  MetaSema::actOnrestoreCommand(llvm::StringRef path,
+                                bool declarationsOnly) const {
+    llvm::raw_ostream& outs = m_MetaProcessor.getOuts();
+    if (path.empty()) {
+      if (!m_Interpreter.getNumDeferredJournalInputs()) {
+        outs << "No deferred inputs to run\n";
+        return AR_Success;
+      }
+      return m_Interpreter.runDeferredJournalInputs() == Interpreter::kSuccess
+        ? AR_Success : AR_Failure;
+    }
+    if (m_Interpreter.restoreJournal(path, declarationsOnly)
+        != Interpreter::kSuccess)
+      return AR_Failure;
+    size_t reused = 0;
+    if (const size_t replayed
+          = m_Interpreter.getNumReplayedJournalModules(&reused))
+      outs << reused << " of " << replayed
+           << (replayed == 1 ? " module" : " modules")
+           << " came out of the object cache\n";
+    if (const size_t deferred = m_Interpreter.getNumDeferredJournalInputs())
+      outs << "Deferred " << deferred
+           << (deferred == 1 ? " input" : " inputs")
+           << "; .restore runs them\n";
+    return AR_Success;
+  }
+
+  MetaSema::ActionResult MetaSema::actOnreloadCommand(llvm::StringRef file) {
+    std::string pathname(m_Interpreter.lookupFileOrLibrary(file));
+    if (pathname.empty())
+      pathname = file;
+    const Interpreter::CompilationResult result
+      = m_Interpreter.reloadFile(pathname);
+    if (result != Interpreter::kMoreInputExpected)
+      return result == Interpreter::kSuccess ? AR_Success : AR_Failure;
+
+    // Like .L: unload what an earlier load of the file declared.
+    if (actOnUCommand(file) != AR_Success)
+      return AR_Failure;
+    const Transaction* unloadPoint = m_Interpreter.getLastTransaction();
+    if (m_Interpreter.loadReloadableFile(pathname) != Interpreter::kSuccess)
+      return AR_Failure;
+    registerUnloadPoint(unloadPoint, pathname);
+    return AR_Success;
+  }
+
+  MetaSema::ActionResult MetaSema::actOntryCommand(llvm::StringRef what) {
+    if (what.equals("adopt") || what.equals("discard")) {
+      const bool adopted = what.equals("adopt");
+      if (adopted ? m_MetaProcessor.adoptTry() : m_MetaProcessor.discardTry())
+        return AR_Success;
+      cling::errs() << "cling::MetaSema: there is no .try to " << what << '\n';
+      return AR_Failure;
+    }
+    Interpreter::CompilationResult result;
+    if (!m_MetaProcessor.beginTry(what, result)) {
+      cling::errs() << "cling::MetaSema: .try needs fork(), which this "
+                       "platform does not have\n";
+      return AR_Failure;
+    }
+    return result == Interpreter::kFailure ? AR_Failure : AR_Success;
+  }
+
   void MetaSema::actOndynamicExtensionsCommand(SwitchMode mode/* = kToggle*/) const {
     if (mode == kToggle) {
       bool flag = !m_Interpreter.isDynamicLookupEnabled();
@@ -325,11 +613,17 @@ namespace cling {
       "   " << metaString << "(x|X) <filename>[args]\t- Same as .L and runs a function with"
                              "\n\t\t\t\t  signature: ret_type filename(args)\n"
       "\n"
+      "   " << metaString << "L <filename>+\t\t- Load the file compiled into a shared library,"
+                             "\n\t\t\t\t  cached until it changes; '++' always compiles it"
+                             "\n\t\t\t\t  (also for .x)\n"
+      "\n"
       "   " << metaString << "> <filename>\t\t- Redirect command to a given file\n"
         "      '>' or '1>'\t\t- Redirects the stdout stream only\n"
         "      '2>'\t\t\t- Redirects the stderr stream only\n"
         "      '&>' (or '2>&1')\t\t- Redirects both stdout and stderr\n"
         "      '>>'\t\t\t- Appends to the given file\n"
+        "      <filename> --buffered\t- Buffers the output, a thread writes it to the file\n"
+        "      <filename> --gzip\t\t- Same, gzip compressed\n"
       "\n"
       "   " << metaString << "undo [n]\t\t\t- Unloads the last 'n' inputs lines\n"
       "\n"
@@ -339,10 +633,17 @@ namespace cling {
                              "\n\t\t\t\t  adds the path to the include paths\n"
       "\n"
       "   " << metaString << "O <level>\t\t\t- Sets the optimization level (0-3)"
-                             "\n\t\t\t\t  (not yet implemented)\n"
+                             "\n\t\t\t\t  or, with 'auto', lets each input get"
+                             "\n\t\t\t\t  the one its code calls for\n"
       "\n"
       "   " << metaString << "class <name>\t\t- Prints out class <name> in a CINT-like style\n"
       "\n"
+      "   " << metaString << "class [options]\t\t- Lists the classes, " << metaString << "Class verbosely; also"
+                             "\n\t\t\t\t  " << metaString << "namespace, " << metaString << "typedef and " << metaString << "g. Options:"
+                             "\n\t\t\t\t  -p <prefix> | -r <regex> of the names,"
+                             "\n\t\t\t\t  -n <page size> [-page <page>]. Only the"
+                             "\n\t\t\t\t  declarations loaded so far are listed\n"
+      "\n"
       "   " << metaString << "files \t\t\t- Prints out some CINT-like file statistics\n"
       "\n"
       "   " << metaString << "fileEx \t\t\t- Prints out some file statistics\n"
@@ -371,6 +672,56 @@ namespace cling {
                              "\t\t\t\t  'asttree [filter]'  abstract syntax tree layout\n"
                              "\t\t\t\t  'decl' dump ast declarations\n"
                              "\t\t\t\t  'undo' show undo stack\n"
+                             "\t\t\t\t  'transactions' transaction pool usage\n"
+                             "\t\t\t\t  'time [reset]' time spent per compilation stage\n"
+                             "\t\t\t\t  'timetrace' write the sections timed so far to\n"
+                             "\t\t\t\t  the file of --time-trace\n"
+                             "\t\t\t\t  'memory' memory kept alive per transaction\n"
+                             "\t\t\t\t  'heap' live heap allocations of the JITted code per\n"
+                             "\t\t\t\t  transaction and function, see CLING_HEAP_PROFILE\n"
+                             "\t\t\t\t  'cuda [reset|kernels]' time spent compiling and\n"
+                             "\t\t\t\t  running device code; 'kernels' toggles timing\n"
+                             "\t\t\t\t  the GPU with CUDA events\n"
+      "\n"
+      "   " << metaString << "timing [on|off]\t\t- Toggles the report of the time, peak memory and"
+                             "\n\t\t\t\t  hardware counters of each input\n"
+      "\n"
+      "   " << metaString << "export [-O<n>] <filename>\t- Compiles the code of the session into the"
+                             "\n\t\t\t\t  shared library (or '.o' object) <filename>, with a"
+                             "\n\t\t\t\t  header declaring it next to it\n"
+      "\n"
+      "   " << metaString << "package [-O<n>] <filename>\t- Compiles the code of the last input into the"
+                             "\n\t\t\t\t  package <filename>, with the symbols and libraries"
+                             "\n\t\t\t\t  it needs, for ObjectRunner::addPackage()\n"
+      "\n"
+      "   " << metaString << "remarks [missed|passed|all|off] - Shows the optimization remarks of the"
+                             "\n\t\t\t\t  inputs since the last .remarks, e.g. why a loop"
+                             "\n\t\t\t\t  was not vectorized; the first use starts"
+                             "\n\t\t\t\t  collecting them\n"
+      "\n"
+      "   " << metaString << "pgo [on|off|optimize]\t- Collects the profile of the code of the next"
+                             "\n\t\t\t\t  inputs while it runs, or re-optimizes the code"
+                             "\n\t\t\t\t  that ran with it\n"
+      "\n"
+      "   " << metaString << "profile [start|stop|report] - Samples where the CPU time of this"
+                             "\n\t\t\t\t  thread goes, or shows the functions and calling"
+                             "\n\t\t\t\t  contexts it went to\n"
+      "\n"
+      "   " << metaString << "journal [<filename>]\t- Records the next inputs into the journal"
+                             "\n\t\t\t\t  <filename>, or stops recording them\n"
+      "\n"
+      "   " << metaString << "restore [-declarations] [<filename>] - Replays the inputs of the"
+                             "\n\t\t\t\t  journal <filename>, reusing their cached objects;"
+                             "\n\t\t\t\t  -declarations defers the statements to the next"
+                             "\n\t\t\t\t  .restore without <filename>\n"
+      "\n"
+      "   " << metaString << "reload <filename>\t\t- Loads the file, or compiles the function bodies"
+                             "\n\t\t\t\t  that changed since; other changes load it anew\n"
+      "\n"
+      "   " << metaString << "try [<code>]\t\t- Runs <code>, or the next input, in a fork of the"
+                             "\n\t\t\t\t  session, leaving the session as it is\n"
+      "   " << metaString << "try adopt|discard\t- Goes on with the session of the fork, or drops"
+                             "\n\t\t\t\t  the fork\n"
       "\n"
       "   " << metaString << "help\t\t\t- Shows this information\n"
       "\n"
@@ -414,35 +765,44 @@ namespace cling {
   }
 
   void MetaSema::actOnclassCommand(llvm::StringRef className) const {
-    if (!className.empty())
+    DisplayFilter Filter;
+    if (!className.empty() && !className.startswith("-"))
       DisplayClass(m_MetaProcessor.getOuts(),
                    &m_Interpreter, className.str().c_str(), true);
-    else
-      DisplayClasses(m_MetaProcessor.getOuts(), &m_Interpreter, false);
+    else if (parseDisplayFilter(className, Filter))
+      DisplayClasses(m_MetaProcessor.getOuts(), getDisplayIndex(), false,
+                     Filter);
   }
 
-  void MetaSema::actOnClassCommand() const {
-    DisplayClasses(m_MetaProcessor.getOuts(), &m_Interpreter, true);
+  void MetaSema::actOnClassCommand(llvm::StringRef options) const {
+    DisplayFilter Filter;
+    if (parseDisplayFilter(options, Filter))
+      DisplayClasses(m_MetaProcessor.getOuts(), getDisplayIndex(), true,
+                     Filter);
   }
 
-  void MetaSema::actOnNamespaceCommand() const {
-    DisplayNamespaces(m_MetaProcessor.getOuts(), &m_Interpreter);
+  void MetaSema::actOnNamespaceCommand(llvm::StringRef options) const {
+    DisplayFilter Filter;
+    if (parseDisplayFilter(options, Filter))
+      DisplayNamespaces(m_MetaProcessor.getOuts(), getDisplayIndex(), Filter);
   }
 
   void MetaSema::actOngCommand(llvm::StringRef varName) const {
-    if (varName.empty())
-      DisplayGlobals(m_MetaProcessor.getOuts(), &m_Interpreter);
-    else
+    DisplayFilter Filter;
+    if (!varName.empty() && !varName.startswith("-"))
       DisplayGlobal(m_MetaProcessor.getOuts(),
                     &m_Interpreter, varName.str().c_str());
+    else if (parseDisplayFilter(varName, Filter))
+      DisplayGlobals(m_MetaProcessor.getOuts(), getDisplayIndex(), Filter);
   }
 
   void MetaSema::actOnTypedefCommand(llvm::StringRef typedefName) const {
-    if (typedefName.empty())
-      DisplayTypedefs(m_MetaProcessor.getOuts(), &m_Interpreter);
-    else
+    DisplayFilter Filter;
+    if (!typedefName.empty() && !typedefName.startswith("-"))
       DisplayTypedef(m_MetaProcessor.getOuts(),
                      &m_Interpreter, typedefName.str().c_str());
+    else if (parseDisplayFilter(typedefName, Filter))
+      DisplayTypedefs(m_MetaProcessor.getOuts(), getDisplayIndex(), Filter);
   }
 
   MetaSema::ActionResult
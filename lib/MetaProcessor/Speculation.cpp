@@ -0,0 +1,304 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "Speculation.h"
+
+#include "cling/Interpreter/Exception.h"
+#include "cling/MetaProcessor/MetaProcessor.h"
+#include "cling/Utils/Output.h"
+
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Frontend/CompilerInstance.h"
+
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#ifdef LLVM_ON_UNIX
+#include <cerrno>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace cling {
+
+#ifdef LLVM_ON_UNIX
+  namespace {
+    ///\brief The peer may be gone: rather fail than get a SIGPIPE.
+#ifdef MSG_NOSIGNAL
+    const int kSendFlags = MSG_NOSIGNAL;
+#else
+    const int kSendFlags = 0;
+#endif
+
+    bool sendAll(int FD, const void* Data, size_t Size) {
+      const char* Pos = static_cast<const char*>(Data);
+      while (Size) {
+        ssize_t Sent = ::send(FD, Pos, Size, kSendFlags);
+        if (Sent < 0 && errno == EINTR)
+          continue;
+        if (Sent <= 0)
+          return false;
+        Pos += Sent;
+        Size -= Sent;
+      }
+      return true;
+    }
+
+    bool readAll(int FD, void* Data, size_t Size) {
+      char* Pos = static_cast<char*>(Data);
+      while (Size) {
+        ssize_t Read = ::read(FD, Pos, Size);
+        if (Read < 0 && errno == EINTR)
+          continue;
+        if (Read <= 0)
+          return false;
+        Pos += Read;
+        Size -= Read;
+      }
+      return true;
+    }
+
+    int waitFor(int Pid) {
+      int Status = 0;
+      while (::waitpid(Pid, &Status, 0) < 0 && errno == EINTR)
+        ;
+      return Status;
+    }
+
+    ///\brief Brings what the process wrote so far to its file descriptors,
+    /// which the parent and the child share.
+    void flushOutput() {
+      cling::outs().flush();
+      cling::errs().flush();
+      llvm::outs().flush();
+      llvm::errs().flush();
+      std::cout.flush();
+      std::cerr.flush();
+      ::fflush(nullptr);
+    }
+
+    ///\brief Runs Process, reporting the exceptions thrown out of it like
+    /// UserInterface::runInteractively() does.
+    template <class Fn> void runReporting(Fn&& Process) {
+      try {
+        Process();
+      }
+      catch (InterpreterException& e) {
+        if (!e.diagnose()) {
+          cling::errs() << ">>> Caught an interpreter exception!\n"
+                        << ">>> " << e.what() << '\n';
+        }
+      }
+      catch (std::exception& e) {
+        cling::errs() << ">>> Caught a std::exception!\n"
+                      << ">>> " << e.what() << '\n';
+      }
+      catch (...) {
+        cling::errs() << "Exception occurred. Recovering...\n";
+      }
+    }
+  } // unnamed namespace
+
+  Speculation::~Speculation() {
+    if (m_Adopted) {
+      // The end of the input ends the adopted session.
+      ::close(m_Channel);
+      endAdopted();
+    }
+    if (isPending())
+      discard();
+  }
+
+  bool Speculation::isSupported() { return true; }
+
+  void Speculation::forget() {
+    if (m_Channel != -1)
+      ::close(m_Channel);
+    m_Channel = -1;
+    m_Child = -1;
+    m_Adopted = false;
+    m_ExpectedIndent = 0;
+  }
+
+  void Speculation::reportEnd(int Status) const {
+    if (WIFSIGNALED(Status))
+      cling::errs() << "cling::MetaProcessor: the .try was killed by signal "
+                    << WTERMSIG(Status) << '\n';
+    else if (WIFEXITED(Status))
+      cling::errs() << "cling::MetaProcessor: the .try exited with code "
+                    << WEXITSTATUS(Status) << '\n';
+  }
+
+  void Speculation::endAdopted() {
+    const int Status = waitFor(m_Child);
+    if (WIFSIGNALED(Status))
+      reportEnd(Status);
+    // The child ran the atexit functions of the interpreted code, and wrote
+    // through the redirections of this process.
+    m_MetaProcessor.resetStdStreams();
+    flushOutput();
+    std::_Exit(WIFEXITED(Status) ? WEXITSTATUS(Status) : EXIT_FAILURE);
+  }
+
+  Interpreter::CompilationResult Speculation::run(const std::string& Input) {
+    if (isPending())
+      discard();
+    Interpreter& Interp = m_MetaProcessor.getInterpreter();
+    // Their threads would be gone in the child, maybe holding locks.
+    Interp.prepareFork();
+
+    int Channel[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, Channel)) {
+      cling::errs() << "cling::MetaProcessor: cannot .try: "
+                    << ::strerror(errno) << '\n';
+      return Interpreter::kFailure;
+    }
+    flushOutput();
+    const pid_t Pid = ::fork();
+    if (Pid < 0) {
+      cling::errs() << "cling::MetaProcessor: cannot fork a .try: "
+                    << ::strerror(errno) << '\n';
+      ::close(Channel[0]);
+      ::close(Channel[1]);
+      return Interpreter::kFailure;
+    }
+
+    if (!Pid) {
+      ::close(Channel[0]);
+      // An adopted child trying further: its parent is not the one of the
+      // new child, whose end it must see.
+      if (m_Parent != -1)
+        ::close(m_Parent);
+      m_Parent = Channel[1];
+      Interp.onForked();
+
+      int32_t Result = Interpreter::kFailure;
+      runReporting([&] {
+        Result = Interp.process(Input);
+      });
+      flushOutput();
+      char Command = 0;
+      if (!sendAll(m_Parent, &Result, sizeof(Result))
+          || !readAll(m_Parent, &Command, 1) || Command != 'a')
+        ::_exit(EXIT_SUCCESS);
+      serve();
+    }
+
+    ::close(Channel[1]);
+    m_Child = Pid;
+    m_Channel = Channel[0];
+    int32_t Result = Interpreter::kFailure;
+    if (!readAll(m_Channel, &Result, sizeof(Result))) {
+      reportEnd(waitFor(m_Child));
+      forget();
+      return Interpreter::kFailure;
+    }
+    return (Interpreter::CompilationResult)Result;
+  }
+
+  bool Speculation::adopt() {
+    if (!sendAll(m_Channel, "a", 1)) {
+      reportEnd(waitFor(m_Child));
+      forget();
+      return false;
+    }
+    m_Adopted = true;
+    return true;
+  }
+
+  void Speculation::discard() {
+    ::kill(m_Child, SIGKILL);
+    waitFor(m_Child);
+    forget();
+  }
+
+  int Speculation::forward(llvm::StringRef Line,
+                           Interpreter::CompilationResult& compRes) {
+    std::string Frame(1, 'l');
+    const uint32_t Size = Line.size();
+    Frame.append(reinterpret_cast<const char*>(&Size), sizeof(Size));
+    Frame.append(Line.data(), Line.size());
+    // The child ends without an answer upon a quit.
+    int32_t Reply[2];
+    if (!sendAll(m_Channel, Frame.data(), Frame.size())
+        || !readAll(m_Channel, Reply, sizeof(Reply)))
+      endAdopted();
+    m_ExpectedIndent = Reply[0];
+    compRes = (Interpreter::CompilationResult)Reply[1];
+    return Reply[0];
+  }
+
+  void Speculation::cancelContinuation() {
+    m_ExpectedIndent = 0;
+    sendAll(m_Channel, "c", 1);
+  }
+
+  void Speculation::serve() {
+    char Kind;
+    while (readAll(m_Parent, &Kind, 1)) {
+      if (Kind == 'c') {
+        m_MetaProcessor.cancelContinuation();
+        continue;
+      }
+      uint32_t Size;
+      if (!readAll(m_Parent, &Size, sizeof(Size)))
+        break;
+      std::string Line(Size, '\0');
+      if (!readAll(m_Parent, &Line[0], Size))
+        break;
+
+      Interpreter::CompilationResult compRes = Interpreter::kFailure;
+      int32_t Reply[2] = {0, Interpreter::kFailure};
+      runReporting([&] {
+        Reply[0] = m_MetaProcessor.process(Line, compRes);
+      });
+      Reply[1] = compRes;
+      flushOutput();
+      if (Reply[0] < 0 || !sendAll(m_Parent, Reply, sizeof(Reply)))
+        break;
+    }
+
+    // The session ends here, as the driver ends it.
+    Interpreter& Interp = m_MetaProcessor.getInterpreter();
+    const unsigned Errs
+      = Interp.getCI()->getDiagnostics().getClient()->getNumErrors();
+    Interp.fastExit(Errs ? EXIT_FAILURE : EXIT_SUCCESS);
+  }
+#else
+  Speculation::~Speculation() {}
+
+  bool Speculation::isSupported() { return false; }
+
+  Interpreter::CompilationResult Speculation::run(const std::string&) {
+    return Interpreter::kFailure;
+  }
+
+  bool Speculation::adopt() { return false; }
+
+  void Speculation::discard() {}
+
+  int Speculation::forward(llvm::StringRef,
+                           Interpreter::CompilationResult& compRes) {
+    compRes = Interpreter::kFailure;
+    return 0;
+  }
+
+  void Speculation::cancelContinuation() {}
+#endif // LLVM_ON_UNIX
+
+} // end namespace cling
@@ -0,0 +1,99 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_SPECULATION_H
+#define CLING_SPECULATION_H
+
+#include "cling/Interpreter/Interpreter.h"
+
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+
+namespace cling {
+  class MetaProcessor;
+
+  ///\brief Runs an input of `.try` in a child that fork() makes of the
+  /// process: the child starts from a copy on write of the session, so that
+  /// the session is checkpointed for free. Its output goes to the standard
+  /// streams of the session as it comes.
+  ///
+  /// Once the input ran, the child waits until it is discarded, which kills
+  /// it, or adopted: the session then goes on in the child, to which this
+  /// process forwards its inputs, reading them and showing the prompt as
+  /// before. The process ends when the adopted session does, with its exit
+  /// code, and without running what the interpreted code left to run at
+  /// exit once more.
+  ///
+  /// The threads of the process are not in the child, see
+  /// Interpreter::onForked(); the redirections of `.>` that buffer in a
+  /// thread keep being written by the one of this process.
+  ///
+  class Speculation {
+    MetaProcessor& m_MetaProcessor;
+
+    ///\brief The child running the input, or -1.
+    int m_Child = -1;
+    ///\brief Whether the session went on in m_Child.
+    bool m_Adopted = false;
+    ///\brief The socket to m_Child.
+    int m_Channel = -1;
+    ///\brief The socket to the parent, in a child.
+    int m_Parent = -1;
+    ///\brief What the adopted session answered last, for
+    /// MetaProcessor::getExpectedIndent().
+    int m_ExpectedIndent = 0;
+
+    ///\brief Waits for the child to end, then ends this process as it did.
+    [[noreturn]] void endAdopted();
+
+    ///\brief Reports how the child ended, if not by a discard.
+    void reportEnd(int Status) const;
+
+    ///\brief Releases the child, leaving no speculation.
+    void forget();
+
+    ///\brief The loop of an adopted child, processing the inputs of the
+    /// parent until the session ends, which ends the child.
+    [[noreturn]] void serve();
+
+  public:
+    Speculation(MetaProcessor& MP): m_MetaProcessor(MP) {}
+    ///\brief Discards the pending child; an adopted one is told that the
+    /// session ends, and this process ends with it.
+    ~Speculation();
+
+    ///\brief Whether fork() is available.
+    static bool isSupported();
+
+    ///\brief Runs Input in a new child, discarding the pending one.
+    ///\returns The result of Input, kFailure if the child ended.
+    Interpreter::CompilationResult run(const std::string& Input);
+
+    bool isPending() const { return m_Child != -1 && !m_Adopted; }
+    bool isAdopted() const { return m_Adopted; }
+
+    ///\brief Lets the session go on in the pending child.
+    ///\returns false if the child is gone, which was reported.
+    bool adopt();
+
+    ///\brief Kills the pending child.
+    void discard();
+
+    ///\brief Has the adopted child process Line, as MetaProcessor::process()
+    /// does.
+    int forward(llvm::StringRef Line, Interpreter::CompilationResult& compRes);
+
+    ///\brief MetaProcessor::cancelContinuation() of the adopted child.
+    void cancelContinuation();
+
+    int getExpectedIndent() const { return m_ExpectedIndent; }
+  };
+} // end namespace cling
+
+#endif // CLING_SPECULATION_H
@@ -0,0 +1,212 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "HeaderPreloader.h"
+
+#include "cling/Interpreter/Interpreter.h"
+
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/Module.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Lex/HeaderSearch.h"
+#include "clang/Lex/Preprocessor.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+#include <algorithm>
+#include <tuple>
+
+using namespace llvm;
+
+namespace {
+  ///\brief The most files read ahead for a session.
+  static const size_t kMaxFiles = 2000;
+
+  ///\brief The #include of Line, spelled with its delimiters: all of it if
+  /// Complete, else what is typed so far, e.g. "<vec".
+  static StringRef getInclude(StringRef Line, bool& Complete) {
+    Complete = false;
+    Line = Line.ltrim();
+    if (!Line.consume_front("#"))
+      return StringRef();
+    Line = Line.ltrim();
+    if (!Line.consume_front("include"))
+      return StringRef();
+    Line = Line.ltrim();
+    if (Line.empty() || (Line[0] != '<' && Line[0] != '"'))
+      return StringRef();
+    const size_t End = Line.find(Line[0] == '<' ? '>' : '"', 1);
+    if (End == StringRef::npos)
+      return Line.size() > 1 ? Line.rtrim() : StringRef();
+    Complete = End > 1;
+    return Line.substr(0, End + 1);
+  }
+} // unnamed namespace
+
+namespace cling {
+
+  HeaderPreloader::HeaderPreloader(Interpreter& Interp): m_Interp(Interp) {
+    const clang::HeaderSearch& HS
+      = Interp.getCI()->getPreprocessor().getHeaderSearchInfo();
+    for (auto Dir = HS.search_dir_begin(), E = HS.search_dir_end();
+         Dir != E; ++Dir) {
+      if (Dir->isNormalDir())
+        m_SearchDirs.push_back(Dir->getName().str());
+    }
+  }
+
+  HeaderPreloader::~HeaderPreloader() {
+    {
+      std::lock_guard<std::mutex> Lock(m_Mutex);
+      m_Stop = true;
+    }
+    m_Wake.notify_one();
+    if (m_Thread.joinable())
+      m_Thread.join();
+  }
+
+  void HeaderPreloader::lookup(StringRef Name, bool Angled) {
+    clang::Preprocessor& PP = m_Interp.getCI()->getPreprocessor();
+    const clang::DirectoryLookup* CurDir = nullptr;
+    clang::ModuleMap::KnownHeader Module;
+    // This is what the #include does first, with the same caching.
+    const clang::FileEntry* FE
+      = PP.LookupFile(clang::SourceLocation(), Name, Angled,
+                      /*FromDir*/ nullptr, /*FromFile*/ nullptr, CurDir,
+                      /*SearchPath*/ nullptr, /*RelativePath*/ nullptr,
+                      PP.getLangOpts().Modules ? &Module : nullptr,
+                      /*IsMapped*/ nullptr, /*IsFrameworkFound*/ nullptr,
+                      /*SkipCache*/ false, /*OpenFile*/ false,
+                      /*CacheFail*/ false);
+    if (!FE)
+      return;
+    if (clang::Module* M = Module.getModule()) {
+      // The #include imports the module instead of parsing the header.
+      clang::HeaderSearch& HS = PP.getHeaderSearchInfo();
+      M = M->getTopLevelModule();
+      std::string PCM = HS.getPrebuiltModuleFileName(M->Name);
+      if (PCM.empty())
+        PCM = HS.getCachedModuleFileName(M);
+      if (!PCM.empty() && sys::fs::exists(PCM)) {
+        enqueue(PCM, /*Header*/ false);
+        return;
+      }
+      // Else the module is built from the headers.
+    }
+    enqueue(FE->getName(), /*Header*/ true);
+  }
+
+  void HeaderPreloader::enqueue(StringRef Path, bool Header) {
+    {
+      std::lock_guard<std::mutex> Lock(m_Mutex);
+      m_Queue.emplace_back(Path.str(), Header);
+      if (!m_Thread.joinable())
+        m_Thread = std::thread(&HeaderPreloader::run, this);
+    }
+    m_Wake.notify_one();
+  }
+
+  void HeaderPreloader::read(const std::string& Path, bool Header) {
+    if (m_Read.size() >= kMaxFiles || !m_Read.insert(Path).second)
+      return;
+    auto Buf = MemoryBuffer::getFile(Path, /*FileSize*/ -1,
+                                     /*RequiresNullTerminator*/ false);
+    if (!Buf)
+      return;
+    if (!Header) {
+      // A PCM may be mapped: touch its pages to read them in.
+      const char* Data = (*Buf)->getBufferStart();
+      volatile char Sink = 0;
+      for (size_t I = 0, N = (*Buf)->getBufferSize(); I < N; I += 4096)
+        Sink = Sink + Data[I];
+      return;
+    }
+
+    // Follow the #includes of the header as the preprocessor would, but
+    // ignoring the conditions around them: reading too much is cheap.
+    StringRef Dir = sys::path::parent_path(Path);
+    StringRef Rest = (*Buf)->getBuffer();
+    while (!Rest.empty()) {
+      StringRef Line;
+      std::tie(Line, Rest) = Rest.split('\n');
+      bool Complete;
+      StringRef Include = getInclude(Line, Complete);
+      if (!Complete)
+        continue;
+      StringRef Name = Include.drop_front().drop_back();
+      SmallString<256> Found;
+      if (Include[0] == '"') {
+        Found = Dir;
+        sys::path::append(Found, Name);
+        if (!sys::fs::exists(Found))
+          Found.clear();
+      }
+      for (size_t I = 0, N = m_SearchDirs.size(); Found.empty() && I < N;
+           ++I) {
+        Found = m_SearchDirs[I];
+        sys::path::append(Found, Name);
+        if (!sys::fs::exists(Found))
+          Found.clear();
+      }
+      if (!Found.empty() && !m_Read.count(Found)) {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        m_Queue.emplace_back(Found.str().str(), /*Header*/ true);
+      }
+    }
+  }
+
+  void HeaderPreloader::run() {
+    while (true) {
+      std::pair<std::string, bool> Next;
+      {
+        std::unique_lock<std::mutex> Lock(m_Mutex);
+        m_Wake.wait(Lock, [this] { return m_Stop || !m_Queue.empty(); });
+        if (m_Stop)
+          return;
+        Next = std::move(m_Queue.front());
+        m_Queue.pop_front();
+      }
+      read(Next.first, Next.second);
+    }
+  }
+
+  void HeaderPreloader::addHistoryLine(StringRef Line) {
+    bool Complete;
+    StringRef Include = getInclude(Line, Complete);
+    if (!Complete || m_History.size() >= 16
+        || std::find(m_History.begin(), m_History.end(), Include)
+             != m_History.end())
+      return;
+    m_History.push_back(Include.str());
+    lookup(Include.drop_front().drop_back(), Include[0] == '<');
+  }
+
+  void HeaderPreloader::onEdit(StringRef Line) {
+    bool Complete;
+    StringRef Include = getInclude(Line, Complete);
+    if (Include.empty())
+      return;
+    if (!Complete) {
+      // The newest one of the history that this is the beginning of.
+      auto I = std::find_if(m_History.begin(), m_History.end(),
+                            [Include](const std::string& H) {
+                              return StringRef(H).startswith(Include);
+                            });
+      if (I == m_History.end())
+        return;
+      Include = *I;
+    }
+    if (Include == m_LastName)
+      return;
+    m_LastName = Include.str();
+    lookup(Include.drop_front().drop_back(), Include[0] == '<');
+  }
+} // end namespace cling
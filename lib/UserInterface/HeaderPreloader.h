@@ -0,0 +1,87 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_HEADER_PRELOADER_H
+#define CLING_HEADER_PRELOADER_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cling {
+  class Interpreter;
+
+  ///\brief Reads the headers that the user is likely to include next while
+  /// the prompt waits for input, such that the #include finds them in the
+  /// caches of the operating system and of the FileManager.
+  ///
+  /// The candidates are the #include of the line being typed, or the one of
+  /// the recent history that it starts, and the headers recently included
+  /// in the history. They are looked up on the main thread, which warms the
+  /// FileManager and yields the PCM of a module that provides them. A
+  /// thread then reads them, the headers they include (found on a copy of
+  /// the include paths) and the PCMs, without touching the interpreter:
+  /// that remains the main thread's.
+  ///
+  class HeaderPreloader {
+    Interpreter& m_Interp;
+
+    ///\brief The directories of the include paths, for the thread.
+    std::vector<std::string> m_SearchDirs;
+
+    ///\brief The #include names of the history, with their delimiters, e.g.
+    /// "<vector>"; newest first.
+    std::vector<std::string> m_History;
+
+    ///\brief The last name that onEdit() looked up.
+    std::string m_LastName;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_Wake;
+    ///\brief The files to read, with whether they are headers to scan for
+    /// more #includes.
+    std::deque<std::pair<std::string, bool>> m_Queue;
+    bool m_Stop = false;
+
+    ///\brief The files read so far; used by the thread only.
+    llvm::StringSet<> m_Read;
+
+    std::thread m_Thread;
+
+    ///\brief Looks the header Name up and queues what it needs.
+    void lookup(llvm::StringRef Name, bool Angled);
+
+    void enqueue(llvm::StringRef Path, bool Header);
+
+    ///\brief Reads the file Path; queues the headers it includes.
+    void read(const std::string& Path, bool Header);
+
+    ///\brief The loop of m_Thread, which starts with the first enqueue().
+    void run();
+
+  public:
+    HeaderPreloader(Interpreter& Interp);
+    ~HeaderPreloader();
+
+    ///\brief Preloads the header that the history's Line includes, if
+    /// any; pass the lines newest first.
+    void addHistoryLine(llvm::StringRef Line);
+
+    ///\brief Preloads the header that the input Line includes, or the one of
+    /// the history that its incomplete #include starts.
+    void onEdit(llvm::StringRef Line);
+  };
+} // end namespace cling
+
+#endif // CLING_HEADER_PRELOADER_H
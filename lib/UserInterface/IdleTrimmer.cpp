@@ -0,0 +1,79 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "IdleTrimmer.h"
+
+#include "cling/Interpreter/Interpreter.h"
+
+#include <cstdlib>
+
+namespace cling {
+
+  IdleTrimmer::IdleTrimmer(Interpreter& Interp,
+                           std::chrono::milliseconds Delay)
+    : m_Interp(Interp), m_Delay(Delay),
+      m_Thread(&IdleTrimmer::run, this) {}
+
+  IdleTrimmer::~IdleTrimmer() {
+    {
+      std::lock_guard<std::mutex> Lock(m_Mutex);
+      m_Stop = true;
+    }
+    m_Wake.notify_one();
+    m_Thread.join();
+  }
+
+  bool IdleTrimmer::isEnabled(std::chrono::milliseconds& Delay) {
+    const char* Env = ::getenv("CLING_IDLE_TRIM");
+    if (!Env)
+      return false;
+    char* End = nullptr;
+    const double Seconds = ::strtod(Env, &End);
+    if (End == Env || *End || Seconds <= 0)
+      return false;
+    Delay = std::chrono::milliseconds(static_cast<long long>(Seconds * 1000));
+    return true;
+  }
+
+  void IdleTrimmer::busy() {
+    {
+      std::lock_guard<std::mutex> Lock(m_Mutex);
+      m_Busy = true;
+      m_Trimmed = false;
+      ++m_Generation;
+    }
+    m_Wake.notify_one();
+  }
+
+  void IdleTrimmer::idle() {
+    {
+      std::lock_guard<std::mutex> Lock(m_Mutex);
+      m_Busy = false;
+      ++m_Generation;
+    }
+    m_Wake.notify_one();
+  }
+
+  void IdleTrimmer::run() {
+    std::unique_lock<std::mutex> Lock(m_Mutex);
+    while (!m_Stop) {
+      if (m_Busy || m_Trimmed) {
+        m_Wake.wait(Lock);
+        continue;
+      }
+      const unsigned Generation = m_Generation;
+      if (m_Wake.wait_for(Lock, m_Delay, [&] {
+            return m_Stop || m_Generation != Generation;
+          }))
+        continue;
+      // Holding the lock keeps the main thread from the interpreter.
+      m_Interp.trimMemory(Interpreter::kTrimHeap);
+      m_Trimmed = true;
+    }
+  }
+} // end namespace cling
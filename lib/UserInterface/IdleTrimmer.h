@@ -0,0 +1,78 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_IDLE_TRIMMER_H
+#define CLING_IDLE_TRIMMER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace cling {
+  class Interpreter;
+
+  ///\brief Calls Interpreter::trimMemory() once the prompt has waited for
+  /// input for a while, see CLING_IDLE_TRIM.
+  ///
+  /// The main thread brackets its uses of the interpreter with busy() and
+  /// idle(). A thread waits for the delay to pass without any, then trims
+  /// with the lock held, so that busy() waits for the trim to finish. It
+  /// trims once until the interpreter is used again.
+  ///
+  class IdleTrimmer {
+    Interpreter& m_Interp;
+    const std::chrono::milliseconds m_Delay;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_Wake;
+    bool m_Busy = true;
+    bool m_Trimmed = false;
+    bool m_Stop = false;
+    ///\brief Counts the calls of busy() and idle(), for the thread to see
+    /// whether the interpreter was used while it waited.
+    unsigned m_Generation = 0;
+
+    std::thread m_Thread;
+
+    ///\brief The loop of m_Thread.
+    void run();
+
+  public:
+    IdleTrimmer(Interpreter& Interp, std::chrono::milliseconds Delay);
+    ~IdleTrimmer();
+
+    ///\brief Whether CLING_IDLE_TRIM asks for a trimmer, and after how many
+    /// seconds of waiting.
+    static bool isEnabled(std::chrono::milliseconds& Delay);
+
+    ///\brief The main thread is about to use the interpreter; waits for a
+    /// trim in progress.
+    void busy();
+
+    ///\brief The main thread no longer uses the interpreter.
+    void idle();
+
+    ///\brief Marks the interpreter busy for a scope, on a null trimmer too.
+    class BusyRAII {
+      IdleTrimmer* m_Trimmer;
+
+    public:
+      BusyRAII(IdleTrimmer* Trimmer): m_Trimmer(Trimmer) {
+        if (m_Trimmer)
+          m_Trimmer->busy();
+      }
+      ~BusyRAII() {
+        if (m_Trimmer)
+          m_Trimmer->idle();
+      }
+    };
+  };
+} // end namespace cling
+
+#endif // CLING_IDLE_TRIMMER_H
@@ -9,21 +9,34 @@
 
 #include "cling/UserInterface/UserInterface.h"
 
+#include "HeaderPreloader.h"
+#include "IdleTrimmer.h"
+
 #include "cling/Interpreter/Exception.h"
 #include "cling/MetaProcessor/MetaProcessor.h"
 #include "cling/Utils/Output.h"
 #include "textinput/Callbacks.h"
+#include "textinput/History.h"
 #include "textinput/TextInput.h"
+#include "textinput/TextInputContext.h"
 #include "textinput/StreamReader.h"
 #include "textinput/TerminalDisplay.h"
 
 #include "llvm/ADT/SmallString.h"
+#include "llvm/Config/llvm-config.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/Path.h"
 
 #include "clang/Basic/LangOptions.h"
 #include "clang/Frontend/CompilerInstance.h"
 
+#include <algorithm>
+#include <cstring>
+
+#ifdef LLVM_ON_UNIX
+#include <signal.h>
+#endif
+
 namespace {
   ///\brief Class that specialises the textinput TabCompletion to allow Cling
   /// to code complete through its own textinput mechanism which is part of the
@@ -31,21 +44,117 @@ namespace {
   ///
   class UITabCompletion : public textinput::TabCompletion {
     const cling::Interpreter& m_ParentInterpreter;
+    cling::IdleTrimmer* m_Trimmer;
   
   public:
-    UITabCompletion(const cling::Interpreter& Parent) :
-                    m_ParentInterpreter(Parent) {}
+    UITabCompletion(const cling::Interpreter& Parent,
+                    cling::IdleTrimmer* Trimmer) :
+                    m_ParentInterpreter(Parent), m_Trimmer(Trimmer) {}
     ~UITabCompletion() {}
 
     bool Complete(textinput::Text& Line /*in+out*/,
                   size_t& Cursor /*in+out*/,
                   textinput::EditorRange& R /*out*/,
                   std::vector<std::string>& Completions /*out*/) override {
+      cling::IdleTrimmer::BusyRAII Busy(m_Trimmer);
       m_ParentInterpreter.codeComplete(Line.GetText(), Cursor, Completions);
       return true;
     }
   };
 
+  ///\brief Passes the line being typed to the HeaderPreloader.
+  ///
+  class UIEditWatcher : public textinput::EditWatcher {
+    cling::HeaderPreloader& m_Preloader;
+    cling::IdleTrimmer* m_Trimmer;
+
+  public:
+    UIEditWatcher(cling::HeaderPreloader& Preloader,
+                  cling::IdleTrimmer* Trimmer) :
+                  m_Preloader(Preloader), m_Trimmer(Trimmer) {}
+
+    void OnEdit(const std::string& Line) override {
+      cling::IdleTrimmer::BusyRAII Busy(m_Trimmer);
+      m_Preloader.onEdit(Line);
+    }
+  };
+
+  ///\brief Processes lines pasted at once: the code between the meta
+  /// commands as one input, each meta command on its own as if typed.
+  ///
+  ///\returns What MetaProcessor::process() returned last.
+  ///
+  static int processPaste(cling::MetaProcessor& MP, llvm::StringRef Lines,
+                          cling::Interpreter::CompilationResult& compRes) {
+    int indent = 0;
+    size_t codeBegin = 0;
+    for (size_t lineBegin = 0; lineBegin <= Lines.size();) {
+      const size_t lineEnd = std::min(Lines.find('\n', lineBegin),
+                                      Lines.size());
+      const llvm::StringRef Line = Lines.slice(lineBegin, lineEnd);
+      if (Line.ltrim().startswith(".")) {
+        if (codeBegin < lineBegin) {
+          indent = MP.process(Lines.slice(codeBegin, lineBegin - 1), compRes);
+          if (indent < 0)
+            return indent;
+        }
+        indent = MP.process(Line, compRes);
+        if (indent < 0)
+          return indent;
+        codeBegin = lineEnd + 1;
+      }
+      lineBegin = lineEnd + 1;
+    }
+    if (codeBegin < Lines.size())
+      indent = MP.process(Lines.substr(codeBegin), compRes);
+    return indent;
+  }
+
+#ifdef LLVM_ON_UNIX
+  ///\brief Makes SIGINT cancel the compilation of the input being processed,
+  /// see Interpreter::cancelCompilation(). Once it is cancelled, e.g. if
+  /// the input's code runs already, the next SIGINT does what it did before.
+  ///
+  class CancelOnInterruptRAII {
+    static cling::Interpreter* s_Interp;
+    static struct sigaction s_Prev;
+    bool m_Installed = false;
+
+    static void handle(int Sig) {
+      if (!s_Interp->isCompilationCancelled()) {
+        s_Interp->cancelCompilation();
+        return;
+      }
+      ::sigaction(SIGINT, &s_Prev, nullptr);
+      ::raise(Sig);
+    }
+
+  public:
+    CancelOnInterruptRAII(cling::Interpreter* Interp) {
+      if (!Interp)
+        return;
+      s_Interp = Interp;
+      struct sigaction SA;
+      ::memset(&SA, 0, sizeof(SA));
+      SA.sa_handler = &handle;
+      ::sigemptyset(&SA.sa_mask);
+      m_Installed = !::sigaction(SIGINT, &SA, &s_Prev);
+    }
+
+    ~CancelOnInterruptRAII() {
+      if (m_Installed)
+        ::sigaction(SIGINT, &s_Prev, nullptr);
+    }
+  };
+
+  cling::Interpreter* CancelOnInterruptRAII::s_Interp = nullptr;
+  struct sigaction CancelOnInterruptRAII::s_Prev;
+#else
+  struct CancelOnInterruptRAII {
+    CancelOnInterruptRAII(cling::Interpreter*) {}
+  };
+#endif
+
   ///\brief Delays ~TextInput until after ~StreamReader and ~TerminalDisplay
   ///
   class TextInputHolder {
@@ -89,14 +198,41 @@ namespace cling {
         llvm::sys::path::append(histfilePath, ".cling_history");
     }
 
+    // Give the memory the interpreter can do without back while it waits.
+    std::unique_ptr<IdleTrimmer> Trimmer;
+    std::chrono::milliseconds TrimDelay;
+    if (IdleTrimmer::isEnabled(TrimDelay))
+      Trimmer.reset(new IdleTrimmer(m_MetaProcessor->getInterpreter(),
+                                    TrimDelay));
+
+    // Read the headers the input is about to include while it is typed.
+    std::unique_ptr<HeaderPreloader> Preloader;
+    std::unique_ptr<UIEditWatcher> Watcher;
+    if (!getenv("CLING_NOPRELOAD")) {
+      Preloader.reset(new HeaderPreloader(m_MetaProcessor->getInterpreter()));
+      Watcher.reset(new UIEditWatcher(*Preloader, Trimmer.get()));
+    }
+
     TextInputHolder TI(histfilePath);
 
     // Inform text input about the code complete consumer
     // TextInput owns the TabCompletion.
     UITabCompletion* Completion =
-                      new UITabCompletion(m_MetaProcessor->getInterpreter());
+      new UITabCompletion(m_MetaProcessor->getInterpreter(), Trimmer.get());
     TI->SetCompletion(Completion);
 
+    if (Watcher) {
+      TI->SetEditWatcher(Watcher.get());
+      const textinput::History* Hist = TI->GetContext()->GetHistory();
+      for (size_t I = 0, N = std::min(Hist->GetSize(), size_t(200)); I < N;
+           ++I)
+        Preloader->addHistoryLine(Hist->GetLine(I));
+    }
+
+    // Ctrl-C cancels a long compilation instead of ending the session.
+    cling::Interpreter* Cancellable = getenv("CLING_NOCANCEL")
+      ? nullptr : &m_MetaProcessor->getInterpreter();
+
     bool Done = false;
     std::string Line;
     std::string Prompt("[cling]$ ");
@@ -107,14 +243,25 @@ namespace cling {
         {
           MetaProcessor::MaybeRedirectOutputRAII RAII(*m_MetaProcessor);
           TI->SetPrompt(Prompt.c_str());
+          if (Trimmer)
+            Trimmer->idle();
           Done = TI->ReadInput() == textinput::TextInput::kRREOF;
+          if (Trimmer)
+            Trimmer->busy();
           TI->TakeInput(Line);
           if (Done && Line.empty())
             break;
         }
 
         cling::Interpreter::CompilationResult compRes;
-        const int indent = m_MetaProcessor->process(Line, compRes);
+        int indent;
+        {
+          CancelOnInterruptRAII CancelOnInterrupt(Cancellable);
+          // Only a paste has more than one line.
+          indent = Line.find('\n') == std::string::npos
+            ? m_MetaProcessor->process(Line, compRes)
+            : processPaste(*m_MetaProcessor, Line, compRes);
+        }
 
         // Quit requested?
         if (indent < 0)
@@ -42,6 +42,14 @@ namespace textinput {
                            EditorRange& R /*out*/) = 0;
     virtual ~FunKey();
   };
+
+  class EditWatcher {
+  public:
+    // Called with the line after each edit while the input is being read,
+    // e.g. to prepare for it while the user is typing.
+    virtual void OnEdit(const std::string& Line /*in*/) = 0;
+    virtual ~EditWatcher();
+  };
 }
 
 #endif // TEXTINPUT_COMPLETION_H
@@ -56,6 +56,7 @@ namespace textinput {
     virtual void DisplayInfo(const std::vector<std::string>& Options) = 0;//Info
     virtual void Attach() {} // Take control e.g. of the terminal
     virtual void Detach() {} // Allow others to control terminal's parameters
+    virtual void Flush() {} // Write out the output buffered so far
 
   private:
     const TextInputContext* fContext; // Context object
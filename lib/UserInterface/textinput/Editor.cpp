@@ -114,12 +114,7 @@ namespace textinput {
       if (startAt == (size_t) -1) {
         startAt = 0;
       }
-      for (size_t i = startAt, n = Hist->GetSize(); i < n; ++i) {
-        if (Hist->GetLine(i).find(fSearch) != std::string::npos) {
-          NewHistEntry = i;
-          break;
-        }
-      }
+      NewHistEntry = Hist->FindLine(fSearch, startAt);
     }
     if (NewHistEntry != (size_t) -1) {
       // No, even if they are unchanged: we might have
@@ -195,6 +190,22 @@ namespace textinput {
     return kPRSuccess;
   }
 
+  Editor::EProcessResult
+  Editor::Insert(const std::string& T, EditorRange& R) {
+    // Insert e.g. a paste as one edit, to be undone at once.
+    CancelSpecialInputMode(R.fDisplay);
+    PushUndo();
+    ClearPasteBuf();
+
+    Text& Line = fContext->GetLine();
+    size_t Cursor = fContext->GetCursor();
+    Line.insert(Cursor, T);
+    R.fEdit.Extend(Range(Cursor, T.length()));
+    R.fDisplay.Extend(Range(Cursor, Range::End()));
+    fContext->SetCursor(Cursor + T.length());
+    return kPRSuccess;
+  }
+
   Editor::EProcessResult
   Editor::ProcessMove(EMoveID M, EditorRange &R) {
     if (fMode == kHistSearchMode) {
@@ -544,4 +555,5 @@ namespace textinput {
    // Pin vtables:
    TabCompletion::~TabCompletion() {}
    FunKey::~FunKey() {}
+   EditWatcher::~EditWatcher() {}
 }
@@ -128,6 +128,7 @@ namespace textinput {
 
     Range ResetText();
     EProcessResult Process(Command Cmd, EditorRange& R);
+    EProcessResult Insert(const std::string& T, EditorRange& R);
 
     const Text& GetEditorPrompt() const { return fEditorPrompt; }
     void SetEditorPrompt(const Text& EP) { fEditorPrompt = EP; }
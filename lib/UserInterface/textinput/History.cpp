@@ -14,28 +14,341 @@
 //===----------------------------------------------------------------------===//
 
 #include "textinput/History.h"
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <iterator>
 #include <sstream>
+#include <stdint.h>
 
 #ifdef WIN32
 # include <stdio.h>
 extern "C" unsigned long __stdcall GetCurrentProcessId(void);
 #else
+# include <fcntl.h>
+# include <sys/file.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
 # include <unistd.h>
 #endif
 
 namespace textinput {
+  // The lines of the history file as it was at startup. The file is mapped
+  // and its lines are found through an index of their offsets, kept in
+  // <file>.idx: each start only indexes the lines appended since the
+  // previous one, the lines themselves are read when they are needed.
+  class History::FileLines {
+  public:
+    static FileLines* Open(const std::string& fileName);
+    ~FileLines();
+
+    size_t GetSize() const { return fNumIndexed + fTail.size(); }
+    // Line I, 0 being the oldest.
+    std::string GetLine(size_t I) const {
+      const Entry& E = GetEntry(I);
+      return std::string(fData + E.fBegin, E.fEnd - E.fBegin);
+    }
+    // The newest line before line End containing what, -1 if none.
+    size_t FindBefore(const std::string& what, size_t End) const;
+
+  private:
+    struct Entry {
+      uint64_t fBegin; // Offset of the first character of the line
+      uint64_t fEnd; // Offset after its last character, but '\r'
+    };
+    struct IndexHeader {
+      char fMagic[8];
+      uint64_t fHeadSize; // Number of bytes hashed at the start of the file
+      uint64_t fHeadHash; // Identifies the file: pruning rewrites its start
+      uint64_t fCovered; // Size of the file that is indexed
+      uint64_t fNumEntries; // Number of entries that follow
+    };
+
+    FileLines(): fData(0), fSize(0), fIndex(0), fIndexSize(0),
+                 fNumIndexed(0) {}
+
+    static uint64_t HashHead(const char* Data, size_t Size) {
+      // FNV-1a
+      uint64_t Hash = 14695981039346656037ULL;
+      for (size_t i = 0; i < Size; ++i)
+        Hash = (Hash ^ (unsigned char)Data[i]) * 1099511628211ULL;
+      return Hash;
+    }
+    const Entry& GetEntry(size_t I) const {
+      return I < fNumIndexed ? fIndex[I] : fTail[I - fNumIndexed];
+    }
+    // Collects the non-empty lines of the file from Offset into fTail.
+    void Scan(size_t Offset, bool CompleteOnly);
+    // Reads and extends the index, then maps it.
+    void UpdateIndex(const std::string& IndexName);
+
+    const char* fData; // Mapping of the file
+    size_t fSize;
+    const Entry* fIndex; // Mapping of the index entries
+    size_t fIndexSize; // Size of the mapping of the index, with the header
+    size_t fNumIndexed; // Number of entries in fIndex
+    std::vector<Entry> fTail; // Lines not in the index
+  };
+
+  static const char sIndexMagic[8] = {'t','i','h','i','s','t','1','\0'};
+
+  History::FileLines*
+  History::FileLines::Open(const std::string& fileName) {
+#ifdef WIN32
+    // Read by History::ReadFile() instead.
+    return 0;
+#else
+    int FD = ::open(fileName.c_str(), O_RDONLY);
+    if (FD == -1) return 0;
+    struct stat St;
+    if (::fstat(FD, &St) || !S_ISREG(St.st_mode) || !St.st_size) {
+      ::close(FD);
+      return 0;
+    }
+    void* Data = ::mmap(0, St.st_size, PROT_READ, MAP_SHARED, FD, 0);
+    ::close(FD);
+    if (Data == MAP_FAILED) return 0;
+
+    FileLines* Lines = new FileLines();
+    Lines->fData = (const char*) Data;
+    Lines->fSize = St.st_size;
+    Lines->UpdateIndex(fileName + ".idx");
+    return Lines;
+#endif
+  }
+
+  History::FileLines::~FileLines() {
+#ifndef WIN32
+    if (fIndex)
+      ::munmap((void*)((const char*)fIndex - sizeof(IndexHeader)), fIndexSize);
+    if (fData)
+      ::munmap((void*)fData, fSize);
+#endif
+  }
+
+  void
+  History::FileLines::Scan(size_t Offset, bool CompleteOnly) {
+    while (Offset < fSize) {
+      const char* Begin = fData + Offset;
+      const char* NL = (const char*) ::memchr(Begin, '\n', fSize - Offset);
+      if (!NL && CompleteOnly) return;
+      const char* End = NL ? NL : fData + fSize;
+      const size_t Next = End - fData + (NL ? 1 : 0);
+      while (End > Begin && End[-1] == '\r') --End;
+      if (End > Begin) {
+        Entry E = { (uint64_t) Offset, (uint64_t) (End - fData) };
+        fTail.push_back(E);
+      }
+      Offset = Next;
+    }
+  }
+
+  void
+  History::FileLines::UpdateIndex(const std::string& IndexName) {
+#ifndef WIN32
+    // Without an index, e.g. in a read-only directory, scan all of the file.
+    int FD = ::open(IndexName.c_str(), O_RDWR | O_CREAT, 0600);
+    if (FD == -1 || ::flock(FD, LOCK_EX)) {
+      if (FD != -1) ::close(FD);
+      Scan(0, false);
+      return;
+    }
+
+    IndexHeader Header;
+    struct stat St;
+    ::memset(&St, 0, sizeof(St));
+    const size_t HeadSize = std::min(fSize, (size_t) 4096);
+    bool Valid = !::fstat(FD, &St) && St.st_size >= (off_t) sizeof(Header)
+      && ::pread(FD, &Header, sizeof(Header), 0) == sizeof(Header)
+      && !::memcmp(Header.fMagic, sIndexMagic, sizeof(sIndexMagic))
+      && Header.fHeadSize <= fSize
+      && Header.fHeadHash == HashHead(fData, Header.fHeadSize)
+      && Header.fCovered <= fSize
+      && (!Header.fCovered || fData[Header.fCovered - 1] == '\n')
+      && (uint64_t) St.st_size
+           >= sizeof(Header) + Header.fNumEntries * sizeof(Entry);
+    if (!Valid) {
+      // New, or the file was rewritten: start over. Other sessions might
+      // have mapped the index; replace it rather than truncating it.
+      if (St.st_size) {
+        std::stringstream TmpName;
+        TmpName << IndexName << ".tmp" << ::getpid();
+        int NewFD = ::open(TmpName.str().c_str(),
+                           O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (NewFD != -1 && (::flock(NewFD, LOCK_EX)
+                            || ::rename(TmpName.str().c_str(),
+                                        IndexName.c_str()))) {
+          ::unlink(TmpName.str().c_str());
+          ::close(NewFD);
+          NewFD = -1;
+        }
+        ::close(FD);
+        if (NewFD == -1) {
+          Scan(0, false);
+          return;
+        }
+        FD = NewFD;
+      }
+      ::memcpy(Header.fMagic, sIndexMagic, sizeof(sIndexMagic));
+      Header.fHeadSize = HeadSize;
+      Header.fHeadHash = HashHead(fData, HeadSize);
+      Header.fCovered = 0;
+      Header.fNumEntries = 0;
+    }
+
+    // Index the complete lines appended since, then add the last, incomplete
+    // one (another session might be writing it) in memory only.
+    size_t Covered = fSize;
+    while (Covered > Header.fCovered && fData[Covered - 1] != '\n')
+      --Covered;
+    Scan(Header.fCovered, true);
+    const off_t EntriesAt = sizeof(Header) + Header.fNumEntries * sizeof(Entry);
+    const size_t NewSize = fTail.size() * sizeof(Entry);
+    bool Written = !::ftruncate(FD, EntriesAt)
+      && (!NewSize
+          || ::pwrite(FD, &fTail[0], NewSize, EntriesAt) == (ssize_t) NewSize);
+    if (Written) {
+      Header.fCovered = Covered;
+      Header.fNumEntries += fTail.size();
+      Written = ::pwrite(FD, &Header, sizeof(Header), 0) == sizeof(Header);
+    }
+    if (Written) {
+      fIndexSize = sizeof(Header) + Header.fNumEntries * sizeof(Entry);
+      void* Map = ::mmap(0, fIndexSize, PROT_READ, MAP_SHARED, FD, 0);
+      if (Map != MAP_FAILED) {
+        fIndex = (const Entry*)((const char*) Map + sizeof(Header));
+        fNumIndexed = Header.fNumEntries;
+        fTail.clear();
+      }
+    }
+    ::flock(FD, LOCK_UN);
+    ::close(FD);
+
+    if (!fIndex) {
+      // Keep the lines in memory then.
+      fTail.clear();
+      Scan(0, true);
+    }
+    Scan(Covered, false);
+#endif
+  }
+
+  size_t
+  History::FileLines::FindBefore(const std::string& what, size_t End) const {
+    if (what.empty() || !End || End > GetSize()) return (size_t) -1;
+    // Search the mapped text backwards, from the end of line End - 1; a
+    // match belongs to the entry it starts in, if it ends there too.
+    typedef std::reverse_iterator<const char*> RevIter;
+    const char* Begin = fData;
+    const char* Last = fData + GetEntry(End - 1).fEnd;
+    while (Last - Begin >= (ptrdiff_t) what.size()) {
+      RevIter I = std::search(RevIter(Last), RevIter(Begin),
+                              what.rbegin(), what.rend());
+      if (I == RevIter(Begin)) break;
+      const char* Match = I.base() - what.size();
+      // The last entry starting at or before Match.
+      size_t Lo = 0, Hi = End;
+      while (Hi - Lo > 1) {
+        const size_t Mid = Lo + (Hi - Lo) / 2;
+        if (fData + GetEntry(Mid).fBegin <= Match)
+          Lo = Mid;
+        else
+          Hi = Mid;
+      }
+      const Entry& E = GetEntry(Lo);
+      if (fData + E.fBegin <= Match
+          && Match + what.size() <= fData + E.fEnd)
+        return Lo;
+      Last = Match + what.size() - 1;
+    }
+    return (size_t) -1;
+  }
+
   History::History(const char* filename):
     fHistFileName(filename ? filename : ""), fMaxDepth((size_t) -1),
-    fPruneLength(0), fNumHistFileLines(0) {
+    fPruneLength(0), fNumHistFileLines(0), fFileLines(0) {
     // Create a history object, initialize from filename if the file
     // exists. Append new lines to filename taking into account the
     // maximal number of lines allowed by SetMaxDepth().
-    if (filename) ReadFile(filename);
+    if (filename) {
+      fFileLines = FileLines::Open(fHistFileName);
+      if (fFileLines)
+        fNumHistFileLines = fFileLines->GetSize();
+      else
+        ReadFile(filename);
+    }
+  }
+
+  History::~History() {
+    delete fFileLines;
+  }
+
+  size_t
+  History::GetNumFileLines() const {
+    return fFileLines ? fFileLines->GetSize() : 0;
+  }
+
+  const std::string&
+  History::GetLine(size_t Idx) const {
+    static const std::string sEmpty;
+    if (Idx >= GetSize())
+      return sEmpty;
+    if (Idx < fEntries.size())
+      return fEntries[fEntries.size() - 1 - Idx];
+    const size_t FileIdx = GetNumFileLines() - 1 - (Idx - fEntries.size());
+    std::map<size_t, std::string>::iterator I
+      = fFileLineCache.find(FileIdx);
+    if (I == fFileLineCache.end())
+      I = fFileLineCache.insert(std::make_pair(FileIdx,
+                                    fFileLines->GetLine(FileIdx))).first;
+    return I->second;
   }
 
-  History::~History() {}
+  void
+  History::ModifyLine(size_t Idx, const char* line) {
+    // Does not sync to file!
+    if (Idx < fEntries.size())
+      fEntries[fEntries.size() - 1 - Idx] = line;
+    else if (Idx < GetSize())
+      fFileLineCache[GetNumFileLines() - 1 - (Idx - fEntries.size())] = line;
+  }
+
+  size_t
+  History::FindLine(const std::string& what, size_t Idx) const {
+    for (; Idx < fEntries.size(); ++Idx) {
+      if (GetLine(Idx).find(what) != std::string::npos)
+        return Idx;
+    }
+    if (Idx >= GetSize())
+      return (size_t) -1;
+
+    // Lines of the file, newest first: search the file for those that are
+    // as they were, and the cache for those that were modified.
+    const size_t NumFileLines = GetNumFileLines();
+    const size_t End = NumFileLines - (Idx - fEntries.size());
+    size_t Found = End;
+    do {
+      Found = fFileLines->FindBefore(what, Found);
+      std::map<size_t, std::string>::const_iterator I
+        = fFileLineCache.find(Found);
+      if (I == fFileLineCache.end() || I->second.find(what) != std::string::npos)
+        break;
+    } while (Found != (size_t) -1);
+    for (std::map<size_t, std::string>::const_reverse_iterator
+           I(fFileLineCache.lower_bound(End)), E = fFileLineCache.rend();
+         I != E; ++I) {
+      if (Found != (size_t) -1 && I->first <= Found)
+        break;
+      if (I->second.find(what) != std::string::npos) {
+        Found = I->first;
+        break;
+      }
+    }
+    if (Found == (size_t) -1)
+      return (size_t) -1;
+    return fEntries.size() + NumFileLines - 1 - Found;
+  }
 
   void
   History::AddLine(const std::string& line) {
@@ -17,6 +17,7 @@
 #define TEXTINPUT_HISTORY_H
 
 #include <cstddef>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -37,29 +38,30 @@ namespace textinput {
       fPruneLength = pruneLength; }
 
     // Indices are reverse! I.e. 0 is newest!
-    const std::string& GetLine(size_t Idx) const {
-      static const std::string sEmpty;
-      if (Idx == (size_t)-1 || fEntries.empty())
-         return sEmpty;
-      return fEntries[fEntries.size() - 1 - Idx];
-    }
-    size_t GetSize() const { return fEntries.size(); }
+    const std::string& GetLine(size_t Idx) const;
+    size_t GetSize() const { return fEntries.size() + GetNumFileLines(); }
 
     void AddLine(const std::string& line);
-    void ModifyLine(size_t Idx, const char* line) {
-      fEntries[fEntries.size() - 1 - Idx] = line;
-      // Does not sync to file!
-    }
+    void ModifyLine(size_t Idx, const char* line);
+
+    // Index of the newest line at Idx or older containing what, -1 if none.
+    size_t FindLine(const std::string& what, size_t Idx) const;
 
     void AppendToFile();
     void ReadFile(const char* FileName);
 
   private:
+    class FileLines;
+    size_t GetNumFileLines() const;
+
     std::string fHistFileName; // History file name
     size_t fMaxDepth; // Max number of entries before pruning
     size_t fPruneLength; // Remaining entries after pruning
     size_t fNumHistFileLines; // Hist file's number of lines at previous access
     std::vector<std::string> fEntries; // Previous input lines
+    FileLines* fFileLines; // Lines of the hist file at startup, older
+    // Lines of fFileLines read or modified so far, by line number
+    mutable std::map<size_t, std::string> fFileLineCache;
   };
 }
 
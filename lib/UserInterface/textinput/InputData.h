@@ -52,6 +52,7 @@ namespace textinput {
       kEIF12,
       kEIEOF,
       kEIResizeEvent,
+      kEIPaste, // a bracketed paste, see Reader::TakePaste()
       kEIIgnore
     };
 
@@ -17,6 +17,7 @@
 
 #include "textinput/InputData.h"
 #include <cstddef>
+#include <string>
 
 namespace textinput {
   class TextInputContext;
@@ -38,6 +39,8 @@ namespace textinput {
     virtual bool HavePendingInput(bool wait) = 0;
     virtual bool HaveBufferedInput() const { return false; }
     virtual bool ReadInput(size_t& nRead, InputData& in) = 0;
+    // The text of the kEIPaste input just read.
+    virtual std::string TakePaste() { return std::string(); }
 
     virtual bool IsFromTTY() = 0;
   private:
@@ -22,9 +22,7 @@
 #include <unistd.h>
 #include <termios.h>
 #include <stdio.h>
-#ifdef __APPLE__
 #include <errno.h> // For EINTR
-#endif
 
 #include <cctype>
 #include <cstring>
@@ -161,6 +159,7 @@ namespace textinput {
     // set to raw i.e. unbuffered
     if (fHaveInputFocus) return;
     TerminalConfigUnix::Get().Attach();
+    SetBracketedPaste(true);
     fHaveInputFocus = true;
   }
 
@@ -170,10 +169,25 @@ namespace textinput {
   StreamReaderUnix::ReleaseInputFocus() {
     // set to buffered
     if (!fHaveInputFocus) return;
+    SetBracketedPaste(false);
     TerminalConfigUnix::Get().Detach();
     fHaveInputFocus = false;
   }
 
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Ask the terminal to mark what gets pasted, such that a paste can be
+  /// inserted at once instead of key by key. Terminals that do not know the
+  /// mode ignore it.
+  ///
+  /// \param[in] enable whether pastes are marked from now on
+  void
+  StreamReaderUnix::SetBracketedPaste(bool enable) {
+    if (!fIsTTY || !isatty(fileno(stdout))) return;
+    const char* seq = enable ? "\033[?2004h" : "\033[?2004l";
+    ssize_t ret = write(fileno(stdout), seq, 8);
+    (void)ret;
+  }
+
   ////////////////////////////////////////////////////////////////////////////////
   /// Test or wait for available input
   ///
@@ -216,6 +230,7 @@ namespace textinput {
       gExtKeyMap['[']['4']['~'] = InputData::kEIEnd;
       gExtKeyMap['[']['5']['~'] = InputData::kEIPgUp;
       gExtKeyMap['[']['6']['~'] = InputData::kEIPgDown;
+      gExtKeyMap['[']['2']['0']['0']['~'] = InputData::kEIPaste;
       gExtKeyMap['[']['1'][';']['5']['A'].Set(InputData::kEIUp,
                                          InputData::kModCtrl);
       gExtKeyMap['[']['1'][';']['5']['B'].Set(InputData::kEIDown,
@@ -273,6 +288,8 @@ namespace textinput {
       if (GetContext()->GetKeyBinding()->IsEscCommandEnabled()
           || !ProcessCSI(in)) {
         in.SetExtended(InputData::kEIEsc);
+      } else if (in.GetExtendedInput() == InputData::kEIPaste) {
+        ReadPaste(nRead);
       }
     } else if (isprint(c)) { // c >= 0x20(32) && c < 0x7f(127)
       in.SetRaw(c);
@@ -291,6 +308,56 @@ namespace textinput {
     return true;
   }
 
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Read the text of a bracketed paste, up to the ESC [ 201 ~ that ends it,
+  /// in blocks rather than character by character.
+  ///
+  /// \param[in] nRead number of already read characters, incremented
+  void
+  StreamReaderUnix::ReadPaste(size_t& nRead) {
+    static const char kEnd[] = "\033[201~";
+    const size_t kEndLen = sizeof(kEnd) - 1;
+    fPaste.clear();
+    char buf[4096];
+    size_t avail = 0, pos = 0;
+    while (true) {
+      char c;
+      if (!fReadAheadBuffer.empty()) {
+        c = fReadAheadBuffer.front();
+        fReadAheadBuffer.pop();
+      } else {
+        if (pos == avail) {
+          ssize_t ret = read(fileno(stdin), buf, sizeof(buf));
+          if (ret == -1 && errno == EINTR) continue;
+          if (ret <= 0) return; // EOF; keep what was pasted
+          avail = ret;
+          pos = 0;
+        }
+        c = buf[pos++];
+      }
+      // Lines are entered with CR (INLCR), the input wants NL.
+      fPaste += c == 13 ? '\n' : c;
+      ++nRead;
+      if (c == '~' && fPaste.size() >= kEndLen
+          && !fPaste.compare(fPaste.size() - kEndLen, kEndLen, kEnd)) {
+        fPaste.resize(fPaste.size() - kEndLen);
+        break;
+      }
+    }
+    // What was typed after the paste.
+    for (; pos < avail; ++pos)
+      fReadAheadBuffer.push(buf[pos]);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the text of the last bracketed paste, and forget it.
+  std::string
+  StreamReaderUnix::TakePaste() {
+    std::string paste;
+    paste.swap(fPaste);
+    return paste;
+  }
+
   ////////////////////////////////////////////////////////////////////////////////
   /// Read one character from stdin. Block if not available.
   int
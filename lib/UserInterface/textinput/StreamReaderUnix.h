@@ -19,6 +19,7 @@
 #include "textinput/StreamReader.h"
 #include <cstddef>
 #include <queue>
+#include <string>
 
 namespace textinput {
   class InputData;
@@ -35,15 +36,19 @@ namespace textinput {
     bool HavePendingInput(bool wait) override;
     bool HaveBufferedInput() const override { return !fReadAheadBuffer.empty(); }
     bool ReadInput(size_t& nRead, InputData& in) override;
+    std::string TakePaste() override;
 
     bool IsFromTTY() override { return fIsTTY; }
   private:
     int ReadRawCharacter();
     bool ProcessCSI(InputData& in);
+    void ReadPaste(size_t& nRead);
+    void SetBracketedPaste(bool enable);
 
     bool fHaveInputFocus; // whether we configured the tty
     bool fIsTTY; // whether input FD is a tty
     std::queue<char> fReadAheadBuffer; // input chars we read too much (CSI)
+    std::string fPaste; // the text of the last bracketed paste
   };
 }
 
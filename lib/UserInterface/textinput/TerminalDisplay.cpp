@@ -46,11 +46,59 @@ namespace textinput {
   TerminalDisplay::NotifyTextChange(Range r) {
     if (!IsTTY()) return;
     Attach();
-    WriteWrapped(r.fPromptUpdate, GetContext()->GetTextInput()->IsInputMasked(),
-      r.fStart, r.fLength);
+    const bool masked = GetContext()->GetTextInput()->IsInputMasked();
+    Text Line = GetShownLine(masked);
+    if (r.fPromptUpdate != Range::kNoPromptUpdate || !fShownValid
+        || TrimUnchanged(r, Line)) {
+      WriteWrapped(r.fPromptUpdate, masked, r.fStart, r.fLength);
+    }
+    fShown = Line;
+    fShownValid = true;
     Move(GetCursor());
   }
 
+  ////////////////////////////////////////////////////////////////////////////////
+  /// The input line as it is displayed: masked or not, with its colors.
+  Text
+  TerminalDisplay::GetShownLine(bool masked) const {
+    const Text& Line = GetContext()->GetLine();
+    if (masked)
+      return Text(std::string(Line.length(), '*'), 0);
+    return Line;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Narrow the range r to the characters of Line that differ from those
+  /// displayed: the editor often asks to redraw up to the end of the line.
+  ///
+  /// \param[in,out] r Range to write out the line for.
+  /// \param[in] Line line to be displayed.
+  /// \return whether anything needs to be written.
+  bool
+  TerminalDisplay::TrimUnchanged(Range& r, const Text& Line) const {
+    const size_t Len = Line.length();
+    const size_t ShownLen = fShown.length();
+    const bool ToEnd = r.fLength == Range::End() || r.fStart + r.fLength >= Len;
+    size_t Start = r.fStart;
+    size_t End = ToEnd ? Len : r.fStart + r.fLength;
+    while (Start < End && Start < ShownLen && Line[Start] == fShown[Start]
+           && Line.GetColor(Start) == fShown.GetColor(Start))
+      ++Start;
+    if (ToEnd && Len != ShownLen) {
+      // Characters move, or need to be erased: write on to the end.
+      r.fStart = Start;
+      r.fLength = Range::End();
+      return true;
+    }
+    // Unchanged trailing characters stay where they are.
+    while (End > Start && End <= ShownLen && Line[End - 1] == fShown[End - 1]
+           && Line.GetColor(End - 1) == fShown.GetColor(End - 1))
+      --End;
+    r.fStart = Start;
+    r.fLength = End - Start;
+    return End > Start;
+  }
+
   ////////////////////////////////////////////////////////////////////////////////
   /// Notify the display that the cursor has been changed. Move to the cursor.
   void
@@ -70,6 +118,7 @@ namespace textinput {
     }
     fWriteLen = 0;
     fWritePos = Pos();
+    fShownValid = false;
   }
 
   ////////////////////////////////////////////////////////////////////////////////
@@ -110,6 +159,7 @@ namespace textinput {
   TerminalDisplay::Detach() {
     fWritePos = Pos();
     fWriteLen = 0;
+    fShownValid = false;
     if (GetContext()->GetColorizer()) {
       Color DefaultColor;
       GetContext()->GetColorizer()->GetColor(0, DefaultColor);
@@ -43,7 +43,8 @@ namespace textinput {
 
   protected:
     TerminalDisplay(bool isTTY):
-      fIsTTY(isTTY), fWidth(80), fWriteLen(0), fPrevColor(-1) {}
+      fIsTTY(isTTY), fWidth(80), fWriteLen(0), fPrevColor(-1),
+      fShownValid(false) {}
     void SetIsTTY(bool isTTY) { fIsTTY = isTTY; }
     Pos GetCursor() const {
       // Collect the different prompts and the text cursor to calculate
@@ -77,12 +78,18 @@ namespace textinput {
 
     virtual void EraseToRight() = 0;
 
+  private:
+    Text GetShownLine(bool masked) const;
+    bool TrimUnchanged(Range& r, const Text& Line) const;
+
   protected:
     bool fIsTTY; // whether this is a terminal or redirected
     size_t fWidth; // Width of the terminal in character columns
     size_t fWriteLen; // Length of output written.
     Pos fWritePos; // Current position of writing (temporarily != cursor)
     char fPrevColor; // currently configured color
+    Text fShown; // Input line as displayed, if fShownValid
+    bool fShownValid; // whether fShown is known
   };
 }
 #endif // TEXTINPUT_TERMINALDISPLAY_H
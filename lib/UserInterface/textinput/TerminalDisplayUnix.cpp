@@ -17,6 +17,7 @@
 
 #include "textinput/TerminalDisplayUnix.h"
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 // putenv not in cstdlib on Solaris
@@ -129,6 +130,7 @@ namespace textinput {
 
   TerminalDisplayUnix::~TerminalDisplayUnix() {
     Detach();
+    Flush();
     if (fOutputID != STDOUT_FILENO) {
       SYNC_OUT(fOutputID);
       ::close(fOutputID);
@@ -254,15 +256,35 @@ namespace textinput {
   }
 
   ////////////////////////////////////////////////////////////////////////////////
-  /// Writes out a raw string to stdout.
+  /// Buffers a raw string to be written out to stdout by Flush().
   ///
   /// \param[in] text raw string to be written out
   /// \param[in] len length of the raw string
   void
   TerminalDisplayUnix::WriteRawString(const char *text, size_t len) {
-    if (write(fOutputID, text, len) == -1) {
-      // Silence Ubuntu's "unused result". We don't care if it fails.
+    fOutput.append(text, len);
+    // Don't let a huge paste pile up.
+    if (fOutput.size() >= 64 * 1024)
+      Flush();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Writes out the buffered output in one write: over a remote connection,
+  /// each write can become a packet of its own.
+  void
+  TerminalDisplayUnix::Flush() {
+    const char* text = fOutput.data();
+    size_t len = fOutput.size();
+    while (len) {
+      ssize_t ret = write(fOutputID, text, len);
+      if (ret == -1) {
+        if (errno == EINTR) continue;
+        break; // We don't care if it fails.
+      }
+      text += ret;
+      len -= ret;
     }
+    fOutput.clear();
   }
 
   ////////////////////////////////////////////////////////////////////////////////
@@ -289,9 +311,10 @@ namespace textinput {
   void
   TerminalDisplayUnix::Detach() {
     if (!fIsAttached) return;
+    TerminalDisplay::Detach(); // might reset the color
+    Flush();
     SYNC_OUT(fOutputID);
     TerminalConfigUnix::Get().Detach();
-    TerminalDisplay::Detach();
     fIsAttached = false;
   }
 
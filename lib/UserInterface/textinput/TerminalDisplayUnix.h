@@ -17,6 +17,7 @@
 #define TEXTINPUT_TERMINALDISPLAYUNIX_H
 
 #include <cstddef>
+#include <string>
 #include "textinput/TerminalDisplay.h"
 
 namespace textinput {
@@ -32,6 +33,7 @@ namespace textinput {
 
     void Attach();
     void Detach();
+    void Flush();
 
   protected:
     void MoveUp(size_t nLines = 1);
@@ -51,6 +53,7 @@ namespace textinput {
     bool fIsAttached; // whether tty is configured
     size_t fNColors; // number of colors supported by output
     int fOutputID; // Prompt output file descriptor
+    std::string fOutput; // Output not written yet, see Flush()
   };
 }
 #endif // TEXTINPUT_TERMINALDISPLAYUNIX_H
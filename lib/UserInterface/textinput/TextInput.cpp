@@ -13,6 +13,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "textinput/TextInput.h"
+#include "textinput/Callbacks.h"
 #include "textinput/Color.h"
 #include "textinput/Display.h"
 #include "textinput/Editor.h"
@@ -37,7 +38,8 @@ namespace textinput {
   fMaxChars(0),
   fLastReadResult(kRRNone),
   fActive(false),
-  fNeedPromptRedraw(false)
+  fNeedPromptRedraw(false),
+  fPasteRestCursor(0)
   {
     fContext = new TextInputContext(this, HistFile);
     fContext->AddDisplay(display);
@@ -59,7 +61,23 @@ namespace textinput {
     while (!input.empty() && input[input.length() - 1] == 13) {
       input.erase(input.length() - 1);
     }
+    if (input.find('\n') != std::string::npos) {
+      // Pasted lines go to the history one by one.
+      if (!IsInputMasked() && IsAutoHistAddEnabled()) {
+        for (size_t pos = 0; pos <= input.length();) {
+          size_t eol = std::min(input.find('\n', pos), input.length());
+          AddHistoryLine(input.substr(pos, eol - pos).c_str());
+          pos = eol + 1;
+        }
+      }
+      fContext->GetLine().clear();
+    }
     fContext->GetEditor()->ResetText();
+    if (!fPasteRest.empty()) {
+      fContext->SetLine(fPasteRest);
+      fContext->SetCursor(fPasteRestCursor);
+      fPasteRest.clear();
+    }
 
     // Signal displays that the input got taken.
     std::for_each(fContext->GetDisplays().begin(), fContext->GetDisplays().end(),
@@ -123,8 +141,19 @@ namespace textinput {
              || (nRead < nMax && (*iR)->HavePendingInput(waitForInput))
              || (*iR)->HaveBufferedInput()) {
         if ((*iR)->ReadInput(nRead, in)) {
-          ProcessNewInput(in, R);
+          if (!in.IsRaw() && in.GetExtendedInput() == InputData::kEIPaste)
+            ProcessPaste((*iR)->TakePaste(), R);
+          else
+            ProcessNewInput(in, R);
           DisplayNewInput(R, OldCursorPos);
+          // Write out what this input changed at once; a paste is handled
+          // as one input.
+          if (!(*iR)->HaveBufferedInput()) {
+            FlushDisplays();
+            EditWatcher* EW = fContext->GetEditWatcher();
+            if (EW && fLastReadResult == kRRNone)
+              EW->OnEdit(fContext->GetLine().GetText());
+          }
           if (fLastReadResult == kRREOF
               || fLastReadResult == kRRReadEOLDelimiter)
             break;
@@ -139,9 +168,17 @@ namespace textinput {
         fLastReadResult = kRRNoMorePendingInput;
       }
     }
+    FlushDisplays();
     return fLastReadResult;
   }
 
+  void
+  TextInput::FlushDisplays() const {
+    // Write out what the displays buffered, before the application does.
+    std::for_each(fContext->GetDisplays().begin(), fContext->GetDisplays().end(),
+                  [](Display *D) { return D->Flush(); });
+  }
+
   void
   TextInput::ProcessNewInput(const InputData& in, EditorRange& R) {
     // in was read, process it.
@@ -187,6 +224,25 @@ namespace textinput {
     }
   }
 
+  void
+  TextInput::ProcessPaste(const std::string& paste, EditorRange& R) {
+    // A paste is inserted at once. If it has complete lines, the input
+    // ends after the last of them, and the rest is the next line.
+    size_t lastEOL = paste.rfind('\n');
+    if (lastEOL == std::string::npos) {
+      fContext->GetEditor()->Insert(paste, R);
+      return;
+    }
+    Text& Line = fContext->GetLine();
+    size_t Cursor = fContext->GetCursor();
+    fPasteRest = paste.substr(lastEOL + 1);
+    fPasteRestCursor = fPasteRest.length();
+    fPasteRest += Line.GetText().substr(Cursor);
+    Line.erase(Cursor, Line.length() - Cursor);
+    fContext->GetEditor()->Insert(paste.substr(0, lastEOL), R);
+    fLastReadResult = kRRReadEOLDelimiter;
+  }
+
   void
   TextInput::DisplayNewInput(EditorRange& R, size_t& oldCursorPos) {
     // Display what has been entered.
@@ -212,6 +268,7 @@ namespace textinput {
     GrabInputOutput();
     fNeedPromptRedraw = false;
     UpdateDisplay(EditorRange(Range::AllText(), Range::AllWithPrompt()));
+    FlushDisplays();
   }
 
   void
@@ -291,6 +348,10 @@ namespace textinput {
   TextInput::SetFunctionKeyHandler(FunKey* fc) {
     fContext->SetFunctionKeyHandler(fc);
   }
+  void
+  TextInput::SetEditWatcher(EditWatcher* ew) {
+    fContext->SetEditWatcher(ew);
+  }
 
   void
   TextInput::GrabInputOutput() const {
@@ -23,6 +23,7 @@ namespace textinput {
   class Colorizer;
   class Display;
   class EditorRange;
+  class EditWatcher;
   class FunKey;
   class InputData;
   class Reader;
@@ -59,6 +60,7 @@ namespace textinput {
     void SetColorizer(Colorizer* c);
     void SetCompletion(TabCompletion* tc);
     void SetFunctionKeyHandler(FunKey* fc);
+    void SetEditWatcher(EditWatcher* ew); // not owned
 
     void SetMaxPendingCharsToRead(size_t nMax) { fMaxChars = nMax; }
     void SetReadingAllPendingChars() { fMaxChars = (size_t) -1; }
@@ -89,8 +91,10 @@ namespace textinput {
     void AddHistoryLine(const char* line);
 
   private:
+    void FlushDisplays() const;
     void HandleControl(char c, EditorRange& r);
     void ProcessNewInput(const InputData& in, EditorRange& r);
+    void ProcessPaste(const std::string& paste, EditorRange& r);
     void DisplayNewInput(EditorRange& r, size_t& oldCursorPos);
 
     bool fMasked; // whether input should be shown
@@ -101,6 +105,8 @@ namespace textinput {
     TextInputContext* fContext; // context object
     mutable bool fActive; // whether textinput is controlling input/output
     bool fNeedPromptRedraw; // whether the prompt should be redrawn on next attach
+    std::string fPasteRest; // the next line, after a paste of complete lines
+    size_t fPasteRestCursor; // the cursor in fPasteRest
   };
 }
 #endif
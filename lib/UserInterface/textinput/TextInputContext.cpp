@@ -25,7 +25,7 @@
 textinput::TextInputContext::TextInputContext(TextInput* ti,
                                               const char* histFile):
 fTextInput(ti), fBind(0), fEdit(0), fSignal(0), fColor(0), fHist(0),
-fTabCompletion(0), fFunKey(0), fCursor(0) {
+fTabCompletion(0), fFunKey(0), fEditWatcher(0), fCursor(0) {
   fHist = new History(histFile);
   fEdit = new Editor(this);
   fBind = new KeyBinding();
@@ -23,6 +23,7 @@ namespace textinput {
   class Colorizer;
   class Display;
   class Editor;
+  class EditWatcher;
   class FunKey;
   class History;
   class KeyBinding;
@@ -48,9 +49,11 @@ namespace textinput {
     History* GetHistory() const { return fHist; }
     TabCompletion* GetCompletion() const { return fTabCompletion; }
     FunKey* GetFunctionKeyHandler() const { return fFunKey; }
+    EditWatcher* GetEditWatcher() const { return fEditWatcher; }
     void SetColorizer(Colorizer* C) { fColor = C; }
     void SetCompletion(TabCompletion* tc) { fTabCompletion = tc; }
     void SetFunctionKeyHandler(FunKey* fc) { fFunKey = fc; }
+    void SetEditWatcher(EditWatcher* ew) { fEditWatcher = ew; }
 
     const Text& GetPrompt() const { return fPrompt; }
     Text& GetPrompt() { return fPrompt; }
@@ -79,6 +82,7 @@ namespace textinput {
     History* fHist; // history to use
     TabCompletion* fTabCompletion; // Tab completion handler
     FunKey* fFunKey; // Function key handler
+    EditWatcher* fEditWatcher; // Notified of edits of the line
     Text fPrompt; // current prompt
     Text fLine; // current input
     size_t fCursor; // input cursor position in fLine
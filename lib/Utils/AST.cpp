@@ -188,6 +188,7 @@ namespace utils {
   }
 
   const char* const Synthesize::UniquePrefix = "__cling_Un1Qu3";
+  const char* const Synthesize::WrapperTail = "(void* vpClingValue) {\n ";
 
   IntegerLiteral* Synthesize::IntegerLiteralExpr(ASTContext& C, uintptr_t Ptr) {
     const llvm::APInt Addr(8 * sizeof(void*), Ptr);
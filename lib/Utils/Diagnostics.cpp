@@ -9,6 +9,13 @@
 
 #include "cling/Utils/Diagnostics.h"
 
+#include "cling/Utils/Output.h"
+
+#include "clang/Basic/SourceManager.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/raw_ostream.h"
+
 namespace cling {
 namespace utils {
 
@@ -61,5 +68,46 @@ DiagnosticsStore::Report(bool DoReset) {
     Reset();
 }
 
+void DiagnosticRecord::print(llvm::raw_ostream& Out) const {
+  switch (Level) {
+    case clang::DiagnosticsEngine::Ignored: Out << "ignored"; break;
+    case clang::DiagnosticsEngine::Note: Out << "note"; break;
+    case clang::DiagnosticsEngine::Remark: Out << "remark"; break;
+    case clang::DiagnosticsEngine::Warning: Out << "warning"; break;
+    case clang::DiagnosticsEngine::Error: Out << "error"; break;
+    case clang::DiagnosticsEngine::Fatal: Out << "fatal"; break;
+  }
+  Out << '\t' << ID << '\t' << File << ':' << Line << ':' << Column << '\t'
+      << Message << '\n';
+}
+
+void
+StructuredDiagnostics::HandleDiagnostic(clang::DiagnosticsEngine::Level Level,
+                                        const clang::Diagnostic& Info) {
+  // Keeps the counts of warnings and errors.
+  DiagnosticConsumer::HandleDiagnostic(Level, Info);
+  if (Level == clang::DiagnosticsEngine::Note && !m_Notes)
+    return;
+
+  llvm::SmallString<128> Message;
+  Info.FormatDiagnostic(Message);
+  DiagnosticRecord Record = {Level, Info.getID(), llvm::StringRef(), 0, 0,
+                             Message};
+  if (Info.getLocation().isValid() && Info.hasSourceManager()) {
+    clang::PresumedLoc PLoc
+      = Info.getSourceManager().getPresumedLoc(Info.getLocation());
+    if (PLoc.isValid()) {
+      Record.File = PLoc.getFilename();
+      Record.Line = PLoc.getLine();
+      Record.Column = PLoc.getColumn();
+    }
+  }
+
+  if (m_Callback)
+    m_Callback(Record);
+  else
+    Record.print(cling::errs());
+}
+
 } // namespace utils
 } // namespace cling
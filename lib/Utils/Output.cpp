@@ -9,22 +9,77 @@
 
 #include "cling/Utils/Output.h"
 
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Support/Format.h"
 #include "llvm/Support/Process.h"
-#include "llvm/Support/raw_os_ostream.h"
 
+#include <atomic>
 #include <iostream>
+#include <mutex>
+#include <thread>
 
 namespace cling {
   namespace utils {
 
     namespace {
-      class ColoredOutput : public llvm::raw_os_ostream {
-        bool m_Colorize = true;
+      ///\brief What the streams of all threads write to, a line at a time
+      /// for all but the thread that created it.
+      class SharedOutput {
+        std::ostream& m_Out;
+        std::mutex m_Mutex;
+
+      public:
+        const std::thread::id Owner;
+        std::atomic<bool> Colorize;
+
+        SharedOutput(std::ostream& Out)
+            : m_Out(Out), Owner(std::this_thread::get_id()), Colorize(true) {}
+
+        void write(const char* Ptr, size_t Size) {
+          std::lock_guard<std::mutex> Lock(m_Mutex);
+          m_Out.write(Ptr, Size);
+        }
+      };
+
+      class ColoredOutput : public llvm::raw_ostream {
+        SharedOutput& m_Shared;
+        ///\brief Whether to hold the last line until it is complete.
+        const bool m_Lines;
+        llvm::SmallString<128> m_Line;
+        uint64_t m_Pos = 0;
+
+        enum { kMaxLine = 4096 };
+
+        void write_impl(const char* Ptr, size_t Size) override {
+          m_Pos += Size;
+          if (!m_Lines) {
+            m_Shared.write(Ptr, Size);
+            return;
+          }
+          m_Line.append(Ptr, Ptr + Size);
+          // npos + 1 is 0: no newline.
+          size_t End = llvm::StringRef(m_Line).rfind('\n') + 1;
+          if (!End) {
+            if (m_Line.size() < kMaxLine)
+              return;
+            End = m_Line.size();
+          }
+          m_Shared.write(m_Line.data(), End);
+          m_Line.erase(m_Line.begin(), m_Line.begin() + End);
+        }
+
+        uint64_t current_pos() const override { return m_Pos; }
+
+        void writeLine() {
+          if (m_Line.empty())
+            return;
+          m_Shared.write(m_Line.data(), m_Line.size());
+          m_Line.clear();
+        }
 
         raw_ostream& changeColor(enum Colors colors, bool bold, bool bg) {
-          if (m_Colorize) {
-            if (llvm::sys::Process::ColorNeedsFlush()) flush();
+          if (m_Shared.Colorize) {
+            if (llvm::sys::Process::ColorNeedsFlush()) writeLine();
             if (const char* colorcode =
                     (colors == SAVEDCOLOR)
                         ? llvm::sys::Process::OutputBold(bg)
@@ -34,8 +89,8 @@ namespace cling {
           return *this;
         }
         raw_ostream& resetColor() {
-          if (m_Colorize) {
-            if (llvm::sys::Process::ColorNeedsFlush()) flush();
+          if (m_Shared.Colorize) {
+            if (llvm::sys::Process::ColorNeedsFlush()) writeLine();
             if (const char* colorcode = llvm::sys::Process::ResetColor())
               write(colorcode, ::strlen(colorcode));
           }
@@ -43,35 +98,53 @@ namespace cling {
         }
 
         raw_ostream& reverseColor() {
-          if (m_Colorize) {
-            if (llvm::sys::Process::ColorNeedsFlush()) flush();
+          if (m_Shared.Colorize) {
+            if (llvm::sys::Process::ColorNeedsFlush()) writeLine();
 
             if (const char* colorcode = llvm::sys::Process::OutputReverse())
               write(colorcode, ::strlen(colorcode));
           }
           return *this;
         }
-        bool has_colors() const { return m_Colorize; }
-        bool is_displayed() const { return m_Colorize; }
+        bool has_colors() const { return m_Shared.Colorize; }
+        bool is_displayed() const { return m_Shared.Colorize; }
       public:
 
-        ColoredOutput(std::ostream& Out, bool Unbufferd = true)
-            : raw_os_ostream(Out) {
-          if (Unbufferd) SetUnbuffered();
-        }
-        
-        bool Colors(bool C) { m_Colorize = C; return m_Colorize; }
+        ColoredOutput(SharedOutput& Shared, bool Lines)
+            : raw_ostream(/*unbuffered=*/true), m_Shared(Shared),
+              m_Lines(Lines) {}
+
+        ~ColoredOutput() { writeLine(); }
       };
+
+      SharedOutput& getSharedOut() {
+        static SharedOutput sOut(std::cout);
+        return sOut;
+      }
+
+      SharedOutput& getSharedErr() {
+        static SharedOutput sErr(std::cerr);
+        return sErr;
+      }
     } // anonymous namespace
 
     llvm::raw_ostream& outs() {
-      static ColoredOutput sOut(std::cout);
-      return sOut;
+      SharedOutput& Shared = getSharedOut();
+      static ColoredOutput sOut(Shared, /*Lines=*/false);
+      if (std::this_thread::get_id() == Shared.Owner)
+        return sOut;
+      // Written when the thread ends, if the last line is not complete.
+      static thread_local ColoredOutput tOut(Shared, /*Lines=*/true);
+      return tOut;
     }
 
     llvm::raw_ostream& errs() {
-      static ColoredOutput sErr(std::cerr);
-      return sErr;
+      SharedOutput& Shared = getSharedErr();
+      static ColoredOutput sErr(Shared, /*Lines=*/false);
+      if (std::this_thread::get_id() == Shared.Owner)
+        return sErr;
+      static thread_local ColoredOutput tErr(Shared, /*Lines=*/true);
+      return tErr;
     }
 
     llvm::raw_ostream& log() {
@@ -80,10 +153,9 @@ namespace cling {
 
     bool ColorizeOutput(unsigned Which) {
 #define COLOR_FLAG(Fv, Fn) (Which == 8 ? llvm::sys::Process::Fn() : Which & Fv)
-      return static_cast<ColoredOutput &>(outs()).Colors(
-                              COLOR_FLAG(1, StandardOutIsDisplayed)) |
-             static_cast<ColoredOutput &>(errs()).Colors(
-                              COLOR_FLAG(2, StandardErrIsDisplayed));
+      getSharedOut().Colorize = COLOR_FLAG(1, StandardOutIsDisplayed);
+      getSharedErr().Colorize = COLOR_FLAG(2, StandardErrIsDisplayed);
+      return getSharedOut().Colorize | getSharedErr().Colorize;
     }
   }
 }
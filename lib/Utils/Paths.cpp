@@ -11,6 +11,7 @@
 #include "cling/Utils/Output.h"
 #include "clang/Basic/FileManager.h"
 #include "clang/Lex/HeaderSearchOptions.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
@@ -294,8 +295,23 @@ bool SplitPaths(llvm::StringRef PathStr,
   return AllExisted;
 }
 
+std::string PathSet::getKey(llvm::StringRef Path) {
+  llvm::SmallString<256> Key;
+  // Relative paths change their meaning with the CWD.
+  if (llvm::sys::path::is_absolute(Path) &&
+      !llvm::sys::fs::real_path(Path, Key))
+    return Key.str().str();
+  Key = Path;
+  llvm::sys::path::remove_dots(Key);
+  while (Key.size() > 1 && llvm::sys::path::is_separator(Key.back()))
+    Key.pop_back();
+  if (Key.empty())
+    return ".";
+  return Key.str().str();
+}
+
 void AddIncludePaths(llvm::StringRef PathStr, clang::HeaderSearchOptions& HOpts,
-                     const char* Delim) {
+                     const char* Delim, PathSet* Known) {
 
   llvm::SmallVector<llvm::StringRef, 10> Paths;
   if (Delim && *Delim)
@@ -303,15 +319,17 @@ void AddIncludePaths(llvm::StringRef PathStr, clang::HeaderSearchOptions& HOpts,
   else
     Paths.push_back(PathStr);
 
+  PathSet Local;
+  if (!Known) {
+    Known = &Local;
+    for (const clang::HeaderSearchOptions::Entry& E : HOpts.UserEntries)
+      Local.insert(E.Path);
+  }
+
   // Avoid duplicates
   llvm::SmallVector<llvm::StringRef, 10> PathsChecked;
   for (llvm::StringRef Path : Paths) {
-    bool Exists = false;
-    for (const clang::HeaderSearchOptions::Entry& E : HOpts.UserEntries) {
-      if ((Exists = E.Path == Path))
-        break;
-    }
-    if (!Exists)
+    if (Known->insert(Path))
       PathsChecked.push_back(Path);
   }
 
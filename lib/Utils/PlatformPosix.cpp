@@ -13,16 +13,30 @@
 
 #include "cling/Utils/Paths.h"
 #include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 
 #include <array>
 #include <atomic>
+#include <mutex>
 #include <string>
 #include <cxxabi.h>
 #include <dlfcn.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <glob.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <string.h>
+#include <netdb.h>
 #include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
 
 // PATH_MAX
 #ifdef __APPLE__
@@ -40,45 +54,69 @@ namespace platform {
 namespace {
   struct PointerCheck {
   private:
-    // A simple round-robin cache: what enters first, leaves first.
-    // MRU cache wasn't worth the extra CPU cycles.
-    static thread_local std::array<const void*, 8> lines;
-    static thread_local unsigned mostRecent;
+    // The pages known to be mapped: a small open addressing set, probing
+    // kProbes slots from the page's hash. Caching pages rather than pointers
+    // makes walking an array or a node pool hit after the first access.
+    static constexpr unsigned kSlots = 64;
+    static constexpr unsigned kProbes = 4;
+    static thread_local std::array<size_t, kSlots> pages;
+    static thread_local unsigned victim;
     size_t page_size;
     size_t page_mask;
+    unsigned page_shift;
+
+    unsigned hash(size_t page) const {
+      return unsigned(((page >> page_shift) * 2654435761u) % kSlots);
+    }
 
     // Concurrent writes to the same cache element can result in invalid cache
     // elements, causing pointer address not being available in the cache even
     // though they should be, i.e. false cache misses. While can cause a
     // slow-down, the cost for keeping the cache thread-local or atomic is
     // much higher (yes, this was measured).
-    void push(const void* P) {
-      mostRecent = (mostRecent + 1) % lines.size();
-      lines[mostRecent] = P;
+    void push(size_t page, unsigned h) {
+      for (unsigned i = 0; i < kProbes; ++i) {
+        size_t& slot = pages[(h + i) % kSlots];
+        if (!slot) {
+          slot = page;
+          return;
+        }
+      }
+      // All taken: evict round-robin, what enters first, leaves first.
+      victim = (victim + 1) % kProbes;
+      pages[(h + victim) % kSlots] = page;
     }
 
   public:
-    PointerCheck() : page_size(::sysconf(_SC_PAGESIZE)), page_mask(~(page_size - 1))
+    PointerCheck() : page_size(::sysconf(_SC_PAGESIZE)), page_mask(~(page_size - 1)),
+                     page_shift(0)
     {
        assert(IsPowerOfTwo(page_size));
+       while ((size_t(1) << page_shift) < page_size)
+         ++page_shift;
     }
 
     bool operator () (const void* P) {
+      // Address of page containing P, assuming page_size is a power of 2.
+      const size_t page = ((size_t)P) & page_mask;
+      // Page 0 is never mapped, which lets 0 mark an empty slot.
+      if (!page)
+        return false;
+
+      const unsigned h = hash(page);
       // std::find is considerably slower, do manual search instead.
-      if (P == lines[0] || P == lines[1] || P == lines[2] || P == lines[3]
-          || P == lines[4] || P == lines[5] || P == lines[6] || P == lines[7])
+      static_assert(kProbes == 4, "Update the probes below!");
+      if (page == pages[h] || page == pages[(h + 1) % kSlots]
+          || page == pages[(h + 2) % kSlots] || page == pages[(h + 3) % kSlots])
         return true;
 
-      // Address of page containing P, assuming page_size is a power of 2
-      void *base = (void *)(((size_t)P) & page_mask);
-
       // P is invalid only when msync returns -1 and sets errno to ENOMEM
-      if (::msync(base, page_size, MS_ASYNC) != 0) {
+      if (::msync((void*)page, page_size, MS_ASYNC) != 0) {
         assert(errno == ENOMEM && "Unexpected error in call to msync()");
         return false;
       }
 
-      push(P);
+      push(page, h);
       return true;
     }
   private:
@@ -89,8 +127,9 @@ namespace {
        return n == 1;
     }
   };
-  thread_local std::array<const void*, 8> PointerCheck::lines = {{}};
-  thread_local unsigned PointerCheck::mostRecent = 0;
+  thread_local std::array<size_t, PointerCheck::kSlots> PointerCheck::pages
+    = {{}};
+  thread_local unsigned PointerCheck::victim = 0;
 }
 
 bool IsMemoryValid(const void *P) {
@@ -98,6 +137,87 @@ bool IsMemoryValid(const void *P) {
   return sPointerCheck(P);
 }
 
+bool AdviseHugePages(void* Addr, size_t Size) {
+#if defined(MADV_HUGEPAGE)
+  return ::madvise(Addr, Size, MADV_HUGEPAGE) == 0;
+#else
+  return false;
+#endif
+}
+
+long GetPeakRSS() {
+  struct rusage Usage;
+  if (::getrusage(RUSAGE_SELF, &Usage))
+    return -1;
+#ifdef __APPLE__
+  return Usage.ru_maxrss / 1024; // bytes
+#else
+  return Usage.ru_maxrss;
+#endif
+}
+
+namespace {
+  struct FaultGuard {
+    sigjmp_buf Env;
+    const void* Addr = nullptr;
+    FaultGuard* Prev;
+  };
+  // The innermost RunGuarded() of this thread.
+  static thread_local FaultGuard* sFaultGuard = nullptr;
+  static struct sigaction sPrevSEGV, sPrevBUS;
+
+  static void FaultHandler(int Sig, siginfo_t* Info, void* Ctx) {
+    if (FaultGuard* G = sFaultGuard) {
+      G->Addr = Info->si_addr;
+      siglongjmp(G->Env, 1);
+    }
+
+    // Not a fault of guarded code: do what would have happened without us.
+    const struct sigaction& Prev = Sig == SIGBUS ? sPrevBUS : sPrevSEGV;
+    if (Prev.sa_flags & SA_SIGINFO)
+      return Prev.sa_sigaction(Sig, Info, Ctx);
+    if (Prev.sa_handler == SIG_IGN)
+      return;
+    if (Prev.sa_handler != SIG_DFL)
+      return Prev.sa_handler(Sig);
+    ::signal(Sig, SIG_DFL);
+    ::raise(Sig);
+  }
+
+  static void InstallFaultHandler() {
+    struct sigaction Action;
+    ::memset(&Action, 0, sizeof(Action));
+    Action.sa_sigaction = FaultHandler;
+    Action.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&Action.sa_mask);
+    ::sigaction(SIGSEGV, &Action, &sPrevSEGV);
+    ::sigaction(SIGBUS, &Action, &sPrevBUS);
+  }
+}
+
+bool RunGuarded(void (*Func)(void*), void* Arg, const void** FaultAddr) {
+  // Installed once and kept: guarding a call then costs no system call.
+  static std::once_flag sInstalled;
+  std::call_once(sInstalled, InstallFaultHandler);
+
+  FaultGuard G;
+  G.Prev = sFaultGuard;
+  struct Restore {
+    FaultGuard* Prev;
+    ~Restore() { sFaultGuard = Prev; }
+  } R{G.Prev};
+
+  // Save and restore the signal mask: we leave the handler with siglongjmp.
+  if (sigsetjmp(G.Env, /*savesigs*/ 1)) {
+    if (FaultAddr)
+      *FaultAddr = G.Addr;
+    return false;
+  }
+  sFaultGuard = &G;
+  Func(Arg);
+  return true;
+}
+
 std::string GetCwd() {
   char Buffer[PATH_MAXC];
   if (::getcwd(Buffer, sizeof(Buffer)))
@@ -149,6 +269,68 @@ std::string NormalizePath(const std::string& Path) {
   return std::string();
 }
 
+int SpawnPiped(const std::string& Path, int& ReadFD, int& WriteFD) {
+  int ToChild[2], FromChild[2];
+  if (::pipe(ToChild))
+    return -1;
+  if (::pipe(FromChild)) {
+    ::close(ToChild[0]);
+    ::close(ToChild[1]);
+    return -1;
+  }
+  // Build the arguments before forking: the child must not allocate.
+  const std::string In = std::to_string(ToChild[0]);
+  const std::string Out = std::to_string(FromChild[1]);
+  const pid_t Pid = ::fork();
+  if (Pid == 0) {
+    ::close(ToChild[1]);
+    ::close(FromChild[0]);
+    ::execl(Path.c_str(), Path.c_str(), In.c_str(), Out.c_str(),
+            (char*)nullptr);
+    ::_exit(127);
+  }
+  ::close(ToChild[0]);
+  ::close(FromChild[1]);
+  if (Pid == -1) {
+    ::close(ToChild[1]);
+    ::close(FromChild[0]);
+    return -1;
+  }
+  // Later children must not keep the pipes open.
+  ::fcntl(ToChild[1], F_SETFD, FD_CLOEXEC);
+  ::fcntl(FromChild[0], F_SETFD, FD_CLOEXEC);
+  ReadFD = FromChild[0];
+  WriteFD = ToChild[1];
+  return Pid;
+}
+
+int ConnectTCP(const std::string& Host, const std::string& Port) {
+  struct addrinfo Hints = {};
+  Hints.ai_family = AF_UNSPEC;
+  Hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo* Addrs = nullptr;
+  if (::getaddrinfo(Host.c_str(), Port.c_str(), &Hints, &Addrs))
+    return -1;
+  int FD = -1;
+  for (struct addrinfo* AI = Addrs; AI; AI = AI->ai_next) {
+    FD = ::socket(AI->ai_family, AI->ai_socktype, AI->ai_protocol);
+    if (FD == -1)
+      continue;
+    if (!::connect(FD, AI->ai_addr, AI->ai_addrlen))
+      break;
+    ::close(FD);
+    FD = -1;
+  }
+  ::freeaddrinfo(Addrs);
+  if (FD != -1) {
+    // The messages are small and answered one by one.
+    int One = 1;
+    ::setsockopt(FD, IPPROTO_TCP, TCP_NODELAY, &One, sizeof(One));
+    ::fcntl(FD, F_SETFD, FD_CLOEXEC);
+  }
+  return FD;
+}
+
 bool Popen(const std::string& Cmd, llvm::SmallVectorImpl<char>& Buf, bool RdE) {
   if (FILE *PF = ::popen(RdE ? (Cmd + " 2>&1").c_str() : Cmd.c_str(), "r")) {
     Buf.resize(0);
@@ -168,6 +350,117 @@ bool Popen(const std::string& Cmd, llvm::SmallVectorImpl<char>& Buf, bool RdE) {
   return false;
 }
 
+#if !defined(__APPLE__) && !defined(__CYGWIN__)
+namespace {
+  ///\brief Collects the directories of an ld.so.conf file, following its
+  /// `include` directives, like ldconfig does.
+  class LdSoConfReader {
+    llvm::SmallVectorImpl<std::string>& m_Paths;
+    llvm::StringSet<>& m_Seen;
+
+    void addDirectory(llvm::StringRef Dir) {
+      // The trailing '/' matches what the LD_DEBUG output had.
+      std::string Path = Dir.rtrim('/').str() + '/';
+      if (llvm::sys::fs::is_directory(Path) && m_Seen.insert(Path).second)
+        m_Paths.push_back(std::move(Path));
+    }
+
+    void include(llvm::StringRef Pattern, llvm::StringRef FromDir,
+                 unsigned Depth) {
+      llvm::SmallString<256> Abs(Pattern);
+      if (!llvm::sys::path::is_absolute(Abs)) {
+        Abs = FromDir;
+        llvm::sys::path::append(Abs, Pattern);
+      }
+      glob_t Matches;
+      if (::glob(Abs.c_str(), 0, nullptr, &Matches) == 0) {
+        for (size_t I = 0; I < Matches.gl_pathc; ++I)
+          read(Matches.gl_pathv[I], Depth + 1);
+      }
+      ::globfree(&Matches);
+    }
+
+  public:
+    LdSoConfReader(llvm::SmallVectorImpl<std::string>& Paths,
+                   llvm::StringSet<>& Seen) : m_Paths(Paths), m_Seen(Seen) {}
+
+    void read(llvm::StringRef File, unsigned Depth = 0) {
+      // Guard against include cycles.
+      if (Depth > 8)
+        return;
+      auto Buffer = llvm::MemoryBuffer::getFile(File);
+      if (!Buffer)
+        return;
+      const llvm::StringRef FromDir = llvm::sys::path::parent_path(File);
+
+      llvm::SmallVector<llvm::StringRef, 16> Lines;
+      (*Buffer)->getBuffer().split(Lines, '\n', -1, /*KeepEmpty*/ false);
+      for (llvm::StringRef Line : Lines) {
+        Line = Line.split('#').first.trim();
+        if (Line.empty() || Line.startswith("hwcap "))
+          continue;
+        if (Line.startswith("include ")
+            || Line.startswith("include\t")) {
+          llvm::SmallVector<llvm::StringRef, 2> Patterns;
+          Line.drop_front(8).split(Patterns, ' ', -1, /*KeepEmpty*/ false);
+          for (llvm::StringRef Pattern : Patterns)
+            include(Pattern.trim(), FromDir, Depth);
+          continue;
+        }
+        // ldconfig accepts several directories per line.
+        while (!Line.empty()) {
+          const size_t End = Line.find_first_of(" \t:,");
+          addDirectory(Line.substr(0, End));
+          Line = Line.substr(End).ltrim(" \t:,");
+        }
+      }
+    }
+  };
+
+  ///\brief The directories built into the dynamic linker.
+  static void GetDefaultLibraryPaths(llvm::SmallVectorImpl<std::string>& Paths,
+                                     llvm::StringSet<>& Seen) {
+    // The multiarch directories of Debian-based distributions.
+#if defined(__x86_64__) && defined(__ILP32__)
+    static const char* const kTriple = "x86_64-linux-gnux32";
+#elif defined(__x86_64__)
+    static const char* const kTriple = "x86_64-linux-gnu";
+#elif defined(__i386__)
+    static const char* const kTriple = "i386-linux-gnu";
+#elif defined(__aarch64__)
+    static const char* const kTriple = "aarch64-linux-gnu";
+#elif defined(__arm__) && defined(__ARM_PCS_VFP)
+    static const char* const kTriple = "arm-linux-gnueabihf";
+#elif defined(__arm__)
+    static const char* const kTriple = "arm-linux-gnueabi";
+#elif defined(__powerpc64__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    static const char* const kTriple = "powerpc64le-linux-gnu";
+#elif defined(__powerpc64__)
+    static const char* const kTriple = "powerpc64-linux-gnu";
+#elif defined(__s390x__)
+    static const char* const kTriple = "s390x-linux-gnu";
+#else
+    static const char* const kTriple = nullptr;
+#endif
+    std::vector<std::string> Dirs;
+    if (kTriple) {
+      Dirs.push_back(std::string("/lib/") + kTriple + '/');
+      Dirs.push_back(std::string("/usr/lib/") + kTriple + '/');
+    }
+#if defined(__LP64__)
+    Dirs.push_back("/lib64/");
+    Dirs.push_back("/usr/lib64/");
+#endif
+    Dirs.push_back("/lib/");
+    Dirs.push_back("/usr/lib/");
+
+    for (std::string& Dir : Dirs)
+      if (llvm::sys::fs::is_directory(Dir) && Seen.insert(Dir).second)
+        Paths.push_back(std::move(Dir));
+  }
+} // unnamed namespace
+#endif
+
 bool GetSystemLibraryPaths(llvm::SmallVectorImpl<std::string>& Paths) {
 #if defined(__APPLE__) || defined(__CYGWIN__)
   Paths.push_back("/usr/local/lib/");
@@ -182,27 +475,12 @@ bool GetSystemLibraryPaths(llvm::SmallVectorImpl<std::string>& Paths) {
   Paths.push_back("/lib64/");
  #endif
 #else
-  llvm::SmallString<1024> Buf;
-  platform::Popen("LD_DEBUG=libs LD_PRELOAD=DOESNOTEXIST ls", Buf, true);
-  const llvm::StringRef Result = Buf.str();
-
-  const std::size_t NPos = std::string::npos;
-  const std::size_t LD = Result.find("(LD_LIBRARY_PATH)");
-  std::size_t From = Result.find("search path=", LD == NPos ? 0 : LD);
-  if (From != NPos) {
-    const std::size_t To = Result.find("(system search path)", From);
-    if (To != NPos) {
-      From += 12;
-      std::string SysPath = Result.substr(From, To-From);
-      SysPath.erase(std::remove_if(SysPath.begin(), SysPath.end(), isspace),
-                    SysPath.end());
-
-      llvm::SmallVector<llvm::StringRef, 10> CurPaths;
-      SplitPaths(SysPath, CurPaths);
-      for (const auto& Path : CurPaths)
-        Paths.push_back(Path.str());
-    }
-  }
+  // Mirror what the dynamic linker searches after LD_LIBRARY_PATH: the
+  // directories configured for ld.so.cache, then its built-in defaults. This
+  // used to be queried from `LD_DEBUG=libs`, at the cost of a fork/exec.
+  llvm::StringSet<> Seen;
+  LdSoConfReader(Paths, Seen).read("/etc/ld.so.conf");
+  GetDefaultLibraryPaths(Paths, Seen);
 #endif
   return true;
 }
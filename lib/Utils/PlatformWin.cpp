@@ -15,12 +15,16 @@
 
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/ConvertUTF.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
 
+#include <algorithm>
+#include <atomic>
 #include <map>
+#include <mutex>
 #include <sstream>
 #include <stdlib.h>
 #include <vector>
@@ -37,7 +41,7 @@
 #endif
 
 #include <Windows.h>
-#include <Psapi.h>   // EnumProcessModulesEx
+#include <Psapi.h>   // EnumProcessModulesEx, GetProcessMemoryInfo
 #include <direct.h>  // _getcwd
 #include <shlobj.h>  // SHGetFolderPath
 #pragma comment(lib, "Advapi32.lib")
@@ -554,10 +558,228 @@ bool IsMemoryValid(const void *P) {
   return true;
 }
 
+bool AdviseHugePages(void* Addr, size_t Size) {
+  // Large pages must be requested when mapping, with a privilege.
+  return false;
+}
+
+long GetPeakRSS() {
+  PROCESS_MEMORY_COUNTERS Counters;
+  if (!::GetProcessMemoryInfo(::GetCurrentProcess(), &Counters,
+                              sizeof(Counters)))
+    return -1;
+  return long(Counters.PeakWorkingSetSize / 1024);
+}
+
+int SpawnPiped(const std::string& Path, int& ReadFD, int& WriteFD) {
+  // The remote executors are only supported on POSIX systems.
+  return -1;
+}
+
+int ConnectTCP(const std::string& Host, const std::string& Port) {
+  return -1;
+}
+
+bool RunGuarded(void (*Func)(void*), void* Arg, const void** FaultAddr) {
+#ifdef _MSC_VER
+  // No C++ objects in here: they do not mix with __try.
+  __try {
+    Func(Arg);
+  } __except (::GetExceptionCode() == EXCEPTION_ACCESS_VIOLATION
+              ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH) {
+    if (FaultAddr)
+      *FaultAddr = nullptr;
+    return false;
+  }
+#else
+  Func(Arg);
+#endif
+  return true;
+}
+
+namespace {
+/// The modules of the process, in the order DLSym() searches them, with an
+/// index of their exports built upon the first search of each.
+///
+/// Enumerating the modules and calling GetProcAddress() on each for every
+/// symbol made linking a transaction with many externals slow. The list is
+/// kept until a module gets loaded or unloaded: the loader notifies that,
+/// as do DLOpen() and DLClose(). Without notifications, the modules are
+/// enumerated for each lookup, but their indexes are still kept.
+class ModuleCache {
+  struct Module {
+    /// The header fields identifying the image at the module's address,
+    /// which another DLL may take after an unload.
+    DWORD TimeDateStamp = 0;
+    DWORD SizeOfImage = 0;
+    /// Whether DLSym() ignores the module.
+    bool Skip = false;
+    bool Indexed = false;
+    /// The exported names; a null address for a forwarder, which
+    /// GetProcAddress() resolves.
+    llvm::StringMap<const void*> Exports;
+  };
+
+  std::mutex m_Mutex;
+  std::vector<HMODULE> m_Order;
+  std::map<HMODULE, Module> m_Modules;
+  /// Incremented upon each load and unload; the list is of m_Built.
+  std::atomic<unsigned> m_Generation{1};
+  unsigned m_Built = 0;
+  bool m_Notified = false;
+
+  static const IMAGE_NT_HEADERS* getHeaders(HMODULE H) {
+    const char* Base = reinterpret_cast<const char*>(H);
+    auto* DOS = reinterpret_cast<const IMAGE_DOS_HEADER*>(Base);
+    if (DOS->e_magic != IMAGE_DOS_SIGNATURE)
+      return nullptr;
+    auto* NT = reinterpret_cast<const IMAGE_NT_HEADERS*>(Base + DOS->e_lfanew);
+    return NT->Signature == IMAGE_NT_SIGNATURE ? NT : nullptr;
+  }
+
+  /// Reads the export directory of the image H.
+  static void index(HMODULE H, const IMAGE_NT_HEADERS& NT, Module& M) {
+    M.Indexed = true;
+    const IMAGE_DATA_DIRECTORY& Dir
+      = NT.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
+    if (!Dir.VirtualAddress || !Dir.Size)
+      return;
+    const char* Base = reinterpret_cast<const char*>(H);
+    auto* Exp = reinterpret_cast<const IMAGE_EXPORT_DIRECTORY*>(
+      Base + Dir.VirtualAddress);
+    auto* Names = reinterpret_cast<const DWORD*>(Base + Exp->AddressOfNames);
+    auto* Ordinals
+      = reinterpret_cast<const WORD*>(Base + Exp->AddressOfNameOrdinals);
+    auto* Functions
+      = reinterpret_cast<const DWORD*>(Base + Exp->AddressOfFunctions);
+    for (DWORD I = 0; I < Exp->NumberOfNames; ++I) {
+      const DWORD RVA = Functions[Ordinals[I]];
+      // A forwarder points into the directory, at "OtherDLL.Name".
+      const bool Forwarder = RVA >= Dir.VirtualAddress
+                             && RVA < Dir.VirtualAddress + Dir.Size;
+      M.Exports[Base + Names[I]] = Forwarder ? nullptr : Base + RVA;
+    }
+  }
+
+  /// Enumerates the modules, keeping the indexes of those still loaded.
+  bool refresh(std::string* Err) {
+#ifdef _WIN64
+    const DWORD Flags = LIST_MODULES_64BIT;
+#else
+    const DWORD Flags = LIST_MODULES_32BIT;
+#endif
+    // The generation before enumerating: a load while doing so refreshes
+    // again at the next lookup.
+    const unsigned Generation = m_Generation;
+    llvm::SmallVector<HMODULE, 256> Handles;
+    DWORD Bytes = 0;
+    do {
+      Handles.resize(std::max<size_t>(Handles.capacity(),
+                                      Bytes / sizeof(HMODULE)));
+      if (::EnumProcessModulesEx(::GetCurrentProcess(), Handles.data(),
+                                 Handles.size() * sizeof(HMODULE), &Bytes,
+                                 Flags) == 0) {
+        if (Err)
+          GetLastErrorAsString(*Err, "EnumProcessModulesEx");
+        return false;
+      }
+    } while (Bytes > Handles.size() * sizeof(HMODULE));
+    Handles.resize(Bytes / sizeof(HMODULE));
+
+    std::map<HMODULE, Module> Modules;
+    m_Order.clear();
+    for (HMODULE H : Handles) {
+      const IMAGE_NT_HEADERS* NT = getHeaders(H);
+      if (!NT)
+        continue;
+      Module& M = Modules[H];
+      auto Known = m_Modules.find(H);
+      if (Known != m_Modules.end()
+          && Known->second.TimeDateStamp == NT->FileHeader.TimeDateStamp
+          && Known->second.SizeOfImage == NT->OptionalHeader.SizeOfImage)
+        M = std::move(Known->second);
+      else {
+        M.TimeDateStamp = NT->FileHeader.TimeDateStamp;
+        M.SizeOfImage = NT->OptionalHeader.SizeOfImage;
+        TCHAR Filename[MAX_PATH];
+        if (::GetModuleFileName(H, Filename, MAX_PATH))
+          M.Skip = _tcsstr(Filename, _T("msvcp_"))
+                   || _tcsstr(Filename, _T("VCRUNTIME"));
+      }
+      if (!M.Skip)
+        m_Order.push_back(H);
+    }
+    m_Modules.swap(Modules);
+    m_Built = Generation;
+    return true;
+  }
+
+  static VOID CALLBACK notify(ULONG Reason, const void* Data, PVOID Context);
+
+public:
+  ModuleCache();
+
+  static ModuleCache& get() {
+    // Never destroyed: the loader may notify until the process is gone.
+    static ModuleCache* Cache = new ModuleCache();
+    return *Cache;
+  }
+
+  void invalidate() { ++m_Generation; }
+
+  const void* lookup(const std::string& Name, std::string* Err) {
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+    if ((!m_Notified || m_Built != m_Generation) && !refresh(Err))
+      return nullptr;
+    for (HMODULE H : m_Order) {
+      Module& M = m_Modules[H];
+      if (!M.Indexed) {
+        if (const IMAGE_NT_HEADERS* NT = getHeaders(H))
+          index(H, *NT, M);
+      }
+      auto Found = M.Exports.find(Name);
+      if (Found == M.Exports.end())
+        continue;
+      if (Found->second)
+        return Found->second;
+      // GetProcAddress() loads the DLL forwarded to, which only touches
+      // m_Generation from the notification.
+      if (void* Addr = ::GetProcAddress(H, Name.c_str()))
+        return Addr;
+    }
+    return nullptr;
+  }
+};
+
+// The loader notifications, see LdrRegisterDllNotification() of ntdll.
+typedef VOID (CALLBACK* LdrDllNotification_t)(ULONG, const void*, PVOID);
+typedef LONG (NTAPI* LdrRegisterDllNotification_t)(ULONG,
+                                                   LdrDllNotification_t,
+                                                   PVOID, PVOID*);
+
+VOID CALLBACK ModuleCache::notify(ULONG, const void*, PVOID Context) {
+  // This runs under the loader lock: no locking, no loading.
+  static_cast<ModuleCache*>(Context)->invalidate();
+}
+
+ModuleCache::ModuleCache() {
+  HMODULE NTDLL = ::GetModuleHandleA("ntdll.dll");
+  if (!NTDLL)
+    return;
+  auto Register = reinterpret_cast<LdrRegisterDllNotification_t>(
+    ::GetProcAddress(NTDLL, "LdrRegisterDllNotification"));
+  PVOID Cookie = nullptr;
+  m_Notified = Register
+               && Register(0, &ModuleCache::notify, this, &Cookie) == 0;
+}
+} // unnamed namespace
+
 const void* DLOpen(const std::string& Path, std::string* Err) {
   HMODULE dyLibHandle = ::LoadLibraryA(Path.c_str());
   if (!dyLibHandle && Err)
     GetLastErrorAsString(*Err, "LoadLibrary");
+  else if (dyLibHandle)
+    ModuleCache::get().invalidate();
 
   return reinterpret_cast<void*>(dyLibHandle);
 }
@@ -573,12 +795,6 @@ const void *CheckImp(void *addr, bool dllimp) {
 }
 
 const void* DLSym(const std::string& Name, std::string* Err) {
- #ifdef _WIN64
-  const DWORD Flags = LIST_MODULES_64BIT;
- #else
-  const DWORD Flags = LIST_MODULES_32BIT;
- #endif
-
   bool dllimp = false;
   std::string s = Name;
   // remove the leading '__imp_' from the symbol (will be replaced by an
@@ -593,44 +809,8 @@ const void* DLSym(const std::string& Name, std::string* Err) {
   if (s.compare("_CxxThrowException@8") == 0)
     s = "_CxxThrowException";
 
-  DWORD Bytes;
-  std::string ErrStr;
-  llvm::SmallVector<HMODULE, 128> Modules;
-  Modules.resize(Modules.capacity());
-  if (::EnumProcessModulesEx(::GetCurrentProcess(), &Modules[0],
-                           Modules.capacity_in_bytes(), &Bytes, Flags) != 0) {
-    // Search the modules we got
-    const DWORD NumNeeded = Bytes/sizeof(HMODULE);
-    const DWORD NumFirst = Modules.size();
-    TCHAR lpFilename[MAX_PATH];
-    if (NumNeeded < NumFirst)
-      Modules.resize(NumNeeded);
-
-    // In reverse so user loaded modules are searched first
-    for (auto It = Modules.begin(), End = Modules.end(); It < End; ++It) {
-      GetModuleFileName(*It, lpFilename, MAX_PATH);
-      if (!_tcsstr(lpFilename, _T("msvcp_")) &&
-          !_tcsstr(lpFilename, _T("VCRUNTIME"))) {
-        if (void* Addr = ::GetProcAddress(*It, s.c_str())) {
-          return CheckImp(Addr, dllimp);
-        }
-      }
-    }
-    if (NumNeeded > NumFirst) {
-      // The number of modules was too small to get them all, so call again
-      Modules.resize(NumNeeded);
-      if (::EnumProcessModulesEx(::GetCurrentProcess(), &Modules[0],
-                               Modules.capacity_in_bytes(), &Bytes, Flags) != 0) {
-        for (DWORD i = NumNeeded-1; i > NumFirst; --i) {
-          if (void* Addr = ::GetProcAddress(Modules[i], s.c_str()))
-            return CheckImp(Addr, dllimp);
-        }
-      } else if (Err)
-        GetLastErrorAsString(*Err, "EnumProcessModulesEx");
-    }
-  } else if (Err)
-    GetLastErrorAsString(*Err, "EnumProcessModulesEx");
-
+  if (const void* Addr = ModuleCache::get().lookup(s, Err))
+    return CheckImp(const_cast<void*>(Addr), dllimp);
   return nullptr;
 }
 
@@ -639,6 +819,7 @@ void DLClose(const void* Lib, std::string* Err) {
     if (Err)
       GetLastErrorAsString(*Err, "FreeLibrary");
   }
+  ModuleCache::get().invalidate();
 }
 
 bool GetSystemLibraryPaths(llvm::SmallVectorImpl<std::string>& Paths) {
@@ -807,15 +988,21 @@ static void MergeRanges(ImageRanges &Ranges) {
   Ranges.swap(Merged);
 }
 
+// The ranges of all images by their last address, to the first one and the
+// ImageBase: FindEHFrame() runs for each exception, in sessions that might
+// have thousands of images.
+typedef std::map<uintptr_t, std::pair<uintptr_t, uintptr_t>> AddressIndex;
+
+static AddressIndex& getAddressIndex() {
+  static AddressIndex sIndex;
+  return sIndex;
+}
+
 static uintptr_t FindEHFrame(uintptr_t Caller) {
-  ImageBaseMap& Unwind = getImageBaseMap();
-  for (auto&& Itr : Unwind) {
-    const uintptr_t ImgBase = Itr.first;
-    for (auto&& Rng : Itr.second) {
-      if (Caller >= (ImgBase + Rng.first) && Caller <= (ImgBase + Rng.second))
-        return ImgBase;
-    }
-  }
+  const AddressIndex& Index = getAddressIndex();
+  AddressIndex::const_iterator It = Index.lower_bound(Caller);
+  if (It != Index.end() && It->second.first <= Caller)
+    return It->second.second;
   return 0;
 }
 
@@ -854,6 +1041,11 @@ void RegisterEHFrames(uintptr_t ImgBs, const EHFrameInfos& Frames, bool Block) {
 
   if (!Block)
     MergeRanges(Ranges); // Initial sort and merge
+
+  AddressIndex& Index = getAddressIndex();
+  for (auto&& Rng : Ranges)
+    if (Rng.first <= Rng.second)
+      Index[ImgBs + Rng.second] = std::make_pair(ImgBs + Rng.first, ImgBs);
 }
 
 void DeRegisterEHFrames(uintptr_t ImgBase, const EHFrameInfos& Frames) {
@@ -863,7 +1055,14 @@ void DeRegisterEHFrames(uintptr_t ImgBase, const EHFrameInfos& Frames) {
 
   // Remove the ImageBase from lookup
   ImageBaseMap& Unwind = getImageBaseMap();
-  Unwind.erase(Unwind.find(ImgBase));
+  ImageBaseMap::iterator Img = Unwind.find(ImgBase);
+  AddressIndex& Index = getAddressIndex();
+  for (auto&& Rng : Img->second) {
+    AddressIndex::iterator It = Index.find(ImgBase + Rng.second);
+    if (It != Index.end() && It->second.second == ImgBase)
+      Index.erase(It);
+  }
+  Unwind.erase(Img);
 
   // Unregister all the PRUNTIME_FUNCTIONs
   for (auto&& Frame : Frames)
@@ -9,6 +9,7 @@
 
 #include "cling/Utils/SourceNormalization.h"
 
+#include "clang/Basic/CharInfo.h"
 #include "clang/Basic/LangOptions.h"
 #include "clang/Basic/SourceManager.h"
 #include "clang/Lex/Lexer.h"
@@ -316,6 +317,69 @@ size_t getFileOffset(const Token& Tok) {
   return Tok.getLocation().getRawEncoding();
 }
 
+///\brief Whether getWrapPoint() wraps all of source because of its first
+/// tokens, as for most expressions and calls, telling from the characters
+/// without a Lexer. False if the lexer has to decide.
+///
+/// The first token must be a literal, an operator or '{', or an identifier
+/// followed by a token that cannot continue a declarator. Anything that might
+/// be or hide a directive, a comment, an attribute or a line splice - '#',
+/// '/', '[', '\\', trigraphs and digraphs - as first token, as well as the
+/// keywords that getWrapPoint() and IsClassOrFunction() look further for, are
+/// left to the lexer.
+bool startsWithExpression(llvm::StringRef source,
+                          const LangOptions& LangOpts) {
+  if (LangOpts.CUDA)
+    return false;
+  const char* Cur = source.begin();
+  const char* End = source.end();
+  auto skipWhitespace = [&]() {
+    while (Cur != End && isWhitespace(*Cur))
+      ++Cur;
+  };
+  skipWhitespace();
+  if (Cur == End)
+    return false;
+
+  if (!isIdentifierHead(*Cur)) {
+    switch (*Cur) {
+    case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+    case '"': case '\'': case '(': case '-': case '+': case '!': case '~':
+    case '*': case '&': case '.': case ';': case '{':
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  const char* IdentStart = Cur;
+  while (Cur != End && isIdentifierBody(*Cur))
+    ++Cur;
+  const llvm::StringRef First(IdentStart, Cur - IdentStart);
+  // Neither '$' nor universal character names.
+  if (Cur != End && (*Cur == '$' || *Cur == '\\' || !isASCII(*Cur)))
+    return false;
+  if (First == "using" || First == "extern" || First == "namespace"
+      || First == "template" || First == "static" || First == "constexpr"
+      || First == "inline" || First == "const")
+    return false;
+
+  skipWhitespace();
+  if (Cur == End)
+    return true;
+  switch (*Cur) {
+  // 'f(' is a call; others are not part of a declarator: 'x.f()', 'v[0]' or
+  // 'vector<int> v' do not define a function or class either.
+  case '(': case ')': case '[': case ']': case '{': case '}': case '.':
+  case '-': case '+': case '=': case '!': case '~': case '^': case '|':
+  case '%': case '<': case '>': case ',': case ';':
+    return true;
+  default:
+    return false;
+  }
+}
+
 }
 
 size_t
@@ -379,6 +443,10 @@ size_t cling::utils::getWrapPoint(std::string& source,
   // TA.Revert();
   // return result == TPResult::True();
 
+  // Most inputs are expressions; decide those without a Lexer.
+  if (startsWithExpression(source, LangOpts))
+    return 0;
+
   MinimalPPLexer Lex(LangOpts, source);
   Token Tok;
 
@@ -529,3 +597,93 @@ size_t cling::utils::getWrapPoint(std::string& source,
   // We have only had PP directives; no need to wrap.
   return std::string::npos;
 }
+
+size_t cling::utils::getChunkEnd(llvm::StringRef source, size_t minSize,
+                                 const clang::LangOptions& LangOpts) {
+  MinimalPPLexer Lex(LangOpts, source);
+  Token Tok;
+  int depth = 0, ppDepth = 0;
+  bool atDirectiveName = false, atDeclStart = true, endsWithBrace = false;
+  // The first identifier of the current top-level declaration, and the last
+  // token before the current one at depth 0.
+  llvm::StringRef first, prevIdent;
+  tok::TokenKind prev = tok::unknown;
+  // The end of a '}' ending the declaration, unless the next token continues
+  // it as for 'auto l = []{};'.
+  size_t pending = std::string::npos;
+
+  while (true) {
+    const bool atEOF = Lex.Lex(Tok);
+    if (pending != std::string::npos) {
+      if (!Tok.isOneOf(tok::semi, tok::comma, tok::l_paren, tok::period,
+                       tok::arrow)
+          && !(Tok.is(tok::raw_identifier)
+               && Tok.getRawIdentifier().equals("catch")))
+        return pending;
+      pending = std::string::npos;
+    }
+
+    if (Lex.inPPDirective() || Tok.is(tok::eod)) {
+      if (Tok.is(tok::hash))
+        atDirectiveName = true;
+      else if (atDirectiveName) {
+        atDirectiveName = false;
+        if (Tok.is(tok::raw_identifier)) {
+          llvm::StringRef directive = Tok.getRawIdentifier();
+          if (directive.startswith("if"))
+            ++ppDepth;
+          else if (directive.equals("endif") && ppDepth)
+            --ppDepth;
+        }
+      }
+      if (atEOF)
+        break;
+      continue;
+    }
+    if (Tok.is(tok::eof))
+      break;
+
+    if (depth == 0 && atDeclStart) {
+      first = Tok.is(tok::raw_identifier) ? Tok.getRawIdentifier()
+                                          : llvm::StringRef();
+      atDeclStart = false;
+    }
+    const size_t end = getFileOffset(Tok) + Tok.getLength();
+
+    if (Tok.is(tok::l_brace)) {
+      if (depth++ == 0) {
+        // Namespaces, linkage specifications and function bodies end with
+        // their '}'; classes, enums and initializers with a ';'.
+        endsWithBrace = first.equals("namespace")
+          || (first.equals("extern") && prev == tok::string_literal)
+          || prev == tok::r_paren
+          || prev == tok::r_brace // 'X::X(): m{0} {'
+          || (prev == tok::raw_identifier
+              && (prevIdent.equals("const") || prevIdent.equals("noexcept")
+                  || prevIdent.equals("try")));
+      }
+    } else if (Tok.is(tok::r_brace)) {
+      if (depth > 0 && --depth == 0 && endsWithBrace) {
+        atDeclStart = true;
+        if (ppDepth == 0 && end >= minSize)
+          pending = end;
+      }
+    } else if (Tok.isOneOf(tok::l_paren, tok::l_square)) {
+      ++depth;
+    } else if (Tok.isOneOf(tok::r_paren, tok::r_square)) {
+      if (depth > 0)
+        --depth;
+    } else if (Tok.is(tok::semi) && depth == 0) {
+      atDeclStart = true;
+      if (ppDepth == 0 && end >= minSize)
+        return end;
+    }
+
+    if (depth == 0 || (depth == 1 && Tok.is(tok::l_brace))) {
+      prev = Tok.getKind();
+      prevIdent = Tok.is(tok::raw_identifier) ? Tok.getRawIdentifier()
+                                              : llvm::StringRef();
+    }
+  }
+  return source.size();
+}
@@ -12,6 +12,13 @@
 
 #include "llvm/ADT/SmallString.h"
 #include "llvm/Support/Format.h"
+#include "llvm/Support/MathExtras.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 #ifdef _WIN32
 #include <Shlwapi.h>
@@ -37,8 +44,42 @@ static uint8_t mask8(char Octet) {
   return static_cast<uint8_t>(Octet); //  & 0xff
 }
 
+///\brief The number of bytes from Str that are printable ASCII, ' ' to '~',
+/// which are valid UTF-8 and printable in any locale.
+static size_t countPrintableASCII(const char* Str, size_t N) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  // Signed, the bytes from 0x80 are below ' '.
+  const __m128i Low = _mm_set1_epi8(' ' - 1);
+  const __m128i High = _mm_set1_epi8('~' + 1);
+  for (; i + 16 <= N; i += 16) {
+    const __m128i V = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Str+i));
+    const unsigned Printable = _mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpgt_epi8(V, Low), _mm_cmplt_epi8(V, High)));
+    if (Printable != 0xffff)
+      return i + llvm::countTrailingZeros(~Printable);
+  }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  const uint8x16_t Low = vdupq_n_u8(' ' - 1);
+  const uint8x16_t High = vdupq_n_u8('~' + 1);
+  for (; i + 16 <= N; i += 16) {
+    const uint8x16_t V = vld1q_u8(reinterpret_cast<const uint8_t*>(Str + i));
+    if (vminvq_u8(vandq_u8(vcgtq_u8(V, Low), vcltq_u8(V, High))) != 0xff)
+      break; // Find which byte below.
+  }
+#endif
+  while (i < N && Str[i] >= ' ' && Str[i] <= '~')
+    ++i;
+  return i;
+}
+
 bool Validate(const char* Str, size_t N, const std::locale& LC, bool& isPrint) {
   for (size_t i = 0, N1 = (N-1); i < N; ++i) {
+    // Skip the runs of ASCII in bulk; they leave isPrint as it is.
+    i += countPrintableASCII(Str + i, N - i);
+    if (i == N)
+      break;
+
     uint8_t n;
     uint8_t C = mask8(Str[i]);
     isPrint = isPrint ? std::isprint(Str[i], LC) : false;
@@ -190,6 +231,21 @@ public:
     // If nothing is UTF-8 validate against std::isprint<char> .
   }
 
+  ///\brief Writes the printable ASCII from Ptr as is, as operator() would
+  /// one character at a time.
+  void printASCII(const char*& Ptr, llvm::raw_ostream& Stream) {
+    const size_t N = countPrintableASCII(Ptr, m_End - Ptr);
+    if (!N)
+      return;
+    if (m_HexRun) {
+      m_HexRun = false;
+      if (std::isxdigit(wchar_t(*Ptr), m_Loc))
+        Stream << "\" \"";
+    }
+    Stream << llvm::StringRef(Ptr, N);
+    Ptr += N;
+  }
+
   HexState operator() (const char*& Ptr, llvm::raw_ostream& Stream,
                        bool ForceHex) {
     // Block allocate the next chunk
@@ -285,6 +341,7 @@ llvm::raw_ostream& EscapeSequence::encode(const char* const Start, size_t N,
     // A const char* string may not neccessarily be utf8.
     // When the locale can output utf8 strings, validate it as utf8 first.
     if (!m_Utf8Out) {
+      Ptr += countPrintableASCII(Ptr, N);
       while (isPrint && Ptr < End)
         isPrint = std::isprint(*Ptr++, m_Loc);
     } else
@@ -308,6 +365,9 @@ llvm::raw_ostream& EscapeSequence::encode(const char* const Start, size_t N,
     HexState Hex = kText;
     llvm::raw_svector_ostream Strm(Dump.buf());
     while ((Hex < kEnd) && (Ptr < End)) {
+      Dump.printASCII(Ptr, Strm);
+      if (Ptr == End)
+        break;
       const size_t LastPos = Ptr - Start;
       switch (Dump(Ptr, Strm, Hex==kHex)) {
         case kHex:
@@ -334,8 +394,11 @@ llvm::raw_ostream& EscapeSequence::encode(const char* const Start, size_t N,
 
   // Force hex output for the rest of the string
   llvm::raw_svector_ostream Strm(Dump.buf());
-  while (Ptr < End)
-    Dump(Ptr, Strm, true);
+  while (Ptr < End) {
+    Dump.printASCII(Ptr, Strm);
+    if (Ptr < End)
+      Dump(Ptr, Strm, true);
+  }
 
   return Output << Strm.str();
 }
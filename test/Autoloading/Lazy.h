@@ -0,0 +1,8 @@
+#define LAZY_H_PARSED
+
+namespace lazy {
+  class Lazy {
+  public:
+    int Value = 42;
+  };
+}
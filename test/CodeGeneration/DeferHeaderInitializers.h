@@ -0,0 +1,9 @@
+extern "C" int printf(const char*,...);
+
+struct Noisy {
+  int Value;
+  Noisy(const char* Name, int V): Value(V) { printf("constructed %s\n", Name); }
+};
+
+Noisy First("first", 1);
+Noisy Second("second", 2);
@@ -0,0 +1,42 @@
+#include <cstdio>
+#include <stdexcept>
+
+inline int twice(int I) { return 2 * I; }
+static int hidden(int I) { return I + 1; }
+int Calls = 0;
+
+struct Counter {
+  Counter(int Start);
+  int Value;
+};
+Counter::Counter(int Start): Value(Start) { ++Calls; }
+
+#define DEFINE(N)                                           \
+  int f##N(int I) { ++Calls; return twice(I) + N; }         \
+  const char* name##N() { return "f" #N; }
+#define DEFINE8(N)                                          \
+  DEFINE(N##0) DEFINE(N##1) DEFINE(N##2) DEFINE(N##3)       \
+  DEFINE(N##4) DEFINE(N##5) DEFINE(N##6) DEFINE(N##7)
+
+DEFINE8(1)
+DEFINE8(2)
+DEFINE8(3)
+DEFINE8(4)
+
+int sum() {
+  int S = 0;
+#define CALL(N) S += f##N(1);
+#define CALL8(N)                                            \
+  CALL(N##0) CALL(N##1) CALL(N##2) CALL(N##3)               \
+  CALL(N##4) CALL(N##5) CALL(N##6) CALL(N##7)
+  CALL8(1) CALL8(2) CALL8(3) CALL8(4)
+  return S;
+}
+
+int viaHidden(int I) { return hidden(I); }
+
+int checked(int I) {
+  if (I < 0)
+    throw std::invalid_argument("negative");
+  return f11(I);
+}
@@ -0,0 +1,14 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+// Part of LoadFiles.C
+
+#include "LoadFilesC.h"
+
+// Sees the macro of the file loaded before it.
+int loadFilesValue() { return LOAD_FILES_VALUE + loadFilesBase; }
@@ -0,0 +1,14 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+// Part of LoadFiles.C
+
+#ifndef LOAD_FILES_C_H
+#define LOAD_FILES_C_H
+int loadFilesBase = 1;
+#endif
@@ -0,0 +1,16 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+extern "C" int printf(const char* fmt, ...);
+
+int CompiledGlobal = 40;
+
+int Compiled(int a) {
+  printf("Compiled(%d)\n", a);
+  return a + ++CompiledGlobal;
+}
@@ -0,0 +1,19 @@
+/*------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//----------------------------------------------------------------------------*/
+
+// Used as library source by ProcessSymbolCache.C, built once per
+// CACHE_VALUE; the second build also has cache_later().
+CLING_EXPORT int cache_value() {
+  return CACHE_VALUE;
+}
+
+#ifdef CACHE_LATER
+CLING_EXPORT int cache_later() {
+  return CACHE_LATER;
+}
+#endif
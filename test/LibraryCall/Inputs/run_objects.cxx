@@ -0,0 +1,56 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+// A host without the interpreter, running what it wrote through
+// cling::ObjectRunner. The arguments are handled in order:
+//   -l <library>  loads a shared library
+//   -p <package>  adds a package of .package
+//   -c <function> calls the function int(), printing what it returns
+//   -r <function> runs the function void()
+//   <object>      adds an object file, e.g. of .export
+
+#include "cling/Exec/ObjectRunner.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+int main(int argc, char** argv) {
+  cling::ObjectRunner Runner;
+  for (int i = 1; i < argc; ++i) {
+    const char* Arg = argv[i];
+    bool HasValue = Arg[0] == '-' && i + 1 < argc;
+    std::string Err;
+    bool OK = true;
+    if (HasValue && !strcmp(Arg, "-l"))
+      OK = Runner.loadLibrary(argv[++i], Err);
+    else if (HasValue && !strcmp(Arg, "-p"))
+      OK = Runner.addPackageFile(argv[++i], Err);
+    else if (HasValue && !strcmp(Arg, "-c")) {
+      const char* Name = argv[++i];
+      if (int (*Func)() = Runner.getFunction<int()>(Name))
+        printf("%s() = %d\n", Name, Func());
+      else {
+        Err = std::string("no function ") + Name;
+        OK = false;
+      }
+    } else if (HasValue && !strcmp(Arg, "-r")) {
+      if (!Runner.run(argv[++i])) {
+        Err = std::string("no function ") + argv[i];
+        OK = false;
+      }
+    } else
+      OK = Runner.addObjectFile(Arg, Err);
+    if (!OK) {
+      printf("run_objects: error: %s\n", Err.c_str());
+      return 1;
+    }
+  }
+  printf("run_objects: done\n");
+  return 0;
+}
@@ -0,0 +1 @@
+template <class T> T deref(T* P) { return *P; }
@@ -0,0 +1,18 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+// Part of DeferredBodies.C
+
+#pragma once
+
+template <class T> T twice(T t) { return t + t; }
+
+// Never instantiated, thus never parsed: its error goes unnoticed.
+template <class T> int neverUsed(T t) { return undeclaredInHeader + t; }
+
+inline int notATemplate() { return 3; }
@@ -0,0 +1,67 @@
+#!/usr/bin/env python
+#------------------------------------------------------------------------------
+# CLING - the C++ LLVM-based InterpreterG :)
+#
+# This file is dual-licensed: you can choose to license it under the University
+# of Illinois Open Source License or the GNU Lesser General Public License. See
+# LICENSE.TXT for details.
+#------------------------------------------------------------------------------
+
+# Runs the command - a cling - on a terminal, pastes the lines of the file
+# onto its prompt, as terminals in bracketed-paste mode do, then types the
+# keys given and .q. Prints what the terminal showed, without the escape
+# sequences, and whether the prompt turned bracketed paste on.
+#
+# Usage: paste.py <file> <keys> <command>...
+
+import os
+import pty
+import re
+import select
+import sys
+import time
+
+PROMPT = b'$ '
+TIMEOUT = 60
+
+def read_until(fd, output, pattern):
+  deadline = time.time() + TIMEOUT
+  while pattern is None or pattern not in output[0]:
+    remaining = deadline - time.time()
+    if remaining <= 0:
+      sys.stdout.write('paste.py: timeout\n')
+      return False
+    if not select.select([fd], [], [], remaining)[0]:
+      continue
+    try:
+      data = os.read(fd, 65536)
+    except OSError:
+      data = b''
+    if not data:
+      return pattern is None
+    output[0] += data
+  return True
+
+def main():
+  paste = open(sys.argv[1], 'rb').read()
+  keys = sys.argv[2].encode()
+  pid, fd = pty.fork()
+  if pid == 0:
+    os.environ['TERM'] = 'xterm'
+    os.execvp(sys.argv[3], sys.argv[3:])
+
+  output = [b'']
+  if read_until(fd, output, PROMPT):
+    if b'\x1b[?2004h' in output[0]:
+      sys.stdout.write('paste.py: bracketed paste on\n')
+    os.write(fd, b'\x1b[200~' + paste + b'\x1b[201~')
+    os.write(fd, keys + b'\n.q\n')
+    read_until(fd, output, None)
+  os.waitpid(pid, 0)
+
+  text = re.sub(rb'\x1b(\[[0-9;?]*[A-Za-z~]|[()][0-9A-Za-z]|[=>])', b'',
+                output[0]).replace(b'\r', b'')
+  sys.stdout.write(text.decode('utf-8', 'replace'))
+
+if __name__ == '__main__':
+  main()
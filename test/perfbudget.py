@@ -0,0 +1,156 @@
+# -*- Python -*-
+#------------------------------------------------------------------------------
+# CLING - the C++ LLVM-based InterpreterG :)
+#
+# This file is dual-licensed: you can choose to license it under the University
+# of Illinois Open Source License or the GNU Lesser General Public License. See
+# LICENSE.TXT for details.
+#------------------------------------------------------------------------------
+
+# The PERF-BUDGET flavor of the tests: a test with the annotation
+#
+#   // PERF-BUDGET: [<metric>...] [ratio=<ratio>]
+#
+# gets its wall time, the peak RSS of its cling processes and the time of
+# their phases (see cling::TimingStats) measured, and fails if a metric
+# exceeds its baseline times the ratio; no metric means all of them. The
+# metrics are 'wall-ms', 'peak-rss-kb' and the phases, e.g. 'codegen', in ms.
+#
+# Without the lit parameter perf_baseline=<file> the annotation is ignored.
+# With perf_record=1 the measurements are written to the baseline instead;
+# perf_budget_ratio=<ratio> sets the default ratio, 1.25.
+
+import copy
+import json
+import os
+import re
+import time
+
+import lit.formats
+import lit.Test
+
+try:
+    import fcntl
+except ImportError:
+    fcntl = None
+
+# Exceeding the budget by less than this is noise.
+TIME_SLACK_MS = 20.0
+RSS_SLACK_KB = 8192.0
+
+BUDGET_RE = re.compile(r'//\s*PERF-BUDGET:(.*)$')
+
+def parseBudget(path):
+    """Returns the metrics and the ratio of the annotation, or None."""
+    with open(path) as f:
+        for line in f:
+            match = BUDGET_RE.search(line)
+            if not match:
+                continue
+            metrics, ratio = [], None
+            for word in match.group(1).split():
+                if word.startswith('ratio='):
+                    ratio = float(word[len('ratio='):])
+                else:
+                    metrics.append(word)
+            return metrics, ratio
+    return None
+
+def readTimingStats(path):
+    """Sums the lines of $CLING_TIMING_STATS: the phases in ms, the largest
+    peak RSS in kB."""
+    measured = {}
+    if not os.path.exists(path):
+        return measured
+    with open(path) as f:
+        for line in f:
+            for pair in line.split():
+                name, _, value = pair.partition('=')
+                value = float(value)
+                if name == 'peak-rss-kb':
+                    measured[name] = max(measured.get(name, 0.), value)
+                else:
+                    measured[name] = measured.get(name, 0.) + value / 1e6
+    return measured
+
+class LockedFile(object):
+    """Serializes the updates of the baseline by the lit workers."""
+    def __init__(self, path):
+        self.lock = open(path + '.lock', 'w')
+    def __enter__(self):
+        if fcntl:
+            fcntl.flock(self.lock, fcntl.LOCK_EX)
+        return self
+    def __exit__(self, *args):
+        if fcntl:
+            fcntl.flock(self.lock, fcntl.LOCK_UN)
+        self.lock.close()
+
+def readBaseline(path):
+    if not os.path.exists(path):
+        return {}
+    with open(path) as f:
+        return json.load(f)
+
+class PerfBudgetTest(lit.formats.ShTest):
+    def __init__(self, execute_external, baseline, record, ratio):
+        lit.formats.ShTest.__init__(self, execute_external)
+        self.baseline = baseline
+        self.record = record
+        self.ratio = ratio
+
+    def execute(self, test, litConfig):
+        budget = parseBudget(test.getSourcePath())
+        if budget is None:
+            return lit.formats.ShTest.execute(self, test, litConfig)
+        metrics, ratio = budget
+        ratio = ratio or self.ratio
+
+        stats = test.getExecPath() + '.timingstats'
+        if os.path.exists(stats):
+            os.remove(stats)
+        # Only this test's processes write the stats.
+        test.config = copy.copy(test.config)
+        test.config.environment = dict(test.config.environment)
+        test.config.environment['CLING_TIMING_STATS'] = stats
+
+        start = time.time()
+        result = lit.formats.ShTest.execute(self, test, litConfig)
+        wall = (time.time() - start) * 1e3
+        if result.code != lit.Test.PASS:
+            return result
+
+        measured = readTimingStats(stats)
+        measured['wall-ms'] = wall
+        for name in sorted(measured):
+            result.addMetric(name, lit.Test.RealMetricValue(measured[name]))
+
+        key = '/'.join(test.path_in_suite)
+        if self.record:
+            with LockedFile(self.baseline):
+                baseline = readBaseline(self.baseline)
+                baseline[key] = measured
+                with open(self.baseline, 'w') as f:
+                    json.dump(baseline, f, indent=2, sort_keys=True)
+            return result
+
+        expected = readBaseline(self.baseline).get(key)
+        if expected is None:
+            return result
+        exceeded = []
+        for name in metrics or sorted(expected):
+            if name not in expected or name not in measured:
+                continue
+            slack = RSS_SLACK_KB if name == 'peak-rss-kb' else TIME_SLACK_MS
+            if measured[name] > expected[name] * ratio + slack:
+                exceeded.append('%s: %.1f, baseline %.1f (ratio %.2f)'
+                                % (name, measured[name], expected[name],
+                                   measured[name] / max(expected[name], 1e-3)))
+        if not exceeded:
+            return result
+        output = result.output + '\nPERF-BUDGET exceeded:\n  ' \
+                 + '\n  '.join(exceeded) + '\n'
+        failed = lit.Test.Result(lit.Test.FAIL, output, result.elapsed)
+        for name, value in result.metrics.items():
+            failed.addMetric(name, value)
+        return failed
@@ -19,10 +19,20 @@
 #include "cling/Interpreter/Exception.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <map>
 #include <string>
+#include <vector>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <thread>
 #ifndef _WIN32
+# include <fcntl.h>
+# include <poll.h>
 # include <unistd.h>
 #else
 # include <io.h>
@@ -33,6 +43,273 @@
 // from create.
 int pipeToJupyterFD = -1;
 
+namespace {
+  ///\brief MIME data this large is passed in a file in shared memory: through
+  /// the pipe, it would take many reads and copies on the kernel's side.
+  static const long kSharedMemoryThreshold = 1024 * 1024;
+
+  static void appendLong(std::string& Buf, long L) {
+    Buf.append(reinterpret_cast<const char*>(&L), sizeof(long));
+  }
+
+  ///\brief Writes all of Data, which might take more than one write().
+  static bool writeAll(int FD, const char* Data, size_t Size) {
+    while (Size) {
+      const long Written = write(FD, Data, Size);
+      if (Written < 0) {
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+      Data += Written;
+      Size -= Written;
+    }
+    return true;
+  }
+
+#ifndef _WIN32
+  ///\brief Writes Head and Data to a new file, in shared memory if
+  /// available.
+  ///\returns the path of the file, or an empty string on failure.
+  static std::string writeToSharedMemory(const std::string& Head,
+                                         const char* Data, long Size) {
+    std::string Path = "/dev/shm";
+    if (::access(Path.c_str(), W_OK)) {
+      const char* TmpDir = ::getenv("TMPDIR");
+      Path = TmpDir && *TmpDir ? TmpDir : "/tmp";
+    }
+    Path += "/cling-jupyter-XXXXXX";
+    int FD = ::mkstemp(&Path[0]);
+    if (FD < 0)
+      return std::string();
+    const bool Written = writeAll(FD, Head.data(), Head.size())
+                         && writeAll(FD, Data, Size);
+    ::close(FD);
+    if (!Written) {
+      ::unlink(Path.c_str());
+      return std::string();
+    }
+    return Path;
+  }
+#endif
+
+  ///\brief Appends the element MimeType of a MIME dictionary, whose data
+  /// is Head followed by Size bytes at Data.
+  static void appendElement(std::string& Message, const std::string& MimeType,
+                            const std::string& Head, const char* Data,
+                            long Size) {
+    appendLong(Message, (long)MimeType.size() + 1);
+    Message.append(MimeType.c_str(), MimeType.size() + 1);
+#ifndef _WIN32
+    if ((long)Head.size() + Size >= kSharedMemoryThreshold) {
+      const std::string Path = writeToSharedMemory(Head, Data, Size);
+      if (!Path.empty()) {
+        appendLong(Message, -(long)(Path.size() + 1));
+        Message.append(Path.c_str(), Path.size() + 1);
+        return;
+      }
+    }
+#endif
+    appendLong(Message, (long)Head.size() + Size);
+    Message += Head;
+    Message.append(Data, Size);
+  }
+
+#ifndef _WIN32
+  ///\brief The stdout and stderr of the kernel process while a cell runs.
+  static int savedStdFDs[2] = {-1, -1};
+
+  ///\brief What cling_capture_end() writes to, to tell the OutputCapture
+  /// that the cell is done.
+  static int captureDoneFD = -1;
+
+  ///\brief The output of a stream not yet sent, keeping the latest
+  /// kCapacity bytes of it.
+  class RingBuffer {
+    std::vector<char> m_Buf;
+    size_t m_Begin = 0;
+    size_t m_Size = 0;
+    size_t m_Dropped = 0;
+
+  public:
+    static const size_t kCapacity = 4 * 1024 * 1024;
+
+    RingBuffer() : m_Buf(kCapacity) {}
+
+    bool empty() const { return !m_Size && !m_Dropped; }
+
+    void append(const char* Data, size_t Size) {
+      if (Size > kCapacity) {
+        m_Dropped += Size - kCapacity;
+        Data += Size - kCapacity;
+        Size = kCapacity;
+      }
+      if (m_Size + Size > kCapacity) {
+        const size_t Drop = m_Size + Size - kCapacity;
+        m_Begin = (m_Begin + Drop) % kCapacity;
+        m_Size -= Drop;
+        m_Dropped += Drop;
+      }
+      for (size_t End = (m_Begin + m_Size) % kCapacity; Size;) {
+        const size_t N = std::min(Size, kCapacity - End);
+        ::memcpy(&m_Buf[End], Data, N);
+        Data += N;
+        Size -= N;
+        m_Size += N;
+        End = (End + N) % kCapacity;
+      }
+    }
+
+    ///\brief Moves up to Max bytes to To, after a note on what was dropped.
+    void take(std::string& To, size_t Max) {
+      if (m_Dropped) {
+        To += "\n[cling: " + std::to_string(m_Dropped)
+              + " bytes of output dropped]\n";
+        m_Dropped = 0;
+      }
+      for (size_t N = std::min(Max, m_Size); N;) {
+        const size_t Part = std::min(N, kCapacity - m_Begin);
+        To.append(&m_Buf[m_Begin], Part);
+        m_Begin = (m_Begin + Part) % kCapacity;
+        m_Size -= Part;
+        N -= Part;
+      }
+    }
+  };
+
+  ///\brief Reads what a cell writes to stdout and stderr on a thread, and
+  /// sends it to the kernel in chunks, at most one per stream and
+  /// kInterval. Reading never waits for the kernel, so the cell never
+  /// waits either: what the kernel is too slow for is dropped, oldest first.
+  ///
+  /// A chunk is the stream, 1 for stdout and 2 for stderr, as an unsigned
+  /// char, the size of the text as a 32 bit unsigned int and the text. Once
+  /// the streams are restored and everything is sent, the pipe is closed.
+  /// What the cell wrote is in the pipes by then: the capture reads it and
+  /// stops, as a process that the cell started might keep them open.
+  class OutputCapture {
+    int m_Streams[2];
+    int m_Messages;
+    ///\brief Readable once the streams are restored.
+    int m_Done;
+    RingBuffer m_Pending[2];
+
+    static const size_t kChunkSize = 64 * 1024;
+    static constexpr std::chrono::milliseconds kInterval{100};
+
+    bool hasPending() const {
+      return !m_Pending[0].empty() || !m_Pending[1].empty();
+    }
+
+  public:
+    OutputCapture(int Stdout, int Stderr, int Messages, int Done)
+      : m_Streams{Stdout, Stderr}, m_Messages(Messages), m_Done(Done) {}
+
+    ~OutputCapture() {
+      for (int FD : m_Streams)
+        if (FD >= 0)
+          ::close(FD);
+      if (m_Done >= 0)
+        ::close(m_Done);
+      ::close(m_Messages);
+    }
+
+    void run() {
+      using Clock = std::chrono::steady_clock;
+      std::string Outgoing;
+      size_t Sent = 0;
+      Clock::time_point LastChunk = Clock::now() - kInterval;
+      char Buf[64 * 1024];
+      while (m_Streams[0] >= 0 || m_Streams[1] >= 0 || hasPending()
+             || Sent < Outgoing.size()) {
+        const bool Open = m_Streams[0] >= 0 || m_Streams[1] >= 0;
+        if (Sent == Outgoing.size()) {
+          Outgoing.clear();
+          Sent = 0;
+          // The last chunks go without delay.
+          if (hasPending()
+              && (!Open || Clock::now() - LastChunk >= kInterval)) {
+            for (unsigned char Stream = 1; Stream <= 2; ++Stream) {
+              std::string Text;
+              m_Pending[Stream - 1].take(Text, kChunkSize);
+              if (Text.empty())
+                continue;
+              const uint32_t Size = Text.size();
+              Outgoing += (char)Stream;
+              Outgoing.append((const char*)&Size, sizeof(Size));
+              Outgoing += Text;
+            }
+            LastChunk = Clock::now();
+          }
+        }
+
+        pollfd FDs[4];
+        nfds_t NumFDs = 0;
+        for (int FD : m_Streams)
+          if (FD >= 0)
+            FDs[NumFDs++] = {FD, POLLIN, 0};
+        const nfds_t DoneIdx = NumFDs;
+        if (m_Done >= 0 && Open)
+          FDs[NumFDs++] = {m_Done, POLLIN, 0};
+        if (Sent < Outgoing.size())
+          FDs[NumFDs++] = {m_Messages, POLLOUT, 0};
+        int Timeout = -1;
+        if (Sent == Outgoing.size() && hasPending()) {
+          auto Wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+              kInterval - (Clock::now() - LastChunk));
+          Timeout = Wait.count() > 0 ? (int)Wait.count() : 0;
+        }
+        if (::poll(FDs, NumFDs, Timeout) < 0 && errno != EINTR)
+          return;
+        // Once the cell is done, the streams are read until they are empty,
+        // or for as much as is kept of them, and closed.
+        const bool Done = DoneIdx < NumFDs && FDs[DoneIdx].fd == m_Done
+                          && FDs[DoneIdx].revents;
+
+        for (int& FD : m_Streams) {
+          if (FD < 0)
+            continue;
+          bool Close = false;
+          for (size_t Drained = 0; ;) {
+            const long Read = ::read(FD, Buf, sizeof(Buf));
+            if (Read > 0) {
+              m_Pending[&FD - m_Streams].append(Buf, Read);
+              Drained += Read;
+              if (Done && Drained < RingBuffer::kCapacity)
+                continue;
+              Close = Done;
+            } else if (Read < 0 && errno == EINTR)
+              continue;
+            else
+              Close = Done || !Read || errno != EAGAIN;
+            break;
+          }
+          if (Close) {
+            ::close(FD);
+            FD = -1;
+          }
+        }
+        if (Sent < Outgoing.size()) {
+          const long Written = ::write(m_Messages, Outgoing.data() + Sent,
+                                       Outgoing.size() - Sent);
+          if (Written > 0)
+            Sent += Written;
+          else if (errno != EAGAIN && errno != EINTR)
+            return; // The kernel is gone.
+        }
+      }
+    }
+  };
+
+  constexpr std::chrono::milliseconds OutputCapture::kInterval;
+
+  static bool setNonBlocking(int FD) {
+    const int Flags = ::fcntl(FD, F_GETFL);
+    return Flags >= 0 && ::fcntl(FD, F_SETFL, Flags | O_NONBLOCK) >= 0;
+  }
+#endif
+} // unnamed namespace
+
 namespace cling {
   namespace Jupyter {
     struct MIMEDataRef {
@@ -42,7 +319,7 @@ namespace cling {
       MIMEDataRef(const std::string& str):
       m_Data(str.c_str()), m_Size((long)str.length() + 1) {}
       MIMEDataRef(const char* str):
-      MIMEDataRef(std::string(str)) {}
+      m_Data(str), m_Size((long)::strlen(str) + 1) {}
       MIMEDataRef(const char* data, long size):
       m_Data(data), m_Size(size) {}
     };
@@ -62,33 +339,72 @@ namespace cling {
       //   - size of MIME data buffer (including the terminating 0 for
       //     0-terminated strings)
       //   - MIME data buffer
+      // or, for data of at least kSharedMemoryThreshold bytes:
+      //   - minus the size of the path of the file holding the data
+      //     (including the terminating 0); the kernel removes the file.
+      //   - the path as 0-terminated string
+
+      // Assemble the message to write it at once: one pipe message per
+      // output, whatever the number of its elements.
+      std::string message(1, (char)sizeof(long));
+      appendLong(message, (long)contentDict.size());
+
+      for (const auto& iContent: contentDict) {
+        const MIMEDataRef& mimeData = iContent.second;
+        appendElement(message, iContent.first, std::string(), mimeData.m_Data,
+                      mimeData.m_Size);
+      }
+      return writeAll(pipeToJupyterFD, message.data(), message.size());
+    }
 
-      // Write number of dictionary elements (and the size of that number in a
-      // char)
-      unsigned char sizeLong = sizeof(long);
-      if (write(pipeToJupyterFD, &sizeLong, 1) != 1)
+    /// Push an array to Jupyter, as its bytes rather than as text. To be
+    /// called from user code, e.g. for a std::vector<double> v:
+    /// pushArray(v.data(), "f8", {(long)v.size()}).
+    ///\param data - the elements, contiguous and in C order.
+    ///\param dtype - the NumPy type string of the elements, e.g. "f8" or
+    /// "<i4"; without byte order, that of this machine.
+    ///\param shape - the extent of each dimension.
+    ///\returns `false` if dtype is unknown or the array could not be sent.
+    bool pushArray(const void* data, const std::string& dtype,
+                   const std::vector<long>& shape) {
+      // The element "application/x-cling-ndarray" is a JSON header with the
+      // dtype and shape, padded with 0s to a multiple of 64 bytes such that
+      // the elements that follow it are aligned in the kernel's mapping of
+      // the shared memory. A "text/plain" element describes the array for
+      // frontends that cannot show it.
+      std::string typeStr = dtype;
+      if (typeStr.empty() || !::strchr("<>|=", typeStr[0])) {
+        const unsigned one = 1;
+        typeStr.insert(0, *(const char*)&one ? "<" : ">");
+      }
+      size_t digits = typeStr.find_first_of("0123456789");
+      if (digits == std::string::npos || typeStr.size() < 3)
         return false;
-      long dictSize = contentDict.size();
-      if (write(pipeToJupyterFD, &dictSize, sizeof(long)) != sizeof(long))
+      long size = ::atol(typeStr.c_str() + digits);
+      if (size <= 0)
         return false;
 
-      for (auto iContent: contentDict) {
-        const std::string& mimeType = iContent.first;
-        long mimeTypeSize = (long)mimeType.size();
-        if (write(pipeToJupyterFD, &mimeTypeSize, sizeof(long)) != sizeof(long))
-          return false;
-        if (write(pipeToJupyterFD, mimeType.c_str(), mimeType.size() + 1)
-            != (long)(mimeType.size() + 1))
-          return false;
-        const MIMEDataRef& mimeData = iContent.second;
-        if (write(pipeToJupyterFD, &mimeData.m_Size, sizeof(long))
-            != sizeof(long))
-          return false;
-        if (write(pipeToJupyterFD, mimeData.m_Data, mimeData.m_Size)
-            != mimeData.m_Size)
+      std::string head = "{\"dtype\": \"" + typeStr + "\", \"shape\": [";
+      std::string text = "array(dtype='" + typeStr + "', shape=(";
+      for (size_t i = 0, n = shape.size(); i < n; ++i) {
+        if (shape[i] < 0)
           return false;
+        size *= shape[i];
+        const std::string extent = std::to_string(shape[i]);
+        head += (i ? ", " : "") + extent;
+        text += (i ? ", " : "") + extent;
       }
-      return true;
+      head += "]}";
+      head.resize((head.size() / 64 + 1) * 64, '\0');
+      text += shape.size() == 1 ? ",))" : "))";
+
+      std::string message(1, (char)sizeof(long));
+      appendLong(message, 2);
+      appendElement(message, "application/x-cling-ndarray", head,
+                    (const char*)data, size);
+      appendElement(message, "text/plain", std::string(), text.c_str(),
+                    (long)text.size() + 1);
+      return writeAll(pipeToJupyterFD, message.data(), message.size());
     }
   } // namespace Jupyter
 } // namespace cling
@@ -106,6 +422,9 @@ TheMetaProcessor*
 cling_create(int argc, const char *argv[], const char* llvmdir, int pipefd) {
   pipeToJupyterFD = pipefd;
   auto I = new cling::Interpreter(argc, argv, llvmdir);
+  // Re-running the cells of a notebook compiles only those that changed or
+  // depend on what changed.
+  I->getRuntimeOptions().CacheCells = 1;
   return new cling::MetaProcessor(*I, cling::errs());
 }
 
@@ -178,6 +497,85 @@ void cling_eval_free(char* str) {
   free(str);
 }
 
+/// Capture stdout and stderr until cling_capture_end(), see OutputCapture.
+/// Returns the pipe to read the chunks of output from, which the kernel
+/// closes; -1 if output cannot be captured, e.g. on Windows.
+int cling_capture_begin() {
+#ifndef _WIN32
+  if (savedStdFDs[0] >= 0)
+    return -1;
+  int Messages[2], Streams[2][2], Done[2];
+  if (::pipe(Messages))
+    return -1;
+  if (::pipe(Streams[0])) {
+    ::close(Messages[0]);
+    ::close(Messages[1]);
+    return -1;
+  }
+  if (::pipe(Streams[1])) {
+    for (int FD : {Messages[0], Messages[1], Streams[0][0], Streams[0][1]})
+      ::close(FD);
+    return -1;
+  }
+  if (::pipe(Done)) {
+    for (int FD : {Messages[0], Messages[1], Streams[0][0], Streams[0][1],
+                   Streams[1][0], Streams[1][1]})
+      ::close(FD);
+    return -1;
+  }
+  // Not for the processes that the cell starts: the ends they keep open
+  // would hold the kernel back.
+  for (int FD : {Messages[0], Messages[1], Streams[0][0], Streams[1][0],
+                 Done[0], Done[1]})
+    ::fcntl(FD, F_SETFD, FD_CLOEXEC);
+  captureDoneFD = Done[1];
+  setNonBlocking(Messages[1]);
+  setNonBlocking(Streams[0][0]);
+  setNonBlocking(Streams[1][0]);
+
+  ::fflush(stdout);
+  ::fflush(stderr);
+  for (int I = 0; I < 2; ++I) {
+    savedStdFDs[I] = ::dup(I + 1);
+    ::dup2(Streams[I][1], I + 1);
+    ::close(Streams[I][1]);
+  }
+  OutputCapture* Capture
+    = new OutputCapture(Streams[0][0], Streams[1][0], Messages[1], Done[0]);
+  std::thread([Capture] {
+    Capture->run();
+    delete Capture;
+  }).detach();
+  return Messages[0];
+#else
+  return -1;
+#endif
+}
+
+/// Restore stdout and stderr; the kernel gets what is left of the output,
+/// then the end of the pipe of cling_capture_begin().
+void cling_capture_end() {
+#ifndef _WIN32
+  cling::outs().flush();
+  ::fflush(stdout);
+  ::fflush(stderr);
+  for (int I = 0; I < 2; ++I) {
+    if (savedStdFDs[I] < 0)
+      continue;
+    ::dup2(savedStdFDs[I], I + 1);
+    ::close(savedStdFDs[I]);
+    savedStdFDs[I] = -1;
+  }
+  if (captureDoneFD >= 0) {
+    // A byte rather than the end of the pipe: a process forked by the cell
+    // might still hold it.
+    while (::write(captureDoneFD, "", 1) < 0 && errno == EINTR) {}
+    ::close(captureDoneFD);
+    captureDoneFD = -1;
+  }
+#endif
+}
+
 /// Code completion interfaces.
 
 /// Start completion of code. Returns a handle to be passed to
@@ -22,6 +22,8 @@ __version__ = '0.0.3'
 import ctypes
 from contextlib import contextmanager
 from fcntl import fcntl, F_GETFL, F_SETFL
+import json
+import mmap
 import os
 import shutil
 import select
@@ -41,6 +43,10 @@ from jupyter_client.session import Session
 class my_void_p(ctypes.c_void_p):
   pass
 
+# The MIME type of cling::Jupyter::pushArray(): a JSON header with dtype and
+# shape, padded with 0s to a multiple of 64 bytes, then the elements.
+NDARRAY_MIME = 'application/x-cling-ndarray'
+
 libc = ctypes.CDLL(None)
 try:
     c_stdout_p = ctypes.c_void_p.in_dll(libc, 'stdout')
@@ -165,6 +171,12 @@ class ClingKernel(Kernel):
         self.libclingJupyter.cling_complete_start.restype = my_void_p
         self.libclingJupyter.cling_complete_next.restype = my_void_p #c_char_p
 
+        # The pipe of cling_capture_begin(), while a cell runs; -1 if the
+        # streams are captured through FdReplacer instead.
+        self.capture_pipe = -1
+        self.native_capture = hasattr(self.libclingJupyter,
+                                      'cling_capture_begin')
+
     def _process_stdio_data(self, pipe, name):
         """Read from the pipe, send it to IOPub as name stream."""
         data = os.read(pipe, 1024)
@@ -174,6 +186,34 @@ class ClingKernel(Kernel):
           'text': data.decode('utf8', 'replace'),
         }, parent=self._parent_header)
 
+    def _process_capture_data(self):
+        """Send a chunk of the native capture to IOPub as a stream message."""
+        # Wire format: the stream (1: stdout, 2: stderr) as unsigned char,
+        # the size of the text as 32 bit unsigned int, the text.
+        head = os.read(self.capture_pipe, 1)
+        if not head:
+            os.close(self.capture_pipe)
+            self.capture_pipe = -1
+            return
+        stream = struct.unpack('B', head)[0]
+        size = struct.unpack('=I', self._read_exactly(self.capture_pipe, 4))[0]
+        data = self._read_exactly(self.capture_pipe, size)
+        self.session.send(self.iopub_socket, 'stream', {
+          'name': 'stdout' if stream == 1 else 'stderr',
+          'text': data.decode('utf8', 'replace'),
+        }, parent=self._parent_header)
+
+    def _read_exactly(self, pipe, size):
+        """Read size bytes from a pipe; os.read() returns what is available."""
+        chunks = []
+        while size:
+            chunk = os.read(pipe, size)
+            if not chunk:
+                raise EOFError('sideband pipe closed')
+            chunks.append(chunk)
+            size -= len(chunk)
+        return b''.join(chunks)
+
     def _recv_dict(self, pipe):
         """Receive a serialized dict on a pipe
 
@@ -184,51 +224,101 @@ class ClingKernel(Kernel):
         #   // - num bytes in a long (sent as a single unsigned char!)
         #   // - num elements of the MIME dictionary; Jupyter selects one to display.
         #   // For each MIME dictionary element:
-        #   //   - length of MIME type key
+        #   //   - size of MIME type key (including the terminating 0)
         #   //   - MIME type key
         #   //   - size of MIME data buffer (including the terminating 0 for
         #   //     0-terminated strings)
         #   //   - MIME data buffer
+        #   // or, for large data:
+        #   //   - minus the size of the path of the file holding the data
+        #   //   - the path as 0-terminated string; the file is ours to remove
+        # The data of NDARRAY_MIME is kept as bytes, or as the mapping of the
+        # file: the array is not copied.
         data = {}
-        b1 = os.read(pipe, 1)
+        b1 = self._read_exactly(pipe, 1)
         sizeof_long = struct.unpack('B', b1)[0]
         if sizeof_long == 8:
-            fmt = 'Q'
+            fmt = 'q'
         else:
-            fmt = 'L'
-        buf = os.read(pipe, sizeof_long)
-        num_elements = struct.unpack(fmt, buf)[0]
+            fmt = 'l'
+        def read_long():
+            return struct.unpack(fmt, self._read_exactly(pipe, sizeof_long))[0]
+        num_elements = read_long()
         for i in range(num_elements):
-            buf = os.read(pipe, sizeof_long)
-            len_key = struct.unpack(fmt, buf)[0]
-            key = os.read(pipe, len_key).decode('utf8')
-            buf = os.read(pipe, sizeof_long)
-            len_value = struct.unpack(fmt, buf)[0]
-            value = os.read(pipe, len_value).decode('utf8')
-            data[key] = value
+            len_key = read_long()
+            key = self._read_exactly(pipe, len_key).rstrip(b'\0').decode('utf8')
+            len_value = read_long()
+            if len_value < 0:
+                path = self._read_exactly(pipe, -len_value).rstrip(b'\0')
+                try:
+                    with open(path, 'rb') as f:
+                        if key == NDARRAY_MIME:
+                            value = mmap.mmap(f.fileno(), 0,
+                                              access=mmap.ACCESS_READ)
+                        else:
+                            value = f.read()
+                finally:
+                    os.unlink(path)
+            else:
+                value = self._read_exactly(pipe, len_value)
+            if key == NDARRAY_MIME:
+                data[key] = value
+            else:
+                data[key] = value.decode('utf8')
         return data
 
+    def _decode_ndarray(self, value):
+        """Split the data of NDARRAY_MIME into its header and its elements.
+
+        Returns the header dict (dtype, shape) and a memoryview of the
+        elements, or a NumPy array of them if NumPy is available.
+        """
+        end = value.find(b'\0')
+        header = json.loads(bytes(value[:end]).decode('utf8'))
+        elements = memoryview(value)[(end // 64 + 1) * 64:]
+        try:
+            import numpy
+        except ImportError:
+            return header, elements
+        array = numpy.frombuffer(elements, dtype=header['dtype'])
+        return header, array.reshape(header['shape'])
+
 
     def _process_sideband_data(self):
         """publish display-data messages on IOPub.
         """
         data = self._recv_dict(self.sideband_pipe)
+        buffers = None
+        if NDARRAY_MIME in data:
+            # The header goes into the message, the elements into a binary
+            # buffer of it; the last array also stays with the kernel.
+            header, self.last_array = self._decode_ndarray(data[NDARRAY_MIME])
+            data[NDARRAY_MIME] = header
+            buffers = [memoryview(self.last_array).cast('B')]
         self.session.send(self.iopub_socket, 'display_data',
             content={
                 'data': data,
                 'metadata': {},
             },
             parent=self._parent_header,
+            buffers=buffers,
             )
 
     def forward_streams(self):
         """Put the forwarding pipes in place for stdout, stderr."""
+        self.replaced_streams = []
+        if self.native_capture:
+            self.capture_pipe = self.libclingJupyter.cling_capture_begin()
+            if self.capture_pipe >= 0:
+                return
         self.replaced_streams = [FdReplacer("stdout"), FdReplacer("stderr")]
 
     def handle_input(self):
         """Capture stdout, stderr and sideband. Forward them as stream messages."""
         # create pipe for stdout, stderr
         select_on = [self.sideband_pipe]
+        if self.capture_pipe >= 0:
+            select_on.append(self.capture_pipe)
         for rs in self.replaced_streams:
             if rs:
                 select_on.append(rs.pipe_out)
@@ -243,6 +333,8 @@ class ClingKernel(Kernel):
         for fd in r:
             if fd == self.sideband_pipe:
                 self._process_sideband_data()
+            elif fd == self.capture_pipe:
+                self._process_capture_data()
             else:
                 if fd == self.replaced_streams[0].pipe_out:
                     rs = 0
@@ -253,6 +345,11 @@ class ClingKernel(Kernel):
 
     def close_forwards(self):
         """Close the forwarding pipes."""
+        if self.capture_pipe >= 0:
+            # The reader thread sends what is left, then closes the pipe.
+            self.libclingJupyter.cling_capture_end()
+            while self.capture_pipe >= 0:
+                self.handle_input()
         libc.fflush(c_stdout_p)
         libc.fflush(c_stderr_p)
         for rs in self.replaced_streams:
@@ -0,0 +1,385 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include <cling/Interpreter/DynamicLibraryManager.h>
+#include <cling/Interpreter/Interpreter.h>
+#include <cling/Interpreter/LookupHelper.h>
+#include <cling/Interpreter/Value.h>
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef LLVM_ON_UNIX
+#include <sys/resource.h>
+#endif
+
+namespace {
+  typedef std::chrono::steady_clock Clock;
+
+  static double nanosecondsSince(Clock::time_point Start) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - Start)
+      .count();
+  }
+
+  ///\brief What the process spent, to tell the threads that ran from the
+  /// ones that waited: a thread blocking on a contended lock gives up its
+  /// CPU (a voluntary context switch) and stops accumulating CPU time.
+  struct Usage {
+    double CPUNs = 0;
+    long VoluntarySwitches = 0;
+    long InvoluntarySwitches = 0;
+
+    static Usage now() {
+      Usage U;
+#ifdef LLVM_ON_UNIX
+      struct rusage RU;
+      if (!::getrusage(RUSAGE_SELF, &RU)) {
+        U.CPUNs = (RU.ru_utime.tv_sec + RU.ru_stime.tv_sec) * 1e9
+                  + (RU.ru_utime.tv_usec + RU.ru_stime.tv_usec) * 1e3;
+        U.VoluntarySwitches = RU.ru_nvcsw;
+        U.InvoluntarySwitches = RU.ru_nivcsw;
+      }
+#endif
+      return U;
+    }
+
+    Usage& operator+=(const Usage& Other) {
+      CPUNs += Other.CPUNs;
+      VoluntarySwitches += Other.VoluntarySwitches;
+      InvoluntarySwitches += Other.InvoluntarySwitches;
+      return *this;
+    }
+
+    Usage operator-(const Usage& Start) const {
+      Usage U(*this);
+      U.CPUNs -= Start.CPUNs;
+      U.VoluntarySwitches -= Start.VoluntarySwitches;
+      U.InvoluntarySwitches -= Start.InvoluntarySwitches;
+      return U;
+    }
+  };
+
+  ///\brief Runs the benchmarks and prints one JSON line per benchmark.
+  class Runner {
+    llvm::raw_ostream& m_Out;
+    std::string m_Filter;
+    unsigned m_Repetitions;
+
+    ///\brief The median of measureThreads() with one thread, per benchmark.
+    llvm::StringMap<double> m_SingleThreadNs;
+
+    ///\brief Prints the line of Name, leaving it open for more fields.
+    void reportOpen(llvm::StringRef Name, unsigned Iterations,
+                    std::vector<double>& NsPerIter) {
+      std::sort(NsPerIter.begin(), NsPerIter.end());
+      m_Out << "{\"name\":\"" << Name << "\",\"iterations\":" << Iterations
+            << ",\"repetitions\":" << NsPerIter.size()
+            << ",\"min_ns\":" << uint64_t(NsPerIter.front())
+            << ",\"median_ns\":" << uint64_t(NsPerIter[NsPerIter.size() / 2])
+            << ",\"max_ns\":" << uint64_t(NsPerIter.back());
+    }
+
+    void report(llvm::StringRef Name, unsigned Iterations,
+                std::vector<double>& NsPerIter) {
+      reportOpen(Name, Iterations, NsPerIter);
+      m_Out << "}\n";
+      m_Out.flush();
+    }
+
+  public:
+    Runner(llvm::raw_ostream& Out, std::string Filter, unsigned Repetitions):
+      m_Out(Out), m_Filter(std::move(Filter)), m_Repetitions(Repetitions) {}
+
+    bool isEnabled(llvm::StringRef Name) const {
+      return m_Filter.empty() || Name.contains(m_Filter);
+    }
+
+    ///\brief Times Iterations calls of Body, m_Repetitions times.
+    template <class F>
+    void measure(llvm::StringRef Name, unsigned Iterations, F Body) {
+      if (!isEnabled(Name))
+        return;
+      Body(); // Warm up caches, e.g. the JIT's.
+      std::vector<double> NsPerIter;
+      for (unsigned R = 0; R < m_Repetitions; ++R) {
+        Clock::time_point Start = Clock::now();
+        for (unsigned I = 0; I < Iterations; ++I)
+          Body();
+        NsPerIter.push_back(nanosecondsSince(Start) / Iterations);
+      }
+      report(Name, Iterations, NsPerIter);
+    }
+
+    ///\brief Like measure(), for benchmarks with a setup that must not be
+    /// timed: Body(Iterations) returns the nanoseconds of what it timed.
+    template <class F>
+    void measureTimed(llvm::StringRef Name, unsigned Iterations, F Body) {
+      if (!isEnabled(Name))
+        return;
+      std::vector<double> NsPerIter;
+      for (unsigned R = 0; R < m_Repetitions; ++R)
+        NsPerIter.push_back(Body(Iterations) / Iterations);
+      report(Name, Iterations, NsPerIter);
+    }
+
+    ///\brief Times Threads threads calling Body(State) Iterations times
+    /// each, all at once, m_Repetitions times. Each thread first makes its
+    /// State by calling Setup(), untimed; the states are destroyed untimed
+    /// too, once all threads are done.
+    ///
+    /// The nanoseconds per iteration are the wall time over all iterations
+    /// of all threads, the inverse of the throughput: with perfect scaling
+    /// they go down linearly with Threads. "scaling" is the throughput
+    /// relative to Threads times the one of a single thread (1 is perfect),
+    /// "cpu_utilization" the CPU time of the threads over their wall time,
+    /// and the *_switches the context switches per iteration; a lock all
+    /// threads contend for shows as a utilization well below 1 and as many
+    /// voluntary switches.
+    template <class S, class F>
+    void measureThreads(llvm::StringRef Name, unsigned Threads,
+                        unsigned Iterations, S Setup, F Body) {
+      const std::string FullName
+        = Name.str() + "/threads:" + std::to_string(Threads);
+      if (!isEnabled(FullName))
+        return;
+      typedef decltype(Setup()) State;
+      std::vector<double> NsPerIter;
+      Usage Used;
+      for (unsigned R = 0; R < m_Repetitions; ++R) {
+        std::vector<State> States(Threads);
+        std::mutex Mutex;
+        std::condition_variable Changed;
+        unsigned Ready = 0;
+        bool Go = false;
+        std::vector<std::thread> Workers;
+        for (unsigned T = 0; T < Threads; ++T) {
+          Workers.emplace_back([&, T] {
+            States[T] = Setup();
+            {
+              std::unique_lock<std::mutex> Lock(Mutex);
+              ++Ready;
+              Changed.notify_all();
+              Changed.wait(Lock, [&] { return Go; });
+            }
+            for (unsigned I = 0; I < Iterations; ++I)
+              Body(States[T]);
+          });
+        }
+        Usage Start;
+        Clock::time_point StartTime;
+        {
+          std::unique_lock<std::mutex> Lock(Mutex);
+          Changed.wait(Lock, [&] { return Ready == Threads; });
+          Start = Usage::now();
+          StartTime = Clock::now();
+          Go = true;
+        }
+        Changed.notify_all();
+        for (std::thread& Worker : Workers)
+          Worker.join();
+        NsPerIter.push_back(nanosecondsSince(StartTime)
+                            / (Threads * Iterations));
+        Used += Usage::now() - Start;
+      }
+
+      reportOpen(FullName, Iterations, NsPerIter);
+      const double MedianNs = NsPerIter[NsPerIter.size() / 2];
+      const double TotalIters = double(Threads) * Iterations * m_Repetitions;
+      double WallNs = 0;
+      for (double Ns : NsPerIter)
+        WallNs += Ns * Threads * Iterations;
+      if (Threads == 1)
+        m_SingleThreadNs[Name] = MedianNs;
+      m_Out << ",\"threads\":" << Threads
+            << ",\"ops_per_s\":" << uint64_t(1e9 / MedianNs);
+      auto Single = m_SingleThreadNs.find(Name);
+      if (Single != m_SingleThreadNs.end()) {
+        m_Out << ",\"scaling\":";
+        m_Out << llvm::format("%.3f", Single->second / MedianNs / Threads);
+      }
+#ifdef LLVM_ON_UNIX
+      m_Out << ",\"cpu_utilization\":"
+            << llvm::format("%.3f", Used.CPUNs / (WallNs * Threads))
+            << ",\"voluntary_switches\":"
+            << llvm::format("%.2f", Used.VoluntarySwitches / TotalIters)
+            << ",\"involuntary_switches\":"
+            << llvm::format("%.2f", Used.InvoluntarySwitches / TotalIters);
+#endif
+      m_Out << "}\n";
+      m_Out.flush();
+    }
+  };
+
+  static const char* const kSTLHeaders = "#include <algorithm>\n"
+                                         "#include <map>\n"
+                                         "#include <memory>\n"
+                                         "#include <string>\n"
+                                         "#include <vector>\n";
+} // unnamed namespace
+
+int main(int argc, const char* const* argv) {
+  std::string Filter;
+  unsigned Repetitions = 5;
+  unsigned MaxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+  // The interpreter gets argv[0] and everything after "--".
+  std::vector<const char*> InterpArgs(1, argv[0]);
+  for (int I = 1; I < argc; ++I) {
+    llvm::StringRef Arg(argv[I]);
+    if (Arg == "--") {
+      InterpArgs.insert(InterpArgs.end(), argv + I + 1, argv + argc);
+      break;
+    }
+    if (Arg.startswith("--filter="))
+      Filter = Arg.substr(9);
+    else if (Arg.startswith("--repetitions=")) {
+      if (Arg.substr(14).getAsInteger(10, Repetitions) || !Repetitions) {
+        llvm::errs() << "cling-bench: invalid " << Arg << '\n';
+        return 1;
+      }
+    } else if (Arg.startswith("--threads=")) {
+      if (Arg.substr(10).getAsInteger(10, MaxThreads) || !MaxThreads) {
+        llvm::errs() << "cling-bench: invalid " << Arg << '\n';
+        return 1;
+      }
+    } else {
+      llvm::errs() << "usage: cling-bench [--filter=<substring>] "
+                      "[--repetitions=<n>] [--threads=<n>] "
+                      "[-- <cling args>]\n";
+      return 1;
+    }
+  }
+  const int InterpArgc = InterpArgs.size();
+  const char* const* InterpArgv = InterpArgs.data();
+
+  llvm::raw_ostream& Out = llvm::outs();
+  Out << "{\"context\":{\"cling\":\"" << cling::Interpreter::getVersion()
+      << "\",\"llvm\":\"" << LLVM_VERSION_STRING << "\"}}\n";
+  Runner Bench(Out, Filter, Repetitions);
+
+  Bench.measure("interpreter.construct", 3, [&] {
+    cling::Interpreter Interp(InterpArgc, InterpArgv, LLVMDIR);
+  });
+
+  Bench.measureTimed("declare.stl-headers", 1, [&](unsigned N) {
+    double Ns = 0;
+    for (unsigned I = 0; I < N; ++I) {
+      cling::Interpreter Interp(InterpArgc, InterpArgv, LLVMDIR);
+      Clock::time_point Start = Clock::now();
+      Interp.declare(kSTLHeaders);
+      Ns += nanosecondsSince(Start);
+    }
+    return Ns;
+  });
+
+  // The remaining benchmarks share one interpreter.
+  cling::Interpreter Interp(InterpArgc, InterpArgv, LLVMDIR);
+  Interp.declare(kSTLHeaders);
+  Interp.declare("int i = 0;");
+
+  Bench.measure("process.trivial", 200, [&] {
+    cling::Value V;
+    Interp.process("i + 1;", &V);
+  });
+
+  Bench.measureTimed("unload.transactions", 100, [&](unsigned N) {
+    static unsigned Counter = 0;
+    for (unsigned I = 0; I < N; ++I)
+      Interp.declare("int cling_bench_unload_" + std::to_string(Counter++)
+                     + " = 0;");
+    Clock::time_point Start = Clock::now();
+    Interp.unload(N);
+    return nanosecondsSince(Start);
+  });
+
+  const cling::LookupHelper& LH = Interp.getLookupHelper();
+  Bench.measure("lookup.findScope", 1000, [&] {
+    LH.findScope("std::vector<int>", cling::LookupHelper::NoDiagnostics);
+  });
+
+  Bench.measure("lookup.findType", 1000, [&] {
+    LH.findType("std::map<std::string, std::vector<int>>",
+                cling::LookupHelper::NoDiagnostics);
+  });
+
+  Bench.measure("dyld.search-missing", 3, [&] {
+    Interp.getDynamicLibraryManager()
+      ->searchLibrariesForSymbol("_Z26cling_bench_missing_symbolv",
+                                 /*searchSystem=*/true);
+  });
+
+  cling::Value Vec;
+  Interp.evaluate("std::vector<int>{1, 2, 3, 4, 5, 6, 7, 8}", Vec);
+  Bench.measure("value.print", 200, [&] {
+    std::string Printed;
+    llvm::raw_string_ostream OS(Printed);
+    Vec.print(OS);
+  });
+
+  // Interpreters driven concurrently, one per thread, for 1, 2, 4... up to
+  // MaxThreads threads. What they share in the process serializes them: the
+  // globals of the runtime, LLVM's ManagedStatics, the lock of
+  // llvm::sys::DynamicLibrary and the scans of the Dyld.
+  std::vector<unsigned> ThreadCounts;
+  for (unsigned T = 1; T < MaxThreads; T *= 2)
+    ThreadCounts.push_back(T);
+  ThreadCounts.push_back(MaxThreads);
+
+  typedef std::unique_ptr<cling::Interpreter> InterpPtr;
+  auto NoState = [] { return InterpPtr(); };
+  auto MakeInterp = [&] {
+    InterpPtr I(new cling::Interpreter(InterpArgc, InterpArgv, LLVMDIR));
+    I->declare("extern \"C\" int atoi(const char*);\n"
+               "int i = 0;");
+    return I;
+  };
+
+  for (unsigned T : ThreadCounts)
+    Bench.measureThreads("interpreter.construct", T, 2, NoState,
+                         [&](InterpPtr&) {
+      cling::Interpreter Interp(InterpArgc, InterpArgv, LLVMDIR);
+    });
+
+  for (unsigned T : ThreadCounts)
+    Bench.measureThreads("process.trivial", T, 100, MakeInterp,
+                         [&](InterpPtr& I) {
+      cling::Value V;
+      I->process("i + 1;", &V);
+    });
+
+  // Each wrapper has the JIT resolve a symbol of the process, through
+  // llvm::sys::DynamicLibrary::SearchForAddressOfSymbol().
+  for (unsigned T : ThreadCounts)
+    Bench.measureThreads("process.call", T, 100, MakeInterp,
+                         [&](InterpPtr& I) {
+      cling::Value V;
+      I->process("atoi(\"1\") + i;", &V);
+    });
+
+  for (unsigned T : ThreadCounts)
+    Bench.measureThreads("dyld.search-missing", T, 2, MakeInterp,
+                         [&](InterpPtr& I) {
+      I->getDynamicLibraryManager()
+        ->searchLibrariesForSymbol("_Z26cling_bench_missing_symbolv",
+                                   /*searchSystem=*/true);
+    });
+
+  return 0;
+}
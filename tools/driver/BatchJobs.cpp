@@ -0,0 +1,201 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "BatchJobs.h"
+
+#include "cling/Interpreter/Interpreter.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#ifdef LLVM_ON_UNIX
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+#ifdef LLVM_ON_UNIX
+  struct Job {
+    pid_t Pid = -1;
+    ///\brief Unlinked temporary files collecting stdout and stderr.
+    int Out = -1;
+    int Err = -1;
+    bool Done = false;
+    int Status = 0;
+  };
+
+  static int createOutputFile() {
+    int FD = -1;
+    llvm::SmallString<128> Path;
+    if (llvm::sys::fs::createTemporaryFile("cling-job", "txt", FD, Path))
+      return -1;
+    ::unlink(Path.c_str());
+    return FD;
+  }
+
+  ///\brief Copies the output of a job to the standard stream StdFD, and
+  /// closes it.
+  static void copyOutput(int& FD, int StdFD) {
+    if (FD < 0)
+      return;
+    char Buf[65536];
+    ::lseek(FD, 0, SEEK_SET);
+    for (;;) {
+      ssize_t Read = ::read(FD, Buf, sizeof(Buf));
+      if (Read < 0 && errno == EINTR)
+        continue;
+      if (Read <= 0)
+        break;
+      for (ssize_t Done = 0; Done < Read;) {
+        ssize_t Written = ::write(StdFD, Buf + Done, Read - Done);
+        if (Written < 0) {
+          if (errno == EINTR)
+            continue;
+          break;
+        }
+        Done += Written;
+      }
+    }
+    ::close(FD);
+    FD = -1;
+  }
+
+  ///\brief Whether the job failed, reporting how.
+  static bool reportFailure(const Job& J, const std::string& Input) {
+    const bool Ran = J.Pid > 0 && J.Status != -1;
+    if (Ran && WIFEXITED(J.Status) && WEXITSTATUS(J.Status) == EXIT_SUCCESS)
+      return false;
+    llvm::errs() << "cling: '" << Input << "' ";
+    if (!Ran)
+      llvm::errs() << "could not be run\n";
+    else if (WIFSIGNALED(J.Status))
+      llvm::errs() << "crashed with signal " << WTERMSIG(J.Status) << '\n';
+    else if (WIFEXITED(J.Status))
+      llvm::errs() << "failed with exit code " << WEXITSTATUS(J.Status)
+                   << '\n';
+    else
+      llvm::errs() << "stopped\n";
+    return true;
+  }
+#endif
+} // unnamed namespace
+
+namespace cling {
+  namespace driver {
+
+#ifdef LLVM_ON_UNIX
+    bool forkBatchJobs(Interpreter& Interp, unsigned MaxJobs,
+                       const std::vector<std::string>& Inputs,
+                       std::string& Input, int& ExitCode) {
+      if (!MaxJobs)
+        MaxJobs = std::max(std::thread::hardware_concurrency(), 1u);
+      std::vector<Job> Jobs(Inputs.size());
+      size_t Next = 0, Printed = 0, Running = 0, Failed = 0;
+
+      // Else the forks would wait for the threads of the JIT's pools, or
+      // print what this process buffered.
+      Interp.prepareFork();
+      ::fflush(stdout);
+      ::fflush(stderr);
+      llvm::errs().flush();
+      while (Printed < Jobs.size()) {
+        for (; Running < MaxJobs && Next < Jobs.size(); ++Next) {
+          Job& J = Jobs[Next];
+          J.Out = createOutputFile();
+          J.Err = createOutputFile();
+          if (J.Out >= 0 && J.Err >= 0)
+            J.Pid = ::fork();
+          if (!J.Pid) {
+            Interp.onForked();
+            // The inputs run side by side: none can have the terminal.
+            const int Null = ::open("/dev/null", O_RDONLY);
+            if (Null >= 0) {
+              ::dup2(Null, STDIN_FILENO);
+              ::close(Null);
+            }
+            ::dup2(J.Out, STDOUT_FILENO);
+            ::dup2(J.Err, STDERR_FILENO);
+            for (const Job& Other : Jobs) {
+              if (Other.Out >= 0)
+                ::close(Other.Out);
+              if (Other.Err >= 0)
+                ::close(Other.Err);
+            }
+            Input = Inputs[Next];
+            return true;
+          }
+          if (J.Pid < 0) {
+            llvm::errs() << "cling: cannot fork to run '" << Inputs[Next]
+                         << "': " << ::strerror(errno) << '\n';
+            J.Done = true;
+            J.Status = -1;
+          } else
+            ++Running;
+        }
+
+        // Print the jobs done, in order.
+        for (; Printed < Next && Jobs[Printed].Done; ++Printed) {
+          Job& J = Jobs[Printed];
+          copyOutput(J.Out, STDOUT_FILENO);
+          copyOutput(J.Err, STDERR_FILENO);
+          if (reportFailure(J, Inputs[Printed]))
+            ++Failed;
+        }
+        if (!Running)
+          continue;
+
+        int Status = 0;
+        const pid_t Pid = ::waitpid(-1, &Status, 0);
+        if (Pid < 0) {
+          if (errno == EINTR)
+            continue;
+          // Our children are gone.
+          for (Job& J : Jobs)
+            if (J.Pid > 0 && !J.Done) {
+              J.Done = true;
+              J.Status = -1;
+            }
+          Running = 0;
+          continue;
+        }
+        for (Job& J : Jobs)
+          if (J.Pid == Pid && !J.Done) {
+            J.Done = true;
+            J.Status = Status;
+            --Running;
+            break;
+          }
+      }
+
+      if (Failed)
+        llvm::errs() << "cling: " << Failed << " of " << Jobs.size()
+                     << " inputs failed\n";
+      ExitCode = Failed ? EXIT_FAILURE : EXIT_SUCCESS;
+      return false;
+    }
+#else
+    bool forkBatchJobs(Interpreter&, unsigned,
+                       const std::vector<std::string>&, std::string&,
+                       int& ExitCode) {
+      llvm::errs() << "cling: -j is not supported on this platform\n";
+      ExitCode = EXIT_FAILURE;
+      return false;
+    }
+#endif
+  } // end namespace driver
+} // end namespace cling
@@ -0,0 +1,41 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_DRIVER_BATCH_JOBS_H
+#define CLING_DRIVER_BATCH_JOBS_H
+
+#include <string>
+#include <vector>
+
+namespace cling {
+  class Interpreter;
+
+  namespace driver {
+    ///\brief Runs each of Inputs in its own fork of this process, at most
+    /// MaxJobs at a time: the inputs start from Interp as initialized so
+    /// far, and do not see each other. The output of each
+    /// input is printed once it is done, in the order of Inputs, with
+    /// stdout and stderr kept apart. Only returns in a fork, or when all
+    /// inputs ran.
+    ///
+    ///\param[in] Interp - The interpreter, whose threads are idled before
+    ///   the forks and made anew in them, see Interpreter::prepareFork().
+    ///\param[in] MaxJobs - The number of forks running at once, 0 for one
+    ///   per core.
+    ///\param[out] Input - The input to run, in the fork.
+    ///\param[out] ExitCode - EXIT_FAILURE if an input failed or crashed,
+    ///   else EXIT_SUCCESS; in this process.
+    ///\returns true in the fork, which now has the streams for Input.
+    ///
+    bool forkBatchJobs(Interpreter& Interp, unsigned MaxJobs,
+                       const std::vector<std::string>& Inputs,
+                       std::string& Input, int& ExitCode);
+  } // end namespace driver
+} // end namespace cling
+
+#endif // CLING_DRIVER_BATCH_JOBS_H
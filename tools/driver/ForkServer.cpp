@@ -0,0 +1,254 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "ForkServer.h"
+
+#include "cling/Interpreter/Interpreter.h"
+
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef LLVM_ON_UNIX
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// A job is sent as its payload size, with the client's stdin, stdout and
+// stderr attached, then the payload: the client's working directory and the
+// inputs, separated by '\0'. The fork running the job answers with its exit
+// code, then closes the connection by exiting.
+
+namespace {
+#ifdef LLVM_ON_UNIX
+  static bool readAll(int FD, void* Buf, size_t Size) {
+    for (size_t Done = 0; Done < Size;) {
+      ssize_t Read = ::read(FD, (char*)Buf + Done, Size - Done);
+      if (Read <= 0) {
+        if (Read && errno == EINTR)
+          continue;
+        return false;
+      }
+      Done += Read;
+    }
+    return true;
+  }
+
+  static bool writeAll(int FD, const void* Buf, size_t Size) {
+    for (size_t Done = 0; Done < Size;) {
+      ssize_t Written = ::write(FD, (const char*)Buf + Done, Size - Done);
+      if (Written < 0) {
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+      Done += Written;
+    }
+    return true;
+  }
+
+  static bool makeAddress(const std::string& Path, sockaddr_un& Addr) {
+    Addr = sockaddr_un();
+    Addr.sun_family = AF_UNIX;
+    if (Path.size() >= sizeof(Addr.sun_path)) {
+      llvm::errs() << "cling: socket path too long: " << Path << '\n';
+      return false;
+    }
+    ::strcpy(Addr.sun_path, Path.c_str());
+    return true;
+  }
+
+  static void printError(const char* What, const std::string& Path) {
+    llvm::errs() << "cling: cannot " << What << " '" << Path
+                 << "': " << ::strerror(errno) << '\n';
+  }
+
+  ///\brief Receives the job on Connection and makes its streams and working
+  /// directory the ones of this process.
+  static bool receiveJob(int Connection, std::vector<std::string>& Inputs) {
+    uint32_t Size = 0;
+    iovec IOV = {&Size, sizeof(Size)};
+    alignas(cmsghdr) char Control[CMSG_SPACE(3 * sizeof(int))];
+    msghdr Msg = msghdr();
+    Msg.msg_iov = &IOV;
+    Msg.msg_iovlen = 1;
+    Msg.msg_control = Control;
+    Msg.msg_controllen = sizeof(Control);
+    if (::recvmsg(Connection, &Msg, MSG_WAITALL) != sizeof(Size))
+      return false;
+    cmsghdr* CMsg = CMSG_FIRSTHDR(&Msg);
+    if (!CMsg || CMsg->cmsg_type != SCM_RIGHTS
+        || CMsg->cmsg_len != CMSG_LEN(3 * sizeof(int)))
+      return false;
+    int FDs[3];
+    ::memcpy(FDs, CMSG_DATA(CMsg), sizeof(FDs));
+    for (int StdFD = 0; StdFD < 3; ++StdFD) {
+      ::dup2(FDs[StdFD], StdFD);
+      ::close(FDs[StdFD]);
+    }
+
+    std::string Payload(Size, '\0');
+    if (!readAll(Connection, &Payload[0], Size))
+      return false;
+    for (size_t Begin = 0; Begin < Size;) {
+      size_t End = Payload.find('\0', Begin);
+      if (End == std::string::npos)
+        End = Size;
+      Inputs.push_back(Payload.substr(Begin, End - Begin));
+      Begin = End + 1;
+    }
+    if (Inputs.empty() || ::chdir(Inputs.front().c_str()))
+      return false;
+    Inputs.erase(Inputs.begin());
+    return true;
+  }
+#endif
+} // unnamed namespace
+
+namespace cling {
+  namespace driver {
+
+#ifdef LLVM_ON_UNIX
+    bool acceptForkJob(Interpreter& Interp, const std::string& Path,
+                       std::vector<std::string>& Inputs, int& Connection) {
+      sockaddr_un Addr;
+      if (!makeAddress(Path, Addr))
+        return false;
+      int Socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+      if (Socket < 0) {
+        printError("create a socket for", Path);
+        return false;
+      }
+      // Replace the socket of a server that is gone, not one still serving.
+      if (!::connect(Socket, (sockaddr*)&Addr, sizeof(Addr))) {
+        llvm::errs() << "cling: '" << Path << "' is already served\n";
+        return false;
+      }
+      ::close(Socket);
+      ::unlink(Path.c_str());
+      Socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+      if (Socket < 0 || ::bind(Socket, (sockaddr*)&Addr, sizeof(Addr))
+          || ::listen(Socket, SOMAXCONN)) {
+        printError("listen on", Path);
+        return false;
+      }
+
+      // Let the finished jobs be reaped.
+      ::signal(SIGCHLD, SIG_IGN);
+      ::fflush(stdout);
+      ::fflush(stderr);
+      while (true) {
+        Connection = ::accept(Socket, nullptr, nullptr);
+        if (Connection < 0) {
+          if (errno == EINTR)
+            continue;
+          printError("accept jobs on", Path);
+          return false;
+        }
+        // A pool of the JIT, e.g. of CLING_JIT_THREADS, must not be amid a
+        // job: the fork would wait for its threads forever.
+        Interp.prepareFork();
+        pid_t Pid = ::fork();
+        if (!Pid) {
+          Interp.onForked();
+          ::close(Socket);
+          // The job might wait for its own children.
+          ::signal(SIGCHLD, SIG_DFL);
+          if (!receiveJob(Connection, Inputs))
+            ::_exit(EXIT_FAILURE);
+          return true;
+        }
+        if (Pid < 0)
+          printError("fork a job of", Path);
+        ::close(Connection);
+      }
+    }
+
+    void finishForkJob(int Connection, int ExitCode) {
+      // The client then waits until the connection closes at this process'
+      // exit, i.e. for the output of the atexit functions.
+      int32_t Code = ExitCode;
+      writeAll(Connection, &Code, sizeof(Code));
+    }
+
+    int runForkClient(const std::string& Path,
+                      const std::vector<std::string>& Inputs) {
+      sockaddr_un Addr;
+      if (!makeAddress(Path, Addr))
+        return EXIT_FAILURE;
+      int Socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+      if (Socket < 0 || ::connect(Socket, (sockaddr*)&Addr, sizeof(Addr))) {
+        printError("connect to", Path);
+        return EXIT_FAILURE;
+      }
+
+      char CWD[4096];
+      if (!::getcwd(CWD, sizeof(CWD))) {
+        printError("send the working directory to", Path);
+        return EXIT_FAILURE;
+      }
+      std::string Payload(CWD);
+      for (const std::string& Input : Inputs) {
+        Payload += '\0';
+        Payload += Input;
+      }
+
+      uint32_t Size = Payload.size();
+      iovec IOV = {&Size, sizeof(Size)};
+      alignas(cmsghdr) char Control[CMSG_SPACE(3 * sizeof(int))];
+      msghdr Msg = msghdr();
+      Msg.msg_iov = &IOV;
+      Msg.msg_iovlen = 1;
+      Msg.msg_control = Control;
+      Msg.msg_controllen = sizeof(Control);
+      cmsghdr* CMsg = CMSG_FIRSTHDR(&Msg);
+      CMsg->cmsg_level = SOL_SOCKET;
+      CMsg->cmsg_type = SCM_RIGHTS;
+      CMsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+      const int FDs[3] = {0, 1, 2};
+      ::memcpy(CMSG_DATA(CMsg), FDs, sizeof(FDs));
+      if (::sendmsg(Socket, &Msg, 0) != sizeof(Size)
+          || !writeAll(Socket, Payload.data(), Payload.size())) {
+        printError("send the job to", Path);
+        return EXIT_FAILURE;
+      }
+
+      // No answer means that the job crashed.
+      int32_t ExitCode = EXIT_FAILURE;
+      if (!readAll(Socket, &ExitCode, sizeof(ExitCode)))
+        ExitCode = EXIT_FAILURE;
+      char End;
+      while (readAll(Socket, &End, 1))
+        ;
+      ::close(Socket);
+      return ExitCode;
+    }
+#else
+    bool acceptForkJob(Interpreter&, const std::string&,
+                       std::vector<std::string>&, int&) {
+      llvm::errs() << "cling: --fork-server is not supported on this "
+                      "platform\n";
+      return false;
+    }
+
+    void finishForkJob(int, int) {}
+
+    int runForkClient(const std::string&, const std::vector<std::string>&) {
+      llvm::errs() << "cling: --fork-client is not supported on this "
+                      "platform\n";
+      return EXIT_FAILURE;
+    }
+#endif
+  } // end namespace driver
+} // end namespace cling
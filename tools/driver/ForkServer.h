@@ -0,0 +1,47 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_DRIVER_FORK_SERVER_H
+#define CLING_DRIVER_FORK_SERVER_H
+
+#include <string>
+#include <vector>
+
+namespace cling {
+  class Interpreter;
+
+  namespace driver {
+    ///\brief Accepts jobs on the Unix socket Path, running each in a fork of
+    /// this process: the jobs start from Interp as initialized so far,
+    /// without paying for its construction. Only returns in a fork, or if
+    /// the socket cannot be served.
+    ///
+    ///\param[in] Interp - The interpreter, whose threads are idled before
+    ///   each fork and made anew in it, see Interpreter::prepareFork().
+    ///\param[out] Inputs - The inputs of the job.
+    ///\param[out] Connection - To pass to finishForkJob().
+    ///\returns true in the fork, which now has the client's standard streams
+    ///   and working directory; false in the server upon failure.
+    ///
+    bool acceptForkJob(Interpreter& Interp, const std::string& Path,
+                       std::vector<std::string>& Inputs, int& Connection);
+
+    ///\brief Sends the exit code of the job the fork ran to its client.
+    void finishForkJob(int Connection, int ExitCode);
+
+    ///\brief Runs Inputs as a job of the fork server at Path, passing it
+    /// this process' standard streams.
+    ///
+    ///\returns The exit code of the job, or EXIT_FAILURE if it crashed.
+    ///
+    int runForkClient(const std::string& Path,
+                      const std::vector<std::string>& Inputs);
+  } // end namespace driver
+} // end namespace cling
+
+#endif // CLING_DRIVER_FORK_SERVER_H
@@ -0,0 +1,129 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "StdinBatch.h"
+
+#include "cling/Interpreter/Interpreter.h"
+#include "cling/MetaProcessor/InputValidator.h"
+#include "cling/MetaProcessor/MetaProcessor.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+  ///\brief The size of the blocks read from stdin.
+  static const size_t kBlockSize = 1024 * 1024;
+
+  ///\brief A batch is compiled once it has this many constructs, or bytes.
+  static const size_t kBatchInputs = 1024;
+  static const size_t kBatchBytes = 4 * 1024 * 1024;
+
+  class StdinBatch {
+    cling::Interpreter& m_Interp;
+    cling::MetaProcessor& m_MP;
+    cling::InputValidator m_Validator;
+    ///\brief Whether m_Validator has collected part of a construct.
+    bool m_InConstruct = false;
+    std::vector<std::string> m_Batch;
+    size_t m_BatchBytes = 0;
+
+  public:
+    StdinBatch(cling::Interpreter& Interp, cling::MetaProcessor& MP):
+      m_Interp(Interp), m_MP(MP) {}
+
+    void flush() {
+      if (m_Batch.empty())
+        return;
+      m_Interp.processBatch(m_Batch);
+      m_Batch.clear();
+      m_BatchBytes = 0;
+    }
+
+    ///\brief Takes the next line, without its newline.
+    ///\returns false if it asked to quit.
+    bool addLine(const std::string& Line) {
+      const llvm::StringRef Trimmed = llvm::StringRef(Line).ltrim();
+      if (!m_InConstruct && !m_Validator.inBlockComment()) {
+        if (Trimmed.empty())
+          return true;
+        if (Trimmed.front() == '.') {
+          // Meta commands see, and can change, what came before them.
+          flush();
+          cling::Interpreter::CompilationResult Result;
+          return m_MP.process(Line, Result) != -1;
+        }
+      }
+
+      m_InConstruct = true;
+      if (m_Validator.validate(Line) == cling::InputValidator::kIncomplete)
+        return true;
+      m_Batch.emplace_back();
+      m_Validator.reset(&m_Batch.back());
+      m_InConstruct = false;
+      m_BatchBytes += m_Batch.back().size();
+      if (m_Batch.size() >= kBatchInputs || m_BatchBytes >= kBatchBytes)
+        flush();
+      return true;
+    }
+
+    ///\brief The input ended: an incomplete construct still gets compiled,
+    /// as by the prompt, for the diagnostics.
+    void finish() {
+      if (m_InConstruct) {
+        m_Batch.emplace_back();
+        m_Validator.reset(&m_Batch.back());
+        m_InConstruct = false;
+      }
+      flush();
+    }
+  };
+} // unnamed namespace
+
+namespace cling {
+  namespace driver {
+    void runStdinBatch(Interpreter& Interp, MetaProcessor& MP) {
+      StdinBatch Batch(Interp, MP);
+      std::vector<char> Block(kBlockSize);
+      // The start of a line that continues in the next block.
+      std::string Line;
+      bool Quit = false;
+      while (!Quit) {
+        const size_t Read = std::fread(Block.data(), 1, Block.size(), stdin);
+        if (!Read)
+          break;
+        const char* Cur = Block.data();
+        const char* End = Cur + Read;
+        while (!Quit && Cur != End) {
+          const char* NL = static_cast<const char*>(
+              std::memchr(Cur, '\n', End - Cur));
+          if (!NL) {
+            Line.append(Cur, End);
+            break;
+          }
+          Line.append(Cur, NL);
+          if (!Line.empty() && Line.back() == '\r')
+            Line.pop_back();
+          Quit = !Batch.addLine(Line);
+          Line.clear();
+          Cur = NL + 1;
+        }
+      }
+      if (std::ferror(stdin))
+        llvm::errs() << "cling: error reading stdin\n";
+      if (!Quit && !Line.empty())
+        Quit = !Batch.addLine(Line);
+      if (!Quit)
+        Batch.finish();
+    }
+  } // end namespace driver
+} // end namespace cling
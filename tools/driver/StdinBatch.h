@@ -0,0 +1,27 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_DRIVER_STDIN_BATCH_H
+#define CLING_DRIVER_STDIN_BATCH_H
+
+namespace cling {
+  class Interpreter;
+  class MetaProcessor;
+
+  namespace driver {
+    ///\brief Runs stdin without prompts: it is read in large blocks, split
+    /// into complete top-level constructs the way the prompt splits it, and
+    /// those are compiled in batches through Interpreter::processBatch().
+    /// Meta commands end the current batch and run on their own, through
+    /// MetaProcessor; .q stops reading.
+    ///
+    void runStdinBatch(Interpreter& Interp, MetaProcessor& MP);
+  } // end namespace driver
+} // end namespace cling
+
+#endif // CLING_DRIVER_STDIN_BATCH_H
@@ -0,0 +1,83 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "WarmCache.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace cling {
+  namespace driver {
+    bool readWarmCacheManifest(int argc, const char* const* argv,
+                               std::vector<std::string>& Args,
+                               std::vector<std::string>& Files,
+                               bool& Requested) {
+      llvm::StringRef Manifest;
+      Requested = false;
+      for (int I = 1; I < argc; ++I) {
+        const llvm::StringRef Arg(argv[I]);
+        if (Arg == "--warm-cache") {
+          if (I + 1 == argc) {
+            llvm::errs() << "cling: --warm-cache needs a manifest\n";
+            Requested = true;
+            return false;
+          }
+          Manifest = argv[++I];
+        }
+        else if (Arg.startswith("--warm-cache="))
+          Manifest = Arg.substr(sizeof("--warm-cache=") - 1);
+        else
+          continue;
+        Requested = true;
+      }
+      if (!Requested)
+        return true;
+
+      auto Buffer = llvm::MemoryBuffer::getFile(Manifest);
+      if (!Buffer) {
+        llvm::errs() << "cling: cannot read the manifest '" << Manifest
+                     << "': " << Buffer.getError().message() << '\n';
+        return false;
+      }
+
+      const llvm::StringRef Dir = llvm::sys::path::parent_path(Manifest);
+      llvm::SmallVector<llvm::StringRef, 64> Lines;
+      (*Buffer)->getBuffer().split(Lines, '\n', -1, false);
+      for (llvm::StringRef Line : Lines) {
+        Line = Line.trim();
+        if (Line.empty() || Line.startswith("#"))
+          continue;
+        if (Line.startswith("-")) {
+          // "-I dir" has its value on the same line.
+          llvm::BumpPtrAllocator Alloc;
+          llvm::StringSaver Saver(Alloc);
+          llvm::SmallVector<const char*, 4> Tokens;
+          llvm::cl::TokenizeGNUCommandLine(Line, Saver, Tokens);
+          Args.insert(Args.end(), Tokens.begin(), Tokens.end());
+          continue;
+        }
+        llvm::SmallString<256> Path(Dir);
+        llvm::sys::path::append(Path, Line);
+        if (!Dir.empty() && llvm::sys::path::is_relative(Line)
+            && llvm::sys::fs::exists(Path))
+          Files.push_back(Path.str().str());
+        else
+          Files.push_back(Line.str());
+      }
+      return true;
+    }
+  } // end namespace driver
+} // end namespace cling
@@ -0,0 +1,36 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_DRIVER_WARM_CACHE_H
+#define CLING_DRIVER_WARM_CACHE_H
+
+#include <string>
+#include <vector>
+
+namespace cling {
+  namespace driver {
+    ///\brief Reads the manifest of --warm-cache, if argv has one; read before
+    /// the interpreter is created, which needs its compiler options. Each
+    /// line of the manifest is a header, script or library to compile into
+    /// the caches, see Interpreter::warmCaches(), or compiler options if it
+    /// starts with '-'. Empty lines and those starting with '#' are skipped;
+    /// relative paths are looked up next to the manifest first.
+    ///
+    ///\param[out] Args - The compiler options of the manifest.
+    ///\param[out] Files - The files of the manifest.
+    ///\param[out] Requested - Whether argv has --warm-cache.
+    ///\returns false if the manifest cannot be read, which is reported.
+    ///
+    bool readWarmCacheManifest(int argc, const char* const* argv,
+                               std::vector<std::string>& Args,
+                               std::vector<std::string>& Files,
+                               bool& Requested);
+  } // end namespace driver
+} // end namespace cling
+
+#endif // CLING_DRIVER_WARM_CACHE_H
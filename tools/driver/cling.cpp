@@ -11,14 +11,22 @@
 #include "cling/MetaProcessor/MetaProcessor.h"
 #include "cling/UserInterface/UserInterface.h"
 
+#include "BatchJobs.h"
+#include "ForkServer.h"
+#include "StdinBatch.h"
+#include "WarmCache.h"
+
 #include "clang/Basic/LangOptions.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/FrontendTool/Utils.h"
 
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Process.h"
 #include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/raw_ostream.h"
 
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -51,6 +59,31 @@ static int checkDiagErrors(clang::CompilerInstance* CI, unsigned* OutErrs = 0) {
   return Errs ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
+// Parse the files or run the lines of code in Inputs.
+static void processInputs(cling::Interpreter& Interp, cling::UserInterface& Ui,
+                          const std::vector<std::string>& Inputs) {
+  for (const std::string &Input : Inputs) {
+    std::string Cmd;
+    cling::Interpreter::CompilationResult Result;
+    const std::string Filepath = Interp.lookupFileOrLibrary(Input);
+    if (!Filepath.empty()) {
+      std::ifstream File(Filepath);
+      std::string Line;
+      std::getline(File, Line);
+      if (Line[0] == '#' && Line[1] == '!') {
+        // TODO: Check whether the filename specified after #! is the current
+        // executable.
+        while (std::getline(File, Line)) {
+          Ui.getMetaProcessor()->process(Line, Result, 0);
+        }
+        continue;
+      }
+      Cmd += ".x ";
+    }
+    Cmd += Input;
+    Ui.getMetaProcessor()->process(Cmd, Result, 0);
+  }
+}
 
 int main( int argc, char **argv ) {
 
@@ -75,8 +108,26 @@ int main( int argc, char **argv ) {
   }
 #endif
 
+  // A job for a fork server; parsed here, as it is not worth an interpreter.
+  static const char ForkClient[] = "--fork-client=";
+  if (argc > 1 && !::strncmp(argv[1], ForkClient, sizeof(ForkClient) - 1))
+    return cling::driver::runForkClient(
+      argv[1] + sizeof(ForkClient) - 1,
+      std::vector<std::string>(argv + 2, argv + argc));
+
+  // The compiler options of a --warm-cache manifest go after the others.
+  std::vector<std::string> WarmCacheArgs, WarmCacheFiles;
+  bool WarmCache = false;
+  if (!cling::driver::readWarmCacheManifest(argc, argv, WarmCacheArgs,
+                                            WarmCacheFiles, WarmCache))
+    return EXIT_FAILURE;
+  std::vector<const char*> Argv(argv, argv + argc);
+  for (const std::string& Arg : WarmCacheArgs)
+    Argv.push_back(Arg.c_str());
+  Argv.push_back(nullptr);
+
   // Set up the interpreter
-  cling::Interpreter Interp(argc, argv);
+  cling::Interpreter Interp(Argv.size() - 1, Argv.data());
   const cling::InvocationOptions& Opts = Interp.getOptions();
 
   if (!Interp.isValid()) {
@@ -102,34 +153,58 @@ int main( int argc, char **argv ) {
 
   Interp.AddIncludePath(".");
 
-  for (const std::string& Lib : Opts.LibsToLoad)
-    Interp.loadFile(Lib);
+  if (WarmCache) {
+    // Nothing runs: the -l libraries get indexed, the inputs compiled.
+    WarmCacheFiles.insert(WarmCacheFiles.end(), Opts.LibsToLoad.begin(),
+                          Opts.LibsToLoad.end());
+    WarmCacheFiles.insert(WarmCacheFiles.end(), Opts.Inputs.begin(),
+                          Opts.Inputs.end());
+    return Interp.warmCaches(WarmCacheFiles) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  if (!Opts.AutoloadMapFile.empty())
+    return Interp.GenerateAutoLoadingMaps(Opts.Inputs, Opts.AutoloadMapFile,
+                                          Opts.AutoloadMapJobs)
+             ? EXIT_SUCCESS : EXIT_FAILURE;
+
+  Interp.loadFiles(Opts.LibsToLoad);
 
   cling::UserInterface Ui(Interp);
-  // If we are not interactive we're supposed to parse files
-  if (!Opts.IsInteractive()) {
-    for (const std::string &Input : Opts.Inputs) {
-      std::string Cmd;
-      cling::Interpreter::CompilationResult Result;
-      const std::string Filepath = Interp.lookupFileOrLibrary(Input);
-      if (!Filepath.empty()) {
-        std::ifstream File(Filepath);
-        std::string Line;
-        std::getline(File, Line);
-        if (Line[0] == '#' && Line[1] == '!') {
-          // TODO: Check whether the filename specified after #! is the current
-          // executable.
-          while (std::getline(File, Line)) {
-            Ui.getMetaProcessor()->process(Line, Result, 0);
-          }
-          continue;
-        }
-        Cmd += ".x ";
-      }
-      Cmd += Input;
-      Ui.getMetaProcessor()->process(Cmd, Result, 0);
+  std::vector<std::string> Inputs = Opts.Inputs;
+  int ForkJobConnection = -1;
+  if (!Opts.ForkServerSocket.empty()) {
+    // The inputs are the prelude of all jobs; from here on, this is a fork
+    // running a job.
+    processInputs(Interp, Ui, Inputs);
+    Inputs.clear();
+    // Its errors are reported once, by the server, not by every job.
+    clang::DiagnosticConsumer* Diags
+      = Interp.getCI()->getDiagnostics().getClient();
+    if (const unsigned Errs = Diags->getNumErrors()) {
+      llvm::errs() << "cling: the prelude of the fork server had " << Errs
+                   << (Errs == 1 ? " error\n" : " errors\n");
+      Diags->clear();
     }
+    if (!cling::driver::acceptForkJob(Interp, Opts.ForkServerSocket, Inputs,
+                                      ForkJobConnection))
+      return EXIT_FAILURE;
   }
+
+  if (Opts.Jobs != 1 && Inputs.size() > 1) {
+    // From here on, this is a fork running one of the inputs.
+    std::string Input;
+    int ExitCode = EXIT_SUCCESS;
+    if (!cling::driver::forkBatchJobs(Interp, Opts.Jobs, Inputs, Input,
+                                      ExitCode))
+      return ExitCode;
+    Inputs.assign(1, Input);
+  }
+
+  // If we are not interactive we're supposed to parse files
+  if (!Inputs.empty() && !(Inputs.size() == 1 && Inputs[0] == "-"))
+    processInputs(Interp, Ui, Inputs);
+  else if (Opts.BatchStdin && !llvm::sys::Process::StandardInIsUserInput())
+    cling::driver::runStdinBatch(Interp, *Ui.getMetaProcessor());
   else {
     Ui.runInteractively(Opts.NoLogo);
   }
@@ -138,5 +213,13 @@ int main( int argc, char **argv ) {
   ::fflush(stdout);
   ::fflush(stderr);
 
-  return checkDiagErrors(Interp.getCI());
+  const int ExitCode = checkDiagErrors(Interp.getCI());
+  if (ForkJobConnection != -1)
+    cling::driver::finishForkJob(ForkJobConnection, ExitCode);
+  if (Opts.FastExit) {
+    // The redirected output must reach its files before the process ends.
+    Ui.getMetaProcessor()->resetStdStreams();
+    Interp.fastExit(ExitCode);
+  }
+  return ExitCode;
 }
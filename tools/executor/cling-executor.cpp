@@ -0,0 +1,175 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ExecutionEngine/Orc/OrcABISupport.h>
+#include <llvm/ExecutionEngine/Orc/OrcRemoteTargetServer.h>
+#include <llvm/ExecutionEngine/Orc/RawByteChannel.h>
+#include <llvm/ExecutionEngine/RTDyldMemoryManager.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace llvm;
+
+namespace {
+#if defined(__x86_64__) || defined(_M_X64)
+  typedef orc::OrcX86_64_SysV HostOrcArch;
+#else
+  typedef orc::OrcGenericABI HostOrcArch;
+#endif
+
+  ///\brief The RPC channel to the interpreter, over a pipe or a socket.
+  class FDChannel final: public orc::rpc::RawByteChannel {
+    int m_InFD;
+    int m_OutFD;
+
+  public:
+    FDChannel(int InFD, int OutFD): m_InFD(InFD), m_OutFD(OutFD) {}
+
+    Error readBytes(char* Dst, unsigned Size) override {
+      for (unsigned Done = 0; Done < Size;) {
+        ssize_t Read = ::read(m_InFD, Dst + Done, Size - Done);
+        if (Read <= 0) {
+          if (Read && (errno == EINTR || errno == EAGAIN))
+            continue;
+          if (!Read)
+            return errorCodeToError(make_error_code(std::errc::broken_pipe));
+          return errorCodeToError(std::error_code(errno,
+                                                  std::generic_category()));
+        }
+        Done += Read;
+      }
+      return Error::success();
+    }
+
+    Error appendBytes(const char* Src, unsigned Size) override {
+      for (unsigned Done = 0; Done < Size;) {
+        ssize_t Written = ::write(m_OutFD, Src + Done, Size - Done);
+        if (Written < 0) {
+          if (errno == EINTR || errno == EAGAIN)
+            continue;
+          return errorCodeToError(std::error_code(errno,
+                                                  std::generic_category()));
+        }
+        Done += Written;
+      }
+      return Error::success();
+    }
+
+    Error send() override { return Error::success(); }
+  };
+
+  ///\brief Serves one interpreter until it ends the session.
+  static int serve(int InFD, int OutFD) {
+    ExitOnError ExitOnErr("cling-executor: ");
+    auto SymbolLookup = [](const std::string& Name) {
+      return RTDyldMemoryManager::getSymbolAddressInProcess(Name);
+    };
+    auto RegisterEHFrames = [](uint8_t* Addr, uint32_t Size) {
+      RTDyldMemoryManager::registerEHFramesInProcess(Addr, Size);
+    };
+    auto DeregisterEHFrames = [](uint8_t* Addr, uint32_t Size) {
+      RTDyldMemoryManager::deregisterEHFramesInProcess(Addr, Size);
+    };
+
+    FDChannel Channel(InFD, OutFD);
+    orc::remote::OrcRemoteTargetServer<FDChannel, HostOrcArch>
+      Server(Channel, SymbolLookup, RegisterEHFrames, DeregisterEHFrames);
+    while (!Server.receivedTerminate())
+      ExitOnErr(Server.handleOne());
+    return 0;
+  }
+
+  ///\brief Accepts interpreters on Port, each served by a child process:
+  /// a crash of the code does not affect the other sessions.
+  static int listenOn(unsigned Port) {
+    int Socket = ::socket(AF_INET, SOCK_STREAM, 0);
+    int On = 1;
+    ::setsockopt(Socket, SOL_SOCKET, SO_REUSEADDR, &On, sizeof(On));
+    sockaddr_in Addr = {};
+    Addr.sin_family = AF_INET;
+    Addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    Addr.sin_port = htons(Port);
+    if (Socket < 0
+        || ::bind(Socket, (sockaddr*)&Addr, sizeof(Addr)) < 0
+        || ::listen(Socket, 4) < 0) {
+      errs() << "cling-executor: cannot listen on port " << Port << ": "
+             << std::error_code(errno, std::generic_category()).message()
+             << '\n';
+      return 1;
+    }
+    // Let the children of finished sessions be reaped.
+    ::signal(SIGCHLD, SIG_IGN);
+    while (true) {
+      int Connection = ::accept(Socket, nullptr, nullptr);
+      if (Connection < 0) {
+        if (errno == EINTR)
+          continue;
+        return 1;
+      }
+      if (!::fork()) {
+        ::close(Socket);
+        return serve(Connection, Connection);
+      }
+      ::close(Connection);
+    }
+  }
+} // unnamed namespace
+
+int main(int argc, char** argv) {
+  std::vector<StringRef> Args(argv + 1, argv + argc);
+  unsigned Port = 0;
+  if (!Args.empty() && Args.front().consume_front("--listen=")) {
+    if (Args.front().getAsInteger(10, Port) || !Port) {
+      errs() << "cling-executor: invalid port '" << Args.front() << "'\n";
+      return 1;
+    }
+    Args.erase(Args.begin());
+  } else if (Args.size() < 2) {
+    errs() << "usage: cling-executor <in-fd> <out-fd> [library...]\n"
+              "       cling-executor --listen=<port> [library...]\n";
+    return 1;
+  }
+
+  int InFD = -1, OutFD = -1;
+  if (!Port) {
+    InFD = std::atoi(Args[0].data());
+    OutFD = std::atoi(Args[1].data());
+    Args.erase(Args.begin(), Args.begin() + 2);
+  }
+
+  // The code resolves to the symbols of this process and its libraries.
+  sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+  for (StringRef Library : Args) {
+    std::string Err;
+    if (sys::DynamicLibrary::LoadLibraryPermanently(Library.data(), &Err)) {
+      errs() << "cling-executor: cannot load '" << Library << "': " << Err
+             << '\n';
+      return 1;
+    }
+  }
+
+  if (Port)
+    return listenOn(Port);
+  int Ret = serve(InFD, OutFD);
+  ::close(InFD);
+  ::close(OutFD);
+  return Ret;
+}
@@ -0,0 +1,214 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include <cling/Interpreter/CIFactory.h>
+#include <cling/Interpreter/Interpreter.h>
+
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Lex/HeaderSearch.h>
+#include <clang/Lex/Preprocessor.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+  ///\brief The modules of the modulemaps cling ships, but boost's: there
+  /// are too many to build them all; name those that are used instead.
+  static const char* const kDefaultModules[] = {
+#ifdef _WIN32
+    "vcruntime", "services",
+#endif
+    "libc", "std", "tinyxml2", "cuda", "Vc"
+  };
+
+  ///\brief Exit codes of the process building one module.
+  enum BuildResult { kBuilt = 0, kFailed = 1, kNotFound = 2 };
+
+  ///\brief Imports the module Name, which makes clang build its PCM into
+  /// the module cache path that is part of Args.
+  static int buildModule(llvm::StringRef Name,
+                         const std::vector<const char*>& Args) {
+    cling::Interpreter Interp(Args.size(), Args.data(), LLVMDIR);
+    if (!Interp.isValid())
+      return kFailed;
+    clang::HeaderSearch& HS
+      = Interp.getCI()->getPreprocessor().getHeaderSearchInfo();
+    if (!HS.lookupModule(Name, /*AllowSearch*/true, /*AllowExtraSearch*/true))
+      return kNotFound;
+    return Interp.loadModule(Name) ? kBuilt : kFailed;
+  }
+
+  struct Job {
+    std::string Module;
+    llvm::sys::ProcessInfo Process;
+  };
+} // unnamed namespace
+
+int main(int argc, const char* const* argv) {
+  std::string OutDir;
+  unsigned Jobs = std::thread::hardware_concurrency();
+  bool Check = false;
+  std::string BuildOne;
+  std::vector<std::string> Modules;
+  // The interpreter gets argv[0] and everything after "--".
+  std::vector<const char*> InterpArgs(1, argv[0]);
+  for (int I = 1; I < argc; ++I) {
+    llvm::StringRef Arg(argv[I]);
+    if (Arg == "--") {
+      InterpArgs.insert(InterpArgs.end(), argv + I + 1, argv + argc);
+      break;
+    }
+    if (Arg == "-o" && I + 1 < argc)
+      OutDir = argv[++I];
+    else if (Arg.startswith("-j")) {
+      if (Arg.substr(2).getAsInteger(10, Jobs) || !Jobs) {
+        llvm::errs() << "cling-prebuild-modules: invalid " << Arg << '\n';
+        return 1;
+      }
+    } else if (Arg == "--check")
+      Check = true;
+    else if (Arg.startswith("--build-one="))
+      BuildOne = Arg.substr(12);
+    else if (!Arg.startswith("-"))
+      Modules.push_back(Arg);
+    else {
+      llvm::errs() << "usage: cling-prebuild-modules -o <dir> [-j<n>] "
+                      "[--check] [<module>...] [-- <cling args>]\n";
+      return 1;
+    }
+  }
+  if (OutDir.empty()) {
+    llvm::errs() << "cling-prebuild-modules: no output directory, use -o\n";
+    return 1;
+  }
+
+  llvm::SmallString<256> AbsOutDir(OutDir);
+  llvm::sys::fs::make_absolute(AbsOutDir);
+  const std::string CacheArg = "-fmodules-cache-path=" + AbsOutDir.str().str();
+  InterpArgs.push_back("-fmodules");
+  InterpArgs.push_back(CacheArg.c_str());
+
+  if (!BuildOne.empty())
+    return buildModule(BuildOne, InterpArgs);
+
+  if (Check) {
+    std::string Stamp;
+    if (!cling::CIFactory::readPrebuiltModulesStamp(AbsOutDir, Stamp))
+      return 1;
+    cling::Interpreter Interp(InterpArgs.size(), InterpArgs.data(), LLVMDIR);
+    return Stamp == cling::CIFactory::getPrebuiltModulesFingerprint(
+                      *Interp.getCI()) ? 0 : 1;
+  }
+
+  if (!Jobs)
+    Jobs = 1;
+  if (Modules.empty())
+    Modules.assign(std::begin(kDefaultModules), std::end(kDefaultModules));
+
+  if (std::error_code EC = llvm::sys::fs::create_directories(AbsOutDir)) {
+    llvm::errs() << "cling-prebuild-modules: cannot create " << AbsOutDir
+                 << ": " << EC.message() << '\n';
+    return 1;
+  }
+  // Modules of different versions must not pass as up to date.
+  llvm::SmallString<256> StampFile(AbsOutDir);
+  llvm::sys::path::append(StampFile,
+                          cling::CIFactory::PrebuiltModulesStampName);
+  llvm::sys::fs::remove(StampFile);
+
+  // Build each module in a process of its own; clang's lock files make
+  // those sharing a dependency wait for each other instead of building it
+  // twice.
+  const std::string Self
+    = llvm::sys::fs::getMainExecutable(argv[0], (void*)&buildModule);
+  std::vector<Job> Running;
+  std::vector<std::string> Built;
+  size_t Next = 0;
+  bool Failed = false;
+  while (Next < Modules.size() || !Running.empty()) {
+    while (Next < Modules.size() && Running.size() < Jobs) {
+      const std::string& Module = Modules[Next++];
+      std::vector<llvm::StringRef> ChildArgs;
+      const std::string BuildOneArg = "--build-one=" + Module;
+      ChildArgs.push_back(Self);
+      ChildArgs.push_back(BuildOneArg);
+      ChildArgs.push_back("-o");
+      ChildArgs.push_back(AbsOutDir);
+      ChildArgs.push_back("--");
+      // Skip argv[0] and the module flags added above.
+      for (size_t I = 1; I + 2 < InterpArgs.size(); ++I)
+        ChildArgs.push_back(InterpArgs[I]);
+      std::string ErrMsg;
+      llvm::sys::ProcessInfo PI
+        = llvm::sys::ExecuteNoWait(Self, ChildArgs, llvm::None, {}, 0,
+                                   &ErrMsg);
+      if (!PI.Pid) {
+        llvm::errs() << "cling-prebuild-modules: cannot build " << Module
+                     << ": " << ErrMsg << '\n';
+        Failed = true;
+        continue;
+      }
+      Running.push_back(Job{Module, PI});
+    }
+
+    for (auto I = Running.begin(); I != Running.end();) {
+      llvm::sys::ProcessInfo Done
+        = llvm::sys::Wait(I->Process, 0, /*WaitUntilTerminates*/false);
+      if (!Done.Pid) {
+        ++I;
+        continue;
+      }
+      switch (Done.ReturnCode) {
+        case kBuilt:
+          llvm::outs() << "built " << I->Module << '\n';
+          Built.push_back(I->Module);
+          break;
+        case kNotFound:
+          llvm::outs() << "skipped " << I->Module << ": no such module\n";
+          break;
+        default:
+          llvm::errs() << "failed to build " << I->Module << '\n';
+          Failed = true;
+      }
+      I = Running.erase(I);
+    }
+    if (!Running.empty())
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  if (Failed)
+    return 1;
+
+  cling::Interpreter Interp(InterpArgs.size(), InterpArgs.data(), LLVMDIR);
+  if (!Interp.isValid()
+      || !cling::CIFactory::writePrebuiltModulesStamp(
+           AbsOutDir,
+           cling::CIFactory::getPrebuiltModulesFingerprint(*Interp.getCI()))) {
+    llvm::errs() << "cling-prebuild-modules: cannot write " << StampFile
+                 << '\n';
+    return 1;
+  }
+
+  // Which module declares what, for CLING_LAZY_MODULE_IMPORT.
+  for (const std::string& Module : Built)
+    Interp.loadModule(Module, /*complain*/ false);
+  llvm::SmallString<256> IndexFile(AbsOutDir);
+  llvm::sys::path::append(IndexFile,
+                          cling::CIFactory::PrebuiltModuleIndexName);
+  if (!Interp.writeModuleIndex(IndexFile))
+    return 1;
+  return 0;
+}